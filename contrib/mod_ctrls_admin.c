@@ -1226,6 +1226,108 @@ static int admin_addr_status(pr_ctrls_t *ctrl, const pr_netaddr_t *addr,
   return 0;
 }
 
+static const char *ctrls_stats_phase_name(int phase) {
+  switch (phase) {
+    case 0:
+      return "ALL";
+
+    case PRE_CMD:
+      return "PRE_CMD";
+
+    case CMD:
+      return "CMD";
+
+    case POST_CMD:
+      return "POST_CMD";
+
+    case POST_CMD_ERR:
+      return "POST_CMD_ERR";
+
+    case LOG_CMD:
+      return "LOG_CMD";
+
+    case LOG_CMD_ERR:
+      return "LOG_CMD_ERR";
+  }
+
+  return "OTHER";
+}
+
+static int ctrls_stats_cb(const char *module_name, const char *cmd_name,
+    int phase, const pr_stats_histo_t *histo, void *user_data) {
+  pr_ctrls_t *ctrl = user_data;
+  char name[128];
+
+  if (module_name != NULL) {
+    pr_snprintf(name, sizeof(name), "mod_%s.c:%s", module_name, cmd_name);
+
+  } else {
+    sstrncpy(name, cmd_name, sizeof(name));
+  }
+
+  pr_ctrls_add_response(ctrl,
+    "%-32s %-12s count %lu avg %lu p50 %lu p90 %lu p99 %lu max %lu usecs",
+    name, ctrls_stats_phase_name(phase), (unsigned long) histo->count,
+    (unsigned long) (histo->total_usecs / histo->count),
+    (unsigned long) pr_stats_histo_get_percentile(histo, 50),
+    (unsigned long) pr_stats_histo_get_percentile(histo, 90),
+    (unsigned long) pr_stats_histo_get_percentile(histo, 99),
+    (unsigned long) histo->max_usecs);
+  return 0;
+}
+
+static int ctrls_handle_stats(pr_ctrls_t *ctrl, int reqargc,
+    char **reqargv) {
+
+  /* Check the stats ACL */
+  if (!pr_ctrls_check_acl(ctrl, ctrls_admin_acttab, "stats")) {
+
+    /* Access denied */
+    pr_ctrls_add_response(ctrl, "access denied");
+    return -1;
+  }
+
+  /* Be pedantic */
+  if (reqargc > 1) {
+    pr_ctrls_add_response(ctrl, "wrong number of parameters");
+    return -1;
+  }
+
+  if (!pr_stats_enabled()) {
+    pr_ctrls_add_response(ctrl, "latency statistics not available");
+    return -1;
+  }
+
+  if (reqargc == 1) {
+    if (strcmp(reqargv[0], "reset") != 0) {
+      pr_ctrls_add_response(ctrl, "unsupported parameter '%s'", reqargv[0]);
+      return -1;
+    }
+
+    if (pr_stats_reset() < 0) {
+      pr_ctrls_add_response(ctrl, "error resetting statistics: %s",
+        strerror(errno));
+      return -1;
+    }
+
+    pr_ctrls_add_response(ctrl, "statistics reset");
+    return 0;
+  }
+
+  if (pr_stats_walk(ctrls_stats_cb, ctrl) < 0) {
+    pr_ctrls_add_response(ctrl, "error reading statistics: %s",
+      strerror(errno));
+    return -1;
+  }
+
+  if (ctrl->ctrls_cb_resps == NULL ||
+      ctrl->ctrls_cb_resps->nelts == 0) {
+    pr_ctrls_add_response(ctrl, "no latencies recorded");
+  }
+
+  return 0;
+}
+
 static int ctrls_handle_status(pr_ctrls_t *ctrl, int reqargc,
     char **reqargv) {
   register int i = 0;
@@ -1714,6 +1816,8 @@ static ctrls_acttab_t ctrls_admin_acttab[] = {
     ctrls_handle_scoreboard },
   { "shutdown", "shutdown the daemon",	NULL,
     ctrls_handle_shutdown },
+  { "stats",	"display/reset command latency statistics",	NULL,
+    ctrls_handle_stats },
   { "status",	"display status of servers",		NULL,
     ctrls_handle_status },
   { "trace",	"set trace levels",		NULL,
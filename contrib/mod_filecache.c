@@ -0,0 +1,1575 @@
+/*
+ * ProFTPD: mod_filecache -- a module implementing a shared cache of the
+ *                           contents of small, frequently read files
+ * Copyright (c) 2026 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ *
+ * This is mod_filecache, contrib software for proftpd 1.3.x.
+ */
+
+#include "conf.h"
+#include "privs.h"
+#ifdef PR_USE_CTRLS
+# include "mod_ctrls.h"
+#endif /* PR_USE_CTRLS */
+
+#if HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+
+#define MOD_FILECACHE_VERSION			"mod_filecache/0.1"
+
+/* Make sure the version of proftpd is as necessary. */
+#if PROFTPD_VERSION_NUMBER < 0x0001030701
+# error "ProFTPD 1.3.7rc1 or later required"
+#endif
+
+#ifndef MAP_FAILED
+# define MAP_FAILED     ((void *) -1)
+#endif
+
+#define FILECACHE_DEFAULT_CAPACITY	512
+#define FILECACHE_DEFAULT_MAX_FILE_SIZE	(32 * 1024)
+
+/* A file's device and inode numbers are hashed, and that hash % nrows
+ * indicates the row index.  Each row has this many columns; when all of
+ * the columns of a row are in use, the least recently used one is evicted.
+ */
+#define FILECACHE_COLS_PER_ROW		8
+
+/* Max number of lock attempts */
+#define FILECACHE_MAX_LOCK_ATTEMPTS	10
+
+/* Max number of attempts for reading an entry which is being changed */
+#define FILECACHE_MAX_READ_ATTEMPTS	10
+
+#if defined(__GNUC__)
+# define FILECACHE_BARRIER()		__sync_synchronize()
+# define FILECACHE_ATOMIC_ADD(v, n)	__sync_fetch_and_add(&(v), (n))
+#else
+# define FILECACHE_BARRIER()
+/* Without atomic operations, concurrent values may occasionally collide. */
+# define FILECACHE_ATOMIC_ADD(v, n)	(((v) += (n)) - (n))
+#endif
+
+/* From src/main.c */
+extern pid_t mpid;
+
+module filecache_module;
+
+#ifdef PR_USE_CTRLS
+static ctrls_acttab_t filecache_acttab[];
+#endif
+
+/* Pool for this module's use */
+static pool *filecache_pool = NULL;
+
+/*  Storage structure:
+ *
+ *    Header (struct filecache_stats)
+ *    Entries: capacity * struct filecache_entry
+ *    Data: capacity * FileCacheMaxFileSize bytes
+ *
+ *  Entry i holds its file contents in the i'th data slot.  Session processes
+ *  read entries without locking: an entry's generation number is odd while
+ *  the entry is being changed, and readers retry (or skip the entry) if the
+ *  generation number changes while they are copying it.  Changes to the
+ *  entries of a row are made while holding the row's write lock on the
+ *  FileCacheTable.
+ */
+struct filecache_stats {
+  uint32_t fcs_count;
+  uint32_t fcs_highest;
+  uint32_t fcs_hits;
+  uint32_t fcs_misses;
+  uint32_t fcs_stale;
+  uint32_t fcs_evictions;
+  uint64_t fcs_hit_bytes;
+
+  /* Ticks on every lookup; used for LRU ordering of the entries. */
+  uint64_t fcs_clock;
+};
+
+struct filecache_entry {
+  uint32_t fce_gen;
+  uint32_t fce_hash;
+  dev_t fce_dev;
+  ino_t fce_ino;
+  off_t fce_size;
+  time_t fce_mtime;
+  time_t fce_ctime;
+  time_t fce_ts;
+  uint64_t fce_used;
+  uint32_t fce_hits;
+  char fce_path[PR_TUNABLE_PATH_MAX+1];
+};
+
+/* The state of a file handle whose reads are served from its cached
+ * contents.
+ */
+struct filecache_fh {
+  char *data;
+  size_t datalen;
+  off_t offset;
+};
+
+static int filecache_engine = FALSE;
+static unsigned int filecache_capacity = FILECACHE_DEFAULT_CAPACITY;
+static size_t filecache_max_filesz = FILECACHE_DEFAULT_MAX_FILE_SIZE;
+static unsigned int filecache_nrows = 0;
+
+static char *filecache_table_path = NULL;
+static pr_fh_t *filecache_tabfh = NULL;
+
+static void *filecache_table = NULL;
+static size_t filecache_tablesz = 0;
+static struct filecache_stats *filecache_table_stats = NULL;
+static struct filecache_entry *filecache_table_entries = NULL;
+static char *filecache_table_data = NULL;
+
+static pr_fs_t *filecache_fs = NULL;
+
+static const char *trace_channel = "filecache";
+
+static int filecache_sess_init(void);
+
+static void *filecache_get_shm(pr_fh_t *tabfh, size_t datasz) {
+  void *data;
+  int fd, mmap_flags, res, xerrno;
+
+  fd = tabfh->fh_fd;
+
+  /* Truncate the table first; any existing data should be deleted. */
+  res = ftruncate(fd, 0);
+  if (res < 0) {
+    xerrno = errno;
+
+    pr_log_debug(DEBUG0, MOD_FILECACHE_VERSION
+      ": error truncating FileCacheTable '%s' to size 0: %s", tabfh->fh_path,
+      strerror(xerrno));
+
+    errno = xerrno;
+    return NULL;
+  }
+
+  /* Seek to the desired table size (actually, one byte less than the desired
+   * size) and write a single byte, so that there's enough allocated backing
+   * store on the filesystem to support the ensuing mmap() call.
+   */
+  if (lseek(fd, datasz, SEEK_SET) == (off_t) -1) {
+    xerrno = errno;
+
+    pr_log_debug(DEBUG0, MOD_FILECACHE_VERSION
+      ": error seeking to offset %lu in FileCacheTable '%s': %s",
+      (unsigned long) datasz-1, tabfh->fh_path, strerror(xerrno));
+
+    errno = xerrno;
+    return NULL;
+  }
+
+  res = write(fd, "", 1);
+  if (res != 1) {
+    xerrno = errno;
+
+    pr_log_debug(DEBUG0, MOD_FILECACHE_VERSION
+      ": error writing single byte to FileCacheTable '%s': %s",
+      tabfh->fh_path, strerror(xerrno));
+
+    errno = xerrno;
+    return NULL;
+  }
+
+  mmap_flags = MAP_SHARED;
+
+  /* As for mod_statcache, the table fd is kept open only for fcntl(2) byte
+   * range locking; anonymous memory is used for the mapping where possible.
+   */
+#if defined(MAP_ANONYMOUS)
+  mmap_flags |= MAP_ANONYMOUS;
+  fd = -1;
+
+#elif defined(MAP_ANON)
+  mmap_flags |= MAP_ANON;
+  fd = -1;
+
+#else
+  pr_log_debug(DEBUG8, MOD_FILECACHE_VERSION
+    ": mmap(2) MAP_ANONYMOUS and MAP_ANON flags not defined");
+#endif
+
+  data = mmap(NULL, datasz, PROT_READ|PROT_WRITE, mmap_flags, fd, 0);
+  if (data == MAP_FAILED) {
+    xerrno = errno;
+
+    pr_log_debug(DEBUG0, MOD_FILECACHE_VERSION
+      ": error mapping FileCacheTable '%s' fd %d size %lu into memory: %s",
+      tabfh->fh_path, fd, (unsigned long) datasz, strerror(xerrno));
+
+    errno = xerrno;
+    return NULL;
+  }
+
+  /* The mapping is zero-filled (anonymous memory, or a freshly truncated
+   * file), so there is no need to clear it here; only the pages actually
+   * used by cached files are ever touched.
+   */
+  return data;
+}
+
+static const char *get_lock_type(struct flock *lock) {
+  const char *lock_type;
+
+  switch (lock->l_type) {
+    case F_RDLCK:
+      lock_type = "read";
+      break;
+
+    case F_WRLCK:
+      lock_type = "write";
+      break;
+
+    case F_UNLCK:
+      lock_type = "unlock";
+      break;
+
+    default:
+      lock_type = "[UNKNOWN]";
+  }
+
+  return lock_type;
+}
+
+/* Row locking routines.  Only changes to entries are locked; lookups use the
+ * entry generation numbers instead.
+ */
+static int lock_row(int fd, int lock_type, uint32_t row_idx) {
+  struct flock lock;
+  unsigned int nattempts = 1;
+  size_t rowlen;
+
+  rowlen = FILECACHE_COLS_PER_ROW * sizeof(struct filecache_entry);
+
+  lock.l_type = lock_type;
+  lock.l_whence = 0;
+  lock.l_start = sizeof(struct filecache_stats) + (row_idx * rowlen);
+  lock.l_len = rowlen;
+
+  pr_trace_msg(trace_channel, 15,
+    "attempt #%u to acquire row %s lock on FileCacheTable fd %d "
+    "(off %lu, len %lu)", nattempts, get_lock_type(&lock), fd,
+    (unsigned long) lock.l_start, (unsigned long) lock.l_len);
+
+  while (fcntl(fd, F_SETLK, &lock) < 0) {
+    int xerrno = errno;
+
+    if (xerrno == EINTR) {
+      pr_signals_handle();
+      continue;
+    }
+
+    pr_trace_msg(trace_channel, 3,
+      "%s lock (attempt #%u) of FileCacheTable fd %d failed: %s",
+      get_lock_type(&lock), nattempts, fd, strerror(xerrno));
+
+    if (xerrno == EAGAIN ||
+        xerrno == EACCES) {
+      /* Treat this as an interrupted call, call pr_signals_handle() (which
+       * will delay for a few msecs because of EINTR), and try again.
+       * After MAX_LOCK_ATTEMPTS attempts, give up altogether.
+       */
+
+      nattempts++;
+      if (nattempts <= FILECACHE_MAX_LOCK_ATTEMPTS) {
+        errno = EINTR;
+
+        pr_signals_handle();
+
+        errno = 0;
+        continue;
+      }
+
+      pr_trace_msg(trace_channel, 15, "unable to acquire %s row lock on "
+        "FileCacheTable fd %d after %u attempts: %s", get_lock_type(&lock),
+        fd, nattempts, strerror(xerrno));
+    }
+
+    errno = xerrno;
+    return -1;
+  }
+
+  return 0;
+}
+
+static int filecache_wlock_row(int fd, uint32_t row_idx) {
+  return lock_row(fd, F_WRLCK, row_idx);
+}
+
+static int filecache_unlock_row(int fd, uint32_t row_idx) {
+  return lock_row(fd, F_UNLCK, row_idx);
+}
+
+/* Table manipulation routines */
+
+/* See http://www.cse.yorku.ca/~oz/hash.html */
+static uint32_t filecache_hash(dev_t dev, ino_t ino) {
+  register unsigned int i;
+  unsigned char key[sizeof(dev_t) + sizeof(ino_t)];
+  uint32_t h = 5381;
+
+  memcpy(key, &dev, sizeof(dev_t));
+  memcpy(key + sizeof(dev_t), &ino, sizeof(ino_t));
+
+  for (i = 0; i < sizeof(key); i++) {
+    h = ((h << 5) + h) + key[i];
+  }
+
+  /* Strip off the high bit. */
+  h &= ~(1 << 31);
+
+  return h;
+}
+
+static struct filecache_entry *filecache_get_entry(unsigned int idx) {
+  return &(filecache_table_entries[idx]);
+}
+
+static char *filecache_get_data(unsigned int idx) {
+  return filecache_table_data + (idx * filecache_max_filesz);
+}
+
+static int filecache_entry_matches(struct filecache_entry *fce,
+    struct stat *st) {
+  if (fce->fce_ts == 0 ||
+      fce->fce_dev != st->st_dev ||
+      fce->fce_ino != st->st_ino) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static int filecache_entry_is_valid(struct filecache_entry *fce,
+    struct stat *st) {
+  if (fce->fce_size != st->st_size ||
+      fce->fce_mtime != st->st_mtime ||
+      fce->fce_ctime != st->st_ctime) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Copy the cached contents of the given file into buf.  Returns 0 if the
+ * contents were found, and -1 otherwise, with errno set to ENOENT if the
+ * file is not cached, or ESTALE if the cached contents are out of date.
+ */
+static int filecache_table_get(struct stat *st, char *buf, uint32_t hash) {
+  register unsigned int i;
+  uint32_t row_idx;
+  int stale = FALSE;
+
+  if (filecache_table == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  row_idx = hash % filecache_nrows;
+
+  for (i = 0; i < FILECACHE_COLS_PER_ROW; i++) {
+    register unsigned int j;
+    unsigned int idx;
+    struct filecache_entry *fce;
+
+    idx = (row_idx * FILECACHE_COLS_PER_ROW) + i;
+    fce = filecache_get_entry(idx);
+
+    for (j = 0; j < FILECACHE_MAX_READ_ATTEMPTS; j++) {
+      uint32_t gen;
+      int found = FALSE, valid = FALSE;
+
+      gen = fce->fce_gen;
+      if (gen & 1) {
+        continue;
+      }
+
+      FILECACHE_BARRIER();
+      if (fce->fce_hash == hash &&
+          filecache_entry_matches(fce, st) == TRUE) {
+        found = TRUE;
+
+        if (filecache_entry_is_valid(fce, st) == TRUE) {
+          memcpy(buf, filecache_get_data(idx), (size_t) st->st_size);
+          valid = TRUE;
+        }
+      }
+      FILECACHE_BARRIER();
+
+      if (fce->fce_gen != gen) {
+        continue;
+      }
+
+      if (found == FALSE) {
+        break;
+      }
+
+      if (valid == FALSE) {
+        pr_trace_msg(trace_channel, 9,
+          "found stale entry for '%s' (hash %lu) at row %lu, col %u",
+          fce->fce_path, (unsigned long) hash, (unsigned long) row_idx + 1,
+          i + 1);
+        stale = TRUE;
+        break;
+      }
+
+      pr_trace_msg(trace_channel, 9,
+        "found entry for '%s' (hash %lu) at row %lu, col %u", fce->fce_path,
+        (unsigned long) hash, (unsigned long) row_idx + 1, i + 1);
+
+      /* The LRU and hit counts are only hints; they are updated without
+       * holding the row lock.
+       */
+      fce->fce_used = FILECACHE_ATOMIC_ADD(filecache_table_stats->fcs_clock,
+        1);
+      fce->fce_hits++;
+
+      FILECACHE_ATOMIC_ADD(filecache_table_stats->fcs_hits, 1);
+      FILECACHE_ATOMIC_ADD(filecache_table_stats->fcs_hit_bytes,
+        (uint64_t) st->st_size);
+      return 0;
+    }
+  }
+
+  FILECACHE_ATOMIC_ADD(filecache_table_stats->fcs_misses, 1);
+
+  if (stale == TRUE) {
+    FILECACHE_ATOMIC_ADD(filecache_table_stats->fcs_stale, 1);
+    errno = ESTALE;
+
+  } else {
+    errno = ENOENT;
+  }
+
+  return -1;
+}
+
+static void filecache_entry_begin(struct filecache_entry *fce) {
+  fce->fce_gen++;
+  FILECACHE_BARRIER();
+}
+
+static void filecache_entry_end(struct filecache_entry *fce) {
+  FILECACHE_BARRIER();
+  fce->fce_gen++;
+}
+
+static void filecache_stats_incr_count(int32_t incr) {
+  uint32_t count;
+
+  count = FILECACHE_ATOMIC_ADD(filecache_table_stats->fcs_count, incr) + incr;
+
+  /* The highest count is approximate. */
+  if (count > filecache_table_stats->fcs_highest) {
+    filecache_table_stats->fcs_highest = count;
+  }
+}
+
+/* Add the contents of the given file to the table, replacing any existing
+ * entry for the file, or evicting the least recently used entry of the
+ * row.  The caller must hold the row's write lock.
+ */
+static int filecache_table_add(const char *path, struct stat *st,
+    const char *buf, uint32_t hash) {
+  register unsigned int i;
+  uint32_t row_idx;
+  unsigned int idx = 0;
+  int found_slot = FALSE, evicted = FALSE;
+  uint64_t oldest = 0;
+  struct filecache_entry *fce = NULL;
+
+  if (filecache_table == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  row_idx = hash % filecache_nrows;
+
+  for (i = 0; i < FILECACHE_COLS_PER_ROW; i++) {
+    unsigned int col_idx;
+    struct filecache_entry *col_fce;
+
+    col_idx = (row_idx * FILECACHE_COLS_PER_ROW) + i;
+    col_fce = filecache_get_entry(col_idx);
+
+    if (col_fce->fce_ts == 0) {
+      /* Empty slot; keep looking for an existing entry for this file. */
+      if (found_slot == FALSE ||
+          evicted == TRUE) {
+        idx = col_idx;
+        found_slot = TRUE;
+        evicted = FALSE;
+      }
+
+      continue;
+    }
+
+    if (filecache_entry_matches(col_fce, st) == TRUE) {
+      /* Replace the existing (stale) entry for this file. */
+      idx = col_idx;
+      found_slot = TRUE;
+      evicted = FALSE;
+
+      FILECACHE_ATOMIC_ADD(filecache_table_stats->fcs_count, -1);
+      break;
+    }
+
+    if (found_slot == FALSE ||
+        (evicted == TRUE && col_fce->fce_used < oldest)) {
+      idx = col_idx;
+      oldest = col_fce->fce_used;
+      found_slot = TRUE;
+      evicted = TRUE;
+    }
+  }
+
+  fce = filecache_get_entry(idx);
+
+  if (evicted == TRUE) {
+    pr_trace_msg(trace_channel, 9,
+      "evicting entry for '%s' at row %lu, col %u", fce->fce_path,
+      (unsigned long) row_idx + 1, (idx % FILECACHE_COLS_PER_ROW) + 1);
+    FILECACHE_ATOMIC_ADD(filecache_table_stats->fcs_evictions, 1);
+    FILECACHE_ATOMIC_ADD(filecache_table_stats->fcs_count, -1);
+  }
+
+  pr_trace_msg(trace_channel, 9,
+    "adding entry for '%s' (hash %lu, %" PR_LU " bytes) at row %lu, col %u",
+    path, (unsigned long) hash, (pr_off_t) st->st_size,
+    (unsigned long) row_idx + 1, (idx % FILECACHE_COLS_PER_ROW) + 1);
+
+  filecache_entry_begin(fce);
+
+  fce->fce_hash = hash;
+  fce->fce_dev = st->st_dev;
+  fce->fce_ino = st->st_ino;
+  fce->fce_size = st->st_size;
+  fce->fce_mtime = st->st_mtime;
+  fce->fce_ctime = st->st_ctime;
+  fce->fce_ts = time(NULL);
+  fce->fce_used = FILECACHE_ATOMIC_ADD(filecache_table_stats->fcs_clock, 1);
+  fce->fce_hits = 0;
+  sstrncpy(fce->fce_path, path, sizeof(fce->fce_path));
+  memcpy(filecache_get_data(idx), buf, (size_t) st->st_size);
+
+  filecache_entry_end(fce);
+
+  filecache_stats_incr_count(1);
+  return 0;
+}
+
+static int filecache_table_clear(int fd) {
+  register unsigned int i;
+
+  for (i = 0; i < filecache_nrows; i++) {
+    register unsigned int j;
+
+    if (filecache_wlock_row(fd, i) < 0) {
+      return -1;
+    }
+
+    for (j = 0; j < FILECACHE_COLS_PER_ROW; j++) {
+      struct filecache_entry *fce;
+
+      fce = filecache_get_entry((i * FILECACHE_COLS_PER_ROW) + j);
+      if (fce->fce_ts == 0) {
+        continue;
+      }
+
+      filecache_entry_begin(fce);
+      fce->fce_ts = 0;
+      filecache_entry_end(fce);
+
+      FILECACHE_ATOMIC_ADD(filecache_table_stats->fcs_count, -1);
+    }
+
+    (void) filecache_unlock_row(fd, i);
+  }
+
+  return 0;
+}
+
+/* FSIO callbacks
+ */
+
+static pr_fs_t *filecache_get_next_fs(void) {
+  return filecache_fs->fs_next;
+}
+
+static int filecache_next_fstat(pr_fh_t *fh, int fd, struct stat *st) {
+  pr_fs_t *fs;
+
+  fs = filecache_get_next_fs();
+  while (fs && fs->fs_next && !fs->fstat) {
+    fs = fs->fs_next;
+  }
+
+  return (fs->fstat)(fh, fd, st);
+}
+
+static int filecache_next_read(pr_fh_t *fh, int fd, char *buf, size_t bufsz) {
+  pr_fs_t *fs;
+
+  fs = filecache_get_next_fs();
+  while (fs && fs->fs_next && !fs->read) {
+    fs = fs->fs_next;
+  }
+
+  return (fs->read)(fh, fd, buf, bufsz);
+}
+
+static off_t filecache_next_lseek(pr_fh_t *fh, int fd, off_t offset,
+    int whence) {
+  pr_fs_t *fs;
+
+  fs = filecache_get_next_fs();
+  while (fs && fs->fs_next && !fs->lseek) {
+    fs = fs->fs_next;
+  }
+
+  return (fs->lseek)(fh, fd, offset, whence);
+}
+
+static int filecache_fsio_read(pr_fh_t *fh, int fd, char *buf, size_t bufsz) {
+  struct filecache_fh *cfh;
+  size_t len;
+
+  cfh = fh->fh_fs->fs_data;
+
+  if (cfh->offset >= (off_t) cfh->datalen) {
+    return 0;
+  }
+
+  len = cfh->datalen - (size_t) cfh->offset;
+  if (len > bufsz) {
+    len = bufsz;
+  }
+
+  memcpy(buf, cfh->data + cfh->offset, len);
+  cfh->offset += len;
+
+  return (int) len;
+}
+
+static off_t filecache_fsio_lseek(pr_fh_t *fh, int fd, off_t offset,
+    int whence) {
+  struct filecache_fh *cfh;
+  off_t new_offset;
+
+  cfh = fh->fh_fs->fs_data;
+
+  switch (whence) {
+    case SEEK_SET:
+      new_offset = offset;
+      break;
+
+    case SEEK_CUR:
+      new_offset = cfh->offset + offset;
+      break;
+
+    case SEEK_END:
+      new_offset = (off_t) cfh->datalen + offset;
+      break;
+
+    default:
+      errno = EINVAL;
+      return (off_t) -1;
+  }
+
+  if (new_offset < 0) {
+    errno = EINVAL;
+    return (off_t) -1;
+  }
+
+  cfh->offset = new_offset;
+  return new_offset;
+}
+
+/* Arrange for reads of the given handle to be served from the given
+ * contents.  The handle gets its own FS object, stacked on top of its
+ * current FS, so that only this handle uses the cached read/lseek
+ * callbacks; other handles (e.g. for files too large to cache) keep using
+ * the underlying FS, including sendfile(2).
+ */
+static void filecache_use_data(pr_fh_t *fh, char *data, size_t datalen) {
+  pr_fs_t *fs;
+  struct filecache_fh *cfh;
+
+  cfh = pcalloc(fh->fh_pool, sizeof(struct filecache_fh));
+  cfh->data = data;
+  cfh->datalen = datalen;
+  cfh->offset = 0;
+
+  fs = pr_create_fs(fh->fh_pool, "filecache");
+  fs->fs_next = fh->fh_fs;
+  fs->fs_path = fh->fh_fs->fs_path;
+  fs->fs_data = cfh;
+  fs->non_std_path = fh->fh_fs->non_std_path;
+
+  fs->read = filecache_fsio_read;
+  fs->lseek = filecache_fsio_lseek;
+
+  fh->fh_fs = fs;
+}
+
+/* Read the entire file, expected to be st_size bytes, into buf.  Returns
+ * the number of bytes read, which differs from st_size if the file changed
+ * size while being read.
+ */
+static off_t filecache_read_file(pr_fh_t *fh, int fd, char *buf,
+    off_t st_size) {
+  off_t total = 0;
+
+  /* Note that we ask for one more byte than expected, in order to detect
+   * files which have grown since we stat'd them.
+   */
+  while (total <= st_size) {
+    int res;
+
+    pr_signals_handle();
+
+    res = filecache_next_read(fh, fd, buf + total,
+      (size_t) (st_size + 1 - total));
+    if (res < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      return -1;
+    }
+
+    if (res == 0) {
+      break;
+    }
+
+    total += res;
+  }
+
+  return total;
+}
+
+static int filecache_fsio_open(pr_fh_t *fh, const char *path, int flags) {
+  int fd, res, tab_fd, xerrno;
+  pr_fs_t *fs;
+  struct stat st;
+  time_t now;
+  char *buf;
+  off_t nread;
+  uint32_t hash, row_idx;
+
+  fs = filecache_get_next_fs();
+  while (fs && fs->fs_next && !fs->open) {
+    fs = fs->fs_next;
+  }
+
+  fd = (fs->open)(fh, path, flags);
+  if (fd < 0) {
+    return fd;
+  }
+
+  /* Only files opened for reading are cached. */
+  if ((flags & O_ACCMODE) != O_RDONLY ||
+      (flags & O_TRUNC)) {
+    return fd;
+  }
+
+  /* Note the time before checking the file; see below. */
+  now = time(NULL);
+
+  if (filecache_next_fstat(fh, fd, &st) < 0) {
+    pr_trace_msg(trace_channel, 3, "error checking '%s': %s", path,
+      strerror(errno));
+    return fd;
+  }
+
+  if (!S_ISREG(st.st_mode) ||
+      st.st_size == 0 ||
+      st.st_size > (off_t) filecache_max_filesz) {
+    return fd;
+  }
+
+  hash = filecache_hash(st.st_dev, st.st_ino);
+
+  buf = palloc(fh->fh_pool, (size_t) st.st_size + 1);
+  if (filecache_table_get(&st, buf, hash) == 0) {
+    pr_trace_msg(trace_channel, 11, "serving '%s' (%" PR_LU " bytes) from "
+      "cache", path, (pr_off_t) st.st_size);
+    filecache_use_data(fh, buf, (size_t) st.st_size);
+    return fd;
+  }
+
+  nread = filecache_read_file(fh, fd, buf, st.st_size);
+  if (nread != st.st_size) {
+    xerrno = errno;
+
+    pr_trace_msg(trace_channel, 9, "'%s' changed while reading (read %"
+      PR_LU " of %" PR_LU " bytes), not caching", path, (pr_off_t) nread,
+      (pr_off_t) st.st_size);
+
+    if (filecache_next_lseek(fh, fd, 0, SEEK_SET) < 0) {
+      xerrno = errno;
+
+      (void) close(fd);
+      errno = xerrno;
+      return -1;
+    }
+
+    return fd;
+  }
+
+  /* We have the entire file in memory now, so serve this handle from it
+   * regardless of whether it can be cached.
+   */
+  filecache_use_data(fh, buf, (size_t) st.st_size);
+
+  /* Files changed within the current second are not cached: a later change
+   * within that same second would not change their timestamps, and thus
+   * would not be detected.
+   */
+  if (st.st_mtime >= now ||
+      st.st_ctime >= now) {
+    pr_trace_msg(trace_channel, 9, "'%s' was changed too recently, "
+      "not caching", path);
+    return fd;
+  }
+
+  tab_fd = filecache_tabfh->fh_fd;
+  row_idx = hash % filecache_nrows;
+
+  if (filecache_wlock_row(tab_fd, row_idx) < 0) {
+    pr_trace_msg(trace_channel, 3,
+      "error write-locking shared memory: %s", strerror(errno));
+    return fd;
+  }
+
+  res = filecache_table_add(path, &st, buf, hash);
+  xerrno = errno;
+
+  if (filecache_unlock_row(tab_fd, row_idx) < 0) {
+    pr_trace_msg(trace_channel, 3,
+      "error unlocking shared memory: %s", strerror(errno));
+  }
+
+  if (res < 0) {
+    pr_trace_msg(trace_channel, 3, "error caching '%s': %s", path,
+      strerror(xerrno));
+  }
+
+  return fd;
+}
+
+#ifdef PR_USE_CTRLS
+/* Controls handlers
+ */
+
+static int filecache_handle_filecache(pr_ctrls_t *ctrl, int reqargc,
+    char **reqargv) {
+  /* Check the ACL */
+  if (!pr_ctrls_check_acl(ctrl, filecache_acttab, "filecache")) {
+
+    /* Access denied */
+    pr_ctrls_add_response(ctrl, "access denied");
+    return -1;
+  }
+
+  /* Sanity check */
+  if (reqargv == NULL) {
+    pr_ctrls_add_response(ctrl, "missing parameters");
+    return -1;
+  }
+
+  if (filecache_engine != TRUE ||
+      filecache_table == NULL) {
+    pr_ctrls_add_response(ctrl, MOD_FILECACHE_VERSION " not enabled");
+    return -1;
+  }
+
+  /* Check for options. */
+  pr_getopt_reset();
+
+  if (strcmp(reqargv[0], "info") == 0) {
+    uint32_t count, highest, hits, misses, stale, evictions;
+    uint64_t hit_bytes;
+    float current_usage = 0.0, highest_usage = 0.0, hit_rate = 0.0;
+
+    /* Like the metrics, the stats are read without locking; they are only
+     * approximate anyway.
+     */
+    count = filecache_table_stats->fcs_count;
+    highest = filecache_table_stats->fcs_highest;
+    hits = filecache_table_stats->fcs_hits;
+    misses = filecache_table_stats->fcs_misses;
+    stale = filecache_table_stats->fcs_stale;
+    evictions = filecache_table_stats->fcs_evictions;
+    hit_bytes = filecache_table_stats->fcs_hit_bytes;
+
+    current_usage = (((float) count / (float) filecache_capacity) * 100.0);
+    highest_usage = (((float) highest / (float) filecache_capacity) * 100.0);
+    if ((hits + misses) > 0) {
+      hit_rate = (((float) hits / (float) (hits + misses)) * 100.0);
+    }
+
+    pr_log_debug(DEBUG7, MOD_FILECACHE_VERSION
+      ": showing filecache statistics");
+
+    pr_ctrls_add_response(ctrl,
+      " hits %lu, misses %lu: %02.1f%% hit rate",
+      (unsigned long) hits, (unsigned long) misses, hit_rate);
+    pr_ctrls_add_response(ctrl,
+      "   stale %lu, evictions %lu", (unsigned long) stale,
+      (unsigned long) evictions);
+    pr_ctrls_add_response(ctrl, " bytes served from cache: %" PR_LU,
+      (pr_off_t) hit_bytes);
+    pr_ctrls_add_response(ctrl, " current count: %lu (of %lu) (%02.1f%% usage)",
+      (unsigned long) count, (unsigned long) filecache_capacity, current_usage);
+    pr_ctrls_add_response(ctrl, " highest count: %lu (of %lu) (%02.1f%% usage)",
+      (unsigned long) highest, (unsigned long) filecache_capacity,
+      highest_usage);
+    pr_ctrls_add_response(ctrl, " max file size: %lu bytes",
+      (unsigned long) filecache_max_filesz);
+
+  } else if (strcmp(reqargv[0], "dump") == 0) {
+    register unsigned int i;
+    time_t now;
+
+    pr_log_debug(DEBUG7, MOD_FILECACHE_VERSION ": dumping filecache");
+
+    pr_ctrls_add_response(ctrl, "FileCache Contents:");
+    now = time(NULL);
+
+    for (i = 0; i < filecache_nrows; i++) {
+      register unsigned int j;
+
+      pr_ctrls_add_response(ctrl, "  Row %u:", i + 1);
+
+      for (j = 0; j < FILECACHE_COLS_PER_ROW; j++) {
+        struct filecache_entry *fce;
+
+        pr_signals_handle();
+
+        fce = filecache_get_entry((i * FILECACHE_COLS_PER_ROW) + j);
+        if (fce->fce_ts > 0) {
+          pr_ctrls_add_response(ctrl,
+            "    Col %u: '%s' (%" PR_LU " bytes, %lu hits, %u secs old)",
+            j + 1, fce->fce_path, (pr_off_t) fce->fce_size,
+            (unsigned long) fce->fce_hits, (unsigned int) (now - fce->fce_ts));
+
+        } else {
+          pr_ctrls_add_response(ctrl, "    Col %u: <empty>", j + 1);
+        }
+      }
+    }
+
+  } else if (strcmp(reqargv[0], "clear") == 0) {
+    if (filecache_table_clear(filecache_tabfh->fh_fd) < 0) {
+      pr_ctrls_add_response(ctrl, "error clearing filecache: %s",
+        strerror(errno));
+      return -1;
+    }
+
+    pr_log_debug(DEBUG7, MOD_FILECACHE_VERSION ": cleared filecache");
+    pr_ctrls_add_response(ctrl, "filecache cleared");
+
+  } else {
+    pr_ctrls_add_response(ctrl, "unknown filecache action requested: '%s'",
+      reqargv[0]);
+    return -1;
+  }
+
+  return 0;
+}
+
+#endif /* PR_USE_CTRLS */
+
+/* Configuration handlers
+ */
+
+/* usage: FileCacheCapacity count */
+MODRET set_filecachecapacity(cmd_rec *cmd) {
+  int capacity;
+
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  capacity = atoi(cmd->argv[1]);
+  if (capacity < FILECACHE_COLS_PER_ROW) {
+    char str[32];
+
+    memset(str, '\0', sizeof(str));
+    pr_snprintf(str, sizeof(str), "%d", (int) FILECACHE_COLS_PER_ROW);
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "parameter must be ", str,
+      " or greater", NULL));
+  }
+
+  /* Always round UP to the nearest multiple of FILECACHE_COLS_PER_ROW. */
+  if (capacity % FILECACHE_COLS_PER_ROW != 0) {
+    int factor;
+
+    factor = (capacity / (int) FILECACHE_COLS_PER_ROW);
+    capacity = ((factor * (int) FILECACHE_COLS_PER_ROW) +
+      (int) FILECACHE_COLS_PER_ROW);
+  }
+
+  filecache_capacity = capacity;
+  return PR_HANDLED(cmd);
+}
+
+/* usage: FileCacheControlsACLs actions|all allow|deny user|group list */
+MODRET set_filecachectrlsacls(cmd_rec *cmd) {
+#ifdef PR_USE_CTRLS
+  char *bad_action = NULL, **actions = NULL;
+
+  CHECK_ARGS(cmd, 4);
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  /* We can cheat here, and use the ctrls_parse_acl() routine to
+   * separate the given string...
+   */
+  actions = ctrls_parse_acl(cmd->tmp_pool, cmd->argv[1]);
+
+  /* Check the second parameter to make sure it is "allow" or "deny" */
+  if (strcmp(cmd->argv[2], "allow") != 0 &&
+      strcmp(cmd->argv[2], "deny") != 0) {
+    CONF_ERROR(cmd, "second parameter must be 'allow' or 'deny'");
+  }
+
+  /* Check the third parameter to make sure it is "user" or "group" */
+  if (strcmp(cmd->argv[3], "user") != 0 &&
+      strcmp(cmd->argv[3], "group") != 0) {
+    CONF_ERROR(cmd, "third parameter must be 'user' or 'group'");
+  }
+
+  bad_action = pr_ctrls_set_module_acls(filecache_acttab, filecache_pool,
+    actions, cmd->argv[2], cmd->argv[3], cmd->argv[4]);
+  if (bad_action != NULL) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, ": unknown action: '",
+      bad_action, "'", NULL));
+  }
+
+  return PR_HANDLED(cmd);
+#else
+  CONF_ERROR(cmd, "requires Controls support (use --enable-ctrls)");
+#endif /* PR_USE_CTRLS */
+}
+
+/* usage: FileCacheEngine on|off */
+MODRET set_filecacheengine(cmd_rec *cmd) {
+  int engine = -1;
+  config_rec *c;
+
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
+
+  engine = get_boolean(cmd, 1);
+  if (engine == -1) {
+    CONF_ERROR(cmd, "expected Boolean parameter");
+  }
+
+  /* The table is needed if any server uses the cache. */
+  if (engine == TRUE) {
+    filecache_engine = engine;
+  }
+
+  c = add_config_param(cmd->argv[0], 1, NULL);
+  c->argv[0] = palloc(c->pool, sizeof(int));
+  *((int *) c->argv[0]) = engine;
+
+  return PR_HANDLED(cmd);
+}
+
+/* usage: FileCacheMaxFileSize size [units] */
+MODRET set_filecachemaxfilesize(cmd_rec *cmd) {
+  off_t nbytes = 0;
+  const char *units = NULL;
+
+  if (cmd->argc < 2 ||
+      cmd->argc > 3) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  if (cmd->argc == 3) {
+    units = cmd->argv[2];
+  }
+
+  if (pr_str_get_nbytes(cmd->argv[1], units, &nbytes) < 0) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "unable to parse: ",
+      cmd->argv[1], " ", units ? units : "", ": ", strerror(errno), NULL));
+  }
+
+  if (nbytes <= 0 ||
+      nbytes > INT_MAX) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "invalid size: ", cmd->argv[1],
+      NULL));
+  }
+
+  /* Keep the data slots aligned. */
+  filecache_max_filesz = (((size_t) nbytes + 7) & ~((size_t) 7));
+  return PR_HANDLED(cmd);
+}
+
+/* usage: FileCacheTable path */
+MODRET set_filecachetable(cmd_rec *cmd) {
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  if (pr_fs_valid_path(cmd->argv[1]) < 0) {
+    CONF_ERROR(cmd, "must be an absolute path");
+  }
+
+  filecache_table_path = pstrdup(filecache_pool, cmd->argv[1]);
+  return PR_HANDLED(cmd);
+}
+
+/* Command handlers
+ */
+
+MODRET filecache_post_pass(cmd_rec *cmd) {
+  if (filecache_engine == FALSE ||
+      filecache_table == NULL) {
+    return PR_DECLINED(cmd);
+  }
+
+  /* Unlike mod_statcache, we do not unmount the existing "/" FS; we are
+   * stacked on top of it, and defer to it for everything except opening
+   * (and reading) files.
+   */
+  filecache_fs = pr_register_fs(filecache_pool, "filecache", "/");
+  if (filecache_fs == NULL) {
+    pr_log_debug(DEBUG3, MOD_FILECACHE_VERSION
+      ": error registering 'filecache' fs: %s", strerror(errno));
+    filecache_engine = FALSE;
+    return PR_DECLINED(cmd);
+  }
+
+  filecache_fs->open = filecache_fsio_open;
+
+  pr_fs_setcwd(pr_fs_getvwd());
+  pr_fs_clear_cache2(NULL);
+
+  return PR_DECLINED(cmd);
+}
+
+/* Metrics
+ */
+
+static int filecache_metrics_cb(pr_metrics_t *metrics, void *user_data) {
+  if (filecache_table_stats == NULL) {
+    return 0;
+  }
+
+  pr_metrics_add_family(metrics, "proftpd_filecache_entries",
+    PR_METRICS_TYPE_GAUGE, "Files in the FileCacheTable");
+  pr_metrics_add_sample(metrics, "proftpd_filecache_entries",
+    (double) filecache_table_stats->fcs_count, NULL);
+
+  pr_metrics_add_family(metrics, "proftpd_filecache_entries_max",
+    PR_METRICS_TYPE_GAUGE, "Highest number of files in the FileCacheTable");
+  pr_metrics_add_sample(metrics, "proftpd_filecache_entries_max",
+    (double) filecache_table_stats->fcs_highest, NULL);
+
+  pr_metrics_add_family(metrics, "proftpd_filecache_lookups",
+    PR_METRICS_TYPE_COUNTER, "FileCacheTable lookups, by result");
+  pr_metrics_add_sample(metrics, "proftpd_filecache_lookups_total",
+    (double) filecache_table_stats->fcs_hits, "result", "hit", NULL);
+  pr_metrics_add_sample(metrics, "proftpd_filecache_lookups_total",
+    (double) filecache_table_stats->fcs_misses, "result", "miss", NULL);
+
+  pr_metrics_add_family(metrics, "proftpd_filecache_stale",
+    PR_METRICS_TYPE_COUNTER, "FileCacheTable entries found out of date");
+  pr_metrics_add_sample(metrics, "proftpd_filecache_stale_total",
+    (double) filecache_table_stats->fcs_stale, NULL);
+
+  pr_metrics_add_family(metrics, "proftpd_filecache_evicted",
+    PR_METRICS_TYPE_COUNTER, "FileCacheTable entries evicted");
+  pr_metrics_add_sample(metrics, "proftpd_filecache_evicted_total",
+    (double) filecache_table_stats->fcs_evictions, NULL);
+
+  pr_metrics_add_family(metrics, "proftpd_filecache_hit_bytes",
+    PR_METRICS_TYPE_COUNTER, "Bytes read from the FileCacheTable");
+  pr_metrics_add_sample(metrics, "proftpd_filecache_hit_bytes_total",
+    (double) filecache_table_stats->fcs_hit_bytes, NULL);
+
+  return 0;
+}
+
+/* Event handlers
+ */
+
+static void filecache_sess_reinit_ev(const void *event_data, void *user_data) {
+  int res;
+
+  /* A HOST command changed the main_server pointer; reinitialize ourselves. */
+
+  pr_event_unregister(&filecache_module, "core.session-reinit",
+    filecache_sess_reinit_ev);
+
+  res = filecache_sess_init();
+  if (res < 0) {
+    pr_session_disconnect(&filecache_module,
+      PR_SESS_DISCONNECT_SESSION_INIT_FAILED, NULL);
+  }
+}
+
+static void filecache_table_close(void) {
+  if (filecache_table != NULL) {
+    if (munmap(filecache_table, filecache_tablesz) < 0) {
+      pr_log_debug(DEBUG1, MOD_FILECACHE_VERSION
+        ": error detaching shared memory: %s", strerror(errno));
+
+    } else {
+      pr_log_debug(DEBUG7, MOD_FILECACHE_VERSION
+        ": detached %lu bytes of shared memory for FileCacheTable '%s'",
+        (unsigned long) filecache_tablesz, filecache_table_path);
+    }
+
+    filecache_table = NULL;
+    filecache_table_stats = NULL;
+    filecache_table_entries = NULL;
+    filecache_table_data = NULL;
+  }
+
+  if (filecache_tabfh != NULL) {
+    if (pr_fsio_close(filecache_tabfh) < 0) {
+      pr_log_debug(DEBUG1, MOD_FILECACHE_VERSION
+        ": error closing FileCacheTable '%s': %s", filecache_table_path,
+        strerror(errno));
+    }
+
+    filecache_tabfh = NULL;
+  }
+}
+
+static void filecache_shutdown_ev(const void *event_data, void *user_data) {
+
+  /* Remove the mmap from the system.  We can only do this reliably
+   * when the standalone daemon process exits; if it's an inetd process,
+   * there many be other proftpd processes still running.
+   */
+  if (getpid() == mpid &&
+      ServerType == SERVER_STANDALONE) {
+    filecache_table_close();
+  }
+}
+
+#if defined(PR_SHARED_MODULE)
+static void filecache_mod_unload_ev(const void *event_data, void *user_data) {
+  if (strcmp("mod_filecache.c", (const char *) event_data) == 0) {
+#ifdef PR_USE_CTRLS
+    register unsigned int i;
+
+    for (i = 0; filecache_acttab[i].act_action; i++) {
+      (void) pr_ctrls_unregister(&filecache_module,
+        filecache_acttab[i].act_action);
+    }
+#endif /* PR_USE_CTRLS */
+
+    pr_event_unregister(&filecache_module, NULL, NULL);
+    (void) pr_metrics_unregister(&filecache_module, NULL);
+
+    filecache_table_close();
+
+    if (filecache_pool) {
+      destroy_pool(filecache_pool);
+      filecache_pool = NULL;
+    }
+
+    filecache_engine = FALSE;
+  }
+}
+#endif /* PR_SHARED_MODULE */
+
+static void filecache_postparse_ev(const void *event_data, void *user_data) {
+  size_t entrysz, tablesz;
+  void *table;
+  int xerrno;
+  struct stat st;
+
+  if (filecache_engine == FALSE) {
+    return;
+  }
+
+  /* Make sure the FileCacheTable exists. */
+  if (filecache_table_path == NULL) {
+    pr_log_pri(PR_LOG_NOTICE, MOD_FILECACHE_VERSION
+      ": missing required FileCacheTable configuration");
+    pr_session_disconnect(&filecache_module, PR_SESS_DISCONNECT_BAD_CONFIG,
+      NULL);
+  }
+
+  PRIVS_ROOT
+  filecache_tabfh = pr_fsio_open(filecache_table_path, O_RDWR|O_CREAT);
+  xerrno = errno;
+  PRIVS_RELINQUISH
+
+  if (filecache_tabfh == NULL) {
+    pr_log_pri(PR_LOG_NOTICE, MOD_FILECACHE_VERSION
+      ": unable to open FileCacheTable '%s': %s", filecache_table_path,
+      strerror(xerrno));
+    pr_session_disconnect(&filecache_module, PR_SESS_DISCONNECT_BAD_CONFIG,
+      NULL);
+  }
+
+  if (pr_fsio_fstat(filecache_tabfh, &st) < 0) {
+    xerrno = errno;
+
+    pr_log_pri(PR_LOG_NOTICE, MOD_FILECACHE_VERSION
+      ": unable to stat FileCacheTable '%s': %s", filecache_table_path,
+      strerror(xerrno));
+    pr_fsio_close(filecache_tabfh);
+    filecache_tabfh = NULL;
+    pr_session_disconnect(&filecache_module, PR_SESS_DISCONNECT_BAD_CONFIG,
+      NULL);
+  }
+
+  if (S_ISDIR(st.st_mode)) {
+    xerrno = EISDIR;
+
+    pr_log_pri(PR_LOG_NOTICE, MOD_FILECACHE_VERSION
+      ": unable to stat FileCacheTable '%s': %s", filecache_table_path,
+      strerror(xerrno));
+    pr_fsio_close(filecache_tabfh);
+    filecache_tabfh = NULL;
+    pr_session_disconnect(&filecache_module, PR_SESS_DISCONNECT_BAD_CONFIG,
+      NULL);
+  }
+
+  if (filecache_tabfh->fh_fd <= STDERR_FILENO) {
+    int usable_fd;
+
+    usable_fd = pr_fs_get_usable_fd(filecache_tabfh->fh_fd);
+    if (usable_fd < 0) {
+      pr_log_debug(DEBUG0, MOD_FILECACHE_VERSION
+        "warning: unable to find good fd for FileCacheTable %s: %s",
+        filecache_table_path, strerror(errno));
+
+    } else {
+      close(filecache_tabfh->fh_fd);
+      filecache_tabfh->fh_fd = usable_fd;
+    }
+  }
+
+  /* The size of the table, in bytes, is:
+   *
+   *  sizeof(header) + capacity * (sizeof(entry) + max file size)
+   */
+  entrysz = sizeof(struct filecache_entry) + filecache_max_filesz;
+  if (filecache_capacity > ((SIZE_MAX - sizeof(struct filecache_stats)) /
+      entrysz)) {
+    pr_log_pri(PR_LOG_NOTICE, MOD_FILECACHE_VERSION
+      ": FileCacheCapacity %u and FileCacheMaxFileSize %lu are too large",
+      filecache_capacity, (unsigned long) filecache_max_filesz);
+    pr_session_disconnect(&filecache_module, PR_SESS_DISCONNECT_BAD_CONFIG,
+      NULL);
+  }
+
+  tablesz = sizeof(struct filecache_stats) + (filecache_capacity * entrysz);
+
+  /* Get the shm for storing all of our cached files. */
+  table = filecache_get_shm(filecache_tabfh, tablesz);
+  if (table == NULL) {
+    pr_log_pri(PR_LOG_NOTICE, MOD_FILECACHE_VERSION
+      ": unable to get shared memory for FileCacheTable '%s': %s",
+      filecache_table_path, strerror(errno));
+    pr_session_disconnect(&filecache_module, PR_SESS_DISCONNECT_BAD_CONFIG,
+      NULL);
+  }
+
+  pr_trace_msg(trace_channel, 9,
+    "allocated %lu bytes of shared memory for %u files of up to %lu bytes",
+    (unsigned long) tablesz, filecache_capacity,
+    (unsigned long) filecache_max_filesz);
+
+  filecache_table = table;
+  filecache_tablesz = tablesz;
+  filecache_table_stats = table;
+  filecache_table_entries = (struct filecache_entry *)
+    (((char *) table) + sizeof(struct filecache_stats));
+  filecache_table_data = ((char *) filecache_table_entries) +
+    (filecache_capacity * sizeof(struct filecache_entry));
+
+  filecache_nrows = (filecache_capacity / FILECACHE_COLS_PER_ROW);
+
+  (void) pr_metrics_register(&filecache_module, "stats", filecache_metrics_cb,
+    NULL);
+}
+
+static void filecache_restart_ev(const void *event_data, void *user_data) {
+#ifdef PR_USE_CTRLS
+  register unsigned int i;
+#endif /* PR_USE_CTRLS */
+
+  (void) pr_metrics_unregister(&filecache_module, NULL);
+
+  /* Detach the table; the postparse event listener maps a new one, using
+   * the new configuration.
+   */
+  filecache_table_close();
+
+  if (filecache_pool) {
+    destroy_pool(filecache_pool);
+    filecache_pool = NULL;
+  }
+
+  filecache_pool = make_sub_pool(permanent_pool);
+  pr_pool_tag(filecache_pool, MOD_FILECACHE_VERSION);
+
+#ifdef PR_USE_CTRLS
+  /* Register the control handlers */
+  for (i = 0; filecache_acttab[i].act_action; i++) {
+
+    /* Allocate and initialize the ACL for this control. */
+    filecache_acttab[i].act_acl = pcalloc(filecache_pool, sizeof(ctrls_acl_t));
+    pr_ctrls_init_acl(filecache_acttab[i].act_acl);
+  }
+#endif /* PR_USE_CTRLS */
+
+  filecache_engine = FALSE;
+  filecache_capacity = FILECACHE_DEFAULT_CAPACITY;
+  filecache_max_filesz = FILECACHE_DEFAULT_MAX_FILE_SIZE;
+  filecache_table_path = NULL;
+}
+
+/* Initialization routines
+ */
+
+static int filecache_init(void) {
+#ifdef PR_USE_CTRLS
+  register unsigned int i = 0;
+#endif /* PR_USE_CTRLS */
+
+  /* Allocate the pool for this module's use. */
+  filecache_pool = make_sub_pool(permanent_pool);
+  pr_pool_tag(filecache_pool, MOD_FILECACHE_VERSION);
+
+#ifdef PR_USE_CTRLS
+  /* Register the control handlers */
+  for (i = 0; filecache_acttab[i].act_action; i++) {
+
+    /* Allocate and initialize the ACL for this control. */
+    filecache_acttab[i].act_acl = pcalloc(filecache_pool, sizeof(ctrls_acl_t));
+    pr_ctrls_init_acl(filecache_acttab[i].act_acl);
+
+    if (pr_ctrls_register(&filecache_module, filecache_acttab[i].act_action,
+        filecache_acttab[i].act_desc, filecache_acttab[i].act_cb) < 0) {
+      pr_log_pri(PR_LOG_INFO, MOD_FILECACHE_VERSION
+        ": error registering '%s' control: %s",
+        filecache_acttab[i].act_action, strerror(errno));
+    }
+  }
+#endif /* PR_USE_CTRLS */
+
+#if defined(PR_SHARED_MODULE)
+  pr_event_register(&filecache_module, "core.module-unload",
+    filecache_mod_unload_ev, NULL);
+#endif /* PR_SHARED_MODULE */
+  pr_event_register(&filecache_module, "core.postparse",
+    filecache_postparse_ev, NULL);
+  pr_event_register(&filecache_module, "core.restart",
+    filecache_restart_ev, NULL);
+  pr_event_register(&filecache_module, "core.shutdown",
+    filecache_shutdown_ev, NULL);
+
+  return 0;
+}
+
+static int filecache_sess_init(void) {
+  config_rec *c;
+
+  pr_event_register(&filecache_module, "core.session-reinit",
+    filecache_sess_reinit_ev, NULL);
+
+  /* The FileCacheEngine directive may be set differently for this vhost. */
+  filecache_engine = FALSE;
+
+  c = find_config(main_server->conf, CONF_PARAM, "FileCacheEngine", FALSE);
+  if (c != NULL) {
+    filecache_engine = *((int *) c->argv[0]);
+  }
+
+  return 0;
+}
+
+#ifdef PR_USE_CTRLS
+
+/* Controls table
+ */
+static ctrls_acttab_t filecache_acttab[] = {
+  { "filecache",	"display or clear cached files", NULL,
+    filecache_handle_filecache },
+
+  { NULL, NULL, NULL, NULL }
+};
+#endif /* PR_USE_CTRLS */
+
+/* Module API tables
+ */
+
+static conftable filecache_conftab[] = {
+  { "FileCacheCapacity",	set_filecachecapacity,		NULL },
+  { "FileCacheControlsACLs",	set_filecachectrlsacls,		NULL },
+  { "FileCacheEngine",		set_filecacheengine,		NULL },
+  { "FileCacheMaxFileSize",	set_filecachemaxfilesize,	NULL },
+  { "FileCacheTable",		set_filecachetable,		NULL },
+  { NULL }
+};
+
+static cmdtable filecache_cmdtab[] = {
+  { POST_CMD,	C_PASS,	G_NONE,	filecache_post_pass,	FALSE,	FALSE },
+  { 0, NULL }
+};
+
+module filecache_module = {
+  NULL, NULL,
+
+  /* Module API version 2.0 */
+  0x20,
+
+  /* Module name */
+  "filecache",
+
+  /* Module configuration handler table */
+  filecache_conftab,
+
+  /* Module command handler table */
+  filecache_cmdtab,
+
+  /* Module authentication handler table */
+  NULL,
+
+  /* Module initialization function */
+  filecache_init,
+
+  /* Session initialization function */
+  filecache_sess_init,
+
+  /* Module version */
+  MOD_FILECACHE_VERSION
+};
@@ -93,6 +93,11 @@ static quota_units_t byte_units = BYTE;
 static off_t quotatab_disk_nbytes;
 static unsigned int quotatab_disk_nfiles;
 
+/* The number of bytes which the current upload may add before exceeding a
+ * quota, as noted for other modules (e.g. mod_xfer's StorePreallocate).
+ */
+static off_t quotatab_bytes_in_avail = 0;
+
 /* For handling deletes of files which not belong to us. */
 static struct stat quotatab_dele_st;
 static int quotatab_have_dele_st = FALSE;
@@ -595,6 +600,34 @@ static int quotatab_ignore_path(pool *p, const char *path) {
 #endif
 }
 
+/* Notes how many more bytes may be uploaded, if any limit applies to
+ * uploads; the caller will have removed any previous note.
+ */
+static void quotatab_note_bytes_in_avail(void) {
+  double avail = -1.0;
+
+  if (sess_limit.bytes_in_avail > 0.0) {
+    avail = sess_limit.bytes_in_avail - sess_tally.bytes_in_used;
+  }
+
+  if (sess_limit.bytes_xfer_avail > 0.0 &&
+      (avail < 0.0 ||
+       sess_limit.bytes_xfer_avail - sess_tally.bytes_xfer_used < avail)) {
+    avail = sess_limit.bytes_xfer_avail - sess_tally.bytes_xfer_used;
+  }
+
+  if (avail < 0.0) {
+    return;
+  }
+
+  quotatab_bytes_in_avail = (off_t) avail;
+  if (pr_table_add(session.notes, "mod_quotatab.bytes-in-avail",
+      &quotatab_bytes_in_avail, sizeof(off_t)) < 0) {
+    quotatab_log("error stashing 'mod_quotatab.bytes-in-avail' note: %s",
+      strerror(errno));
+  }
+}
+
 static int quotatab_scan_dir(pool *p, const char *path, uid_t uid,
     gid_t gid, int flags, double *nbytes, unsigned int *nfiles) {
   struct stat st;
@@ -1862,6 +1895,7 @@ MODRET quotatab_pre_appe(cmd_rec *cmd) {
 
   have_aborted_transfer = FALSE;
   have_err_response = FALSE;
+  (void) pr_table_remove(session.notes, "mod_quotatab.bytes-in-avail", NULL);
 
   /* Sanity check */
   if (!use_quotas) {
@@ -1925,6 +1959,7 @@ MODRET quotatab_pre_appe(cmd_rec *cmd) {
   }
 
   have_quota_update = QUOTA_HAVE_WRITE_UPDATE;
+  quotatab_note_bytes_in_avail();
   return PR_DECLINED(cmd);
 }
 
@@ -3578,6 +3613,7 @@ MODRET quotatab_pre_stor(cmd_rec *cmd) {
  
   have_aborted_transfer = FALSE;
   have_err_response = FALSE;
+  (void) pr_table_remove(session.notes, "mod_quotatab.bytes-in-avail", NULL);
 
   /* Sanity check */
   if (!use_quotas) {
@@ -3677,6 +3713,7 @@ MODRET quotatab_pre_stor(cmd_rec *cmd) {
   }
 
   have_quota_update = QUOTA_HAVE_WRITE_UPDATE;
+  quotatab_note_bytes_in_avail();
   return PR_DECLINED(cmd);
 }
 
@@ -220,6 +220,11 @@ struct fxp_handle {
    */
   size_t fh_bytes_xferred;
 
+  /* For releasing any space preallocated for an upload, beyond the data
+   * actually uploaded, when the file is closed.
+   */
+  off_t fh_prealloc_end;
+
   void *dirh;
   const char *dir;
 };
@@ -2806,14 +2811,19 @@ static char *fxp_get_path_listing(pool *p, const char *path, struct stat *st,
 }
 
 static struct fxp_dirent *fxp_get_dirent(pool *p, cmd_rec *cmd,
-    const char *real_path, mode_t *fake_mode) {
+    const char *real_path, const struct stat *dent_st, mode_t *fake_mode) {
   struct fxp_dirent *fxd;
   struct stat st;
   int hidden = 0, res;
 
-  pr_fs_clear_cache2(real_path);
-  if (pr_fsio_lstat(real_path, &st) < 0) {
-    return NULL;
+  if (dent_st != NULL) {
+    memcpy(&st, dent_st, sizeof(struct stat));
+
+  } else {
+    pr_fs_clear_cache2(real_path);
+    if (pr_fsio_lstat(real_path, &st) < 0) {
+      return NULL;
+    }
   }
 
   res = dir_check(p, cmd, G_DIRS, real_path, &hidden);
@@ -3057,6 +3067,8 @@ static int fxp_handle_abort(const void *key_data, size_t key_datasz,
     fxp_cmd_dispatch_err(cmd);
   }
 
+  sftp_misc_prealloc_trim(fxh->fh, fxh->fh_prealloc_end);
+
   if (pr_fsio_close(fxh->fh) < 0) {
     (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
       "error writing aborted file '%s': %s", fxh->fh->fh_path, strerror(errno));
@@ -6505,6 +6517,8 @@ static int fxp_handle_close(struct fxp_packet *fxp) {
       session.curr_cmd = C_RETR;
     }
 
+    sftp_misc_prealloc_trim(fxh->fh, fxh->fh_prealloc_end);
+
     res = pr_fsio_close(fxh->fh);
     xerrno = errno;
 
@@ -8748,6 +8762,7 @@ static int fxp_handle_open(struct fxp_packet *fxp) {
   char *path, *orig_path;
   uint32_t attr_flags, buflen, bufsz, desired_access = 0, flags;
   int file_existed = FALSE, open_flags, res, timeout_stalled;
+  off_t prealloc_len = 0;
   pr_fh_t *fh;
   struct stat *attrs, st;
   struct fxp_handle *fxh;
@@ -9304,7 +9319,16 @@ static int fxp_handle_open(struct fxp_packet *fxp) {
    * of the file at CLOSE is less than the size sent here, we could log it
    * as an incomplete upload.  Not all clients will provide the size attribute,
    * for those that do, it can be useful.
+   *
+   * The provided size is also used for preallocating the space for an
+   * upload, per any StorePreallocate configuration; unlike truncation, the
+   * preallocation does not change the file size, and any space not used by
+   * the upload is released when the file is closed.
    */
+  if ((attr_flags & SSH2_FX_ATTR_SIZE) &&
+      ((open_flags & O_WRONLY) || (open_flags & O_RDWR))) {
+    prealloc_len = attrs->st_size;
+  }
 
   attr_flags &= ~SSH2_FX_ATTR_SIZE;
 
@@ -9422,6 +9446,15 @@ static int fxp_handle_open(struct fxp_packet *fxp) {
     return fxp_packet_write(resp);
   }
 
+  if (prealloc_len > 0) {
+    fxh->fh_prealloc_end = sftp_misc_prealloc_file(fxh->pool, fh, 0,
+      prealloc_len);
+    if (fxh->fh_prealloc_end > 0) {
+      pr_trace_msg(trace_channel, 9, "preallocated %" PR_LU " bytes for '%s'",
+        (pr_off_t) fxh->fh_prealloc_end, fh->fh_path);
+    }
+  }
+
   pr_trace_msg(trace_channel, 8, "sending response: HANDLE %s", fxh->name);
 
   sftp_msg_write_byte(&buf, &buflen, SFTP_SSH2_FXP_HANDLE);
@@ -9852,12 +9885,12 @@ static int fxp_handle_read(struct fxp_packet *fxp) {
   cmd = fxp_cmd_alloc(fxp->pool, "READ", name);
   cmd->cmd_class = CL_READ|CL_SFTP;
 
-  pr_scoreboard_entry_update(session.pid,
+  pr_scoreboard_entry_update_deferred(session.pid,
     PR_SCORE_CMD, "%s", "READ", NULL, NULL);
-  pr_scoreboard_entry_update(session.pid,
+  pr_scoreboard_entry_update_deferred(session.pid,
     PR_SCORE_CMD_ARG, "%s", name, NULL, NULL);
 
-  pr_proctitle_set("%s - %s: READ %s %" PR_LU " %lu", session.user,
+  pr_proctitle_set_deferred("%s - %s: READ %s %" PR_LU " %lu", session.user,
     session.proc_prefix, name, (pr_off_t) offset, (unsigned long) datalen);
 
   pr_trace_msg(trace_channel, 7, "received request: READ %s %" PR_LU " %lu",
@@ -9912,7 +9945,7 @@ static int fxp_handle_read(struct fxp_packet *fxp) {
   /* Add a note containing the file handle for logging (Bug#3707). */
   fxp_set_filehandle_note(cmd, fxh);
 
-  pr_scoreboard_entry_update(session.pid,
+  pr_scoreboard_entry_update_deferred(session.pid,
     PR_SCORE_CMD_ARG, "%s", fxh->fh->fh_path, NULL, NULL);
 
   if ((off_t) offset > fxh->fh_st->st_size) {
@@ -9943,7 +9976,7 @@ static int fxp_handle_read(struct fxp_packet *fxp) {
     return fxp_packet_write(resp);
   }
 
-  pr_scoreboard_entry_update(session.pid,
+  pr_scoreboard_entry_update_deferred(session.pid,
     PR_SCORE_XFER_SIZE, fxh->fh_st->st_size,
     PR_SCORE_XFER_DONE, (off_t) offset,
     NULL);
@@ -10145,7 +10178,7 @@ static int fxp_handle_readdir(struct fxp_packet *fxp) {
   unsigned char *buf;
   char *cmd_name, *name;
   uint32_t attr_flags, buflen, curr_packet_pathsz = 0, max_packetsz;
-  struct dirent *dent;
+  pr_fs_dirent_t *dent;
   struct fxp_buffer *fxb;
   struct fxp_dirent **paths;
   struct fxp_handle *fxh;
@@ -10333,7 +10366,8 @@ static int fxp_handle_readdir(struct fxp_packet *fxp) {
     fake_group = session.group;
   }
 
-  while ((dent = pr_fsio_readdir(fxh->dirh)) != NULL) {
+  while ((dent = pr_fsio_readdir2(fxh->dirh,
+      PR_FSIO_READDIR_FL_LSTAT)) != NULL) {
     char *real_path;
     struct fxp_dirent *fxd;
     uint32_t curr_packetsz, max_entry_metadata, max_entrysz;
@@ -10362,14 +10396,21 @@ static int fxp_handle_readdir(struct fxp_packet *fxp) {
      * lower down in the ACL-checking code.  Plus, this allows regex filters
      * that rely on the dot directory name to work properly.
      */
-    if (!is_dotdir(dent->d_name)) {
-      real_path = pdircat(fxp->pool, fxh->dir, dent->d_name, NULL);
+    if (!is_dotdir(dent->name)) {
+      real_path = pdircat(fxp->pool, fxh->dir, dent->name, NULL);
 
     } else {
-      real_path = pstrdup(fxp->pool, dent->d_name);
+      real_path = pstrdup(fxp->pool, dent->name);
     }
 
-    fxd = fxp_get_dirent(fxp->pool, cmd, real_path, fake_mode);
+    if (dent->st_errno != 0) {
+      pr_trace_msg(trace_channel, 3,
+        "unable to obtain directory listing for '%s': %s", real_path,
+        strerror(dent->st_errno));
+      continue;
+    }
+
+    fxd = fxp_get_dirent(fxp->pool, cmd, real_path, &(dent->st), fake_mode);
     if (fxd == NULL) {
       int xerrno = errno;
 
@@ -10380,8 +10421,8 @@ static int fxp_handle_readdir(struct fxp_packet *fxp) {
       continue;
     }
 
-    dent_len = strlen(dent->d_name);
-    fxd->client_path = pstrndup(fxp->pool, dent->d_name, dent_len);
+    dent_len = strlen(dent->name);
+    fxd->client_path = pstrndup(fxp->pool, dent->name, dent_len);
     curr_packet_pathsz += (dent_len + 1);
     
     *((struct fxp_dirent **) push_array(path_list)) = fxd;
@@ -12813,12 +12854,12 @@ static int fxp_handle_write(struct fxp_packet *fxp) {
   cmd = fxp_cmd_alloc(fxp->pool, "WRITE", cmd_arg);
   cmd->cmd_class = CL_WRITE|CL_SFTP;
 
-  pr_scoreboard_entry_update(session.pid,
+  pr_scoreboard_entry_update_deferred(session.pid,
     PR_SCORE_CMD, "%s", "WRITE", NULL, NULL);
-  pr_scoreboard_entry_update(session.pid,
+  pr_scoreboard_entry_update_deferred(session.pid,
     PR_SCORE_CMD_ARG, "%s", name, NULL, NULL);
 
-  pr_proctitle_set("%s - %s: WRITE %s %" PR_LU " %lu", session.user,
+  pr_proctitle_set_deferred("%s - %s: WRITE %s %" PR_LU " %lu", session.user,
     session.proc_prefix, name, (pr_off_t) offset, (unsigned long) datalen);
 
   pr_trace_msg(trace_channel, 7, "received request: WRITE %s %" PR_LU " %lu",
@@ -12871,7 +12912,7 @@ static int fxp_handle_write(struct fxp_packet *fxp) {
   /* Add a note containing the file handle for logging (Bug#3707). */
   fxp_set_filehandle_note(cmd, fxh);
 
-  pr_scoreboard_entry_update(session.pid,
+  pr_scoreboard_entry_update_deferred(session.pid,
     PR_SCORE_CMD_ARG, "%s", fxh->fh->fh_path, NULL, NULL);
   fxh->fh_bytes_xferred += datalen;
 
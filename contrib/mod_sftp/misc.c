@@ -287,6 +287,91 @@ int sftp_misc_chown_path(pool *p, const char *path) {
   return 0;
 }
 
+off_t sftp_misc_prealloc_file(pool *p, pr_fh_t *fh, off_t offset,
+    off_t len) {
+  config_rec *c;
+  off_t min_len, max_len, avail_kb;
+  const off_t *quota_avail;
+
+  if (fh == NULL ||
+      len <= 0) {
+    return 0;
+  }
+
+  c = find_config(get_dir_ctxt(p, fh->fh_path), CONF_PARAM,
+    "StorePreallocate", FALSE);
+  if (c == NULL ||
+      *((int *) c->argv[0]) == FALSE) {
+    return 0;
+  }
+
+  min_len = *((off_t *) c->argv[1]);
+  max_len = *((off_t *) c->argv[2]);
+
+  if (len < min_len) {
+    return 0;
+  }
+
+  if (pr_fs_uses_sys_write(fh) != TRUE) {
+    return 0;
+  }
+
+  /* The announced size comes from the client; do not reserve space for an
+   * upload which could not be completed anyway, for lack of disk space or
+   * of quota.
+   */
+  if (pr_fs_fgetsize(PR_FH_FD(fh), &avail_kb) == 0 &&
+      len / 1024 > avail_kb) {
+    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+      "not preallocating %" PR_LU " bytes for '%s': only %" PR_LU " KB "
+      "available", (pr_off_t) len, fh->fh_path, (pr_off_t) avail_kb);
+    return 0;
+  }
+
+  quota_avail = pr_table_get(session.notes, "mod_quotatab.bytes-in-avail",
+    NULL);
+  if (quota_avail != NULL &&
+      len > *quota_avail) {
+    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+      "not preallocating %" PR_LU " bytes for '%s': only %" PR_LU " bytes "
+      "of quota available", (pr_off_t) len, fh->fh_path,
+      (pr_off_t) *quota_avail);
+    return 0;
+  }
+
+  if (len > max_len) {
+    len = max_len;
+  }
+
+  if (pr_fs_allocate(PR_FH_FD(fh), offset, len, 0) < 0) {
+    (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+      "error preallocating %" PR_LU " bytes for '%s': %s", (pr_off_t) len,
+      fh->fh_path, strerror(errno));
+    return 0;
+  }
+
+  return offset + len;
+}
+
+void sftp_misc_prealloc_trim(pr_fh_t *fh, off_t prealloc_end) {
+  struct stat st;
+
+  if (fh == NULL ||
+      prealloc_end == 0) {
+    return;
+  }
+
+  if (pr_fsio_fstat(fh, &st) == 0 &&
+      st.st_size < prealloc_end) {
+    if (pr_fs_allocate(PR_FH_FD(fh), st.st_size, prealloc_end - st.st_size,
+        PR_FS_ALLOCATE_FL_DEALLOCATE) < 0) {
+      (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
+        "error releasing preallocated space beyond end of '%s': %s",
+        fh->fh_path, strerror(errno));
+    }
+  }
+}
+
 const char *sftp_misc_get_chroot(pool *p) {
   return pr_table_get(session.notes, "mod_sftp.chroot-path", NULL);
 }
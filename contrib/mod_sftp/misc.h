@@ -29,6 +29,16 @@
 
 int sftp_misc_chown_file(pool *, pr_fh_t *);
 int sftp_misc_chown_path(pool *, const char *);
+
+/* Preallocates the disk space for an upload of the announced length, per
+ * any StorePreallocate configuration.  Returns the end of the preallocated
+ * space, or zero if nothing was preallocated.
+ */
+off_t sftp_misc_prealloc_file(pool *, pr_fh_t *, off_t, off_t);
+
+/* Releases any preallocated space beyond the end of the file. */
+void sftp_misc_prealloc_trim(pr_fh_t *, off_t);
+
 const char *sftp_misc_get_chroot(pool *p);
 const char *sftp_misc_namelist_shared(pool *, const char *, const char *);
 char *sftp_misc_vroot_abs_path(pool *p, const char *, int);
@@ -826,7 +826,10 @@ int sftp_ssh2_packet_read(int sockfd, struct ssh2_packet *pkt) {
   unsigned char buf[SFTP_MAX_PACKET_LEN];
   size_t buflen, bufsz = SFTP_MAX_PACKET_LEN, offset = 0;
 
-  pr_session_set_idle();
+  /* This is called for every packet, e.g. for each READ/WRITE request
+   * during a transfer, so coalesce the idle updates.
+   */
+  pr_session_set_idle_deferred();
 
   while (1) {
     uint32_t req_blocksz;
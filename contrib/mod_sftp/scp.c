@@ -83,6 +83,9 @@ struct scp_path {
   /* For the reading of bytes of files. */
   off_t recvlen;
 
+  /* The end of any space preallocated for the file being received. */
+  off_t prealloc_end;
+
   int wrote_errors;
 
   /* Track state of how much file metadata we've sent. */
@@ -272,10 +275,13 @@ static struct scp_session *scp_get_session(uint32_t channel_id) {
 
 static void reset_path(struct scp_path *sp) {
   if (sp->fh) {
+    sftp_misc_prealloc_trim(sp->fh, sp->prealloc_end);
     pr_fsio_close(sp->fh);
     sp->fh = NULL;
   }
 
+  sp->prealloc_end = 0;
+
   /* XXX Should clear/reset the sent fields as well, but this function
    * is mainly for use when receiving files, not sending files.
    */
@@ -1091,6 +1097,15 @@ static int recv_finfo(pool *p, uint32_t channel_id, struct scp_path *sp,
 
   sftp_misc_chown_file(p, sp->fh);
 
+  /* The client told us the size of the file to come; preallocate its space,
+   * if so configured.
+   */
+  sp->prealloc_end = sftp_misc_prealloc_file(p, sp->fh, 0, sp->filesz);
+  if (sp->prealloc_end > 0) {
+    pr_trace_msg(trace_channel, 9, "preallocated %" PR_LU " bytes for '%s'",
+      (pr_off_t) sp->prealloc_end, sp->fh->fh_path);
+  }
+
   write_confirm(p, channel_id, 0, NULL);
   return 0;
 }
@@ -1527,6 +1542,9 @@ static int recv_path(pool *p, uint32_t channel_id, struct scp_path *sp,
     /* Set session.curr_cmd, for any FSIO callbacks that might be interested. */
     session.curr_cmd = C_STOR;
 
+    sftp_misc_prealloc_trim(sp->fh, sp->prealloc_end);
+    sp->prealloc_end = 0;
+
     res = pr_fsio_close(sp->fh);
     if (res < 0) {
       int xerrno = errno;
@@ -2853,6 +2871,8 @@ int sftp_scp_close_session(uint32_t channel_id) {
                     "_");
                 }
 
+                sftp_misc_prealloc_trim(elt->fh, elt->prealloc_end);
+
                 if (pr_fsio_close(elt->fh) < 0) {
                   (void) pr_log_writefile(sftp_logfd, MOD_SFTP_VERSION,
                     "error writing aborted file '%s': %s", elt->best_path,
@@ -31,11 +31,8 @@
 #include "mod_ctrls.h"
 
 #include <sys/mman.h>
-#include <sys/ipc.h>
-#include <sys/msg.h>
-#include <sys/uio.h>
 
-#define MOD_SHAPER_VERSION		"mod_shaper/0.6.6"
+#define MOD_SHAPER_VERSION		"mod_shaper/0.7.0"
 
 /* Make sure the version of proftpd is as necessary. */
 #if PROFTPD_VERSION_NUMBER < 0x0001030402
@@ -58,25 +55,10 @@ static int shaper_engine = FALSE;
 static char *shaper_log_path = NULL;
 static int shaper_logfd = -1;
 static pool *shaper_pool = NULL;
-static int shaper_qid = -1;
-static unsigned long shaper_qmaxbytes = 0;
 static int shaper_scrub_timer_id = -1;
 static char *shaper_tab_path = NULL;
-static pool *shaper_tab_pool = NULL;
 static int shaper_tabfd = -1;
 
-#define SHAPER_PROJ_ID		24
-
-#if defined(FREEBSD4)
-#  define SHAPER_IOV_BASE		(char *)
-#elif defined(LINUX)
-#  define SHAPER_IOV_BASE		(__ptr_t)
-#elif defined(SOLARIS2)
-#  define SHAPER_IOV_BASE		(caddr_t)
-#else
-#  define SHAPER_IOV_BASE		(void *)
-#endif
-
 #ifndef HAVE_FLOCK
 # define LOCK_SH	1
 # define LOCK_EX	2
@@ -92,319 +74,86 @@ static int shaper_tabfd = -1;
 
 #define SHAPER_SCRUB_INTERVAL		60
 
-#ifndef SHAPER_MAX_SEND_ATTEMPTS
-# define SHAPER_MAX_SEND_ATTEMPTS	5
+/* Maximum number of shaped sessions in the ShaperTable. */
+#ifndef SHAPER_MAX_SESSIONS
+# define SHAPER_MAX_SESSIONS		4096
+#endif
+
+/* Identifies the ShaperTable format; older tables are reinitialized. */
+#define SHAPER_TABLE_MAGIC		0x53485032
+
+#if defined(__GNUC__)
+# define SHAPER_BARRIER()		__sync_synchronize()
+#else
+# define SHAPER_BARRIER()
 #endif
 
+/* The ShaperTable is mapped, shared, into the daemon and every session
+ * process.  Changes to the table (sessions joining and leaving, and changes
+ * made via the "shaper" control) are made under the ShaperTable lock, and
+ * bump the table's generation number.  Each shaped session polls the
+ * generation number between transfer buffers, and reads its new rates from
+ * the table when it changes; no messages need to be sent to the sessions.
+ *
+ * The generation number is odd while the table is being changed, so that
+ * the sessions, which read the table without locking it, can tell whether
+ * what they read is consistent.
+ */
 struct shaper_sess {
   pid_t sess_pid;
   unsigned int sess_prio;
   int sess_downincr;
-  long double sess_downrate;
   int sess_upincr;
-  long double sess_uprate;
 };
 
-struct {
-  int def_prio;
+struct shaper_table {
+  uint32_t magic;
+  volatile uint32_t generation;
+
+  unsigned int def_prio;
   long double downrate;
   unsigned int def_downshares;
   long double uprate;
   unsigned int def_upshares;
+
+  /* Kept up to date as sessions join, leave, and are adjusted, so that
+   * each session can compute its rates without scanning the table.
+   */
   unsigned int nsessions;
-  array_header *sess_list;
+  unsigned int total_downshares;
+  unsigned int total_upshares;
 
-} shaper_tab;
+  struct shaper_sess sess_list[SHAPER_MAX_SESSIONS];
+};
 
-/* Define our own structure for messages, since one is not portably defined.
+/* The ShaperAll settings; the configured settings are used for initializing
+ * the table.
  */
-struct shaper_msg {
-  /* Message type */
-  long mtype;
+struct shaper_settings {
+  int def_prio;
+  long double downrate;
+  unsigned int def_downshares;
+  long double uprate;
+  unsigned int def_upshares;
 
-  /* Message data */
-  char mtext[1];
-};
+} shaper_tab;
+
+static struct shaper_table *shaper_map = NULL;
+
+/* The current session's ShaperTable slot, and the rates it last read from
+ * the table.
+ */
+static int shaper_sess_idx = -1;
+static uint32_t shaper_sess_generation = 1;
+static unsigned int shaper_sess_prio = 0;
+static long double shaper_sess_downrate = -1.0, shaper_sess_uprate = -1.0;
 
 /* Necessary function prototypes. */
-static void shaper_msg_clear(pid_t);
-static int shaper_rate_alter(unsigned int, long double, long double);
 static void shaper_sess_exit_ev(const void *, void *);
-static void shaper_sigusr2_ev(const void *, void *);
-static int shaper_table_send(void);
 
 /* Support functions
  */
 
-static key_t shaper_get_key(const char *path) {
-  pr_fh_t *fh;
-  struct stat st;
-
-  /* ftok() uses stat(2) on the given path, which means that it needs to exist.
-   */
-  fh = pr_fsio_open(path, O_WRONLY|O_CREAT);
-  if (fh == NULL) {
-    int xerrno = errno;
-
-    (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-      "error opening '%s': %s", path, strerror(xerrno));
-
-    errno = xerrno;
-    return -1;
-  }
-
-  if (pr_fsio_fstat(fh, &st) < 0) {
-    int xerrno = errno;
-
-    (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-      "error checking '%s': %s", path, strerror(xerrno));
-
-    pr_fsio_close(fh);
-    errno = xerrno;
-    return -1;
-  }
-
-  if (S_ISDIR(st.st_mode)) {
-    int xerrno = EISDIR;
-
-    (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-      "error using '%s': %s", path, strerror(xerrno));
-
-    pr_fsio_close(fh);
-    errno = xerrno;
-    return -1;
-  }
-
-  pr_fsio_close(fh);
-
-  return ftok(path, SHAPER_PROJ_ID);
-}
-
-static int shaper_get_queue(const char *path) {
-  int qid;
-
-  /* Obtain a key for this path. */
-  key_t key = shaper_get_key(path);
-  if (key == (key_t) -1) {
-    (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-      "unable to get key for '%s': %s", path, strerror(errno));
-    return -1;
-  }
-
-  /* Try first using IPC_CREAT|IPC_EXCL, to check if there is an existing
-   * queue for this key.  If there is, try again, using a flag of zero.
-   */
-  qid = msgget(key, IPC_CREAT|IPC_EXCL|0666);
-  if (qid < 0) {
-    if (errno == EEXIST)
-      qid = msgget(key, 0);
-
-    else
-      return -1;
-  }
-
-  return qid;
-}
-
-static int shaper_remove_queue(void) {
-  struct msqid_ds ds;
-  int res;
-
-  memset(&ds, 0, sizeof(ds));
-
-  res = msgctl(shaper_qid, IPC_RMID, &ds);
-  if (res < 0) {
-    (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-      "error removing queue ID %d: %s", shaper_qid, strerror(errno));
-
-  } else {
-    (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-      "removed queue ID %d", shaper_qid);
-    shaper_qid = -1;
-  }
-
-  return res;
-}
-
-static int shaper_msg_recv(void) {
-  int nmsgs = 0;
-  ssize_t msglen = 0;
-  struct shaper_msg *msg;
-
-  /* The expected message length consists of a priority (the unsigned int),
-   * the new downrate (the long double), and the new uprate (another long
-   * double).
-   */
-  size_t msgsz = sizeof(unsigned int) + sizeof(long double) +
-    sizeof(long double);
-
-  msg = malloc(sizeof(struct shaper_msg) + msgsz - sizeof(msg->mtext));
-  if (msg == NULL) {
-    pr_log_pri(PR_LOG_ALERT, MOD_SHAPER_VERSION ": Out of memory!");
-    pr_session_disconnect(&shaper_module, PR_SESS_DISCONNECT_NOMEM, NULL);
-  }
-
-  msglen = msgrcv(shaper_qid, msg, msgsz, getpid(), IPC_NOWAIT|MSG_NOERROR);
-  while (msglen > 0) {
-    unsigned int prio;
-    long double downrate, uprate;
-
-    pr_signals_handle();
-    nmsgs++;
-
-    memcpy(&prio, msg->mtext, sizeof(unsigned int));
-    memcpy(&downrate, msg->mtext + sizeof(unsigned int), sizeof(long double));
-    memcpy(&uprate, msg->mtext + sizeof(unsigned int) + sizeof(long double),
-      sizeof(long double));
-
-    (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-      "received prio %u, rate %3.2Lf down, %3.2Lf up", prio, downrate,
-      uprate);
-
-    if (shaper_rate_alter(prio, downrate, uprate) < 0) {
-      (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-        "error altering rate for current session: %s", strerror(errno));
-    }
-
-    msglen = msgrcv(shaper_qid, msg, msgsz, getpid(), IPC_NOWAIT|MSG_NOERROR);
-  }
-
-  free(msg);
-
-  if (msglen < 0 &&
-#ifdef ENOMSG
-      errno != ENOMSG &&
-#endif /* ENOMSG */
-      errno != EAGAIN)
-    return -1;
-
-  return nmsgs;
-}
-
-static int shaper_msg_send(pid_t dst_pid, unsigned int prio,
-    long double downrate, long double uprate) {
-  unsigned int error_count = 0;
-  int res;
-  struct shaper_msg *msg;
-  size_t msgsz = sizeof(unsigned int) + sizeof(long double) +
-    sizeof(long double);
-
-  msg = malloc(sizeof(struct shaper_msg) + msgsz - sizeof(msg->mtext));
-  if (msg == NULL) {
-    pr_log_pri(PR_LOG_ALERT, MOD_SHAPER_VERSION ": Out of memory!");
-    pr_session_disconnect(&shaper_module, PR_SESS_DISCONNECT_NOMEM, NULL);
-  }
-
-  msg->mtype = dst_pid;
-  memcpy(msg->mtext, &prio, sizeof(unsigned int));
-  memcpy(msg->mtext + sizeof(unsigned int), &downrate, sizeof(long double));
-  memcpy(msg->mtext + sizeof(unsigned int) + sizeof(long double), &uprate,
-    sizeof(long double));
-
-  /* Remove any old messages in the queue for the destination PID.  This
-   * helps keep the queue clear and moving, more resistant to (inadvertent
-   * or not) DoS situations.
-   */
-  shaper_msg_clear(dst_pid);
-
-  while (msgsnd(shaper_qid, msg, msgsz, IPC_NOWAIT) < 0) {
-    pr_signals_handle();
-
-    if (errno != EAGAIN) {
-      free(msg);
-      return -1;
-
-    } else {
-      /* The EAGAIN error happens when there are too many bytes of messages
-       * on the queue.  Check to see what the current number of messages
-       * on the queue is, and log the error.
-       *
-       * If this error is hit too many times in a loop, we may need to give
-       * up permanently.  (XXX in the future, if one queue is too small for
-       * a busy daemon, look into a different queue allocation strategy.)
-       */
-      struct msqid_ds ds;
-
-      if (msgctl(shaper_qid, IPC_STAT, &ds) < 0) {
-        (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-          "error checking queue ID %d: %s", shaper_qid, strerror(errno));
-
-      } else {
-        (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-          "unable to send message to PID %lu via queue ID %d, max bytes (%lu) "
-          "reached (%lu messages of %lu bytes currently in queue)",
-          (unsigned long) dst_pid, shaper_qid, shaper_qmaxbytes,
-          (unsigned long) ds.msg_qnum, (unsigned long) ds.msg_qnum * msgsz);
-      }
-
-      error_count++;
-      if (error_count > SHAPER_MAX_SEND_ATTEMPTS) {
-        free(msg);
-
-        (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-          "unable to send message to PID %lu via queue ID %d after %u attempts "
-          "(%u max attempts allowed), failing", (unsigned long) dst_pid,
-          shaper_qid, error_count, SHAPER_MAX_SEND_ATTEMPTS);
-
-        errno = EPERM;
-        return -1;
-      }
-    }
-
-  }
-  free(msg);
-
-  /* Send SIGUSR2 to the destination process, to let it know that it should
-   * check the queue for messages.
-   */
-  PRIVS_ROOT
-  res = kill(dst_pid, SIGUSR2);
-  PRIVS_RELINQUISH
-
-  if (res < 0) {
-    if (errno == ESRCH) {
-      shaper_msg_clear(dst_pid);
-
-    } else {
-      (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-        "error sending notice: %s", strerror(errno));
-    }
-  }
-
-#if 0
-  /* Handle our own signal, if necessary. */
-  if (getpid() == dst_pid)
-    pr_signals_handle();
-#endif
-
-  return 0;
-}
-
-static void shaper_msg_clear(pid_t dst_pid) {
-  ssize_t msglen = 0;
-  struct shaper_msg *msg;
-  size_t msgsz = sizeof(unsigned int) + sizeof(long double) +
-    sizeof(long double);
-
-  msg = malloc(sizeof(struct shaper_msg) + msgsz - sizeof(msg->mtext));
-  if (msg == NULL) {
-    pr_log_pri(PR_LOG_ALERT, MOD_SHAPER_VERSION ": Out of memory!");
-    pr_session_disconnect(&shaper_module, PR_SESS_DISCONNECT_NOMEM, NULL);
-  }
-
-  (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-    "clearing queue ID %d of messages for process ID %lu", shaper_qid,
-    (unsigned long) dst_pid);
-  msglen = msgrcv(shaper_qid, msg, msgsz, dst_pid, IPC_NOWAIT|MSG_NOERROR);
-  while (msglen > 0) {
-    pr_signals_handle();
-
-    msglen = msgrcv(shaper_qid, msg, msgsz, dst_pid, IPC_NOWAIT|MSG_NOERROR);
-  }
-
-  free(msg);
-}
-
 static void shaper_remove_config(unsigned int prio) {
   config_rec *c;
   register unsigned int i;
@@ -513,76 +262,6 @@ static int shaper_rate_alter(unsigned int prio, long double downrate,
   return 0;
 }
 
-/* Flush the ShaperTable out to disk. */
-static int shaper_table_flush(void) {
-  register unsigned int i;
-  int res;
-  struct iovec tab_iov[6];
-  struct shaper_sess *sess_list;
-
-  /* Seek to the start of the file. */
-  if (lseek(shaper_tabfd, 0, SEEK_SET) == (off_t) -1) {
-    (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-      "error seeking to start of ShaperTable: %s", strerror(errno));
-    return -1;
-  }
-
-  /* Write out the ShaperTable header. */
-  tab_iov[0].iov_base = SHAPER_IOV_BASE &shaper_tab.def_prio;
-  tab_iov[0].iov_len = sizeof(shaper_tab.def_prio);
-
-  tab_iov[1].iov_base = SHAPER_IOV_BASE &shaper_tab.downrate;
-  tab_iov[1].iov_len = sizeof(shaper_tab.downrate);
-
-  tab_iov[2].iov_base = SHAPER_IOV_BASE &shaper_tab.def_downshares;
-  tab_iov[2].iov_len = sizeof(shaper_tab.def_downshares);
-
-  tab_iov[3].iov_base = SHAPER_IOV_BASE &shaper_tab.uprate;
-  tab_iov[3].iov_len = sizeof(shaper_tab.uprate);
-
-  tab_iov[4].iov_base = SHAPER_IOV_BASE &shaper_tab.def_upshares;
-  tab_iov[4].iov_len = sizeof(shaper_tab.def_upshares);
-
-  tab_iov[5].iov_base = SHAPER_IOV_BASE &shaper_tab.nsessions;
-  tab_iov[5].iov_len = sizeof(shaper_tab.nsessions);
-
-  res = writev(shaper_tabfd, tab_iov, 6);
-  if (res < 0) {
-    (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-      "error writing ShaperTable (%d) header: %s", shaper_tabfd,
-      strerror(errno));
-    return -1;
-  }
-
-  sess_list = shaper_tab.sess_list->elts;
-  for (i = 0; i < shaper_tab.nsessions; i++) {
-    tab_iov[0].iov_base = SHAPER_IOV_BASE &sess_list[i].sess_pid;
-    tab_iov[0].iov_len = sizeof(pid_t);
-
-    tab_iov[1].iov_base = SHAPER_IOV_BASE &sess_list[i].sess_prio;
-    tab_iov[1].iov_len = sizeof(unsigned int);
-
-    tab_iov[2].iov_base = SHAPER_IOV_BASE &sess_list[i].sess_downincr;
-    tab_iov[2].iov_len = sizeof(int);
-
-    tab_iov[3].iov_base = SHAPER_IOV_BASE &sess_list[i].sess_downrate;
-    tab_iov[3].iov_len = sizeof(long double);
-
-    tab_iov[4].iov_base = SHAPER_IOV_BASE &sess_list[i].sess_upincr;
-    tab_iov[4].iov_len = sizeof(int);
-
-    tab_iov[5].iov_base = SHAPER_IOV_BASE &sess_list[i].sess_uprate;
-    tab_iov[5].iov_len = sizeof(long double);
-
-    res = writev(shaper_tabfd, tab_iov, 6);
-    if (res < 0)
-      (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-        "error writing ShaperTable session entry: %s", strerror(errno));
-  }
-
-  return 0;
-}
-
 #ifndef HAVE_FLOCK
 static const char *get_lock_type(struct flock *lock) {
   const char *lock_type;
@@ -720,153 +399,160 @@ static int shaper_table_lock(int op) {
 #endif /* HAVE_FLOCK */
 }
 
-static int shaper_table_init(pr_fh_t *fh) {
-  unsigned int nsessions = 0;
-  struct stat st;
-  struct iovec tab_iov[6];
+/* Returns the number of down/up shares of the given session; a session
+ * always has at least one share.
+ */
+static unsigned int shaper_sess_downshares(const struct shaper_sess *sess) {
+  int shares;
 
-  if (pr_fsio_fstat(fh, &st) < 0) {
-    (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-      "unable to fstat ShaperTable: %s", strerror(errno));
-    errno = EINVAL;
-    return -1;
-  }
+  shares = (int) shaper_map->def_downshares + sess->sess_downincr;
+  return (shares >= 1 ? (unsigned int) shares : 1);
+}
 
-  shaper_tabfd = fh->fh_fd;
+static unsigned int shaper_sess_upshares(const struct shaper_sess *sess) {
+  int shares;
 
-  /* XXX maybe add a shaper control to clear/re-init the table, in cases
-   * where the format changes?
-   */
+  shares = (int) shaper_map->def_upshares + sess->sess_upincr;
+  return (shares >= 1 ? (unsigned int) shares : 1);
+}
 
-  /* If the table already exists (i.e. size > 0), return. */
-  if (st.st_size > 0) {
-    (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-      "ShaperTable '%s' has size %" PR_LU " bytes, is already initialized",
-      fh->fh_path, (pr_off_t) st.st_size);
-    return 0;
+/* Computes the rates of the given session, from its shares of the overall
+ * rates.
+ */
+static void shaper_sess_get_rates(const struct shaper_sess *sess,
+    unsigned int total_downshares, unsigned int total_upshares,
+    long double *downrate, long double *uprate) {
+
+  if (total_downshares == 0) {
+    total_downshares = 1;
   }
 
-  tab_iov[0].iov_base = SHAPER_IOV_BASE &shaper_tab.def_prio;
-  tab_iov[0].iov_len = sizeof(shaper_tab.def_prio);
+  if (total_upshares == 0) {
+    total_upshares = 1;
+  }
 
-  tab_iov[1].iov_base = SHAPER_IOV_BASE &shaper_tab.downrate;
-  tab_iov[1].iov_len = sizeof(shaper_tab.downrate);
+  *downrate = (shaper_map->downrate / total_downshares) *
+    shaper_sess_downshares(sess);
+  *uprate = (shaper_map->uprate / total_upshares) *
+    shaper_sess_upshares(sess);
+}
 
-  tab_iov[2].iov_base = SHAPER_IOV_BASE &shaper_tab.def_downshares;
-  tab_iov[2].iov_len = sizeof(shaper_tab.def_downshares);
+/* Marks the start and end of a change to the ShaperTable; the caller must
+ * hold the ShaperTable write lock.
+ */
+static void shaper_table_begin(void) {
+  shaper_map->generation++;
+  SHAPER_BARRIER();
+}
 
-  tab_iov[3].iov_base = SHAPER_IOV_BASE &shaper_tab.uprate;
-  tab_iov[3].iov_len = sizeof(shaper_tab.uprate);
+static void shaper_table_end(void) {
+  SHAPER_BARRIER();
+  shaper_map->generation++;
+}
 
-  tab_iov[4].iov_base = SHAPER_IOV_BASE &shaper_tab.def_upshares;
-  tab_iov[4].iov_len = sizeof(shaper_tab.def_upshares);
+/* Recomputes the total shares, e.g. after the default shares change. */
+static void shaper_table_sum_shares(void) {
+  register unsigned int i;
 
-  tab_iov[5].iov_base = SHAPER_IOV_BASE &nsessions;
-  tab_iov[5].iov_len = sizeof(nsessions);
+  shaper_map->total_downshares = shaper_map->total_upshares = 0;
 
-  if (lseek(fh->fh_fd, 0, SEEK_SET) < 0) {
-    return -1;
-  }
- 
-  if (writev(fh->fh_fd, tab_iov, 6) < 0) {
-    return -1;
-  }
+  for (i = 0; i < SHAPER_MAX_SESSIONS; i++) {
+    struct shaper_sess *sess = &(shaper_map->sess_list[i]);
 
-  (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-    "initialized ShaperTable with rate %3.2Lf KB/s (down), %3.2Lf KB/s (up), "
-    "default priority %u, default shares %u down, %u up", shaper_tab.downrate,
-    shaper_tab.uprate, shaper_tab.def_prio, shaper_tab.def_downshares,
-    shaper_tab.def_upshares);
+    if (sess->sess_pid == 0) {
+      continue;
+    }
 
-  return 0;
+    shaper_map->total_downshares += shaper_sess_downshares(sess);
+    shaper_map->total_upshares += shaper_sess_upshares(sess);
+  }
 }
 
-/* Refresh the in-memory ShaperTable from disk. */
-static int shaper_table_refresh(void) {
-  register unsigned int i;
-  int res;
-  struct iovec tab_iov[6];
+static int shaper_table_init(pr_fh_t *fh) {
+  struct stat st;
+  void *data;
+  int init_tab = FALSE;
 
-  if (lseek(shaper_tabfd, 0, SEEK_SET) == (off_t) -1) {
+  if (pr_fsio_fstat(fh, &st) < 0) {
     (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-      "error seeking to start of ShaperTable: %s", strerror(errno));
+      "unable to fstat ShaperTable: %s", strerror(errno));
+    errno = EINVAL;
     return -1;
   }
 
-  /* Read the ShaperTable header. */
-
-  tab_iov[0].iov_base = SHAPER_IOV_BASE &shaper_tab.def_prio;
-  tab_iov[0].iov_len = sizeof(shaper_tab.def_prio);
+  shaper_tabfd = fh->fh_fd;
 
-  tab_iov[1].iov_base = SHAPER_IOV_BASE &shaper_tab.downrate;
-  tab_iov[1].iov_len = sizeof(shaper_tab.downrate);
+  if (shaper_table_lock(LOCK_EX) < 0) {
+    return -1;
+  }
 
-  tab_iov[2].iov_base = SHAPER_IOV_BASE &shaper_tab.def_downshares;
-  tab_iov[2].iov_len = sizeof(shaper_tab.def_downshares);
+  /* A table of the wrong size is from an older version, or is otherwise
+   * unusable; start it afresh.
+   */
+  if (st.st_size != (off_t) sizeof(struct shaper_table)) {
+    if (ftruncate(fh->fh_fd, 0) < 0 ||
+        ftruncate(fh->fh_fd, sizeof(struct shaper_table)) < 0) {
+      int xerrno = errno;
 
-  tab_iov[3].iov_base = SHAPER_IOV_BASE &shaper_tab.uprate;
-  tab_iov[3].iov_len = sizeof(shaper_tab.uprate);
+      shaper_table_lock(LOCK_UN);
+      errno = xerrno;
+      return -1;
+    }
 
-  tab_iov[4].iov_base = SHAPER_IOV_BASE &shaper_tab.def_upshares;
-  tab_iov[4].iov_len = sizeof(shaper_tab.def_upshares);
+    init_tab = TRUE;
+  }
 
-  tab_iov[5].iov_base = SHAPER_IOV_BASE &shaper_tab.nsessions;
-  tab_iov[5].iov_len = sizeof(shaper_tab.nsessions);
+  data = mmap(NULL, sizeof(struct shaper_table), PROT_READ|PROT_WRITE,
+    MAP_SHARED, fh->fh_fd, 0);
+  if (data == MAP_FAILED) {
+    int xerrno = errno;
 
-  res = readv(shaper_tabfd, tab_iov, 6);
-  if (res < 0) {
-    (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-      "error reading ShaperTable header: %s", strerror(errno));
+    shaper_table_lock(LOCK_UN);
+    errno = xerrno;
     return -1;
   }
- 
-  /* For every session, read in its information and add it to the list.
-   * For this, we need a pool for the session list.
-   */
 
-  if (shaper_tab_pool) {
-    destroy_pool(shaper_tab_pool);
-    shaper_tab_pool = NULL;
-    shaper_tab.sess_list = NULL;
-  }
+  shaper_map = data;
 
-  shaper_tab_pool = make_sub_pool(shaper_pool);
-  pr_pool_tag(shaper_tab_pool, MOD_SHAPER_VERSION ": ShaperTable pool");
-
-  shaper_tab.sess_list = make_array(shaper_tab_pool, 0,
-    sizeof(struct shaper_sess));
-
-  for (i = 0; i < shaper_tab.nsessions; i++) {
-    struct shaper_sess *sess = push_array(shaper_tab.sess_list);
+  if (shaper_map->magic != SHAPER_TABLE_MAGIC) {
+    init_tab = TRUE;
+  }
 
-    tab_iov[0].iov_base = SHAPER_IOV_BASE &sess->sess_pid;
-    tab_iov[0].iov_len = sizeof(sess->sess_pid);
+  /* XXX maybe add a shaper control to clear/re-init the table? */
+  if (!init_tab) {
+    shaper_table_lock(LOCK_UN);
 
-    tab_iov[1].iov_base = SHAPER_IOV_BASE &sess->sess_prio;
-    tab_iov[1].iov_len = sizeof(sess->sess_prio);
+    (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
+      "ShaperTable '%s' (%u %s) is already initialized", fh->fh_path,
+      shaper_map->nsessions, shaper_map->nsessions != 1 ? "sessions" :
+      "session");
+    return 0;
+  }
 
-    tab_iov[2].iov_base = SHAPER_IOV_BASE &sess->sess_downincr;
-    tab_iov[2].iov_len = sizeof(sess->sess_downincr);
+  memset(shaper_map, 0, sizeof(struct shaper_table));
+  shaper_map->magic = SHAPER_TABLE_MAGIC;
+  shaper_map->def_prio = shaper_tab.def_prio;
+  shaper_map->downrate = shaper_tab.downrate;
+  shaper_map->def_downshares = shaper_tab.def_downshares;
+  shaper_map->uprate = shaper_tab.uprate;
+  shaper_map->def_upshares = shaper_tab.def_upshares;
 
-    tab_iov[3].iov_base = SHAPER_IOV_BASE &sess->sess_downrate;
-    tab_iov[3].iov_len = sizeof(sess->sess_downrate);
+  shaper_table_lock(LOCK_UN);
 
-    tab_iov[4].iov_base = SHAPER_IOV_BASE &sess->sess_upincr;
-    tab_iov[4].iov_len = sizeof(sess->sess_upincr);
+  (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
+    "initialized ShaperTable with rate %3.2Lf KB/s (down), %3.2Lf KB/s (up), "
+    "default priority %u, default shares %u down, %u up", shaper_tab.downrate,
+    shaper_tab.uprate, shaper_tab.def_prio, shaper_tab.def_downshares,
+    shaper_tab.def_upshares);
 
-    tab_iov[5].iov_base = SHAPER_IOV_BASE &sess->sess_uprate;
-    tab_iov[5].iov_len = sizeof(sess->sess_uprate);
+  return 0;
+}
 
-    res = readv(shaper_tabfd, tab_iov, 6);
-    if (res < 0) {
-      (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-        "error reading session entry %u from ShaperTable: %s", i + 1,
-        strerror(errno));
-      return -1;
-    }
+static void shaper_table_close(void) {
+  if (shaper_map != NULL) {
+    (void) munmap((void *) shaper_map, sizeof(struct shaper_table));
+    shaper_map = NULL;
   }
-
-  return 0;
 }
 
 /* Scan the ShaperTable for any sessions who might have exited in a Bad Way
@@ -874,74 +560,51 @@ static int shaper_table_refresh(void) {
  */
 static void shaper_table_scrub(void) {
   register unsigned int i;
-  struct shaper_sess *sess_list;
-  array_header *new_sess_list;
-  int send_tab = FALSE;
+  int changed = FALSE;
 
-  if (shaper_table_lock(LOCK_EX) < 0)
-    return;
-
-  if (shaper_table_refresh() < 0) {
-    shaper_table_lock(LOCK_UN);
+  if (shaper_map == NULL) {
     return;
   }
 
-  if (shaper_tab.nsessions == 0) {
-    /* No sessions in the ShaperTable to be removed. */
-    shaper_table_lock(LOCK_UN);
+  if (shaper_table_lock(LOCK_EX) < 0) {
     return;
   }
 
-  sess_list = shaper_tab.sess_list->elts;
-  new_sess_list = make_array(shaper_tab_pool, 0, sizeof(struct shaper_sess));
+  for (i = 0; i < SHAPER_MAX_SESSIONS; i++) {
+    struct shaper_sess *sess = &(shaper_map->sess_list[i]);
 
-  for (i = 0; i < shaper_tab.nsessions; i++) {
+    if (sess->sess_pid == 0) {
+      continue;
+    }
 
     /* Check to see if the PID in this entry is valid.  If not, erase
      * the slot.
      */
-    if (kill(sess_list[i].sess_pid, 0) < 0) {
-      if (errno == ESRCH) {
-
-        /* OK, the recorded PID is no longer valid. */
-        (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-          "removed dead session (pid %u) from ShaperTable",
-          (unsigned int) sess_list[i].sess_pid);
-        send_tab = TRUE;
-      } 
+    if (kill(sess->sess_pid, 0) < 0 &&
+        errno == ESRCH) {
 
-    } else {
-      struct shaper_sess *sess = push_array(new_sess_list);
-
-      sess->sess_pid = sess_list[i].sess_pid;
-      sess->sess_prio = sess_list[i].sess_prio;
-      sess->sess_downincr = sess_list[i].sess_downincr;
-      sess->sess_downrate = sess_list[i].sess_downrate;
-      sess->sess_upincr = sess_list[i].sess_upincr;
-      sess->sess_uprate = sess_list[i].sess_uprate;
-    }
-  }
-
-  /* Replace the session list.  The memory pointed to by the overwritten
-   * pointer will be freed when shaper_tab_pool is freed, which will be
-   * when the table is next refreshed.
-   */
+      /* OK, the recorded PID is no longer valid. */
+      (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
+        "removed dead session (pid %u) from ShaperTable",
+        (unsigned int) sess->sess_pid);
 
-  shaper_tab.nsessions = new_sess_list->nelts;
-  shaper_tab.sess_list = new_sess_list;
+      if (!changed) {
+        shaper_table_begin();
+        changed = TRUE;
+      }
 
-  if (send_tab && shaper_table_send() < 0) {
-    shaper_table_lock(LOCK_UN);
-    return;
+      shaper_map->total_downshares -= shaper_sess_downshares(sess);
+      shaper_map->total_upshares -= shaper_sess_upshares(sess);
+      shaper_map->nsessions--;
+      memset(sess, 0, sizeof(struct shaper_sess));
+    }
   }
 
-  if (shaper_table_flush() < 0) {
-    shaper_table_lock(LOCK_UN);
-    return;
+  if (changed) {
+    shaper_table_end();
   }
 
   shaper_table_lock(LOCK_UN);
-  return;
 }
 
 static int shaper_table_scrub_cb(CALLBACK_FRAME) {
@@ -951,274 +614,248 @@ static int shaper_table_scrub_cb(CALLBACK_FRAME) {
   return 1;
 }
 
-/* Scan the ShaperTable, sending messages to each session for their new rate
- * and its priority.
+/* Reads the current session's priority and rates from the ShaperTable,
+ * without locking it.  Returns -1 if a consistent read could not be made,
+ * e.g. because the table is being changed.
  */
-static int shaper_table_send(void) {
+static int shaper_sess_read_rates(uint32_t *generation, unsigned int *prio,
+    long double *downrate, long double *uprate) {
   register unsigned int i;
-  unsigned int total_downshares = 0, total_upshares = 0;
-  long double rate_per_downshare, rate_per_upshare;
-  struct shaper_sess *sess_list = shaper_tab.sess_list->elts;
 
-  for (i = 0; i < shaper_tab.nsessions; i++) {
-    total_downshares += (shaper_tab.def_downshares +
-      sess_list[i].sess_downincr);
-    total_upshares += (shaper_tab.def_upshares +
-      sess_list[i].sess_upincr);
+  for (i = 0; i < 10; i++) {
+    uint32_t gen;
+    struct shaper_sess sess;
+    unsigned int total_downshares, total_upshares;
+
+    gen = shaper_map->generation;
+    if (gen & 1) {
+      continue;
+    }
+
+    SHAPER_BARRIER();
+    memcpy(&sess, &(shaper_map->sess_list[shaper_sess_idx]), sizeof(sess));
+    total_downshares = shaper_map->total_downshares;
+    total_upshares = shaper_map->total_upshares;
+    shaper_sess_get_rates(&sess, total_downshares, total_upshares, downrate,
+      uprate);
+    SHAPER_BARRIER();
+
+    if (shaper_map->generation == gen) {
+      *generation = gen;
+      *prio = sess.sess_prio;
+      return 0;
+    }
   }
 
-  if (total_downshares == 0) {
-    total_downshares = 1;
+  errno = EAGAIN;
+  return -1;
+}
+
+/* Applies the current session's rates from the ShaperTable, if they have
+ * changed since last read.  Returns TRUE if the session's TransferRates
+ * were changed.
+ */
+static int shaper_sess_poll(void) {
+  uint32_t generation;
+  unsigned int prio;
+  long double downrate, uprate;
+
+  if (shaper_map == NULL ||
+      shaper_sess_idx < 0 ||
+      shaper_map->generation == shaper_sess_generation) {
+    return FALSE;
   }
 
-  if (total_upshares == 0) {
-    total_upshares = 1;
+  if (shaper_sess_read_rates(&generation, &prio, &downrate, &uprate) < 0) {
+    /* Try again on the next poll. */
+    return FALSE;
   }
 
-  (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-    "total session shares: %u down, %u up", total_downshares, total_upshares);
+  shaper_sess_generation = generation;
 
-  rate_per_downshare = shaper_tab.downrate / total_downshares;
-  rate_per_upshare = shaper_tab.uprate / total_upshares;
+  if (prio == shaper_sess_prio &&
+      downrate == shaper_sess_downrate &&
+      uprate == shaper_sess_uprate) {
+    return FALSE;
+  }
 
   (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-    "rate per share: %3.2Lf down, %3.2Lf up", rate_per_downshare,
-    rate_per_upshare);
+    "read prio %u, rate %3.2Lf down, %3.2Lf up", prio, downrate, uprate);
 
-  for (i = 0; i < shaper_tab.nsessions; i++) {
-    sess_list[i].sess_downrate = rate_per_downshare *
-      (shaper_tab.def_downshares + sess_list[i].sess_downincr);
-    sess_list[i].sess_uprate = rate_per_upshare *
-      (shaper_tab.def_upshares + sess_list[i].sess_upincr);
+  if (prio != shaper_sess_prio) {
+    shaper_remove_config(shaper_sess_prio);
+  }
 
+  if (shaper_rate_alter(prio, downrate, uprate) < 0) {
     (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-      "pid %u has shares of %u down, %u up, sending rates of %3.2Lf down, "
-      "%3.2Lf up", (unsigned int) sess_list[i].sess_pid,
-      shaper_tab.def_downshares + sess_list[i].sess_downincr,
-      shaper_tab.def_upshares + sess_list[i].sess_upincr,
-      sess_list[i].sess_downrate, sess_list[i].sess_uprate);
-
-    if (shaper_msg_send(sess_list[i].sess_pid, sess_list[i].sess_prio,
-        sess_list[i].sess_downrate, sess_list[i].sess_uprate) < 0) 
-      (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-        "error sending msg to pid %u: %s",
-        (unsigned int) sess_list[i].sess_pid, strerror(errno));
+      "error altering rate for current session: %s", strerror(errno));
+    return FALSE;
   }
 
-  return 0;
+  shaper_sess_prio = prio;
+  shaper_sess_downrate = downrate;
+  shaper_sess_uprate = uprate;
+
+  return TRUE;
 }
 
 static int shaper_table_sess_add(pid_t sess_pid, unsigned int prio,
     int downincr, int upincr) {
-  struct shaper_sess *sess;
+  register unsigned int i;
+  struct shaper_sess *sess = NULL;
 
   if (shaper_table_lock(LOCK_EX) < 0) {
     return -1;
   }
 
-  if (shaper_table_refresh() < 0) {
-    int xerrno = errno;
+  for (i = 0; i < SHAPER_MAX_SESSIONS; i++) {
+    if (shaper_map->sess_list[i].sess_pid == 0) {
+      sess = &(shaper_map->sess_list[i]);
+      break;
+    }
+  }
 
+  if (sess == NULL) {
     shaper_table_lock(LOCK_UN);
-    errno = xerrno;
+
+    (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
+      "ShaperTable is full (%u sessions)", (unsigned int) SHAPER_MAX_SESSIONS);
+    errno = ENOSPC;
     return -1;
   }
 
-  shaper_tab.nsessions++;
-  sess = push_array(shaper_tab.sess_list);
+  shaper_table_begin();
+
   sess->sess_pid = sess_pid;
 
   if (prio != (unsigned int) -1) {
     sess->sess_prio = prio;
 
   } else {
-    sess->sess_prio = shaper_tab.def_prio;
+    sess->sess_prio = shaper_map->def_prio;
   }
 
   sess->sess_downincr = downincr;
-  sess->sess_downrate = 0.0;
   sess->sess_upincr = upincr;
-  sess->sess_uprate = 0.0;
 
-  if (shaper_table_send() < 0) {
-    int xerrno = errno;
-
-    shaper_table_lock(LOCK_UN);
-    errno = xerrno;
-    return -1;
-  }
-
-  if (shaper_table_flush() < 0) {
-    int xerrno = errno;
-
-    shaper_table_lock(LOCK_UN);
-    errno = xerrno;
-    return -1;
-  }
+  shaper_map->nsessions++;
+  shaper_map->total_downshares += shaper_sess_downshares(sess);
+  shaper_map->total_upshares += shaper_sess_upshares(sess);
 
+  shaper_table_end();
   shaper_table_lock(LOCK_UN);
+
+  shaper_sess_idx = i;
   return 0;
 }
 
 static int shaper_table_sess_modify(pid_t sess_pid, unsigned int prio,
     int downincr, int upincr) {
   register unsigned int i;
-  int found = FALSE, adj_down_ok = FALSE, adj_up_ok = FALSE;
-  struct shaper_sess *sess_list;
+  int adj_down_ok = FALSE, adj_up_ok = FALSE;
+  struct shaper_sess *sess = NULL;
 
   if (shaper_table_lock(LOCK_EX) < 0)
     return -1;
 
-  if (shaper_table_refresh() < 0) {
-    int xerrno = errno;
-
-    shaper_table_lock(LOCK_UN);
-    errno = xerrno;
-    return -1;
+  for (i = 0; i < SHAPER_MAX_SESSIONS; i++) {
+    if (shaper_map->sess_list[i].sess_pid == sess_pid) {
+      sess = &(shaper_map->sess_list[i]);
+      break;
+    }
   }
 
-  /* XXX for large ShaperTables, this linear scan will increase the time
-   * needed for adjusting sessions.
-   */
-  sess_list = shaper_tab.sess_list->elts;
-  for (i = 0; i < shaper_tab.nsessions; i++) {
-    if (sess_list[i].sess_pid != sess_pid)
-      continue;
-
-    found = TRUE;
-
-    if ((shaper_tab.def_downshares + sess_list[i].sess_downincr +
+  if (sess != NULL) {
+    if (((int) shaper_map->def_downshares + sess->sess_downincr +
         downincr) >= 1) {
       adj_down_ok = TRUE;
-      sess_list[i].sess_downincr += downincr;
     }
 
-    if ((shaper_tab.def_upshares + sess_list[i].sess_upincr +
+    if (((int) shaper_map->def_upshares + sess->sess_upincr +
         upincr) >= 1) {
       adj_up_ok = TRUE;
-      sess_list[i].sess_upincr += upincr;
     }
-
-    if (prio != (unsigned int) -1)
-      sess_list[i].sess_prio = prio;
-
-    break;
   }
 
   /* If the session was not found, or if the given adjustments were not OK,
-   * do not send the changes out, but be done now.
+   * do not make the changes, but be done now.
    */
-  if (!found || (!adj_down_ok && !adj_up_ok)) {
+  if (sess == NULL || (!adj_down_ok && !adj_up_ok)) {
     shaper_table_lock(LOCK_UN);
 
-    if (!found)
+    if (sess == NULL)
       errno = ENOENT;
 
     else if (!adj_down_ok) {
       (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
         "error modifying session: shares increment (%s%d) will drop "
         "session downshares (%u) below 1", downincr > 0 ? "+" : "", downincr,
-        shaper_tab.def_downshares);
+        shaper_map->def_downshares);
       errno = EINVAL;
 
     } else if (!adj_up_ok) {
       (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
         "error modifying session: shares increment (%s%d) will drop "
         "session upshares (%u) below 1", upincr > 0 ? "+" : "", upincr,
-        shaper_tab.def_upshares);
+        shaper_map->def_upshares);
       errno = EINVAL;
     }
 
     return -1;
   }
 
-  if (shaper_table_send() < 0) {
-    int xerrno = errno;
+  shaper_table_begin();
 
-    shaper_table_lock(LOCK_UN);
-    errno = xerrno;
-    return -1;
-  }
+  shaper_map->total_downshares -= shaper_sess_downshares(sess);
+  shaper_map->total_upshares -= shaper_sess_upshares(sess);
 
-  if (shaper_table_flush() < 0) {
-    int xerrno = errno;
+  if (adj_down_ok) {
+    sess->sess_downincr += downincr;
+  }
 
-    shaper_table_lock(LOCK_UN);
-    errno = xerrno;
-    return -1;
+  if (adj_up_ok) {
+    sess->sess_upincr += upincr;
   }
 
+  if (prio != (unsigned int) -1)
+    sess->sess_prio = prio;
+
+  shaper_map->total_downshares += shaper_sess_downshares(sess);
+  shaper_map->total_upshares += shaper_sess_upshares(sess);
+
+  shaper_table_end();
   shaper_table_lock(LOCK_UN);
   return 0;
 }
 
 static int shaper_table_sess_remove(pid_t sess_pid) {
   register unsigned int i;
-  int found = FALSE;
-  struct shaper_sess *sess_list;
-  array_header *new_sess_list;
+  struct shaper_sess *sess = NULL;
 
   if (shaper_table_lock(LOCK_EX) < 0)
     return -1;
 
-  if (shaper_table_refresh() < 0) {
-    int xerrno = errno;
-
-    shaper_table_lock(LOCK_UN);
-    errno = xerrno;
-    return -1;
+  for (i = 0; i < SHAPER_MAX_SESSIONS; i++) {
+    if (shaper_map->sess_list[i].sess_pid == sess_pid) {
+      sess = &(shaper_map->sess_list[i]);
+      break;
+    }
   }
 
-  if (shaper_tab.nsessions == 0) {
-    /* No sessions in the ShaperTable to be removed. */
+  if (sess == NULL) {
+    /* Not in the ShaperTable, e.g. already scrubbed. */
     shaper_table_lock(LOCK_UN);
     return 0;
   }
 
-  sess_list = shaper_tab.sess_list->elts;
-  new_sess_list = make_array(shaper_tab_pool, 0, sizeof(struct shaper_sess));
+  shaper_table_begin();
 
-  for (i = 0; i < shaper_tab.nsessions; i++) {
-    if (sess_list[i].sess_pid != sess_pid) {
-      struct shaper_sess *sess = push_array(new_sess_list);
-
-      sess->sess_pid = sess_list[i].sess_pid;
-      sess->sess_prio = sess_list[i].sess_prio;
-      sess->sess_downincr = sess_list[i].sess_downincr;
-      sess->sess_downrate = sess_list[i].sess_downrate;
-      sess->sess_upincr = sess_list[i].sess_upincr;
-      sess->sess_uprate = sess_list[i].sess_uprate;
-
-    } else
-       found = TRUE;
-  }
-
-  if (found)
-    shaper_tab.nsessions--;
-
-  /* Replace the session list.  The memory pointed to by the overwritten
-   * pointer will be freed when shaper_tab_pool is freed, which will be
-   * when the table is next refreshed.
-   */
-
-  shaper_tab.sess_list = new_sess_list;
-
-  if (shaper_table_send() < 0) {
-    int xerrno = errno;
-
-    shaper_table_lock(LOCK_UN);
-    errno = xerrno;
-    return -1;
-  }
-
-  if (shaper_table_flush() < 0) {
-    int xerrno = errno;
-
-    shaper_table_lock(LOCK_UN);
-    errno = xerrno;
-    return -1;
-  }
+  shaper_map->total_downshares -= shaper_sess_downshares(sess);
+  shaper_map->total_upshares -= shaper_sess_upshares(sess);
+  shaper_map->nsessions--;
+  memset(sess, 0, sizeof(struct shaper_sess));
 
+  shaper_table_end();
   shaper_table_lock(LOCK_UN);
   return 0;
 }
@@ -1233,6 +870,7 @@ static int shaper_handle_all(pr_ctrls_t *ctrl, int reqargc,
     char **reqargv) {
   register int i;
   int send_tab = TRUE;
+  struct shaper_settings settings;
 
   if (reqargc < 2 ||
       reqargc > 14 ||
@@ -1248,11 +886,11 @@ static int shaper_handle_all(pr_ctrls_t *ctrl, int reqargc,
     return -1;
   }
 
-  if (shaper_table_refresh() < 0) {
-    shaper_table_lock(LOCK_UN);
-    pr_ctrls_add_response(ctrl, "error handling request");
-    return -1;
-  }
+  settings.def_prio = shaper_map->def_prio;
+  settings.downrate = shaper_map->downrate;
+  settings.def_downshares = shaper_map->def_downshares;
+  settings.uprate = shaper_map->uprate;
+  settings.def_upshares = shaper_map->def_upshares;
 
   for (i = 0; i < reqargc;) {
     if (strcmp(reqargv[i], "downrate") == 0) {
@@ -1277,9 +915,9 @@ static int shaper_handle_all(pr_ctrls_t *ctrl, int reqargc,
         continue;
       }
 
-      shaper_tab.downrate = rate;
+      settings.downrate = rate;
       pr_ctrls_add_response(ctrl, "overall downrate (%3.2Lf) set",
-        shaper_tab.downrate);
+        settings.downrate);
 
       i += 2;
 
@@ -1294,9 +932,9 @@ static int shaper_handle_all(pr_ctrls_t *ctrl, int reqargc,
         continue;
       }
 
-      shaper_tab.def_downshares = shares;
+      settings.def_downshares = shares;
       pr_ctrls_add_response(ctrl, "default downshares (%u) set",
-        shaper_tab.def_downshares);
+        settings.def_downshares);
 
       i += 2;
 
@@ -1311,9 +949,9 @@ static int shaper_handle_all(pr_ctrls_t *ctrl, int reqargc,
         continue;
       }
 
-      shaper_tab.def_prio = prio;
+      settings.def_prio = prio;
       pr_ctrls_add_response(ctrl, "default priority (%u) set",
-        shaper_tab.def_prio);
+        settings.def_prio);
 
       i += 2;
 
@@ -1338,10 +976,10 @@ static int shaper_handle_all(pr_ctrls_t *ctrl, int reqargc,
         continue;
       }
 
-      shaper_tab.downrate = rate;
-      shaper_tab.uprate = rate;
+      settings.downrate = rate;
+      settings.uprate = rate;
       pr_ctrls_add_response(ctrl, "overall rates (%3.2Lf down, %3.2Lf up) set",
-        shaper_tab.downrate, shaper_tab.uprate);
+        settings.downrate, settings.uprate);
 
       i += 2;
 
@@ -1356,10 +994,10 @@ static int shaper_handle_all(pr_ctrls_t *ctrl, int reqargc,
         continue;
       }
 
-      shaper_tab.def_downshares = shares;
-      shaper_tab.def_upshares = shares;
+      settings.def_downshares = shares;
+      settings.def_upshares = shares;
       pr_ctrls_add_response(ctrl, "default shares (%u down, %u up) set",
-        shaper_tab.def_downshares, shaper_tab.def_upshares);
+        settings.def_downshares, settings.def_upshares);
 
       i += 2;
 
@@ -1384,9 +1022,9 @@ static int shaper_handle_all(pr_ctrls_t *ctrl, int reqargc,
         continue;
       }
 
-      shaper_tab.uprate = rate;
+      settings.uprate = rate;
       pr_ctrls_add_response(ctrl, "overall uprate (%3.2Lf) set",
-        shaper_tab.uprate);
+        settings.uprate);
 
       i += 2;
 
@@ -1401,9 +1039,9 @@ static int shaper_handle_all(pr_ctrls_t *ctrl, int reqargc,
         continue;
       }
 
-      shaper_tab.def_upshares = shares;
+      settings.def_upshares = shares;
       pr_ctrls_add_response(ctrl, "default upshares (%u) set",
-        shaper_tab.def_upshares);
+        settings.def_upshares);
 
       i += 2;
 
@@ -1421,17 +1059,17 @@ static int shaper_handle_all(pr_ctrls_t *ctrl, int reqargc,
     return -1;
   }
 
-  if (shaper_table_send() < 0) {
-    shaper_table_lock(LOCK_UN);
-    pr_ctrls_add_response(ctrl, "error handling request");
-    return -1;
-  }
+  /* The sessions will notice the new generation, and adjust their rates. */
+  shaper_table_begin();
 
-  if (shaper_table_flush() < 0) {
-    shaper_table_lock(LOCK_UN);
-    pr_ctrls_add_response(ctrl, "error handling request");
-    return -1;
-  }
+  shaper_map->def_prio = settings.def_prio;
+  shaper_map->downrate = settings.downrate;
+  shaper_map->def_downshares = settings.def_downshares;
+  shaper_map->uprate = settings.uprate;
+  shaper_map->def_upshares = settings.def_upshares;
+  shaper_table_sum_shares();
+
+  shaper_table_end();
 
   shaper_table_lock(LOCK_UN);
   return 0;
@@ -1441,8 +1079,6 @@ static int shaper_handle_all(pr_ctrls_t *ctrl, int reqargc,
 static int shaper_handle_info(pr_ctrls_t *ctrl, int reqargc,
     char **reqargv) {
   register unsigned int i;
-  struct shaper_sess *sess_list;
-  unsigned int total_downshares = 0, total_upshares = 0;
   char *downbuf = NULL, *upbuf = NULL;
   size_t downbufsz = 14, upbufsz = 14;
 
@@ -1453,34 +1089,15 @@ static int shaper_handle_info(pr_ctrls_t *ctrl, int reqargc,
     return -1;
   }
 
-  if (shaper_table_refresh() < 0) {
-    int xerrno = errno;
-    shaper_table_lock(LOCK_UN);
-
-    (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-      "error refreshing ShaperTable: %s", strerror(xerrno));
-    pr_ctrls_add_response(ctrl, "error handling request");
-    return -1;
-  }
-
   pr_ctrls_add_response(ctrl, "Overall Rates: %3.2Lf KB/s down, %3.2Lf KB/s up",
-    shaper_tab.downrate, shaper_tab.uprate);
+    shaper_map->downrate, shaper_map->uprate);
   pr_ctrls_add_response(ctrl, "Default Shares Per Session: %u down, %u up",
-    shaper_tab.def_downshares, shaper_tab.def_upshares);
-  pr_ctrls_add_response(ctrl, "Default Priority: %u", shaper_tab.def_prio);
+    shaper_map->def_downshares, shaper_map->def_upshares);
+  pr_ctrls_add_response(ctrl, "Default Priority: %u", shaper_map->def_prio);
   pr_ctrls_add_response(ctrl, "Number of Shaped Sessions: %u",
-    shaper_tab.nsessions);
-
-  sess_list = shaper_tab.sess_list->elts;
-
-  for (i = 0; i < shaper_tab.nsessions; i++) {
-    total_downshares += (shaper_tab.def_downshares +
-      sess_list[i].sess_downincr);
-    total_upshares += (shaper_tab.def_upshares +
-      sess_list[i].sess_upincr);
-  }
+    shaper_map->nsessions);
 
-  if (shaper_tab.nsessions) {
+  if (shaper_map->nsessions) {
     pr_ctrls_add_response(ctrl, "%-5s %8s %-14s %11s %-14s %11s",
       "PID", "Priority", "DShares", "DRate (KB/s)", "UShares", "URate (KB/s)");
     pr_ctrls_add_response(ctrl, "----- -------- -------------- ------------ -------------- ------------");
@@ -1488,23 +1105,33 @@ static int shaper_handle_info(pr_ctrls_t *ctrl, int reqargc,
     upbuf = palloc(ctrl->ctrls_tmp_pool, upbufsz);
   }
 
-  for (i = 0; i < shaper_tab.nsessions; i++) {
+  for (i = 0; i < SHAPER_MAX_SESSIONS; i++) {
+    struct shaper_sess *sess = &(shaper_map->sess_list[i]);
+    long double downrate, uprate;
+
+    if (sess->sess_pid == 0) {
+      continue;
+    }
+
+    shaper_sess_get_rates(sess, shaper_map->total_downshares,
+      shaper_map->total_upshares, &downrate, &uprate);
+
     memset(downbuf, '\0', downbufsz);
     memset(upbuf, '\0', upbufsz);
 
     pr_snprintf(downbuf, downbufsz, "%u/%u (%s%d)",
-      shaper_tab.def_downshares + sess_list[i].sess_downincr, total_downshares,
-      sess_list[i].sess_downincr > 0 ? "+" : "", sess_list[i].sess_downincr);
+      shaper_sess_downshares(sess), shaper_map->total_downshares,
+      sess->sess_downincr > 0 ? "+" : "", sess->sess_downincr);
     downbuf[downbufsz-1] = '\0';
 
     pr_snprintf(upbuf, upbufsz, "%u/%u (%s%d)",
-      shaper_tab.def_upshares + sess_list[i].sess_upincr, total_upshares,
-      sess_list[i].sess_upincr > 0 ? "+" : "", sess_list[i].sess_upincr);
+      shaper_sess_upshares(sess), shaper_map->total_upshares,
+      sess->sess_upincr > 0 ? "+" : "", sess->sess_upincr);
     upbuf[upbufsz-1] = '\0';
 
     pr_ctrls_add_response(ctrl, "%5u %8u %14s  %11.2Lf %14s  %11.2Lf",
-      (unsigned int) sess_list[i].sess_pid, sess_list[i].sess_prio,
-      downbuf, sess_list[i].sess_downrate, upbuf, sess_list[i].sess_uprate);
+      (unsigned int) sess->sess_pid, sess->sess_prio, downbuf, downrate,
+      upbuf, uprate);
   }
 
   shaper_table_lock(LOCK_UN);
@@ -2097,14 +1724,15 @@ MODRET shaper_post_pass(cmd_rec *cmd) {
     return PR_DECLINED(cmd);
   }
 
-  if (shaper_tabfd < 0) {
+  if (shaper_tabfd < 0 ||
+      shaper_map == NULL) {
     (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
       "ShaperTable not open, disabling ShaperEngine");
     shaper_engine = FALSE;
     return PR_DECLINED(cmd);
   }
 
-  if (shaper_tab.downrate < 0.0 || shaper_tab.uprate < 0.0) {
+  if (shaper_map->downrate < 0.0 || shaper_map->uprate < 0.0) {
     (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
       "overall rates negative or not configured, disabling ShaperEngine");
     shaper_engine = FALSE;
@@ -2112,8 +1740,6 @@ MODRET shaper_post_pass(cmd_rec *cmd) {
   }
 
   pr_event_register(&shaper_module, "core.exit", shaper_sess_exit_ev, NULL);
-  pr_event_register(&shaper_module, "core.signal.USR2", shaper_sigusr2_ev,
-    NULL);
 
   c = find_config(TOPLEVEL_CONF, CONF_PARAM, "ShaperSession", FALSE);
   if (c) {
@@ -2126,8 +1752,15 @@ MODRET shaper_post_pass(cmd_rec *cmd) {
   if (shaper_table_sess_add(getpid(), prio, downincr, upincr) < 0) {
     (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
       "error adding session to ShaperTable: %s", strerror(errno));
+    return PR_DECLINED(cmd);
   }
 
+  /* Apply this session's initial rates, and check for changes to them
+   * during transfers.
+   */
+  (void) shaper_sess_poll();
+  pr_throttle_set_rate_poll(shaper_sess_poll);
+
   return PR_DECLINED(cmd);
 }
 
@@ -2145,17 +1778,13 @@ MODRET shaper_post_err_pass(cmd_rec *cmd) {
 
 static void shaper_shutdown_ev(const void *event_data, void *user_data) {
 
-  /* Remove the queue from the system, and delete the ShaperTable.  We can
+  /* Delete the ShaperTable.  We can
    * only do this reliably when the standalone daemon process exits; if it's
    * an inetd process, there may be other proftpd processes still running.
    */
   if (getpid() == mpid &&
       ServerType == SERVER_STANDALONE) {
 
-    if (shaper_qid >= 0) {
-      shaper_remove_queue();
-    }
-
     if (shaper_tab_path) {
       if (pr_fsio_unlink(shaper_tab_path) < 0) {
         pr_log_debug(DEBUG9, MOD_SHAPER_VERSION
@@ -2168,6 +1797,7 @@ static void shaper_shutdown_ev(const void *event_data, void *user_data) {
 }
 
 static void shaper_sess_exit_ev(const void *event_data, void *user_data) {
+  pr_throttle_set_rate_poll(NULL);
 
   /* Remove this session from the ShaperTable. */
   if (shaper_table_sess_remove(getpid()) < 0) {
@@ -2175,9 +1805,7 @@ static void shaper_sess_exit_ev(const void *event_data, void *user_data) {
       "error removing session from ShaperTable: %s", strerror(errno));
   }
 
-  /* Clear any messages for this session from the queue as well. */
-  shaper_msg_clear(getpid());
-
+  shaper_sess_idx = -1;
   return;
 }
 
@@ -2198,9 +1826,9 @@ static void shaper_mod_unload_ev(const void *event_data, void *user_data) {
     if (shaper_pool) {
       destroy_pool(shaper_pool);
       shaper_pool = NULL;
-      shaper_tab_pool = NULL;
-      shaper_tab.sess_list = NULL;
     }
+
+    shaper_table_close();
   }
 }
 #endif /* PR_SHARED_MODULE */
@@ -2266,60 +1894,15 @@ static void shaper_postparse_ev(const void *event_data, void *user_data) {
     }
 
     /* Initialize ShaperTable */
-    if (shaper_table_init(fh) < 0)
+    if (shaper_table_init(fh) < 0) {
       (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
         "error initializing ShaperTable: %s", strerror(errno));
-
-    (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-      "determining queue ID for path '%s'", shaper_tab_path);
-
-    shaper_qid = shaper_get_queue(shaper_tab_path);
-    if (shaper_qid < 0) {
-      (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-        "error obtaining queue ID: %s", strerror(errno));
-
-    } else {
-      struct msqid_ds ds;
-
-      (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-        "obtained queue ID %d", shaper_qid);
-
-      if (msgctl(shaper_qid, IPC_STAT, &ds) < 0) {
-        (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-          "error checking queue ID %d: %s", shaper_qid, strerror(errno));
-
-      } else {
-        shaper_qmaxbytes = ds.msg_qbytes;
-      }
-
-      /* We could be being restarted, in which case we want to send our
-       * reinitialized table to existing sessions.
-       */
-
-      if (shaper_table_lock(LOCK_EX) < 0) {
-        (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-          "error locking ShaperTable: %s", strerror(errno));
-        return;
-      }
-
-      if (shaper_table_refresh() < 0) {
-        shaper_table_lock(LOCK_UN);
-        return;
-      }
-
-      if (shaper_table_send() < 0) {
-        shaper_table_lock(LOCK_UN);
-        return;
-      }
-
-      if (shaper_table_flush() < 0) {
-        shaper_table_lock(LOCK_UN);
-        return;
-      }
-
-      shaper_table_lock(LOCK_UN);
     }
 
+    /* Sessions which outlive a restart keep using the existing table, and
+     * need not be told about it.
+     */
+
     if (shaper_scrub_timer_id == -1) {
       shaper_scrub_timer_id = pr_timer_add(SHAPER_SCRUB_INTERVAL, -1,
         &shaper_module, shaper_table_scrub_cb, "shaper table scrubber");
@@ -2341,10 +1924,15 @@ static void shaper_restart_ev(const void *event_data, void *user_data) {
 
   if (shaper_pool) {
     destroy_pool(shaper_pool);
+  }
 
-    /* Make sure to mark subpools as invalid now as well. */
-    shaper_tab_pool = NULL;
-    shaper_tab.sess_list = NULL;
+  /* The ShaperTable is mapped and opened anew once the configuration has
+   * been re-read.
+   */
+  shaper_table_close();
+  if (shaper_tabfd >= 0) {
+    (void) close(shaper_tabfd);
+    shaper_tabfd = -1;
   }
 
   shaper_pool = make_sub_pool(permanent_pool);
@@ -2363,33 +1951,6 @@ static void shaper_restart_ev(const void *event_data, void *user_data) {
   return;
 }
 
-static void shaper_sigusr2_ev(const void *event_data, void *user_data) {
-  int res;
-
-  /* Check the queue for any messages for us. */
-  res = shaper_msg_recv();
-
-  switch (res) {
-    case -1:
-      (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-        "error receiving updates for pid %lu: %s", (unsigned long) getpid(),
-        strerror(errno));
-      break;
-
-    case 0:
-      (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-        "received signal, no updates for pid %lu", (unsigned long) getpid());
-      break;
-
-    default:
-      (void) pr_log_writefile(shaper_logfd, MOD_SHAPER_VERSION,
-        "received signal, read in %d %s for pid %lu", res,
-        res == 1 ? "update" : "updates", (unsigned long) getpid());
-  }
-
-  return;
-}
-
 /* Initialization functions
  */
 
@@ -2403,7 +1964,6 @@ static int shaper_init(void) {
   shaper_tab.def_downshares = SHAPER_DEFAULT_DOWNSHARES;
   shaper_tab.uprate = SHAPER_DEFAULT_RATE;
   shaper_tab.def_upshares = SHAPER_DEFAULT_UPSHARES;
-  shaper_tab.nsessions = 0;
 
   if (pr_ctrls_register(&shaper_module, "shaper", "tune mod_shaper settings",
       shaper_handle_shaper) < 0) {
@@ -1195,6 +1195,42 @@ int snmp_db_get_value(pool *p, unsigned int field, int32_t *int_value,
   return 0;
 }
 
+int snmp_db_peek_value(unsigned int field, uint32_t *value) {
+  void *db_data, *field_data;
+  int db_id;
+  off_t field_start;
+  size_t field_len;
+
+  if (value == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  db_id = snmp_db_get_field_db_id(field);
+  if (db_id < 0) {
+    return -1;
+  }
+
+  if (get_field_range(field, &field_start, &field_len) < 0) {
+    return -1;
+  }
+
+  db_data = snmp_dbs[db_id].db_data;
+  if (db_data == NULL ||
+      field_len != sizeof(uint32_t)) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  /* The field is read without taking its lock; a single aligned 32-bit
+   * value cannot be seen half-updated.
+   */
+  field_data = &(((uint32_t *) db_data)[field_start]);
+  *value = *((volatile uint32_t *) field_data);
+
+  return 0;
+}
+
 int snmp_db_incr_value(pool *p, unsigned int field, int32_t incr) {
   uint32_t orig_val, new_val;
   int db_id, res;
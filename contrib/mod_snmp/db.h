@@ -232,6 +232,12 @@ int snmp_db_close(pool *p, int db_id);
 int snmp_db_open(pool *p, int db_id);
 int snmp_db_get_value(pool *p, unsigned int field, int32_t *int_value,
   char **str_value, size_t *str_valuelen);
+
+/* Reads the value of a numeric field without locking it, for callers which
+ * only need a recent value, e.g. metrics.
+ */
+int snmp_db_peek_value(unsigned int field, uint32_t *value);
+
 int snmp_db_incr_value(pool *p, unsigned int field, int32_t incr);
 
 /* Used to reset/clear counters. */
@@ -3201,6 +3201,168 @@ MODRET snmp_err_ccc(cmd_rec *cmd) {
   return PR_DECLINED(cmd);
 }
 
+/* Metrics
+ */
+
+static void snmp_metrics_add(pr_metrics_t *metrics, const char *name,
+    unsigned int field, double scale, const char *label_name,
+    const char *label_value, const char *label_name2,
+    const char *label_value2) {
+  uint32_t value;
+
+  /* Fields of tables which are not in use (e.g. for modules which are not
+   * loaded) cannot be read, and are skipped.
+   */
+  if (snmp_db_peek_value(field, &value) < 0) {
+    return;
+  }
+
+  pr_metrics_add_sample(metrics, name, (double) value * scale, label_name,
+    label_value, label_name2, label_value2, NULL);
+}
+
+static int snmp_metrics_cb(pr_metrics_t *metrics, void *user_data) {
+  if (snmp_engine == FALSE) {
+    return 0;
+  }
+
+  pr_metrics_add_family(metrics, "proftpd_connections",
+    PR_METRICS_TYPE_COUNTER, "Connections accepted by the daemon");
+  snmp_metrics_add(metrics, "proftpd_connections_total",
+    SNMP_DB_DAEMON_F_CONN_TOTAL, 1.0, NULL, NULL, NULL, NULL);
+
+  pr_metrics_add_family(metrics, "proftpd_connections_refused",
+    PR_METRICS_TYPE_COUNTER, "Connections refused by the daemon");
+  snmp_metrics_add(metrics, "proftpd_connections_refused_total",
+    SNMP_DB_DAEMON_F_CONN_REFUSED_TOTAL, 1.0, NULL, NULL, NULL, NULL);
+
+  pr_metrics_add_family(metrics, "proftpd_logins", PR_METRICS_TYPE_COUNTER,
+    "Successful logins, by protocol");
+  snmp_metrics_add(metrics, "proftpd_logins_total",
+    SNMP_DB_FTP_LOGINS_F_TOTAL, 1.0, "protocol", "ftp", NULL, NULL);
+  snmp_metrics_add(metrics, "proftpd_logins_total",
+    SNMP_DB_FTPS_LOGINS_F_TOTAL, 1.0, "protocol", "ftps", NULL, NULL);
+
+  pr_metrics_add_family(metrics, "proftpd_login_failures",
+    PR_METRICS_TYPE_COUNTER, "Failed logins, by protocol and reason");
+  snmp_metrics_add(metrics, "proftpd_login_failures_total",
+    SNMP_DB_FTP_LOGINS_F_ERR_BAD_USER_TOTAL, 1.0, "protocol", "ftp",
+    "reason", "bad_user");
+  snmp_metrics_add(metrics, "proftpd_login_failures_total",
+    SNMP_DB_FTP_LOGINS_F_ERR_BAD_PASSWD_TOTAL, 1.0, "protocol", "ftp",
+    "reason", "bad_password");
+  snmp_metrics_add(metrics, "proftpd_login_failures_total",
+    SNMP_DB_FTP_LOGINS_F_ERR_GENERAL_TOTAL, 1.0, "protocol", "ftp",
+    "reason", "general");
+  snmp_metrics_add(metrics, "proftpd_login_failures_total",
+    SNMP_DB_FTPS_LOGINS_F_ERR_BAD_USER_TOTAL, 1.0, "protocol", "ftps",
+    "reason", "bad_user");
+  snmp_metrics_add(metrics, "proftpd_login_failures_total",
+    SNMP_DB_FTPS_LOGINS_F_ERR_BAD_PASSWD_TOTAL, 1.0, "protocol", "ftps",
+    "reason", "bad_password");
+  snmp_metrics_add(metrics, "proftpd_login_failures_total",
+    SNMP_DB_FTPS_LOGINS_F_ERR_GENERAL_TOTAL, 1.0, "protocol", "ftps",
+    "reason", "general");
+
+  pr_metrics_add_family(metrics, "proftpd_file_transfers",
+    PR_METRICS_TYPE_COUNTER, "Completed file transfers, by protocol and "
+    "direction");
+  snmp_metrics_add(metrics, "proftpd_file_transfers_total",
+    SNMP_DB_FTP_XFERS_F_FILE_DOWNLOAD_TOTAL, 1.0, "protocol", "ftp",
+    "direction", "download");
+  snmp_metrics_add(metrics, "proftpd_file_transfers_total",
+    SNMP_DB_FTP_XFERS_F_FILE_UPLOAD_TOTAL, 1.0, "protocol", "ftp",
+    "direction", "upload");
+  snmp_metrics_add(metrics, "proftpd_file_transfers_total",
+    SNMP_DB_FTPS_XFERS_F_FILE_DOWNLOAD_TOTAL, 1.0, "protocol", "ftps",
+    "direction", "download");
+  snmp_metrics_add(metrics, "proftpd_file_transfers_total",
+    SNMP_DB_FTPS_XFERS_F_FILE_UPLOAD_TOTAL, 1.0, "protocol", "ftps",
+    "direction", "upload");
+  snmp_metrics_add(metrics, "proftpd_file_transfers_total",
+    SNMP_DB_SFTP_XFERS_F_FILE_DOWNLOAD_TOTAL, 1.0, "protocol", "sftp",
+    "direction", "download");
+  snmp_metrics_add(metrics, "proftpd_file_transfers_total",
+    SNMP_DB_SFTP_XFERS_F_FILE_UPLOAD_TOTAL, 1.0, "protocol", "sftp",
+    "direction", "upload");
+  snmp_metrics_add(metrics, "proftpd_file_transfers_total",
+    SNMP_DB_SCP_XFERS_F_FILE_DOWNLOAD_TOTAL, 1.0, "protocol", "scp",
+    "direction", "download");
+  snmp_metrics_add(metrics, "proftpd_file_transfers_total",
+    SNMP_DB_SCP_XFERS_F_FILE_UPLOAD_TOTAL, 1.0, "protocol", "scp",
+    "direction", "upload");
+
+  /* The database records kilobytes transferred. */
+  pr_metrics_add_family(metrics, "proftpd_transferred_bytes",
+    PR_METRICS_TYPE_COUNTER, "Bytes of completed file transfers, "
+    "counted in whole KB, by protocol and direction");
+  snmp_metrics_add(metrics, "proftpd_transferred_bytes_total",
+    SNMP_DB_FTP_XFERS_F_KB_DOWNLOAD_TOTAL, 1024.0, "protocol", "ftp",
+    "direction", "download");
+  snmp_metrics_add(metrics, "proftpd_transferred_bytes_total",
+    SNMP_DB_FTP_XFERS_F_KB_UPLOAD_TOTAL, 1024.0, "protocol", "ftp",
+    "direction", "upload");
+  snmp_metrics_add(metrics, "proftpd_transferred_bytes_total",
+    SNMP_DB_FTPS_XFERS_F_KB_DOWNLOAD_TOTAL, 1024.0, "protocol", "ftps",
+    "direction", "download");
+  snmp_metrics_add(metrics, "proftpd_transferred_bytes_total",
+    SNMP_DB_FTPS_XFERS_F_KB_UPLOAD_TOTAL, 1024.0, "protocol", "ftps",
+    "direction", "upload");
+  snmp_metrics_add(metrics, "proftpd_transferred_bytes_total",
+    SNMP_DB_SFTP_XFERS_F_KB_DOWNLOAD_TOTAL, 1024.0, "protocol", "sftp",
+    "direction", "download");
+  snmp_metrics_add(metrics, "proftpd_transferred_bytes_total",
+    SNMP_DB_SFTP_XFERS_F_KB_UPLOAD_TOTAL, 1024.0, "protocol", "sftp",
+    "direction", "upload");
+  snmp_metrics_add(metrics, "proftpd_transferred_bytes_total",
+    SNMP_DB_SCP_XFERS_F_KB_DOWNLOAD_TOTAL, 1024.0, "protocol", "scp",
+    "direction", "download");
+  snmp_metrics_add(metrics, "proftpd_transferred_bytes_total",
+    SNMP_DB_SCP_XFERS_F_KB_UPLOAD_TOTAL, 1024.0, "protocol", "scp",
+    "direction", "upload");
+
+  pr_metrics_add_family(metrics, "proftpd_timeouts", PR_METRICS_TYPE_COUNTER,
+    "Sessions ended by timeouts, by timeout");
+  snmp_metrics_add(metrics, "proftpd_timeouts_total",
+    SNMP_DB_TIMEOUTS_F_IDLE_TOTAL, 1.0, "timeout", "idle", NULL, NULL);
+  snmp_metrics_add(metrics, "proftpd_timeouts_total",
+    SNMP_DB_TIMEOUTS_F_LOGIN_TOTAL, 1.0, "timeout", "login", NULL, NULL);
+  snmp_metrics_add(metrics, "proftpd_timeouts_total",
+    SNMP_DB_TIMEOUTS_F_NOXFER_TOTAL, 1.0, "timeout", "no_transfer", NULL,
+    NULL);
+  snmp_metrics_add(metrics, "proftpd_timeouts_total",
+    SNMP_DB_TIMEOUTS_F_STALLED_TOTAL, 1.0, "timeout", "stalled", NULL, NULL);
+
+  pr_metrics_add_family(metrics, "proftpd_bans", PR_METRICS_TYPE_GAUGE,
+    "Current bans, by type");
+  snmp_metrics_add(metrics, "proftpd_bans",
+    SNMP_DB_BAN_BANS_F_USER_BAN_COUNT, 1.0, "type", "user", NULL, NULL);
+  snmp_metrics_add(metrics, "proftpd_bans",
+    SNMP_DB_BAN_BANS_F_HOST_BAN_COUNT, 1.0, "type", "host", NULL, NULL);
+  snmp_metrics_add(metrics, "proftpd_bans",
+    SNMP_DB_BAN_BANS_F_CLASS_BAN_COUNT, 1.0, "type", "class", NULL, NULL);
+
+  pr_metrics_add_family(metrics, "proftpd_bans_added",
+    PR_METRICS_TYPE_COUNTER, "Bans added, by type");
+  snmp_metrics_add(metrics, "proftpd_bans_added_total",
+    SNMP_DB_BAN_BANS_F_USER_BAN_TOTAL, 1.0, "type", "user", NULL, NULL);
+  snmp_metrics_add(metrics, "proftpd_bans_added_total",
+    SNMP_DB_BAN_BANS_F_HOST_BAN_TOTAL, 1.0, "type", "host", NULL, NULL);
+  snmp_metrics_add(metrics, "proftpd_bans_added_total",
+    SNMP_DB_BAN_BANS_F_CLASS_BAN_TOTAL, 1.0, "type", "class", NULL, NULL);
+
+  pr_metrics_add_family(metrics, "proftpd_banned_connections",
+    PR_METRICS_TYPE_COUNTER, "Connections refused due to bans, by type");
+  snmp_metrics_add(metrics, "proftpd_banned_connections_total",
+    SNMP_DB_BAN_CONNS_F_USER_BAN_TOTAL, 1.0, "type", "user", NULL, NULL);
+  snmp_metrics_add(metrics, "proftpd_banned_connections_total",
+    SNMP_DB_BAN_CONNS_F_HOST_BAN_TOTAL, 1.0, "type", "host", NULL, NULL);
+  snmp_metrics_add(metrics, "proftpd_banned_connections_total",
+    SNMP_DB_BAN_CONNS_F_CLASS_BAN_TOTAL, 1.0, "type", "class", NULL, NULL);
+
+  return 0;
+}
+
 /* Event handlers
  */
 
@@ -3395,6 +3557,7 @@ static void snmp_mod_unload_ev(const void *event_data, void *user_data) {
 
     /* Unregister ourselves from all events. */
     pr_event_unregister(&snmp_module, NULL, NULL);
+    (void) pr_metrics_unregister(&snmp_module, NULL);
 
     for (i = 0; snmp_table_ids[i] > 0; i++) {
       snmp_db_close(snmp_pool, snmp_table_ids[i]);
@@ -3573,12 +3736,18 @@ static void snmp_postparse_ev(const void *event_data, void *user_data) {
     for (i = 0; snmp_table_ids[i] > 0; i++) {
       (void) snmp_db_close(snmp_pool, snmp_table_ids[i]);
     }
+
+    return;
   }
 
+  /* Export the counters as metrics as well. */
+  (void) pr_metrics_register(&snmp_module, "counters", snmp_metrics_cb, NULL);
   return;
 }
 
 static void snmp_restart_ev(const void *event_data, void *user_data) {
+  (void) pr_metrics_unregister(&snmp_module, NULL);
+
   if (snmp_engine == FALSE) {
     return;
   }
@@ -3609,6 +3778,8 @@ static void snmp_restart_ev(const void *event_data, void *user_data) {
 static void snmp_shutdown_ev(const void *event_data, void *user_data) {
   register unsigned int i;
 
+  (void) pr_metrics_unregister(&snmp_module, NULL);
+
   snmp_agent_stop(snmp_agent_pid);
 
   for (i = 0; snmp_table_ids[i] > 0; i++) {
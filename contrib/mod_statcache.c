@@ -375,7 +375,6 @@ static int statcache_unlock_stats(int fd) {
   return lock_table(fd, F_UNLCK, (6 * sizeof(uint32_t)));
 }
 
-#ifdef PR_USE_CTRLS
 static uint32_t statcache_stats_get_count(void) {
   uint32_t count = 0;
 
@@ -428,7 +427,6 @@ static uint32_t statcache_stats_get_rejects(void) {
     (5 * sizeof(uint32_t))));
   return rejects;
 }
-#endif /* PR_USE_CTRLS */
 
 static int statcache_stats_incr_count(int32_t incr) {
   uint32_t *count = NULL, *highest = NULL;
@@ -2186,6 +2184,48 @@ MODRET statcache_pre_list(cmd_rec *cmd) {
 }
 #endif /* MADV_WILLNEED */
 
+/* Metrics
+ */
+
+static int statcache_metrics_cb(pr_metrics_t *metrics, void *user_data) {
+  if (statcache_table_stats == NULL) {
+    return 0;
+  }
+
+  /* Like the "statcache info" control, the stats are read without locking
+   * the table; they are only approximate anyway.
+   */
+  pr_metrics_add_family(metrics, "proftpd_statcache_entries",
+    PR_METRICS_TYPE_GAUGE, "Entries in the StatCacheTable");
+  pr_metrics_add_sample(metrics, "proftpd_statcache_entries",
+    (double) statcache_stats_get_count(), NULL);
+
+  pr_metrics_add_family(metrics, "proftpd_statcache_entries_max",
+    PR_METRICS_TYPE_GAUGE, "Highest number of entries in the StatCacheTable");
+  pr_metrics_add_sample(metrics, "proftpd_statcache_entries_max",
+    (double) statcache_stats_get_highest(), NULL);
+
+  pr_metrics_add_family(metrics, "proftpd_statcache_lookups",
+    PR_METRICS_TYPE_COUNTER, "StatCacheTable lookups, by result");
+  pr_metrics_add_sample(metrics, "proftpd_statcache_lookups_total",
+    (double) statcache_stats_get_hits(), "result", "hit", NULL);
+  pr_metrics_add_sample(metrics, "proftpd_statcache_lookups_total",
+    (double) statcache_stats_get_misses(), "result", "miss", NULL);
+
+  pr_metrics_add_family(metrics, "proftpd_statcache_expired",
+    PR_METRICS_TYPE_COUNTER, "StatCacheTable entries expired");
+  pr_metrics_add_sample(metrics, "proftpd_statcache_expired_total",
+    (double) statcache_stats_get_expires(), NULL);
+
+  pr_metrics_add_family(metrics, "proftpd_statcache_rejected",
+    PR_METRICS_TYPE_COUNTER, "StatCacheTable entries rejected, due to a full "
+    "table");
+  pr_metrics_add_sample(metrics, "proftpd_statcache_rejected_total",
+    (double) statcache_stats_get_rejects(), NULL);
+
+  return 0;
+}
+
 /* Event handlers
  */
 
@@ -2293,6 +2333,7 @@ static void statcache_mod_unload_ev(const void *event_data, void *user_data) {
 #endif /* PR_USE_CTRLS */
 
     pr_event_unregister(&statcache_module, NULL, NULL);
+    (void) pr_metrics_unregister(&statcache_module, NULL);
 
     if (statcache_tabfh) {
       (void) pr_fsio_close(statcache_tabfh);
@@ -2415,6 +2456,8 @@ static void statcache_postparse_ev(const void *event_data, void *user_data) {
   statcache_nrows = (statcache_capacity / STATCACHE_COLS_PER_ROW);
   statcache_rowlen = (STATCACHE_COLS_PER_ROW * sizeof(struct statcache_entry));
 
+  (void) pr_metrics_register(&statcache_module, "stats", statcache_metrics_cb,
+    NULL);
   return;
 }
 
@@ -2423,6 +2466,8 @@ static void statcache_restart_ev(const void *event_data, void *user_data) {
   register unsigned int i;
 #endif /* PR_USE_CTRLS */
 
+  (void) pr_metrics_unregister(&statcache_module, NULL);
+
   if (statcache_pool) {
     destroy_pool(statcache_pool);
     statcache_pool = NULL;
@@ -0,0 +1,120 @@
+/*
+ * ProFTPD - FTP server daemon
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project and other respective copyright
+ * holders give permission to link this program with OpenSSL, and distribute
+ * the resulting executable, without including the source code for OpenSSL in
+ * the source distribution.
+ */
+
+/* Shared authentication cache */
+
+#ifndef PR_AUTHCACHE_H
+#define PR_AUTHCACHE_H
+
+/* The cache holds the results of getpwnam, getgrnam, and getgroups lookups,
+ * as answered by the auth modules (e.g. mod_sql, mod_ldap), in memory shared
+ * by the daemon and all of its session processes, so that sessions for the
+ * same users do not each query the backends again.  Lookups which no module
+ * answered are cached too, for a separate (usually shorter) time.  Password
+ * hashes are not cached.
+ *
+ * Results are cached per server, since each server may have its own
+ * AuthOrder and backend configuration, and, within a server, per <Anonymous>
+ * section in effect for the session, since auth configuration (e.g.
+ * SQLEngine) may be scoped to such a section.
+ *
+ * Every session trusts the cached results for its logins, e.g. for the UID
+ * and home directory of a user.  Thus only processes which can regain root
+ * privileges (i.e. the daemon, and sessions which have not revoked root via
+ * PRIVS_REVOKE, as for RootRevoke) may use the cache; such a process could
+ * change any user's entry in the system databases anyway.  Processes which
+ * revoke root release their mapping of the cache, and do their lookups
+ * without it.  For a daemon not run as root, all sessions run as the same
+ * user, and there is no such boundary to keep.
+ */
+
+#define PR_AUTHCACHE_TYPE_PWNAM		1
+#define PR_AUTHCACHE_TYPE_GRNAM		2
+#define PR_AUTHCACHE_TYPE_GROUPS	3
+
+/* Allocates the cache, with the given size in bytes, replacing (and thus
+ * clearing) any existing cache.  Found results are kept for ttl seconds, and
+ * not-found results for negative_ttl seconds; a negative_ttl of zero means
+ * that not-found results are not cached.  Must be called by the daemon
+ * process, before session processes are forked.
+ */
+int pr_authcache_init(size_t size, time_t ttl, time_t negative_ttl);
+
+/* Releases the cache. */
+int pr_authcache_free(void);
+
+/* Returns TRUE if the cache is allocated, FALSE otherwise. */
+int pr_authcache_enabled(void);
+
+/* The lookup functions return 0 if there is a cached result for the name,
+ * in which case the result (NULL or -1 for a cached not-found result) is
+ * allocated from the given pool, and the name of the module which answered
+ * the lookup, if any, is provided.  Otherwise they return -1, with errno set
+ * to ENOENT.
+ */
+int pr_authcache_get_pwnam(pool *p, const char *name, struct passwd **pw,
+  const char **module_name);
+int pr_authcache_get_grnam(pool *p, const char *name, struct group **gr,
+  const char **module_name);
+
+/* Adds the cached group IDs and names to the given arrays (either of which
+ * may be NULL), and provides the count returned by the module.
+ */
+int pr_authcache_get_groups(pool *p, const char *name, array_header *gids,
+  array_header *names, int *count, const char **module_name);
+
+/* Adds the result of a lookup, as answered by the named module, to the
+ * cache; a NULL result (or a count of -1) records that the name was not
+ * found.
+ */
+int pr_authcache_add_pwnam(const char *name, const struct passwd *pw,
+  const char *module_name);
+int pr_authcache_add_grnam(const char *name, const struct group *gr,
+  const char *module_name);
+int pr_authcache_add_groups(const char *name, const array_header *gids,
+  const array_header *names, int count, const char *module_name);
+
+/* Removes the cached results of the given type (or of all types, for a type
+ * of zero) for the given name, for all servers and <Anonymous> sections.
+ */
+int pr_authcache_remove(int type, const char *name);
+
+/* Removes all of the cached results. */
+int pr_authcache_clear(void);
+
+/* Statistics, per module answering lookups.  Hits are lookups answered from
+ * the cache; misses are lookups which the module answered, having not been
+ * found in the cache.  Lookups which no module answered are counted under a
+ * module name of "none".
+ */
+struct authcache_stats {
+  const char *module_name;
+  uint64_t hits;
+  uint64_t misses;
+};
+
+/* Returns the statistics, in an array allocated from the given pool. */
+array_header *pr_authcache_get_stats(pool *p);
+
+#endif /* PR_AUTHCACHE_H */
@@ -36,6 +36,9 @@
 typedef struct ipbind_rec {
   struct ipbind_rec *ib_next;
 
+  /* Next binding in the same chain of the address/port lookup index. */
+  struct ipbind_rec *ib_port_next;
+
   /* IP address to which this binding is "bound" */
   const pr_netaddr_t *ib_addr;
   unsigned int ib_port;
@@ -51,12 +54,17 @@ typedef struct ipbind_rec {
    */
   conn_t *ib_listener;
 
-  /* List of name-based servers bound to the above IP address.  Note that
-   * if this functionality becomes widely adopted and used, a more efficient
-   * search-and-lookup mechanism will be needed, for performance reasons.
+  /* List of name-based servers bound to the above IP address, in
+   * configuration order.
    */
   array_header *ib_namebinds;
 
+  /* Lookup index for the above name-based servers: a hash of all of the
+   * names, and a trie of the wildcard (glob) names, keyed by their literal
+   * trailing DNS labels.  Maintained by pr_namebind_create().
+   */
+  struct namebind_index_rec *ib_namebind_index;
+
   /* If this binding is the DefaultServer binding */
   unsigned char ib_isdefault;
 
@@ -162,6 +170,10 @@ int pr_namebind_create(server_rec *server, const char *name,
 /* Search the Bindings layer, and return the pr_namebind_t associated with
  * the given addr, port, and name.  If requested, skip over inactive
  * bindings while searching.
+ *
+ * An exactly matching name is preferred; otherwise, the wildcard names with
+ * the longest literal DNS suffix matching the given name are tried first,
+ * in configuration order.
  */
 pr_namebind_t *pr_namebind_find(const char *name, const pr_netaddr_t *addr,
   unsigned int port, unsigned char skip_inactive);
@@ -183,6 +195,12 @@ unsigned int pr_namebind_count(server_rec *);
 /* Initialize the Bindings layer. */
 void init_bindings(void);
 
+/* Initialize the Bindings layer as a standalone server would, but without
+ * creating any listening connections, e.g. when only checking the
+ * configuration.
+ */
+void init_bindings_check(void);
+
 /* Free the Bindings layer. */
 void free_bindings(void);
 
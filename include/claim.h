@@ -0,0 +1,75 @@
+/*
+ * ProFTPD - FTP server daemon
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project and other respective copyright
+ * holders give permission to link this program with OpenSSL, and distribute
+ * the resulting executable, without including the source code for OpenSSL in
+ * the source distribution.
+ */
+
+/* Claims on entries in memory shared between processes */
+
+#ifndef PR_CLAIM_H
+#define PR_CLAIM_H
+
+/* Tables kept in anonymous shared mappings (e.g. for latency statistics,
+ * or TransferAggregateRate buckets) hand out their entries without locks: a
+ * process claims an empty entry, fills in its key, and then marks it ready.
+ * While the entry is claimed, it holds the PID of the claiming process, and
+ * the time at which it was claimed.  Other processes wanting the entry wait
+ * for it to become ready; if the claiming process has exited, or has held
+ * the claim for longer than PR_CLAIM_STALE_SECS (e.g. because its PID has
+ * since been reused), the claim is stale, and is taken over.
+ */
+
+#define PR_CLAIM_EMPTY		0
+#define PR_CLAIM_READY		0xffffffffU
+
+#ifndef PR_CLAIM_STALE_SECS
+# define PR_CLAIM_STALE_SECS	10
+#endif /* PR_CLAIM_STALE_SECS */
+
+typedef struct {
+  /* PR_CLAIM_EMPTY, PR_CLAIM_READY, or the PID of the claiming process. */
+  volatile uint32_t state;
+
+  /* When the claim was made. */
+  volatile uint32_t claimed;
+} pr_claim_t;
+
+/* Claims the entry, if it is in the given state (PR_CLAIM_EMPTY or
+ * PR_CLAIM_READY).  Returns 0 if the entry was claimed, otherwise -1, with
+ * errno set to EBUSY.
+ */
+int pr_claim_acquire(pr_claim_t *claim, uint32_t state);
+
+/* Marks the claimed entry as ready, once it has been filled in. */
+void pr_claim_release(pr_claim_t *claim);
+
+/* Returns TRUE if the entry is ready, i.e. has been filled in. */
+int pr_claim_is_ready(pr_claim_t *claim);
+
+/* Waits for another process to finish filling in the entry.  Returns 0
+ * once the entry is ready.  If the claim is stale, it is taken over, and
+ * PR_CLAIM_TAKEN is returned; the caller then fills the entry in, and
+ * releases it, itself.
+ */
+int pr_claim_wait(pr_claim_t *claim);
+#define PR_CLAIM_TAKEN		1
+
+#endif /* PR_CLAIM_H */
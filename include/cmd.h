@@ -104,6 +104,9 @@ int pr_cmd_get_id(const char *name_name);
 #define PR_CMD_CLNT_ID		59
 #define PR_CMD_RANG_ID		60
 
+/* The highest of the above IDs. */
+#define PR_CMD_MAX_ID		PR_CMD_RANG_ID
+
 /* The minimum and maximum command name lengths. */
 #define PR_CMD_MIN_NAMELEN	3
 #define PR_CMD_MAX_NAMELEN	4
@@ -101,6 +101,11 @@
 #include "event.h"
 #include "var.h"
 #include "throttle.h"
+#include "claim.h"
+#include "stats.h"
+#include "metrics.h"
+#include "listcache.h"
+#include "authcache.h"
 #include "trace.h"
 #include "encode.h"
 #include "compat.h"
@@ -275,6 +275,37 @@ int pr_fsio_futimes(pr_fh_t *, struct timeval *);
 int pr_fsio_fsync(pr_fh_t *fh);
 off_t pr_fsio_lseek(pr_fh_t *, off_t, int);
 
+/* Directory scanning.  These stat(2) the entries of a directory opened via
+ * pr_fsio_opendir() relative to that open directory, rather than via their
+ * full paths, where the directory's filesystem allows for it.  The results
+ * do not use (or populate) the statcache.
+ */
+typedef struct {
+  const char *name;
+
+  /* File type (S_IFMT bits) of the entry, if known without a stat(2);
+   * zero otherwise.
+   */
+  mode_t type;
+
+  /* If a stat(2)/lstat(2) was requested: st_errno is zero, and st is
+   * filled in, on success.
+   */
+  int st_errno;
+  struct stat st;
+} pr_fs_dirent_t;
+
+/* Returns the next entry of the given directory, or NULL at the end of the
+ * directory.  The returned entry is valid until the next call.
+ */
+pr_fs_dirent_t *pr_fsio_readdir2(void *dir, int flags);
+#define PR_FSIO_READDIR_FL_STAT		0x001
+#define PR_FSIO_READDIR_FL_LSTAT	0x002
+
+/* Looks up the given entry name in the given open directory. */
+int pr_fsio_statat(void *dir, const char *name, struct stat *st, int flags);
+#define PR_FSIO_STATAT_FL_NOFOLLOW	0x001
+
 /* Extended attribute support */
 ssize_t pr_fsio_getxattr(pool *p, const char *, const char *, void *, size_t);
 ssize_t pr_fsio_lgetxattr(pool *, const char *, const char *, void *, size_t);
@@ -339,6 +370,7 @@ int pr_fsio_set_use_mkdtemp(int);
  */
 unsigned long pr_fsio_set_options(unsigned long opts);
 #define PR_FSIO_OPT_IGNORE_XATTR		0x00001
+#define PR_FSIO_OPT_IGNORE_RESOLVE_BENEATH	0x00002
 
 /* FS-related functions */
 
@@ -360,8 +392,8 @@ int pr_unregister_fs(const char *);
 void pr_fs_clear_cache(void);
 int pr_fs_clear_cache2(const char *path);
 
-/* Dump the current contents of the statcache via trace logging, to the
- * "fs.statcache" trace channel.
+/* Dump the current contents of the statcache, and its hit/miss/eviction
+ * counters, via trace logging, to the "fs.statcache" trace channel.
  */
 void pr_fs_statcache_dump(void);
 
@@ -381,6 +413,12 @@ void pr_fs_statcache_reset(void);
 int pr_fs_statcache_set_policy(unsigned int size, unsigned int max_age,
   unsigned int flags);
 
+/* Set the max age (in seconds) for cached failed lookups, e.g. for
+ * nonexistent paths.  These are kept no longer than the policy max age.
+ * A max age of zero disables the caching of failed lookups.
+ */
+int pr_fs_statcache_set_negative_max_age(unsigned int max_age);
+
 /* Copy a file from the given source path to the destination path. */
 int pr_fs_copy_file(const char *src, const char *dst);
 
@@ -394,6 +432,18 @@ int pr_fs_copy_file2(const char *src, const char *dst, int flags,
   void (*progress_cb)(int));
 #define PR_FSIO_COPY_FILE_FL_NO_DELETE_ON_FAILURE	0x0001
 
+/* Returns TRUE if reads from the given file handle go directly to read(2),
+ * and FALSE if a custom FS handles them (e.g. serving them from a cache).
+ * Code which reads the handle's fd itself, e.g. using sendfile(2), should
+ * only do so when this returns TRUE.
+ */
+int pr_fs_uses_sys_read(pr_fh_t *fh);
+
+/* Returns TRUE if writes to the given file handle go directly to write(2),
+ * and FALSE if a custom FS handles them.
+ */
+int pr_fs_uses_sys_write(pr_fh_t *fh);
+
 int pr_fs_setcwd(const char *);
 const char *pr_fs_getcwd(void);
 const char *pr_fs_getvwd(void);
@@ -486,6 +536,29 @@ void pr_fs_fadvise(int fd, off_t offset, off_t len, int advice);
 #define PR_FS_FADVISE_DONTNEED		14
 #define PR_FS_FADVISE_NOREUSE		15
 
+/* Start, or wait for, the writing of the dirty pages in the given section
+ * of the opened file to disk.  A len of zero means the section extends to
+ * the end of the file.  Returns -1 with errno set to ENOSYS if the platform
+ * cannot write out just a section of a file; PR_FS_SYNC_RANGE_DATASYNC,
+ * which ignores the section and syncs all of the file's data, is always
+ * supported.
+ */
+int pr_fs_sync_range(int fd, off_t offset, off_t len, int flags);
+#define PR_FS_SYNC_RANGE_WRITE		0x001
+#define PR_FS_SYNC_RANGE_WAIT		0x002
+#define PR_FS_SYNC_RANGE_DATASYNC	0x004
+
+/* Allocate (or deallocate) the disk blocks for the given section of the
+ * opened file, without changing the file size.  Preallocating the blocks
+ * for an upload of known size lets the filesystem lay the file out
+ * contiguously; blocks preallocated beyond the data actually written should
+ * be deallocated again once the upload is done.  Returns -1 with errno set
+ * to ENOSYS if the platform does not support this, or EOPNOTSUPP if the
+ * filesystem does not.
+ */
+int pr_fs_allocate(int fd, off_t offset, off_t len, int flags);
+#define PR_FS_ALLOCATE_FL_DEALLOCATE	0x001
+
 /* For internal use only. */
 int init_fs(void);
 
@@ -0,0 +1,114 @@
+/*
+ * ProFTPD - FTP server daemon
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project and other respective copyright
+ * holders give permission to link this program with OpenSSL, and distribute
+ * the resulting executable, without including the source code for OpenSSL in
+ * the source distribution.
+ */
+
+/* Rendered directory listing cache */
+
+#ifndef PR_LISTCACHE_H
+#define PR_LISTCACHE_H
+
+/* The cache holds the fully formatted output of directory listings (LIST,
+ * NLST, MLSD), in memory shared by the daemon and all of its session
+ * processes, so that a listing rendered by one session can be sent as is
+ * by other sessions listing the same, unchanged directory with the same
+ * options and the same view of that directory.
+ */
+
+/* Default ListCacheMaxAge, in seconds. */
+#define PR_LISTCACHE_DEFAULT_MAX_AGE	30
+
+/* Allocates the cache, with the given size in bytes, replacing (and thus
+ * clearing) any existing cache.  Must be called by the daemon process,
+ * before session processes are forked.
+ */
+int pr_listcache_init(size_t size);
+
+/* Releases the cache. */
+int pr_listcache_free(void);
+
+/* Returns TRUE if the cache is allocated, FALSE otherwise. */
+int pr_listcache_enabled(void);
+
+/* Returns TRUE if the cache is allocated, and ListCacheEngine is on in the
+ * current configuration context, FALSE otherwise.
+ */
+int pr_listcache_engine_enabled(void);
+
+/* Returns the size of the largest listing which can be cached, or zero
+ * if the cache is not allocated.
+ */
+size_t pr_listcache_get_max_size(void);
+
+/* Returns a key for the listing of the given directory, for the given
+ * command and listing options.  The key covers the directory's identity and
+ * timestamps, and the parts of the session (user, groups, class, client
+ * address, chroot, and the configuration in effect for the directory) which
+ * determine which entries are visible, and how they are shown.
+ */
+const char *pr_listcache_get_key(pool *p, const char *cmd_name,
+  const char *path, const struct stat *st, const char *opts);
+
+/* Looks up the listing for the given key, added no more than max_age
+ * seconds ago.  On success, a copy of the listing, allocated from the given
+ * pool, is returned in data and datalen.  Returns -1, with errno set to
+ * ENOENT, if there is no usable cached listing.
+ */
+int pr_listcache_get(pool *p, const char *key, time_t max_age,
+  char **data, size_t *datalen);
+
+/* Looks up the cached listing of the given directory, for the given command
+ * and listing options, using the ListCacheMaxAge in effect.  On success, the
+ * listing is returned in data and datalen, as for pr_listcache_get().
+ * Otherwise, -1 is returned, and key is set to the key under which the
+ * rendered listing is to be added, or to NULL if the listing is not to be
+ * cached (e.g. ListCacheEngine is off, or the directory has changed within
+ * the current second).
+ */
+int pr_listcache_lookup(pool *p, const char *cmd_name, const char *path,
+  const struct stat *st, const char *opts, const char **key, char **data,
+  size_t *datalen);
+
+/* Adds the listing for the given key to the cache.  Returns -1, with errno
+ * set to EAGAIN, if the listing could not be added due to another session
+ * adding a listing at the same time.
+ */
+int pr_listcache_add(const char *key, const char *data, size_t datalen);
+
+/* A listing being captured, as it is sent, for adding to the cache. */
+typedef struct {
+  char *data;
+  size_t datalen;
+  size_t datasz;
+} pr_listcache_buf_t;
+
+/* Appends the given data to the captured listing, growing its buffer (from
+ * the given pool) as needed.  Returns -1, with errno set to EFBIG, if the
+ * listing would then be too large to cache.
+ */
+int pr_listcache_append(pool *p, pr_listcache_buf_t *buf, const char *data,
+  size_t datalen);
+
+/* Removes all of the cached listings. */
+int pr_listcache_clear(void);
+
+#endif /* PR_LISTCACHE_H */
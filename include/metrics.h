@@ -0,0 +1,103 @@
+/*
+ * ProFTPD - FTP server daemon
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project and other respective copyright
+ * holders give permission to link this program with OpenSSL, and distribute
+ * the resulting executable, without including the source code for OpenSSL in
+ * the source distribution.
+ */
+
+/* Metrics exporter */
+
+#ifndef PR_METRICS_H
+#define PR_METRICS_H
+
+/* The daemon process serves metrics, in the OpenMetrics text format, to
+ * HTTP clients connecting to the MetricsListen Unix domain socket or
+ * loopback address.  The metrics are rendered from the scoreboard, the
+ * latency statistics, and any collectors registered by modules; none of
+ * these sources require locking the session processes out.
+ */
+
+typedef struct metrics_rec pr_metrics_t;
+
+/* Metric family types */
+#define PR_METRICS_TYPE_COUNTER		1
+#define PR_METRICS_TYPE_GAUGE		2
+#define PR_METRICS_TYPE_HISTOGRAM	3
+
+/* Adds the TYPE and HELP metadata for the given metric family; this must be
+ * called before adding the samples of that family.
+ */
+int pr_metrics_add_family(pr_metrics_t *metrics, const char *name, int type,
+  const char *help);
+
+/* Adds a sample with the given name (which, for counters, must include the
+ * "_total" suffix) and value.  The value is followed by a NULL-terminated
+ * list of label name and label value pairs, e.g.:
+ *
+ *  pr_metrics_add_sample(metrics, "proftpd_sessions", 3.0,
+ *    "server", "ProFTPD", "state", "idle", NULL);
+ */
+int pr_metrics_add_sample(pr_metrics_t *metrics, const char *name,
+  double value, ...);
+
+/* Adds the samples for the given latency histogram, in seconds, followed by
+ * a NULL-terminated list of label name and label value pairs; the family
+ * must have been added as PR_METRICS_TYPE_HISTOGRAM.
+ */
+int pr_metrics_add_histogram(pr_metrics_t *metrics, const char *name,
+  const pr_stats_histo_t *histo, ...);
+
+/* Registers a collector, called whenever the metrics are rendered.  A
+ * module's collectors are called in registration order, after the core
+ * collectors.
+ */
+int pr_metrics_register(module *m, const char *name,
+  int (*cb)(pr_metrics_t *metrics, void *user_data), void *user_data);
+
+/* Unregisters the named collector of the given module; if the name is NULL,
+ * all of the module's collectors are unregistered.
+ */
+int pr_metrics_unregister(module *m, const char *name);
+
+/* Renders all of the metrics, allocating the text from the given pool. */
+int pr_metrics_render(pool *p, char **text, size_t *textlen);
+
+/* Starts listening for metrics requests on the given address: either the
+ * path to a Unix domain socket, or a loopback "address:port".  Any previous
+ * listening socket is closed first.
+ */
+int pr_metrics_listen(const char *addr);
+
+/* Closes the listening socket, if any.  The Unix domain socket path is only
+ * removed by the process which created it.
+ */
+int pr_metrics_close(void);
+
+/* Adds the listening socket, if any, to the given set, returning the new
+ * maximum fd.
+ */
+int pr_metrics_set_fds(fd_set *rfds, int maxfd);
+
+/* Serves a pending metrics request, if the listening socket is in the given
+ * set.  Returns 1 if a request was pending, 0 otherwise.
+ */
+int pr_metrics_handle_fds(fd_set *rfds);
+
+#endif /* PR_METRICS_H */
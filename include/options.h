@@ -184,6 +184,15 @@
 # define PR_TUNABLE_SCOREBOARD_SCRUB_TIMER	30
 #endif
 
+/* Number of seconds allowed for serving a metrics request, from reading the
+ * request through writing the response; the daemon does not accept
+ * connections in the meantime.
+ */
+
+#ifndef PR_TUNABLE_METRICS_TIMEOUT
+# define PR_TUNABLE_METRICS_TIMEOUT	1
+#endif
+
 /* Maximum number of attempted updates to the scoreboard during a
  * file transfer before an actual write is done.  This is to allow
  * an optimization where the scoreboard is not updated on every loop
@@ -194,6 +203,15 @@
 # define PR_TUNABLE_XFER_SCOREBOARD_UPDATES	10
 #endif
 
+/* Maximum number of times per second that deferred scoreboard and process
+ * title updates, as made on high-frequency paths such as per-packet transfer
+ * progress, are actually written out.
+ */
+
+#ifndef PR_TUNABLE_DEFERRED_UPDATES_PER_SEC
+# define PR_TUNABLE_DEFERRED_UPDATES_PER_SEC	4
+#endif
+
 #ifndef PR_TUNABLE_CALLER_DEPTH
 /* Max depth of call stack if stacktrace support is enabled. */
 # define PR_TUNABLE_CALLER_DEPTH	32
@@ -254,4 +272,9 @@
 # define PR_TUNABLE_FS_STATCACHE_MAX_AGE	30
 #endif
 
+/* Max age of cached failed lookups (e.g. ENOENT). */
+#ifndef PR_TUNABLE_FS_STATCACHE_NEGATIVE_MAX_AGE
+# define PR_TUNABLE_FS_STATCACHE_NEGATIVE_MAX_AGE	5
+#endif
+
 #endif /* PR_OPTIONS_H */
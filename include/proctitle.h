@@ -42,6 +42,21 @@ void pr_proctitle_set(const char *, ...)
 
 void pr_proctitle_set_str(const char *);
 
+/* Like pr_proctitle_set(), except that the title may not be changed
+ * immediately; it is changed at most PR_TUNABLE_DEFERRED_UPDATES_PER_SEC
+ * times per second.  A pending title is set by the next pr_proctitle_set()
+ * or pr_proctitle_flush() call, or by a timer within a second or so.
+ */
+void pr_proctitle_set_deferred(const char *, ...)
+#ifdef __GNUC__
+       __attribute__ ((format (printf, 1, 2)));
+#else
+       ;
+#endif
+
+/* Sets any pending deferred title. */
+void pr_proctitle_flush(void);
+
 /* If this function is used, all subsquent calls to pr_proctitle_set() and
  * pr_proctitle_set_str() will effectively be ignored.
  */
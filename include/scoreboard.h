@@ -149,6 +149,49 @@ pr_scoreboard_entry_t *pr_scoreboard_entry_read(void);
 const char *pr_scoreboard_entry_get(int);
 int pr_scoreboard_entry_kill(pr_scoreboard_entry_t *, int);
 int pr_scoreboard_entry_update(pid_t, ...);
+
+/* Like pr_scoreboard_entry_update(), except that the changes may not be
+ * written to the scoreboard immediately; they are written at most
+ * PR_TUNABLE_DEFERRED_UPDATES_PER_SEC times per second.  Pending changes are
+ * written by the next pr_scoreboard_entry_update() or
+ * pr_scoreboard_entry_flush() call, or by a timer within a second or so.
+ * Use this for updates on high-frequency paths, such as per-packet
+ * transfer progress.
+ */
+int pr_scoreboard_entry_update_deferred(pid_t, ...);
+
+/* Writes any pending deferred changes to the scoreboard. */
+int pr_scoreboard_entry_flush(void);
+
 int pr_scoreboard_entry_lock(int, int);
 
+/* Session count types, for pr_scoreboard_get_count().  Each counts the
+ * entries with the given server address (e.g. "127.0.0.1:21") and:
+ */
+#define PR_SCORE_COUNT_SERVER		1	/* (nothing else) */
+#define PR_SCORE_COUNT_HOST		2	/* client address */
+#define PR_SCORE_COUNT_CLASS		3	/* class (case-insensitive) */
+#define PR_SCORE_COUNT_USER		4	/* user */
+#define PR_SCORE_COUNT_USER_HOST	5	/* user, client address */
+#define PR_SCORE_COUNT_HOST_CMD		6	/* client address, command */
+#define PR_SCORE_COUNT_USER_CMD		7	/* user, command */
+
+/* Count only the entries whose user is not "(none)"; may be combined with
+ * PR_SCORE_COUNT_SERVER, PR_SCORE_COUNT_HOST, and PR_SCORE_COUNT_CLASS.  The
+ * PR_SCORE_COUNT_USER and PR_SCORE_COUNT_USER_HOST counts always exclude
+ * the "(none)" user.
+ */
+#define PR_SCORE_COUNT_FL_AUTH		0x100
+
+/* Looks up the number of scoreboard entries matching the given type and
+ * names, without scanning the scoreboard.  Returns -1, with errno set to
+ * ENOSYS or EAGAIN, if the counts are not kept (e.g. for inetd servers), or
+ * are not currently reliable; callers should then scan the scoreboard.
+ */
+int pr_scoreboard_get_count(int type, const char *server_addr,
+  const char *name, const char *name2, unsigned int *count);
+
+/* Internal use only */
+int init_scoreboard_counters(void);
+
 #endif /* PR_SCOREBOARD_H */
@@ -117,6 +117,11 @@ void pr_session_send_banner(server_rec *, int);
  */
 int pr_session_set_idle(void);
 
+/* Like pr_session_set_idle(), using the deferred scoreboard and proctitle
+ * updates, for callers which mark the session idle between every packet.
+ */
+int pr_session_set_idle_deferred(void);
+
 /* Sets the current protocol name. */
 int pr_session_set_protocol(const char *);
 
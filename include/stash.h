@@ -51,6 +51,19 @@ int pr_stash_remove_cmd(const char *cmd_name, module *m,
 int pr_stash_remove_auth(const char *api_name, module *m);
 int pr_stash_remove_hook(const char *hook_name, module *m);
 
+/* Returns the NULL-terminated list of CMD symbols, for the given command
+ * name and cmd_type (PRE_CMD, CMD, POST_CMD, etc), in the order in which they
+ * are to be dispatched; this is the same order in which they would be
+ * returned by pr_stash_get_symbol2().  The cmd_id, if known (i.e. greater
+ * than zero), is used to find the list without hashing the name.
+ *
+ * The lists are resolved once, and then reused until the CMD symbols change,
+ * e.g. due to a module being loaded or unloaded; callers should thus not
+ * hold on to a returned list.  Returns NULL, with errno set, on error.
+ */
+cmdtable **pr_stash_get_cmd_handlers(const char *cmd_name, int cmd_id,
+  unsigned char cmd_type);
+
 void pr_stash_dump(void (*)(const char *, ...));
 
 /* Internal use only */
@@ -0,0 +1,108 @@
+/*
+ * ProFTPD - FTP server daemon
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project and other respective copyright
+ * holders give permission to link this program with OpenSSL, and distribute
+ * the resulting executable, without including the source code for OpenSSL in
+ * the source distribution.
+ */
+
+/* Command latency statistics */
+
+#ifndef PR_STATS_H
+#define PR_STATS_H
+
+/* Number of buckets in a latency histogram.  Bucket 0 counts latencies of
+ * less than 1 usec; bucket N counts latencies of at least 2^(N-1), and less
+ * than 2^N, usecs.  The last bucket also counts all longer latencies.
+ */
+#define PR_STATS_HISTO_NBUCKETS		26
+
+typedef struct {
+  uint64_t count;
+  uint64_t total_usecs;
+  uint64_t max_usecs;
+  uint64_t buckets[PR_STATS_HISTO_NBUCKETS];
+} pr_stats_histo_t;
+
+/* The histograms are kept in memory shared by the daemon and all of its
+ * session processes, keyed by command name, module name (for the latencies
+ * of individual module handlers), and dispatch phase (PRE_CMD, CMD, etc).
+ * A phase of zero is used for latencies covering all of the phases of a
+ * command dispatch, and for module handlers called outside of a command
+ * dispatch (e.g. for the Auth API).
+ */
+
+/* Returns the current time, in usecs, for use in measuring latencies. */
+uint64_t pr_stats_get_usecs(void);
+
+/* Returns TRUE if latencies are being recorded, FALSE otherwise. */
+int pr_stats_enabled(void);
+
+/* Records the latency of dispatching the given command, for the given
+ * phase.
+ */
+int pr_stats_add_cmd(const char *cmd_name, int phase, uint64_t usecs);
+
+/* Records the latency of the given module's handler for the given command
+ * (or Auth API call), for the given phase.
+ */
+int pr_stats_add_handler(const char *module_name, const char *cmd_name,
+  int phase, uint64_t usecs);
+
+/* Calls the given callback for each recorded histogram; the module_name is
+ * NULL for command histograms.  Walking stops if the callback returns
+ * non-zero.
+ */
+int pr_stats_walk(int (*cb)(const char *module_name, const char *cmd_name,
+  int phase, const pr_stats_histo_t *histo, void *user_data), void *user_data);
+
+/* Returns the latency, in usecs, below which the given percentage of the
+ * histogram's latencies fall; this is the upper bound of the bucket which
+ * contains that percentile.
+ */
+uint64_t pr_stats_histo_get_percentile(const pr_stats_histo_t *histo,
+  unsigned int pct);
+
+/* A streaming median estimator, small enough to be kept in shared memory
+ * and updated by many processes at once without locking.  Each value moves
+ * the estimate toward it by a fraction of the running median deviation, so
+ * that the estimate settles around the median of the recent values.  A
+ * zeroed estimator is empty.
+ */
+typedef struct {
+  volatile uint64_t state;
+  volatile uint32_t count;
+} pr_stats_median_t;
+
+/* Adds a value to the estimator. */
+int pr_stats_median_add(pr_stats_median_t *median, uint32_t value);
+
+/* Returns the current median estimate, or -1 (with errno set to ENOENT) if
+ * no values have been added.
+ */
+long pr_stats_median_get(const pr_stats_median_t *median);
+
+/* Clears all of the recorded latencies. */
+int pr_stats_reset(void);
+
+/* Internal use only */
+int init_stats(void);
+int free_stats(void);
+
+#endif /* PR_STATS_H */
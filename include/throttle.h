@@ -31,4 +31,37 @@ int pr_throttle_have_rate(void);
 void pr_throttle_init(cmd_rec *);
 void pr_throttle_pause(off_t, int);
 
+/* Sets a function to be called before each throttling pause, which returns
+ * TRUE if it has changed the TransferRates in effect for the session (e.g.
+ * by adding TransferRate config_recs).  The changed rate is then applied to
+ * the rest of the current transfer.  Use NULL to remove the function.
+ */
+void pr_throttle_set_rate_poll(int (*poll)(void));
+
+/* TransferAggregateRate token buckets, shared by all session processes.
+ * These are used by pr_throttle_init() and pr_throttle_pause(), and are
+ * exposed for testing; times are in usecs, as from pr_stats_get_usecs().
+ */
+typedef struct throttle_bucket pr_throttle_bucket_t;
+
+/* Returns the bucket for the given key, with the given rate (in bytes per
+ * sec) and burst (in bytes), claiming an empty bucket, or reusing an idle
+ * one, if need be.  Returns NULL, with errno set to ENOSPC, if the table is
+ * full.
+ */
+pr_throttle_bucket_t *pr_throttle_bucket_get(const char *key, uint64_t rate,
+  uint64_t burst, uint64_t now);
+
+/* Refills the bucket for the time elapsed, and debits the given number of
+ * bytes from it.  Returns the number of usecs to wait until any resulting
+ * debt has been repaid, or -1, with errno set to ESTALE, if the bucket has
+ * since been reused for another key.
+ */
+long pr_throttle_bucket_debit(pr_throttle_bucket_t *tb, const char *key,
+  off_t nbytes, uint64_t now);
+
+/* Internal use only */
+int init_throttle(void);
+int free_throttle(void);
+
 #endif /* PR_THROTTLE_H */
@@ -76,5 +76,6 @@ int pr_timer_usleep(unsigned long usecs);
 /* For internal use only. */
 void handle_alarm(void);
 void timers_init(void);
+void timers_reset_alarm(void);
 
 #endif /* PR_TIMERS_H */
@@ -37,10 +37,25 @@
 # include <sys/audit.h>
 #endif
 
+#if defined(PR_USE_CTRLS)
+# include <mod_ctrls.h>
+#endif /* PR_USE_CTRLS */
+
 extern pid_t mpid;
 
 module auth_module;
 
+/* AuthCache defaults */
+#define AUTH_DEFAULT_CACHE_SIZE		(1024 * 1024)
+#define AUTH_DEFAULT_CACHE_TTL		300
+#define AUTH_DEFAULT_CACHE_NEGATIVE_TTL	60
+
+static pool *auth_cache_pool = NULL;
+
+#if defined(PR_USE_CTRLS)
+static ctrls_acttab_t auth_cache_acttab[];
+#endif /* PR_USE_CTRLS */
+
 #ifdef PR_USE_LASTLOG
 static unsigned char lastlog = FALSE;
 #endif /* PR_USE_LASTLOG */
@@ -164,10 +179,227 @@ static void auth_sess_reinit_ev(const void *event_data, void *user_data) {
   }
 }
 
+static void auth_postparse_ev(const void *event_data, void *user_data) {
+  config_rec *c;
+  off_t size = AUTH_DEFAULT_CACHE_SIZE;
+  time_t ttl = AUTH_DEFAULT_CACHE_TTL;
+  time_t negative_ttl = AUTH_DEFAULT_CACHE_NEGATIVE_TTL;
+
+  c = find_config(main_server->conf, CONF_PARAM, "AuthCacheEngine", FALSE);
+  if (c == NULL ||
+      *((int *) c->argv[0]) == FALSE) {
+    return;
+  }
+
+  c = find_config(main_server->conf, CONF_PARAM, "AuthCacheSize", FALSE);
+  if (c != NULL) {
+    size = *((off_t *) c->argv[0]);
+  }
+
+  c = find_config(main_server->conf, CONF_PARAM, "AuthCacheTTL", FALSE);
+  if (c != NULL) {
+    ttl = *((time_t *) c->argv[0]);
+    negative_ttl = *((time_t *) c->argv[1]);
+  }
+
+  if (pr_authcache_init((size_t) size, ttl, negative_ttl) < 0) {
+    pr_log_pri(PR_LOG_NOTICE, "unable to allocate AuthCacheSize %" PR_LU
+      " bytes: %s", (pr_off_t) size, strerror(errno));
+  }
+}
+
+static void auth_restart_ev(const void *event_data, void *user_data) {
+#if defined(PR_USE_CTRLS)
+  register unsigned int i;
+#endif /* PR_USE_CTRLS */
+
+  /* The backends and their configuration may have changed; the postparse
+   * event listener allocates a new, empty cache, if need be.
+   */
+  (void) pr_authcache_free();
+
+  if (auth_cache_pool != NULL) {
+    destroy_pool(auth_cache_pool);
+  }
+
+  auth_cache_pool = make_sub_pool(permanent_pool);
+  pr_pool_tag(auth_cache_pool, "mod_auth AuthCache pool");
+
+#if defined(PR_USE_CTRLS)
+  for (i = 0; auth_cache_acttab[i].act_action; i++) {
+    auth_cache_acttab[i].act_acl = pcalloc(auth_cache_pool,
+      sizeof(ctrls_acl_t));
+    pr_ctrls_init_acl(auth_cache_acttab[i].act_acl);
+  }
+#endif /* PR_USE_CTRLS */
+}
+
+/* Control handlers
+ */
+
+#if defined(PR_USE_CTRLS)
+static int auth_cache_handle_info(pr_ctrls_t *ctrl, int reqargc,
+    char **reqargv) {
+  register unsigned int i;
+  pool *tmp_pool;
+  array_header *stats;
+  struct authcache_stats *elts;
+
+  tmp_pool = make_sub_pool(ctrl->ctrls_tmp_pool);
+  stats = pr_authcache_get_stats(tmp_pool);
+  if (stats == NULL) {
+    pr_ctrls_add_response(ctrl, "error reading AuthCache statistics: %s",
+      strerror(errno));
+    destroy_pool(tmp_pool);
+    return -1;
+  }
+
+  if (stats->nelts == 0) {
+    pr_ctrls_add_response(ctrl, "AuthCache: no lookups");
+    destroy_pool(tmp_pool);
+    return 0;
+  }
+
+  pr_ctrls_add_response(ctrl, "AuthCache lookups, by answering module:");
+
+  elts = stats->elts;
+  for (i = 0; i < stats->nelts; i++) {
+    uint64_t total;
+
+    total = elts[i].hits + elts[i].misses;
+    pr_ctrls_add_response(ctrl, "  %s%s: %" PR_LU " hits, %" PR_LU
+      " misses (%.1f%% hit rate)",
+      strcmp(elts[i].module_name, "none") != 0 ? "mod_" : "",
+      strcmp(elts[i].module_name, "none") != 0 ? elts[i].module_name :
+        "(not found)", (pr_off_t) elts[i].hits, (pr_off_t) elts[i].misses,
+      total > 0 ? ((double) elts[i].hits * 100.0) / total : 0.0);
+  }
+
+  destroy_pool(tmp_pool);
+  return 0;
+}
+
+static int auth_cache_handle_clear(pr_ctrls_t *ctrl, int reqargc,
+    char **reqargv) {
+  int type = 0, res;
+  const char *name;
+
+  if (reqargc == 0) {
+    if (pr_authcache_clear() < 0) {
+      pr_ctrls_add_response(ctrl, "error clearing AuthCache: %s",
+        strerror(errno));
+      return -1;
+    }
+
+    pr_ctrls_add_response(ctrl, "AuthCache cleared");
+    return 0;
+  }
+
+  /* usage: clear [user|group|groups] name */
+  if (reqargc == 2) {
+    if (strcmp(reqargv[0], "user") == 0) {
+      type = PR_AUTHCACHE_TYPE_PWNAM;
+
+    } else if (strcmp(reqargv[0], "group") == 0) {
+      type = PR_AUTHCACHE_TYPE_GRNAM;
+
+    } else if (strcmp(reqargv[0], "groups") == 0) {
+      type = PR_AUTHCACHE_TYPE_GROUPS;
+
+    } else {
+      pr_ctrls_add_response(ctrl, "unknown AuthCache entry type: '%s'",
+        reqargv[0]);
+      return -1;
+    }
+
+    name = reqargv[1];
+
+  } else if (reqargc == 1) {
+    name = reqargv[0];
+
+  } else {
+    pr_ctrls_add_response(ctrl, "authcache clear: wrong number of parameters");
+    return -1;
+  }
+
+  res = pr_authcache_remove(type, name);
+  if (res < 0) {
+    pr_ctrls_add_response(ctrl, "error removing '%s' from AuthCache: %s",
+      name, strerror(errno));
+    return -1;
+  }
+
+  pr_ctrls_add_response(ctrl, "removed %d AuthCache %s for '%s'", res,
+    res != 1 ? "entries" : "entry", name);
+  return 0;
+}
+
+static int auth_cache_handle_authcache(pr_ctrls_t *ctrl, int reqargc,
+    char **reqargv) {
+
+  if (pr_authcache_enabled() == FALSE) {
+    pr_ctrls_add_response(ctrl, "authcache: AuthCache disabled");
+    return -1;
+  }
+
+  if (reqargc == 0 ||
+      reqargv == NULL) {
+    pr_ctrls_add_response(ctrl, "authcache: missing required parameters");
+    return -1;
+  }
+
+  if (strcmp(reqargv[0], "info") == 0) {
+
+    if (!pr_ctrls_check_acl(ctrl, auth_cache_acttab, "info")) {
+      pr_ctrls_add_response(ctrl, "access denied");
+      return -1;
+    }
+
+    return auth_cache_handle_info(ctrl, --reqargc, ++reqargv);
+
+  } else if (strcmp(reqargv[0], "clear") == 0) {
+
+    if (!pr_ctrls_check_acl(ctrl, auth_cache_acttab, "clear")) {
+      pr_ctrls_add_response(ctrl, "access denied");
+      return -1;
+    }
+
+    return auth_cache_handle_clear(ctrl, --reqargc, ++reqargv);
+  }
+
+  pr_ctrls_add_response(ctrl, "unknown authcache action: '%s'", reqargv[0]);
+  return -1;
+}
+#endif /* PR_USE_CTRLS */
+
 /* Initialization functions
  */
 
 static int auth_init(void) {
+  pr_event_register(&auth_module, "core.postparse", auth_postparse_ev, NULL);
+  pr_event_register(&auth_module, "core.restart", auth_restart_ev, NULL);
+
+  auth_cache_pool = make_sub_pool(permanent_pool);
+  pr_pool_tag(auth_cache_pool, "mod_auth AuthCache pool");
+
+#if defined(PR_USE_CTRLS)
+  if (pr_ctrls_register(&auth_module, "authcache",
+      "manage the shared authentication cache",
+      auth_cache_handle_authcache) < 0) {
+    pr_log_pri(PR_LOG_NOTICE,
+      "mod_auth: error registering 'authcache' control: %s", strerror(errno));
+
+  } else {
+    register unsigned int i;
+
+    for (i = 0; auth_cache_acttab[i].act_action; i++) {
+      auth_cache_acttab[i].act_acl = pcalloc(auth_cache_pool,
+        sizeof(ctrls_acl_t));
+      pr_ctrls_init_acl(auth_cache_acttab[i].act_acl);
+    }
+  }
+#endif /* PR_USE_CTRLS */
+
   /* Add the commands handled by this module to the HELP list. */ 
   pr_help_add(C_USER, _("<sp> username"), TRUE);
   pr_help_add(C_PASS, _("<sp> password"), TRUE);
@@ -1895,6 +2127,33 @@ auth_failure:
   return 0;
 }
 
+/* Look up the counts used by auth_scan_scoreboard() from the scoreboard
+ * counters, rather than scanning the scoreboard.
+ */
+static int auth_get_scan_counts(const char *server_addr,
+    const char *client_addr, unsigned int *cur, unsigned int *ccur,
+    unsigned int *hcur) {
+
+  if (pr_scoreboard_get_count(PR_SCORE_COUNT_SERVER, server_addr, NULL, NULL,
+      cur) < 0) {
+    return -1;
+  }
+
+  if (pr_scoreboard_get_count(PR_SCORE_COUNT_HOST, server_addr, client_addr,
+      NULL, hcur) < 0) {
+    return -1;
+  }
+
+  /* Only count up authenticated clients, as per the documentation. */
+  if (session.conn_class != NULL &&
+      pr_scoreboard_get_count(PR_SCORE_COUNT_CLASS|PR_SCORE_COUNT_FL_AUTH,
+        server_addr, session.conn_class->cls_name, NULL, ccur) < 0) {
+    return -1;
+  }
+
+  return 0;
+}
+
 /* This function counts the number of connected users. It only fills in the
  * Class-based counters and an estimate for the number of clients. The primary
  * purpose is to make it so that the %N/%y escapes work in a DisplayConnect
@@ -1915,35 +2174,40 @@ static int auth_scan_scoreboard(void) {
   curr_server_addr[sizeof(curr_server_addr)-1] = '\0';
 
   /* Determine how many users are currently connected */
-  if (pr_rewind_scoreboard() < 0) {
-    pr_log_pri(PR_LOG_NOTICE, "error rewinding scoreboard: %s",
-      strerror(errno));
-  }
+  if (auth_get_scan_counts(curr_server_addr, client_addr, &cur, &ccur,
+      &hcur) < 0) {
+    cur = ccur = hcur = 0;
 
-  while ((score = pr_scoreboard_entry_read()) != NULL) {
-    pr_signals_handle();
+    if (pr_rewind_scoreboard() < 0) {
+      pr_log_pri(PR_LOG_NOTICE, "error rewinding scoreboard: %s",
+        strerror(errno));
+    }
+
+    while ((score = pr_scoreboard_entry_read()) != NULL) {
+      pr_signals_handle();
 
-    /* Make sure it matches our current server */
-    if (strcmp(score->sce_server_addr, curr_server_addr) == 0) {
-      cur++;
+      /* Make sure it matches our current server */
+      if (strcmp(score->sce_server_addr, curr_server_addr) == 0) {
+        cur++;
 
-      if (strcmp(score->sce_client_addr, client_addr) == 0)
-        hcur++;
+        if (strcmp(score->sce_client_addr, client_addr) == 0)
+          hcur++;
 
-      /* Only count up authenticated clients, as per the documentation. */
-      if (strncmp(score->sce_user, "(none)", 7) == 0)
-        continue;
+        /* Only count up authenticated clients, as per the documentation. */
+        if (strncmp(score->sce_user, "(none)", 7) == 0)
+          continue;
 
-      /* Note: the class member of the scoreboard entry will never be
-       * NULL.  At most, it may be the empty string.
-       */
-      if (session.conn_class != NULL &&
-          strcasecmp(score->sce_class, session.conn_class->cls_name) == 0) {
-        ccur++;
+        /* Note: the class member of the scoreboard entry will never be
+         * NULL.  At most, it may be the empty string.
+         */
+        if (session.conn_class != NULL &&
+            strcasecmp(score->sce_class, session.conn_class->cls_name) == 0) {
+          ccur++;
+        }
       }
     }
+    pr_restore_scoreboard();
   }
-  pr_restore_scoreboard();
 
   key = "client-count";
   (void) pr_table_remove(session.notes, key, NULL);
@@ -2031,6 +2295,67 @@ static int have_client_limits(cmd_rec *cmd) {
   return FALSE;
 }
 
+/* Look up the counts used by auth_count_scoreboard() from the scoreboard
+ * counters, rather than scanning the scoreboard.  The counts must match what
+ * the scan would find: within an <Anonymous> context only the sessions of
+ * the anonymous user are counted (but all sessions for the class), and
+ * otherwise only authenticated sessions are counted.
+ */
+static int auth_get_client_counts(config_rec *anon_config, const char *user,
+    const char *server_addr, const char *client_addr, long *cur, long *hcur,
+    long *ccur, long *usersessions, long *hostsperuser) {
+  unsigned int n = 0, nuser = 0, nuserhost = 0;
+  int class_type = PR_SCORE_COUNT_CLASS|PR_SCORE_COUNT_FL_AUTH;
+
+  if (anon_config == NULL ||
+      anon_config->config_type == CONF_ANON) {
+    if (pr_scoreboard_get_count(PR_SCORE_COUNT_USER, server_addr, user, NULL,
+        &nuser) < 0) {
+      return -1;
+    }
+
+    if (pr_scoreboard_get_count(PR_SCORE_COUNT_USER_HOST, server_addr, user,
+        client_addr, &nuserhost) < 0) {
+      return -1;
+    }
+
+    *usersessions = nuser;
+    *hostsperuser = 1 + (nuser - nuserhost);
+  }
+
+  if (anon_config == NULL) {
+    if (pr_scoreboard_get_count(PR_SCORE_COUNT_SERVER|PR_SCORE_COUNT_FL_AUTH,
+        server_addr, NULL, NULL, &n) < 0) {
+      return -1;
+    }
+    *cur = n;
+
+    if (pr_scoreboard_get_count(PR_SCORE_COUNT_HOST|PR_SCORE_COUNT_FL_AUTH,
+        server_addr, client_addr, NULL, &n) < 0) {
+      return -1;
+    }
+    *hcur = n;
+
+  } else {
+    if (anon_config->config_type == CONF_ANON) {
+      *cur = nuser;
+      *hcur = nuserhost;
+    }
+
+    class_type = PR_SCORE_COUNT_CLASS;
+  }
+
+  if (session.conn_class != NULL) {
+    if (pr_scoreboard_get_count(class_type, server_addr,
+        session.conn_class->cls_name, NULL, &n) < 0) {
+      return -1;
+    }
+    *ccur = n;
+  }
+
+  return 0;
+}
+
 static int auth_count_scoreboard(cmd_rec *cmd, const char *user) {
   char *key;
   void *v;
@@ -2059,57 +2384,65 @@ static int auth_count_scoreboard(cmd_rec *cmd, const char *user) {
       pr_netaddr_get_ipstr(session.c->local_addr), main_server->ServerPort);
     curr_server_addr[sizeof(curr_server_addr)-1] = '\0';
 
-    if (pr_rewind_scoreboard() < 0) {
-      pr_log_pri(PR_LOG_NOTICE, "error rewinding scoreboard: %s",
-        strerror(errno));
-    }
+    if (auth_get_client_counts(c, user, curr_server_addr,
+        pr_netaddr_get_ipstr(session.c->remote_addr), &cur, &hcur, &ccur,
+        &usersessions, &hostsperuser) < 0) {
+      cur = hcur = ccur = usersessions = 0;
+      hostsperuser = 1;
 
-    while ((score = pr_scoreboard_entry_read()) != NULL) {
-      unsigned char same_host = FALSE;
+      if (pr_rewind_scoreboard() < 0) {
+        pr_log_pri(PR_LOG_NOTICE, "error rewinding scoreboard: %s",
+          strerror(errno));
+      }
 
-      pr_signals_handle();
+      while ((score = pr_scoreboard_entry_read()) != NULL) {
+        unsigned char same_host = FALSE;
 
-      /* Make sure it matches our current server. */
-      if (strcmp(score->sce_server_addr, curr_server_addr) == 0) {
+        pr_signals_handle();
 
-        if ((c != NULL &&
-             c->config_type == CONF_ANON &&
-             strcmp(score->sce_user, user) == 0) ||
-            c == NULL) {
+        /* Make sure it matches our current server. */
+        if (strcmp(score->sce_server_addr, curr_server_addr) == 0) {
 
-          /* Only count authenticated clients, as per the documentation. */
-          if (strncmp(score->sce_user, "(none)", 7) == 0) {
-            continue;
-          }
+          if ((c != NULL &&
+               c->config_type == CONF_ANON &&
+               strcmp(score->sce_user, user) == 0) ||
+              c == NULL) {
 
-          cur++;
+            /* Only count authenticated clients, as per the documentation. */
+            if (strncmp(score->sce_user, "(none)", 7) == 0) {
+              continue;
+            }
 
-          /* Count up sessions on a per-host basis. */
+            cur++;
 
-          if (strcmp(score->sce_client_addr,
-              pr_netaddr_get_ipstr(session.c->remote_addr)) == 0) {
-            same_host = TRUE;
-            hcur++;
-          }
+            /* Count up sessions on a per-host basis. */
 
-          /* Take a per-user count of connections. */
-          if (strcmp(score->sce_user, user) == 0) {
-            usersessions++;
+            if (strcmp(score->sce_client_addr,
+                pr_netaddr_get_ipstr(session.c->remote_addr)) == 0) {
+              same_host = TRUE;
+              hcur++;
+            }
 
-            /* Count up unique hosts. */
-            if (same_host == FALSE) {
-              hostsperuser++;
+            /* Take a per-user count of connections. */
+            if (strcmp(score->sce_user, user) == 0) {
+              usersessions++;
+
+              /* Count up unique hosts. */
+              if (same_host == FALSE) {
+                hostsperuser++;
+              }
             }
           }
-        }
 
-        if (session.conn_class != NULL &&
-            strcasecmp(score->sce_class, session.conn_class->cls_name) == 0) {
-          ccur++;
+          if (session.conn_class != NULL &&
+              strcasecmp(score->sce_class, session.conn_class->cls_name) == 0) {
+            ccur++;
+          }
         }
       }
+      pr_restore_scoreboard();
     }
-    pr_restore_scoreboard();
+
     PRIVS_RELINQUISH
   }
 
@@ -3075,6 +3408,125 @@ MODRET set_anonrejectpasswords(cmd_rec *cmd) {
 #endif
 }
 
+/* usage: AuthCacheControlsACLs actions|all allow|deny user|group list */
+MODRET set_authcachectrlsacls(cmd_rec *cmd) {
+#if defined(PR_USE_CTRLS)
+  char *bad_action = NULL, **actions = NULL;
+
+  CHECK_ARGS(cmd, 4);
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  actions = ctrls_parse_acl(cmd->tmp_pool, cmd->argv[1]);
+
+  /* Check the second parameter to make sure it is "allow" or "deny" */
+  if (strcmp(cmd->argv[2], "allow") != 0 &&
+      strcmp(cmd->argv[2], "deny") != 0) {
+    CONF_ERROR(cmd, "second parameter must be 'allow' or 'deny'");
+  }
+
+  /* Check the third parameter to make sure it is "user" or "group" */
+  if (strcmp(cmd->argv[3], "user") != 0 &&
+      strcmp(cmd->argv[3], "group") != 0) {
+    CONF_ERROR(cmd, "third parameter must be 'user' or 'group'");
+  }
+
+  bad_action = pr_ctrls_set_module_acls(auth_cache_acttab, auth_cache_pool,
+    actions, cmd->argv[2], cmd->argv[3], cmd->argv[4]);
+  if (bad_action != NULL) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, ": unknown authcache action: '",
+      bad_action, "'", NULL));
+  }
+
+  return PR_HANDLED(cmd);
+#else
+  CONF_ERROR(cmd, "requires Controls support (--enable-ctrls)")
+#endif /* PR_USE_CTRLS */
+}
+
+/* usage: AuthCacheEngine on|off */
+MODRET set_authcacheengine(cmd_rec *cmd) {
+  int engine = -1;
+  config_rec *c = NULL;
+
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  engine = get_boolean(cmd, 1);
+  if (engine == -1) {
+    CONF_ERROR(cmd, "expected Boolean parameter");
+  }
+
+  c = add_config_param(cmd->argv[0], 1, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[0]) = engine;
+
+  return PR_HANDLED(cmd);
+}
+
+/* usage: AuthCacheSize size [units] */
+MODRET set_authcachesize(cmd_rec *cmd) {
+  off_t size = 0;
+  config_rec *c = NULL;
+
+  if (cmd->argc < 2 ||
+      cmd->argc > 3) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  if (pr_str_get_nbytes(cmd->argv[1], cmd->argc == 3 ? cmd->argv[2] : NULL,
+      &size) < 0) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "unable to parse: ",
+      cmd->argv[1], ": ", strerror(errno), NULL));
+  }
+
+  if (size < 65536) {
+    CONF_ERROR(cmd, "size must be at least 64 KB");
+  }
+
+  c = add_config_param(cmd->argv[0], 1, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(off_t));
+  *((off_t *) c->argv[0]) = size;
+
+  return PR_HANDLED(cmd);
+}
+
+/* usage: AuthCacheTTL secs|duration [negative-secs|duration] */
+MODRET set_authcachettl(cmd_rec *cmd) {
+  int ttl, negative_ttl = AUTH_DEFAULT_CACHE_NEGATIVE_TTL;
+  config_rec *c = NULL;
+
+  if (cmd->argc < 2 ||
+      cmd->argc > 3) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  if (pr_str_get_duration(cmd->argv[1], &ttl) < 0 ||
+      ttl <= 0) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "invalid TTL: ", cmd->argv[1],
+      NULL));
+  }
+
+  if (cmd->argc == 3) {
+    if (pr_str_get_duration(cmd->argv[2], &negative_ttl) < 0 ||
+        negative_ttl < 0) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "invalid negative TTL: ",
+        cmd->argv[2], NULL));
+    }
+  }
+
+  c = add_config_param(cmd->argv[0], 2, NULL, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(time_t));
+  *((time_t *) c->argv[0]) = ttl;
+  c->argv[1] = pcalloc(c->pool, sizeof(time_t));
+  *((time_t *) c->argv[1]) = negative_ttl;
+
+  return PR_HANDLED(cmd);
+}
+
 MODRET set_authaliasonly(cmd_rec *cmd) {
   int bool = -1;
   config_rec *c = NULL;
@@ -4069,6 +4521,10 @@ static conftable auth_conftab[] = {
   { "AnonRequirePassword",	set_anonrequirepassword,	NULL },
   { "AnonRejectPasswords",	set_anonrejectpasswords,	NULL },
   { "AuthAliasOnly",		set_authaliasonly,		NULL },
+  { "AuthCacheControlsACLs",	set_authcachectrlsacls,		NULL },
+  { "AuthCacheEngine",		set_authcacheengine,		NULL },
+  { "AuthCacheSize",		set_authcachesize,		NULL },
+  { "AuthCacheTTL",		set_authcachettl,		NULL },
   { "AuthUsingAlias",		set_authusingalias,		NULL },
   { "CreateHome",		set_createhome,			NULL },
   { "DefaultChdir",		add_defaultchdir,		NULL },
@@ -4098,6 +4554,14 @@ static conftable auth_conftab[] = {
   { NULL,			NULL,				NULL }
 };
 
+#if defined(PR_USE_CTRLS)
+static ctrls_acttab_t auth_cache_acttab[] = {
+  { "clear",	NULL, NULL, NULL },
+  { "info",	NULL, NULL, NULL },
+  { NULL,	NULL, NULL, NULL }
+};
+#endif /* PR_USE_CTRLS */
+
 static cmdtable auth_cmdtab[] = {
   { PRE_CMD,	C_USER,	G_NONE,	auth_pre_user,	FALSE,	FALSE,	CL_AUTH },
   { CMD,	C_USER,	G_NONE,	auth_user,	FALSE,	FALSE,	CL_AUTH },
@@ -26,6 +26,10 @@
 #include "conf.h"
 #include "privs.h"
 
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+
 /* AIX has some rather stupid function prototype inconsistencies between
  * their crypt.h and stdlib.h's setkey() declarations.
  */
@@ -46,6 +50,8 @@
 
 module auth_file_module;
 
+extern xaset_t *server_list;
+
 typedef union {
   uid_t uid;
   gid_t gid;
@@ -89,11 +95,101 @@ static unsigned long auth_file_opts = 0UL;
 
 static int handle_empty_salt = FALSE;
 
+/* AuthFileIndex: the daemon process reads each configured AuthUserFile and
+ * AuthGroupFile into a read-only index, shared with all session processes,
+ * with hash tables for looking up entries by name and by ID, and groups by
+ * member name.  The index records the identity of the file from which it was
+ * built; sessions only use an index which matches their opened file, and
+ * otherwise read the file itself, as usual.
+ *
+ * The index does not hold password hashes: authentication always reads the
+ * file.  Each session unmaps the indexes of other servers' files, so that
+ * a session only has the entries which it could read from its own files.
+ */
+#define AF_INDEX_TYPE_USER		1
+#define AF_INDEX_TYPE_GROUP		2
+
+#define AF_INDEX_DEFAULT_INTERVAL	10
+#define AF_INDEX_IOBUFSZ		(64 * 1024)
+#define AF_INDEX_MIN_NBUCKETS		16
+#define AF_INDEX_ALIGN(n)		(((n) + 7) & ~((size_t) 7))
+
+/* The password field of entries returned from the index. */
+#define AF_INDEX_NOPASSWD		"*"
+
+/* Links to the next entry in a hash chain are the entry's index plus one;
+ * zero ends the chain.  Strings are offsets into the string table.
+ */
+typedef struct {
+  uid_t uid;
+  gid_t gid;
+  uint32_t name, gecos, dir, shell;
+  uint32_t next_name, next_id;
+
+} af_index_pwent_t;
+
+typedef struct {
+  gid_t gid;
+  uint32_t name;
+
+  /* The group's members are nmem consecutive member entries. */
+  uint32_t mem, nmem;
+  uint32_t next_name, next_id;
+
+} af_index_grent_t;
+
+typedef struct {
+  uint32_t name;
+  uint32_t grent;
+  uint32_t next;
+
+} af_index_member_t;
+
+typedef struct {
+  /* Identity of the indexed file. */
+  dev_t file_dev;
+  ino_t file_ino;
+  off_t file_size;
+  time_t file_mtime;
+  time_t file_ctime;
+
+  /* FALSE if the file was modified in the same second in which it was read;
+   * a later modification in that second would not change its timestamps.
+   */
+  int settled;
+
+  uint32_t nents, nmembers, nbuckets, nmember_buckets;
+  size_t ents_off, members_off, name_buckets_off, id_buckets_off,
+    member_buckets_off, strs_off;
+
+} af_index_hdr_t;
+
+typedef struct af_index_rec {
+  struct af_index_rec *next;
+  int type;
+  const char *path;
+
+  af_index_hdr_t *hdr;
+  size_t hdrsz;
+
+} af_index_t;
+
+static pool *af_index_pool = NULL;
+static af_index_t *af_indexes = NULL;
+static int af_index_timerno = -1;
+
 static int authfile_sess_init(void);
 
 static int af_setpwent(pool *);
 static int af_setgrent(pool *);
 
+static int af_index_getpwnam(pool *, const char *, struct passwd **);
+static int af_index_getpwuid(pool *, uid_t, struct passwd **);
+static int af_index_getgrnam(pool *, const char *, struct group **);
+static int af_index_getgrgid(pool *, gid_t, struct group **);
+static int af_index_getgroups(pool *, const char *, array_header *,
+  array_header *);
+
 static const char *trace_channel = "auth.file";
 
 /* Support routines.  Move the passwd/group functions out of lib/ into here. */
@@ -576,6 +672,10 @@ static struct group *af_getgrnam(pool *p, const char *name) {
     return NULL;
   }
 
+  if (af_index_getgrnam(p, name, &grp) == 0) {
+    return grp;
+  }
+
   while ((grp = af_getgrent(p)) != NULL) {
     pr_signals_handle();
 
@@ -595,6 +695,10 @@ static struct group *af_getgrgid(pool *p, gid_t gid) {
     return NULL;
   }
 
+  if (af_index_getgrgid(p, gid, &grp) == 0) {
+    return grp;
+  }
+
   while ((grp = af_getgrent(p)) != NULL) {
     pr_signals_handle();
 
@@ -811,6 +915,10 @@ static struct passwd *af_getpwnam(pool *p, const char *name) {
     return NULL;
   }
 
+  if (af_index_getpwnam(p, name, &pwd) == 0) {
+    return pwd;
+  }
+
   while ((pwd = af_getpwent(p)) != NULL) {
     pr_signals_handle();
 
@@ -824,7 +932,21 @@ static struct passwd *af_getpwnam(pool *p, const char *name) {
 }
 
 static char *af_getpwpass(pool *p, const char *name) {
-  struct passwd *pwd = af_getpwnam(p, name);
+  struct passwd *pwd = NULL;
+
+  /* The index has no password hashes, so always read the file. */
+  if (af_setpwent(p) < 0) {
+    return NULL;
+  }
+
+  while ((pwd = af_getpwent(p)) != NULL) {
+    pr_signals_handle();
+
+    if (strcmp(name, pwd->pw_name) == 0) {
+      break;
+    }
+  }
+
   return pwd ? pwd->pw_passwd : NULL;
 }
 
@@ -835,6 +957,10 @@ static struct passwd *af_getpwuid(pool *p, uid_t uid) {
     return NULL;
   }
 
+  if (af_index_getpwuid(p, uid, &pwd) == 0) {
+    return pwd;
+  }
+
   while ((pwd = af_getpwent(p)) != NULL) {
     pr_signals_handle();
 
@@ -908,6 +1034,822 @@ static int af_setpwent(pool *p) {
   return -1;
 }
 
+/* AuthFileIndex routines.
+ */
+
+struct af_index_strs {
+  pool *pool;
+  char *data;
+  size_t datasz, datalen;
+};
+
+static uint32_t af_index_hash(const char *key) {
+  const unsigned char *ptr;
+  uint32_t h = 2166136261UL;
+
+  /* FNV-1a */
+  for (ptr = (const unsigned char *) key; *ptr; ptr++) {
+    h ^= *ptr;
+    h *= 16777619UL;
+  }
+
+  return h;
+}
+
+static uint32_t af_index_hash_id(uint32_t id) {
+  return id * 2654435761UL;
+}
+
+static uint32_t af_index_nbuckets(uint32_t count) {
+  uint32_t nbuckets = AF_INDEX_MIN_NBUCKETS;
+
+  while (nbuckets < count &&
+         nbuckets < 0x80000000UL) {
+    nbuckets <<= 1;
+  }
+
+  return nbuckets;
+}
+
+static uint32_t af_index_add_str(struct af_index_strs *strs, const char *str) {
+  size_t len;
+  uint32_t off;
+
+  if (str == NULL) {
+    str = "";
+  }
+
+  len = strlen(str) + 1;
+  if (strs->datalen + len > strs->datasz) {
+    size_t datasz;
+    char *data;
+
+    datasz = strs->datasz > 0 ? strs->datasz : 8192;
+    while (strs->datalen + len > datasz) {
+      datasz *= 2;
+    }
+
+    data = palloc(strs->pool, datasz);
+    if (strs->datalen > 0) {
+      memcpy(data, strs->data, strs->datalen);
+      pr_memscrub(strs->data, strs->datalen);
+    }
+
+    strs->data = data;
+    strs->datasz = datasz;
+  }
+
+  off = (uint32_t) strs->datalen;
+  memcpy(strs->data + strs->datalen, str, len);
+  strs->datalen += len;
+
+  return off;
+}
+
+static int af_index_stat_matches(const af_index_hdr_t *hdr,
+    const struct stat *st) {
+  if (hdr->file_dev != st->st_dev ||
+      hdr->file_ino != st->st_ino ||
+      hdr->file_size != st->st_size ||
+      hdr->file_mtime != st->st_mtime ||
+      hdr->file_ctime != st->st_ctime) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static int af_index_build(af_index_t *idx) {
+  pool *tmp_pool;
+  FILE *fh;
+  struct stat st;
+  time_t now;
+  char *iobuf, *ptr;
+  int mmap_flags, xerrno;
+  authfile_file_t af;
+  array_header *ents, *members = NULL;
+  struct af_index_strs strs;
+  af_index_hdr_t *hdr;
+  uint32_t *name_buckets, *id_buckets, *member_buckets = NULL, nents, i;
+  size_t entsz, hdrsz;
+  const char *type_name;
+
+  mmap_flags = MAP_SHARED;
+#if defined(MAP_ANONYMOUS)
+  mmap_flags |= MAP_ANONYMOUS;
+#elif defined(MAP_ANON)
+  mmap_flags |= MAP_ANON;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+
+  type_name = idx->type == AF_INDEX_TYPE_USER ? "AuthUserFile" :
+    "AuthGroupFile";
+
+  /* Note the time before reading the file; if the file is modified in this
+   * same second, the index is rebuilt later.
+   */
+  time(&now);
+
+  PRIVS_ROOT
+  fh = fopen(idx->path, "r");
+  xerrno = errno;
+  PRIVS_RELINQUISH
+
+  if (fh == NULL) {
+    pr_log_debug(DEBUG3, MOD_AUTH_FILE_VERSION
+      ": unable to open %s '%s' for indexing: %s", type_name, idx->path,
+      strerror(xerrno));
+    errno = xerrno;
+    return -1;
+  }
+
+  if (fstat(fileno(fh), &st) < 0) {
+    xerrno = errno;
+    fclose(fh);
+
+    errno = xerrno;
+    return -1;
+  }
+
+  tmp_pool = make_sub_pool(af_index_pool);
+  pr_pool_tag(tmp_pool, "AuthFileIndex build pool");
+
+  /* As the file may contain sensitive data, read it using our own buffer,
+   * which is scrubbed once done.
+   */
+  iobuf = palloc(tmp_pool, AF_INDEX_IOBUFSZ);
+  (void) setvbuf(fh, iobuf, _IOFBF, AF_INDEX_IOBUFSZ);
+
+  memset(&strs, 0, sizeof(strs));
+  strs.pool = tmp_pool;
+
+  /* Read the entries using the usual routines, with a file record which has
+   * no restrictions; sessions apply their restrictions to the indexed
+   * entries.
+   */
+  memset(&af, 0, sizeof(af));
+  af.af_path = (char *) idx->path;
+  af.af_file = fh;
+
+  if (idx->type == AF_INDEX_TYPE_USER) {
+    authfile_file_t *user_file;
+    struct passwd *pwd;
+
+    entsz = sizeof(af_index_pwent_t);
+    ents = make_array(tmp_pool, 1024, entsz);
+
+    user_file = af_user_file;
+    af_user_file = &af;
+
+    while ((pwd = af_getpwent(tmp_pool)) != NULL) {
+      af_index_pwent_t *ent;
+
+      ent = push_array(ents);
+      ent->uid = pwd->pw_uid;
+      ent->gid = pwd->pw_gid;
+      ent->name = af_index_add_str(&strs, pwd->pw_name);
+      ent->gecos = af_index_add_str(&strs, pwd->pw_gecos);
+      ent->dir = af_index_add_str(&strs, pwd->pw_dir);
+      ent->shell = af_index_add_str(&strs, pwd->pw_shell);
+      ent->next_name = ent->next_id = 0;
+    }
+
+    af_user_file = user_file;
+
+  } else {
+    authfile_file_t *group_file;
+    struct group *grp;
+
+    entsz = sizeof(af_index_grent_t);
+    ents = make_array(tmp_pool, 1024, entsz);
+    members = make_array(tmp_pool, 1024, sizeof(af_index_member_t));
+
+    group_file = af_group_file;
+    af_group_file = &af;
+
+    while ((grp = af_getgrent(tmp_pool)) != NULL) {
+      af_index_grent_t *ent;
+      char **gr_mems;
+
+      ent = push_array(ents);
+      ent->gid = grp->gr_gid;
+      ent->name = af_index_add_str(&strs, grp->gr_name);
+      ent->mem = members->nelts;
+      ent->nmem = 0;
+      ent->next_name = ent->next_id = 0;
+
+      for (gr_mems = grp->gr_mem; gr_mems && *gr_mems; gr_mems++) {
+        af_index_member_t *member;
+
+        member = push_array(members);
+        member->name = af_index_add_str(&strs, *gr_mems);
+        member->grent = ents->nelts - 1;
+        member->next = 0;
+        ent->nmem++;
+      }
+    }
+
+    af_group_file = group_file;
+  }
+
+  fclose(fh);
+  pr_memscrub(iobuf, AF_INDEX_IOBUFSZ);
+
+  nents = ents->nelts;
+
+  hdrsz = AF_INDEX_ALIGN(sizeof(af_index_hdr_t));
+  hdr = pcalloc(tmp_pool, sizeof(af_index_hdr_t));
+  hdr->file_dev = st.st_dev;
+  hdr->file_ino = st.st_ino;
+  hdr->file_size = st.st_size;
+  hdr->file_mtime = st.st_mtime;
+  hdr->file_ctime = st.st_ctime;
+  hdr->settled = (st.st_mtime < now && st.st_ctime < now);
+  hdr->nents = nents;
+  hdr->nbuckets = af_index_nbuckets(nents);
+
+  hdr->ents_off = hdrsz;
+  hdrsz += AF_INDEX_ALIGN(nents * entsz);
+
+  if (members != NULL) {
+    hdr->nmembers = members->nelts;
+    hdr->nmember_buckets = af_index_nbuckets(members->nelts);
+  }
+
+  hdr->members_off = hdrsz;
+  hdrsz += AF_INDEX_ALIGN(hdr->nmembers * sizeof(af_index_member_t));
+
+  hdr->name_buckets_off = hdrsz;
+  hdrsz += AF_INDEX_ALIGN(hdr->nbuckets * sizeof(uint32_t));
+
+  hdr->id_buckets_off = hdrsz;
+  hdrsz += AF_INDEX_ALIGN(hdr->nbuckets * sizeof(uint32_t));
+
+  hdr->member_buckets_off = hdrsz;
+  hdrsz += AF_INDEX_ALIGN(hdr->nmember_buckets * sizeof(uint32_t));
+
+  hdr->strs_off = hdrsz;
+  hdrsz += AF_INDEX_ALIGN(strs.datalen);
+
+  ptr = mmap(NULL, hdrsz, PROT_READ|PROT_WRITE, mmap_flags, -1, 0);
+  if (ptr == MAP_FAILED) {
+    xerrno = errno;
+
+    pr_log_debug(DEBUG0, MOD_AUTH_FILE_VERSION
+      ": error allocating %lu bytes for %s '%s' index: %s",
+      (unsigned long) hdrsz, type_name, idx->path, strerror(xerrno));
+
+    if (strs.datalen > 0) {
+      pr_memscrub(strs.data, strs.datalen);
+    }
+    destroy_pool(tmp_pool);
+
+    errno = xerrno;
+    return -1;
+  }
+
+  /* Anonymous mappings are already zeroed, i.e. the hash chains are empty. */
+  memcpy(ptr, hdr, sizeof(af_index_hdr_t));
+  hdr = (af_index_hdr_t *) ptr;
+
+  if (nents > 0) {
+    memcpy(ptr + hdr->ents_off, ents->elts, nents * entsz);
+  }
+
+  if (hdr->nmembers > 0) {
+    memcpy(ptr + hdr->members_off, members->elts,
+      hdr->nmembers * sizeof(af_index_member_t));
+  }
+
+  if (strs.datalen > 0) {
+    memcpy(ptr + hdr->strs_off, strs.data, strs.datalen);
+    pr_memscrub(strs.data, strs.datalen);
+  }
+
+  destroy_pool(tmp_pool);
+
+  /* Link the entries into their hash chains, last entry first, so that each
+   * chain lists its entries in the order in which they appear in the file.
+   */
+  name_buckets = (uint32_t *) (ptr + hdr->name_buckets_off);
+  id_buckets = (uint32_t *) (ptr + hdr->id_buckets_off);
+
+  for (i = nents; i > 0; i--) {
+    uint32_t name_idx, id_idx;
+
+    if (idx->type == AF_INDEX_TYPE_USER) {
+      af_index_pwent_t *ent;
+
+      ent = ((af_index_pwent_t *) (ptr + hdr->ents_off)) + (i - 1);
+      name_idx = af_index_hash(ptr + hdr->strs_off + ent->name) &
+        (hdr->nbuckets - 1);
+      id_idx = af_index_hash_id((uint32_t) ent->uid) & (hdr->nbuckets - 1);
+
+      ent->next_name = name_buckets[name_idx];
+      ent->next_id = id_buckets[id_idx];
+
+    } else {
+      af_index_grent_t *ent;
+
+      ent = ((af_index_grent_t *) (ptr + hdr->ents_off)) + (i - 1);
+      name_idx = af_index_hash(ptr + hdr->strs_off + ent->name) &
+        (hdr->nbuckets - 1);
+      id_idx = af_index_hash_id((uint32_t) ent->gid) & (hdr->nbuckets - 1);
+
+      ent->next_name = name_buckets[name_idx];
+      ent->next_id = id_buckets[id_idx];
+    }
+
+    name_buckets[name_idx] = i;
+    id_buckets[id_idx] = i;
+  }
+
+  if (hdr->nmembers > 0) {
+    member_buckets = (uint32_t *) (ptr + hdr->member_buckets_off);
+
+    for (i = hdr->nmembers; i > 0; i--) {
+      af_index_member_t *member;
+      uint32_t member_idx;
+
+      member = ((af_index_member_t *) (ptr + hdr->members_off)) + (i - 1);
+      member_idx = af_index_hash(ptr + hdr->strs_off + member->name) &
+        (hdr->nmember_buckets - 1);
+
+      member->next = member_buckets[member_idx];
+      member_buckets[member_idx] = i;
+    }
+  }
+
+  /* Sessions only ever read the index. */
+  if (mprotect(ptr, hdrsz, PROT_READ) < 0) {
+    pr_log_debug(DEBUG5, MOD_AUTH_FILE_VERSION
+      ": error making %s '%s' index read-only: %s", type_name, idx->path,
+      strerror(errno));
+  }
+
+  if (idx->hdr != NULL) {
+    (void) munmap((void *) idx->hdr, idx->hdrsz);
+  }
+
+  idx->hdr = hdr;
+  idx->hdrsz = hdrsz;
+
+  pr_log_debug(DEBUG5, MOD_AUTH_FILE_VERSION
+    ": indexed %lu %s from %s '%s' (%lu bytes)", (unsigned long) nents,
+    idx->type == AF_INDEX_TYPE_USER ? "users" : "groups", type_name,
+    idx->path, (unsigned long) hdrsz);
+  return 0;
+}
+
+static void af_index_add(int type, const char *path) {
+  af_index_t *idx;
+
+  for (idx = af_indexes; idx; idx = idx->next) {
+    if (idx->type == type &&
+        strcmp(idx->path, path) == 0) {
+      return;
+    }
+  }
+
+  idx = pcalloc(af_index_pool, sizeof(af_index_t));
+  idx->type = type;
+  idx->path = pstrdup(af_index_pool, path);
+
+  idx->next = af_indexes;
+  af_indexes = idx;
+
+  (void) af_index_build(idx);
+}
+
+static void af_index_free(void) {
+  af_index_t *idx;
+
+  if (af_index_timerno > 0) {
+    (void) pr_timer_remove(af_index_timerno, &auth_file_module);
+    af_index_timerno = -1;
+  }
+
+  for (idx = af_indexes; idx; idx = idx->next) {
+    if (idx->hdr != NULL) {
+      (void) munmap((void *) idx->hdr, idx->hdrsz);
+      idx->hdr = NULL;
+    }
+  }
+
+  af_indexes = NULL;
+
+  if (af_index_pool != NULL) {
+    destroy_pool(af_index_pool);
+    af_index_pool = NULL;
+  }
+}
+
+static int af_index_timer_cb(CALLBACK_FRAME) {
+  af_index_t *idx;
+
+  /* Rebuild any index whose file has changed, or which was built from a
+   * file modified in the second in which it was read.
+   */
+  for (idx = af_indexes; idx; idx = idx->next) {
+    struct stat st;
+    int res;
+
+    pr_signals_handle();
+
+    if (idx->hdr != NULL &&
+        idx->hdr->settled == TRUE) {
+      PRIVS_ROOT
+      res = stat(idx->path, &st);
+      PRIVS_RELINQUISH
+
+      if (res < 0 ||
+          af_index_stat_matches(idx->hdr, &st) == TRUE) {
+        continue;
+      }
+    }
+
+    pr_trace_msg(trace_channel, 9, "rebuilding index of '%s'", idx->path);
+    (void) af_index_build(idx);
+  }
+
+  /* Always return 1, so that the timer is restarted. */
+  return 1;
+}
+
+/* Returns the index for the session's opened AuthUserFile/AuthGroupFile, if
+ * there is one which was built from that same, unmodified file.
+ */
+static af_index_hdr_t *af_index_get(int type) {
+  authfile_file_t *af;
+  af_index_t *idx;
+  struct stat st;
+
+  af = type == AF_INDEX_TYPE_USER ? af_user_file : af_group_file;
+  if (af == NULL ||
+      af->af_file == NULL) {
+    return NULL;
+  }
+
+  for (idx = af_indexes; idx; idx = idx->next) {
+    if (idx->type == type &&
+        strcmp(idx->path, af->af_path) == 0) {
+      break;
+    }
+  }
+
+  if (idx == NULL ||
+      idx->hdr == NULL ||
+      idx->hdr->settled == FALSE) {
+    return NULL;
+  }
+
+  /* Compare against the opened file, rather than its path, which may not
+   * be reachable from within a chroot.
+   */
+  if (fstat(fileno(af->af_file), &st) < 0) {
+    return NULL;
+  }
+
+  if (af_index_stat_matches(idx->hdr, &st) == FALSE) {
+    pr_trace_msg(trace_channel, 9,
+      "index of '%s' is out of date, reading file", idx->path);
+    return NULL;
+  }
+
+  pr_trace_msg(trace_channel, 17, "using index of '%s'", idx->path);
+  return idx->hdr;
+}
+
+/* Unmaps the indexes of all files other than the session's own
+ * AuthUserFile/AuthGroupFile.
+ */
+static void af_index_unmap_others(void) {
+  af_index_t *idx;
+
+  for (idx = af_indexes; idx; idx = idx->next) {
+    authfile_file_t *af;
+
+    if (idx->hdr == NULL) {
+      continue;
+    }
+
+    af = idx->type == AF_INDEX_TYPE_USER ? af_user_file : af_group_file;
+    if (af != NULL &&
+        strcmp(idx->path, af->af_path) == 0) {
+      continue;
+    }
+
+    pr_trace_msg(trace_channel, 17, "unmapping index of '%s'", idx->path);
+    (void) munmap((void *) idx->hdr, idx->hdrsz);
+    idx->hdr = NULL;
+  }
+}
+
+/* As with the entries read from the file, the entries returned from the
+ * index are overwritten by the next lookup.
+ */
+static struct passwd af_index_pwd;
+static char *af_index_pwbuf = NULL;
+static size_t af_index_pwbufsz = 0;
+
+static struct group af_index_grp;
+static char *af_index_grbuf = NULL;
+static size_t af_index_grbufsz = 0;
+
+static char *af_index_getbuf(char **buf, size_t *bufsz, size_t len) {
+  if (len > *bufsz) {
+    char *new_buf;
+
+    new_buf = realloc(*buf, len);
+    if (new_buf == NULL) {
+      pr_log_pri(PR_LOG_ALERT, "Out of memory!");
+      _exit(1);
+    }
+
+    *buf = new_buf;
+    *bufsz = len;
+  }
+
+  return *buf;
+}
+
+static char *af_index_copy_str(char **ptr, const char *str) {
+  char *res;
+  size_t len;
+
+  res = *ptr;
+  len = strlen(str) + 1;
+  memcpy(res, str, len);
+  *ptr += len;
+
+  return res;
+}
+
+static struct passwd *af_index_pwent(const af_index_hdr_t *hdr,
+    const af_index_pwent_t *ent) {
+  const char *strs;
+  char *ptr;
+  size_t len;
+
+  strs = ((const char *) hdr) + hdr->strs_off;
+
+  len = strlen(strs + ent->name) + strlen(AF_INDEX_NOPASSWD) +
+    strlen(strs + ent->gecos) + strlen(strs + ent->dir) +
+    strlen(strs + ent->shell) + 5;
+  ptr = af_index_getbuf(&af_index_pwbuf, &af_index_pwbufsz, len);
+
+  memset(&af_index_pwd, 0, sizeof(af_index_pwd));
+  af_index_pwd.pw_name = af_index_copy_str(&ptr, strs + ent->name);
+  af_index_pwd.pw_passwd = af_index_copy_str(&ptr, AF_INDEX_NOPASSWD);
+  af_index_pwd.pw_uid = ent->uid;
+  af_index_pwd.pw_gid = ent->gid;
+  af_index_pwd.pw_gecos = af_index_copy_str(&ptr, strs + ent->gecos);
+  af_index_pwd.pw_dir = af_index_copy_str(&ptr, strs + ent->dir);
+  af_index_pwd.pw_shell = af_index_copy_str(&ptr, strs + ent->shell);
+
+  return &af_index_pwd;
+}
+
+static struct group *af_index_grent(const af_index_hdr_t *hdr,
+    const af_index_grent_t *ent) {
+  const char *strs;
+  const af_index_member_t *members;
+  char *ptr;
+  size_t len, memsz;
+  register unsigned int i;
+
+  strs = ((const char *) hdr) + hdr->strs_off;
+  members = (const af_index_member_t *) (((const char *) hdr) +
+    hdr->members_off);
+
+  /* The member list comes first in the buffer, for its alignment. */
+  memsz = sizeof(char *) * (ent->nmem + 1);
+  len = memsz + strlen(strs + ent->name) + strlen(AF_INDEX_NOPASSWD) + 2;
+  for (i = 0; i < ent->nmem; i++) {
+    len += strlen(strs + members[ent->mem + i].name) + 1;
+  }
+
+  ptr = af_index_getbuf(&af_index_grbuf, &af_index_grbufsz, len);
+
+  memset(&af_index_grp, 0, sizeof(af_index_grp));
+  af_index_grp.gr_mem = (char **) ptr;
+  ptr += memsz;
+
+  af_index_grp.gr_name = af_index_copy_str(&ptr, strs + ent->name);
+  af_index_grp.gr_passwd = af_index_copy_str(&ptr, AF_INDEX_NOPASSWD);
+  af_index_grp.gr_gid = ent->gid;
+
+  for (i = 0; i < ent->nmem; i++) {
+    af_index_grp.gr_mem[i] = af_index_copy_str(&ptr,
+      strs + members[ent->mem + i].name);
+  }
+  af_index_grp.gr_mem[ent->nmem] = NULL;
+
+  return &af_index_grp;
+}
+
+/* The lookup functions return -1 if there is no usable index, in which case
+ * the caller reads the file; otherwise they return 0, with the first allowed
+ * matching entry, if any.
+ */
+
+static int af_index_getpwnam(pool *p, const char *name, struct passwd **res) {
+  const af_index_hdr_t *hdr;
+  const af_index_pwent_t *ents;
+  const uint32_t *buckets;
+  const char *strs;
+  uint32_t i;
+
+  hdr = af_index_get(AF_INDEX_TYPE_USER);
+  if (hdr == NULL) {
+    return -1;
+  }
+
+  ents = (const af_index_pwent_t *) (((const char *) hdr) + hdr->ents_off);
+  buckets = (const uint32_t *) (((const char *) hdr) + hdr->name_buckets_off);
+  strs = ((const char *) hdr) + hdr->strs_off;
+
+  *res = NULL;
+  for (i = buckets[af_index_hash(name) & (hdr->nbuckets - 1)]; i != 0;
+      i = ents[i-1].next_name) {
+    struct passwd *pwd;
+
+    if (strcmp(strs + ents[i-1].name, name) != 0) {
+      continue;
+    }
+
+    pwd = af_index_pwent(hdr, &(ents[i-1]));
+    if (af_allow_pwent(p, pwd) == 0) {
+      *res = pwd;
+      break;
+    }
+  }
+
+  return 0;
+}
+
+static int af_index_getpwuid(pool *p, uid_t uid, struct passwd **res) {
+  const af_index_hdr_t *hdr;
+  const af_index_pwent_t *ents;
+  const uint32_t *buckets;
+  uint32_t i;
+
+  hdr = af_index_get(AF_INDEX_TYPE_USER);
+  if (hdr == NULL) {
+    return -1;
+  }
+
+  ents = (const af_index_pwent_t *) (((const char *) hdr) + hdr->ents_off);
+  buckets = (const uint32_t *) (((const char *) hdr) + hdr->id_buckets_off);
+
+  *res = NULL;
+  for (i = buckets[af_index_hash_id((uint32_t) uid) & (hdr->nbuckets - 1)];
+      i != 0; i = ents[i-1].next_id) {
+    struct passwd *pwd;
+
+    if (ents[i-1].uid != uid) {
+      continue;
+    }
+
+    pwd = af_index_pwent(hdr, &(ents[i-1]));
+    if (af_allow_pwent(p, pwd) == 0) {
+      *res = pwd;
+      break;
+    }
+  }
+
+  return 0;
+}
+
+static int af_index_getgrnam(pool *p, const char *name, struct group **res) {
+  const af_index_hdr_t *hdr;
+  const af_index_grent_t *ents;
+  const uint32_t *buckets;
+  const char *strs;
+  uint32_t i;
+
+  hdr = af_index_get(AF_INDEX_TYPE_GROUP);
+  if (hdr == NULL) {
+    return -1;
+  }
+
+  ents = (const af_index_grent_t *) (((const char *) hdr) + hdr->ents_off);
+  buckets = (const uint32_t *) (((const char *) hdr) + hdr->name_buckets_off);
+  strs = ((const char *) hdr) + hdr->strs_off;
+
+  *res = NULL;
+  for (i = buckets[af_index_hash(name) & (hdr->nbuckets - 1)]; i != 0;
+      i = ents[i-1].next_name) {
+    struct group *grp;
+
+    if (strcmp(strs + ents[i-1].name, name) != 0) {
+      continue;
+    }
+
+    grp = af_index_grent(hdr, &(ents[i-1]));
+    if (af_allow_grent(p, grp) == 0) {
+      *res = grp;
+      break;
+    }
+  }
+
+  return 0;
+}
+
+static int af_index_getgrgid(pool *p, gid_t gid, struct group **res) {
+  const af_index_hdr_t *hdr;
+  const af_index_grent_t *ents;
+  const uint32_t *buckets;
+  uint32_t i;
+
+  hdr = af_index_get(AF_INDEX_TYPE_GROUP);
+  if (hdr == NULL) {
+    return -1;
+  }
+
+  ents = (const af_index_grent_t *) (((const char *) hdr) + hdr->ents_off);
+  buckets = (const uint32_t *) (((const char *) hdr) + hdr->id_buckets_off);
+
+  *res = NULL;
+  for (i = buckets[af_index_hash_id((uint32_t) gid) & (hdr->nbuckets - 1)];
+      i != 0; i = ents[i-1].next_id) {
+    struct group *grp;
+
+    if (ents[i-1].gid != gid) {
+      continue;
+    }
+
+    grp = af_index_grent(hdr, &(ents[i-1]));
+    if (af_allow_grent(p, grp) == 0) {
+      *res = grp;
+      break;
+    }
+  }
+
+  return 0;
+}
+
+/* Adds the IDs and names of the allowed groups listing the given user as a
+ * member, in file order, as reading the file would.
+ */
+static int af_index_getgroups(pool *p, const char *user, array_header *gids,
+    array_header *groups) {
+  const af_index_hdr_t *hdr;
+  const af_index_grent_t *ents;
+  const af_index_member_t *members;
+  const uint32_t *buckets;
+  const char *strs;
+  uint32_t i;
+
+  hdr = af_index_get(AF_INDEX_TYPE_GROUP);
+  if (hdr == NULL) {
+    return -1;
+  }
+
+  if (hdr->nmembers == 0) {
+    return 0;
+  }
+
+  ents = (const af_index_grent_t *) (((const char *) hdr) + hdr->ents_off);
+  members = (const af_index_member_t *) (((const char *) hdr) +
+    hdr->members_off);
+  buckets = (const uint32_t *) (((const char *) hdr) +
+    hdr->member_buckets_off);
+  strs = ((const char *) hdr) + hdr->strs_off;
+
+  for (i = buckets[af_index_hash(user) & (hdr->nmember_buckets - 1)]; i != 0;
+      i = members[i-1].next) {
+    const af_index_grent_t *ent;
+    struct group grp;
+
+    if (strcmp(strs + members[i-1].name, user) != 0) {
+      continue;
+    }
+
+    ent = &(ents[members[i-1].grent]);
+
+    memset(&grp, 0, sizeof(grp));
+    grp.gr_name = (char *) (strs + ent->name);
+    grp.gr_gid = ent->gid;
+
+    if (af_allow_grent(p, &grp) < 0) {
+      continue;
+    }
+
+    if (gids) {
+      *((gid_t *) push_array(gids)) = ent->gid;
+    }
+
+    if (groups) {
+      *((char **) push_array(groups)) = pstrdup(session.pool, strs + ent->name);
+    }
+  }
+
+  return 0;
+}
+
 /* Authentication handlers.
  */
 
@@ -932,15 +1874,7 @@ MODRET authfile_getpwnam(cmd_rec *cmd) {
     return PR_DECLINED(cmd);
   }
 
-  /* Ugly -- we iterate through the file.  Time-consuming. */
-  while ((pwd = af_getpwent(cmd->tmp_pool)) != NULL) {
-    pr_signals_handle();
-
-    if (strcmp(name, pwd->pw_name) == 0) {
-      /* Found the requested name */
-      break;
-    }
-  }
+  pwd = af_getpwnam(cmd->tmp_pool, name);
 
   return pwd ? mod_create_data(cmd, pwd) : PR_DECLINED(cmd);
 }
@@ -1024,14 +1958,7 @@ MODRET authfile_getgrnam(cmd_rec *cmd) {
     return PR_DECLINED(cmd);
   }
 
-  while ((grp = af_getgrent(cmd->tmp_pool)) != NULL) {
-    pr_signals_handle();
-
-    if (strcmp(name, grp->gr_name) == 0) {
-      /* Found the name requested */
-      break;
-    }
-  }
+  grp = af_getgrnam(cmd->tmp_pool, name);
 
   return grp ? mod_create_data(cmd, grp) : PR_DECLINED(cmd);
 }
@@ -1081,28 +2008,31 @@ MODRET authfile_getgroups(cmd_rec *cmd) {
 
   (void) af_setgrent(cmd->tmp_pool);
 
-  /* This is where things get slow, expensive, and ugly.  Loop through
-   * everything, checking to make sure we haven't already added it.
-   */
-  while ((grp = af_getgrent(cmd->tmp_pool)) != NULL &&
-      grp->gr_mem) {
-    char **gr_mems = NULL;
+  if (af_index_getgroups(cmd->tmp_pool, pwd->pw_name, gids, groups) < 0) {
+    /* This is where things get slow, expensive, and ugly.  Loop through
+     * everything, checking to make sure we haven't already added it.
+     */
+    while ((grp = af_getgrent(cmd->tmp_pool)) != NULL &&
+        grp->gr_mem) {
+      char **gr_mems = NULL;
 
-    pr_signals_handle();
+      pr_signals_handle();
 
-    /* Loop through each member name listed */
-    for (gr_mems = grp->gr_mem; *gr_mems; gr_mems++) {
+      /* Loop through each member name listed */
+      for (gr_mems = grp->gr_mem; *gr_mems; gr_mems++) {
 
-      /* If it matches the given username... */
-      if (strcmp(*gr_mems, pwd->pw_name) == 0) {
+        /* If it matches the given username... */
+        if (strcmp(*gr_mems, pwd->pw_name) == 0) {
 
-        /* ...add the GID and name */
-        if (gids) {
-          *((gid_t *) push_array(gids)) = grp->gr_gid;
-        }
+          /* ...add the GID and name */
+          if (gids) {
+            *((gid_t *) push_array(gids)) = grp->gr_gid;
+          }
 
-        if (groups) {
-          *((char **) push_array(groups)) = pstrdup(session.pool, grp->gr_name);
+          if (groups) {
+            *((char **) push_array(groups)) = pstrdup(session.pool,
+              grp->gr_name);
+          }
         }
       }
     }
@@ -1340,6 +2270,44 @@ MODRET authfile_chkpass(cmd_rec *cmd) {
 /* Configuration handlers
  */
 
+/* usage: AuthFileIndex on|off [check-interval] */
+MODRET set_authfileindex(cmd_rec *cmd) {
+  int engine = -1, interval = AF_INDEX_DEFAULT_INTERVAL;
+  config_rec *c;
+
+  if (cmd->argc < 2 ||
+      cmd->argc > 3) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  engine = get_boolean(cmd, 1);
+  if (engine == -1) {
+    CONF_ERROR(cmd, "expected Boolean parameter");
+  }
+
+  if (cmd->argc == 3) {
+    int secs = 0;
+
+    if (pr_str_get_duration(cmd->argv[2], &secs) < 0 ||
+        secs <= 0) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "invalid check interval: ",
+        cmd->argv[2], NULL));
+    }
+
+    interval = secs;
+  }
+
+  c = add_config_param(cmd->argv[0], 2, NULL, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[0]) = engine;
+  c->argv[1] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[1]) = interval;
+
+  return PR_HANDLED(cmd);
+}
+
 /* usage: AuthFileOptions opt1 ... */
 MODRET set_authfileoptions(cmd_rec *cmd) {
   config_rec *c = NULL;
@@ -1655,6 +2623,59 @@ MODRET set_authuserfile(cmd_rec *cmd) {
 /* Event listeners
  */
 
+static void authfile_postparse_ev(const void *event_data, void *user_data) {
+  config_rec *c;
+  server_rec *s;
+  int interval;
+
+  /* The indexes are built by the daemon process, for its session processes;
+   * there is no such daemon process for inetd-run sessions.
+   */
+  if (ServerType != SERVER_STANDALONE) {
+    return;
+  }
+
+  c = find_config(main_server->conf, CONF_PARAM, "AuthFileIndex", FALSE);
+  if (c == NULL ||
+      *((int *) c->argv[0]) != TRUE) {
+    return;
+  }
+
+  interval = *((int *) c->argv[1]);
+
+  af_index_free();
+  af_index_pool = make_sub_pool(permanent_pool);
+  pr_pool_tag(af_index_pool, "AuthFileIndex pool");
+
+  for (s = (server_rec *) server_list->xas_list; s; s = s->next) {
+    authfile_file_t *af;
+
+    pr_signals_handle();
+
+    c = find_config(s->conf, CONF_PARAM, "AuthUserFile", FALSE);
+    if (c != NULL) {
+      af = c->argv[0];
+      af_index_add(AF_INDEX_TYPE_USER, af->af_path);
+    }
+
+    c = find_config(s->conf, CONF_PARAM, "AuthGroupFile", FALSE);
+    if (c != NULL) {
+      af = c->argv[0];
+      af_index_add(AF_INDEX_TYPE_GROUP, af->af_path);
+    }
+  }
+
+  if (af_indexes != NULL) {
+    af_index_timerno = pr_timer_add(interval, -1, &auth_file_module,
+      af_index_timer_cb, "AuthFileIndex check");
+  }
+}
+
+static void authfile_restart_ev(const void *event_data, void *user_data) {
+  /* The postparse event listener builds new indexes, if need be. */
+  af_index_free();
+}
+
 static void authfile_sess_reinit_ev(const void *event_data, void *user_data) {
   int res;
 
@@ -1703,12 +2724,23 @@ static int authfile_init(void) {
     }
   }
 
+  pr_event_register(&auth_file_module, "core.postparse", authfile_postparse_ev,
+    NULL);
+  pr_event_register(&auth_file_module, "core.restart", authfile_restart_ev,
+    NULL);
+
   return 0;
 }
 
 static int authfile_sess_init(void) {
   config_rec *c = NULL;
 
+  /* Sessions use, but do not maintain, the daemon's indexes. */
+  if (af_index_timerno > 0) {
+    (void) pr_timer_remove(af_index_timerno, &auth_file_module);
+    af_index_timerno = -1;
+  }
+
   pr_event_register(&auth_file_module, "core.session-reinit",
     authfile_sess_reinit_ev, NULL);
 
@@ -1722,6 +2754,7 @@ static int authfile_sess_init(void) {
     af_group_file = c->argv[0];
   }
 
+  af_index_unmap_others();
   return 0;
 }
 
@@ -1729,6 +2762,7 @@ static int authfile_sess_init(void) {
  */
 
 static conftable authfile_conftab[] = {
+  { "AuthFileIndex",	set_authfileindex,	NULL },
   { "AuthFileOptions",	set_authfileoptions,	NULL },
   { "AuthGroupFile",	set_authgroupfile,	NULL },
   { "AuthUserFile",	set_authuserfile,	NULL },
@@ -56,6 +56,12 @@ char AddressCollisionCheck = TRUE;
 static int core_scrub_timer_id = -1;
 static pr_fh_t *displayquit_fh = NULL;
 
+/* The address/port combinations of the <VirtualHost> sections parsed so
+ * far, for AddressCollisionCheck.
+ */
+static pool *vhost_addrs_pool = NULL;
+static pr_table_t *vhost_addrs = NULL;
+
 #ifdef PR_USE_TRACE
 static const char *trace_log = NULL;
 #endif /* PR_USE_TRACE */
@@ -982,6 +988,43 @@ MODRET set_maxinstances(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: LatencyStats on|off */
+MODRET set_latencystats(cmd_rec *cmd) {
+  int engine = -1;
+  config_rec *c;
+
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  engine = get_boolean(cmd, 1);
+  if (engine == -1) {
+    CONF_ERROR(cmd, "expected Boolean parameter");
+  }
+
+  c = add_config_param(cmd->argv[0], 1, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[0]) = engine;
+
+  return PR_HANDLED(cmd);
+}
+
+/* usage: MetricsListen path|address:port */
+MODRET set_metricslisten(cmd_rec *cmd) {
+  char *addr;
+
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  addr = cmd->argv[1];
+  if (*addr != '/' &&
+      strrchr(addr, ':') == NULL) {
+    CONF_ERROR(cmd, "must be an absolute path or an address:port");
+  }
+
+  (void) add_config_param_str(cmd->argv[0], 1, addr);
+  return PR_HANDLED(cmd);
+}
+
 /* usage: MaxCommandRate rate [interval] */
 MODRET set_maxcommandrate(cmd_rec *cmd) {
   config_rec *c;
@@ -1426,13 +1469,15 @@ MODRET add_from(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
-/* usage: FSCachePolicy on|off|size {count} [maxAge {age}] */
+/* usage: FSCachePolicy on|off|size {count} [maxAge {age}]
+ *          [negativeMaxAge {age}]
+ */
 MODRET set_fscachepolicy(cmd_rec *cmd) {
   register unsigned int i;
   config_rec *c;
 
-  if (cmd->argc != 2 &&
-      cmd->argc != 5) {
+  if (cmd->argc < 2 ||
+      (cmd->argc > 2 && (cmd->argc-1) % 2 != 0)) {
     CONF_ERROR(cmd, "wrong number of parameters");
   }
 
@@ -1444,30 +1489,34 @@ MODRET set_fscachepolicy(cmd_rec *cmd) {
       CONF_ERROR(cmd, "expected Boolean parameter");
     }
 
-    c = add_config_param(cmd->argv[0], 3, NULL, NULL, NULL);
+    c = add_config_param(cmd->argv[0], 4, NULL, NULL, NULL, NULL);
     c->argv[0] = palloc(c->pool, sizeof(int));
     *((int *) c->argv[0]) = engine;
     c->argv[1] = palloc(c->pool, sizeof(unsigned int));
     *((unsigned int *) c->argv[1]) = PR_TUNABLE_FS_STATCACHE_SIZE;
     c->argv[2] = palloc(c->pool, sizeof(unsigned int));
     *((unsigned int *) c->argv[2]) = PR_TUNABLE_FS_STATCACHE_MAX_AGE;
+    c->argv[3] = palloc(c->pool, sizeof(unsigned int));
+    *((unsigned int *) c->argv[3]) = PR_TUNABLE_FS_STATCACHE_NEGATIVE_MAX_AGE;
 
     return PR_HANDLED(cmd);
   }
 
-  c = add_config_param_str(cmd->argv[0], 3, NULL, NULL, NULL);
+  c = add_config_param_str(cmd->argv[0], 4, NULL, NULL, NULL, NULL);
   c->argv[0] = palloc(c->pool, sizeof(int));
   *((int *) c->argv[0]) = TRUE;
   c->argv[1] = palloc(c->pool, sizeof(unsigned int));
   *((unsigned int *) c->argv[1]) = PR_TUNABLE_FS_STATCACHE_SIZE;
   c->argv[2] = palloc(c->pool, sizeof(unsigned int));
   *((unsigned int *) c->argv[2]) = PR_TUNABLE_FS_STATCACHE_MAX_AGE;
+  c->argv[3] = palloc(c->pool, sizeof(unsigned int));
+  *((unsigned int *) c->argv[3]) = PR_TUNABLE_FS_STATCACHE_NEGATIVE_MAX_AGE;
 
   for (i = 1; i < cmd->argc; i++) {
     if (strncasecmp(cmd->argv[i], "size", 5) == 0) {
       int size;
 
-      size = atoi(cmd->argv[i++]);
+      size = atoi(cmd->argv[++i]);
       if (size < 1) {
         CONF_ERROR(cmd, "size parameter must be greater than 1");
       }
@@ -1477,13 +1526,23 @@ MODRET set_fscachepolicy(cmd_rec *cmd) {
     } else if (strncasecmp(cmd->argv[i], "maxAge", 7) == 0) {
       int max_age;
 
-      max_age = atoi(cmd->argv[i++]);
+      max_age = atoi(cmd->argv[++i]);
       if (max_age < 1) {
         CONF_ERROR(cmd, "maxAge parameter must be greater than 1");
       }
 
       *((unsigned int *) c->argv[2]) = max_age;
 
+    } else if (strncasecmp(cmd->argv[i], "negativeMaxAge", 15) == 0) {
+      int max_age;
+
+      max_age = atoi(cmd->argv[++i]);
+      if (max_age < 0) {
+        CONF_ERROR(cmd, "negativeMaxAge parameter must be 0 or greater");
+      }
+
+      *((unsigned int *) c->argv[3]) = max_age;
+
     } else {
       CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "unknown FSCachePolicy: ",
         cmd->argv[i], NULL));
@@ -1512,6 +1571,9 @@ MODRET set_fsoptions(cmd_rec *cmd) {
     if (strcmp(cmd->argv[i], "IgnoreExtendedAttributes") == 0) {
       opts |= PR_FSIO_OPT_IGNORE_XATTR;
 
+    } else if (strcmp(cmd->argv[i], "IgnoreResolveBeneath") == 0) {
+      opts |= PR_FSIO_OPT_IGNORE_RESOLVE_BENEATH;
+
     } else {
       CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, ": unknown FSOption '",
         cmd->argv[i], "'", NULL));
@@ -3384,7 +3446,6 @@ MODRET add_virtualhost(cmd_rec *cmd) {
 }
 
 MODRET end_virtualhost(cmd_rec *cmd) {
-  server_rec *s = NULL, *next_s = NULL;
   const pr_netaddr_t *addr = NULL;
   const char *address = NULL;
   unsigned int addr_flags = PR_NETADDR_GET_ADDR_FL_INCL_DEVICE;
@@ -3414,57 +3475,73 @@ MODRET end_virtualhost(cmd_rec *cmd) {
       "warning: unable to determine IP address of '%s'", address);
   }
 
-  if (AddressCollisionCheck) {
-    /* Check if this server's address/port combination is already being used. */
-    for (s = (server_rec *) server_list->xas_list; addr && s; s = next_s) {
-      next_s = s->next;
+  if (AddressCollisionCheck &&
+      addr != NULL) {
+    const char *addr_key, *main_addrstr;
+    const pr_netaddr_t *main_addr;
+    server_rec *used_by = NULL;
+    char port_str[32];
 
-      /* Have to resort to duplicating some of fixup_servers()'s functionality
-       * here, to do this check The Right Way(tm).
-       */
-      if (s != cmd->server) {
-        const char *serv_addrstr = NULL;
-        const pr_netaddr_t *serv_addr = NULL;
+    /* Check if this server's address/port combination is already being
+     * used, either by the main server, or by an earlier <VirtualHost>.  The
+     * latter are looked up by IP address and port, rather than comparing
+     * against every server parsed so far.
+     */
+    main_addrstr = main_server->ServerAddress ? main_server->ServerAddress :
+      pr_netaddr_get_localaddr_str(cmd->tmp_pool);
+    main_addr = pr_netaddr_get_addr2(cmd->tmp_pool, main_addrstr, NULL,
+      addr_flags);
+    if (main_addr == NULL) {
+      pr_log_pri(PR_LOG_WARNING,
+        "warning: unable to determine IP address of '%s'", main_addrstr);
 
-        if (s->addr) {
-          serv_addr = s->addr;
+    } else if (pr_netaddr_cmp(addr, main_addr) == 0 &&
+               cmd->server->ServerPort == main_server->ServerPort) {
+      used_by = main_server;
+    }
 
-        } else {
-          serv_addrstr = s->ServerAddress ? s->ServerAddress :
-            pr_netaddr_get_localaddr_str(cmd->tmp_pool);
+    if (vhost_addrs == NULL) {
+      unsigned int max_ents = UINT_MAX;
 
-          serv_addr = pr_netaddr_get_addr2(cmd->tmp_pool, serv_addrstr, NULL,
-            addr_flags);
-        }
+      vhost_addrs_pool = make_sub_pool(permanent_pool);
+      pr_pool_tag(vhost_addrs_pool, "VirtualHost Addresses Pool");
 
-        if (serv_addr == NULL) {
-          pr_log_pri(PR_LOG_WARNING,
-            "warning: unable to determine IP address of '%s'", serv_addrstr);
+      vhost_addrs = pr_table_nalloc(vhost_addrs_pool, 0, 1024);
+      (void) pr_table_ctl(vhost_addrs, PR_TABLE_CTL_SET_MAX_ENTS, &max_ents);
+    }
 
-        } else if (pr_netaddr_cmp(addr, serv_addr) == 0 &&
-            cmd->server->ServerPort == s->ServerPort) {
-          config_rec *c;
+    memset(port_str, '\0', sizeof(port_str));
+    pr_snprintf(port_str, sizeof(port_str)-1, "%u", cmd->server->ServerPort);
+    addr_key = pstrcat(cmd->tmp_pool, pr_netaddr_get_ipstr(addr), "#",
+      port_str, NULL);
 
-          /* If this server has a ServerAlias, it means it's a named vhost and
-           * can be used for name-based virtual hosting.  Which, in turn, means
-           * that this collision is expected, even wanted.
-           */
-          c = find_config(cmd->server->conf, CONF_PARAM, "ServerAlias", FALSE);
-          if (c == NULL) {
-            pr_log_pri(PR_LOG_WARNING,
-              "warning: \"%s\" address/port (%s:%d) already in use by \"%s\"",
-              cmd->server->ServerName ? cmd->server->ServerName : "ProFTPD",
-              pr_netaddr_get_ipstr(addr), cmd->server->ServerPort,
-              s->ServerName ? s->ServerName : "ProFTPD");
-
-            if (xaset_remove(server_list, (xasetmember_t *) cmd->server) == 1) {
-              destroy_pool(cmd->server->pool);
-            }
-          }
-        }
+    if (used_by == NULL) {
+      used_by = (server_rec *) pr_table_get(vhost_addrs, addr_key, NULL);
+    }
 
-        continue;
+    if (used_by != NULL) {
+      config_rec *c;
+
+      /* If this server has a ServerAlias, it means it's a named vhost and
+       * can be used for name-based virtual hosting.  Which, in turn, means
+       * that this collision is expected, even wanted.
+       */
+      c = find_config(cmd->server->conf, CONF_PARAM, "ServerAlias", FALSE);
+      if (c == NULL) {
+        pr_log_pri(PR_LOG_WARNING,
+          "warning: \"%s\" address/port (%s:%d) already in use by \"%s\"",
+          cmd->server->ServerName ? cmd->server->ServerName : "ProFTPD",
+          pr_netaddr_get_ipstr(addr), cmd->server->ServerPort,
+          used_by->ServerName ? used_by->ServerName : "ProFTPD");
+
+        if (xaset_remove(server_list, (xasetmember_t *) cmd->server) == 1) {
+          destroy_pool(cmd->server->pool);
+        }
       }
+
+    } else {
+      (void) pr_table_add(vhost_addrs, pstrdup(vhost_addrs_pool, addr_key),
+        cmd->server, sizeof(server_rec *));
     }
   }
 
@@ -6477,14 +6554,16 @@ MODRET core_post_pass(cmd_rec *cmd) {
   c = find_config(main_server->conf, CONF_PARAM, "FSCachePolicy", FALSE);
   if (c != NULL) {
     int engine;
-    unsigned int size, max_age;
+    unsigned int size, max_age, negative_max_age;
 
     engine = *((int *) c->argv[0]);
     size = *((unsigned int *) c->argv[1]);
     max_age = *((unsigned int *) c->argv[2]);
+    negative_max_age = *((unsigned int *) c->argv[3]);
 
     if (engine) {
       pr_fs_statcache_set_policy(size, max_age, 0);
+      pr_fs_statcache_set_negative_max_age(negative_max_age);
 
     } else {
       pr_fs_statcache_set_policy(0, 0, 0);
@@ -6494,6 +6573,8 @@ MODRET core_post_pass(cmd_rec *cmd) {
     /* Set the default statcache policy. */
     pr_fs_statcache_set_policy(PR_TUNABLE_FS_STATCACHE_SIZE,
       PR_TUNABLE_FS_STATCACHE_MAX_AGE, 0);
+    pr_fs_statcache_set_negative_max_age(
+      PR_TUNABLE_FS_STATCACHE_NEGATIVE_MAX_AGE);
   }
 
   /* Register an exit handler here, for clearing the statcache. */
@@ -6570,6 +6651,14 @@ static void core_exit_ev(const void *event_data, void *user_data) {
   pr_fs_statcache_free();
 }
 
+static void core_postparse_ev(const void *event_data, void *user_data) {
+  if (vhost_addrs_pool != NULL) {
+    destroy_pool(vhost_addrs_pool);
+    vhost_addrs_pool = NULL;
+    vhost_addrs = NULL;
+  }
+}
+
 static void core_restart_ev(const void *event_data, void *user_data) {
   pr_fs_statcache_reset();
   pr_scoreboard_scrub();
@@ -6672,6 +6761,7 @@ static int core_init(void) {
   pr_feat_add(C_SIZE);
   pr_feat_add(C_HOST);
 
+  pr_event_register(&core_module, "core.postparse", core_postparse_ev, NULL);
   pr_event_register(&core_module, "core.restart", core_restart_ev, NULL);
   pr_event_register(&core_module, "core.startup", core_startup_ev, NULL);
 
@@ -7133,10 +7223,12 @@ static conftable core_conftab[] = {
   { "IgnoreHidden",		set_ignorehidden,		NULL },
   { "Include",			set_include,	 		NULL },
   { "IncludeOptions",		set_includeoptions, 		NULL },
+  { "LatencyStats",		set_latencystats,		NULL },
   { "MasqueradeAddress",	set_masqueradeaddress,		NULL },
   { "MaxCommandRate",		set_maxcommandrate,		NULL },
   { "MaxConnectionRate",	set_maxconnrate,		NULL },
   { "MaxInstances",		set_maxinstances,		NULL },
+  { "MetricsListen",		set_metricslisten,		NULL },
   { "MultilineRFC2228",		set_multilinerfc2228,		NULL },
   { "Order",			set_order,			NULL },
   { "PassivePorts",		set_passiveports,		NULL },
@@ -29,7 +29,7 @@
 #include "conf.h"
 #include "privs.h"
 
-#define MOD_DELAY_VERSION		"mod_delay/0.7"
+#define MOD_DELAY_VERSION		"mod_delay/0.8"
 
 /* Make sure the version of proftpd is as necessary. */
 #if PROFTPD_VERSION_NUMBER < 0x0001021001
@@ -52,7 +52,7 @@
 # include <mod_ctrls.h>
 #endif /* PR_USE_CTRLS */
 
-/* Number of values to keep in a row. */
+/* Number of values to keep in a row; this must be a power of two. */
 #ifndef DELAY_NVALUES
 # define DELAY_NVALUES			256
 #endif
@@ -92,6 +92,13 @@
  */
 #define DELAY_MAX_CONNECT_INTERVAL_USECS	60000000L
 
+#if defined(__GNUC__)
+# define DELAY_ATOMIC_ADD(v, n)		__sync_fetch_and_add(&(v), (n))
+#else
+/* Without atomic operations, concurrent values may occasionally collide. */
+# define DELAY_ATOMIC_ADD(v, n)		(((v) += (n)) - (n))
+#endif
+
 #if defined(PR_USE_CTRLS)
 static ctrls_acttab_t delay_acttab[];
 #endif /* PR_USE_CTRLS */
@@ -100,9 +107,17 @@ extern xaset_t *server_list;
 
 module delay_module;
 
+/* Sessions add their values to the DelayTable rows without locking them.
+ * Each row is a ring of the most recent values: a session claims the next
+ * slot by atomically incrementing the count of values ever added, and the
+ * median is estimated incrementally as the values are added, rather than
+ * selected from the stored values.  The stored values are kept for the
+ * "delay info" control action.
+ */
 struct delay_vals_rec {
   char dv_proto[16];
-  unsigned int dv_nvals;
+  volatile unsigned int dv_nvals;
+  pr_stats_median_t dv_median;
   long dv_vals[DELAY_NVALUES];
 };
 
@@ -142,164 +157,61 @@ static unsigned long delay_user_min_delay = 0UL;
 static int delay_sess_init(void);
 static void delay_table_reset(void);
 
-#define delay_swap(a, b) \
-  tmp = (a); \
-  (a) = (b); \
-  (b) = tmp;
-
 static const char *trace_channel = "delay";
 
-static long delay_select_k(unsigned long k, array_header *values) {
-  unsigned long l, ir, tmp = 0;
-  long *elts = (long *) values->elts;
-  unsigned int nelts = values->nelts;
-
-  /* This is from "Numeric Recipes in C", Ch. 8.5, as the select()
-   * algorithm, an in-place sorting algorithm for finding the Kth
-   * element in an array, where all elements to the left of K are
-   * smaller than K, and all elements to the right are larger.
-   */
-
-  l = 1;
-  ir = values->nelts - 1;
-
-  while (TRUE) {
-    pr_signals_handle();
-
-    if (ir <= l+1) {
-      if (ir == l+1 &&
-          elts[ir] < elts[l]) {
-        delay_swap(elts[l], elts[ir]);
-      }
-
-      return elts[k];
-
-    } else {
-      unsigned int i, j;
-      long p;
-      unsigned long mid = (l + ir) >> 1;
-
-      delay_swap(elts[mid], elts[l+1]);
-      if (elts[l] > elts[ir]) {
-        delay_swap(elts[l], elts[ir]);
-      }
-
-      if (elts[l+1] > elts[ir]) {
-        delay_swap(elts[l+1], elts[ir]);
-      }
-
-      if (elts[l] > elts[l+1]) {
-        delay_swap(elts[l], elts[l+1]);
-      }
-
-      i = l + 1;
-      j = ir;
-      p = elts[l+1];
-
-      while (TRUE) {
-        pr_signals_handle();
-
-        do i++;
-          while (i < nelts && elts[i] < p);
-
-        do j--;
-          while (elts[j] > p);
-
-        if (j < i) {
-          break;
-        }
-
-        delay_swap(elts[i], elts[j]);
-      }
-
-      elts[l+1] = elts[j];
-      elts[j] = p;
+static struct delay_vals_rec *delay_get_vals(unsigned int rownum,
+    const char *protocol) {
+  register unsigned int i;
+  struct delay_rec *row;
 
-      if ((unsigned long) p >= k) {
-        ir = j - 1;
-      }
+  row = &((struct delay_rec *) delay_tab.dt_data)[rownum];
 
-      if ((unsigned long) p <= k) {
-        l = i;
-      }
+  for (i = 0; i < DELAY_NPROTO; i++) {
+    struct delay_vals_rec *dv;
 
-      if (l >= (nelts - 1) ||
-          ir >= nelts) {
-        break;
-      }
+    dv = &(row->d_vals[i]);
+    if (strcmp(dv->dv_proto, protocol) == 0) {
+      return dv;
     }
   }
 
-  return -1;
+  return NULL;
 }
 
-static long delay_get_median(pool *p, unsigned int rownum, const char *protocol,
+static long delay_get_median(unsigned int rownum, const char *protocol,
     long interval) {
-  register unsigned int i;
-  struct delay_rec *row;
-  struct delay_vals_rec *dv = NULL;
-  long *tab_vals = NULL, median;
-  array_header *list = make_array(p, 1, sizeof(long));
-  
-  /* Calculate the median value of the current command's recorded values,
+  struct delay_vals_rec *dv;
+  long median = -1;
+
+  /* Look up the estimated median of the current command's recorded values,
    * taking the protocol (e.g. "ftp", "ftps", "ssh2") into account.
    *
-   * When calculating the median, we use the current interval as well
-   * as the recorded intervals in the table, giving us an odd number of
-   * values.
-   *
-   * If the number of values in this row is less than the watermark
-   * value, we'll actually return the maximum value, rather than the
-   * median.  Below the watermark, the server is "cold" and has not
-   * yet accumulated enough data to make the median a useful value.
+   * If no values have been recorded yet, the current interval is the
+   * median, and no delay is needed.
    */
 
-  row = &((struct delay_rec *) delay_tab.dt_data)[rownum];
-
-  /* Find the list of delay values that match the given protocol. */
-  for (i = 0; i < DELAY_NPROTO; i++) {
-    dv = &(row->d_vals[i]);
-    if (strcmp(dv->dv_proto, protocol) == 0) {
-      tab_vals = dv->dv_vals;
-      break;
-    }
+  dv = delay_get_vals(rownum, protocol);
+  if (dv != NULL) {
+    median = pr_stats_median_get(&(dv->dv_median));
   }
 
-  /* Start at the end of the row and work backward, as values are
-   * always added at the end of the row, shifting everything to the left.
-   */
-  if (tab_vals != NULL) {
-    for (i = 1; i < dv->dv_nvals; i++) {
-      /* Ignore any possible garbage (i.e. negative) values in the
-       * DelayTable.
-       */
-      if (tab_vals[DELAY_NVALUES - 1 - i] >= 0) {
-        *((long *) push_array(list)) = tab_vals[DELAY_NVALUES - 1 - i];
-      }
-    }
+  if (median < 0) {
+    median = interval;
   }
-  *((long *) push_array(list)) = interval;
-
-  pr_trace_msg(trace_channel, 6, "selecting median interval from %d %s",
-    list->nelts, list->nelts != 1 ? "values" : "value");
 
-  median = delay_select_k(((list->nelts + 1) / 2), list);
-  if (median >= 0) {
+  /* Enforce an additional restriction: no delays over a hard limit. */
+  if (median >= DELAY_MAX_DELAY_USECS) {
+    pr_trace_msg(trace_channel, 1,
+      "selected median (%ld usecs) exceeds max delay (%ld usecs), ignoring",
+      median, (long) DELAY_MAX_DELAY_USECS);
+    pr_log_debug(DEBUG5, MOD_DELAY_VERSION
+      ": selected median (%ld usecs) exceeds max delay (%ld usecs), ignoring",
+      median, (long) DELAY_MAX_DELAY_USECS);
+    median = -1;
 
-    /* Enforce an additional restriction: no delays over a hard limit. */
-    if (median >= DELAY_MAX_DELAY_USECS) {
-      pr_trace_msg(trace_channel, 1,
-        "selected median (%ld usecs) exceeds max delay (%ld usecs), ignoring",
-        median, (long) DELAY_MAX_DELAY_USECS);
-      pr_log_debug(DEBUG5, MOD_DELAY_VERSION
-        ": selected median (%ld usecs) exceeds max delay (%ld usecs), ignoring",
-        median, (long) DELAY_MAX_DELAY_USECS);
-      median = -1;
-
-    } else {
-      pr_trace_msg(trace_channel, 7, "selected median interval of %ld usecs",
-        median);
-    }
+  } else {
+    pr_trace_msg(trace_channel, 7, "selected median interval of %ld usecs",
+      median);
   }
 
   return median;
@@ -521,34 +433,34 @@ static unsigned int delay_get_pass_rownum(unsigned int sid) {
 
 static void delay_table_add_interval(unsigned int rownum, const char *protocol,
     long interval) {
-  register unsigned int i;
-  struct delay_rec *row;
-  struct delay_vals_rec *dv = NULL;
-
-  row = &((struct delay_rec *) delay_tab.dt_data)[rownum];
+  struct delay_vals_rec *dv;
+  unsigned int idx;
 
-  for (i = 0; i < DELAY_NPROTO; i++) {
-    dv = &(row->d_vals[i]);
-    if (strcmp(dv->dv_proto, protocol) == 0) {
-      break;
-    }
+  /* A negative interval means that the clock was stepped back while the
+   * command was handled; it says nothing about how long the command took,
+   * and would wrap around when cast for the median, so drop it.
+   */
+  if (interval < 0) {
+    pr_trace_msg(trace_channel, 3, "ignoring negative interval (%ld usecs)",
+      interval);
+    return;
   }
 
-  /* Shift all existing values to the left one position. */
-  memmove(&(dv->dv_vals[0]), &(dv->dv_vals[1]),
-    sizeof(long) * (DELAY_NVALUES - 1));
-
-  /* Add the given value to the end. */
+  dv = delay_get_vals(rownum, protocol);
+  if (dv == NULL) {
+    return;
+  }
 
   if (interval > DELAY_MAX_DELAY_USECS) {
     /* Truncate the interval to the maximum allowed value. */
     interval = DELAY_MAX_DELAY_USECS;
   }
 
-  dv->dv_vals[DELAY_NVALUES-1] = interval;
-  if (dv->dv_nvals < DELAY_NVALUES) {
-    dv->dv_nvals++;
-  }
+  /* Claim the next slot in the ring, overwriting the oldest value. */
+  idx = DELAY_ATOMIC_ADD(dv->dv_nvals, 1) % DELAY_NVALUES;
+  dv->dv_vals[idx] = interval;
+
+  (void) pr_stats_median_add(&(dv->dv_median), (uint32_t) interval);
 }
 
 static int delay_table_init(void) {
@@ -1037,33 +949,6 @@ static void delay_table_reset(void) {
   return;
 }
 
-static int delay_table_wlock(unsigned int rownum) {
-  struct flock lock;
-
-  lock.l_type = F_WRLCK;
-  lock.l_whence = 0;
-  lock.l_start = sizeof(struct delay_rec) * rownum;
-  lock.l_len = sizeof(struct delay_rec);
-
-  pr_trace_msg(trace_channel, 8, "write-locking DelayTable '%s', row %u",
-    delay_tab.dt_path, rownum + 1);
-  while (fcntl(delay_tab.dt_fd, F_SETLKW, &lock) < 0) {
-    int xerrno = errno;
-
-    if (xerrno == EINTR) {
-      pr_signals_handle();
-      continue;
-    }
-
-    pr_trace_msg(trace_channel, 1, "error locking row: %s", strerror(xerrno));
-
-    errno = xerrno;
-    return -1;
-  }
-
-  return 0;
-}
-
 static int delay_table_unload(int unlock_table) {
 
   if (delay_tab.dt_data) {
@@ -1107,33 +992,6 @@ static int delay_table_unload(int unlock_table) {
   return 0;
 }
 
-static int delay_table_unlock(unsigned int rownum) {
-  struct flock lock;
-
-  lock.l_type = F_UNLCK;
-  lock.l_whence = 0;
-  lock.l_start = sizeof(struct delay_rec) * rownum;
-  lock.l_len = sizeof(struct delay_rec);
-
-  pr_trace_msg(trace_channel, 8, "unlocking DelayTable '%s', row %u",
-    delay_tab.dt_path, rownum + 1);
-  while (fcntl(delay_tab.dt_fd, F_SETLKW, &lock) < 0) {
-    int xerrno = errno;
-
-    if (xerrno == EINTR) {
-      pr_signals_handle();
-      continue;
-    }
-
-    pr_trace_msg(trace_channel, 1, "error unlocking row: %s", strerror(xerrno));
-
-    errno = xerrno;
-    return -1;
-  }
-
-  return 0;
-}
-
 #if defined(PR_USE_CTRLS)
 
 /* Control handlers
@@ -1197,6 +1055,7 @@ static int delay_handle_info(pr_ctrls_t *ctrl, int reqargc,
     for (i = 0; i < DELAY_NPROTO; i++) {
       struct delay_vals_rec *dv;
       register unsigned int j;
+      unsigned int nvals, count;
 
       dv = &(row->d_vals[i]);
 
@@ -1204,19 +1063,20 @@ static int delay_handle_info(pr_ctrls_t *ctrl, int reqargc,
         continue;
       }
 
-      pr_ctrls_add_response(ctrl, " + Protocol %s, %u values:", dv->dv_proto,
-        dv->dv_nvals);
+      nvals = dv->dv_nvals;
+      count = nvals < DELAY_NVALUES ? nvals : DELAY_NVALUES;
+
+      pr_ctrls_add_response(ctrl, " + Protocol %s, %u values, median %ld:",
+        dv->dv_proto, count, pr_stats_median_get(&(dv->dv_median)));
 
-      /* Start at the end of the row and work backward, as values are
-       * always added at the end of the row, shifting everything to the left.
-       */
+      /* Start with the most recently added value, and work backward. */
       vals = "";
-      for (j = 0; j < dv->dv_nvals; j++) {
+      for (j = 0; j < count; j++) {
         char buf[80];
 
         memset(buf, '\0', sizeof(buf));
         pr_snprintf(buf, sizeof(buf)-1, "%10ld",
-          dv->dv_vals[DELAY_NVALUES - 1 - j]);
+          dv->dv_vals[(nvals - 1 - j) % DELAY_NVALUES]);
 
         vals = pstrcat(tmp_pool, vals, " ", buf, NULL);
 
@@ -1242,6 +1102,7 @@ static int delay_handle_info(pr_ctrls_t *ctrl, int reqargc,
     for (i = 0; i < DELAY_NPROTO; i++) {
       struct delay_vals_rec *dv;
       register unsigned int j;
+      unsigned int nvals, count;
 
       dv = &(row->d_vals[i]);
 
@@ -1249,16 +1110,19 @@ static int delay_handle_info(pr_ctrls_t *ctrl, int reqargc,
         continue;
       }
 
-      pr_ctrls_add_response(ctrl, " + Protocol %s, %u values:", dv->dv_proto,
-        dv->dv_nvals);
+      nvals = dv->dv_nvals;
+      count = nvals < DELAY_NVALUES ? nvals : DELAY_NVALUES;
+
+      pr_ctrls_add_response(ctrl, " + Protocol %s, %u values, median %ld:",
+        dv->dv_proto, count, pr_stats_median_get(&(dv->dv_median)));
 
       vals = "";
-      for (j = 0; j < dv->dv_nvals; j++) {
+      for (j = 0; j < count; j++) {
         char buf[80];
 
         memset(buf, '\0', sizeof(buf));
         pr_snprintf(buf, sizeof(buf)-1, "%10ld",
-          dv->dv_vals[DELAY_NVALUES - 1 - j]);
+          dv->dv_vals[(nvals - 1 - j) % DELAY_NVALUES]);
 
         vals = pstrcat(tmp_pool, vals, " ", buf, NULL);
 
@@ -1293,8 +1157,8 @@ static int delay_handle_info(pr_ctrls_t *ctrl, int reqargc,
 
 static int delay_handle_reset(pr_ctrls_t *ctrl, int reqargc,
     char **reqarg) {
-  struct flock lock;
   pr_fh_t *fh;
+  struct stat st;
   int xerrno = 0;
 
   PRIVS_ROOT
@@ -1310,38 +1174,43 @@ static int delay_handle_reset(pr_ctrls_t *ctrl, int reqargc,
     return -1;
   }
 
-  lock.l_type = F_WRLCK;
-  lock.l_whence = 0;
-  lock.l_start = 0;
-  lock.l_len = 0;
-
-  while (fcntl(fh->fh_fd, F_SETLKW, &lock) < 0) {
-    if (errno == EINTR) {
-      pr_signals_handle();
-      continue;
-
-    } else {
-      pr_ctrls_add_response(ctrl,
-        "unable to obtain write lock on DelayTable '%s': %s",
-         fh->fh_path, strerror(errno));
-      pr_fsio_close(fh);
-      return -1;
-    }
+  /* Sessions keep the table mapped, so it is cleared in place rather than
+   * truncated; make sure it is large enough to be mapped.
+   */
+  if (pr_fsio_fstat(fh, &st) < 0 ||
+      (st.st_size < (off_t) delay_tab.dt_size &&
+       pr_fsio_ftruncate(fh, delay_tab.dt_size) < 0)) {
+    pr_ctrls_add_response(ctrl,
+      "error sizing DelayTable '%s': %s", fh->fh_path, strerror(errno));
+    pr_fsio_close(fh);
+    return -1;
   }
 
-  if (pr_fsio_ftruncate(fh, 0) < 0) {
+  delay_tab.dt_fd = fh->fh_fd;
+  delay_tab.dt_data = NULL;
+
+  if (delay_table_load(TRUE) < 0) {
     pr_ctrls_add_response(ctrl,
-      "error truncating DelayTable '%s': %s", fh->fh_path, strerror(errno));
+      "unable to load DelayTable '%s' (fd %d) into memory: %s",
+      delay_tab.dt_path, delay_tab.dt_fd, strerror(errno));
+
     pr_fsio_close(fh);
+    delay_tab.dt_fd = -1;
+    delay_tab.dt_data = NULL;
     return -1;
   }
 
-  lock.l_type = F_UNLCK;
-  if (fcntl(fh->fh_fd, F_SETLK, &lock) < 0) {
-    pr_trace_msg(trace_channel, 3,
-      "error unlocking fd %d: %s", fh->fh_fd, strerror(errno));
+  delay_table_reset();
+
+  if (delay_table_unload(TRUE) < 0) {
+    pr_ctrls_add_response(ctrl,
+      "unable to unload DelayTable '%s' from memory: %s",
+      delay_tab.dt_path, strerror(errno));
   }
 
+  delay_tab.dt_fd = -1;
+  delay_tab.dt_data = NULL;
+
   if (pr_fsio_close(fh) < 0) {
     pr_ctrls_add_response(ctrl,
       "error closing DelayTable '%s': %s", delay_tab.dt_path,
@@ -1606,26 +1475,14 @@ MODRET delay_post_pass(cmd_rec *cmd) {
 
   rownum = delay_get_pass_rownum(main_server->sid);
 
-  /* Prepare for manipulating the table. */
-  if (delay_table_load(FALSE) < 0) {
-    int xerrno = errno;
-
-    pr_log_pri(PR_LOG_WARNING, MOD_DELAY_VERSION
-      ": unable to load DelayTable '%s' (fd %d) into memory: %s",
-      delay_tab.dt_path, delay_tab.dt_fd, strerror(xerrno));
-    pr_trace_msg(trace_channel, 1,
-      "unable to load DelayTable '%s' (fd %d) into memory: %s",
-      delay_tab.dt_path, delay_tab.dt_fd, strerror(xerrno));
-
-    errno = xerrno;
+  /* The DelayTable is mapped into memory when the session starts. */
+  if (delay_tab.dt_data == NULL) {
     return PR_DECLINED(cmd);
   }
 
   memset(&tv, 0, sizeof(tv));
   gettimeofday(&tv, NULL);
 
-  delay_table_wlock(rownum);
-
   interval = (tv.tv_sec - delay_tv.tv_sec) * 1000000 +
     (tv.tv_usec - delay_tv.tv_usec);
   pr_trace_msg(trace_channel, 9,
@@ -1634,7 +1491,7 @@ MODRET delay_post_pass(cmd_rec *cmd) {
   proto = pr_session_get_protocol(0);
 
   /* Get the median interval value. */
-  median = delay_get_median(cmd->tmp_pool, rownum, proto, interval);
+  median = delay_get_median(rownum, proto, interval);
 
   /* Add the interval to the table. Only allow a single session to
    * add a portion of the cache size, to prevent a single client from
@@ -1652,23 +1509,6 @@ MODRET delay_post_pass(cmd_rec *cmd) {
     pr_event_generate("mod_delay.max-pass", session.c);
   }
 
-  /* Done with the table. */
-  delay_table_unlock(rownum);
-  if (delay_table_unload(FALSE) < 0) {
-    pr_log_pri(PR_LOG_WARNING, MOD_DELAY_VERSION
-      ": unable to unload DelayTable '%s' from memory: %s",
-      delay_tab.dt_path, strerror(errno));
-  }
-
-  /* If this is a POST_CMD phase, then close the table.  If the phase is
-   * POST_CMD_ERR, then leave the table open; the client may send another
-   * set of USER/PASS commands.
-   */
-  if (session.curr_phase == POST_CMD) {
-    (void) close(delay_tab.dt_fd);
-    delay_tab.dt_fd = -1;
-  }
-
   /* If the current interval is less than the median interval (and a valid
    * median interval was selected), we need to delay ourselves a little.
    */
@@ -1721,26 +1561,14 @@ MODRET delay_post_user(cmd_rec *cmd) {
  
   rownum = delay_get_user_rownum(main_server->sid);
 
-  /* Prepare for manipulating the table. */
-  if (delay_table_load(FALSE) < 0) {
-    int xerrno = errno;
-
-    pr_log_pri(PR_LOG_WARNING, MOD_DELAY_VERSION
-      ": unable to load DelayTable '%s' (fd %d) into memory: %s",
-      delay_tab.dt_path, delay_tab.dt_fd, strerror(xerrno));
-    pr_trace_msg(trace_channel, 1,
-      "unable to load DelayTable '%s' (fd %d) into memory: %s",
-      delay_tab.dt_path, delay_tab.dt_fd, strerror(xerrno));
-
-    errno = xerrno;
+  /* The DelayTable is mapped into memory when the session starts. */
+  if (delay_tab.dt_data == NULL) {
     return PR_DECLINED(cmd);
   }
 
   memset(&tv, 0, sizeof(tv));
   gettimeofday(&tv, NULL);
 
-  delay_table_wlock(rownum);
-
   interval = (tv.tv_sec - delay_tv.tv_sec) * 1000000 +
     (tv.tv_usec - delay_tv.tv_usec);
 
@@ -1760,7 +1588,7 @@ MODRET delay_post_user(cmd_rec *cmd) {
   proto = pr_session_get_protocol(0);
 
   /* Get the median interval value. */
-  median = delay_get_median(cmd->tmp_pool, rownum, proto, interval);
+  median = delay_get_median(rownum, proto, interval);
 
   /* Add the interval to the table. Only allow a single session to
    * add a portion of the cache size, to prevent a single client from
@@ -1778,14 +1606,6 @@ MODRET delay_post_user(cmd_rec *cmd) {
     pr_event_generate("mod_delay.max-user", session.c);
   }
 
-  /* Done with the table. */
-  delay_table_unlock(rownum);
-  if (delay_table_unload(FALSE) < 0) {
-    pr_log_pri(PR_LOG_WARNING, MOD_DELAY_VERSION
-      ": unable to unload DelayTable '%s' from memory: %s",
-      delay_tab.dt_path, strerror(errno));
-  }
-
   /* If the current interval is less than the median interval (and a valid
    * median interval was selected), we need to delay ourselves a little.
    */
@@ -1903,9 +1723,10 @@ static void delay_sess_reinit_ev(const void *event_data, void *user_data) {
 
   delay_engine = TRUE;
 
-  if (delay_tab.dt_fd > 0) {
-    close(delay_tab.dt_fd);
-    delay_tab.dt_fd = -1;
+  if (delay_table_unload(FALSE) < 0) {
+    pr_log_pri(PR_LOG_WARNING, MOD_DELAY_VERSION
+      ": unable to unload DelayTable '%s' from memory: %s",
+      delay_tab.dt_path, strerror(errno));
   }
 
   delay_nuser = 0;
@@ -2134,6 +1955,24 @@ static int delay_sess_init(void) {
   delay_tab.dt_fd = fh->fh_fd;
   delay_tab.dt_data = NULL;
 
+  /* Map the table for the rest of the session; the USER and PASS handlers
+   * then use it without any further system calls.  The mapping outlives
+   * the fd.
+   */
+  if (delay_table_load(FALSE) < 0) {
+    xerrno = errno;
+
+    pr_log_pri(PR_LOG_WARNING, MOD_DELAY_VERSION
+      ": unable to load DelayTable '%s' (fd %d) into memory: %s",
+      delay_tab.dt_path, delay_tab.dt_fd, strerror(xerrno));
+    pr_trace_msg(trace_channel, 1,
+      "unable to load DelayTable '%s' (fd %d) into memory: %s",
+      delay_tab.dt_path, delay_tab.dt_fd, strerror(xerrno));
+  }
+
+  (void) pr_fsio_close(fh);
+  delay_tab.dt_fd = -1;
+
   return 0;  
 }
 
@@ -361,6 +361,35 @@ static char *mlinfo_buf = NULL, *mlinfo_bufptr = NULL;
 static size_t mlinfo_bufsz = 0;
 static size_t mlinfo_buflen = 0;
 
+/* ListCache: the key of the MLSD listing being rendered, if it is to be
+ * cached, and the rendered output so far.
+ */
+static const char *mlsd_cache_key = NULL;
+static pool *mlsd_cache_pool = NULL;
+static pr_listcache_buf_t mlsd_cache_buf;
+
+static void facts_mlsd_cache_reset(void) {
+  if (mlsd_cache_pool != NULL) {
+    destroy_pool(mlsd_cache_pool);
+    mlsd_cache_pool = NULL;
+  }
+
+  mlsd_cache_key = NULL;
+  memset(&mlsd_cache_buf, 0, sizeof(mlsd_cache_buf));
+}
+
+static void facts_mlsd_cache_capture(const char *buf, size_t buflen) {
+  if (mlsd_cache_key == NULL) {
+    return;
+  }
+
+  if (pr_listcache_append(mlsd_cache_pool, &mlsd_cache_buf, buf,
+      buflen) < 0) {
+    pr_trace_msg("listcache", 9, "MLSD listing too large, not caching");
+    facts_mlsd_cache_reset();
+  }
+}
+
 static void facts_mlinfobuf_init(void) {
   if (mlinfo_buf == NULL) {
     mlinfo_bufsz = pr_config_get_server_xfer_bufsz(PR_NETIO_IO_WR);
@@ -395,6 +424,8 @@ static void facts_mlinfobuf_add(struct mlinfo *info, int flags) {
     (void) facts_mlinfobuf_flush();
   }
 
+  facts_mlsd_cache_capture(buf, buflen);
+
   sstrcat(mlinfo_bufptr, buf, mlinfo_bufsz - mlinfo_buflen);
   mlinfo_bufptr += buflen;
   mlinfo_buflen += buflen;
@@ -423,22 +454,30 @@ static void facts_mlinfobuf_flush(void) {
   facts_mlinfobuf_init();
 }
 
+/* If the caller already has the lstat(2) data for the path, e.g. from
+ * scanning its directory, it is given as st.
+ */
 static int facts_mlinfo_get(struct mlinfo *info, const char *path,
-    const char *dent_name, int flags, const char *user, uid_t uid,
-    const char *group, gid_t gid, mode_t *mode) {
+    const char *dent_name, const struct stat *st, int flags, const char *user,
+    uid_t uid, const char *group, gid_t gid, mode_t *mode) {
   char *perm = "";
   int res;
 
-  pr_fs_clear_cache2(path);
-  res = pr_fsio_lstat(path, &(info->st));
-  if (res < 0) {
-    int xerrno = errno;
+  if (st != NULL) {
+    memcpy(&(info->st), st, sizeof(struct stat));
 
-    pr_log_debug(DEBUG4, MOD_FACTS_VERSION ": error lstat'ing '%s': %s",
-      path, strerror(xerrno));
+  } else {
+    pr_fs_clear_cache2(path);
+    res = pr_fsio_lstat(path, &(info->st));
+    if (res < 0) {
+      int xerrno = errno;
 
-    errno = xerrno;
-    return -1;
+      pr_log_debug(DEBUG4, MOD_FACTS_VERSION ": error lstat'ing '%s': %s",
+        path, strerror(xerrno));
+
+      errno = xerrno;
+      return -1;
+    }
   }
 
   if (user != NULL) {
@@ -1338,6 +1377,78 @@ MODRET facts_mfmt(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* Looks for a cached MLSD listing of the given directory.  Returns 1 if the
+ * cached listing was sent, -1 if sending it failed, and 0 if there is no
+ * cached listing; in the latter case, the rendered listing is captured, to
+ * be added to the cache once complete.
+ */
+static int facts_mlsd_cache_lookup(cmd_rec *cmd, const char *path,
+    struct stat *st, int flags, const char *fake_user, uid_t fake_uid,
+    const char *fake_group, gid_t fake_gid, mode_t *fake_mode) {
+  char buf[256], *data = NULL;
+  const char *key = NULL;
+  size_t bufsz, datalen = 0;
+
+  facts_mlsd_cache_reset();
+
+  if (pr_listcache_engine_enabled() == FALSE) {
+    return 0;
+  }
+
+  pr_snprintf(buf, sizeof(buf), "%lu:%lu:%d:%lu:%lu:%d:%o",
+    facts_opts, facts_mlinfo_opts, flags, (unsigned long) fake_uid,
+    (unsigned long) fake_gid, fake_mode != NULL ? TRUE : FALSE,
+    fake_mode != NULL ? (unsigned int) *fake_mode : 0);
+
+  if (pr_listcache_lookup(cmd->tmp_pool, cmd->argv[0], path, st,
+      pstrcat(cmd->tmp_pool, buf, "\n", fake_user ? fake_user : "", "\n",
+        fake_group ? fake_group : "", NULL), &key, &data, &datalen) == 0) {
+    pr_trace_msg("listcache", 11, "sending MLSD listing of '%s' (%lu bytes) "
+      "from cache", path, (unsigned long) datalen);
+
+    bufsz = pr_config_get_server_xfer_bufsz(PR_NETIO_IO_WR);
+
+    /* Make sure the ASCII flags are cleared from the session flags,
+     * so that the pr_data_xfer() function does not try to perform
+     * ASCII translation on this data.
+     */
+    session.sf_flags &= ~SF_ASCII_OVERRIDE;
+
+    while (datalen > 0) {
+      size_t len;
+
+      pr_signals_handle();
+
+      len = datalen > bufsz ? bufsz : datalen;
+      if (pr_data_xfer(data, len) < 0) {
+        pr_log_debug(DEBUG3, MOD_FACTS_VERSION
+          ": error transferring data: [%d] %s", errno, strerror(errno));
+        break;
+      }
+
+      if (XFER_ABORTED) {
+        break;
+      }
+
+      data += len;
+      datalen -= len;
+    }
+
+    session.sf_flags |= SF_ASCII_OVERRIDE;
+    return (datalen > 0 ? -1 : 1);
+  }
+
+  if (key == NULL) {
+    return 0;
+  }
+
+  mlsd_cache_pool = make_sub_pool(cmd->tmp_pool);
+  pr_pool_tag(mlsd_cache_pool, "Facts MLSD ListCache pool");
+  mlsd_cache_key = pstrdup(mlsd_cache_pool, key);
+
+  return 0;
+}
+
 MODRET facts_mlsd(cmd_rec *cmd) {
   const char *path, *decoded_path, *best_path;
   const char *fake_user = NULL, *fake_group = NULL;
@@ -1346,10 +1457,11 @@ MODRET facts_mlsd(cmd_rec *cmd) {
   gid_t fake_gid = -1;
   mode_t *fake_mode = NULL;
   struct mlinfo info;
+  struct stat st;
   unsigned char *ptr;
-  int flags = 0;
+  int flags = 0, res;
   DIR *dirh;
-  struct dirent *dent;
+  pr_fs_dirent_t *dent;
 
   if (cmd->argc != 1) {
     path = pstrdup(cmd->tmp_pool, cmd->arg);
@@ -1414,6 +1526,8 @@ MODRET facts_mlsd(cmd_rec *cmd) {
     return PR_ERROR(cmd);
   }
 
+  memcpy(&st, &(info.st), sizeof(struct stat));
+
   /* Determine whether to display symlinks as such. */
   ptr = get_param_ptr(TOPLEVEL_CONF, "ShowSymlinks", FALSE);
   if (ptr != NULL) {
@@ -1513,15 +1627,38 @@ MODRET facts_mlsd(cmd_rec *cmd) {
   }
   session.sf_flags |= SF_ASCII_OVERRIDE;
 
+  /* Send the cached listing of the directory, if there is one. */
+  res = facts_mlsd_cache_lookup(cmd, best_path, &st, flags, fake_user,
+    fake_uid, fake_group, fake_gid, fake_mode);
+  if (res != 0) {
+    pr_fsio_closedir(dirh);
+
+    if (res < 0 ||
+        XFER_ABORTED) {
+      pr_data_close(TRUE);
+
+    } else {
+      pr_data_close(FALSE);
+    }
+
+    return PR_HANDLED(cmd);
+  }
+
   facts_mlinfobuf_init();
 
-  while ((dent = pr_fsio_readdir(dirh)) != NULL) {
+  while ((dent = pr_fsio_readdir2(dirh, PR_FSIO_READDIR_FL_LSTAT)) != NULL) {
     int hidden = FALSE, res;
     char *rel_path, *abs_path;
 
     pr_signals_handle();
 
-    rel_path = pdircat(cmd->tmp_pool, best_path, dent->d_name, NULL);
+    if (dent->st_errno != 0) {
+      pr_log_debug(DEBUG4, MOD_FACTS_VERSION ": error lstat'ing '%s': %s",
+        dent->name, strerror(dent->st_errno));
+      continue;
+    }
+
+    rel_path = pdircat(cmd->tmp_pool, best_path, dent->name, NULL);
     res = dir_check(cmd->tmp_pool, cmd, cmd->group, rel_path, &hidden);
     if (!res || hidden) {
       continue;
@@ -1549,7 +1686,7 @@ MODRET facts_mlsd(cmd_rec *cmd) {
 
     info.pool = make_sub_pool(cmd->tmp_pool);
     pr_pool_tag(info.pool, "MLSD facts pool");
-    if (facts_mlinfo_get(&info, rel_path, dent->d_name, flags,
+    if (facts_mlinfo_get(&info, rel_path, dent->name, &(dent->st), flags,
         fake_user, fake_uid, fake_group, fake_gid, fake_mode) < 0) {
       pr_log_debug(DEBUG3, MOD_FACTS_VERSION
         ": MLSD: unable to get info for '%s': %s", abs_path, strerror(errno));
@@ -1559,7 +1696,7 @@ MODRET facts_mlsd(cmd_rec *cmd) {
     /* As per RFC3659, the directory being listed should not appear as a
      * component in the paths of the directory contents.
      */
-    info.path = pr_fs_encode_path(info.pool, dent->d_name);
+    info.path = pr_fs_encode_path(info.pool, dent->name);
 
     facts_mlinfobuf_add(&info, FACTS_MLINFO_FL_APPEND_CRLF);
 
@@ -1579,9 +1716,17 @@ MODRET facts_mlsd(cmd_rec *cmd) {
 
   } else {
     facts_mlinfobuf_flush();
+
+    if (mlsd_cache_key != NULL &&
+        !XFER_ABORTED) {
+      (void) pr_listcache_add(mlsd_cache_key, mlsd_cache_buf.data,
+        mlsd_cache_buf.datalen);
+    }
+
     pr_data_close(FALSE);
   }
 
+  facts_mlsd_cache_reset();
   return PR_HANDLED(cmd);
 }
 
@@ -1723,7 +1868,7 @@ MODRET facts_mlst(cmd_rec *cmd) {
   flags |= FACTS_MLINFO_FL_NO_CDIR;
 
   pr_fs_clear_cache2(decoded_path);
-  if (facts_mlinfo_get(&info, decoded_path, decoded_path, flags,
+  if (facts_mlinfo_get(&info, decoded_path, decoded_path, NULL, flags,
       fake_user, fake_uid, fake_group, fake_gid, fake_mode) < 0) {
     pr_response_add_err(R_550, _("'%s' cannot be listed"), path);
 
@@ -27,16 +27,21 @@
 /* Directory listing module for ProFTPD. */
 
 #include "conf.h"
+#include "privs.h"
+
+module ls_module;
+
+extern xaset_t *server_list;
 
 #ifndef GLOB_ABORTED
 #define GLOB_ABORTED GLOB_ABEND
 #endif
 
 #define MAP_UID(x) \
-  (fakeuser ? fakeuser : pr_auth_uid2name(cmd->tmp_pool, (x)))
+  (fakeuser ? fakeuser : pr_auth_uid2name(p, (x)))
 
 #define MAP_GID(x) \
-  (fakegroup ? fakegroup : pr_auth_gid2name(cmd->tmp_pool, (x)))
+  (fakegroup ? fakegroup : pr_auth_gid2name(p, (x)))
 
 static void addfile(cmd_rec *, const char *, const char *, time_t, off_t);
 static int outputfiles(cmd_rec *);
@@ -74,8 +79,40 @@ static unsigned char have_fake_mode = FALSE;
 static int ls_errno = 0;
 static time_t ls_curtime = 0;
 
+/* The directory being listed by listdir(), if any. */
+static void *list_dirh = NULL;
+
+/* ListStreaming: directories with more than list_stream_threshold entries
+ * are listed as their entries are read, rather than after reading (and
+ * sorting) all of them; a threshold of zero streams every directory, and
+ * -1 none.  Sorted streaming sorts runs of entries, spilled to the
+ * session's spill file, and then merges those runs.
+ */
+#define LS_DEFAULT_STREAM_RUN_LEN	10000
+#define LS_STREAM_MIN_RUN_LEN		1000
+#define LS_STREAM_POOL_ENTRIES		256
+#define LS_STREAM_SPILL_BUFSZ		(64 * 1024)
+#define LS_STREAM_READ_BUFSZ		4096
+
+#ifdef P_tmpdir
+# define LS_STREAM_SPILL_DIR		P_tmpdir
+#else
+# define LS_STREAM_SPILL_DIR		"/tmp"
+#endif /* P_tmpdir */
+
+static int list_stream_threshold = -1;
+static int list_stream_sorted = FALSE;
+static int list_spill_fd = -1;
+
+/* Set while listing a directory whose entries are sent as they are listed,
+ * rather than buffered by addfile().
+ */
+static unsigned char list_streaming = FALSE;
+
 static unsigned char use_globbing = TRUE;
 
+static const char *trace_channel = "listcache";
+
 /* Directory listing limits */
 struct list_limit_rec {
   unsigned int curr, max;
@@ -305,6 +342,183 @@ static int ls_perms(pool *p, cmd_rec *cmd, const char *path, int *hidden) {
   return res;
 }
 
+/* ListCache: the key of the listing being rendered, if it is to be cached,
+ * and the rendered output so far.
+ */
+#define LS_DEFAULT_LIST_CACHE_SIZE	(32 * 1024 * 1024)
+
+static const char *list_cache_key = NULL;
+static pool *list_cache_pool = NULL;
+static pr_listcache_buf_t list_cache_buf;
+
+static void ls_cache_reset(void) {
+  if (list_cache_pool != NULL) {
+    destroy_pool(list_cache_pool);
+    list_cache_pool = NULL;
+  }
+
+  list_cache_key = NULL;
+  memset(&list_cache_buf, 0, sizeof(list_cache_buf));
+}
+
+static void ls_cache_capture(const char *buf, size_t buflen) {
+  if (list_cache_key == NULL) {
+    return;
+  }
+
+  if (pr_listcache_append(list_cache_pool, &list_cache_buf, buf,
+      buflen) < 0) {
+    pr_trace_msg(trace_channel, 9, "listing larger than %lu bytes, not "
+      "caching", (unsigned long) pr_listcache_get_max_size());
+    ls_cache_reset();
+  }
+}
+
+/* Sends a cached listing over the data connection, in the same way that
+ * sendline() sends its buffer.
+ */
+static int ls_cache_send(const char *data, size_t datalen) {
+  int res = 0, using_ascii = FALSE;
+  size_t bufsz;
+
+  bufsz = pr_config_get_server_xfer_bufsz(PR_NETIO_IO_WR);
+
+  if (session.sf_flags & SF_ASCII) {
+    using_ascii = TRUE;
+  }
+
+  session.sf_flags &= ~SF_ASCII;
+  session.sf_flags &= ~SF_ASCII_OVERRIDE;
+
+  while (datalen > 0) {
+    size_t len;
+
+    pr_signals_handle();
+
+    len = datalen > bufsz ? bufsz : datalen;
+    res = pr_data_xfer((char *) data, len);
+    if (res < 0) {
+      int xerrno = errno;
+
+      if (session.d != NULL &&
+          session.d->outstrm) {
+        xerrno = PR_NETIO_ERRNO(session.d->outstrm);
+      }
+
+      pr_log_debug(DEBUG3, "pr_data_xfer returned %d, error = %s", res,
+        strerror(xerrno));
+      break;
+    }
+
+    if (XFER_ABORTED) {
+      res = -1;
+      break;
+    }
+
+    data += len;
+    datalen -= len;
+  }
+
+  if (using_ascii) {
+    session.sf_flags |= SF_ASCII;
+  }
+  session.sf_flags |= SF_ASCII_OVERRIDE;
+
+  return (res < 0 ? -1 : 0);
+}
+
+/* The options which determine how the entries of a listing are rendered. */
+static const char *ls_cache_opts(cmd_rec *cmd, const char *target) {
+  char buf[256];
+
+  pr_snprintf(buf, sizeof(buf),
+    "%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d%d:%d:%lu:%u:%u:%u:%d:%o:%d:%d",
+    opt_1, opt_a, opt_A, opt_B, opt_C, opt_c, opt_F, opt_h, opt_l, opt_L,
+    opt_n, opt_r, opt_S, opt_t, opt_U, opt_u, use_globbing, ls_sort_by,
+    list_flags, list_ndepth.max, list_ndirs.max, list_nfiles.max,
+    have_fake_mode, (unsigned int) fakemode, list_show_symlinks,
+    list_times_gmt);
+
+  return pstrcat(cmd->tmp_pool, buf, "\n", fakeuser ? fakeuser : "", "\n",
+    fakegroup ? fakegroup : "", "\n", target, NULL);
+}
+
+/* Looks for a cached listing of the given directory.  Returns 1 if the
+ * cached listing was sent, -1 if sending it failed, and 0 if there is no
+ * cached listing; in the latter case, the rendered listing is captured, to
+ * be added to the cache by ls_cache_done().
+ */
+static int ls_cache_lookup(cmd_rec *cmd, const char *target) {
+  struct stat st;
+  const char *best_path, *key = NULL;
+  char *data = NULL;
+  size_t datalen = 0;
+
+  ls_cache_reset();
+
+  if (pr_listcache_engine_enabled() == FALSE) {
+    return 0;
+  }
+
+  /* Only listings of a single directory's contents are cached. */
+  if (opt_STAT ||
+      opt_R ||
+      opt_d) {
+    return 0;
+  }
+
+  pr_fs_clear_cache2(target);
+  if (pr_fsio_stat(target, &st) < 0 ||
+      !S_ISDIR(st.st_mode)) {
+    return 0;
+  }
+
+  best_path = dir_best_path(cmd->tmp_pool, target);
+  if (best_path == NULL) {
+    return 0;
+  }
+
+  if (pr_listcache_lookup(cmd->tmp_pool, cmd->argv[0], best_path, &st,
+      ls_cache_opts(cmd, target), &key, &data, &datalen) == 0) {
+    pr_trace_msg(trace_channel, 11, "sending listing of '%s' (%lu bytes) "
+      "from cache", best_path, (unsigned long) datalen);
+
+    if (datalen > 0 &&
+        ls_cache_send(data, datalen) < 0) {
+      return -1;
+    }
+
+    return 1;
+  }
+
+  if (key == NULL) {
+    return 0;
+  }
+
+  list_cache_pool = make_sub_pool(cmd->tmp_pool);
+  pr_pool_tag(list_cache_pool, "mod_ls ListCache pool");
+  list_cache_key = pstrdup(list_cache_pool, key);
+
+  return 0;
+}
+
+/* Adds the captured listing, if any, to the cache, if the listing was
+ * completed successfully.
+ */
+static void ls_cache_done(int completed) {
+  if (list_cache_key != NULL &&
+      completed == TRUE &&
+      !XFER_ABORTED) {
+    if (pr_listcache_add(list_cache_key, list_cache_buf.data,
+        list_cache_buf.datalen) == 0) {
+      pr_trace_msg(trace_channel, 9, "cached listing (%lu bytes)",
+        (unsigned long) list_cache_buf.datalen);
+    }
+  }
+
+  ls_cache_reset();
+}
+
 /* sendline() now has an internal buffer, to help speed up LIST output.
  * This buffer is allocated once, the first time sendline() is called.
  * By using a runtime allocation, we can use pr_config_get_server_xfer_bufsz()
@@ -383,6 +597,7 @@ static int sendline(int flags, char *fmt, ...) {
   listbuflen = (listbuf_ptr - listbuf) + strlen(listbuf_ptr);
 
   buflen = strlen(buf);
+  ls_cache_capture(buf, buflen);
   if (buflen >= (listbufsz - listbuflen)) {
     /* Make sure the ASCII flags are cleared from the session flags,
      * so that the pr_data_xfer() function does not try to perform
@@ -457,7 +672,7 @@ static char months[12][4] =
 static int listfile(cmd_rec *cmd, pool *p, const char *resp_code,
     const char *name) {
   register unsigned int i;
-  int rval = 0, len;
+  int rval = 0, len, res;
   time_t sort_time;
   char m[PR_TUNABLE_PATH_MAX+1] = {'\0'}, l[PR_TUNABLE_PATH_MAX+1] = {'\0'}, s[16] = {'\0'};
   struct stat st;
@@ -505,8 +720,16 @@ static int listfile(cmd_rec *cmd, pool *p, const char *resp_code,
     p = cmd->tmp_pool;
   }
 
-  pr_fs_clear_cache2(name);
-  if (pr_fsio_lstat(name, &st) == 0) {
+  if (list_dirh != NULL &&
+      strchr(name, '/') == NULL) {
+    res = pr_fsio_statat(list_dirh, name, &st, PR_FSIO_STATAT_FL_NOFOLLOW);
+
+  } else {
+    pr_fs_clear_cache2(name);
+    res = pr_fsio_lstat(name, &st);
+  }
+
+  if (res == 0) {
     char *display_name = NULL;
 
     suffix[0] = suffix[1] = '\0';
@@ -776,7 +999,7 @@ static int listfile(cmd_rec *cmd, pool *p, const char *resp_code,
         if (opt_1) {
           /* One file per line, with no info other than the file name.  Easy. */
           pr_snprintf(nameline, sizeof(nameline)-1, "%s",
-            pr_fs_encode_path(cmd->tmp_pool, display_name));
+            pr_fs_encode_path(p, display_name));
 
         } else {
           if (!opt_n) {
@@ -785,7 +1008,7 @@ static int listfile(cmd_rec *cmd, pool *p, const char *resp_code,
               "%s %3d %-8s %-8s %s %s %2d %s %s", m, (int) st.st_nlink,
               MAP_UID(st.st_uid), MAP_GID(st.st_gid), s,
               months[t->tm_mon], t->tm_mday, timeline,
-              pr_fs_encode_path(cmd->tmp_pool, display_name));
+              pr_fs_encode_path(p, display_name));
 
           } else {
             /* Format nameline using user/group IDs. */
@@ -793,7 +1016,7 @@ static int listfile(cmd_rec *cmd, pool *p, const char *resp_code,
               "%s %3d %-8u %-8u %s %s %2d %s %s", m, (int) st.st_nlink,
               (unsigned) st.st_uid, (unsigned) st.st_gid, s,
               months[t->tm_mon], t->tm_mday, timeline,
-              pr_fs_encode_path(cmd->tmp_pool, name));
+              pr_fs_encode_path(p, name));
           }
         }
 
@@ -842,7 +1065,7 @@ static int listfile(cmd_rec *cmd, pool *p, const char *resp_code,
       if (S_ISREG(st.st_mode) ||
           S_ISDIR(st.st_mode) ||
           S_ISLNK(st.st_mode)) {
-        addfile(cmd, pr_fs_encode_path(cmd->tmp_pool, name), suffix, sort_time,
+        addfile(cmd, pr_fs_encode_path(p, name), suffix, sort_time,
           st.st_size);
       }
     }
@@ -883,12 +1106,13 @@ static void addfile(cmd_rec *cmd, const char *name, const char *suffix,
     return;
   }
 
-  /* If we are not sorting (-U is in effect), then we have no need to buffer
-   * up the line, and can send it immediately.  This can provide quite a bit
-   * of memory/CPU savings, especially for LIST commands on wide/deep
-   * directories (Bug#4060).
+  /* If we are not sorting (-U is in effect), or the entries are already in
+   * order (ListStreaming), then we have no need to buffer up the line, and can
+   * send it immediately.  This can provide quite a bit of memory/CPU savings,
+   * especially for LIST commands on wide/deep directories (Bug#4060).
    */
-  if (opt_U == 1) {
+  if (opt_U == 1 ||
+      list_streaming == TRUE) {
     (void) sendline(0, "%s%s\r\n", name, suffix);
     return;
   }
@@ -1164,9 +1388,22 @@ static int dircmp(const void *a, const void *b) {
 #endif /* !PR_USE_NLS or !HAVE_STRCOLL */
 }
 
-static char **sreaddir(const char *dirname, const int sort) {
+/* Returns the file type (S_IFMT bits) of an entry returned by sreaddir(),
+ * or zero if not known.
+ */
+static mode_t ls_dirent_type(const char *name) {
+  return ((mode_t) (unsigned char) name[strlen(name) + 1]) << 12;
+}
+
+/* Returns the names of the entries of the given directory, sorted if
+ * requested.  Each
+ * name is followed, after its terminating NUL, by a byte holding the file
+ * type of the entry (see ls_dirent_type()).  If dirh is not NULL, the
+ * directory is left open, for looking up those entries via pr_fsio_statat().
+ */
+static char **sreaddir(const char *dirname, const int sort, void **dirh) {
   DIR *d;
-  struct dirent *de;
+  pr_fs_dirent_t *de;
   struct stat st;
   int i, dir_fd;
   char **p;
@@ -1244,7 +1481,9 @@ static char **sreaddir(const char *dirname, const int sort) {
 
   i = 0;
 
-  while ((de = pr_fsio_readdir(d)) != NULL) {
+  while ((de = pr_fsio_readdir2(d, 0)) != NULL) {
+    size_t namelen;
+
     pr_signals_handle();
 
     if ((size_t) i >= dsize - 1) {
@@ -1270,16 +1509,23 @@ static char **sreaddir(const char *dirname, const int sort) {
       dsize *= 2;
     }
 
-    /* Append the filename to the block. */
-    p[i] = (char *) calloc(strlen(de->d_name) + 1, sizeof(char));
+    /* Append the filename, and its type, to the block. */
+    namelen = strlen(de->name);
+    p[i] = (char *) calloc(namelen + 2, sizeof(char));
     if (p[i] == NULL) {
       pr_log_pri(PR_LOG_ALERT, "Out of memory!");
       exit(1);
     }
-    sstrncpy(p[i++], de->d_name, strlen(de->d_name) + 1);
+    sstrncpy(p[i], de->name, namelen + 1);
+    p[i++][namelen + 1] = (char) (de->type >> 12);
   }
 
-  pr_fsio_closedir(d);
+  if (dirh != NULL) {
+    *dirh = d;
+
+  } else {
+    pr_fsio_closedir(d);
+  }
 
   /* This is correct, since the above is off by one element.
    */
@@ -1292,10 +1538,495 @@ static char **sreaddir(const char *dirname, const int sort) {
   return p;
 }
 
+/* ListStreaming
+ */
+
+struct ls_spill_run {
+  off_t offset, end;
+  char *buf;
+  size_t buflen, bufpos;
+
+  /* The current entry name of the run, or NULL once the run is done. */
+  char *name;
+};
+
+static pool *list_stream_pool = NULL;
+static unsigned int list_stream_nentries = 0;
+
+static int ls_stream_entry(cmd_rec *cmd, pool *workp, const char *resp_code,
+    const char *name) {
+
+  /* Skip dotfiles, unless requested not to via -a or -A. */
+  if (*name == '.' &&
+      (!opt_a && (!opt_A || is_dotdir(name)))) {
+    return 0;
+  }
+
+  /* The memory used for listing an entry is not needed once that entry has
+   * been sent, so release it every so often, lest it grow with the directory.
+   */
+  if (list_stream_pool == NULL ||
+      list_stream_nentries == LS_STREAM_POOL_ENTRIES) {
+    if (list_stream_pool != NULL) {
+      destroy_pool(list_stream_pool);
+    }
+
+    list_stream_pool = make_sub_pool(workp);
+    pr_pool_tag(list_stream_pool, "mod_ls ListStreaming entry pool");
+    list_stream_nentries = 0;
+  }
+
+  list_stream_nentries++;
+  return listfile(cmd, list_stream_pool, resp_code, name);
+}
+
+/* Lists the given names, in order.  Returns 1 if the ListOptions maxfiles
+ * limit was reached, 0 otherwise.
+ */
+static int ls_stream_entries(cmd_rec *cmd, pool *workp, const char *resp_code,
+    array_header *names) {
+  register unsigned int i;
+  char **elts;
+
+  elts = names->elts;
+  for (i = 0; i < names->nelts; i++) {
+    pr_signals_handle();
+
+    if (ls_stream_entry(cmd, workp, resp_code, elts[i]) == 2) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+static int ls_spill_write(const char *buf, size_t buflen, off_t *offset) {
+  while (buflen > 0) {
+    ssize_t res;
+
+    res = pwrite(list_spill_fd, buf, buflen, *offset);
+    if (res < 0) {
+      if (errno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+      return -1;
+    }
+
+    buf += res;
+    buflen -= res;
+    *offset += res;
+  }
+
+  return 0;
+}
+
+/* Sorts the given names, and appends them to the spill file as a run of
+ * NUL-terminated names, using the given buffer of LS_STREAM_SPILL_BUFSZ bytes.
+ */
+static int ls_spill_names(char *buf, array_header *names, array_header *runs,
+    off_t *offset) {
+  register unsigned int i;
+  struct ls_spill_run *run;
+  char **elts;
+  size_t buflen = 0;
+
+  elts = names->elts;
+  PR_DEVEL_CLOCK(qsort(elts, names->nelts, sizeof(char *), dircmp));
+
+  run = push_array(runs);
+  memset(run, 0, sizeof(struct ls_spill_run));
+  run->offset = *offset;
+
+  for (i = 0; i < names->nelts; i++) {
+    size_t namelen;
+
+    namelen = strlen(elts[i]) + 1;
+    if (buflen + namelen > LS_STREAM_SPILL_BUFSZ) {
+      if (ls_spill_write(buf, buflen, offset) < 0) {
+        return -1;
+      }
+
+      buflen = 0;
+    }
+
+    memcpy(buf + buflen, elts[i], namelen);
+    buflen += namelen;
+  }
+
+  if (ls_spill_write(buf, buflen, offset) < 0) {
+    return -1;
+  }
+
+  run->end = *offset;
+  return 0;
+}
+
+/* Advances the run to its next name, reading more of the run from the spill
+ * file as needed.
+ */
+static int ls_spill_next(struct ls_spill_run *run) {
+  char *ptr, *nul = NULL;
+  size_t avail;
+
+  avail = run->buflen - run->bufpos;
+  ptr = run->buf + run->bufpos;
+
+  if (avail > 0) {
+    nul = memchr(ptr, '\0', avail);
+  }
+
+  if (nul == NULL) {
+    memmove(run->buf, ptr, avail);
+    run->buflen = avail;
+    run->bufpos = 0;
+
+    while (run->offset < run->end &&
+           run->buflen < LS_STREAM_READ_BUFSZ) {
+      ssize_t res;
+      size_t len;
+
+      len = LS_STREAM_READ_BUFSZ - run->buflen;
+      if ((off_t) len > run->end - run->offset) {
+        len = run->end - run->offset;
+      }
+
+      res = pread(list_spill_fd, run->buf + run->buflen, len, run->offset);
+      if (res < 0) {
+        if (errno == EINTR) {
+          pr_signals_handle();
+          continue;
+        }
+
+        return -1;
+      }
+
+      if (res == 0) {
+        errno = EIO;
+        return -1;
+      }
+
+      run->buflen += res;
+      run->offset += res;
+    }
+
+    if (run->buflen == 0) {
+      run->name = NULL;
+      return 0;
+    }
+
+    ptr = run->buf;
+    nul = memchr(ptr, '\0', run->buflen);
+    if (nul == NULL) {
+      errno = EIO;
+      return -1;
+    }
+  }
+
+  run->name = ptr;
+  run->bufpos = (nul - run->buf) + 1;
+  return 0;
+}
+
+static void ls_spill_heapify(struct ls_spill_run **heap, unsigned int nruns,
+    unsigned int i) {
+
+  while (TRUE) {
+    struct ls_spill_run *run;
+    unsigned int left, right, min = i;
+
+    left = (2 * i) + 1;
+    right = left + 1;
+
+    if (left < nruns &&
+        dircmp(&(heap[left]->name), &(heap[min]->name)) < 0) {
+      min = left;
+    }
+
+    if (right < nruns &&
+        dircmp(&(heap[right]->name), &(heap[min]->name)) < 0) {
+      min = right;
+    }
+
+    if (min == i) {
+      break;
+    }
+
+    run = heap[i];
+    heap[i] = heap[min];
+    heap[min] = run;
+    i = min;
+  }
+}
+
+/* Lists the names of all of the spilled runs, merged into order. */
+static int ls_spill_merge(cmd_rec *cmd, pool *workp, const char *resp_code,
+    array_header *runs) {
+  register unsigned int i;
+  struct ls_spill_run *elts, **heap;
+  unsigned int nruns = 0;
+
+  elts = runs->elts;
+  heap = pcalloc(workp, runs->nelts * sizeof(struct ls_spill_run *));
+
+  for (i = 0; i < runs->nelts; i++) {
+    elts[i].buf = palloc(workp, LS_STREAM_READ_BUFSZ);
+
+    if (ls_spill_next(&(elts[i])) < 0) {
+      return -1;
+    }
+
+    if (elts[i].name != NULL) {
+      heap[nruns++] = &(elts[i]);
+    }
+  }
+
+  for (i = nruns / 2; i > 0; i--) {
+    ls_spill_heapify(heap, nruns, i - 1);
+  }
+
+  while (nruns > 0) {
+    pr_signals_handle();
+
+    if (XFER_ABORTED) {
+      break;
+    }
+
+    if (ls_stream_entry(cmd, workp, resp_code, heap[0]->name) == 2) {
+      break;
+    }
+
+    if (ls_spill_next(heap[0]) < 0) {
+      return -1;
+    }
+
+    if (heap[0]->name == NULL) {
+      heap[0] = heap[--nruns];
+    }
+
+    ls_spill_heapify(heap, nruns, 0);
+  }
+
+  return 0;
+}
+
+/* Returns TRUE if the current directory is to be listed by ls_stream_dir(),
+ * FALSE otherwise.  Only one-entry-per-line listings of a single directory
+ * in name order, or unsorted, can be streamed.
+ */
+static int ls_stream_enabled(cmd_rec *cmd) {
+  config_rec *c;
+
+  if (opt_R ||
+      opt_C ||
+      opt_S ||
+      opt_t ||
+      opt_STAT) {
+    return FALSE;
+  }
+
+  /* Use the ListStreaming configured for the directory being listed, which
+   * need not be the current working directory.
+   */
+  c = find_config(get_dir_ctxt(cmd->tmp_pool, (char *) pr_fs_getcwd()),
+    CONF_PARAM, "ListStreaming", FALSE);
+  if (c == NULL) {
+    return FALSE;
+  }
+
+  list_stream_threshold = *((int *) c->argv[0]);
+  list_stream_sorted = *((int *) c->argv[1]);
+
+  if (list_stream_threshold < 0) {
+    return FALSE;
+  }
+
+  if (list_stream_sorted == TRUE &&
+      opt_U == 0 &&
+      list_spill_fd < 0) {
+    pr_log_debug(DEBUG8, "ListStreaming: no spill file available for sorted "
+      "streaming, listing directory in memory");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Lists the current directory, as listdir() does, without holding all of the
+ * directory's entries in memory.  Once more than the ListStreaming threshold
+ * of entries has been read, the entries are listed as they are read or, for
+ * sorted streaming, sorted in runs which are spilled to the spill file, and
+ * merged once the directory has been read.
+ */
+static int ls_stream_dir(cmd_rec *cmd, pool *workp, const char *resp_code) {
+  struct stat st;
+  void *dirh;
+  pr_fs_dirent_t *de;
+  pool *run_pool;
+  array_header *names, *runs;
+  char *spill_buf = NULL;
+  unsigned int limit;
+  off_t spill_offset = 0;
+  int done = FALSE, res = 0, sorted = FALSE, streaming = FALSE, xerrno = 0;
+
+  pr_fs_clear_cache2(".");
+  if (pr_fsio_stat(".", &st) < 0 ||
+      !S_ISDIR(st.st_mode)) {
+    return 0;
+  }
+
+  dirh = pr_fsio_opendir(".");
+  if (dirh == NULL) {
+    pr_trace_msg("fsio", 9, "opendir() error on '.': %s", strerror(errno));
+    return 0;
+  }
+
+  limit = list_stream_threshold;
+  if (list_stream_sorted == TRUE &&
+      opt_U == 0) {
+    sorted = TRUE;
+
+    /* The threshold is also the length of the runs to be sorted; each run
+     * needs its own read buffer when merging, so the runs must not be too
+     * short.
+     */
+    if (limit == 0) {
+      limit = LS_DEFAULT_STREAM_RUN_LEN;
+
+    } else if (limit < LS_STREAM_MIN_RUN_LEN) {
+      limit = LS_STREAM_MIN_RUN_LEN;
+    }
+
+    spill_buf = palloc(workp, LS_STREAM_SPILL_BUFSZ);
+
+    if (ftruncate(list_spill_fd, 0) < 0) {
+      pr_log_debug(DEBUG5, "ListStreaming: error truncating spill file: %s",
+        strerror(errno));
+    }
+  }
+
+  run_pool = make_sub_pool(workp);
+  pr_pool_tag(run_pool, "mod_ls ListStreaming run pool");
+  names = make_array(run_pool, 64, sizeof(char *));
+  runs = make_array(workp, 4, sizeof(struct ls_spill_run));
+
+  /* Let listfile() look up the entries relative to the open directory. */
+  list_dirh = dirh;
+  list_streaming = TRUE;
+
+  while ((de = pr_fsio_readdir2(dirh, 0)) != NULL) {
+    pr_signals_handle();
+
+    if (XFER_ABORTED) {
+      done = TRUE;
+      break;
+    }
+
+    if (streaming == FALSE &&
+        names->nelts == limit) {
+      if (sorted) {
+        if (ls_spill_names(spill_buf, names, runs, &spill_offset) < 0) {
+          xerrno = errno;
+          res = -1;
+          break;
+        }
+
+      } else {
+        pr_log_debug(DEBUG8, "ListStreaming: directory has more than %u "
+          "entries, streaming listing", limit);
+        streaming = TRUE;
+
+        if (ls_stream_entries(cmd, workp, resp_code, names) == 1) {
+          done = TRUE;
+          break;
+        }
+      }
+
+      destroy_pool(run_pool);
+      run_pool = make_sub_pool(workp);
+      pr_pool_tag(run_pool, "mod_ls ListStreaming run pool");
+      names = make_array(run_pool, 64, sizeof(char *));
+    }
+
+    if (streaming) {
+      if (ls_stream_entry(cmd, workp, resp_code, de->name) == 2) {
+        done = TRUE;
+        break;
+      }
+
+      continue;
+    }
+
+    *((char **) push_array(names)) = pstrdup(run_pool, de->name);
+  }
+
+  if (res == 0 &&
+      done == FALSE) {
+    if (runs->nelts == 0) {
+      /* The directory was read without needing to spill any runs; list the
+       * rest of it from memory, as listdir() would.
+       */
+      if (opt_U == 0) {
+        PR_DEVEL_CLOCK(qsort(names->elts, names->nelts, sizeof(char *),
+          dircmp));
+      }
+
+      (void) ls_stream_entries(cmd, workp, resp_code, names);
+
+    } else {
+      if (names->nelts > 0 &&
+          ls_spill_names(spill_buf, names, runs, &spill_offset) < 0) {
+        xerrno = errno;
+        res = -1;
+      }
+
+      destroy_pool(run_pool);
+      run_pool = NULL;
+
+      if (res == 0) {
+        pr_log_debug(DEBUG8, "ListStreaming: merging %d sorted runs of "
+          "directory entries (%" PR_LU " bytes)", runs->nelts,
+          (pr_off_t) spill_offset);
+
+        res = ls_spill_merge(cmd, workp, resp_code, runs);
+        xerrno = errno;
+      }
+    }
+  }
+
+  if (run_pool != NULL) {
+    destroy_pool(run_pool);
+  }
+
+  if (list_stream_pool != NULL) {
+    destroy_pool(list_stream_pool);
+    list_stream_pool = NULL;
+  }
+
+  list_dirh = NULL;
+  list_streaming = FALSE;
+  pr_fsio_closedir(dirh);
+
+  if (sorted) {
+    (void) ftruncate(list_spill_fd, 0);
+  }
+
+  if (res < 0) {
+    pr_log_pri(PR_LOG_WARNING, "ListStreaming: error using spill file: %s",
+      strerror(xerrno));
+    ls_errno = xerrno;
+    return -1;
+  }
+
+  return outputfiles(cmd);
+}
+
 /* This listdir() requires a chdir() first. */
 static int listdir(cmd_rec *cmd, pool *workp, const char *resp_code,
     const char *name) {
   char **dir;
+  void *dirh = NULL;
   int dest_workp = 0;
   register unsigned int i = 0;
 
@@ -1339,13 +2070,28 @@ static int listdir(cmd_rec *cmd, pool *workp, const char *resp_code,
     dest_workp++;
   }
 
-  PR_DEVEL_CLOCK(dir = sreaddir(".", opt_U ? FALSE : TRUE));
+  if (ls_stream_enabled(cmd) == TRUE) {
+    int res;
+
+    res = ls_stream_dir(cmd, workp, resp_code);
+
+    if (dest_workp) {
+      destroy_pool(workp);
+    }
+
+    return (res < 0 ? -1 : 0);
+  }
+
+  PR_DEVEL_CLOCK(dir = sreaddir(".", opt_U ? FALSE : TRUE, &dirh));
   if (dir) {
     char **s;
     char **r;
 
     int d = 0;
 
+    /* Let listfile() look up the entries relative to the open directory. */
+    list_dirh = dirh;
+
     s = dir;
     while (*s) {
       if (**s == '.') {
@@ -1377,6 +2123,9 @@ static int listdir(cmd_rec *cmd, pool *workp, const char *resp_code,
       s++;
     }
 
+    list_dirh = NULL;
+    pr_fsio_closedir(dirh);
+
     if (outputfiles(cmd) < 0) {
       if (dest_workp) {
         destroy_pool(workp);
@@ -2026,6 +2775,14 @@ static int dolist(cmd_rec *cmd, const char *opt, const char *resp_code,
         }
 
       } else {
+        int res;
+
+        /* Send the cached listing of the target, if there is one. */
+        res = ls_cache_lookup(cmd, target);
+        if (res != 0) {
+          return (res < 0 ? -1 : 0);
+        }
+
         /* Trick the following code into using the non-glob() processed path */
         a = 0;
         g.gl_pathv = (char **) pcalloc(cmd->tmp_pool, 2 * sizeof(char *));
@@ -2223,6 +2980,13 @@ static int dolist(cmd_rec *cmd, const char *opt, const char *resp_code,
         }
 
       } else {
+        int res;
+
+        res = ls_cache_lookup(cmd, ".");
+        if (res != 0) {
+          return (res < 0 ? -1 : 0);
+        }
+
         list_ndepth.curr++;
         if (listdir(cmd, NULL, resp_code, ".") < 0) {
           ls_terminate();
@@ -2399,7 +3163,7 @@ static int nlstdir(cmd_rec *cmd, const char *dir) {
     use_sorting = TRUE;
   }
 
-  PR_DEVEL_CLOCK(list = sreaddir(".", use_sorting));
+  PR_DEVEL_CLOCK(list = sreaddir(".", use_sorting, NULL));
   if (list == NULL) {
     pr_trace_msg("fsio", 9,
       "sreaddir() error on '.': %s", strerror(errno));
@@ -2441,7 +3205,18 @@ static int nlstdir(cmd_rec *cmd, const char *dir) {
       }
     }
 
-    if (list_flags & LS_FL_NO_ADJUSTED_SYMLINKS) {
+    /* If the directory told us the entry type, and it is not a symlink,
+     * there is no need to look it up.
+     */
+    mode = ls_dirent_type(p);
+    if (S_ISLNK(mode)) {
+      mode = 0;
+    }
+
+    if (mode != 0) {
+      i = -1;
+
+    } else if (list_flags & LS_FL_NO_ADJUSTED_SYMLINKS) {
       i = pr_fsio_readlink(p, file, sizeof(file) - 1);
 
     } else {
@@ -2466,9 +3241,11 @@ static int nlstdir(cmd_rec *cmd, const char *dir) {
         continue;
       }
 
-      mode = file_mode2(cmd->tmp_pool, f);
       if (mode == 0) {
-        continue;
+        mode = file_mode2(cmd->tmp_pool, f);
+        if (mode == 0) {
+          continue;
+        }
       }
 
       if (!curdir) {
@@ -2649,6 +3426,7 @@ MODRET genericlist(cmd_rec *cmd) {
   }
 
   res = dolist(cmd, decoded_path, R_211, TRUE);
+  ls_cache_done(res == 0 ? TRUE : FALSE);
 
   if (XFER_ABORTED) {
     pr_data_abort(0, 0);
@@ -3374,7 +4152,14 @@ MODRET ls_nlst(cmd_rec *cmd) {
       }
       session.sf_flags |= SF_ASCII_OVERRIDE;
 
-      res = nlstdir(cmd, target);
+      res = ls_cache_lookup(cmd, target);
+      if (res == 0) {
+        res = nlstdir(cmd, target);
+        ls_cache_done(res >= 0 ? TRUE : FALSE);
+
+      } else if (res > 0) {
+        res = 0;
+      }
 
     } else {
       pr_response_add_err(R_450, _("%s: Not a regular file"), cmd->arg);
@@ -3619,10 +4404,180 @@ MODRET set_useglobbing(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: ListCacheEngine on|off */
+MODRET set_listcacheengine(cmd_rec *cmd) {
+  int engine = -1;
+  config_rec *c = NULL;
+
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL|CONF_ANON);
+
+  engine = get_boolean(cmd, 1);
+  if (engine == -1) {
+    CONF_ERROR(cmd, "expected Boolean parameter");
+  }
+
+  c = add_config_param(cmd->argv[0], 1, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[0]) = engine;
+  c->flags |= CF_MERGEDOWN;
+
+  return PR_HANDLED(cmd);
+}
+
+/* usage: ListCacheMaxAge secs|duration */
+MODRET set_listcachemaxage(cmd_rec *cmd) {
+  int secs;
+  config_rec *c = NULL;
+
+  CHECK_ARGS(cmd, 1);
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL|CONF_ANON);
+
+  if (pr_str_get_duration(cmd->argv[1], &secs) < 0 ||
+      secs <= 0) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "invalid max age: ",
+      cmd->argv[1], NULL));
+  }
+
+  c = add_config_param(cmd->argv[0], 1, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(time_t));
+  *((time_t *) c->argv[0]) = secs;
+  c->flags |= CF_MERGEDOWN;
+
+  return PR_HANDLED(cmd);
+}
+
+/* usage: ListCacheSize size [units] */
+MODRET set_listcachesize(cmd_rec *cmd) {
+  off_t size = 0;
+  config_rec *c = NULL;
+
+  if (cmd->argc < 2 ||
+      cmd->argc > 3) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  if (pr_str_get_nbytes(cmd->argv[1], cmd->argc == 3 ? cmd->argv[2] : NULL,
+      &size) < 0) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "unable to parse: ",
+      cmd->argv[1], ": ", strerror(errno), NULL));
+  }
+
+  if (size < 65536) {
+    CONF_ERROR(cmd, "size must be at least 64 KB");
+  }
+
+  c = add_config_param(cmd->argv[0], 1, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(off_t));
+  *((off_t *) c->argv[0]) = size;
+
+  return PR_HANDLED(cmd);
+}
+
+/* usage: ListStreaming on|off|count ["Sorted"] */
+MODRET set_liststreaming(cmd_rec *cmd) {
+  int threshold = -1, sorted = FALSE, bool;
+  config_rec *c = NULL;
+
+  if (cmd->argc < 2 ||
+      cmd->argc > 3) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL|CONF_ANON|CONF_DIR);
+
+  if (cmd->argc == 3) {
+    if (strcasecmp(cmd->argv[2], "Sorted") != 0) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "unknown parameter: ",
+        cmd->argv[2], NULL));
+    }
+
+    sorted = TRUE;
+  }
+
+  bool = get_boolean(cmd, 1);
+  if (bool == -1) {
+    threshold = atoi(cmd->argv[1]);
+    if (threshold < 1) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool,
+        "count must be greater than 0: '", cmd->argv[1], "'", NULL));
+    }
+
+  } else if (bool == TRUE) {
+    threshold = 0;
+
+  } else if (sorted == TRUE) {
+    CONF_ERROR(cmd, "Sorted requires ListStreaming to be enabled");
+  }
+
+  c = add_config_param(cmd->argv[0], 2, NULL, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[0]) = threshold;
+  c->argv[1] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[1]) = sorted;
+  c->flags |= CF_MERGEDOWN;
+
+  return PR_HANDLED(cmd);
+}
+
+/* Event handlers
+ */
+
+static void ls_postparse_ev(const void *event_data, void *user_data) {
+  server_rec *s;
+  config_rec *c;
+  off_t size = LS_DEFAULT_LIST_CACHE_SIZE;
+  int engine = FALSE;
+
+  /* Only allocate the cache if some server uses it. */
+  for (s = (server_rec *) server_list->xas_list; s; s = s->next) {
+    c = find_config(s->conf, CONF_PARAM, "ListCacheEngine", TRUE);
+    while (c != NULL) {
+      pr_signals_handle();
+
+      if (*((int *) c->argv[0]) == TRUE) {
+        engine = TRUE;
+        break;
+      }
+
+      c = find_config_next(c, c->next, CONF_PARAM, "ListCacheEngine", TRUE);
+    }
+
+    if (engine == TRUE) {
+      break;
+    }
+  }
+
+  if (engine == FALSE) {
+    return;
+  }
+
+  c = find_config(main_server->conf, CONF_PARAM, "ListCacheSize", FALSE);
+  if (c != NULL) {
+    size = *((off_t *) c->argv[0]);
+  }
+
+  if (pr_listcache_init((size_t) size) < 0) {
+    pr_log_pri(PR_LOG_NOTICE, "unable to allocate ListCacheSize %" PR_LU
+      " bytes: %s", (pr_off_t) size, strerror(errno));
+  }
+}
+
+static void ls_restart_ev(const void *event_data, void *user_data) {
+  /* The cached listings refer to configuration records which are about to
+   * be freed; the postparse event listener allocates a new cache, if need be.
+   */
+  (void) pr_listcache_free();
+}
+
 /* Initialization routines
  */
 
 static int ls_init(void) {
+  pr_event_register(&ls_module, "core.postparse", ls_postparse_ev, NULL);
+  pr_event_register(&ls_module, "core.restart", ls_restart_ev, NULL);
 
   /* Add the commands handled by this module to the HELP list. */
   pr_help_add(C_LIST, _("[<sp> pathname]"), TRUE);
@@ -3632,6 +4587,51 @@ static int ls_init(void) {
   return 0;
 }
 
+static int ls_sess_init(void) {
+  config_rec *c;
+
+  /* Sorted ListStreaming spills runs of entry names to a file, which is
+   * created now, while the session can still reach the temporary directory,
+   * i.e. before any chroot, and removed right away.
+   */
+  c = find_config(main_server->conf, CONF_PARAM, "ListStreaming", TRUE);
+  while (c != NULL) {
+    char path[PR_TUNABLE_PATH_MAX+1];
+    int fd, xerrno;
+
+    pr_signals_handle();
+
+    if (*((int *) c->argv[1]) == FALSE) {
+      c = find_config_next(c, c->next, CONF_PARAM, "ListStreaming", TRUE);
+      continue;
+    }
+
+    pr_snprintf(path, sizeof(path), "%s/proftpd-ls-XXXXXX",
+      LS_STREAM_SPILL_DIR);
+
+    PRIVS_ROOT
+    fd = mkstemp(path);
+    xerrno = errno;
+
+    if (fd >= 0) {
+      (void) unlink(path);
+    }
+    PRIVS_RELINQUISH
+
+    if (fd < 0) {
+      pr_log_pri(PR_LOG_NOTICE, "ListStreaming: unable to create spill file "
+        "in %s: %s", LS_STREAM_SPILL_DIR, strerror(xerrno));
+      break;
+    }
+
+    (void) fcntl(fd, F_SETFD, FD_CLOEXEC);
+    list_spill_fd = fd;
+    break;
+  }
+
+  return 0;
+}
+
 /* Module API tables
  */
 
@@ -3639,7 +4639,11 @@ static conftable ls_conftab[] = {
   { "DirFakeUser",	set_dirfakeusergroup,			NULL },
   { "DirFakeGroup",	set_dirfakeusergroup,			NULL },
   { "DirFakeMode",	set_dirfakemode,			NULL },
+  { "ListCacheEngine",	set_listcacheengine,			NULL },
+  { "ListCacheMaxAge",	set_listcachemaxage,			NULL },
+  { "ListCacheSize",	set_listcachesize,			NULL },
   { "ListOptions",	set_listoptions,			NULL },
+  { "ListStreaming",	set_liststreaming,			NULL },
   { "ShowSymlinks",	set_showsymlinks,			NULL },
   { "UseGlobbing",	set_useglobbing,			NULL },
   { NULL,		NULL,					NULL }
@@ -3679,5 +4683,5 @@ module ls_module = {
   ls_init,
 
   /* Session initialization */
-  NULL
+  ls_sess_init
 };
@@ -66,6 +66,34 @@ static int xfer_check_limit(cmd_rec *);
 #define PR_XFER_OPT_IGNORE_ASCII	0x0002
 static unsigned long xfer_opts = PR_XFER_OPT_HANDLE_ALLO;
 
+/* StoreWriteback */
+#define PR_XFER_DEFAULT_WRITEBACK_LEN	(8 * 1024 * 1024)
+static off_t stor_writeback_len = 0;
+static int stor_writeback_datasync = FALSE;
+
+/* The start of the section of the upload not yet handed to the kernel for
+ * writing, and the start of the section handed over but not yet waited for.
+ */
+static off_t stor_writeback_offset = 0;
+static off_t stor_writeback_prev_offset = 0;
+
+/* StorePreallocate */
+#define PR_XFER_DEFAULT_PREALLOC_MIN	(1024 * 1024)
+#define PR_XFER_DEFAULT_PREALLOC_MAX	(1024 * 1024 * 1024)
+
+/* The size announced by the client using ALLO, for the next upload. */
+static off_t xfer_allo_size = 0;
+
+/* The end of the space preallocated for the current upload. */
+static off_t stor_prealloc_end = 0;
+
+/* A completed upload whose data are synced to disk after the client has
+ * been told that the transfer is complete.
+ */
+static int stor_datasync_fd = -1;
+static int stor_datasync_timerno = -1;
+static char stor_datasync_path[PR_TUNABLE_PATH_MAX+1];
+
 static void xfer_exit_ev(const void *, void *);
 static void xfer_sigusr2_ev(const void *, void *);
 static void xfer_timeout_session_ev(const void *, void *);
@@ -303,24 +331,29 @@ static int xfer_check_limit(cmd_rec *cmd) {
      * many of those other logins are currently using this command.
      */
 
-    (void) pr_rewind_scoreboard();
-    while ((score = pr_scoreboard_entry_read()) != NULL) {
-      pr_signals_handle();
+    if (pr_scoreboard_get_count(PR_SCORE_COUNT_HOST_CMD, server_addr,
+        client_addr, xfer_cmd, &curr) < 0) {
+      curr = 0;
 
-      /* Scoreboard entry must match local server address and remote client
-       * address to be counted.
-       */
-      if (strcmp(score->sce_server_addr, server_addr) != 0)
-        continue;
+      (void) pr_rewind_scoreboard();
+      while ((score = pr_scoreboard_entry_read()) != NULL) {
+        pr_signals_handle();
 
-      if (strcmp(score->sce_client_addr, client_addr) != 0)
-        continue;
+        /* Scoreboard entry must match local server address and remote client
+         * address to be counted.
+         */
+        if (strcmp(score->sce_server_addr, server_addr) != 0)
+          continue;
 
-      if (strcmp(score->sce_cmd, xfer_cmd) == 0)
-        curr++;
-    }
+        if (strcmp(score->sce_client_addr, client_addr) != 0)
+          continue;
 
-    pr_restore_scoreboard();
+        if (strcmp(score->sce_cmd, xfer_cmd) == 0)
+          curr++;
+      }
+
+      pr_restore_scoreboard();
+    }
 
     if (curr >= max) {
       char maxn[20];
@@ -378,21 +411,26 @@ static int xfer_check_limit(cmd_rec *cmd) {
      * those other logins are currently using this command.
      */
 
-    (void) pr_rewind_scoreboard();
-    while ((score = pr_scoreboard_entry_read()) != NULL) {
-      pr_signals_handle();
+    if (pr_scoreboard_get_count(PR_SCORE_COUNT_USER_CMD, server_addr,
+        session.user, xfer_cmd, &curr) < 0) {
+      curr = 0;
 
-      if (strcmp(score->sce_server_addr, server_addr) != 0)
-        continue;
+      (void) pr_rewind_scoreboard();
+      while ((score = pr_scoreboard_entry_read()) != NULL) {
+        pr_signals_handle();
 
-      if (strcmp(score->sce_user, session.user) != 0)
-        continue;
+        if (strcmp(score->sce_server_addr, server_addr) != 0)
+          continue;
 
-      if (strcmp(score->sce_cmd, xfer_cmd) == 0)
-        curr++;
-    }
+        if (strcmp(score->sce_user, session.user) != 0)
+          continue;
+
+        if (strcmp(score->sce_cmd, xfer_cmd) == 0)
+          curr++;
+      }
 
-    pr_restore_scoreboard();
+      pr_restore_scoreboard();
+    }
 
     if (curr >= max) {
       char maxn[20];
@@ -539,21 +577,27 @@ static int transmit_sendfile(off_t data_len, off_t *data_offset,
    * - We're using MODE Z compression
    * - There's no data left to transmit.
    * - UseSendfile is set to off.
+   * - The file's reads are handled by a custom FS (e.g. mod_filecache).
    */
   if (pr_throttle_have_rate() ||
      !(session.xfer.file_size - data_len) ||
      (session.sf_flags & (SF_ASCII|SF_ASCII_OVERRIDE)) ||
      have_rfc2228_data || have_zmode ||
-     !use_sendfile) {
+     !use_sendfile ||
+     pr_fs_uses_sys_read(retr_fh) != TRUE) {
 
     if (!xfer_logged_sendfile_decline_msg) {
       if (!use_sendfile) {
         pr_log_debug(DEBUG10, "declining use of sendfile due to UseSendfile "
           "configuration setting");
 
+      } else if (pr_fs_uses_sys_read(retr_fh) != TRUE) {
+        pr_log_debug(DEBUG10, "declining use of sendfile due to custom FS "
+          "read handling for '%s'", retr_fh->fh_path);
+
       } else if (pr_throttle_have_rate()) {
-        pr_log_debug(DEBUG10, "declining use of sendfile due to TransferRate "
-          "restrictions");
+        pr_log_debug(DEBUG10, "declining use of sendfile due to TransferRate/"
+          "TransferAggregateRate restrictions");
     
       } else if (session.sf_flags & (SF_ASCII|SF_ASCII_OVERRIDE)) {
         pr_log_debug(DEBUG10, "declining use of sendfile for ASCII data");
@@ -935,6 +979,230 @@ static void retr_complete(pool *p) {
   retr_fh = NULL;
 }
 
+static void stor_writeback_init(off_t offset) {
+  config_rec *c;
+
+  stor_writeback_len = 0;
+  stor_writeback_datasync = FALSE;
+
+  c = find_config(CURRENT_CONF, CONF_PARAM, "StoreWriteback", FALSE);
+  if (c == NULL) {
+    return;
+  }
+
+  /* Writing out the handle's fd ourselves only makes sense if the data
+   * written to the handle ends up in that fd.
+   */
+  if (offset == (off_t) -1 ||
+      pr_fs_uses_sys_write(stor_fh) != TRUE) {
+    pr_trace_msg(trace_channel, 9,
+      "StoreWriteback not supported for '%s', ignoring", stor_fh->fh_path);
+    return;
+  }
+
+  stor_writeback_len = *((off_t *) c->argv[0]);
+  stor_writeback_datasync = *((int *) c->argv[1]);
+  stor_writeback_offset = stor_writeback_prev_offset = offset;
+}
+
+/* Called as data are written to the uploaded file, with the current file
+ * offset.  Once another StoreWriteback-sized section has been written, the
+ * kernel is told to start writing that section to disk, and we wait for the
+ * previous section to be written.  Thus at most two sections' worth of the
+ * upload are dirty in memory at any time, rather than letting the kernel
+ * flush gigabytes in one burst (or at close).
+ */
+static void stor_writeback(off_t offset) {
+  int fd;
+  off_t len;
+
+  if (stor_writeback_len == 0) {
+    return;
+  }
+
+  len = offset - stor_writeback_offset;
+  if (len < stor_writeback_len) {
+    return;
+  }
+
+  fd = PR_FH_FD(stor_fh);
+  if (pr_fs_sync_range(fd, stor_writeback_offset, len,
+      PR_FS_SYNC_RANGE_WRITE) < 0) {
+    int xerrno = errno;
+
+    pr_log_debug(DEBUG5, "StoreWriteback: unable to write out '%s' "
+      "incrementally: %s", stor_fh->fh_path, strerror(xerrno));
+
+    /* Don't try again for this upload. */
+    stor_writeback_len = 0;
+    return;
+  }
+
+  if (stor_writeback_prev_offset < stor_writeback_offset) {
+    len = stor_writeback_offset - stor_writeback_prev_offset;
+
+    (void) pr_fs_sync_range(fd, stor_writeback_prev_offset, len,
+      PR_FS_SYNC_RANGE_WAIT);
+
+    /* That section is now clean, and can be dropped from the cache. */
+    pr_fs_fadvise(fd, stor_writeback_prev_offset, len,
+      PR_FS_FADVISE_DONTNEED);
+  }
+
+  pr_trace_msg(trace_channel, 19, "started writeback of '%s' up to offset %"
+    PR_LU, stor_fh->fh_path, (pr_off_t) offset);
+
+  stor_writeback_prev_offset = stor_writeback_offset;
+  stor_writeback_offset = offset;
+}
+
+static void stor_datasync(void) {
+  int res, xerrno;
+  uint64_t start_ms = 0, finish_ms = 0;
+
+  if (stor_datasync_fd < 0) {
+    return;
+  }
+
+  if (stor_datasync_timerno >= 0) {
+    (void) pr_timer_remove(stor_datasync_timerno, &xfer_module);
+    stor_datasync_timerno = -1;
+  }
+
+  pr_gettimeofday_millis(&start_ms);
+  res = pr_fs_sync_range(stor_datasync_fd, 0, 0, PR_FS_SYNC_RANGE_DATASYNC);
+  xerrno = errno;
+  pr_gettimeofday_millis(&finish_ms);
+
+  if (res < 0) {
+    pr_log_pri(PR_LOG_WARNING, "StoreWriteback: error syncing data of "
+      "uploaded file '%s' to disk: %s", stor_datasync_path, strerror(xerrno));
+
+  } else {
+    pr_log_debug(DEBUG5, "StoreWriteback: synced data of uploaded file '%s' "
+      "to disk in %lu ms", stor_datasync_path,
+      (unsigned long) (finish_ms - start_ms));
+  }
+
+  (void) close(stor_datasync_fd);
+  stor_datasync_fd = -1;
+}
+
+static int stor_datasync_cb(CALLBACK_FRAME) {
+  stor_datasync_timerno = -1;
+  stor_datasync();
+
+  /* Don't restart the timer. */
+  return 0;
+}
+
+/* Preallocate the disk space for an upload whose size was announced using
+ * ALLO, so that the filesystem can lay out the file in as few extents as
+ * possible.
+ */
+static void stor_preallocate(off_t offset) {
+  config_rec *c;
+  off_t len, min_len, max_len, avail_kb;
+  const off_t *quota_avail;
+
+  stor_prealloc_end = 0;
+
+  /* The announced size only applies to the upload following the ALLO. */
+  len = xfer_allo_size;
+  xfer_allo_size = 0;
+
+  if (len == 0 ||
+      offset == (off_t) -1) {
+    return;
+  }
+
+  c = find_config(CURRENT_CONF, CONF_PARAM, "StorePreallocate", FALSE);
+  if (c == NULL ||
+      *((int *) c->argv[0]) == FALSE) {
+    return;
+  }
+
+  min_len = *((off_t *) c->argv[1]);
+  max_len = *((off_t *) c->argv[2]);
+
+  if (len < min_len) {
+    pr_trace_msg(trace_channel, 19, "announced size %" PR_LU " for '%s' "
+      "below StorePreallocate minimum %" PR_LU ", not preallocating",
+      (pr_off_t) len, stor_fh->fh_path, (pr_off_t) min_len);
+    return;
+  }
+
+  if (pr_fs_uses_sys_write(stor_fh) != TRUE) {
+    pr_trace_msg(trace_channel, 9,
+      "StorePreallocate not supported for '%s', ignoring", stor_fh->fh_path);
+    return;
+  }
+
+  /* The announced size comes from the client; do not reserve space for an
+   * upload which could not be completed anyway, for lack of disk space (as
+   * checked for ALLO) or of quota.
+   */
+  if (pr_fs_fgetsize(PR_FH_FD(stor_fh), &avail_kb) == 0 &&
+      len / 1024 > avail_kb) {
+    pr_log_debug(DEBUG5, "StorePreallocate: %" PR_LU " KB requested, only %"
+      PR_LU " KB available for '%s', not preallocating",
+      (pr_off_t) (len / 1024), (pr_off_t) avail_kb, stor_fh->fh_path);
+    return;
+  }
+
+  quota_avail = pr_table_get(session.notes, "mod_quotatab.bytes-in-avail",
+    NULL);
+  if (quota_avail != NULL &&
+      len > *quota_avail) {
+    pr_log_debug(DEBUG5, "StorePreallocate: %" PR_LU " bytes requested, only "
+      "%" PR_LU " bytes of quota available for '%s', not preallocating",
+      (pr_off_t) len, (pr_off_t) *quota_avail, stor_fh->fh_path);
+    return;
+  }
+
+  if (len > max_len) {
+    len = max_len;
+  }
+
+  if (pr_fs_allocate(PR_FH_FD(stor_fh), offset, len, 0) < 0) {
+    pr_log_debug(DEBUG5, "StorePreallocate: unable to preallocate %" PR_LU
+      " bytes for '%s': %s", (pr_off_t) len, stor_fh->fh_path,
+      strerror(errno));
+    return;
+  }
+
+  pr_log_debug(DEBUG9, "StorePreallocate: preallocated %" PR_LU " bytes "
+    "at offset %" PR_LU " for '%s'", (pr_off_t) len, (pr_off_t) offset,
+    stor_fh->fh_path);
+  stor_prealloc_end = offset + len;
+}
+
+/* Release any preallocated space beyond the data actually uploaded, e.g.
+ * for aborted uploads, or uploads shorter than announced.
+ */
+static void stor_prealloc_trim(void) {
+  struct stat st;
+
+  if (stor_prealloc_end == 0) {
+    return;
+  }
+
+  if (pr_fsio_fstat(stor_fh, &st) == 0 &&
+      st.st_size < stor_prealloc_end) {
+    pr_trace_msg(trace_channel, 9, "releasing %" PR_LU " preallocated bytes "
+      "beyond end of '%s'", (pr_off_t) (stor_prealloc_end - st.st_size),
+      stor_fh->fh_path);
+
+    if (pr_fs_allocate(PR_FH_FD(stor_fh), st.st_size,
+        stor_prealloc_end - st.st_size, PR_FS_ALLOCATE_FL_DEALLOCATE) < 0) {
+      pr_log_debug(DEBUG5, "StorePreallocate: unable to release preallocated "
+        "space beyond end of '%s': %s", stor_fh->fh_path, strerror(errno));
+    }
+  }
+
+  stor_prealloc_end = 0;
+}
+
 static void stor_abort(pool *p) {
   int res, xerrno = 0;
   pool *tmp_pool;
@@ -944,6 +1212,8 @@ static void stor_abort(pool *p) {
   tmp_pool = make_sub_pool(p);
 
   if (stor_fh != NULL) {
+    stor_prealloc_trim();
+
     res = pr_fsio_close_with_error(tmp_pool, stor_fh, &err);
     xerrno = errno;
 
@@ -1037,14 +1307,54 @@ static void stor_abort(pool *p) {
 }
 
 static int stor_complete(pool *p) {
-  int res, xerrno = 0;
+  int datasync_fd = -1, res, xerrno = 0;
   pool *tmp_pool;
   pr_error_t *err = NULL;
 
+  stor_prealloc_trim();
+
+  if (stor_writeback_datasync == TRUE) {
+    int fd;
+
+    fd = PR_FH_FD(stor_fh);
+
+    /* Start writing out the rest of the upload now, and sync its data
+     * once the client has been told that the transfer is complete, rather
+     * than making the client wait for it.
+     */
+    if (stor_writeback_len > 0) {
+      (void) pr_fs_sync_range(fd, stor_writeback_offset, 0,
+        PR_FS_SYNC_RANGE_WRITE);
+    }
+
+    /* Any previous upload still pending its sync goes first. */
+    stor_datasync();
+
+    datasync_fd = dup(fd);
+    if (datasync_fd < 0) {
+      pr_log_debug(DEBUG5, "StoreWriteback: unable to dup fd %d for '%s': %s",
+        fd, stor_fh->fh_path, strerror(errno));
+
+    } else {
+      sstrncpy(stor_datasync_path, session.xfer.path != NULL ?
+        session.xfer.path : stor_fh->fh_path, sizeof(stor_datasync_path));
+    }
+  }
+
   tmp_pool = make_sub_pool(p);
   res = pr_fsio_close_with_error(tmp_pool, stor_fh, &err);
   xerrno = errno;
 
+  if (res == 0 &&
+      datasync_fd >= 0) {
+    stor_datasync_fd = datasync_fd;
+    stor_datasync_timerno = pr_timer_add(1, -1, &xfer_module,
+      stor_datasync_cb, "StoreWriteback DataSync");
+
+  } else if (datasync_fd >= 0) {
+    (void) close(datasync_fd);
+  }
+
   if (res < 0) {
     pr_error_set_where(err, &xfer_module, __FILE__, __LINE__ - 4);
     pr_error_set_why(err, pstrcat(tmp_pool, "close uploaded file '",
@@ -2000,6 +2310,9 @@ MODRET xfer_stor(cmd_rec *cmd) {
       sizeof(off_t));
   }
 
+  stor_writeback_init(curr_offset);
+  stor_preallocate(curr_offset);
+
   /* Get the latest stats on the file.  If the file already existed, we
    * want to know its current size.
    */
@@ -2139,6 +2452,9 @@ MODRET xfer_stor(cmd_rec *cmd) {
       return PR_ERROR(cmd);
     }
 
+    /* If StoreWriteback is not configured, this does nothing. */
+    stor_writeback(curr_offset + nbytes_stored);
+
     /* If no throttling is configured, this does nothing. */
     pr_throttle_pause(nbytes_stored, FALSE);
 
@@ -2960,7 +3276,7 @@ MODRET xfer_retr(cmd_rec *cmd) {
     if ((nbytes_sent / cnt_steps) != cnt_next) {
       cnt_next = nbytes_sent / cnt_steps;
 
-      pr_scoreboard_entry_update(session.pid,
+      pr_scoreboard_entry_update_deferred(session.pid,
         PR_SCORE_XFER_DONE, nbytes_sent,
         NULL);
     }
@@ -2991,6 +3307,7 @@ MODRET xfer_retr(cmd_rec *cmd) {
      * end-of-loop conditions).
      */
     pr_throttle_pause(session.xfer.total_bytes, TRUE);
+    pr_scoreboard_entry_flush();
 
     retr_complete(cmd->pool);
     xfer_displayfile();
@@ -3216,6 +3533,9 @@ MODRET xfer_allo(cmd_rec *cmd) {
     return PR_ERROR(cmd);
   }
 
+  /* Remember the announced size, for preallocating the next upload. */
+  xfer_allo_size = requested_sz;
+
   if (xfer_opts & PR_XFER_OPT_HANDLE_ALLO) {
     const char *path;
     off_t avail_kb;
@@ -3247,6 +3567,7 @@ MODRET xfer_allo(cmd_rec *cmd) {
           (pr_off_t) requested_kb, (pr_off_t) avail_kb, path);
         pr_response_add_err(R_552, "%s: %s", cmd->arg, strerror(ENOSPC));
 
+        xfer_allo_size = 0;
         pr_cmd_set_errno(cmd, ENOSPC);
         errno = ENOSPC;
         return PR_ERROR(cmd);
@@ -3300,6 +3621,9 @@ MODRET xfer_err_cleanup(cmd_rec *cmd) {
   session.range_start = session.range_len = 0;
   session.restart_pos = 0;
 
+  /* Nor any size announced by ALLO for the failed upload. */
+  xfer_allo_size = 0;
+
   return PR_DECLINED(cmd);
 }
 
@@ -3829,6 +4153,140 @@ MODRET set_storeuniqueprefix(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: StorePreallocate on|off|min-size [units] [max-size [units]] */
+MODRET set_storepreallocate(cmd_rec *cmd) {
+  register unsigned int i;
+  config_rec *c;
+  int engine = TRUE;
+  off_t sizes[2] = { PR_XFER_DEFAULT_PREALLOC_MIN,
+    PR_XFER_DEFAULT_PREALLOC_MAX };
+  unsigned int nsizes = 0;
+
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL|CONF_ANON|CONF_DIR);
+
+  if (cmd->argc-1 < 1 ||
+      cmd->argc-1 > 4) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  if (cmd->argc-1 == 1) {
+    engine = get_boolean(cmd, 1);
+  }
+
+  if (engine == -1) {
+    engine = TRUE;
+
+    for (i = 1; i < cmd->argc; i++) {
+      char *units = NULL;
+
+      if (nsizes == 2) {
+        CONF_ERROR(cmd, "wrong number of parameters");
+      }
+
+      /* The units are optional. */
+      if (i + 1 < cmd->argc &&
+          !PR_ISDIGIT(((char *) cmd->argv[i+1])[0])) {
+        units = cmd->argv[i+1];
+      }
+
+      if (pr_str_get_nbytes(cmd->argv[i], units, &sizes[nsizes]) < 0) {
+        CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "unable to parse: ",
+          cmd->argv[i], units ? " " : "", units ? units : "", ": ",
+          strerror(errno), NULL));
+      }
+
+      if (units != NULL) {
+        i++;
+      }
+
+      nsizes++;
+    }
+
+    if (nsizes == 1 &&
+        sizes[1] < sizes[0]) {
+      sizes[1] = sizes[0];
+    }
+
+    if (sizes[1] == 0) {
+      CONF_ERROR(cmd, "maximum size must be greater than zero");
+    }
+
+    if (sizes[1] < sizes[0]) {
+      CONF_ERROR(cmd, "maximum size must not be less than minimum size");
+    }
+  }
+
+  c = add_config_param(cmd->argv[0], 3, NULL, NULL, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[0]) = engine;
+  c->argv[1] = pcalloc(c->pool, sizeof(off_t));
+  *((off_t *) c->argv[1]) = sizes[0];
+  c->argv[2] = pcalloc(c->pool, sizeof(off_t));
+  *((off_t *) c->argv[2]) = sizes[1];
+
+  c->flags |= CF_MERGEDOWN;
+  return PR_HANDLED(cmd);
+}
+
+/* usage: StoreWriteback on|off|size [units] ["DataSync"] */
+MODRET set_storewriteback(cmd_rec *cmd) {
+  config_rec *c;
+  off_t writeback_len = 0;
+  int datasync = FALSE, nargs;
+
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL|CONF_ANON|CONF_DIR);
+
+  nargs = cmd->argc-1;
+  if (nargs < 1 ||
+      nargs > 3) {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  if (nargs > 1 &&
+      strcasecmp(cmd->argv[nargs], "DataSync") == 0) {
+    datasync = TRUE;
+    nargs--;
+  }
+
+  if (nargs == 1) {
+    int bool;
+
+    bool = get_boolean(cmd, 1);
+    if (bool == -1) {
+      if (pr_str_get_nbytes(cmd->argv[1], NULL, &writeback_len) < 0) {
+        CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "unable to parse: ",
+          cmd->argv[1], ": ", strerror(errno), NULL));
+      }
+
+    } else if (bool == TRUE) {
+      writeback_len = PR_XFER_DEFAULT_WRITEBACK_LEN;
+    }
+
+  } else if (nargs == 2) {
+    if (pr_str_get_nbytes(cmd->argv[1], cmd->argv[2], &writeback_len) < 0) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "unable to parse: ",
+        cmd->argv[1], " ", cmd->argv[2], ": ", strerror(errno), NULL));
+    }
+
+  } else {
+    CONF_ERROR(cmd, "wrong number of parameters");
+  }
+
+  if (writeback_len == 0 &&
+      datasync == TRUE) {
+    CONF_ERROR(cmd, "DataSync requires StoreWriteback to be enabled");
+  }
+
+  c = add_config_param(cmd->argv[0], 2, NULL, NULL);
+  c->argv[0] = pcalloc(c->pool, sizeof(off_t));
+  *((off_t *) c->argv[0]) = writeback_len;
+  c->argv[1] = pcalloc(c->pool, sizeof(int));
+  *((int *) c->argv[1]) = datasync;
+
+  c->flags |= CF_MERGEDOWN;
+  return PR_HANDLED(cmd);
+}
+
 MODRET set_timeoutnoxfer(cmd_rec *cmd) {
   int timeout = -1;
   config_rec *c = NULL;
@@ -3869,6 +4327,93 @@ MODRET set_timeoutstalled(cmd_rec *cmd) {
   return PR_HANDLED(cmd);
 }
 
+/* usage: TransferAggregateRate cmds global|server|class|user kbps[:burst-kb]
+ */
+MODRET set_transferaggregaterate(cmd_rec *cmd) {
+  config_rec *c;
+  const char *scope;
+  char *ptr, *endp = NULL;
+  double kbps, burst_kb = -1.0;
+  uint64_t rate, burst;
+
+  CHECK_ARGS(cmd, 3);
+  CHECK_CONF(cmd, CONF_ROOT|CONF_VIRTUAL|CONF_GLOBAL);
+
+  if (strcasecmp(cmd->argv[2], "global") == 0) {
+    scope = "global";
+
+  } else if (strcasecmp(cmd->argv[2], "server") == 0) {
+    scope = "server";
+
+  } else if (strcasecmp(cmd->argv[2], "class") == 0) {
+    scope = "class";
+
+  } else if (strcasecmp(cmd->argv[2], "user") == 0) {
+    scope = "user";
+
+  } else {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "unknown scope requested: '",
+      cmd->argv[2], "'", NULL));
+  }
+
+  ptr = strchr(cmd->argv[3], ':');
+  if (ptr != NULL) {
+    *ptr++ = '\0';
+
+    burst_kb = strtod(ptr, &endp);
+    if ((endp && *endp) ||
+        burst_kb < 0.0) {
+      CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "invalid burst: '", ptr, "'",
+        NULL));
+    }
+  }
+
+  kbps = strtod(cmd->argv[3], &endp);
+  if ((endp && *endp) ||
+      kbps <= 0.0) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, "invalid rate: '", cmd->argv[3],
+      "'", NULL));
+  }
+
+  rate = (uint64_t) (kbps * 1024.0);
+  if (rate == 0) {
+    rate = 1;
+  }
+
+  /* By default, allow bursts of a tenth of a second's worth of bytes, which
+   * keeps the aggregate rate smooth at sub-second scales.
+   */
+  if (burst_kb < 0.0) {
+    burst = rate / 10;
+
+  } else {
+    burst = (uint64_t) (burst_kb * 1024.0);
+  }
+
+  /* Bursts of more than a minute's worth of bytes are not kept. */
+  if (burst > rate * 60) {
+    burst = rate * 60;
+  }
+
+  c = add_config_param(cmd->argv[0], 5, NULL, NULL, NULL, NULL, NULL);
+
+  if (xfer_parse_cmdlist(cmd->argv[0], c, cmd->argv[1]) < 0) {
+    CONF_ERROR(cmd, "error with command list");
+  }
+
+  c->argv[1] = pstrdup(c->pool, scope);
+  c->argv[2] = pcalloc(c->pool, sizeof(uint64_t));
+  *((uint64_t *) c->argv[2]) = rate;
+  c->argv[3] = pcalloc(c->pool, sizeof(uint64_t));
+  *((uint64_t *) c->argv[3]) = burst;
+
+  /* Keep the command list as given, for naming the shared bucket. */
+  c->argv[4] = pstrdup(c->pool, cmd->argv[1]);
+
+  c->flags |= CF_MERGEDOWN_MULTI;
+  return PR_HANDLED(cmd);
+}
+
 /* usage: TransferOptions opt1 opt2 ... */
 MODRET set_transferoptions(cmd_rec *cmd) {
   config_rec *c = NULL;
@@ -4141,6 +4686,9 @@ static void xfer_exit_ev(const void *event_data, void *user_data) {
     retr_abort(session.pool);
   }
 
+  /* A completed upload may still be waiting for its data to be synced. */
+  stor_datasync();
+
   if (session.sf_flags & SF_XFER) {
     cmd_rec *cmd;
     pr_data_abort(0, FALSE);
@@ -4346,8 +4894,11 @@ static conftable xfer_conftab[] = {
   { "MaxTransfersPerHost",	set_maxtransfersperhost,	NULL },
   { "MaxTransfersPerUser",	set_maxtransfersperuser,	NULL },
   { "StoreUniquePrefix",	set_storeuniqueprefix,		NULL },
+  { "StorePreallocate",	set_storepreallocate,		NULL },
+  { "StoreWriteback",	set_storewriteback,		NULL },
   { "TimeoutNoTransfer",	set_timeoutnoxfer,		NULL },
   { "TimeoutStalled",		set_timeoutstalled,		NULL },
+  { "TransferAggregateRate",	set_transferaggregaterate,	NULL },
   { "TransferOptions",		set_transferoptions,		NULL },
   { "TransferRate",		set_transferrate,		NULL },
   { "UseSendfile",		set_usesendfile,		NULL },
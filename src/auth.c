@@ -461,7 +461,22 @@ static modret_t *dispatch_auth(cmd_rec *cmd, char *match, module **m) {
       "dispatching auth request \"%s\" to module mod_%s",
       match, iter_tab->m->name);
 
-    mr = pr_module_call(iter_tab->m, iter_tab->handler, cmd);
+    if (pr_stats_enabled()) {
+      uint64_t start_usecs, end_usecs;
+      int xerrno;
+
+      start_usecs = pr_stats_get_usecs();
+      mr = pr_module_call(iter_tab->m, iter_tab->handler, cmd);
+      xerrno = errno;
+      end_usecs = pr_stats_get_usecs();
+
+      (void) pr_stats_add_handler(iter_tab->m->name, match, 0,
+        end_usecs > start_usecs ? end_usecs - start_usecs : 0);
+      errno = xerrno;
+
+    } else {
+      mr = pr_module_call(iter_tab->m, iter_tab->handler, cmd);
+    }
 
     /* Return a pointer, if requested, to the module which answered the
      * auth request.  This is used, for example, by auth_getpwnam() for
@@ -662,6 +677,7 @@ struct passwd *pr_auth_getpwnam(pool *p, const char *name) {
   modret_t *mr = NULL;
   struct passwd *res = NULL;
   module *m = NULL;
+  const char *module_name = NULL;
 
   if (p == NULL ||
       name == NULL) {
@@ -669,17 +685,34 @@ struct passwd *pr_auth_getpwnam(pool *p, const char *name) {
     return NULL;
   }
 
-  cmd = make_cmd(p, 1, name);
-  mr = dispatch_auth(cmd, "getpwnam", &m);
+  if (pr_authcache_get_pwnam(p, name, &res, &module_name) == 0) {
+    pr_trace_msg(trace_channel, 15,
+      "using cached getpwnam result for user '%s' (%s%s)", name,
+      module_name ? "from mod_" : "not found", module_name ? module_name : "");
 
-  if (MODRET_ISHANDLED(mr) &&
-      MODRET_HASDATA(mr)) {
-    res = mr->data;
-  }
+    if (module_name != NULL) {
+      m = pr_module_get(pstrcat(p, "mod_", module_name, ".c", NULL));
+    }
 
-  if (cmd->tmp_pool) {
-    destroy_pool(cmd->tmp_pool);
-    cmd->tmp_pool = NULL;
+  } else {
+    cmd = make_cmd(p, 1, name);
+    mr = dispatch_auth(cmd, "getpwnam", &m);
+
+    if (MODRET_ISHANDLED(mr) &&
+        MODRET_HASDATA(mr)) {
+      res = mr->data;
+    }
+
+    /* Errors (e.g. an unreachable backend) are not cached. */
+    if (pr_authcache_enabled() &&
+        !MODRET_ISERROR(mr)) {
+      (void) pr_authcache_add_pwnam(name, res, m ? m->name : NULL);
+    }
+
+    if (cmd->tmp_pool) {
+      destroy_pool(cmd->tmp_pool);
+      cmd->tmp_pool = NULL;
+    }
   }
 
   /* Sanity check */
@@ -811,6 +844,8 @@ struct group *pr_auth_getgrnam(pool *p, const char *name) {
   cmd_rec *cmd = NULL;
   modret_t *mr = NULL;
   struct group *res = NULL;
+  module *m = NULL;
+  const char *module_name = NULL;
 
   if (p == NULL ||
       name == NULL) {
@@ -818,17 +853,29 @@ struct group *pr_auth_getgrnam(pool *p, const char *name) {
     return NULL;
   }
 
-  cmd = make_cmd(p, 1, name);
-  mr = dispatch_auth(cmd, "getgrnam", NULL);
+  if (pr_authcache_get_grnam(p, name, &res, &module_name) == 0) {
+    pr_trace_msg(trace_channel, 15,
+      "using cached getgrnam result for group '%s' (%s%s)", name,
+      module_name ? "from mod_" : "not found", module_name ? module_name : "");
 
-  if (MODRET_ISHANDLED(mr) &&
-      MODRET_HASDATA(mr)) {
-    res = mr->data;
-  }
+  } else {
+    cmd = make_cmd(p, 1, name);
+    mr = dispatch_auth(cmd, "getgrnam", &m);
 
-  if (cmd->tmp_pool) {
-    destroy_pool(cmd->tmp_pool);
-    cmd->tmp_pool = NULL;
+    if (MODRET_ISHANDLED(mr) &&
+        MODRET_HASDATA(mr)) {
+      res = mr->data;
+    }
+
+    if (pr_authcache_enabled() &&
+        !MODRET_ISERROR(mr)) {
+      (void) pr_authcache_add_grnam(name, res, m ? m->name : NULL);
+    }
+
+    if (cmd->tmp_pool) {
+      destroy_pool(cmd->tmp_pool);
+      cmd->tmp_pool = NULL;
+    }
   }
 
   /* Sanity check */
@@ -1502,7 +1549,9 @@ int pr_auth_getgroups(pool *p, const char *name, array_header **group_ids,
     array_header **group_names) {
   cmd_rec *cmd = NULL;
   modret_t *mr = NULL;
-  int res = -1;
+  module *m = NULL;
+  const char *module_name = NULL;
+  int res = -1, have_groups = FALSE;
 
   if (p == NULL ||
       name == NULL) {
@@ -1519,15 +1568,41 @@ int pr_auth_getgroups(pool *p, const char *name, array_header **group_ids,
     *group_names = make_array(permanent_pool, 2, sizeof(char *));
   }
 
-  cmd = make_cmd(p, 3, name, group_ids ? *group_ids : NULL,
-    group_names ? *group_names : NULL);
+  if (pr_authcache_get_groups(p, name, group_ids ? *group_ids : NULL,
+      group_names ? *group_names : NULL, &res, &module_name) == 0) {
+    pr_trace_msg(trace_channel, 15,
+      "using cached getgroups result for user '%s' (%s%s)", name,
+      module_name ? "from mod_" : "not found", module_name ? module_name : "");
+    have_groups = (res >= 0);
 
-  mr = dispatch_auth(cmd, "getgroups", NULL);
+  } else {
+    cmd = make_cmd(p, 3, name, group_ids ? *group_ids : NULL,
+      group_names ? *group_names : NULL);
 
-  if (MODRET_ISHANDLED(mr) &&
-      MODRET_HASDATA(mr)) {
-    res = *((int *) mr->data);
+    mr = dispatch_auth(cmd, "getgroups", &m);
+
+    if (MODRET_ISHANDLED(mr) &&
+        MODRET_HASDATA(mr)) {
+      res = *((int *) mr->data);
+      have_groups = TRUE;
+    }
 
+    /* Only complete results, with both the IDs and the names, are cached. */
+    if (pr_authcache_enabled() &&
+        !MODRET_ISERROR(mr) &&
+        group_ids != NULL &&
+        group_names != NULL) {
+      (void) pr_authcache_add_groups(name, *group_ids, *group_names,
+        have_groups ? res : -1, m ? m->name : NULL);
+    }
+
+    if (cmd->tmp_pool) {
+      destroy_pool(cmd->tmp_pool);
+      cmd->tmp_pool = NULL;
+    }
+  }
+
+  if (have_groups) {
     /* Note: the number of groups returned should, barring error,
      * always be at least 1, as per getgroups(2) behavior.  This one
      * ID is present because it is the primary group membership set in
@@ -1567,11 +1642,6 @@ int pr_auth_getgroups(pool *p, const char *name, array_header **group_ids,
     }
   }
 
-  if (cmd->tmp_pool) {
-    destroy_pool(cmd->tmp_pool);
-    cmd->tmp_pool = NULL;
-  }
-
   return res;
 }
 
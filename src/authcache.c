@@ -0,0 +1,952 @@
+/*
+ * ProFTPD - FTP server daemon
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project and other respective copyright
+ * holders give permission to link this program with OpenSSL, and distribute
+ * the resulting executable, without including the source code for OpenSSL in
+ * the source distribution.
+ */
+
+/* Shared authentication cache */
+
+#include "conf.h"
+
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+
+/* The cached results live in an anonymous shared mapping, created by the
+ * daemon before any session processes are forked.  The mapping holds a
+ * small header, with the per-module statistics, and a table of fixed-size
+ * slots; each result is kept in the slot for its hash, replacing whatever
+ * was there.  As with the listing cache, nothing is ever locked: a slot
+ * carries a generation number, odd while the slot is being changed, and
+ * readers copy the slot out, and then check that the generation has not
+ * changed underneath them.  Clearing the cache bumps the table's epoch,
+ * which every cached result records.
+ */
+
+#define AUTHCACHE_MIN_SIZE		(64 * 1024)
+#define AUTHCACHE_SLOT_SIZE		1024
+#define AUTHCACHE_MIN_NSLOTS		64
+#define AUTHCACHE_MAX_NMODULES		32
+#define AUTHCACHE_MODULE_NAMESZ		32
+
+#if defined(__GNUC__)
+# define AUTHCACHE_BARRIER()		__sync_synchronize()
+# define AUTHCACHE_ATOMIC_CAS(v, o, n)	\
+  __sync_bool_compare_and_swap(&(v), (o), (n))
+# define AUTHCACHE_ATOMIC_INCR(v)	(void) __sync_fetch_and_add(&(v), 1)
+#endif
+
+struct authcache_module {
+  pr_claim_t am_claim;
+
+  char am_name[AUTHCACHE_MODULE_NAMESZ];
+  volatile uint64_t am_hits;
+  volatile uint64_t am_misses;
+};
+
+struct authcache_table {
+  volatile uint32_t at_epoch;
+  uint32_t at_nslots;
+  int64_t at_ttl;
+  int64_t at_negative_ttl;
+
+  struct authcache_module at_modules[AUTHCACHE_MAX_NMODULES];
+};
+
+struct authcache_slot {
+  /* Odd while the slot is being changed. */
+  volatile uint32_t as_gen;
+
+  uint32_t as_hash;
+  uint32_t as_epoch;
+  uint32_t as_sid;
+  int64_t as_expires;
+  uint16_t as_type;
+  uint16_t as_found;
+  uint16_t as_namelen;
+  uint16_t as_ctxlen;
+  uint16_t as_modlen;
+  uint32_t as_datalen;
+
+  /* The name, the auth context, and the module name, each NUL-terminated,
+   * and then the result follow.
+   */
+};
+
+#define AUTHCACHE_SLOT_DATASZ \
+  (AUTHCACHE_SLOT_SIZE - sizeof(struct authcache_slot))
+
+/* Buffer for the result being added to, or read from, a slot. */
+struct authcache_buf {
+  char *ptr;
+  size_t len;
+  size_t sz;
+};
+
+static struct authcache_table *authcache_tab = NULL;
+static size_t authcache_tabsz = 0;
+static char *authcache_slots = NULL;
+
+static const char *none_module_name = "none";
+static const char *trace_channel = "authcache";
+
+/* Auth configuration, e.g. SQLEngine, may be scoped to an <Anonymous>
+ * section, in which case the lookups made for that section may be answered
+ * differently than those for the rest of the server; their results are
+ * cached under the section's path.
+ */
+static const char *authcache_get_context(void) {
+  if (session.anon_config != NULL &&
+      session.anon_config->name != NULL) {
+    return session.anon_config->name;
+  }
+
+  return "";
+}
+
+static uint32_t authcache_hash(int type, unsigned int sid, const char *ctx,
+    const char *name) {
+  const unsigned char *ptr;
+  uint32_t h = 2166136261UL;
+
+  /* FNV-1a, over the name and the context, and then the type and server
+   * ID.
+   */
+  for (ptr = (const unsigned char *) name; *ptr; ptr++) {
+    h ^= *ptr;
+    h *= 16777619UL;
+  }
+
+  /* Hash the NUL between them, so that "ab" + "c" and "a" + "bc" differ. */
+  h *= 16777619UL;
+  for (ptr = (const unsigned char *) ctx; *ptr; ptr++) {
+    h ^= *ptr;
+    h *= 16777619UL;
+  }
+
+  h ^= (uint32_t) type;
+  h *= 16777619UL;
+  h ^= (uint32_t) sid;
+  h *= 16777619UL;
+
+  return h;
+}
+
+static struct authcache_slot *authcache_get_slot(uint32_t idx) {
+  return (struct authcache_slot *) (authcache_slots +
+    ((size_t) idx * AUTHCACHE_SLOT_SIZE));
+}
+
+int pr_authcache_enabled(void) {
+  return (authcache_tab != NULL);
+}
+
+static void authcache_count(const char *module_name, int hit) {
+#if defined(AUTHCACHE_BARRIER)
+  register unsigned int i;
+
+  if (module_name == NULL) {
+    module_name = none_module_name;
+  }
+
+  for (i = 0; i < AUTHCACHE_MAX_NMODULES; i++) {
+    struct authcache_module *am;
+
+    am = &(authcache_tab->at_modules[i]);
+
+    /* Claim an unused entry for the module.  Another session may be naming
+     * this entry; wait for it to finish, or, if it died meanwhile, name the
+     * entry for this module.
+     */
+    if (pr_claim_is_ready(&(am->am_claim)) == FALSE) {
+      if (pr_claim_acquire(&(am->am_claim), PR_CLAIM_EMPTY) == 0 ||
+          pr_claim_wait(&(am->am_claim)) == PR_CLAIM_TAKEN) {
+        sstrncpy(am->am_name, module_name, sizeof(am->am_name));
+        pr_claim_release(&(am->am_claim));
+      }
+    }
+
+    if (strncmp(am->am_name, module_name, sizeof(am->am_name)-1) == 0) {
+      if (hit) {
+        AUTHCACHE_ATOMIC_INCR(am->am_hits);
+
+      } else {
+        AUTHCACHE_ATOMIC_INCR(am->am_misses);
+      }
+
+      return;
+    }
+  }
+#endif /* AUTHCACHE_BARRIER */
+}
+
+array_header *pr_authcache_get_stats(pool *p) {
+  register unsigned int i;
+  array_header *stats;
+
+  if (p == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  if (authcache_tab == NULL) {
+    errno = EPERM;
+    return NULL;
+  }
+
+  stats = make_array(p, 0, sizeof(struct authcache_stats));
+
+  for (i = 0; i < AUTHCACHE_MAX_NMODULES; i++) {
+    register unsigned int j;
+    struct authcache_module *am;
+    struct authcache_stats *st = NULL, *elts;
+
+    am = &(authcache_tab->at_modules[i]);
+    if (pr_claim_is_ready(&(am->am_claim)) == FALSE) {
+      continue;
+    }
+
+    /* Sessions racing to claim entries for the same module may have each
+     * claimed one; merge them.
+     */
+    elts = stats->elts;
+    for (j = 0; j < stats->nelts; j++) {
+      if (strcmp(elts[j].module_name, am->am_name) == 0) {
+        st = &(elts[j]);
+        break;
+      }
+    }
+
+    if (st == NULL) {
+      st = push_array(stats);
+      st->module_name = pstrdup(p, am->am_name);
+      st->hits = st->misses = 0;
+    }
+
+    st->hits += am->am_hits;
+    st->misses += am->am_misses;
+  }
+
+  return stats;
+}
+
+/* Copies the slot for the given name into the buffer, returning the slot
+ * header if it holds an unexpired result for that name.
+ */
+static struct authcache_slot *authcache_get(int type, const char *name,
+    uint64_t *buf) {
+#if defined(AUTHCACHE_BARRIER)
+  struct authcache_slot *slot, *copy;
+  uint32_t gen, hash;
+  size_t namelen, ctxlen;
+  const char *ctx, *ptr;
+
+  if (authcache_tab == NULL) {
+    errno = EPERM;
+    return NULL;
+  }
+
+  ctx = authcache_get_context();
+  hash = authcache_hash(type, main_server->sid, ctx, name);
+  slot = authcache_get_slot(hash % authcache_tab->at_nslots);
+
+  gen = slot->as_gen;
+  AUTHCACHE_BARRIER();
+
+  if (gen == 0 ||
+      (gen & 1) ||
+      slot->as_hash != hash) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  memcpy(buf, slot, AUTHCACHE_SLOT_SIZE);
+
+  AUTHCACHE_BARRIER();
+  if (slot->as_gen != gen) {
+    pr_trace_msg(trace_channel, 17, "slot changed while being read, "
+      "ignoring");
+    errno = ENOENT;
+    return NULL;
+  }
+
+  copy = (struct authcache_slot *) buf;
+  namelen = strlen(name);
+  ctxlen = strlen(ctx);
+
+  if (copy->as_type != type ||
+      copy->as_sid != main_server->sid ||
+      copy->as_epoch != authcache_tab->at_epoch ||
+      copy->as_namelen != namelen ||
+      copy->as_ctxlen != ctxlen ||
+      (size_t) copy->as_namelen + copy->as_ctxlen + copy->as_modlen + 3 +
+        copy->as_datalen > AUTHCACHE_SLOT_DATASZ) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  ptr = ((const char *) copy) + sizeof(struct authcache_slot);
+  if (memcmp(ptr, name, namelen + 1) != 0 ||
+      memcmp(ptr + namelen + 1, ctx, ctxlen + 1) != 0 ||
+      ptr[namelen + 1 + ctxlen + 1 + copy->as_modlen] != '\0') {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  if ((time_t) copy->as_expires <= time(NULL)) {
+    pr_trace_msg(trace_channel, 15, "cached result for '%s' expired, "
+      "ignoring", name);
+    errno = ENOENT;
+    return NULL;
+  }
+
+  return copy;
+#else
+  errno = ENOSYS;
+  return NULL;
+#endif /* !AUTHCACHE_BARRIER */
+}
+
+static const char *authcache_get_module_name(struct authcache_slot *slot) {
+  const char *ptr;
+
+  ptr = ((const char *) slot) + sizeof(struct authcache_slot) +
+    slot->as_namelen + 1 + slot->as_ctxlen + 1;
+  return *ptr ? ptr : NULL;
+}
+
+static void authcache_get_data(struct authcache_slot *slot,
+    struct authcache_buf *data) {
+  data->ptr = ((char *) slot) + sizeof(struct authcache_slot) +
+    slot->as_namelen + 1 + slot->as_ctxlen + 1 + slot->as_modlen + 1;
+  data->len = 0;
+  data->sz = slot->as_datalen;
+}
+
+static int authcache_add(int type, const char *name, int found,
+    const char *module_name, const struct authcache_buf *data) {
+#if defined(AUTHCACHE_BARRIER)
+  struct authcache_slot *slot;
+  uint32_t gen, hash;
+  size_t namelen, ctxlen, modlen, datalen;
+  time_t ttl;
+  const char *ctx;
+  char *ptr;
+
+  if (authcache_tab == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  /* Count the lookup which missed the cache, and went to the module. */
+  authcache_count(found ? module_name : NULL, FALSE);
+
+  ttl = (time_t) (found ? authcache_tab->at_ttl :
+    authcache_tab->at_negative_ttl);
+  if (ttl == 0) {
+    return 0;
+  }
+
+  if (module_name == NULL) {
+    module_name = "";
+  }
+
+  ctx = authcache_get_context();
+  namelen = strlen(name);
+  ctxlen = strlen(ctx);
+  modlen = strlen(module_name);
+  datalen = data != NULL ? data->len : 0;
+
+  if (namelen + ctxlen + modlen + 3 + datalen > AUTHCACHE_SLOT_DATASZ) {
+    pr_trace_msg(trace_channel, 15, "result for '%s' too large (%lu bytes), "
+      "not caching", name, (unsigned long) datalen);
+    errno = EFBIG;
+    return -1;
+  }
+
+  hash = authcache_hash(type, main_server->sid, ctx, name);
+  slot = authcache_get_slot(hash % authcache_tab->at_nslots);
+
+  gen = slot->as_gen;
+  if ((gen & 1) ||
+      !AUTHCACHE_ATOMIC_CAS(slot->as_gen, gen, gen + 1)) {
+    pr_trace_msg(trace_channel, 15, "slot busy, not caching result for '%s'",
+      name);
+    errno = EAGAIN;
+    return -1;
+  }
+
+  AUTHCACHE_BARRIER();
+  slot->as_hash = hash;
+  slot->as_epoch = authcache_tab->at_epoch;
+  slot->as_sid = main_server->sid;
+  slot->as_expires = (int64_t) (time(NULL) + ttl);
+  slot->as_type = type;
+  slot->as_found = found ? 1 : 0;
+  slot->as_namelen = namelen;
+  slot->as_ctxlen = ctxlen;
+  slot->as_modlen = modlen;
+  slot->as_datalen = datalen;
+
+  ptr = ((char *) slot) + sizeof(struct authcache_slot);
+  memcpy(ptr, name, namelen + 1);
+  ptr += namelen + 1;
+  memcpy(ptr, ctx, ctxlen + 1);
+  ptr += ctxlen + 1;
+  memcpy(ptr, module_name, modlen + 1);
+  ptr += modlen + 1;
+  if (datalen > 0) {
+    memcpy(ptr, data->ptr, datalen);
+  }
+
+  AUTHCACHE_BARRIER();
+  slot->as_gen = gen + 2;
+
+  pr_trace_msg(trace_channel, 17, "cached %s result (type %d) for '%s' "
+    "for %lu secs", found ? "found" : "not-found", type, name,
+    (unsigned long) ttl);
+  return 0;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif /* !AUTHCACHE_BARRIER */
+}
+
+/* Result encoding. */
+
+static void authcache_put(struct authcache_buf *buf, const void *data,
+    size_t len) {
+  if (buf->len + len > buf->sz) {
+    /* Mark the result as too large. */
+    buf->len = buf->sz + 1;
+    return;
+  }
+
+  memcpy(buf->ptr + buf->len, data, len);
+  buf->len += len;
+}
+
+static void authcache_put_str(struct authcache_buf *buf, const char *str) {
+  if (str == NULL) {
+    str = "";
+  }
+
+  authcache_put(buf, str, strlen(str) + 1);
+}
+
+static int authcache_take(struct authcache_buf *buf, void *data, size_t len) {
+  if (buf->len + len > buf->sz) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  memcpy(data, buf->ptr + buf->len, len);
+  buf->len += len;
+  return 0;
+}
+
+static char *authcache_take_str(pool *p, struct authcache_buf *buf) {
+  char *ptr, *end;
+
+  ptr = buf->ptr + buf->len;
+  end = memchr(ptr, '\0', buf->sz - buf->len);
+  if (end == NULL) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  buf->len += (end - ptr) + 1;
+  return pstrndup(p, ptr, end - ptr);
+}
+
+int pr_authcache_get_pwnam(pool *p, const char *name, struct passwd **pw,
+    const char **module_name) {
+  uint64_t buf[AUTHCACHE_SLOT_SIZE / sizeof(uint64_t)];
+  struct authcache_slot *slot;
+  struct authcache_buf data;
+  struct passwd *res;
+
+  if (p == NULL ||
+      name == NULL ||
+      pw == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  slot = authcache_get(PR_AUTHCACHE_TYPE_PWNAM, name, buf);
+  if (slot == NULL) {
+    return -1;
+  }
+
+  if (module_name != NULL) {
+    const char *mod_name;
+
+    mod_name = authcache_get_module_name(slot);
+    *module_name = mod_name != NULL ? pstrdup(p, mod_name) : NULL;
+  }
+
+  if (slot->as_found == 0) {
+    authcache_count(NULL, TRUE);
+    *pw = NULL;
+    return 0;
+  }
+
+  authcache_get_data(slot, &data);
+
+  res = pcalloc(p, sizeof(struct passwd));
+  if (authcache_take(&data, &(res->pw_uid), sizeof(uid_t)) < 0 ||
+      authcache_take(&data, &(res->pw_gid), sizeof(gid_t)) < 0 ||
+      (res->pw_name = authcache_take_str(p, &data)) == NULL ||
+      (res->pw_passwd = authcache_take_str(p, &data)) == NULL ||
+      (res->pw_gecos = authcache_take_str(p, &data)) == NULL ||
+      (res->pw_dir = authcache_take_str(p, &data)) == NULL ||
+      (res->pw_shell = authcache_take_str(p, &data)) == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  authcache_count(authcache_get_module_name(slot), TRUE);
+  *pw = res;
+  return 0;
+}
+
+int pr_authcache_add_pwnam(const char *name, const struct passwd *pw,
+    const char *module_name) {
+  char buf[AUTHCACHE_SLOT_SIZE];
+  struct authcache_buf data;
+
+  if (name == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (pw == NULL) {
+    return authcache_add(PR_AUTHCACHE_TYPE_PWNAM, name, FALSE, NULL, NULL);
+  }
+
+  data.ptr = buf;
+  data.len = 0;
+  data.sz = sizeof(buf);
+
+  authcache_put(&data, &(pw->pw_uid), sizeof(uid_t));
+  authcache_put(&data, &(pw->pw_gid), sizeof(gid_t));
+  authcache_put_str(&data, pw->pw_name);
+  /* Password hashes are not kept in memory which every session process,
+   * including those running as other users, can read; the modules check
+   * passwords using their own lookups anyway.
+   */
+  authcache_put_str(&data, "*");
+  authcache_put_str(&data, pw->pw_gecos);
+  authcache_put_str(&data, pw->pw_dir);
+  authcache_put_str(&data, pw->pw_shell);
+
+  return authcache_add(PR_AUTHCACHE_TYPE_PWNAM, name, TRUE, module_name,
+    &data);
+}
+
+int pr_authcache_get_grnam(pool *p, const char *name, struct group **gr,
+    const char **module_name) {
+  uint64_t buf[AUTHCACHE_SLOT_SIZE / sizeof(uint64_t)];
+  struct authcache_slot *slot;
+  struct authcache_buf data;
+  struct group *res;
+  uint32_t nmem, i;
+
+  if (p == NULL ||
+      name == NULL ||
+      gr == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  slot = authcache_get(PR_AUTHCACHE_TYPE_GRNAM, name, buf);
+  if (slot == NULL) {
+    return -1;
+  }
+
+  if (module_name != NULL) {
+    const char *mod_name;
+
+    mod_name = authcache_get_module_name(slot);
+    *module_name = mod_name != NULL ? pstrdup(p, mod_name) : NULL;
+  }
+
+  if (slot->as_found == 0) {
+    authcache_count(NULL, TRUE);
+    *gr = NULL;
+    return 0;
+  }
+
+  authcache_get_data(slot, &data);
+
+  res = pcalloc(p, sizeof(struct group));
+  if (authcache_take(&data, &(res->gr_gid), sizeof(gid_t)) < 0 ||
+      authcache_take(&data, &nmem, sizeof(nmem)) < 0 ||
+      nmem > AUTHCACHE_SLOT_DATASZ ||
+      (res->gr_name = authcache_take_str(p, &data)) == NULL ||
+      (res->gr_passwd = authcache_take_str(p, &data)) == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  res->gr_mem = pcalloc(p, sizeof(char *) * (nmem + 1));
+  for (i = 0; i < nmem; i++) {
+    res->gr_mem[i] = authcache_take_str(p, &data);
+    if (res->gr_mem[i] == NULL) {
+      errno = ENOENT;
+      return -1;
+    }
+  }
+
+  authcache_count(authcache_get_module_name(slot), TRUE);
+  *gr = res;
+  return 0;
+}
+
+int pr_authcache_add_grnam(const char *name, const struct group *gr,
+    const char *module_name) {
+  char buf[AUTHCACHE_SLOT_SIZE];
+  struct authcache_buf data;
+  uint32_t nmem = 0;
+
+  if (name == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (gr == NULL) {
+    return authcache_add(PR_AUTHCACHE_TYPE_GRNAM, name, FALSE, NULL, NULL);
+  }
+
+  data.ptr = buf;
+  data.len = 0;
+  data.sz = sizeof(buf);
+
+  if (gr->gr_mem != NULL) {
+    while (gr->gr_mem[nmem] != NULL) {
+      nmem++;
+    }
+  }
+
+  authcache_put(&data, &(gr->gr_gid), sizeof(gid_t));
+  authcache_put(&data, &nmem, sizeof(nmem));
+  authcache_put_str(&data, gr->gr_name);
+  authcache_put_str(&data, gr->gr_passwd);
+  if (nmem > 0) {
+    register unsigned int i;
+
+    for (i = 0; i < nmem; i++) {
+      authcache_put_str(&data, gr->gr_mem[i]);
+    }
+  }
+
+  return authcache_add(PR_AUTHCACHE_TYPE_GRNAM, name, TRUE, module_name,
+    &data);
+}
+
+int pr_authcache_get_groups(pool *p, const char *name, array_header *gids,
+    array_header *names, int *count, const char **module_name) {
+  uint64_t buf[AUTHCACHE_SLOT_SIZE / sizeof(uint64_t)];
+  struct authcache_slot *slot;
+  struct authcache_buf data;
+  int32_t res;
+  uint32_t ngids, nnames, i;
+  gid_t *cached_gids;
+  char **cached_names;
+
+  if (p == NULL ||
+      name == NULL ||
+      count == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  slot = authcache_get(PR_AUTHCACHE_TYPE_GROUPS, name, buf);
+  if (slot == NULL) {
+    return -1;
+  }
+
+  if (module_name != NULL) {
+    const char *mod_name;
+
+    mod_name = authcache_get_module_name(slot);
+    *module_name = mod_name != NULL ? pstrdup(p, mod_name) : NULL;
+  }
+
+  if (slot->as_found == 0) {
+    authcache_count(NULL, TRUE);
+    *count = -1;
+    return 0;
+  }
+
+  authcache_get_data(slot, &data);
+
+  /* Decode everything before touching the caller's arrays. */
+  if (authcache_take(&data, &res, sizeof(res)) < 0 ||
+      authcache_take(&data, &ngids, sizeof(ngids)) < 0 ||
+      authcache_take(&data, &nnames, sizeof(nnames)) < 0 ||
+      ngids > AUTHCACHE_SLOT_DATASZ ||
+      nnames > AUTHCACHE_SLOT_DATASZ) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  cached_gids = pcalloc(p, sizeof(gid_t) * (ngids + 1));
+  for (i = 0; i < ngids; i++) {
+    if (authcache_take(&data, &(cached_gids[i]), sizeof(gid_t)) < 0) {
+      return -1;
+    }
+  }
+
+  cached_names = pcalloc(p, sizeof(char *) * (nnames + 1));
+  for (i = 0; i < nnames; i++) {
+    cached_names[i] = authcache_take_str(names != NULL ? names->pool : p,
+      &data);
+    if (cached_names[i] == NULL) {
+      return -1;
+    }
+  }
+
+  if (gids != NULL) {
+    for (i = 0; i < ngids; i++) {
+      *((gid_t *) push_array(gids)) = cached_gids[i];
+    }
+  }
+
+  if (names != NULL) {
+    for (i = 0; i < nnames; i++) {
+      *((char **) push_array(names)) = cached_names[i];
+    }
+  }
+
+  authcache_count(authcache_get_module_name(slot), TRUE);
+  *count = (int) res;
+  return 0;
+}
+
+int pr_authcache_add_groups(const char *name, const array_header *gids,
+    const array_header *names, int count, const char *module_name) {
+  char buf[AUTHCACHE_SLOT_SIZE];
+  struct authcache_buf data;
+  int32_t res;
+  uint32_t ngids, nnames, i;
+
+  if (name == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (count < 0) {
+    return authcache_add(PR_AUTHCACHE_TYPE_GROUPS, name, FALSE, NULL, NULL);
+  }
+
+  /* Later lookups may want either list, so both are needed. */
+  if (gids == NULL ||
+      names == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  data.ptr = buf;
+  data.len = 0;
+  data.sz = sizeof(buf);
+
+  res = count;
+  ngids = gids->nelts;
+  nnames = names->nelts;
+
+  authcache_put(&data, &res, sizeof(res));
+  authcache_put(&data, &ngids, sizeof(ngids));
+  authcache_put(&data, &nnames, sizeof(nnames));
+
+  for (i = 0; i < ngids; i++) {
+    authcache_put(&data, &(((gid_t *) gids->elts)[i]), sizeof(gid_t));
+  }
+
+  for (i = 0; i < nnames; i++) {
+    authcache_put_str(&data, ((char **) names->elts)[i]);
+  }
+
+  return authcache_add(PR_AUTHCACHE_TYPE_GROUPS, name, TRUE, module_name,
+    &data);
+}
+
+int pr_authcache_remove(int type, const char *name) {
+#if defined(AUTHCACHE_BARRIER)
+  register unsigned int i;
+  size_t namelen;
+  time_t now;
+  int count = 0;
+
+  if (name == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (authcache_tab == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  namelen = strlen(name);
+  time(&now);
+
+  /* The name's results for each server, context, and type may be in any
+   * slot.
+   */
+  for (i = 0; i < authcache_tab->at_nslots; i++) {
+    struct authcache_slot *slot;
+    uint32_t gen;
+
+    slot = authcache_get_slot(i);
+
+    gen = slot->as_gen;
+    if (gen == 0 ||
+        (gen & 1) ||
+        !AUTHCACHE_ATOMIC_CAS(slot->as_gen, gen, gen + 1)) {
+      continue;
+    }
+
+    AUTHCACHE_BARRIER();
+    if ((type == 0 || slot->as_type == type) &&
+        slot->as_epoch == authcache_tab->at_epoch &&
+        (time_t) slot->as_expires > now &&
+        slot->as_namelen == namelen &&
+        memcmp(((char *) slot) + sizeof(struct authcache_slot), name,
+          namelen + 1) == 0) {
+      slot->as_expires = 0;
+      count++;
+    }
+
+    AUTHCACHE_BARRIER();
+    slot->as_gen = gen + 2;
+  }
+
+  pr_trace_msg(trace_channel, 15, "removed %d cached %s for '%s'", count,
+    count != 1 ? "results" : "result", name);
+  return count;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif /* !AUTHCACHE_BARRIER */
+}
+
+int pr_authcache_clear(void) {
+  if (authcache_tab == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+#if defined(AUTHCACHE_BARRIER)
+  AUTHCACHE_ATOMIC_INCR(authcache_tab->at_epoch);
+#endif /* AUTHCACHE_BARRIER */
+
+  return 0;
+}
+
+int pr_authcache_free(void) {
+  if (authcache_tab == NULL) {
+    return 0;
+  }
+
+  if (munmap((void *) authcache_tab, authcache_tabsz) < 0) {
+    int xerrno = errno;
+
+    pr_log_debug(DEBUG0, "error freeing auth cache: %s", strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  authcache_tab = NULL;
+  authcache_tabsz = 0;
+  authcache_slots = NULL;
+
+  return 0;
+}
+
+int pr_authcache_init(size_t size, time_t ttl, time_t negative_ttl) {
+  void *data;
+  int mmap_flags;
+  uint32_t nslots;
+  size_t tabsz;
+
+  if (size < AUTHCACHE_MIN_SIZE ||
+      ttl <= 0 ||
+      negative_ttl < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  (void) pr_authcache_free();
+
+#if !defined(AUTHCACHE_BARRIER)
+  pr_log_debug(DEBUG0, "atomic operations not supported, not caching "
+    "authentication lookups");
+  errno = ENOSYS;
+  return -1;
+#endif /* AUTHCACHE_BARRIER */
+
+  mmap_flags = MAP_SHARED;
+#if defined(MAP_ANONYMOUS)
+  mmap_flags |= MAP_ANONYMOUS;
+#elif defined(MAP_ANON)
+  mmap_flags |= MAP_ANON;
+#else
+  pr_log_debug(DEBUG0, "mmap(2) MAP_ANONYMOUS and MAP_ANON flags not defined, "
+    "not caching authentication lookups");
+  errno = ENOSYS;
+  return -1;
+#endif
+
+  nslots = size / AUTHCACHE_SLOT_SIZE;
+  if (nslots < AUTHCACHE_MIN_NSLOTS) {
+    nslots = AUTHCACHE_MIN_NSLOTS;
+  }
+
+  tabsz = sizeof(struct authcache_table) +
+    ((size_t) nslots * AUTHCACHE_SLOT_SIZE);
+
+  data = mmap(NULL, tabsz, PROT_READ|PROT_WRITE, mmap_flags, -1, 0);
+  if (data == MAP_FAILED) {
+    int xerrno = errno;
+
+    pr_log_debug(DEBUG0, "error allocating %lu bytes for auth cache: %s",
+      (unsigned long) tabsz, strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  /* Anonymous mappings are already zeroed. */
+  authcache_tab = data;
+  authcache_tabsz = tabsz;
+  authcache_tab->at_epoch = 1;
+  authcache_tab->at_nslots = nslots;
+  authcache_tab->at_ttl = (int64_t) ttl;
+  authcache_tab->at_negative_ttl = (int64_t) negative_ttl;
+
+  authcache_slots = ((char *) data) + sizeof(struct authcache_table);
+
+  pr_trace_msg(trace_channel, 9, "allocated auth cache of %lu bytes "
+    "(%lu slots)", (unsigned long) tabsz, (unsigned long) nslots);
+  return 0;
+}
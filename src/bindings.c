@@ -45,7 +45,7 @@ static void server_cleanup_cb(void *conn) {
 /* The hashing function for the hash table of bindings.  This algorithm
  * is stolen from Apache's http_vhost.c
  */
-static unsigned int ipbind_hash_addr(const pr_netaddr_t *addr) {
+static unsigned int ipbind_addr_key(const pr_netaddr_t *addr) {
   size_t offset;
   unsigned int key;
 
@@ -58,7 +58,405 @@ static unsigned int ipbind_hash_addr(const pr_netaddr_t *addr) {
   key = *(unsigned *) ((char *) pr_netaddr_get_inaddr(addr) + offset - 4);
 
   key ^= (key >> 16);
-  return ((key >> 8) ^ key) % PR_BINDINGS_TABLE_SIZE;
+  return (key >> 8) ^ key;
+}
+
+static unsigned int ipbind_hash_addr(const pr_netaddr_t *addr) {
+  return ipbind_addr_key(addr) % PR_BINDINGS_TABLE_SIZE;
+}
+
+/* The address table above chains every binding for the same address
+ * together, which makes finding the binding for a given address and port
+ * linear in the number of ports bound on that address; with thousands of
+ * port-based <VirtualHost>s on one address, creating the bindings becomes
+ * quadratic.  Bindings are thus also indexed by address and port, in a
+ * table which grows with the number of bindings.
+ */
+#define IPBIND_PORT_INIT_NBUCKETS	256
+
+static pr_ipbind_t **ipbind_port_table = NULL;
+static unsigned int ipbind_port_nbuckets = 0, ipbind_count = 0;
+
+/* Number of bindings with a port of zero, i.e. bound to all ports for their
+ * address.
+ */
+static unsigned int ipbind_wildport_count = 0;
+
+static unsigned int ipbind_hash_addr_port(const pr_netaddr_t *addr,
+    unsigned int port) {
+  return ipbind_addr_key(addr) ^ (port * 2654435761U);
+}
+
+static void ipbind_port_table_add(pr_ipbind_t *ipbind) {
+  unsigned int idx;
+
+  if (ipbind_count >= ipbind_port_nbuckets) {
+    register unsigned int i;
+    pr_ipbind_t **buckets;
+    unsigned int nbuckets;
+
+    /* The old bucket array is left to the pool. */
+    nbuckets = ipbind_port_nbuckets ? ipbind_port_nbuckets * 2 :
+      IPBIND_PORT_INIT_NBUCKETS;
+    buckets = pcalloc(binding_pool, nbuckets * sizeof(pr_ipbind_t *));
+
+    for (i = 0; i < ipbind_port_nbuckets; i++) {
+      pr_ipbind_t *ib, *next;
+
+      for (ib = ipbind_port_table[i]; ib; ib = next) {
+        next = ib->ib_port_next;
+
+        idx = ipbind_hash_addr_port(ib->ib_addr, ib->ib_port) & (nbuckets - 1);
+        ib->ib_port_next = buckets[idx];
+        buckets[idx] = ib;
+      }
+    }
+
+    ipbind_port_table = buckets;
+    ipbind_port_nbuckets = nbuckets;
+  }
+
+  idx = ipbind_hash_addr_port(ipbind->ib_addr, ipbind->ib_port) &
+    (ipbind_port_nbuckets - 1);
+  ipbind->ib_port_next = ipbind_port_table[idx];
+  ipbind_port_table[idx] = ipbind;
+
+  ipbind_count++;
+  if (ipbind->ib_port == 0) {
+    ipbind_wildport_count++;
+  }
+}
+
+/* Returns the most recently created binding for exactly this address and
+ * port, if any.
+ */
+static pr_ipbind_t *ipbind_port_table_get(const pr_netaddr_t *addr,
+    unsigned int port) {
+  pr_ipbind_t *ipbind;
+  unsigned int idx;
+
+  if (ipbind_port_nbuckets == 0) {
+    return NULL;
+  }
+
+  idx = ipbind_hash_addr_port(addr, port) & (ipbind_port_nbuckets - 1);
+  for (ipbind = ipbind_port_table[idx]; ipbind; ipbind = ipbind->ib_port_next) {
+    if (ipbind->ib_port == port &&
+        pr_netaddr_cmp(ipbind->ib_addr, addr) == 0) {
+      return ipbind;
+    }
+  }
+
+  return NULL;
+}
+
+/* Name-based binding indexes.
+ *
+ * Every namebind name is stored in a hash table, keyed case-insensitively.
+ * Names which are globs are also stored in a trie, keyed by the literal
+ * DNS labels at the end of the pattern, in reverse order (e.g. "com",
+ * then "example", for "*.example.com").  Any name matched by a pattern
+ * necessarily ends in those labels, so looking up a name only needs to
+ * pr_fnmatch() the patterns found along that name's path through the trie.
+ *
+ * The trie edges are themselves kept in a hash table, keyed by the parent
+ * node and the label, so that nodes with many children (e.g. "com") do not
+ * need to be scanned.
+ */
+
+#define NAMEBIND_HASH_INIT_NBUCKETS	16
+
+/* Maximum depth of the trie walked on lookup; DNS names have at most 127
+ * labels.
+ */
+#define NAMEBIND_MAX_LABELS		128
+
+struct namebind_hent {
+  struct namebind_hent *next;
+  const void *parent;
+  const char *key;
+  size_t keylen;
+  unsigned int hash;
+  void *value;
+};
+
+struct namebind_hash {
+  struct namebind_hent **buckets;
+  unsigned int nbuckets;
+  unsigned int nents;
+};
+
+struct namebind_node {
+  /* Wildcard namebinds whose literal suffix ends at this node, in
+   * configuration order.
+   */
+  array_header *patterns;
+};
+
+struct namebind_index_rec {
+  struct namebind_hash names;
+  struct namebind_hash edges;
+  struct namebind_node root;
+};
+
+static unsigned int namebind_hash_key(const void *parent, const char *key,
+    size_t keylen) {
+  register unsigned int i;
+  unsigned int h;
+
+  h = (unsigned int) (((unsigned long) parent) >> 3);
+  for (i = 0; i < keylen; i++) {
+    h = (h * 33) + tolower((int) key[i]);
+  }
+
+  return h;
+}
+
+static struct namebind_hent *namebind_hash_get(struct namebind_hash *h,
+    const void *parent, const char *key, size_t keylen) {
+  struct namebind_hent *ent;
+  unsigned int hash;
+
+  if (h->nbuckets == 0) {
+    return NULL;
+  }
+
+  hash = namebind_hash_key(parent, key, keylen);
+  for (ent = h->buckets[hash & (h->nbuckets - 1)]; ent; ent = ent->next) {
+    if (ent->hash == hash &&
+        ent->parent == parent &&
+        ent->keylen == keylen &&
+        strncasecmp(ent->key, key, keylen) == 0) {
+      return ent;
+    }
+  }
+
+  return NULL;
+}
+
+static void namebind_hash_add(pool *p, struct namebind_hash *h,
+    const void *parent, const char *key, size_t keylen, void *value) {
+  struct namebind_hent *ent;
+  unsigned int idx;
+
+  if (h->nents >= h->nbuckets) {
+    register unsigned int i;
+    struct namebind_hent **buckets;
+    unsigned int nbuckets;
+
+    /* Grow the table, keeping the load factor at most one.  The old bucket
+     * array is left to the pool.
+     */
+    nbuckets = h->nbuckets ? h->nbuckets * 2 : NAMEBIND_HASH_INIT_NBUCKETS;
+    buckets = pcalloc(p, nbuckets * sizeof(struct namebind_hent *));
+
+    for (i = 0; i < h->nbuckets; i++) {
+      struct namebind_hent *next;
+
+      for (ent = h->buckets[i]; ent; ent = next) {
+        next = ent->next;
+
+        idx = ent->hash & (nbuckets - 1);
+        ent->next = buckets[idx];
+        buckets[idx] = ent;
+      }
+    }
+
+    h->buckets = buckets;
+    h->nbuckets = nbuckets;
+  }
+
+  ent = pcalloc(p, sizeof(struct namebind_hent));
+  ent->parent = parent;
+  ent->key = key;
+  ent->keylen = keylen;
+  ent->hash = namebind_hash_key(parent, key, keylen);
+  ent->value = value;
+
+  idx = ent->hash & (h->nbuckets - 1);
+  ent->next = h->buckets[idx];
+  h->buckets[idx] = ent;
+  h->nents++;
+}
+
+/* Returns the literal DNS suffix of the given glob pattern, i.e. the labels
+ * following the last glob character, or NULL if there is no such suffix.
+ */
+static const char *namebind_get_suffix(const char *pattern) {
+  const char *ptr, *last = NULL;
+
+  for (ptr = pattern; *ptr; ptr++) {
+    if (*ptr == '*' ||
+        *ptr == '?' ||
+        *ptr == '[' ||
+        *ptr == ']') {
+      last = ptr;
+    }
+  }
+
+  if (last == NULL) {
+    return pattern;
+  }
+
+  ptr = strchr(last, '.');
+  if (ptr == NULL ||
+      *(ptr + 1) == '\0') {
+    return NULL;
+  }
+
+  return ptr + 1;
+}
+
+static void namebind_index_add(pr_ipbind_t *ipbind, pr_namebind_t *namebind) {
+  struct namebind_index_rec *idx;
+  struct namebind_node *node;
+  const char *suffix;
+
+  idx = ipbind->ib_namebind_index;
+  if (idx == NULL) {
+    idx = pcalloc(binding_pool, sizeof(struct namebind_index_rec));
+    ipbind->ib_namebind_index = idx;
+  }
+
+  namebind_hash_add(binding_pool, &(idx->names), NULL, namebind->nb_name,
+    strlen(namebind->nb_name), namebind);
+
+  if (namebind->nb_iswildcard == FALSE) {
+    return;
+  }
+
+  node = &(idx->root);
+
+  suffix = namebind_get_suffix(namebind->nb_name);
+  if (suffix != NULL) {
+    const char *label, *end;
+
+    end = suffix + strlen(suffix);
+    label = end;
+
+    while (TRUE) {
+      struct namebind_hent *ent;
+
+      while (label > suffix &&
+             *(label - 1) != '.') {
+        label--;
+      }
+
+      ent = namebind_hash_get(&(idx->edges), node, label, end - label);
+      if (ent == NULL) {
+        struct namebind_node *child;
+
+        child = pcalloc(binding_pool, sizeof(struct namebind_node));
+        namebind_hash_add(binding_pool, &(idx->edges), node, label,
+          end - label, child);
+        node = child;
+
+      } else {
+        node = ent->value;
+      }
+
+      if (label == suffix) {
+        break;
+      }
+
+      end = label = label - 1;
+    }
+  }
+
+  if (node->patterns == NULL) {
+    node->patterns = make_array(binding_pool, 1, sizeof(pr_namebind_t *));
+  }
+
+  *((pr_namebind_t **) push_array(node->patterns)) = namebind;
+}
+
+static pr_namebind_t *namebind_index_find(struct namebind_index_rec *idx,
+    const char *name, unsigned char skip_inactive) {
+  struct namebind_hent *ent;
+  struct namebind_node *path[NAMEBIND_MAX_LABELS];
+  const char *label, *end;
+  unsigned int depth = 0;
+
+  ent = namebind_hash_get(&(idx->names), NULL, name, strlen(name));
+  if (ent != NULL) {
+    pr_namebind_t *namebind;
+
+    namebind = ent->value;
+    if (skip_inactive == FALSE ||
+        namebind->nb_isactive == TRUE) {
+      pr_trace_msg(trace_channel, 17, "found namebind '%s' for name '%s'",
+        namebind->nb_name, name);
+      return namebind;
+    }
+
+    pr_trace_msg(trace_channel, 17, "namebind '%s' is inactive, skipping",
+      namebind->nb_name);
+  }
+
+  /* Collect the trie nodes along this name's path, from least to most
+   * specific.
+   */
+  path[depth++] = &(idx->root);
+
+  end = label = name + strlen(name);
+  while (depth < NAMEBIND_MAX_LABELS) {
+    while (label > name &&
+           *(label - 1) != '.') {
+      label--;
+    }
+
+    ent = namebind_hash_get(&(idx->edges), path[depth-1], label, end - label);
+    if (ent == NULL) {
+      break;
+    }
+
+    path[depth++] = ent->value;
+
+    if (label == name) {
+      break;
+    }
+
+    end = label = label - 1;
+  }
+
+  while (depth > 0) {
+    struct namebind_node *node;
+
+    node = path[--depth];
+    if (node->patterns != NULL) {
+      register unsigned int i;
+      pr_namebind_t **namebinds;
+      int match_flags = PR_FNM_NOESCAPE|PR_FNM_CASEFOLD;
+
+      namebinds = node->patterns->elts;
+      for (i = 0; i < node->patterns->nelts; i++) {
+        pr_namebind_t *namebind;
+
+        namebind = namebinds[i];
+
+        /* Skip inactive namebinds */
+        if (skip_inactive == TRUE &&
+            namebind->nb_isactive == FALSE) {
+          pr_trace_msg(trace_channel, 17,
+            "namebind '%s' is inactive, skipping", namebind->nb_name);
+          continue;
+        }
+
+        if (pr_fnmatch(namebind->nb_name, name, match_flags) == 0) {
+          pr_trace_msg(trace_channel, 9,
+            "matched name '%s' against pattern '%s'", name,
+            namebind->nb_name);
+          return namebind;
+        }
+
+        pr_trace_msg(trace_channel, 9,
+          "failed to match name '%s' against pattern '%s'", name,
+          namebind->nb_name);
+      }
+    }
+  }
+
+  return NULL;
 }
 
 static pool *listening_conn_pool = NULL;
@@ -71,8 +469,55 @@ struct listener_rec {
   unsigned int port;
   conn_t *conn;
   int claimed;
+
+  /* Index chain holding this listener, and the next listener in that
+   * chain.
+   */
+  unsigned int index_bucket;
+  struct listener_rec *index_next;
 };
 
+/* The listening conns are also chained by address and port, so that finding
+ * the conn for a <VirtualHost> does not scan every other listener (e.g. with
+ * SocketBindTight on, where many addresses share the same port).  Within a
+ * chain, listeners are kept in the same (most recent first) order as in the
+ * list.
+ */
+#define LISTENING_CONN_INDEX_SIZE	1024
+static struct listener_rec *listening_conn_index[LISTENING_CONN_INDEX_SIZE];
+
+/* Set when only checking the configuration, e.g. for `proftpd -t`: the
+ * bindings are set up, but no listening conns are created.
+ */
+static int bindings_check_only = FALSE;
+
+static unsigned int listening_conn_index_bucket(const char *ipstr,
+    unsigned int port) {
+  const unsigned char *ptr;
+  unsigned int h = port;
+
+  if (ipstr != NULL) {
+    for (ptr = (const unsigned char *) ipstr; *ptr; ptr++) {
+      h = (h * 33) + *ptr;
+    }
+  }
+
+  return h % LISTENING_CONN_INDEX_SIZE;
+}
+
+static void listening_conn_index_remove(struct listener_rec *lr) {
+  struct listener_rec **lrp;
+
+  for (lrp = &(listening_conn_index[lr->index_bucket]); *lrp != NULL;
+       lrp = &((*lrp)->index_next)) {
+    if (*lrp == lr) {
+      *lrp = lr->index_next;
+      lr->index_next = NULL;
+      break;
+    }
+  }
+}
+
 conn_t *pr_ipbind_get_listening_conn(server_rec *server,
     const pr_netaddr_t *addr, unsigned int port) {
   conn_t *l;
@@ -80,8 +525,12 @@ conn_t *pr_ipbind_get_listening_conn(server_rec *server,
   struct listener_rec *lr;
 
   if (listening_conn_list) {
-    for (lr = (struct listener_rec *) listening_conn_list->xas_list; lr;
-        lr = lr->next) {
+    unsigned int bucket;
+
+    bucket = listening_conn_index_bucket(
+      addr != NULL ? pr_netaddr_get_ipstr(addr) : NULL, port);
+
+    for (lr = listening_conn_index[bucket]; lr; lr = lr->index_next) {
       int use_elt = FALSE;
 
       pr_signals_handle();
@@ -155,6 +604,27 @@ conn_t *pr_ipbind_get_listening_conn(server_rec *server,
   lr->claimed = TRUE;
 
   xaset_insert(listening_conn_list, (xasetmember_t *) lr);
+
+  /* Index the listener by the same address string used when looking it up;
+   * see above.
+   */
+  if (lr->addr != NULL) {
+    const char *ipstr;
+
+    ipstr = pr_netaddr_get_ipstr(lr->addr);
+    if (ipstr == NULL) {
+      ipstr = pr_netaddr_get_ipstr(l->local_addr);
+    }
+
+    lr->index_bucket = listening_conn_index_bucket(ipstr, port);
+
+  } else {
+    lr->index_bucket = listening_conn_index_bucket(NULL, port);
+  }
+
+  lr->index_next = listening_conn_index[lr->index_bucket];
+  listening_conn_index[lr->index_bucket] = lr;
+
   return l;
 }
 
@@ -426,18 +896,16 @@ int pr_ipbind_create(server_rec *server, const pr_netaddr_t *addr,
   i = ipbind_hash_addr(addr);
 
   /* Make sure the address is not already in use */
-  for (ipbind = ipbind_table[i]; ipbind; ipbind = ipbind->ib_next) {
-    if (pr_netaddr_cmp(ipbind->ib_addr, addr) == 0 &&
-        ipbind->ib_port == port) {
+  ipbind = ipbind_port_table_get(addr, port);
+  if (ipbind != NULL) {
 
-      /* An ipbind already exists for this IP address */
-      pr_log_pri(PR_LOG_WARNING, "notice: '%s' (%s:%u) already bound to '%s'",
-        server->ServerName, pr_netaddr_get_ipstr(addr), port,
-        ipbind->ib_server->ServerName);
+    /* An ipbind already exists for this IP address */
+    pr_log_pri(PR_LOG_WARNING, "notice: '%s' (%s:%u) already bound to '%s'",
+      server->ServerName, pr_netaddr_get_ipstr(addr), port,
+      ipbind->ib_server->ServerName);
 
-      errno = EADDRINUSE;
-      return -1;
-    }
+    errno = EADDRINUSE;
+    return -1;
   }
 
   if (!binding_pool) {
@@ -450,6 +918,7 @@ int pr_ipbind_create(server_rec *server, const pr_netaddr_t *addr,
   ipbind->ib_addr = addr;
   ipbind->ib_port = port;
   ipbind->ib_namebinds = NULL;
+  ipbind->ib_namebind_index = NULL;
   ipbind->ib_isdefault = FALSE;
   ipbind->ib_islocalhost = FALSE;
   ipbind->ib_isactive = FALSE;
@@ -463,6 +932,8 @@ int pr_ipbind_create(server_rec *server, const pr_netaddr_t *addr,
   }
 
   ipbind_table[i] = ipbind;
+  ipbind_port_table_add(ipbind);
+
   return 0;
 }
 
@@ -514,6 +985,22 @@ pr_ipbind_t *pr_ipbind_find(const pr_netaddr_t *addr, unsigned int port,
     return NULL;
   }
 
+  if (port != 0) {
+    /* A binding for exactly this address and port takes precedence over
+     * one bound to all ports on the address.
+     */
+    ipbind = ipbind_port_table_get(addr, port);
+    if (ipbind != NULL &&
+        (!skip_inactive || ipbind->ib_isactive)) {
+      return ipbind;
+    }
+
+    if (ipbind_wildport_count == 0) {
+      errno = ENOENT;
+      return NULL;
+    }
+  }
+
   i = ipbind_hash_addr(addr);
 
   for (ipbind = ipbind_table[i]; ipbind; ipbind = ipbind->ib_next) {
@@ -838,7 +1325,7 @@ int pr_namebind_close(const char *name, const pr_netaddr_t *addr) {
 int pr_namebind_create(server_rec *server, const char *name,
     const pr_netaddr_t *addr, unsigned int server_port) {
   pr_ipbind_t *ipbind = NULL;
-  pr_namebind_t *namebind = NULL, **namebinds = NULL;
+  pr_namebind_t *namebind = NULL;
   unsigned int port;
 
   if (server == NULL ||
@@ -894,31 +1381,21 @@ int pr_namebind_create(server_rec *server, const char *name,
   }
 
   /* Make sure we can add this namebind. */
-  if (!ipbind->ib_namebinds) {
+  if (ipbind->ib_namebinds == NULL) {
     ipbind->ib_namebinds = make_array(binding_pool, 0, sizeof(pr_namebind_t *));
 
   } else {
-    register unsigned int i = 0;
-    namebinds = (pr_namebind_t **) ipbind->ib_namebinds->elts;
-
-    /* See if there is already a namebind for the given name. */
-    for (i = 0; i < ipbind->ib_namebinds->nelts; i++) {
-      namebind = namebinds[i];
-      if (namebind != NULL &&
-          namebind->nb_name != NULL) {
-
-        /* DNS names are case-insensitive, hence the case-insensitive check
-         * here.
-         *
-         * XXX Ideally, we should check whether any existing namebinds which
-         * are globs will match the newly added namebind as well.
-         */
-
-        if (strcasecmp(namebind->nb_name, name) == 0) {
-          errno = EEXIST;
-          return -1;
-        }
-      }
+    /* See if there is already a namebind for the given name.  DNS names are
+     * case-insensitive, hence the index lookups are case-insensitive.
+     *
+     * XXX Ideally, we should check whether any existing namebinds which
+     * are globs will match the newly added namebind as well.
+     */
+    if (ipbind->ib_namebind_index != NULL &&
+        namebind_hash_get(&(ipbind->ib_namebind_index->names), NULL, name,
+          strlen(name)) != NULL) {
+      errno = EEXIST;
+      return -1;
     }
   }
 
@@ -972,6 +1449,8 @@ int pr_namebind_create(server_rec *server, const char *name,
 #endif
 
   *((pr_namebind_t **) push_array(ipbind->ib_namebinds)) = namebind;
+  namebind_index_add(ipbind, namebind);
+
   return 0;
 }
 
@@ -1024,69 +1503,26 @@ pr_namebind_t *pr_namebind_find(const char *name, const pr_netaddr_t *addr,
     return NULL;
   }
 
-  if (ipbind->ib_namebinds == NULL) {
+  if (ipbind->ib_namebinds == NULL ||
+      ipbind->ib_namebind_index == NULL) {
     pr_trace_msg(trace_channel, 17,
       "ipbind %p (server %p) for %s#%u has no namebinds", ipbind,
       ipbind->ib_server, pr_netaddr_get_ipstr(addr), port);
     return NULL;
+  }
 
-  } else {
-    register unsigned int i = 0;
-    pr_namebind_t **namebinds = (pr_namebind_t **) ipbind->ib_namebinds->elts;
-
-    pr_trace_msg(trace_channel, 17,
-      "ipbind %p (server %p) for %s#%u has namebinds (%d)", ipbind,
-      ipbind->ib_server, pr_netaddr_get_ipstr(addr), port,
-      ipbind->ib_namebinds->nelts);
-
-    for (i = 0; i < ipbind->ib_namebinds->nelts; i++) {
-      namebind = namebinds[i];
-      if (namebind == NULL) {
-        continue;
-      }
-
-      /* Skip inactive namebinds */
-      if (skip_inactive == TRUE &&
-          namebind->nb_isactive == FALSE) {
-        pr_trace_msg(trace_channel, 17,
-          "namebind #%u: %s is inactive, skipping", i, namebind->nb_name);
-        continue;
-      }
-
-      /* At present, this looks for an exactly matching name.  In the future,
-       * we may want to have something like Apache's matching scheme, which
-       * looks for the most specific domain to the most general.  Note that
-       * that scheme, however, is specific to DNS; should any other naming
-       * scheme be desired, that sort of matching will be unnecessary.
-       */
-      if (namebind->nb_name != NULL) {
-        pr_trace_msg(trace_channel, 17,
-          "namebind #%u: %s", i, namebind->nb_name);
-
-        if (namebind->nb_iswildcard == FALSE) {
-          if (strcasecmp(namebind->nb_name, name) == 0) {
-            return namebind;
-          }
-
-        } else {
-          int match_flags = PR_FNM_NOESCAPE|PR_FNM_CASEFOLD;
-
-          if (pr_fnmatch(namebind->nb_name, name, match_flags) == 0) {
-            pr_trace_msg(trace_channel, 9,
-              "matched name '%s' against pattern '%s'", name,
-              namebind->nb_name);
-            return namebind;
-          }
+  pr_trace_msg(trace_channel, 17,
+    "ipbind %p (server %p) for %s#%u has namebinds (%d)", ipbind,
+    ipbind->ib_server, pr_netaddr_get_ipstr(addr), port,
+    ipbind->ib_namebinds->nelts);
 
-          pr_trace_msg(trace_channel, 9,
-            "failed to match name '%s' against pattern '%s'", name,
-            namebind->nb_name);
-        }
-      }
-    }
+  namebind = namebind_index_find(ipbind->ib_namebind_index, name,
+    skip_inactive);
+  if (namebind == NULL) {
+    errno = ENOENT;
   }
 
-  return NULL;
+  return namebind;
 }
 
 server_rec *pr_namebind_get_server(const char *name, const pr_netaddr_t *addr,
@@ -1149,6 +1585,8 @@ void free_bindings(void) {
   }
 
   memset(ipbind_table, 0, sizeof(ipbind_table));
+  ipbind_port_table = NULL;
+  ipbind_port_nbuckets = ipbind_count = ipbind_wildport_count = 0;
 
   /* Mark all listening conns as "unclaimed"; any that remaining unclaimed
    * after init_bindings() can be closed.
@@ -1270,10 +1708,15 @@ static int init_standalone_bindings(void) {
 #endif /* PR_USE_IPV6 */
     }
 
-    main_server->listen = pr_ipbind_get_listening_conn(main_server,
-      (SocketBindTight ? main_server->addr : NULL), main_server->ServerPort);
-    if (main_server->listen == NULL) {
-      return -1;
+    if (bindings_check_only == FALSE) {
+      main_server->listen = pr_ipbind_get_listening_conn(main_server,
+        (SocketBindTight ? main_server->addr : NULL), main_server->ServerPort);
+      if (main_server->listen == NULL) {
+        return -1;
+      }
+
+    } else {
+      main_server->listen = NULL;
     }
 
   } else {
@@ -1355,10 +1798,15 @@ static int init_standalone_bindings(void) {
 #endif /* PR_USE_IPV6 */
         }
 
-        serv->listen = pr_ipbind_get_listening_conn(serv,
-          (SocketBindTight ? serv->addr : NULL), serv->ServerPort);
-        if (serv->listen == NULL) {
-          return -1;
+        if (bindings_check_only == FALSE) {
+          serv->listen = pr_ipbind_get_listening_conn(serv,
+            (SocketBindTight ? serv->addr : NULL), serv->ServerPort);
+          if (serv->listen == NULL) {
+            return -1;
+          }
+
+        } else {
+          serv->listen = NULL;
         }
 
         PR_CREATE_IPBIND(serv, serv->addr, serv->ServerPort);
@@ -1411,6 +1859,7 @@ static int init_standalone_bindings(void) {
 
       if (!lr->claimed) {
         xaset_remove(listening_conn_list, (xasetmember_t *) lr);
+        listening_conn_index_remove(lr);
         destroy_pool(lr->pool);
       }
     }
@@ -1435,7 +1884,10 @@ void init_bindings(void) {
   }
 #endif /* PR_USE_IPV6 */
 
-  if (ServerType == SERVER_INETD) {
+  if (bindings_check_only == TRUE) {
+    res = init_standalone_bindings();
+
+  } else if (ServerType == SERVER_INETD) {
     res = init_inetd_bindings();
 
   } else if (ServerType == SERVER_STANDALONE) {
@@ -1449,3 +1901,9 @@ void init_bindings(void) {
   }
 }
 
+void init_bindings_check(void) {
+  bindings_check_only = TRUE;
+  init_bindings();
+  bindings_check_only = FALSE;
+}
+
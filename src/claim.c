@@ -0,0 +1,178 @@
+/*
+ * ProFTPD - FTP server daemon
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project and other respective copyright
+ * holders give permission to link this program with OpenSSL, and distribute
+ * the resulting executable, without including the source code for OpenSSL in
+ * the source distribution.
+ */
+
+/* Claims on entries in memory shared between processes */
+
+#include "conf.h"
+
+#if defined(__GNUC__)
+# define CLAIM_ATOMIC_CAS(v, o, n)	__sync_bool_compare_and_swap(&(v), (o), (n))
+# define CLAIM_BARRIER()		__sync_synchronize()
+#else
+/* Without atomic operations, two processes may occasionally both claim an
+ * entry.
+ */
+# define CLAIM_ATOMIC_CAS(v, o, n)	((v) == (o) ? ((v) = (n), TRUE) : FALSE)
+# define CLAIM_BARRIER()
+#endif
+
+/* Filling in an entry takes well under a microsecond, so the claim is
+ * checked this many times before anything more expensive is done; after
+ * that, whether the claim is stale is checked, and the waiting process
+ * sleeps for CLAIM_WAIT_USECS between checks.  A claiming process which
+ * was merely preempted thus gets all of the time it needs.
+ */
+#define CLAIM_MAX_SPINS			1000
+#define CLAIM_WAIT_USECS		100
+
+static const char *trace_channel = "claim";
+
+int pr_claim_acquire(pr_claim_t *claim, uint32_t state) {
+  if (claim == NULL ||
+      (state != PR_CLAIM_EMPTY &&
+       state != PR_CLAIM_READY)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (claim->state != state) {
+    errno = EBUSY;
+    return -1;
+  }
+
+  /* The time is set before the claim is made, so that anyone seeing the
+   * claim also sees when it was made.  Losing processes set it as well,
+   * to the same time, give or take.
+   */
+  claim->claimed = (uint32_t) time(NULL);
+
+  if (!CLAIM_ATOMIC_CAS(claim->state, state, (uint32_t) getpid())) {
+    errno = EBUSY;
+    return -1;
+  }
+
+  return 0;
+}
+
+void pr_claim_release(pr_claim_t *claim) {
+  uint32_t pid;
+
+  if (claim == NULL) {
+    return;
+  }
+
+  /* Make sure that everything filled in for the entry is seen before the
+   * entry is marked ready.
+   */
+  CLAIM_BARRIER();
+
+  pid = (uint32_t) getpid();
+  if (!CLAIM_ATOMIC_CAS(claim->state, pid, PR_CLAIM_READY)) {
+    pr_trace_msg(trace_channel, 3, "claim by PID %lu taken over by PID %lu "
+      "before being released", (unsigned long) pid,
+      (unsigned long) claim->state);
+  }
+}
+
+int pr_claim_is_ready(pr_claim_t *claim) {
+  if (claim == NULL ||
+      claim->state != PR_CLAIM_READY) {
+    return FALSE;
+  }
+
+  /* Make sure that the entry's contents are read only after its state. */
+  CLAIM_BARRIER();
+  return TRUE;
+}
+
+/* A claim is stale if the claiming process no longer exists, or has held it
+ * for too long.  A claiming process which runs as another user cannot be
+ * signalled (EPERM), but does exist.
+ */
+static int claim_is_stale(uint32_t pid, uint32_t claimed) {
+  int32_t held;
+
+  if (kill((pid_t) pid, 0) < 0 &&
+      errno == ESRCH) {
+    return TRUE;
+  }
+
+  held = (int32_t) ((uint32_t) time(NULL) - claimed);
+  if (held > PR_CLAIM_STALE_SECS ||
+      held < -PR_CLAIM_STALE_SECS) {
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+int pr_claim_wait(pr_claim_t *claim) {
+  unsigned int spins = 0;
+
+  if (claim == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  while (TRUE) {
+    uint32_t pid, claimed;
+
+    CLAIM_BARRIER();
+    pid = claim->state;
+
+    if (pid == PR_CLAIM_READY) {
+      CLAIM_BARRIER();
+      return 0;
+    }
+
+    if (pid == PR_CLAIM_EMPTY) {
+      if (pr_claim_acquire(claim, PR_CLAIM_EMPTY) == 0) {
+        return PR_CLAIM_TAKEN;
+      }
+
+      continue;
+    }
+
+    spins++;
+    if (spins < CLAIM_MAX_SPINS) {
+      continue;
+    }
+
+    claimed = claim->claimed;
+    if (claim_is_stale(pid, claimed)) {
+      claim->claimed = (uint32_t) time(NULL);
+
+      if (CLAIM_ATOMIC_CAS(claim->state, pid, (uint32_t) getpid())) {
+        pr_trace_msg(trace_channel, 3, "took over stale claim by PID %lu "
+          "(held for %ld secs)", (unsigned long) pid,
+          (long) ((uint32_t) time(NULL) - claimed));
+        return PR_CLAIM_TAKEN;
+      }
+
+      continue;
+    }
+
+    (void) pr_timer_usleep(CLAIM_WAIT_USECS);
+  }
+}
@@ -1059,6 +1059,11 @@ static void poll_ctrl(void) {
           pr_proctitle_set_str(title_buf);
         }
 
+        /* Any responses left pending by the dispatched command (e.g. the 426
+         * added by ABOR) are allocated from its pool, about to be destroyed.
+         */
+        resp_list = resp_err_list = NULL;
+
         destroy_pool(cmd->pool);
       }
 
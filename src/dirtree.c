@@ -2501,8 +2501,11 @@ void fixup_dirs(server_rec *s, int flags) {
 int fixup_servers(xaset_t *list) {
   config_rec *c = NULL;
   server_rec *s = NULL, *next_s = NULL;
+  uint64_t start_ms = 0, globals_ms = 0, dirs_ms = 0, end_ms = 0;
 
+  pr_gettimeofday_millis(&start_ms);
   fixup_globals(list);
+  pr_gettimeofday_millis(&globals_ms);
 
   s = (server_rec *) list->xas_list;
   if (s && !s->ServerName)
@@ -2510,6 +2513,7 @@ int fixup_servers(xaset_t *list) {
 
   for (; s; s = next_s) {
     unsigned char *default_server = NULL;
+    uint64_t dirs_start_ms = 0, dirs_end_ms = 0;
 
     next_s = s->next;
     if (s->ServerAddress == NULL) {
@@ -2619,9 +2623,21 @@ int fixup_servers(xaset_t *list) {
       }
     }
 
+    pr_gettimeofday_millis(&dirs_start_ms);
     fixup_dirs(s, 0);
+    pr_gettimeofday_millis(&dirs_end_ms);
+
+    dirs_ms += (dirs_end_ms - dirs_start_ms);
   }
 
+  pr_gettimeofday_millis(&end_ms);
+  pr_log_debug(DEBUG10, "startup: copying <Global> sections took %lu ms",
+    (unsigned long) (globals_ms - start_ms));
+  pr_log_debug(DEBUG10, "startup: fixing up <Directory> sections took %lu ms",
+    (unsigned long) dirs_ms);
+  pr_log_debug(DEBUG10, "startup: fixing up server addresses took %lu ms",
+    (unsigned long) ((end_ms - globals_ms) - dirs_ms));
+
   /* Make sure there actually are server_recs remaining in the list
    * before continuing.  Badly configured/resolved vhosts are rejected, and
    * it's possible to have all vhosts (even the default) rejected.
@@ -80,8 +80,50 @@ struct fsopendir {
 
   pr_fs_t *fsdir;
   DIR *dir;
+
+  /* For looking up entries relative to the open directory; dir_fd is -1
+   * if entries need to be looked up by path.
+   */
+  const char *dir_path;
+  int dir_fd;
+
+  /* The fs_map_gen when dir_fd was chosen; see pr_fsio_statat(). */
+  unsigned int dir_fs_map_gen;
+  pr_fs_dirent_t dent;
 };
 
+/* Entries can be looked up relative to the directory using fstatat(2). */
+#if defined(AT_SYMLINK_NOFOLLOW) && \
+    (defined(HAVE_DIRFD) || defined(HAVE_STRUCT_DIR_D_FD) || \
+     defined(HAVE_STRUCT_DIR_DD_FD) || defined(HAVE_STRUCT_DIR___DD_FD))
+# define PR_USE_FSIO_STATAT	1
+#endif
+
+/* Paths can be resolved beneath the root directory using openat2(2). */
+#if defined(__linux__)
+# include <sys/syscall.h>
+# if defined(SYS_openat2) && defined(O_PATH)
+#  include <linux/openat2.h>
+#  define PR_USE_FSIO_OPENAT2	1
+# endif
+
+/* Files can be copied within the kernel, by sharing extents (reflinks) or
+ * with copy_file_range(2).  Note that <linux/fs.h> conflicts with
+ * <sys/mount.h> on some systems, hence the local definition of FICLONE.
+ */
+# if defined(SYS_copy_file_range)
+#  define PR_USE_FSIO_COPY_FILE_RANGE	1
+# endif
+# if !defined(FICLONE) && defined(_IOW)
+#  define FICLONE		_IOW(0x94, 9, int)
+# endif
+#endif
+
+/* How much data to copy per copy_file_range(2) call. */
+#ifndef FSIO_COPY_FILE_RANGE_CHUNKSZ
+# define FSIO_COPY_FILE_RANGE_CHUNKSZ	(8 * 1024 * 1024)
+#endif
+
 static pr_fs_t *root_fs = NULL, *fs_cwd = NULL;
 static array_header *fs_map = NULL;
 
@@ -95,6 +137,11 @@ static pr_fs_t *fs_cache_fsdir = NULL;
  */
 static unsigned char chk_fs_map = FALSE;
 
+/* Incremented whenever a pr_fs_t has been added or removed; unlike
+ * chk_fs_map, never cleared.
+ */
+static unsigned int fs_map_gen = 0;
+
 /* Virtual working directory */
 static char vwd[PR_TUNABLE_PATH_MAX + 1] = "/";
 
@@ -104,6 +151,14 @@ static size_t cwd_len = 1;
 static int fsio_guard_chroot = FALSE;
 static unsigned long fsio_opts = 0UL;
 
+#ifdef PR_USE_FSIO_OPENAT2
+/* O_PATH descriptor for the current root directory, opened on first use and
+ * closed whenever the root directory changes.
+ */
+static int fs_root_fd = -1;
+static int fs_use_openat2 = TRUE;
+#endif /* PR_USE_FSIO_OPENAT2 */
+
 /* Runtime enabling/disabling of mkdtemp(3) use. */
 #ifdef HAVE_MKDTEMP
 static int fsio_use_mkdtemp = TRUE;
@@ -164,14 +219,9 @@ static int chroot_allow_path(const char *path) {
 }
 
 /* Builtin/default "progress" callback for long-running file copies. */
-static void copy_progress_cb(int nwritten) {
+static void copy_reset_timers(void) {
   int res;
 
-  copy_iter_count++;
-  if ((copy_iter_count % COPY_PROGRESS_NTH_ITER) != 0) {
-    return;
-  }
-
   /* Reset some of the Timeouts which might interfere, i.e. TimeoutIdle and
    * TimeoutNoDataTransfer.
    */
@@ -195,6 +245,15 @@ static void copy_progress_cb(int nwritten) {
   }
 }
 
+static void copy_progress_cb(int nwritten) {
+  copy_iter_count++;
+  if ((copy_iter_count % COPY_PROGRESS_NTH_ITER) != 0) {
+    return;
+  }
+
+  copy_reset_timers();
+}
+
 /* The following static functions are simply wrappers for system functions
  */
 
@@ -1124,144 +1183,163 @@ static int fs_cmp(const void *a, const void *b) {
 
 /* Statcache stuff */
 struct fs_statcache {
+  struct fs_statcache *next, *prev;
+
   pool *sc_pool;
+  pr_table_t *sc_tab;
+  const char *sc_path;
   struct stat sc_stat;
   int sc_errno;
   int sc_retval;
   time_t sc_cached_ts;
 };
 
-struct fs_statcache_evict_data {
-  time_t now;
-  time_t max_age;
-  pr_table_t *cache_tab;
+/* Entries are kept in least-recently-used order, most recent first. */
+struct fs_statcache_lru {
+  struct fs_statcache *head, *tail;
 };
 
 static const char *statcache_channel = "fs.statcache";
 static pool *statcache_pool = NULL;
 static unsigned int statcache_size = 0;
 static unsigned int statcache_max_age = 0;
+static unsigned int statcache_negative_max_age =
+  PR_TUNABLE_FS_STATCACHE_NEGATIVE_MAX_AGE;
 static unsigned int statcache_flags = 0;
 
+static struct {
+  unsigned long hits;
+  unsigned long negative_hits;
+  unsigned long misses;
+  unsigned long expired;
+  unsigned long evicted;
+  unsigned long cleared;
+} statcache_stats;
+
 /* We need to maintain two different caches: one for stat(2) data, and one
  * for lstat(2) data.  For some files (e.g. symlinks), the struct stat data
  * for the same path will be different for the two system calls.
  */
 static pr_table_t *stat_statcache_tab = NULL;
 static pr_table_t *lstat_statcache_tab = NULL;
+static struct fs_statcache_lru stat_statcache_lru;
+static struct fs_statcache_lru lstat_statcache_lru;
 
 #define fs_cache_lstat(f, p, s) cache_stat((f), (p), (s), FSIO_FILE_LSTAT)
 #define fs_cache_stat(f, p, s) cache_stat((f), (p), (s), FSIO_FILE_STAT)
 
+static struct fs_statcache_lru *fs_statcache_get_lru(pr_table_t *cache_tab) {
+  if (cache_tab == stat_statcache_tab) {
+    return &stat_statcache_lru;
+  }
+
+  return &lstat_statcache_lru;
+}
+
+static void fs_statcache_lru_remove(struct fs_statcache_lru *lru,
+    struct fs_statcache *sc) {
+  if (sc->prev != NULL) {
+    sc->prev->next = sc->next;
+
+  } else {
+    lru->head = sc->next;
+  }
+
+  if (sc->next != NULL) {
+    sc->next->prev = sc->prev;
+
+  } else {
+    lru->tail = sc->prev;
+  }
+
+  sc->next = sc->prev = NULL;
+}
+
+static void fs_statcache_lru_add(struct fs_statcache_lru *lru,
+    struct fs_statcache *sc) {
+  sc->prev = NULL;
+  sc->next = lru->head;
+
+  if (lru->head != NULL) {
+    lru->head->prev = sc;
+
+  } else {
+    lru->tail = sc;
+  }
+
+  lru->head = sc;
+}
+
+static void fs_statcache_remove(struct fs_statcache *sc) {
+  fs_statcache_lru_remove(fs_statcache_get_lru(sc->sc_tab), sc);
+  (void) pr_table_remove(sc->sc_tab, sc->sc_path, NULL);
+  destroy_pool(sc->sc_pool);
+}
+
 static const struct fs_statcache *fs_statcache_get(pr_table_t *cache_tab,
     const char *path, size_t path_len, time_t now) {
-  const struct fs_statcache *sc = NULL;
+  struct fs_statcache *sc = NULL;
 
   if (pr_table_count(cache_tab) == 0) {
+    if (statcache_size > 0) {
+      statcache_stats.misses++;
+    }
+
     errno = EPERM;
     return NULL;
   }
 
-  sc = pr_table_get(cache_tab, path, NULL);
+  sc = (struct fs_statcache *) pr_table_get(cache_tab, path, NULL);
   if (sc != NULL) {
-    time_t age;
+    time_t age, max_age;
+
+    /* Failed lookups are cached for a shorter time, so that files created
+     * by other processes are noticed sooner.
+     */
+    max_age = statcache_max_age;
+    if (sc->sc_retval < 0 &&
+        statcache_negative_max_age < max_age) {
+      max_age = statcache_negative_max_age;
+    }
 
     /* If this item hasn't expired yet, return it, otherwise, remove it. */
     age = now - sc->sc_cached_ts;
-    if (age <= statcache_max_age) {
+    if (age <= max_age) {
       pr_trace_msg(statcache_channel, 19,
         "using cached entry for '%s' (age %lu %s)", path,
         (unsigned long) age, age != 1 ? "secs" : "sec");
+
+      if (sc->sc_retval < 0) {
+        statcache_stats.negative_hits++;
+      }
+
+      statcache_stats.hits++;
+
+      /* Mark this entry as the most recently used. */
+      if (sc->prev != NULL) {
+        struct fs_statcache_lru *lru;
+
+        lru = fs_statcache_get_lru(cache_tab);
+        fs_statcache_lru_remove(lru, sc);
+        fs_statcache_lru_add(lru, sc);
+      }
+
       return sc;
     }
 
     pr_trace_msg(statcache_channel, 14,
       "entry for '%s' expired (age %lu %s > max age %lu), removing", path,
       (unsigned long) age, age != 1 ? "secs" : "sec",
-      (unsigned long) statcache_max_age);
-    (void) pr_table_remove(cache_tab, path, NULL);
-    destroy_pool(sc->sc_pool);
+      (unsigned long) max_age);
+    fs_statcache_remove(sc);
+    statcache_stats.expired++;
   }
 
+  statcache_stats.misses++;
   errno = ENOENT;
   return NULL;
 }
 
-static int fs_statcache_evict_expired(const void *key_data, size_t key_datasz,
-    const void *value_data, size_t value_datasz, void *user_data) {
-  const struct fs_statcache *sc;
-  struct fs_statcache_evict_data *evict_data;
-  time_t age;
-  pr_table_t *cache_tab = NULL;
-
-  sc = value_data;
-  evict_data = user_data;
-
-  cache_tab = evict_data->cache_tab;
-  age = evict_data->now - sc->sc_cached_ts;
-  if (age > evict_data->max_age) {
-    pr_trace_msg(statcache_channel, 14,
-      "entry for '%s' expired (age %lu %s > max age %lu), evicting",
-      (char *) key_data, (unsigned long) age, age != 1 ? "secs" : "sec",
-      (unsigned long) evict_data->max_age);
-    (void) pr_table_kremove(cache_tab, key_data, key_datasz, NULL);
-    destroy_pool(sc->sc_pool);
-  }
-
-  return 0;
-}
-
-static int fs_statcache_evict(pr_table_t *cache_tab, time_t now) {
-  int res, table_count;
-  struct fs_statcache_evict_data evict_data;
-
-  /* We try to make room in two passes.  First, evict any item that has
-   * exceeded the maximum age.  After that, if we are still not low enough,
-   * lower the maximum age, and try again.  If not enough room by then, then
-   * we'll try again on the next stat.
-   */
-
-  evict_data.now = now;
-  evict_data.max_age = statcache_max_age;
-  evict_data.cache_tab = cache_tab;
-
-  res = pr_table_do(cache_tab, fs_statcache_evict_expired, &evict_data,
-    PR_TABLE_DO_FL_ALL);
-  if (res < 0) {
-    pr_trace_msg(statcache_channel, 4,
-      "error evicting expired items: %s", strerror(errno));
-  }
-
-  table_count = pr_table_count(cache_tab);
-  if (table_count < 0 ||
-      (unsigned int) table_count < statcache_size) {
-    return 0;
-  }
-
-  /* Try for a shorter max age. */
-  if (statcache_max_age > 10) {
-    evict_data.max_age = (statcache_max_age - 10);
-    res = pr_table_do(cache_tab, fs_statcache_evict_expired, &evict_data,
-      PR_TABLE_DO_FL_ALL);
-    if (res < 0) {
-      pr_trace_msg(statcache_channel, 4,
-        "error evicting expired items: %s", strerror(errno));
-    }
-  }
-
-  table_count = pr_table_count(cache_tab);
-  if (table_count < 0 ||
-      (unsigned int) table_count < statcache_size) {
-    return 0;
-  }
-
-  pr_trace_msg(statcache_channel, 14,
-    "still not enough room in cache (size %d >= max %d)",
-    pr_table_count(cache_tab), statcache_size);
-  errno = EPERM;
-  return -1;
-}
-
 /* Returns 1 if we successfully added a cache entry, 0 if not, and -1 if
  * there was an error.
  */
@@ -1270,6 +1348,7 @@ static int fs_statcache_add(pr_table_t *cache_tab, const char *path,
   int res, table_count;
   pool *sc_pool;
   struct fs_statcache *sc;
+  struct fs_statcache_lru *lru;
 
   if (statcache_size == 0 ||
       statcache_max_age == 0) {
@@ -1277,26 +1356,42 @@ static int fs_statcache_add(pr_table_t *cache_tab, const char *path,
     return 0;
   }
 
+  if (retval < 0 &&
+      statcache_negative_max_age == 0) {
+    /* Caching of failed lookups disabled. */
+    return 0;
+  }
+
+  lru = fs_statcache_get_lru(cache_tab);
+
+  /* If we've reached capacity, evict the least recently used items to make
+   * room.
+   */
   table_count = pr_table_count(cache_tab);
-  if (table_count > 0 &&
-      (unsigned int) table_count >= statcache_size) {
-    /* We've reached capacity, and need to evict some items to make room. */
-    if (fs_statcache_evict(cache_tab, now) < 0) {
-      pr_trace_msg(statcache_channel, 8,
-        "unable to evict enough items from the cache: %s", strerror(errno));
-    }
+  while (table_count > 0 &&
+         (unsigned int) table_count >= statcache_size &&
+         lru->tail != NULL) {
+    pr_trace_msg(statcache_channel, 14,
+      "cache full (size %d >= max %u), evicting entry for '%s'", table_count,
+      statcache_size, lru->tail->sc_path);
+    fs_statcache_remove(lru->tail);
+    statcache_stats.evicted++;
+
+    table_count = pr_table_count(cache_tab);
   }
 
   sc_pool = make_sub_pool(statcache_pool);
   pr_pool_tag(sc_pool, "FS statcache entry pool");
   sc = pcalloc(sc_pool, sizeof(struct fs_statcache));
   sc->sc_pool = sc_pool;
+  sc->sc_tab = cache_tab;
+  sc->sc_path = pstrndup(sc_pool, path, path_len);
   memcpy(&(sc->sc_stat), st, sizeof(struct stat));
   sc->sc_errno = xerrno;
   sc->sc_retval = retval;
   sc->sc_cached_ts = now;
 
-  res = pr_table_add(cache_tab, pstrndup(sc_pool, path, path_len), sc,
+  res = pr_table_add(cache_tab, sc->sc_path, sc,
     sizeof(struct fs_statcache *));
   if (res < 0) {
     int tmp_errno = errno;
@@ -1307,6 +1402,9 @@ static int fs_statcache_add(pr_table_t *cache_tab, const char *path,
 
     destroy_pool(sc->sc_pool);
     errno = tmp_errno;
+
+  } else {
+    fs_statcache_lru_add(lru, sc);
   }
 
   return (res == 0 ? 1 : res);
@@ -1418,6 +1516,214 @@ static int cache_stat(pr_fs_t *fs, const char *path, struct stat *st,
   return retval;
 }
 
+/* Dentry cache stuff */
+
+/* Canonical paths, as resolved for the current working directory, so that
+ * repeated lookups of the same path need not walk it again.  Entries follow
+ * the statcache size and max age policy.
+ */
+struct fs_dentry {
+  struct fs_dentry *next, *prev;
+
+  pool *de_pool;
+  const char *de_key;
+  const char *de_path;
+  pr_fs_t *de_fs;
+  time_t de_cached_ts;
+};
+
+#define FS_DENTRY_RESOLVE_PARTIAL	'p'
+#define FS_DENTRY_RESOLVE_PATH		'r'
+#define FS_DENTRY_CANON_FS		'c'
+
+static pool *dentry_pool = NULL;
+static pr_table_t *dentry_tab = NULL;
+
+/* Most recently used first. */
+static struct fs_dentry *dentry_head = NULL, *dentry_tail = NULL;
+
+static struct {
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long flushed;
+} dentry_stats;
+
+static void fs_dentry_unlink(struct fs_dentry *de) {
+  if (de->prev != NULL) {
+    de->prev->next = de->next;
+
+  } else {
+    dentry_head = de->next;
+  }
+
+  if (de->next != NULL) {
+    de->next->prev = de->prev;
+
+  } else {
+    dentry_tail = de->prev;
+  }
+
+  de->next = de->prev = NULL;
+}
+
+static void fs_dentry_link(struct fs_dentry *de) {
+  de->prev = NULL;
+  de->next = dentry_head;
+
+  if (dentry_head != NULL) {
+    dentry_head->prev = de;
+
+  } else {
+    dentry_tail = de;
+  }
+
+  dentry_head = de;
+}
+
+static void fs_dentry_remove(struct fs_dentry *de) {
+  fs_dentry_unlink(de);
+  (void) pr_table_remove(dentry_tab, de->de_key, NULL);
+  destroy_pool(de->de_pool);
+}
+
+/* Called whenever a path, the working directory, the root directory, or the
+ * FS map changes.  Since a symlink anywhere along a path can change what it
+ * resolves to, all entries are dropped.
+ */
+static void fs_dentry_flush(void) {
+  if (dentry_pool == NULL) {
+    return;
+  }
+
+  if (pr_table_count(dentry_tab) > 0) {
+    pr_trace_msg(statcache_channel, 17, "flushing dentry cache (%d %s)",
+      pr_table_count(dentry_tab),
+      pr_table_count(dentry_tab) != 1 ? "entries" : "entry");
+    dentry_stats.flushed++;
+  }
+
+  /* All of the entries, and the table, are allocated out of dentry_pool. */
+  destroy_pool(dentry_pool);
+  dentry_pool = NULL;
+  dentry_tab = NULL;
+  dentry_head = dentry_tail = NULL;
+}
+
+static int fs_dentry_make_key(char *key, size_t keysz, int kind, int op,
+    const char *path) {
+  int len;
+
+  len = pr_snprintf(key, keysz, "%c%d:%s", kind, op, path);
+  if (len < 0 ||
+      (size_t) len >= keysz) {
+    return -1;
+  }
+
+  return 0;
+}
+
+static const struct fs_dentry *fs_dentry_get(int kind, int op,
+    const char *path) {
+  char key[PR_TUNABLE_PATH_MAX + 32];
+  struct fs_dentry *de;
+  time_t age;
+
+  if (dentry_tab == NULL ||
+      pr_table_count(dentry_tab) == 0) {
+    if (statcache_size > 0) {
+      dentry_stats.misses++;
+    }
+
+    return NULL;
+  }
+
+  if (fs_dentry_make_key(key, sizeof(key), kind, op, path) < 0) {
+    return NULL;
+  }
+
+  de = (struct fs_dentry *) pr_table_get(dentry_tab, key, NULL);
+  if (de == NULL) {
+    dentry_stats.misses++;
+    return NULL;
+  }
+
+  age = time(NULL) - de->de_cached_ts;
+  if (age > (time_t) statcache_max_age) {
+    pr_trace_msg(statcache_channel, 14,
+      "dentry for '%s' expired (age %lu %s > max age %lu), removing", path,
+      (unsigned long) age, age != 1 ? "secs" : "sec",
+      (unsigned long) statcache_max_age);
+    fs_dentry_remove(de);
+    dentry_stats.misses++;
+    return NULL;
+  }
+
+  if (de->prev != NULL) {
+    fs_dentry_unlink(de);
+    fs_dentry_link(de);
+  }
+
+  pr_trace_msg(statcache_channel, 19, "using cached dentry for '%s' ('%s')",
+    path, de->de_path);
+  dentry_stats.hits++;
+  return de;
+}
+
+static void fs_dentry_add(int kind, int op, const char *path,
+    const char *resolved_path, pr_fs_t *fs) {
+  char key[PR_TUNABLE_PATH_MAX + 32];
+  pool *de_pool;
+  struct fs_dentry *de;
+
+  if (statcache_size == 0 ||
+      statcache_max_age == 0) {
+    return;
+  }
+
+  /* Interpolated paths depend on the session user, not just the cwd. */
+  if (*path == '~') {
+    return;
+  }
+
+  if (fs_dentry_make_key(key, sizeof(key), kind, op, path) < 0) {
+    return;
+  }
+
+  if (dentry_pool == NULL) {
+    dentry_pool = make_sub_pool(permanent_pool);
+    pr_pool_tag(dentry_pool, "FS Dentry Cache Pool");
+
+    dentry_tab = pr_table_alloc(dentry_pool, 0);
+  }
+
+  if (pr_table_get(dentry_tab, key, NULL) != NULL) {
+    return;
+  }
+
+  while (dentry_tail != NULL &&
+         (unsigned int) pr_table_count(dentry_tab) >= statcache_size) {
+    fs_dentry_remove(dentry_tail);
+  }
+
+  de_pool = make_sub_pool(dentry_pool);
+  pr_pool_tag(de_pool, "FS dentry pool");
+
+  de = pcalloc(de_pool, sizeof(struct fs_dentry));
+  de->de_pool = de_pool;
+  de->de_key = pstrdup(de_pool, key);
+  de->de_path = pstrdup(de_pool, resolved_path);
+  de->de_fs = fs;
+  de->de_cached_ts = time(NULL);
+
+  if (pr_table_add(dentry_tab, de->de_key, de,
+      sizeof(struct fs_dentry *)) < 0) {
+    destroy_pool(de_pool);
+    return;
+  }
+
+  fs_dentry_link(de);
+}
+
 /* Lookup routines */
 
 /* Necessary prototype for static function */
@@ -1554,11 +1860,26 @@ static pr_fs_t *lookup_file_fs(const char *path, char **deref, int op) {
 
 static pr_fs_t *lookup_file_canon_fs(const char *path, char **deref, int op) {
   static char workpath[PR_TUNABLE_PATH_MAX + 1];
+  const struct fs_dentry *de;
+  pr_fs_t *fs;
+  int res;
 
   memset(workpath,'\0',sizeof(workpath));
 
-  if (pr_fs_resolve_partial(path, workpath, sizeof(workpath)-1,
-      FSIO_FILE_OPEN) == -1) {
+  de = fs_dentry_get(FS_DENTRY_CANON_FS, op, path);
+  if (de != NULL) {
+    sstrncpy(workpath, de->de_path, sizeof(workpath));
+
+    if (deref) {
+      *deref = workpath;
+    }
+
+    return de->de_fs;
+  }
+
+  res = pr_fs_resolve_partial(path, workpath, sizeof(workpath)-1,
+    FSIO_FILE_OPEN);
+  if (res < 0) {
     if (*path == '/' || *path == '~') {
       if (pr_fs_interpolate(path, workpath, sizeof(workpath)-1) != -1) {
         sstrncpy(workpath, path, sizeof(workpath));
@@ -1575,7 +1896,14 @@ static pr_fs_t *lookup_file_canon_fs(const char *path, char **deref, int op) {
     *deref = workpath;
   }
 
-  return lookup_file_fs(workpath, deref, op);
+  fs = lookup_file_fs(workpath, deref, op);
+  if (res == 0 &&
+      fs != NULL &&
+      (deref == NULL || *deref == workpath)) {
+    fs_dentry_add(FS_DENTRY_CANON_FS, op, path, workpath, fs);
+  }
+
+  return fs;
 }
 
 /* FS Statcache API */
@@ -1595,6 +1923,18 @@ static void statcache_dumpf(const char *fmt, ...) {
 }
 
 void pr_fs_statcache_dump(void) {
+  statcache_dumpf("statcache: %lu %s (%lu negative), %lu %s, %lu expired, "
+    "%lu evicted, %lu cleared", statcache_stats.hits,
+    statcache_stats.hits != 1 ? "hits" : "hit", statcache_stats.negative_hits,
+    statcache_stats.misses, statcache_stats.misses != 1 ? "misses" : "miss",
+    statcache_stats.expired, statcache_stats.evicted, statcache_stats.cleared);
+  statcache_dumpf("dentry cache: %d %s, %lu %s, %lu %s, %lu flushed",
+    dentry_tab != NULL ? pr_table_count(dentry_tab) : 0,
+    dentry_tab != NULL && pr_table_count(dentry_tab) == 1 ? "entry" : "entries",
+    dentry_stats.hits, dentry_stats.hits != 1 ? "hits" : "hit",
+    dentry_stats.misses, dentry_stats.misses != 1 ? "misses" : "miss",
+    dentry_stats.flushed);
+
   pr_table_dump(statcache_dumpf, stat_statcache_tab);
   pr_table_dump(statcache_dumpf, lstat_statcache_tab);
 }
@@ -1624,6 +1964,11 @@ void pr_fs_statcache_free(void) {
     lstat_statcache_tab = NULL;
   }
 
+  memset(&stat_statcache_lru, 0, sizeof(stat_statcache_lru));
+  memset(&lstat_statcache_lru, 0, sizeof(lstat_statcache_lru));
+
+  fs_dentry_flush();
+
   /* Note: we do not need to explicitly destroy each entry in the statcache
    * tables, since ALL entries are allocated out of this statcache_pool.
    * And we destroy this pool here.  Much easier cleanup that way.
@@ -1656,72 +2001,154 @@ int pr_fs_statcache_set_policy(unsigned int size, unsigned int max_age,
   return 0;
 }
 
-int pr_fs_clear_cache2(const char *path) {
-  int res;
+int pr_fs_statcache_set_negative_max_age(unsigned int max_age) {
+  statcache_negative_max_age = max_age;
+  return 0;
+}
 
-  (void) pr_event_generate("fs.statcache.clear", path);
+static void fs_statcache_clean_path(const char *path, char *buf,
+    size_t bufsz) {
+  char pathbuf[PR_TUNABLE_PATH_MAX+1];
 
-  if (pr_table_count(stat_statcache_tab) == 0 &&
-      pr_table_count(lstat_statcache_tab) == 0) {
-    return 0;
+  memset(buf, '\0', bufsz);
+  memset(pathbuf, '\0', sizeof(pathbuf));
+
+  if (*path != '/') {
+    size_t pathbuf_len;
+
+    sstrcat(pathbuf, cwd, sizeof(pathbuf)-1);
+    pathbuf_len = cwd_len;
+
+    if (strncmp(cwd, "/", 2) != 0) {
+      sstrcat(pathbuf + pathbuf_len, "/", sizeof(pathbuf) - pathbuf_len - 1);
+      pathbuf_len++;
+    }
+
+    if (strncmp(path, ".", 2) != 0) {
+      sstrcat(pathbuf + pathbuf_len, path, sizeof(pathbuf)- pathbuf_len - 1);
+    }
+
+  } else {
+    sstrncpy(pathbuf, path, sizeof(pathbuf)-1);
   }
 
-  if (path != NULL) {
-    char cleaned_path[PR_TUNABLE_PATH_MAX+1], pathbuf[PR_TUNABLE_PATH_MAX+1];
-    int lstat_count, stat_count;
+  pr_fs_clean_path2(pathbuf, buf, bufsz-1, 0);
+}
 
-    if (*path != '/') {
-      size_t pathbuf_len;
+/* Removes the cached entries for any paths under the given directory. */
+static int fs_statcache_clear_subdir(const char *dir) {
+  register unsigned int i;
+  size_t dir_len;
+  int res = 0;
 
-      memset(cleaned_path, '\0', sizeof(cleaned_path));
-      memset(pathbuf, '\0', sizeof(pathbuf));
+  dir_len = strlen(dir);
+  if (dir_len > 0 &&
+      dir[dir_len-1] == '/') {
+    dir_len--;
+  }
 
-      sstrcat(pathbuf, cwd, sizeof(pathbuf)-1);
-      pathbuf_len = cwd_len;
+  for (i = 0; i < 2; i++) {
+    struct fs_statcache *sc, *sc_next;
 
-      if (strncmp(cwd, "/", 2) != 0) {
-        sstrcat(pathbuf + pathbuf_len, "/", sizeof(pathbuf) - pathbuf_len - 1);
-        pathbuf_len++;
+    sc = (i == 0 ? stat_statcache_lru.head : lstat_statcache_lru.head);
+    for (; sc != NULL; sc = sc_next) {
+      sc_next = sc->next;
+
+      if (strncmp(sc->sc_path, dir, dir_len) == 0 &&
+          sc->sc_path[dir_len] == '/') {
+        pr_trace_msg(statcache_channel, 17, "cleared %s entry for '%s'",
+          i == 0 ? "stat(2)" : "lstat(2)", sc->sc_path);
+        fs_statcache_remove(sc);
+        statcache_stats.cleared++;
+        res++;
       }
+    }
+  }
 
-      if (strncmp(path, ".", 2) != 0) {
-        sstrcat(pathbuf + pathbuf_len, path, sizeof(pathbuf)- pathbuf_len - 1);
+  return res;
+}
+
+#define FS_STATCACHE_FL_PARENT		0x001
+#define FS_STATCACHE_FL_SUBDIR		0x002
+
+/* Clears the cached entries which a change to the given path makes stale:
+ * the path itself, its parent directory (whose link count/timestamps
+ * change when entries are added or removed), and anything beneath it (when
+ * a directory is renamed or removed).
+ */
+static void fs_statcache_invalidate(const char *path, int flags) {
+  char cleaned_path[PR_TUNABLE_PATH_MAX+1], *ptr;
+
+  (void) pr_fs_clear_cache2(path);
+
+  if (pr_table_count(stat_statcache_tab) == 0 &&
+      pr_table_count(lstat_statcache_tab) == 0) {
+    return;
+  }
+
+  fs_statcache_clean_path(path, cleaned_path, sizeof(cleaned_path));
+
+  if (flags & FS_STATCACHE_FL_SUBDIR) {
+    (void) fs_statcache_clear_subdir(cleaned_path);
+  }
+
+  if (flags & FS_STATCACHE_FL_PARENT) {
+    ptr = strrchr(cleaned_path, '/');
+    if (ptr != NULL &&
+        ptr[1] != '\0') {
+      if (ptr == cleaned_path) {
+        ptr++;
       }
 
-    } else {
-      sstrncpy(pathbuf, path, sizeof(pathbuf)-1);
+      *ptr = '\0';
+      (void) pr_fs_clear_cache2(cleaned_path);
     }
+  }
+}
 
-    pr_fs_clean_path2(pathbuf, cleaned_path, sizeof(cleaned_path)-1, 0);
+int pr_fs_clear_cache2(const char *path) {
+  int res;
 
-    res = 0;
+  (void) pr_event_generate("fs.statcache.clear", path);
 
-    stat_count = pr_table_exists(stat_statcache_tab, cleaned_path);
-    if (stat_count > 0) {
-      const struct fs_statcache *sc;
+  if (path == NULL) {
+    /* Emptying the entire cache drops the resolved paths as well. */
+    fs_dentry_flush();
+  }
 
-      sc = pr_table_remove(stat_statcache_tab, cleaned_path, NULL);
-      if (sc != NULL) {
-        destroy_pool(sc->sc_pool);
-      }
+  if (pr_table_count(stat_statcache_tab) == 0 &&
+      pr_table_count(lstat_statcache_tab) == 0) {
+    return 0;
+  }
+
+  if (path != NULL) {
+    char cleaned_path[PR_TUNABLE_PATH_MAX+1];
+    struct fs_statcache *sc;
+
+    fs_statcache_clean_path(path, cleaned_path, sizeof(cleaned_path));
+
+    res = 0;
+
+    sc = (struct fs_statcache *) pr_table_get(stat_statcache_tab,
+      cleaned_path, NULL);
+    if (sc != NULL) {
+      fs_statcache_remove(sc);
+      statcache_stats.cleared++;
 
       pr_trace_msg(statcache_channel, 17, "cleared stat(2) entry for '%s'",
         path);
-      res += stat_count;
+      res++;
     }
 
-    lstat_count = pr_table_exists(lstat_statcache_tab, cleaned_path);
-    if (lstat_count > 0) {
-      const struct fs_statcache *sc;
-
-      sc = pr_table_remove(lstat_statcache_tab, cleaned_path, NULL);
-      if (sc != NULL) {
-        destroy_pool(sc->sc_pool);
-      }
+    sc = (struct fs_statcache *) pr_table_get(lstat_statcache_tab,
+      cleaned_path, NULL);
+    if (sc != NULL) {
+      fs_statcache_remove(sc);
+      statcache_stats.cleared++;
 
       pr_trace_msg(statcache_channel, 17, "cleared lstat(2) entry for '%s'",
         path);
-      res += lstat_count;
+      res++;
     }
 
   } else {
@@ -1739,13 +2166,141 @@ void pr_fs_clear_cache(void) {
 
 /* FS functions proper */
 
+int pr_fs_uses_sys_read(pr_fh_t *fh) {
+  pr_fs_t *fs;
+
+  if (fh == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  fs = fh->fh_fs;
+  while (fs && fs->fs_next && !fs->read) {
+    fs = fs->fs_next;
+  }
+
+  if (fs == NULL ||
+      fs->read != sys_read) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+int pr_fs_uses_sys_write(pr_fh_t *fh) {
+  pr_fs_t *fs;
+
+  if (fh == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  fs = fh->fh_fs;
+  while (fs && fs->fs_next && !fs->write) {
+    fs = fs->fs_next;
+  }
+
+  if (fs == NULL ||
+      fs->write != sys_write) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void fs_copy_file_progress(void (*progress_cb)(int), off_t len) {
+  while (len > 0) {
+    int chunksz;
+
+    chunksz = len > FSIO_COPY_FILE_RANGE_CHUNKSZ ?
+      FSIO_COPY_FILE_RANGE_CHUNKSZ : (int) len;
+
+    if (progress_cb != NULL) {
+      (progress_cb)(chunksz);
+
+    } else {
+      /* Each chunk is much larger than a read/write buffer, so reset the
+       * timers for every chunk.
+       */
+      copy_reset_timers();
+    }
+
+    len -= chunksz;
+  }
+}
+
+/* Copies the source file into the (empty) destination file within the
+ * kernel, first by cloning the source file's extents, on filesystems which
+ * support reflinks, and otherwise using copy_file_range(2).  Returns TRUE if
+ * the entire file was copied; otherwise, the file offsets of both handles
+ * reflect the data copied so far, and the caller copies the rest.
+ */
+static int fs_copy_file_fast(pr_fh_t *src_fh, pr_fh_t *dst_fh,
+    struct stat *src_st, void (*progress_cb)(int)) {
+#if defined(PR_USE_FSIO_COPY_FILE_RANGE) || defined(FICLONE)
+  if (!S_ISREG(src_st->st_mode) ||
+      src_st->st_size == 0 ||
+      pr_fs_uses_sys_read(src_fh) != TRUE ||
+      pr_fs_uses_sys_write(dst_fh) != TRUE) {
+    return FALSE;
+  }
+
+# if defined(FICLONE)
+  if (ioctl(PR_FH_FD(dst_fh), FICLONE, PR_FH_FD(src_fh)) == 0) {
+    pr_trace_msg(trace_channel, 9, "cloned '%s' to '%s' (%" PR_LU " bytes)",
+      src_fh->fh_path, dst_fh->fh_path, (pr_off_t) src_st->st_size);
+    fs_copy_file_progress(progress_cb, src_st->st_size);
+    return TRUE;
+  }
+
+  pr_trace_msg(trace_channel, 17, "unable to clone '%s' to '%s': %s",
+    src_fh->fh_path, dst_fh->fh_path, strerror(errno));
+# endif /* FICLONE */
+
+# if defined(PR_USE_FSIO_COPY_FILE_RANGE)
+  while (TRUE) {
+    ssize_t res;
+
+    pr_signals_handle();
+
+    res = syscall(SYS_copy_file_range, PR_FH_FD(src_fh), NULL,
+      PR_FH_FD(dst_fh), NULL, (size_t) FSIO_COPY_FILE_RANGE_CHUNKSZ, 0);
+    if (res < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      /* Let the read/write loop handle the rest, including reporting any
+       * errors.
+       */
+      pr_trace_msg(trace_channel, 17,
+        "unable to use copy_file_range(2) for '%s': %s", src_fh->fh_path,
+        strerror(errno));
+      return FALSE;
+    }
+
+    if (res == 0) {
+      /* Some filesystems report EOF rather than an error when they cannot
+       * copy; the read/write loop will notice any data left to copy.
+       */
+      return FALSE;
+    }
+
+    fs_copy_file_progress(progress_cb, res);
+  }
+# endif /* PR_USE_FSIO_COPY_FILE_RANGE */
+#endif
+
+  return FALSE;
+}
+
 int pr_fs_copy_file2(const char *src, const char *dst, int flags,
     void (*progress_cb)(int)) {
   pr_fh_t *src_fh, *dst_fh;
   struct stat src_st, dst_st;
   char *buf;
   size_t bufsz;
-  int dst_existed = FALSE, res;
+  int copied = FALSE, dst_existed = FALSE, res;
 #ifdef PR_USE_XATTR
   array_header *xattrs = NULL;
 #endif /* PR_USE_XATTR */
@@ -1903,7 +2458,15 @@ int pr_fs_copy_file2(const char *src, const char *dst, int flags,
   }
 #endif
 
-  while ((res = pr_fsio_read(src_fh, buf, bufsz)) > 0) {
+  /* Try copying within the kernel first; whatever it does not copy is read
+   * and written here.
+   */
+  if (S_ISREG(dst_st.st_mode)) {
+    copied = fs_copy_file_fast(src_fh, dst_fh, &src_st, progress_cb);
+  }
+
+  while (copied == FALSE &&
+         (res = pr_fsio_read(src_fh, buf, bufsz)) > 0) {
     size_t datalen;
     off_t offset;
 
@@ -2267,6 +2830,9 @@ int pr_insert_fs(pr_fs_t *fs, const char *path) {
         fs_objs[i] = fs;
 
         chk_fs_map = TRUE;
+
+        fs_map_gen++;
+        fs_dentry_flush();
         return TRUE;
       }
     }
@@ -2286,6 +2852,8 @@ int pr_insert_fs(pr_fs_t *fs, const char *path) {
    * has been registered.
    */
   chk_fs_map = TRUE;
+  fs_map_gen++;
+  fs_dentry_flush();
 
   return TRUE;
 }
@@ -2335,6 +2903,9 @@ pr_fs_t *pr_unmount_fs(const char *path, const char *name) {
           fs_cwd = root_fs;
 
           chk_fs_map = TRUE;
+
+          fs_map_gen++;
+          fs_dentry_flush();
           return NULL;
         }
 
@@ -2359,6 +2930,8 @@ pr_fs_t *pr_unmount_fs(const char *path, const char *name) {
          * new map.
          */
         chk_fs_map = TRUE;
+        fs_map_gen++;
+        fs_dentry_flush();
 
         return fsi;
       }
@@ -2371,6 +2944,9 @@ pr_fs_t *pr_unmount_fs(const char *path, const char *name) {
       fsi->fs_next = fsi->fs_prev = NULL; 
 
       chk_fs_map = TRUE;
+
+      fs_map_gen++;
+      fs_dentry_flush();
       return fsi;
     }
   }
@@ -2503,6 +3079,9 @@ int pr_fs_setcwd(const char *dir) {
   cwd[sizeof(cwd) - 1] = '\0';
   cwd_len = strlen(cwd);
 
+  /* Cached dentries were resolved relative to the previous cwd. */
+  fs_dentry_flush();
+
   return 0;
 }
 
@@ -2752,7 +3331,151 @@ int pr_fs_interpolate(const char *path, char *buf, size_t buflen) {
   return 1;
 }
 
-int pr_fs_resolve_partial(const char *path, char *buf, size_t buflen, int op) {
+static void fs_close_root_fd(void) {
+#ifdef PR_USE_FSIO_OPENAT2
+  if (fs_root_fd >= 0) {
+    (void) close(fs_root_fd);
+    fs_root_fd = -1;
+  }
+#endif /* PR_USE_FSIO_OPENAT2 */
+}
+
+/* Try to resolve the path with a single openat2(2) call, beneath the root
+ * directory and refusing to follow any symlinks.  If that succeeds, there are
+ * no symlinks to expand, and the canonical path is simply the workpath plus
+ * the components of curpath.  Returns 0 if resolved, or -1 if the caller
+ * needs to walk the path itself (e.g. the path contains symlinks or "..", is
+ * handled by a custom FS, or the kernel does not support openat2(2)).
+ */
+static int fs_resolve_beneath(const char *workpath, const char *curpath,
+    char *buf, size_t buflen, int op) {
+#ifdef PR_USE_FSIO_OPENAT2
+  char pathbuf[PR_TUNABLE_PATH_MAX + 1];
+  const char *where;
+  size_t pathlen;
+  struct open_how how;
+  pr_fs_t *fs;
+  int fd;
+
+  if (fs_use_openat2 == FALSE ||
+      (fsio_opts & PR_FSIO_OPT_IGNORE_RESOLVE_BENEATH)) {
+    return -1;
+  }
+
+  if (*workpath != '\0' &&
+      *workpath != '/') {
+    return -1;
+  }
+
+  /* Repeated slashes and ".." components are handled differently by the
+   * walk than by the kernel; leave those paths to the walk.
+   */
+  if (strstr(curpath, "//") != NULL) {
+    return -1;
+  }
+
+  sstrncpy(pathbuf, workpath, sizeof(pathbuf));
+  pathlen = strlen(pathbuf);
+
+  where = curpath;
+  while (*where != '\0') {
+    const char *ptr;
+    size_t len;
+
+    ptr = strchr(where, '/');
+    len = ptr != NULL ? (size_t) (ptr - where) : strlen(where);
+
+    if (len == 2 &&
+        strncmp(where, "..", 2) == 0) {
+      return -1;
+    }
+
+    if (len > 0 &&
+        (len != 1 || *where != '.')) {
+      if (pathlen == 0 ||
+          pathbuf[pathlen-1] != '/') {
+        if (pathlen + 1 >= sizeof(pathbuf)) {
+          return -1;
+        }
+
+        pathbuf[pathlen++] = '/';
+      }
+
+      if (pathlen + len >= sizeof(pathbuf)) {
+        return -1;
+      }
+
+      memcpy(pathbuf + pathlen, where, len);
+      pathlen += len;
+      pathbuf[pathlen] = '\0';
+    }
+
+    if (ptr == NULL) {
+      break;
+    }
+
+    where = ptr + 1;
+  }
+
+  /* Nothing to look up for the root directory itself. */
+  if (pathlen <= 1) {
+    return -1;
+  }
+
+  fs = lookup_dir_fs(pathbuf, op);
+  while (fs && fs->fs_next && !fs->lstat) {
+    fs = fs->fs_next;
+  }
+
+  if (fs == NULL ||
+      fs->non_std_path == TRUE ||
+      fs->lstat != sys_lstat) {
+    return -1;
+  }
+
+  if (fs_root_fd < 0) {
+    fs_root_fd = open("/", O_PATH|O_DIRECTORY|O_CLOEXEC);
+    if (fs_root_fd < 0) {
+      return -1;
+    }
+  }
+
+  memset(&how, 0, sizeof(how));
+  how.flags = O_PATH|O_CLOEXEC;
+  how.resolve = RESOLVE_BENEATH|RESOLVE_NO_MAGICLINKS|RESOLVE_NO_SYMLINKS;
+
+  fd = (int) syscall(SYS_openat2, fs_root_fd, pathbuf + 1, &how, sizeof(how));
+  if (fd < 0) {
+    int xerrno = errno;
+
+    /* Older kernels (and some seccomp filters) do not allow openat2(2);
+     * stop trying it for the rest of this process.
+     */
+    if (xerrno == ENOSYS ||
+        xerrno == EPERM ||
+        xerrno == EINVAL ||
+        xerrno == E2BIG) {
+      pr_trace_msg(trace_channel, 3,
+        "openat2(2) not usable for resolving paths: %s", strerror(xerrno));
+      fs_use_openat2 = FALSE;
+    }
+
+    return -1;
+  }
+
+  (void) close(fd);
+
+  pr_trace_msg(trace_channel, 19, "resolved '%s' beneath root using "
+    "openat2(2)", pathbuf);
+  sstrncpy(buf, pathbuf, buflen);
+  return 0;
+#else
+  return -1;
+#endif /* PR_USE_FSIO_OPENAT2 */
+}
+
+static int fs_resolve_partial(const char *path, char *buf, size_t buflen,
+    int op) {
   char curpath[PR_TUNABLE_PATH_MAX + 1]  = {'\0'},
        workpath[PR_TUNABLE_PATH_MAX + 1] = {'\0'},
        namebuf[PR_TUNABLE_PATH_MAX + 1]  = {'\0'},
@@ -2791,6 +3514,10 @@ int pr_fs_resolve_partial(const char *path, char *buf, size_t buflen, int op) {
     sstrncpy(curpath, path, sizeof(curpath));
   }
 
+  if (fs_resolve_beneath(workpath, curpath, buf, buflen, op) == 0) {
+    return 0;
+  }
+
   while (fini--) {
     where = curpath;
 
@@ -2953,7 +3680,8 @@ int pr_fs_resolve_partial(const char *path, char *buf, size_t buflen, int op) {
   return 0;
 }
 
-int pr_fs_resolve_path(const char *path, char *buf, size_t buflen, int op) {
+static int fs_resolve_path(const char *path, char *buf, size_t buflen,
+    int op) {
   char curpath[PR_TUNABLE_PATH_MAX + 1]  = {'\0'},
        workpath[PR_TUNABLE_PATH_MAX + 1] = {'\0'},
        namebuf[PR_TUNABLE_PATH_MAX + 1]  = {'\0'},
@@ -2982,6 +3710,10 @@ int pr_fs_resolve_path(const char *path, char *buf, size_t buflen, int op) {
     workpath[0] = '\0';
   }
 
+  if (fs_resolve_beneath(workpath, curpath, buf, buflen, op) == 0) {
+    return 0;
+  }
+
   while (fini--) {
     where = curpath;
 
@@ -3124,7 +3856,55 @@ int pr_fs_resolve_path(const char *path, char *buf, size_t buflen, int op) {
     sstrncpy(workpath, "/", sizeof(workpath));
   }
 
-  sstrncpy(buf, workpath, buflen);
+  sstrncpy(buf, workpath, buflen);
+  return 0;
+}
+
+int pr_fs_resolve_partial(const char *path, char *buf, size_t buflen, int op) {
+  const struct fs_dentry *de;
+
+  if (path == NULL ||
+      buf == NULL ||
+      buflen == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  de = fs_dentry_get(FS_DENTRY_RESOLVE_PARTIAL, op, path);
+  if (de != NULL) {
+    sstrncpy(buf, de->de_path, buflen);
+    return 0;
+  }
+
+  if (fs_resolve_partial(path, buf, buflen, op) < 0) {
+    return -1;
+  }
+
+  fs_dentry_add(FS_DENTRY_RESOLVE_PARTIAL, op, path, buf, NULL);
+  return 0;
+}
+
+int pr_fs_resolve_path(const char *path, char *buf, size_t buflen, int op) {
+  const struct fs_dentry *de;
+
+  if (path == NULL ||
+      buf == NULL ||
+      buflen == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  de = fs_dentry_get(FS_DENTRY_RESOLVE_PATH, op, path);
+  if (de != NULL) {
+    sstrncpy(buf, de->de_path, buflen);
+    return 0;
+  }
+
+  if (fs_resolve_path(path, buf, buflen, op) < 0) {
+    return -1;
+  }
+
+  fs_dentry_add(FS_DENTRY_RESOLVE_PATH, op, path, buf, NULL);
   return 0;
 }
 
@@ -3763,8 +4543,101 @@ int pr_fsio_chdir(const char *path, int hidesymlink) {
  * optimization, caching the last-recently-used pr_fs_t, and
  * avoid future pr_fs_t lookups when iterating via readdir.
  */
+/* Returns the descriptor of the opened directory, if the entries of that
+ * directory are handled by the system stat(2)/lstat(2), and so can be looked
+ * up relative to it.  Otherwise, -1 is returned.
+ */
+#ifdef PR_USE_FSIO_STATAT
+/* Returns TRUE if any registered pr_fs_t handles paths below the given
+ * directory (e.g. one registered for a subdirectory), in which case the
+ * directory's entries may not all be handled by the pr_fs_t for the
+ * directory itself.
+ */
+static int fs_map_has_subdir_fs(const char *dir_path) {
+  register unsigned int i;
+  char buf[PR_TUNABLE_PATH_MAX + 1];
+  size_t buflen;
+  pr_fs_t **fs_objs;
+
+  if (fs_map == NULL ||
+      fs_map->nelts == 0) {
+    return FALSE;
+  }
+
+  memset(buf, '\0', sizeof(buf));
+  if (pr_fs_resolve_partial(dir_path, buf, sizeof(buf)-2,
+      FSIO_DIR_OPENDIR) < 0) {
+    return TRUE;
+  }
+
+  buflen = strlen(buf);
+  if (buflen == 0 ||
+      buf[buflen-1] != '/') {
+    buf[buflen++] = '/';
+    buf[buflen] = '\0';
+  }
+
+  fs_objs = (pr_fs_t **) fs_map->elts;
+  for (i = 0; i < fs_map->nelts; i++) {
+    const char *fs_path;
+
+    fs_path = fs_objs[i]->fs_path;
+    if (strlen(fs_path) > buflen &&
+        strncmp(fs_path, buf, buflen) == 0) {
+      pr_trace_msg(trace_channel, 8, "%s FS at '%s' lies below '%s', "
+        "looking up entries by path", fs_objs[i]->fs_name, fs_path, buf);
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+#endif /* PR_USE_FSIO_STATAT */
+
+static int fs_get_dir_fd(pr_fs_t *fs, pr_fs_t *dir_fs, DIR *dir,
+    const char *dir_path) {
+#ifdef PR_USE_FSIO_STATAT
+  pr_fs_t *stat_fs, *lstat_fs;
+
+  if (fs->non_std_path == TRUE ||
+      dir_fs->opendir != sys_opendir) {
+    return -1;
+  }
+
+  stat_fs = lstat_fs = fs;
+  while (stat_fs && stat_fs->fs_next && !stat_fs->stat) {
+    stat_fs = stat_fs->fs_next;
+  }
+
+  while (lstat_fs && lstat_fs->fs_next && !lstat_fs->lstat) {
+    lstat_fs = lstat_fs->fs_next;
+  }
+
+  if (stat_fs->stat != sys_stat ||
+      lstat_fs->lstat != sys_lstat) {
+    return -1;
+  }
+
+  if (fs_map_has_subdir_fs(dir_path) == TRUE) {
+    return -1;
+  }
+
+# if defined(HAVE_DIRFD)
+  return dirfd(dir);
+# elif defined(HAVE_STRUCT_DIR_D_FD)
+  return dir->d_fd;
+# elif defined(HAVE_STRUCT_DIR_DD_FD)
+  return dir->dd_fd;
+# else
+  return dir->__dd_fd;
+# endif
+#else
+  return -1;
+#endif /* PR_USE_FSIO_STATAT */
+}
+
 void *pr_fsio_opendir(const char *path) {
-  pr_fs_t *fs = NULL;
+  pr_fs_t *fs = NULL, *lookup_fs = NULL;
   fsopendir_t *fsod = NULL, *fsodi = NULL;
   pool *fsod_pool = NULL;
   DIR *res = NULL;
@@ -3788,6 +4661,8 @@ void *pr_fsio_opendir(const char *path) {
     fs = lookup_dir_fs(buf, FSIO_DIR_OPENDIR);
   }
 
+  lookup_fs = fs;
+
   /* Find the first non-NULL custom opendir handler.  If there are none,
    * use the system opendir.
    */
@@ -3825,6 +4700,9 @@ void *pr_fsio_opendir(const char *path) {
   fsod->pool = fsod_pool;
   fsod->dir = res;
   fsod->fsdir = fs;
+  fsod->dir_path = pstrdup(fsod_pool, path);
+  fsod->dir_fd = fs_get_dir_fd(lookup_fs, fs, res, path);
+  fsod->dir_fs_map_gen = fs_map_gen;
   fsod->next = NULL;
   fsod->prev = NULL;
 
@@ -3951,6 +4829,182 @@ struct dirent *pr_fsio_readdir(void *dir) {
   return res;
 }
 
+static fsopendir_t *fs_find_opendir(void *dir) {
+  fsopendir_t *fsod;
+
+  for (fsod = fsopendir_list; fsod; fsod = fsod->next) {
+    if (fsod->dir != NULL &&
+        fsod->dir == dir) {
+      return fsod;
+    }
+  }
+
+  errno = ENOTDIR;
+  return NULL;
+}
+
+int pr_fsio_statat(void *dir, const char *name, struct stat *st, int flags) {
+  fsopendir_t *fsod;
+  pr_fs_t *fs;
+  int (*mystat)(pr_fs_t *, const char *, struct stat *);
+  char path[PR_TUNABLE_PATH_MAX+1];
+  size_t dir_pathlen;
+
+  if (dir == NULL ||
+      name == NULL ||
+      st == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  fsod = fs_find_opendir(dir);
+  if (fsod == NULL) {
+    return -1;
+  }
+
+#ifdef PR_USE_FSIO_STATAT
+  /* A pr_fs_t registered since the directory was opened may handle some of
+   * its entries.
+   */
+  if (fsod->dir_fd >= 0 &&
+      fsod->dir_fs_map_gen != fs_map_gen) {
+    fsod->dir_fd = -1;
+  }
+
+  if (fsod->dir_fd >= 0 &&
+      strchr(name, '/') == NULL) {
+    return fstatat(fsod->dir_fd, name, st,
+      (flags & PR_FSIO_STATAT_FL_NOFOLLOW) ? AT_SYMLINK_NOFOLLOW : 0);
+  }
+#endif /* PR_USE_FSIO_STATAT */
+
+  /* Fall back to looking up the entry by path. */
+  dir_pathlen = strlen(fsod->dir_path);
+  if (dir_pathlen > 0 &&
+      fsod->dir_path[dir_pathlen-1] == '/') {
+    pr_snprintf(path, sizeof(path), "%s%s", fsod->dir_path, name);
+
+  } else {
+    pr_snprintf(path, sizeof(path), "%s/%s", fsod->dir_path, name);
+  }
+
+  /* As with fstatat(2), the statcache is neither used nor populated. */
+  if (flags & PR_FSIO_STATAT_FL_NOFOLLOW) {
+    fs = lookup_file_fs(path, NULL, FSIO_FILE_LSTAT);
+    if (fs == NULL) {
+      return -1;
+    }
+
+    while (fs && fs->fs_next && !fs->lstat) {
+      fs = fs->fs_next;
+    }
+
+    mystat = fs->lstat ? fs->lstat : sys_lstat;
+
+  } else {
+    fs = lookup_file_fs(path, NULL, FSIO_FILE_STAT);
+    if (fs == NULL) {
+      return -1;
+    }
+
+    while (fs && fs->fs_next && !fs->stat) {
+      fs = fs->fs_next;
+    }
+
+    mystat = fs->stat ? fs->stat : sys_stat;
+  }
+
+  pr_trace_msg(trace_channel, 8, "using %s %s() for path '%s'", fs->fs_name,
+    (flags & PR_FSIO_STATAT_FL_NOFOLLOW) ? "lstat" : "stat", path);
+  return (mystat)(fs, path, st);
+}
+
+pr_fs_dirent_t *pr_fsio_readdir2(void *dir, int flags) {
+  fsopendir_t *fsod;
+  pr_fs_t *fs;
+  struct dirent *de;
+  pr_fs_dirent_t *dent;
+
+  if (dir == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  fsod = fs_find_opendir(dir);
+  if (fsod == NULL) {
+    return NULL;
+  }
+
+  /* Find the first non-NULL custom readdir handler.  If there are none,
+   * use the system readdir.
+   */
+  fs = fsod->fsdir;
+  while (fs && fs->fs_next && !fs->readdir) {
+    fs = fs->fs_next;
+  }
+
+  de = (fs->readdir)(fs, dir);
+  if (de == NULL) {
+    return NULL;
+  }
+
+  dent = &(fsod->dent);
+  dent->name = de->d_name;
+  dent->type = 0;
+  dent->st_errno = 0;
+
+#ifdef DT_UNKNOWN
+  switch (de->d_type) {
+    case DT_REG:
+      dent->type = S_IFREG;
+      break;
+
+    case DT_DIR:
+      dent->type = S_IFDIR;
+      break;
+
+    case DT_LNK:
+      dent->type = S_IFLNK;
+      break;
+
+    case DT_FIFO:
+      dent->type = S_IFIFO;
+      break;
+
+    case DT_SOCK:
+      dent->type = S_IFSOCK;
+      break;
+
+    case DT_CHR:
+      dent->type = S_IFCHR;
+      break;
+
+    case DT_BLK:
+      dent->type = S_IFBLK;
+      break;
+
+    default:
+      break;
+  }
+#endif /* DT_UNKNOWN */
+
+  if (flags & (PR_FSIO_READDIR_FL_STAT|PR_FSIO_READDIR_FL_LSTAT)) {
+    int res;
+
+    res = pr_fsio_statat(dir, dent->name, &(dent->st),
+      (flags & PR_FSIO_READDIR_FL_LSTAT) ? PR_FSIO_STATAT_FL_NOFOLLOW : 0);
+    if (res < 0) {
+      dent->st_errno = errno;
+
+    } else if (dent->type == 0 ||
+               !(flags & PR_FSIO_READDIR_FL_LSTAT)) {
+      dent->type = (dent->st.st_mode & S_IFMT);
+    }
+  }
+
+  return dent;
+}
+
 int pr_fsio_mkdir(const char *path, mode_t mode) {
   int res, xerrno;
   pr_fs_t *fs;
@@ -3996,7 +5050,8 @@ int pr_fsio_mkdir(const char *path, mode_t mode) {
   xerrno = errno;
 
   if (res == 0) {
-    pr_fs_clear_cache2(path);
+    fs_statcache_invalidate(path, FS_STATCACHE_FL_PARENT);
+    fs_dentry_flush();
   }
 
   if (dir_umask != (mode_t) -1) {
@@ -4522,7 +5577,8 @@ int pr_fsio_smkdir(pool *p, const char *path, mode_t mode, uid_t uid,
     }
   }
 
-  pr_fs_clear_cache2(path);
+  fs_statcache_invalidate(path, FS_STATCACHE_FL_PARENT);
+  fs_dentry_flush();
   return 0;
 }
 
@@ -4551,7 +5607,8 @@ int pr_fsio_rmdir(const char *path) {
     path);
   res = (fs->rmdir)(fs, path);
   if (res == 0) {
-    pr_fs_clear_cache2(path);
+    fs_statcache_invalidate(path, FS_STATCACHE_FL_PARENT|FS_STATCACHE_FL_SUBDIR);
+    fs_dentry_flush();
   }
 
   return res;
@@ -4801,8 +5858,9 @@ int pr_fsio_rename(const char *rnfr, const char *rnto) {
     fs->fs_name, rnfr, rnto);
   res = (fs->rename)(fs, rnfr, rnto);
   if (res == 0) {
-    pr_fs_clear_cache2(rnfr);
-    pr_fs_clear_cache2(rnto);
+    fs_statcache_invalidate(rnfr, FS_STATCACHE_FL_PARENT|FS_STATCACHE_FL_SUBDIR);
+    fs_statcache_invalidate(rnto, FS_STATCACHE_FL_PARENT|FS_STATCACHE_FL_SUBDIR);
+    fs_dentry_flush();
   }
 
   return res;
@@ -4856,7 +5914,8 @@ int pr_fsio_unlink(const char *name) {
     fs->fs_name, name);
   res = (fs->unlink)(fs, name);
   if (res == 0) {
-    pr_fs_clear_cache2(name);
+    fs_statcache_invalidate(name, FS_STATCACHE_FL_PARENT);
+    fs_dentry_flush();
   }
 
   return res;
@@ -4933,7 +5992,7 @@ pr_fh_t *pr_fsio_open_canon(const char *name, int flags) {
 
   if ((flags & O_CREAT) ||
       (flags & O_TRUNC)) {
-    pr_fs_clear_cache2(name);
+    fs_statcache_invalidate(name, (flags & O_CREAT) ? FS_STATCACHE_FL_PARENT : 0);
   }
 
   if (fcntl(fh->fh_fd, F_SETFD, FD_CLOEXEC) < 0) {
@@ -4994,7 +6053,7 @@ pr_fh_t *pr_fsio_open(const char *name, int flags) {
 
   if ((flags & O_CREAT) ||
       (flags & O_TRUNC)) {
-    pr_fs_clear_cache2(name);
+    fs_statcache_invalidate(name, (flags & O_CREAT) ? FS_STATCACHE_FL_PARENT : 0);
   }
 
   if (fcntl(fh->fh_fd, F_SETFD, FD_CLOEXEC) < 0) {
@@ -5276,7 +6335,9 @@ int pr_fsio_link(const char *target_path, const char *link_path) {
     fs->fs_name, target_path, link_path);
   res = (fs->link)(fs, target_path, link_path);
   if (res == 0) {
-    pr_fs_clear_cache2(link_path);
+    pr_fs_clear_cache2(target_path);
+    fs_statcache_invalidate(link_path, FS_STATCACHE_FL_PARENT);
+    fs_dentry_flush();
   }
 
   return res;
@@ -5308,7 +6369,8 @@ int pr_fsio_symlink(const char *target_path, const char *link_path) {
     fs->fs_name, link_path);
   res = (fs->symlink)(fs, target_path, link_path);
   if (res == 0) {
-    pr_fs_clear_cache2(link_path);
+    fs_statcache_invalidate(link_path, FS_STATCACHE_FL_PARENT);
+    fs_dentry_flush();
   }
 
   return res;
@@ -6084,6 +7146,10 @@ int pr_fsio_removexattr(pool *p, const char *path, const char *name) {
   pr_trace_msg(trace_channel, 8, "using %s removexattr() for path '%s'",
     fs->fs_name, path);
   res = (fs->removexattr)(p, fs, path, name);
+  if (res == 0) {
+    pr_fs_clear_cache2(path);
+  }
+
   return res;
 }
 
@@ -6118,6 +7184,10 @@ int pr_fsio_lremovexattr(pool *p, const char *path, const char *name) {
   pr_trace_msg(trace_channel, 8, "using %s lremovexattr() for path '%s'",
     fs->fs_name, path);
   res = (fs->lremovexattr)(p, fs, path, name);
+  if (res == 0) {
+    pr_fs_clear_cache2(path);
+  }
+
   return res;
 }
 
@@ -6148,6 +7218,10 @@ int pr_fsio_fremovexattr(pool *p, pr_fh_t *fh, const char *name) {
   pr_trace_msg(trace_channel, 8, "using %s fremovexattr() for path '%s'",
     fs->fs_name, fh->fh_path);
   res = (fs->fremovexattr)(p, fh, fh->fh_fd, name);
+  if (res == 0) {
+    pr_fs_clear_cache2(fh->fh_path);
+  }
+
   return res;
 }
 
@@ -6183,6 +7257,10 @@ int pr_fsio_setxattr(pool *p, const char *path, const char *name, void *val,
   pr_trace_msg(trace_channel, 8, "using %s setxattr() for path '%s'",
     fs->fs_name, path);
   res = (fs->setxattr)(p, fs, path, name, val, valsz, flags);
+  if (res == 0) {
+    pr_fs_clear_cache2(path);
+  }
+
   return res;
 }
 
@@ -6218,6 +7296,10 @@ int pr_fsio_lsetxattr(pool *p, const char *path, const char *name, void *val,
   pr_trace_msg(trace_channel, 8, "using %s lsetxattr() for path '%s'",
     fs->fs_name, path);
   res = (fs->lsetxattr)(p, fs, path, name, val, valsz, flags);
+  if (res == 0) {
+    pr_fs_clear_cache2(path);
+  }
+
   return res;
 }
 
@@ -6249,6 +7331,10 @@ int pr_fsio_fsetxattr(pool *p, pr_fh_t *fh, const char *name, void *val,
   pr_trace_msg(trace_channel, 8, "using %s fsetxattr() for path '%s'",
     fs->fs_name, fh->fh_path);
   res = (fs->fsetxattr)(p, fh, fh->fh_fd, name, val, valsz, flags);
+  if (res == 0) {
+    pr_fs_clear_cache2(fh->fh_path);
+  }
+
   return res;
 }
 
@@ -6285,6 +7371,10 @@ int pr_fsio_chroot(const char *path) {
   if (res == 0) {
     unsigned int iter_start = 0;
 
+    /* Paths are now resolved beneath the new root. */
+    fs_close_root_fd();
+    fs_dentry_flush();
+
     /* The filesystem handles in fs_map need to be readjusted to the new root.
      */
     register unsigned int i = 0;
@@ -6350,6 +7440,8 @@ int pr_fsio_chroot(const char *path) {
 
     fs_map = new_map;
     chk_fs_map = TRUE;
+    fs_map_gen++;
+    fs_dentry_flush();
   }
 
   errno = xerrno;
@@ -6612,6 +7704,8 @@ void pr_fs_close_extra_fds(void) {
     nfiles = FSIO_MAX_FD_COUNT;
   }
 
+  fs_close_root_fd();
+
   /* Close the "non-standard" file descriptors. */
   for (i = 3; i < nfiles; i++) {
     /* This is a potentially long-running loop, so handle signals. */
@@ -7027,6 +8121,138 @@ void pr_fs_fadvise(int fd, off_t offset, off_t len, int advice) {
   return;
 }
 
+int pr_fs_sync_range(int fd, off_t offset, off_t len, int flags) {
+  int res;
+
+  if (fd < 0 ||
+      offset < 0 ||
+      len < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (flags & PR_FS_SYNC_RANGE_DATASYNC) {
+#if defined(HAVE_FDATASYNC)
+    res = fdatasync(fd);
+#else
+    res = fsync(fd);
+#endif /* HAVE_FDATASYNC */
+    if (res < 0) {
+      int xerrno = errno;
+
+      pr_trace_msg(trace_channel, 3, "error syncing data for fd %d: %s", fd,
+        strerror(xerrno));
+
+      errno = xerrno;
+      return -1;
+    }
+
+    return 0;
+  }
+
+  if (!(flags & (PR_FS_SYNC_RANGE_WRITE|PR_FS_SYNC_RANGE_WAIT))) {
+    errno = EINVAL;
+    return -1;
+  }
+
+#if defined(SYNC_FILE_RANGE_WRITE)
+  {
+    unsigned int sync_flags;
+
+    /* Waiting for a section means writing out any pages in it which are
+     * still dirty, too.
+     */
+    sync_flags = SYNC_FILE_RANGE_WRITE;
+    if (flags & PR_FS_SYNC_RANGE_WAIT) {
+      sync_flags |= (SYNC_FILE_RANGE_WAIT_BEFORE|SYNC_FILE_RANGE_WAIT_AFTER);
+    }
+
+    res = sync_file_range(fd, offset, len, sync_flags);
+    if (res < 0) {
+      int xerrno = errno;
+
+      pr_trace_msg(trace_channel, 3,
+        "sync_file_range() error on fd %d (off %" PR_LU ", len %" PR_LU
+        ", %s): %s", fd, (pr_off_t) offset, (pr_off_t) len,
+        flags & PR_FS_SYNC_RANGE_WAIT ? "WAIT" : "WRITE", strerror(xerrno));
+
+      errno = xerrno;
+      return -1;
+    }
+
+    return 0;
+  }
+#else
+  errno = ENOSYS;
+  return -1;
+#endif /* SYNC_FILE_RANGE_WRITE */
+}
+
+int pr_fs_allocate(int fd, off_t offset, off_t len, int flags) {
+#if defined(FALLOC_FL_KEEP_SIZE)
+  int res, xerrno;
+
+  if (fd < 0 ||
+      offset < 0 ||
+      len <= 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (flags & PR_FS_ALLOCATE_FL_DEALLOCATE) {
+    struct stat st;
+
+    if (fstat(fd, &st) < 0) {
+      return -1;
+    }
+
+    if (offset >= st.st_size) {
+      /* Filesystems (e.g. ext4) do not punch holes beyond the end of the
+       * file, but do release the blocks there when the file is truncated to
+       * its current size.
+       */
+      res = ftruncate(fd, st.st_size);
+
+    } else {
+# if defined(FALLOC_FL_PUNCH_HOLE)
+      res = fallocate(fd, FALLOC_FL_KEEP_SIZE|FALLOC_FL_PUNCH_HOLE, offset,
+        len);
+# else
+      errno = ENOSYS;
+      res = -1;
+# endif /* FALLOC_FL_PUNCH_HOLE */
+    }
+
+  } else {
+    res = fallocate(fd, FALLOC_FL_KEEP_SIZE, offset, len);
+  }
+
+  if (res < 0) {
+    xerrno = errno;
+
+    pr_trace_msg(trace_channel, 3,
+      "error %sallocating fd %d (off %" PR_LU ", len %" PR_LU "): %s",
+      flags & PR_FS_ALLOCATE_FL_DEALLOCATE ? "de" : "", fd, (pr_off_t) offset,
+      (pr_off_t) len, strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  return 0;
+#else
+  if (fd < 0 ||
+      offset < 0 ||
+      len <= 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  errno = ENOSYS;
+  return -1;
+#endif /* FALLOC_FL_KEEP_SIZE */
+}
+
 int pr_fs_have_access(struct stat *st, int mode, uid_t uid, gid_t gid,
     array_header *suppl_gids) {
   mode_t mask;
@@ -0,0 +1,620 @@
+/*
+ * ProFTPD - FTP server daemon
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project and other respective copyright
+ * holders give permission to link this program with OpenSSL, and distribute
+ * the resulting executable, without including the source code for OpenSSL in
+ * the source distribution.
+ */
+
+/* Rendered directory listing cache */
+
+#include "conf.h"
+
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+
+/* The cached listings live in an anonymous shared mapping, created by the
+ * daemon before any session processes are forked.  The mapping holds a
+ * small hash table of slots, and a ring buffer of entries.  Adding a listing
+ * reserves the next section of the ring (overwriting the oldest entries),
+ * copies the key and listing into it, and then points the slot for that key
+ * at the new entry.  Nothing is ever locked: a slot carries a generation
+ * number, odd while the slot is being changed, and an entry is known to be
+ * intact as long as the ring's head has not moved more than a ring's length
+ * past it.  Readers copy the entry out, and then check that neither has
+ * changed underneath them.
+ */
+
+#define LISTCACHE_MIN_SIZE		(64 * 1024)
+#define LISTCACHE_SLOT_SIZE		4096
+#define LISTCACHE_MIN_NSLOTS		64
+#define LISTCACHE_MAX_NSLOTS		65536
+
+#if defined(__GNUC__)
+# define LISTCACHE_BARRIER()		__sync_synchronize()
+# define LISTCACHE_ATOMIC_CAS(v, o, n)	\
+  __sync_bool_compare_and_swap(&(v), (o), (n))
+#endif
+
+struct listcache_slot {
+  /* Odd while the slot is being changed. */
+  volatile uint32_t ls_gen;
+
+  uint32_t ls_hash;
+
+  /* Position of the entry in the ring, counted from the start of the ring
+   * when the cache was allocated, and the length of the entry.
+   */
+  uint64_t ls_offset;
+  uint32_t ls_len;
+};
+
+struct listcache_entry {
+  int64_t le_added;
+  uint32_t le_hash;
+  uint32_t le_keylen;
+  uint32_t le_datalen;
+
+  /* The key, its terminating NUL, and then the listing follow. */
+};
+
+struct listcache_table {
+  /* Position of the next free byte in the ring; see ls_offset. */
+  volatile uint64_t lt_head;
+
+  uint32_t lt_nslots;
+  uint64_t lt_ringsz;
+};
+
+static struct listcache_table *listcache_tab = NULL;
+static size_t listcache_tabsz = 0;
+static struct listcache_slot *listcache_slots = NULL;
+static char *listcache_ring = NULL;
+
+static const char *trace_channel = "listcache";
+
+static uint32_t listcache_hash(const char *key) {
+  const unsigned char *ptr;
+  uint32_t h = 2166136261UL;
+
+  /* FNV-1a */
+  for (ptr = (const unsigned char *) key; *ptr; ptr++) {
+    h ^= *ptr;
+    h *= 16777619UL;
+  }
+
+  return h;
+}
+
+int pr_listcache_enabled(void) {
+  return (listcache_tab != NULL);
+}
+
+int pr_listcache_engine_enabled(void) {
+  config_rec *c;
+
+  if (listcache_tab == NULL) {
+    return FALSE;
+  }
+
+  c = find_config(CURRENT_CONF, CONF_PARAM, "ListCacheEngine", FALSE);
+  if (c == NULL ||
+      *((int *) c->argv[0]) != TRUE) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+size_t pr_listcache_get_max_size(void) {
+  if (listcache_tab == NULL) {
+    return 0;
+  }
+
+  /* Keep each listing well below the size of the ring, so that adding one
+   * large listing does not evict everything else.
+   */
+  return (size_t) (listcache_tab->lt_ringsz / 4);
+}
+
+const char *pr_listcache_get_key(pool *p, const char *cmd_name,
+    const char *path, const struct stat *st, const char *opts) {
+  register unsigned int i;
+  char buf[512];
+  const char *charset, *class_name, *remote_ip, *key;
+  xaset_t *dir_conf;
+
+  if (p == NULL ||
+      cmd_name == NULL ||
+      path == NULL ||
+      st == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  if (opts == NULL) {
+    opts = "";
+  }
+
+  /* The configuration in effect for the directory determines e.g. the
+   * HideFiles, HideNoAccess, and <Limit> rules applied to its entries.
+   * Configuration records are not reallocated until the daemon restarts
+   * (which clears the cache), and session processes inherit them from the
+   * daemon, so the address identifies the configuration.  The configuration
+   * for the session's current directory (e.g. for ListOptions) is included,
+   * too.
+   */
+  dir_conf = get_dir_ctxt(p, (char *) path);
+
+  class_name = session.conn_class != NULL ? session.conn_class->cls_name : "";
+
+  /* <Limit> sections with Allow/Deny from rules make what is visible depend
+   * on the client's address.
+   */
+  remote_ip = NULL;
+  if (session.c != NULL &&
+      session.c->remote_addr != NULL) {
+    remote_ip = pr_netaddr_get_ipstr(session.c->remote_addr);
+  }
+
+  if (remote_ip == NULL) {
+    remote_ip = "";
+  }
+
+#ifdef PR_USE_NLS
+  charset = pr_encode_get_charset();
+#else
+  charset = NULL;
+#endif /* PR_USE_NLS */
+  if (charset == NULL) {
+    charset = "";
+  }
+
+  pr_snprintf(buf, sizeof(buf),
+    "%lu:%lu:%lu:%lu:%lu:%lu:%lu:%o:%u:%p:%p:%p:%p:%lu:%lu",
+    (unsigned long) st->st_dev, (unsigned long) st->st_ino,
+    (unsigned long) st->st_mtime, (unsigned long) st->st_ctime,
+    (unsigned long) st->st_uid, (unsigned long) st->st_gid,
+    (unsigned long) st->st_nlink, (unsigned int) st->st_mode,
+    main_server->sid, main_server, session.anon_config, session.dir_config,
+    dir_conf,
+    (unsigned long) session.uid, (unsigned long) session.gid);
+
+  key = pstrcat(p, cmd_name, "\n", path, "\n", buf, "\n", opts, "\n",
+    session.user != NULL ? session.user : "", "\n", class_name, "\n",
+    remote_ip, "\n", session.chroot_path != NULL ? session.chroot_path : "",
+    "\n", charset, "\n", NULL);
+
+  if (session.gids != NULL) {
+    gid_t *gids;
+
+    gids = session.gids->elts;
+    for (i = 0; i < session.gids->nelts; i++) {
+      pr_snprintf(buf, sizeof(buf), "%lu,", (unsigned long) gids[i]);
+      key = pstrcat(p, key, buf, NULL);
+    }
+  }
+
+  return key;
+}
+
+static struct listcache_slot *listcache_get_slot(uint32_t hash) {
+  return &(listcache_slots[hash % listcache_tab->lt_nslots]);
+}
+
+/* Returns TRUE if the ring entry at the given offset has not been overwritten
+ * (or reserved for overwriting) since it was added.
+ */
+static int listcache_entry_intact(uint64_t offset) {
+  uint64_t head;
+
+  head = listcache_tab->lt_head;
+  return (head <= offset + listcache_tab->lt_ringsz);
+}
+
+int pr_listcache_get(pool *p, const char *key, time_t max_age,
+    char **data, size_t *datalen) {
+#if defined(LISTCACHE_BARRIER)
+  struct listcache_slot *slot;
+  struct listcache_entry *entry;
+  uint32_t gen, hash, len;
+  uint64_t offset;
+  size_t keylen;
+  char *buf;
+  time_t now;
+
+  if (p == NULL ||
+      key == NULL ||
+      data == NULL ||
+      datalen == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (listcache_tab == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  hash = listcache_hash(key);
+  slot = listcache_get_slot(hash);
+
+  gen = slot->ls_gen;
+  LISTCACHE_BARRIER();
+
+  if (gen == 0 ||
+      (gen & 1) ||
+      slot->ls_hash != hash) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  offset = slot->ls_offset;
+  len = slot->ls_len;
+
+  /* The slot may be changed while we read it, so make sure that the entry
+   * lies within the ring before reading it.
+   */
+  if (len < sizeof(struct listcache_entry) ||
+      (offset % listcache_tab->lt_ringsz) + len > listcache_tab->lt_ringsz ||
+      listcache_entry_intact(offset) == FALSE) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  /* Copy the entry out of the ring, then make sure that it was not changed
+   * while we copied it.
+   */
+  buf = palloc(p, len + 1);
+  memcpy(buf, listcache_ring + (offset % listcache_tab->lt_ringsz), len);
+  buf[len] = '\0';
+
+  LISTCACHE_BARRIER();
+  if (slot->ls_gen != gen ||
+      listcache_entry_intact(offset) == FALSE) {
+    pr_trace_msg(trace_channel, 17, "entry changed while being read, "
+      "ignoring");
+    errno = ENOENT;
+    return -1;
+  }
+
+  entry = (struct listcache_entry *) buf;
+  keylen = strlen(key);
+
+  if (entry->le_hash != hash ||
+      entry->le_keylen != keylen ||
+      sizeof(struct listcache_entry) + keylen + 1 + entry->le_datalen != len ||
+      memcmp(buf + sizeof(struct listcache_entry), key, keylen + 1) != 0) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  now = time(NULL);
+  if (max_age > 0 &&
+      now - (time_t) entry->le_added > max_age) {
+    pr_trace_msg(trace_channel, 15, "cached listing is %lu secs old, "
+      "ignoring", (unsigned long) (now - (time_t) entry->le_added));
+    errno = ENOENT;
+    return -1;
+  }
+
+  *data = buf + sizeof(struct listcache_entry) + keylen + 1;
+  *datalen = entry->le_datalen;
+
+  return 0;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif /* !LISTCACHE_BARRIER */
+}
+
+int pr_listcache_lookup(pool *p, const char *cmd_name, const char *path,
+    const struct stat *st, const char *opts, const char **key, char **data,
+    size_t *datalen) {
+  config_rec *c;
+  const char *cache_key;
+  time_t max_age = PR_LISTCACHE_DEFAULT_MAX_AGE, now;
+
+  if (key == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  *key = NULL;
+
+  if (pr_listcache_engine_enabled() == FALSE) {
+    errno = EPERM;
+    return -1;
+  }
+
+  cache_key = pr_listcache_get_key(p, cmd_name, path, st, opts);
+  if (cache_key == NULL) {
+    return -1;
+  }
+
+  c = find_config(CURRENT_CONF, CONF_PARAM, "ListCacheMaxAge", FALSE);
+  if (c != NULL) {
+    max_age = *((time_t *) c->argv[0]);
+  }
+
+  if (pr_listcache_get(p, cache_key, max_age, data, datalen) == 0) {
+    return 0;
+  }
+
+  /* A directory changed within the current second could change again,
+   * without changing its timestamps, while it is being listed; don't cache
+   * its listing.
+   */
+  now = time(NULL);
+  if (st->st_mtime >= now ||
+      st->st_ctime >= now) {
+    pr_trace_msg(trace_channel, 15, "'%s' changed too recently, not caching "
+      "listing", path);
+    errno = ENOENT;
+    return -1;
+  }
+
+  *key = cache_key;
+  errno = ENOENT;
+  return -1;
+}
+
+int pr_listcache_add(const char *key, const char *data, size_t datalen) {
+#if defined(LISTCACHE_BARRIER)
+  struct listcache_slot *slot;
+  struct listcache_entry entry;
+  uint32_t gen, hash;
+  uint64_t head, offset, ringsz;
+  size_t keylen, len;
+  char *ptr;
+
+  if (key == NULL ||
+      (data == NULL && datalen > 0)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (listcache_tab == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  keylen = strlen(key);
+  len = sizeof(struct listcache_entry) + keylen + 1 + datalen;
+
+  if (datalen > pr_listcache_get_max_size() ||
+      len > listcache_tab->lt_ringsz) {
+    errno = EFBIG;
+    return -1;
+  }
+
+  ringsz = listcache_tab->lt_ringsz;
+
+  /* Keep the entries aligned. */
+  len = (len + 7) & ~((size_t) 7);
+
+  /* Reserve the next section of the ring.  Entries never wrap around the
+   * end of the ring; if the entry does not fit before the end, the rest of
+   * the ring is skipped.
+   */
+  do {
+    uint64_t pos;
+
+    head = listcache_tab->lt_head;
+
+    offset = head;
+    pos = head % ringsz;
+    if (pos + len > ringsz) {
+      offset += (ringsz - pos);
+    }
+
+  } while (!LISTCACHE_ATOMIC_CAS(listcache_tab->lt_head, head, offset + len));
+
+  memset(&entry, 0, sizeof(entry));
+  entry.le_added = (int64_t) time(NULL);
+  entry.le_hash = hash = listcache_hash(key);
+  entry.le_keylen = keylen;
+  entry.le_datalen = datalen;
+
+  ptr = listcache_ring + (offset % ringsz);
+  memcpy(ptr, &entry, sizeof(entry));
+  memcpy(ptr + sizeof(entry), key, keylen + 1);
+  if (datalen > 0) {
+    memcpy(ptr + sizeof(entry) + keylen + 1, data, datalen);
+  }
+
+  /* Point the slot at the new entry, unless another session is doing the
+   * same at the moment.
+   */
+  slot = listcache_get_slot(hash);
+
+  gen = slot->ls_gen;
+  if ((gen & 1) ||
+      !LISTCACHE_ATOMIC_CAS(slot->ls_gen, gen, gen + 1)) {
+    pr_trace_msg(trace_channel, 15, "slot busy, not adding listing");
+    errno = EAGAIN;
+    return -1;
+  }
+
+  LISTCACHE_BARRIER();
+  slot->ls_hash = hash;
+  slot->ls_offset = offset;
+  slot->ls_len = sizeof(entry) + keylen + 1 + datalen;
+  LISTCACHE_BARRIER();
+  slot->ls_gen = gen + 2;
+
+  pr_trace_msg(trace_channel, 17, "added listing (%lu bytes) at offset %"
+    PR_LU, (unsigned long) datalen, (pr_off_t) offset);
+  return 0;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif /* !LISTCACHE_BARRIER */
+}
+
+int pr_listcache_append(pool *p, pr_listcache_buf_t *buf, const char *data,
+    size_t datalen) {
+  if (p == NULL ||
+      buf == NULL ||
+      (data == NULL && datalen > 0)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (buf->datalen + datalen > pr_listcache_get_max_size()) {
+    errno = EFBIG;
+    return -1;
+  }
+
+  if (buf->datalen + datalen > buf->datasz) {
+    char *new_data;
+    size_t new_datasz;
+
+    new_datasz = buf->datasz > 0 ? buf->datasz : 8192;
+    while (new_datasz < buf->datalen + datalen) {
+      new_datasz *= 2;
+    }
+
+    new_data = palloc(p, new_datasz);
+    if (buf->datalen > 0) {
+      memcpy(new_data, buf->data, buf->datalen);
+    }
+
+    buf->data = new_data;
+    buf->datasz = new_datasz;
+  }
+
+  if (datalen > 0) {
+    memcpy(buf->data + buf->datalen, data, datalen);
+    buf->datalen += datalen;
+  }
+
+  return 0;
+}
+
+int pr_listcache_clear(void) {
+  if (listcache_tab == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  /* Moving the head a full ring's length on leaves every entry looking
+   * overwritten, without touching the slots (which may be in use).
+   */
+#if defined(LISTCACHE_BARRIER)
+  (void) __sync_fetch_and_add(&(listcache_tab->lt_head),
+    listcache_tab->lt_ringsz);
+#endif /* LISTCACHE_BARRIER */
+
+  return 0;
+}
+
+int pr_listcache_free(void) {
+  if (listcache_tab == NULL) {
+    return 0;
+  }
+
+  if (munmap((void *) listcache_tab, listcache_tabsz) < 0) {
+    int xerrno = errno;
+
+    pr_trace_msg(trace_channel, 1, "error detaching listing cache: %s",
+      strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  listcache_tab = NULL;
+  listcache_tabsz = 0;
+  listcache_slots = NULL;
+  listcache_ring = NULL;
+
+  return 0;
+}
+
+int pr_listcache_init(size_t size) {
+  void *data;
+  int mmap_flags;
+  uint32_t nslots;
+  size_t tabsz;
+
+  if (size < LISTCACHE_MIN_SIZE) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  (void) pr_listcache_free();
+
+#if !defined(LISTCACHE_BARRIER)
+  pr_log_debug(DEBUG0, "atomic operations not supported, not caching "
+    "directory listings");
+  errno = ENOSYS;
+  return -1;
+#endif /* LISTCACHE_BARRIER */
+
+  mmap_flags = MAP_SHARED;
+#if defined(MAP_ANONYMOUS)
+  mmap_flags |= MAP_ANONYMOUS;
+#elif defined(MAP_ANON)
+  mmap_flags |= MAP_ANON;
+#else
+  pr_log_debug(DEBUG0, "mmap(2) MAP_ANONYMOUS and MAP_ANON flags not defined, "
+    "not caching directory listings");
+  errno = ENOSYS;
+  return -1;
+#endif
+
+  nslots = size / LISTCACHE_SLOT_SIZE;
+  if (nslots < LISTCACHE_MIN_NSLOTS) {
+    nslots = LISTCACHE_MIN_NSLOTS;
+
+  } else if (nslots > LISTCACHE_MAX_NSLOTS) {
+    nslots = LISTCACHE_MAX_NSLOTS;
+  }
+
+  tabsz = sizeof(struct listcache_table) +
+    (nslots * sizeof(struct listcache_slot)) + size;
+
+  data = mmap(NULL, tabsz, PROT_READ|PROT_WRITE, mmap_flags, -1, 0);
+  if (data == MAP_FAILED) {
+    int xerrno = errno;
+
+    pr_log_debug(DEBUG0, "error allocating %lu bytes for listing cache: %s",
+      (unsigned long) tabsz, strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  /* Anonymous mappings are already zeroed. */
+  listcache_tab = data;
+  listcache_tabsz = tabsz;
+  listcache_tab->lt_nslots = nslots;
+  listcache_tab->lt_ringsz = size;
+
+  listcache_slots = (struct listcache_slot *) (((char *) data) +
+    sizeof(struct listcache_table));
+  listcache_ring = ((char *) listcache_slots) +
+    (nslots * sizeof(struct listcache_slot));
+
+  pr_trace_msg(trace_channel, 9, "allocated listing cache of %lu bytes "
+    "(%lu slots)", (unsigned long) size, (unsigned long) nslots);
+  return 0;
+}
@@ -91,6 +91,37 @@ static cmd_rec *make_ftp_cmd(pool *p, char *buf, size_t buflen, int flags);
 
 static const char *config_filename = PR_CONFIG_FILE_PATH;
 
+/* Start of the current startup phase, for the phase timings reported at
+ * DEBUG10 (e.g. by `proftpd -t -d10`).
+ */
+static uint64_t startup_phase_ms = 0;
+
+static void log_startup_phase(const char *phase) {
+  uint64_t now_ms = 0;
+
+  if (pr_gettimeofday_millis(&now_ms) < 0) {
+    return;
+  }
+
+  if (phase != NULL) {
+    pr_log_debug(DEBUG10, "startup: %s took %lu ms", phase,
+      (unsigned long) (now_ms - startup_phase_ms));
+  }
+
+  startup_phase_ms = now_ms;
+}
+
+static unsigned int count_servers(xaset_t *list) {
+  server_rec *s;
+  unsigned int count = 0;
+
+  for (s = (server_rec *) list->xas_list; s; s = s->next) {
+    count++;
+  }
+
+  return count;
+}
+
 /* Add child semaphore fds into the rfd for selecting */
 static int semaphore_fds(fd_set *rfd, int maxfd) {
   if (child_count()) {
@@ -139,6 +170,8 @@ void session_exit(int pri, void *lv, int exitval, void *dummy) {
     if (!nodaemon)
       pr_pidfile_remove();
     PRIVS_RELINQUISH
+
+    pr_metrics_close();
   }
 
   pr_session_end(0);
@@ -205,58 +238,60 @@ void shutdown_end_session(void *d1, void *d2, void *d3, void *d4) {
   }
 }
 
-static int get_command_class(const char *name) {
-  int idx = -1;
-  unsigned int hash = 0;
-  cmdtable *c;
+static int get_command_class(const char *name, int cmd_id) {
+  cmdtable **handlers;
 
-  c = pr_stash_get_symbol2(PR_SYM_CMD, name, NULL, &idx, &hash);
-  while (c && c->cmd_type != CMD) {
-    pr_signals_handle();
-    c = pr_stash_get_symbol2(PR_SYM_CMD, name, c, &idx, &hash);
-  }
+  handlers = pr_stash_get_cmd_handlers(name, cmd_id, CMD);
 
   /* By default, every command has a class of CL_ALL.  This insures that
    * any configured ExtendedLogs that default to "all" will log the command.
    */
-  return (c ? c->cmd_class : CL_ALL);
+  return (handlers && handlers[0] ? handlers[0]->cmd_class : CL_ALL);
+}
+
+/* Returns the name under which to record the latency of the command, or
+ * NULL if it should not be recorded.  Only the names of commands which some
+ * module handles are used, so that clients cannot fill the statistics table
+ * with arbitrary names.
+ */
+static const char *get_stats_cmd_name(cmd_rec *cmd) {
+  if (cmd == NULL ||
+      cmd->argc == 0 ||
+      cmd->argv[0] == NULL) {
+    return NULL;
+  }
+
+  if (cmd->cmd_id > 0 ||
+      command_exists(cmd->argv[0])) {
+    return cmd->argv[0];
+  }
+
+  return NULL;
 }
 
 static int _dispatch(cmd_rec *cmd, int cmd_type, int validate, char *match) {
   const char *cmdargstr = NULL;
-  cmdtable *c;
+  cmdtable *c = NULL, **handlers;
   modret_t *mr;
+  register unsigned int i;
   int success = 0, xerrno = 0;
   int send_error = 0;
-  static int match_index_cache = -1;
-  static unsigned int match_hash_cache = 0;
-  static char *last_match = NULL;
-  int *index_cache = NULL;
-  unsigned int *hash_cache = NULL;
 
   send_error = (cmd_type == PRE_CMD || cmd_type == CMD ||
     cmd_type == POST_CMD_ERR);
 
   if (!match) {
-    match = cmd->argv[0];
-    index_cache = &cmd->stash_index;
-    hash_cache = &cmd->stash_hash;
+    handlers = pr_stash_get_cmd_handlers(cmd->argv[0], cmd->cmd_id, cmd_type);
 
   } else {
-    if (last_match != match) {
-      match_index_cache = -1;
-      last_match = match;
-    }
-
-    index_cache = &match_index_cache;
-    hash_cache = &match_hash_cache;
+    handlers = pr_stash_get_cmd_handlers(match, 0, cmd_type);
   }
 
-  c = pr_stash_get_symbol2(PR_SYM_CMD, match, NULL, index_cache, hash_cache);
-
-  while (c && !success) {
+  for (i = 0; handlers && handlers[i] && !success; i++) {
     size_t cmdargstrlen = 0;
 
+    c = handlers[i];
+
     pr_signals_handle();
 
     session.curr_cmd = cmd->argv[0];
@@ -264,159 +299,173 @@ static int _dispatch(cmd_rec *cmd, int cmd_type, int validate, char *match) {
     session.curr_cmd_rec = cmd;
     session.curr_phase = cmd_type;
 
-    if (c->cmd_type == cmd_type) {
-      if (c->group) {
-        cmd->group = pstrdup(cmd->pool, c->group);
-      }
+    if (c->group) {
+      cmd->group = pstrdup(cmd->pool, c->group);
+    }
 
-      if (c->requires_auth &&
-          cmd_auth_chk &&
-          !cmd_auth_chk(cmd)) {
-        pr_trace_msg("command", 8,
-          "command '%s' failed 'requires_auth' check for mod_%s.c",
-          (char *) cmd->argv[0], c->m->name);
-        errno = EACCES;
-        return -1;
-      }
+    if (c->requires_auth &&
+        cmd_auth_chk &&
+        !cmd_auth_chk(cmd)) {
+      pr_trace_msg("command", 8,
+        "command '%s' failed 'requires_auth' check for mod_%s.c",
+        (char *) cmd->argv[0], c->m->name);
+      errno = EACCES;
+      return -1;
+    }
 
-      if (cmd->tmp_pool == NULL) {
-        cmd->tmp_pool = make_sub_pool(cmd->pool);
-        pr_pool_tag(cmd->tmp_pool, "cmd_rec tmp pool");
-      }
+    if (cmd->tmp_pool == NULL) {
+      cmd->tmp_pool = make_sub_pool(cmd->pool);
+      pr_pool_tag(cmd->tmp_pool, "cmd_rec tmp pool");
+    }
 
-      cmdargstr = pr_cmd_get_displayable_str(cmd, &cmdargstrlen);
+    cmdargstr = pr_cmd_get_displayable_str(cmd, &cmdargstrlen);
 
-      if (cmd_type == CMD) {
+    if (cmd_type == CMD) {
 
-        /* The client has successfully authenticated... */
-        if (session.user) {
-          char *args = NULL;
+      /* The client has successfully authenticated... */
+      if (session.user) {
+        char *args = NULL;
 
-          /* Be defensive, and check whether cmdargstrlen has a value.
-           * If it's zero, assume we need to use strchr(3), rather than
-           * memchr(2); see Bug#3714.
-           */
-          if (cmdargstrlen > 0) {
-            args = memchr(cmdargstr, ' ', cmdargstrlen);
+        /* Be defensive, and check whether cmdargstrlen has a value.
+         * If it's zero, assume we need to use strchr(3), rather than
+         * memchr(2); see Bug#3714.
+         */
+        if (cmdargstrlen > 0) {
+          args = memchr(cmdargstr, ' ', cmdargstrlen);
 
-          } else {
-            args = strchr(cmdargstr, ' ');
-          }
+        } else {
+          args = strchr(cmdargstr, ' ');
+        }
 
-          pr_scoreboard_entry_update(session.pid,
-            PR_SCORE_CMD, "%s", cmd->argv[0], NULL, NULL);
-          pr_scoreboard_entry_update(session.pid,
-            PR_SCORE_CMD_ARG, "%s", args ? (args + 1) : "", NULL, NULL);
+        pr_scoreboard_entry_update(session.pid,
+          PR_SCORE_CMD, "%s", cmd->argv[0], NULL, NULL);
+        pr_scoreboard_entry_update(session.pid,
+          PR_SCORE_CMD_ARG, "%s", args ? (args + 1) : "", NULL, NULL);
 
-          pr_proctitle_set("%s - %s: %s", session.user, session.proc_prefix,
-            cmdargstr);
+        pr_proctitle_set("%s - %s: %s", session.user, session.proc_prefix,
+          cmdargstr);
 
-        /* ...else the client has not yet authenticated */
-        } else {
-          pr_proctitle_set("%s:%d: %s", session.c->remote_addr ?
-            pr_netaddr_get_ipstr(session.c->remote_addr) : "?",
-            session.c->remote_port ? session.c->remote_port : 0, cmdargstr);
-        }
+      /* ...else the client has not yet authenticated */
+      } else {
+        pr_proctitle_set("%s:%d: %s", session.c->remote_addr ?
+          pr_netaddr_get_ipstr(session.c->remote_addr) : "?",
+          session.c->remote_port ? session.c->remote_port : 0, cmdargstr);
       }
+    }
 
-      /* Skip logging the internal CONNECT/DISCONNECT commands. */
-      if (!(cmd->cmd_class & CL_CONNECT) &&
-          !(cmd->cmd_class & CL_DISCONNECT)) {
-
-        pr_log_debug(DEBUG4, "dispatching %s command '%s' to mod_%s",
-          (cmd_type == PRE_CMD ? "PRE_CMD" :
-           cmd_type == CMD ? "CMD" :
-           cmd_type == POST_CMD ? "POST_CMD" :
-           cmd_type == POST_CMD_ERR ? "POST_CMD_ERR" :
-           cmd_type == LOG_CMD ? "LOG_CMD" :
-           cmd_type == LOG_CMD_ERR ? "LOG_CMD_ERR" :
-           "(unknown)"),
-          cmdargstr, c->m->name);
-
-        pr_trace_msg("command", 7, "dispatching %s command '%s' to mod_%s.c",
-          (cmd_type == PRE_CMD ? "PRE_CMD" :
-           cmd_type == CMD ? "CMD" :
-           cmd_type == POST_CMD ? "POST_CMD" :
-           cmd_type == POST_CMD_ERR ? "POST_CMD_ERR" :
-           cmd_type == LOG_CMD ? "LOG_CMD" :
-           cmd_type == LOG_CMD_ERR ? "LOG_CMD_ERR" :
-           "(unknown)"),
-          cmdargstr, c->m->name);
-      }
+    /* Skip logging the internal CONNECT/DISCONNECT commands. */
+    if (!(cmd->cmd_class & CL_CONNECT) &&
+        !(cmd->cmd_class & CL_DISCONNECT)) {
 
-      cmd->cmd_class |= c->cmd_class;
+      pr_log_debug(DEBUG4, "dispatching %s command '%s' to mod_%s",
+        (cmd_type == PRE_CMD ? "PRE_CMD" :
+         cmd_type == CMD ? "CMD" :
+         cmd_type == POST_CMD ? "POST_CMD" :
+         cmd_type == POST_CMD_ERR ? "POST_CMD_ERR" :
+         cmd_type == LOG_CMD ? "LOG_CMD" :
+         cmd_type == LOG_CMD_ERR ? "LOG_CMD_ERR" :
+         "(unknown)"),
+        cmdargstr, c->m->name);
+
+      pr_trace_msg("command", 7, "dispatching %s command '%s' to mod_%s.c",
+        (cmd_type == PRE_CMD ? "PRE_CMD" :
+         cmd_type == CMD ? "CMD" :
+         cmd_type == POST_CMD ? "POST_CMD" :
+         cmd_type == POST_CMD_ERR ? "POST_CMD_ERR" :
+         cmd_type == LOG_CMD ? "LOG_CMD" :
+         cmd_type == LOG_CMD_ERR ? "LOG_CMD_ERR" :
+         "(unknown)"),
+        cmdargstr, c->m->name);
+    }
 
-      /* KLUDGE: disable umask() for not G_WRITE operations.  Config/
-       * Directory walking code will be completely redesigned in 1.3,
-       * this is only necessary for perfomance reasons in 1.1/1.2
-       */
+    cmd->cmd_class |= c->cmd_class;
+
+    /* KLUDGE: disable umask() for not G_WRITE operations.  Config/
+     * Directory walking code will be completely redesigned in 1.3,
+     * this is only necessary for perfomance reasons in 1.1/1.2
+     */
+
+    if (!c->group || strcmp(c->group, G_WRITE) != 0)
+      kludge_disable_umask();
+    if (pr_stats_enabled()) {
+      const char *stats_name;
+      uint64_t start_usecs, end_usecs;
+
+      stats_name = strcmp(c->command, C_ANY) != 0 ? c->command :
+        get_stats_cmd_name(cmd);
 
-      if (!c->group || strcmp(c->group, G_WRITE) != 0)
-        kludge_disable_umask();
+      start_usecs = pr_stats_get_usecs();
       mr = pr_module_call(c->m, c->handler, cmd);
-      kludge_enable_umask();
+      xerrno = errno;
 
-      if (MODRET_ISHANDLED(mr)) {
-        success = 1;
+      if (stats_name != NULL) {
+        end_usecs = pr_stats_get_usecs();
+        (void) pr_stats_add_handler(c->m->name, stats_name, cmd_type,
+          end_usecs > start_usecs ? end_usecs - start_usecs : 0);
+      }
 
-      } else if (MODRET_ISERROR(mr)) {
-        xerrno = errno;
-        success = -1;
+      errno = xerrno;
 
-        if (cmd_type == POST_CMD ||
-            cmd_type == LOG_CMD ||
-            cmd_type == LOG_CMD_ERR) {
-          if (MODRET_ERRMSG(mr)) {
-            pr_log_pri(PR_LOG_NOTICE, "%s", MODRET_ERRMSG(mr));
-          }
+    } else {
+      mr = pr_module_call(c->m, c->handler, cmd);
+    }
+    kludge_enable_umask();
 
-          /* Even though we normally want to return a negative value
-           * for success (indicating lack of success), for
-           * LOG_CMD/LOG_CMD_ERR handlers, we always want to handle
-           * errors as a success value of zero (meaning "keep looking").
-           *
-           * This will allow the cmd_rec to continue to be dispatched to
-           * the other interested handlers (Bug#3633).
-           */
-          if (cmd_type == LOG_CMD || 
-              cmd_type == LOG_CMD_ERR) {
-            success = 0;
-          }
+    if (MODRET_ISHANDLED(mr)) {
+      success = 1;
 
-        } else if (send_error) {
-          if (MODRET_ERRNUM(mr) &&
-              MODRET_ERRMSG(mr)) {
-            pr_response_add_err(MODRET_ERRNUM(mr), "%s", MODRET_ERRMSG(mr));
+    } else if (MODRET_ISERROR(mr)) {
+      xerrno = errno;
+      success = -1;
 
-          } else if (MODRET_ERRMSG(mr)) {
-            pr_response_send_raw("%s", MODRET_ERRMSG(mr));
-          }
+      if (cmd_type == POST_CMD ||
+          cmd_type == LOG_CMD ||
+          cmd_type == LOG_CMD_ERR) {
+        if (MODRET_ERRMSG(mr)) {
+          pr_log_pri(PR_LOG_NOTICE, "%s", MODRET_ERRMSG(mr));
         }
 
-        errno = xerrno;
-      }
+        /* Even though we normally want to return a negative value
+         * for success (indicating lack of success), for
+         * LOG_CMD/LOG_CMD_ERR handlers, we always want to handle
+         * errors as a success value of zero (meaning "keep looking").
+         *
+         * This will allow the cmd_rec to continue to be dispatched to
+         * the other interested handlers (Bug#3633).
+         */
+        if (cmd_type == LOG_CMD || 
+            cmd_type == LOG_CMD_ERR) {
+          success = 0;
+        }
 
-      if (session.user &&
-          !(session.sf_flags & SF_XFER) &&
-          cmd_type == CMD) {
-        pr_session_set_idle();
+      } else if (send_error) {
+        if (MODRET_ERRNUM(mr) &&
+            MODRET_ERRMSG(mr)) {
+          pr_response_add_err(MODRET_ERRNUM(mr), "%s", MODRET_ERRMSG(mr));
+
+        } else if (MODRET_ERRMSG(mr)) {
+          pr_response_send_raw("%s", MODRET_ERRMSG(mr));
+        }
       }
 
-      destroy_pool(cmd->tmp_pool);
-      cmd->tmp_pool = NULL;
+      errno = xerrno;
     }
 
-    if (!success) {
-      c = pr_stash_get_symbol2(PR_SYM_CMD, match, c, index_cache, hash_cache);
+    if (session.user &&
+        !(session.sf_flags & SF_XFER) &&
+        cmd_type == CMD) {
+      pr_session_set_idle();
     }
+
+    destroy_pool(cmd->tmp_pool);
+    cmd->tmp_pool = NULL;
   }
 
   /* Note: validate is only TRUE for the CMD phase, for specific handlers
    * (as opposed to any C_ANY handlers).
    */
 
-  if (!c &&
-      !success &&
+  if (!success &&
       validate) {
     char *method;
 
@@ -599,7 +648,7 @@ static int set_cmd_start_ms(cmd_rec *cmd) {
   return pr_table_add(cmd->notes, "start_ms", v, sizeof(uint64_t));
 }
 
-int pr_cmd_dispatch_phase(cmd_rec *cmd, int phase, int flags) {
+static int dispatch_phase(cmd_rec *cmd, int phase, int flags) {
   char *cp = NULL;
   int success = 0, xerrno = 0;
   pool *resp_pool = NULL;
@@ -641,14 +690,14 @@ int pr_cmd_dispatch_phase(cmd_rec *cmd, int phase, int flags) {
     *cp = toupper(*cp);
   }
 
-  if (cmd->cmd_class == 0) {
-    cmd->cmd_class = get_command_class(cmd->argv[0]);
-  }
-
   if (cmd->cmd_id == 0) {
     cmd->cmd_id = pr_cmd_get_id(cmd->argv[0]);
   }
 
+  if (cmd->cmd_class == 0) {
+    cmd->cmd_class = get_command_class(cmd->argv[0], cmd->cmd_id);
+  }
+
   set_cmd_start_ms(cmd);
 
   if (phase == 0) {
@@ -773,6 +822,30 @@ int pr_cmd_dispatch_phase(cmd_rec *cmd, int phase, int flags) {
   return success;
 }
 
+int pr_cmd_dispatch_phase(cmd_rec *cmd, int phase, int flags) {
+  const char *stats_name;
+  uint64_t start_usecs, end_usecs;
+  int res, xerrno;
+
+  if (!pr_stats_enabled()) {
+    return dispatch_phase(cmd, phase, flags);
+  }
+
+  start_usecs = pr_stats_get_usecs();
+  res = dispatch_phase(cmd, phase, flags);
+  xerrno = errno;
+
+  stats_name = get_stats_cmd_name(cmd);
+  if (stats_name != NULL) {
+    end_usecs = pr_stats_get_usecs();
+    (void) pr_stats_add_cmd(stats_name, phase,
+      end_usecs > start_usecs ? end_usecs - start_usecs : 0);
+  }
+
+  errno = xerrno;
+  return res;
+}
+
 int pr_cmd_dispatch(cmd_rec *cmd) {
   return pr_cmd_dispatch_phase(cmd, 0,
     PR_CMD_DISPATCH_FL_SEND_RESPONSE|PR_CMD_DISPATCH_FL_CLEAR_RESPONSE);
@@ -930,6 +1003,42 @@ static void cmd_loop(server_rec *server, conn_t *c) {
   }
 }
 
+/* Listen for metrics requests, if configured; metrics are only served by
+ * standalone daemons.
+ */
+static void init_metrics_listener(void) {
+  config_rec *c;
+
+  c = find_config(main_server->conf, CONF_PARAM, "MetricsListen", FALSE);
+  if (c == NULL ||
+      ServerType != SERVER_STANDALONE) {
+    pr_metrics_close();
+    return;
+  }
+
+  (void) pr_metrics_listen(c->argv[0]);
+}
+
+/* Record command and handler latencies, if configured; the latencies are
+ * only reported by standalone daemons.
+ */
+static void init_latency_stats(void) {
+  config_rec *c;
+
+  c = find_config(main_server->conf, CONF_PARAM, "LatencyStats", FALSE);
+  if (c == NULL ||
+      *((int *) c->argv[0]) == FALSE ||
+      ServerType != SERVER_STANDALONE) {
+    (void) free_stats();
+    return;
+  }
+
+  if (init_stats() < 0) {
+    pr_log_pri(PR_LOG_NOTICE, "unable to record LatencyStats: %s",
+      strerror(errno));
+  }
+}
+
 void restart_daemon(void *d1, void *d2, void *d3, void *d4) {
   if (is_master && mpid) {
     int maxfd;
@@ -976,6 +1085,11 @@ void restart_daemon(void *d1, void *d2, void *d3, void *d4) {
 
     free_bindings();
 
+    /* Close the metrics socket as well, so that it is not inherited by any
+     * processes which modules may fork while the configuration is re-read.
+     */
+    pr_metrics_close();
+
     /* Run through the list of registered restart callbacks. */
     pr_event_generate("core.restart", NULL);
 
@@ -995,6 +1109,8 @@ void restart_daemon(void *d1, void *d2, void *d3, void *d4) {
 
     pr_event_generate("core.preparse", NULL);
 
+    log_startup_phase(NULL);
+
     PRIVS_ROOT
     if (pr_parser_parse_file(NULL, config_filename, NULL, 0) < 0) {
       int xerrno = errno;
@@ -1021,6 +1137,8 @@ void restart_daemon(void *d1, void *d2, void *d3, void *d4) {
       pr_session_end(0);
     }
 
+    log_startup_phase("parsing configuration");
+
 #ifdef PR_USE_NLS
     encode_init();
 #endif /* PR_USE_NLS */
@@ -1037,12 +1155,21 @@ void restart_daemon(void *d1, void *d2, void *d3, void *d4) {
       pr_session_end(0);
     }
 
+    log_startup_phase("fixing up servers");
+    pr_log_debug(DEBUG10, "startup: %u servers configured",
+      count_servers(server_list));
+
     pr_event_generate("core.postparse", NULL);
 
     /* Recreate the listen connection.  Can an inetd-spawned server accept
      * and process HUP?
      */
+    log_startup_phase(NULL);
     init_bindings();
+    log_startup_phase("initializing bindings");
+
+    init_metrics_listener();
+    init_latency_stats();
 
     gettimeofday(&restart_finish, NULL);
 
@@ -1195,6 +1322,7 @@ static void fork_server(int fd, conn_t *l, unsigned char no_fork) {
 
   /* No longer need any listening fds. */
   pr_ipbind_close_listeners();
+  pr_metrics_close();
 
   /* There would appear to be no useful purpose behind setting the process
    * group of the newly forked child.  In daemon/inetd mode, we should have no
@@ -1541,6 +1669,9 @@ static void daemon_loop(void) {
     /* Monitor children pipes */
     maxfd = semaphore_fds(&listenfds, maxfd);
 
+    /* And the metrics socket, if any. */
+    maxfd = pr_metrics_set_fds(&listenfds, maxfd);
+
     /* Check for ftp shutdown message file */
     switch (check_shutmsg(PR_SHUTMSG_PATH, &shut, &deny, &disc, shutmsg,
         sizeof(shutmsg))) {
@@ -1686,6 +1817,9 @@ static void daemon_loop(void) {
       continue;
     }
 
+    /* Serve any pending metrics request. */
+    (void) pr_metrics_handle_fds(&listenfds);
+
     /* Accept the connection. */
     listen_conn = pr_ipbind_accept_conn(&listenfds, &fd);
 
@@ -1857,6 +1991,7 @@ static void standalone_main(void) {
   } else {
     log_stderr(FALSE);
     daemonize();
+    timers_reset_alarm();
   }
 
   PRIVS_ROOT
@@ -1887,11 +2022,23 @@ static void standalone_main(void) {
     }
   }
   PRIVS_RELINQUISH
+
+  /* Keep session counts, for the Max* limits, alongside the scoreboard. */
+  if (init_scoreboard_counters() < 0) {
+    pr_log_debug(DEBUG3, "unable to keep scoreboard counters: %s",
+      strerror(errno));
+  }
+
   pr_close_scoreboard(TRUE);
 
   pr_event_generate("core.startup", NULL);
 
+  log_startup_phase(NULL);
   init_bindings();
+  log_startup_phase("initializing bindings");
+
+  init_metrics_listener();
+  init_latency_stats();
 
   pr_log_pri(PR_LOG_NOTICE, "ProFTPD %s (built %s) standalone mode STARTUP",
     PROFTPD_VERSION_TEXT " " PR_STATUS, BUILD_STAMP);
@@ -2127,11 +2274,14 @@ static void show_settings(void) {
   printf("    PR_TUNABLE_BUFFER_SIZE = %u\n", PR_TUNABLE_BUFFER_SIZE);
   printf("    PR_TUNABLE_DEFAULT_RCVBUFSZ = %u\n", PR_TUNABLE_DEFAULT_RCVBUFSZ);
   printf("    PR_TUNABLE_DEFAULT_SNDBUFSZ = %u\n", PR_TUNABLE_DEFAULT_SNDBUFSZ);
+  printf("    PR_TUNABLE_DEFERRED_UPDATES_PER_SEC = %u\n",
+    PR_TUNABLE_DEFERRED_UPDATES_PER_SEC);
   printf("    PR_TUNABLE_ENV_MAX = %u\n", PR_TUNABLE_ENV_MAX);
   printf("    PR_TUNABLE_GLOBBING_MAX_MATCHES = %lu\n", PR_TUNABLE_GLOBBING_MAX_MATCHES);
   printf("    PR_TUNABLE_GLOBBING_MAX_RECURSION = %u\n", PR_TUNABLE_GLOBBING_MAX_RECURSION);
   printf("    PR_TUNABLE_HASH_TABLE_SIZE = %u\n", PR_TUNABLE_HASH_TABLE_SIZE);
   printf("    PR_TUNABLE_LOGIN_MAX = %u\n", PR_TUNABLE_LOGIN_MAX);
+  printf("    PR_TUNABLE_METRICS_TIMEOUT = %u\n", PR_TUNABLE_METRICS_TIMEOUT);
   printf("    PR_TUNABLE_NEW_POOL_SIZE = %u\n", PR_TUNABLE_NEW_POOL_SIZE);
   printf("    PR_TUNABLE_PATH_MAX = %u\n", PR_TUNABLE_PATH_MAX);
   printf("    PR_TUNABLE_SCOREBOARD_BUFFER_SIZE = %u\n",
@@ -2456,6 +2606,7 @@ int main(int argc, char *argv[], char **envp) {
   init_dirtree();
   init_stash();
   init_json();
+  init_throttle();
 
 #ifdef PR_USE_CTRLS
   init_ctrls();
@@ -2501,6 +2652,8 @@ int main(int argc, char *argv[], char **envp) {
 
   pr_event_generate("core.preparse", NULL);
 
+  log_startup_phase(NULL);
+
   if (pr_parser_parse_file(NULL, config_filename, NULL, 0) < 0) {
     /* Note: EPERM is used to indicate the presence of unrecognized
      * configuration directives in the parsed file(s).
@@ -2521,12 +2674,18 @@ int main(int argc, char *argv[], char **envp) {
     exit(1);
   }
 
+  log_startup_phase("parsing configuration");
+
   if (fixup_servers(server_list) < 0) {
     pr_log_pri(PR_LOG_WARNING,
       "fatal: error processing configuration file '%s'", config_filename);
     exit(1);
   }
 
+  log_startup_phase("fixing up servers");
+  pr_log_debug(DEBUG10, "startup: %u servers configured",
+    count_servers(server_list));
+
   pr_event_generate("core.postparse", NULL);
 
   if (show_version &&
@@ -2542,6 +2701,13 @@ int main(int argc, char *argv[], char **envp) {
 
   /* We're only doing a syntax check of the configuration file. */
   if (syntax_check) {
+    /* Set up the bindings too (without listening), so that the time taken
+     * for them is reported with that of the other startup phases.
+     */
+    log_startup_phase(NULL);
+    init_bindings_check();
+    log_startup_phase("initializing bindings");
+
     printf("%s", "Syntax check complete.\n");
     pr_session_end(PR_SESS_END_FL_SYNTAX_CHECK);
   }
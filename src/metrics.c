@@ -0,0 +1,1143 @@
+/*
+ * ProFTPD - FTP server daemon
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project and other respective copyright
+ * holders give permission to link this program with OpenSSL, and distribute
+ * the resulting executable, without including the source code for OpenSSL in
+ * the source distribution.
+ */
+
+/* Metrics exporter */
+
+#include "conf.h"
+#include "privs.h"
+
+#include <sys/un.h>
+
+/* Maximum number of label pairs for a single sample. */
+#define METRICS_MAX_LABELS		8
+
+/* Maximum size of a metrics HTTP request. */
+#define METRICS_MAX_REQUEST_SIZE	4096
+
+struct metrics_rec {
+  pool *pool;
+  char *buf;
+  size_t buflen, bufsz;
+};
+
+struct metrics_collector {
+  struct metrics_collector *next;
+  module *m;
+  const char *name;
+  int (*cb)(pr_metrics_t *, void *);
+  void *user_data;
+};
+
+static pool *metrics_pool = NULL;
+static struct metrics_collector *metrics_collectors = NULL;
+
+static int metrics_fd = -1;
+static pid_t metrics_opener = 0;
+static char metrics_sock_path[PR_TUNABLE_PATH_MAX+1];
+
+static const char *trace_channel = "metrics";
+
+static void metrics_append(pr_metrics_t *metrics, const char *text,
+    size_t textlen) {
+
+  if (metrics->buflen + textlen + 1 > metrics->bufsz) {
+    size_t bufsz;
+    char *buf;
+
+    bufsz = metrics->bufsz > 0 ? metrics->bufsz : 4096;
+    while (metrics->buflen + textlen + 1 > bufsz) {
+      bufsz *= 2;
+    }
+
+    buf = palloc(metrics->pool, bufsz);
+    if (metrics->buflen > 0) {
+      memcpy(buf, metrics->buf, metrics->buflen);
+    }
+
+    metrics->buf = buf;
+    metrics->bufsz = bufsz;
+  }
+
+  memcpy(metrics->buf + metrics->buflen, text, textlen);
+  metrics->buflen += textlen;
+  metrics->buf[metrics->buflen] = '\0';
+}
+
+static void metrics_append_str(pr_metrics_t *metrics, const char *text) {
+  metrics_append(metrics, text, strlen(text));
+}
+
+/* Appends the given text, escaping the characters which OpenMetrics requires
+ * to be escaped in label values and HELP text.
+ */
+static void metrics_append_escaped(pr_metrics_t *metrics, const char *text,
+    int escape_quotes) {
+  const char *ptr;
+
+  for (ptr = text; *ptr; ptr++) {
+    switch (*ptr) {
+      case '\\':
+        metrics_append(metrics, "\\\\", 2);
+        break;
+
+      case '\n':
+        metrics_append(metrics, "\\n", 2);
+        break;
+
+      case '"':
+        if (escape_quotes) {
+          metrics_append(metrics, "\\\"", 2);
+          break;
+        }
+
+        /* Fallthrough */
+
+      default:
+        metrics_append(metrics, ptr, 1);
+        break;
+    }
+  }
+}
+
+static void metrics_append_value(pr_metrics_t *metrics, double value) {
+  char buf[64];
+
+  memset(buf, '\0', sizeof(buf));
+  pr_snprintf(buf, sizeof(buf)-1, "%.15g", value);
+  metrics_append_str(metrics, buf);
+}
+
+static void metrics_append_sample(pr_metrics_t *metrics, const char *name,
+    const char *suffix, const char **labels, unsigned int nlabels,
+    const char *extra_label, const char *extra_value, double value) {
+  register unsigned int i;
+
+  metrics_append_str(metrics, name);
+  if (suffix != NULL) {
+    metrics_append_str(metrics, suffix);
+  }
+
+  if (nlabels > 0 ||
+      extra_label != NULL) {
+    metrics_append(metrics, "{", 1);
+
+    for (i = 0; i < nlabels; i++) {
+      if (i > 0) {
+        metrics_append(metrics, ",", 1);
+      }
+
+      metrics_append_str(metrics, labels[i*2]);
+      metrics_append(metrics, "=\"", 2);
+      metrics_append_escaped(metrics, labels[i*2+1], TRUE);
+      metrics_append(metrics, "\"", 1);
+    }
+
+    if (extra_label != NULL) {
+      if (nlabels > 0) {
+        metrics_append(metrics, ",", 1);
+      }
+
+      metrics_append_str(metrics, extra_label);
+      metrics_append(metrics, "=\"", 2);
+      metrics_append_str(metrics, extra_value);
+      metrics_append(metrics, "\"", 1);
+    }
+
+    metrics_append(metrics, "}", 1);
+  }
+
+  metrics_append(metrics, " ", 1);
+  metrics_append_value(metrics, value);
+  metrics_append(metrics, "\n", 1);
+}
+
+/* Collects the NULL-terminated label name/value pairs into the given array,
+ * returning the number of pairs, or -1 if there are too many.
+ */
+static int metrics_get_labels(va_list ap, const char **labels) {
+  unsigned int nlabels = 0;
+  const char *label_name;
+
+  label_name = va_arg(ap, const char *);
+  while (label_name != NULL) {
+    const char *label_value;
+
+    if (nlabels == METRICS_MAX_LABELS) {
+      errno = E2BIG;
+      return -1;
+    }
+
+    label_value = va_arg(ap, const char *);
+    if (label_value == NULL) {
+      label_value = "";
+    }
+
+    labels[nlabels*2] = label_name;
+    labels[nlabels*2+1] = label_value;
+    nlabels++;
+
+    label_name = va_arg(ap, const char *);
+  }
+
+  return nlabels;
+}
+
+int pr_metrics_add_family(pr_metrics_t *metrics, const char *name, int type,
+    const char *help) {
+  const char *type_name;
+
+  if (metrics == NULL ||
+      name == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  switch (type) {
+    case PR_METRICS_TYPE_COUNTER:
+      type_name = "counter";
+      break;
+
+    case PR_METRICS_TYPE_GAUGE:
+      type_name = "gauge";
+      break;
+
+    case PR_METRICS_TYPE_HISTOGRAM:
+      type_name = "histogram";
+      break;
+
+    default:
+      errno = EINVAL;
+      return -1;
+  }
+
+  metrics_append_str(metrics, "# TYPE ");
+  metrics_append_str(metrics, name);
+  metrics_append(metrics, " ", 1);
+  metrics_append_str(metrics, type_name);
+  metrics_append(metrics, "\n", 1);
+
+  if (help != NULL) {
+    metrics_append_str(metrics, "# HELP ");
+    metrics_append_str(metrics, name);
+    metrics_append(metrics, " ", 1);
+    metrics_append_escaped(metrics, help, FALSE);
+    metrics_append(metrics, "\n", 1);
+  }
+
+  return 0;
+}
+
+int pr_metrics_add_sample(pr_metrics_t *metrics, const char *name,
+    double value, ...) {
+  const char *labels[METRICS_MAX_LABELS * 2];
+  int nlabels;
+  va_list ap;
+
+  if (metrics == NULL ||
+      name == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  va_start(ap, value);
+  nlabels = metrics_get_labels(ap, labels);
+  va_end(ap);
+
+  if (nlabels < 0) {
+    return -1;
+  }
+
+  metrics_append_sample(metrics, name, NULL, labels, nlabels, NULL, NULL,
+    value);
+  return 0;
+}
+
+int pr_metrics_add_histogram(pr_metrics_t *metrics, const char *name,
+    const pr_stats_histo_t *histo, ...) {
+  register unsigned int i;
+  const char *labels[METRICS_MAX_LABELS * 2];
+  int nlabels;
+  uint64_t count = 0;
+  va_list ap;
+
+  if (metrics == NULL ||
+      name == NULL ||
+      histo == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  va_start(ap, histo);
+  nlabels = metrics_get_labels(ap, labels);
+  va_end(ap);
+
+  if (nlabels < 0) {
+    return -1;
+  }
+
+  /* Bucket N counts the latencies below 2^N usecs; the last bucket, which
+   * also counts all longer latencies, is only reported as "+Inf".  The
+   * buckets are summed for the count, rather than using the histogram's
+   * own count, so that the values are consistent with each other even
+   * while the histogram is being updated.
+   */
+  for (i = 0; i < PR_STATS_HISTO_NBUCKETS-1; i++) {
+    char le[64];
+
+    count += histo->buckets[i];
+
+    memset(le, '\0', sizeof(le));
+    pr_snprintf(le, sizeof(le)-1, "%.15g",
+      (double) (((uint64_t) 1) << i) / 1000000.0);
+    metrics_append_sample(metrics, name, "_bucket", labels, nlabels, "le", le,
+      (double) count);
+  }
+
+  count += histo->buckets[PR_STATS_HISTO_NBUCKETS-1];
+  metrics_append_sample(metrics, name, "_bucket", labels, nlabels, "le",
+    "+Inf", (double) count);
+  metrics_append_sample(metrics, name, "_count", labels, nlabels, NULL, NULL,
+    (double) count);
+  metrics_append_sample(metrics, name, "_sum", labels, nlabels, NULL, NULL,
+    (double) histo->total_usecs / 1000000.0);
+
+  return 0;
+}
+
+int pr_metrics_register(module *m, const char *name,
+    int (*cb)(pr_metrics_t *, void *), void *user_data) {
+  struct metrics_collector *mc, *last = NULL;
+
+  if (name == NULL ||
+      cb == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  for (mc = metrics_collectors; mc != NULL; mc = mc->next) {
+    if (mc->m == m &&
+        strcmp(mc->name, name) == 0) {
+      errno = EEXIST;
+      return -1;
+    }
+
+    last = mc;
+  }
+
+  if (metrics_pool == NULL) {
+    metrics_pool = make_sub_pool(permanent_pool);
+    pr_pool_tag(metrics_pool, "Metrics Pool");
+  }
+
+  mc = pcalloc(metrics_pool, sizeof(struct metrics_collector));
+  mc->m = m;
+  mc->name = pstrdup(metrics_pool, name);
+  mc->cb = cb;
+  mc->user_data = user_data;
+
+  if (last != NULL) {
+    last->next = mc;
+
+  } else {
+    metrics_collectors = mc;
+  }
+
+  pr_trace_msg(trace_channel, 9, "registered collector '%s' (%s)", name,
+    m != NULL ? m->name : "core");
+  return 0;
+}
+
+int pr_metrics_unregister(module *m, const char *name) {
+  struct metrics_collector *mc, *prev = NULL;
+  int found = FALSE;
+
+  mc = metrics_collectors;
+  while (mc != NULL) {
+    struct metrics_collector *next = mc->next;
+
+    if (mc->m == m &&
+        (name == NULL || strcmp(mc->name, name) == 0)) {
+      if (prev != NULL) {
+        prev->next = next;
+
+      } else {
+        metrics_collectors = next;
+      }
+
+      found = TRUE;
+
+    } else {
+      prev = mc;
+    }
+
+    mc = next;
+  }
+
+  if (!found) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  if (metrics_collectors == NULL &&
+      metrics_pool != NULL) {
+    destroy_pool(metrics_pool);
+    metrics_pool = NULL;
+  }
+
+  return 0;
+}
+
+/* Core collectors */
+
+struct metrics_server_counts {
+  const char *label;
+
+  /* Sessions, by state: authenticating, idle, download, upload, listing,
+   * command.
+   */
+  unsigned int nsessions[6];
+
+  double download_bytes, upload_bytes;
+};
+
+static const char *metrics_states[] = {
+  "authenticating", "idle", "download", "upload", "listing", "command", NULL
+};
+
+static int metrics_get_state(pr_scoreboard_entry_t *score) {
+  const char *cmd;
+
+  if (strcmp(score->sce_user, "(none)") == 0) {
+    return 0;
+  }
+
+  cmd = score->sce_cmd;
+
+  if (strcmp(cmd, "idle") == 0) {
+    return 1;
+  }
+
+  if (strcmp(cmd, "RETR") == 0 ||
+      strcmp(cmd, "READ") == 0 ||
+      strcmp(cmd, "scp download") == 0) {
+    return 2;
+  }
+
+  if (strcmp(cmd, "STOR") == 0 ||
+      strcmp(cmd, "APPE") == 0 ||
+      strcmp(cmd, "STOU") == 0 ||
+      strcmp(cmd, "WRITE") == 0 ||
+      strcmp(cmd, "scp upload") == 0) {
+    return 3;
+  }
+
+  if (strcmp(cmd, "LIST") == 0 ||
+      strcmp(cmd, "NLST") == 0 ||
+      strcmp(cmd, "MLSD") == 0 ||
+      strcmp(cmd, "MLST") == 0 ||
+      strcmp(cmd, "READDIR") == 0) {
+    return 4;
+  }
+
+  return 5;
+}
+
+static int metrics_scoreboard_cb(pr_metrics_t *metrics, void *user_data) {
+  register unsigned int i;
+  array_header *servers;
+  pr_table_t *tab;
+  pr_scoreboard_entry_t *score;
+  unsigned int max_servers = UINT_MAX;
+  int res, xerrno;
+
+  PRIVS_ROOT
+  res = pr_open_scoreboard(O_RDWR);
+  xerrno = errno;
+  PRIVS_RELINQUISH
+
+  if (res < 0) {
+    pr_trace_msg(trace_channel, 3, "error opening scoreboard: %s",
+      strerror(xerrno));
+    return 0;
+  }
+
+  /* There may be many more servers than the default table limit. */
+  tab = pr_table_nalloc(metrics->pool, 0, 256);
+  (void) pr_table_ctl(tab, PR_TABLE_CTL_SET_MAX_ENTS, &max_servers);
+  servers = make_array(metrics->pool, 0,
+    sizeof(struct metrics_server_counts *));
+
+  /* When the scoreboard is mapped, the entries are read using their
+   * sequence counters, without taking any locks.
+   */
+  (void) pr_rewind_scoreboard();
+
+  while ((score = pr_scoreboard_entry_read()) != NULL) {
+    struct metrics_server_counts *counts;
+    const char *label;
+    int state;
+
+    pr_signals_handle();
+
+    label = score->sce_server_label;
+    counts = (struct metrics_server_counts *) pr_table_get(tab, label, NULL);
+    if (counts == NULL) {
+      counts = pcalloc(metrics->pool, sizeof(struct metrics_server_counts));
+      counts->label = pstrdup(metrics->pool, label);
+
+      (void) pr_table_add(tab, counts->label, counts, sizeof(counts));
+      *((struct metrics_server_counts **) push_array(servers)) = counts;
+    }
+
+    state = metrics_get_state(score);
+    counts->nsessions[state]++;
+
+    if (state == 2) {
+      counts->download_bytes += (double) score->sce_xfer_len;
+
+    } else if (state == 3) {
+      counts->upload_bytes += (double) score->sce_xfer_len;
+    }
+  }
+
+  pr_close_scoreboard(TRUE);
+
+  pr_metrics_add_family(metrics, "proftpd_sessions", PR_METRICS_TYPE_GAUGE,
+    "Current sessions, by server and state");
+  for (i = 0; i < servers->nelts; i++) {
+    register unsigned int j;
+    struct metrics_server_counts *counts;
+
+    counts = ((struct metrics_server_counts **) servers->elts)[i];
+    for (j = 0; metrics_states[j] != NULL; j++) {
+      pr_metrics_add_sample(metrics, "proftpd_sessions",
+        (double) counts->nsessions[j], "server", counts->label,
+        "state", metrics_states[j], NULL);
+    }
+  }
+
+  pr_metrics_add_family(metrics, "proftpd_transfers", PR_METRICS_TYPE_GAUGE,
+    "Current file transfers, by server and direction");
+  for (i = 0; i < servers->nelts; i++) {
+    struct metrics_server_counts *counts;
+
+    counts = ((struct metrics_server_counts **) servers->elts)[i];
+    pr_metrics_add_sample(metrics, "proftpd_transfers",
+      (double) counts->nsessions[2], "server", counts->label,
+      "direction", "download", NULL);
+    pr_metrics_add_sample(metrics, "proftpd_transfers",
+      (double) counts->nsessions[3], "server", counts->label,
+      "direction", "upload", NULL);
+  }
+
+  pr_metrics_add_family(metrics, "proftpd_transfer_bytes",
+    PR_METRICS_TYPE_GAUGE,
+    "Bytes transferred so far by current file transfers, by server and "
+    "direction");
+  for (i = 0; i < servers->nelts; i++) {
+    struct metrics_server_counts *counts;
+
+    counts = ((struct metrics_server_counts **) servers->elts)[i];
+    pr_metrics_add_sample(metrics, "proftpd_transfer_bytes",
+      counts->download_bytes, "server", counts->label,
+      "direction", "download", NULL);
+    pr_metrics_add_sample(metrics, "proftpd_transfer_bytes",
+      counts->upload_bytes, "server", counts->label,
+      "direction", "upload", NULL);
+  }
+
+  return 0;
+}
+
+static const char *metrics_get_phase(int phase) {
+  switch (phase) {
+    case 0:
+      return "all";
+
+    case PRE_CMD:
+      return "pre_cmd";
+
+    case CMD:
+      return "cmd";
+
+    case POST_CMD:
+      return "post_cmd";
+
+    case POST_CMD_ERR:
+      return "post_cmd_err";
+
+    case LOG_CMD:
+      return "log_cmd";
+
+    case LOG_CMD_ERR:
+      return "log_cmd_err";
+  }
+
+  return "other";
+}
+
+static int metrics_cmd_histo_cb(const char *module_name, const char *cmd_name,
+    int phase, const pr_stats_histo_t *histo, void *user_data) {
+  pr_metrics_t *metrics = user_data;
+
+  if (module_name != NULL) {
+    return 0;
+  }
+
+  pr_metrics_add_histogram(metrics, "proftpd_command_latency_seconds", histo,
+    "command", cmd_name, "phase", metrics_get_phase(phase), NULL);
+  return 0;
+}
+
+static int metrics_handler_histo_cb(const char *module_name,
+    const char *cmd_name, int phase, const pr_stats_histo_t *histo,
+    void *user_data) {
+  pr_metrics_t *metrics = user_data;
+
+  if (module_name == NULL) {
+    return 0;
+  }
+
+  pr_metrics_add_histogram(metrics, "proftpd_handler_latency_seconds", histo,
+    "module", module_name, "command", cmd_name, "phase",
+    metrics_get_phase(phase), NULL);
+  return 0;
+}
+
+static int metrics_stats_cb(pr_metrics_t *metrics, void *user_data) {
+  if (!pr_stats_enabled()) {
+    return 0;
+  }
+
+  /* The samples of a family must be contiguous, hence the separate walks
+   * for the command and the module handler latencies.
+   */
+  pr_metrics_add_family(metrics, "proftpd_command_latency_seconds",
+    PR_METRICS_TYPE_HISTOGRAM,
+    "Command latencies, by command and dispatch phase; for transfer "
+    "commands, these are the transfer durations");
+  (void) pr_stats_walk(metrics_cmd_histo_cb, metrics);
+
+  pr_metrics_add_family(metrics, "proftpd_handler_latency_seconds",
+    PR_METRICS_TYPE_HISTOGRAM,
+    "Module handler latencies, by module, command and dispatch phase");
+  (void) pr_stats_walk(metrics_handler_histo_cb, metrics);
+
+  return 0;
+}
+
+int pr_metrics_render(pool *p, char **text, size_t *textlen) {
+  pr_metrics_t *metrics;
+  struct metrics_collector *mc;
+
+  if (p == NULL ||
+      text == NULL ||
+      textlen == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  metrics = pcalloc(p, sizeof(pr_metrics_t));
+  metrics->pool = p;
+
+  pr_metrics_add_family(metrics, "proftpd_build_info", PR_METRICS_TYPE_GAUGE,
+    "Version of the running daemon");
+  pr_metrics_add_sample(metrics, "proftpd_build_info", 1.0,
+    "version", PROFTPD_VERSION_TEXT, NULL);
+
+  if (ServerType == SERVER_STANDALONE) {
+    metrics_scoreboard_cb(metrics, NULL);
+  }
+
+  metrics_stats_cb(metrics, NULL);
+
+  for (mc = metrics_collectors; mc != NULL; mc = mc->next) {
+    pr_signals_handle();
+
+    if (mc->cb(metrics, mc->user_data) < 0) {
+      pr_trace_msg(trace_channel, 3, "error running collector '%s' (%s): %s",
+        mc->name, mc->m != NULL ? mc->m->name : "core", strerror(errno));
+    }
+  }
+
+  metrics_append_str(metrics, "# EOF\n");
+
+  *text = metrics->buf;
+  *textlen = metrics->buflen;
+  return 0;
+}
+
+/* Listening */
+
+static int metrics_listen_unix(const char *path) {
+  int fd, res, xerrno;
+  struct sockaddr_un sock;
+
+  if (strlen(path) >= sizeof(sock.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+
+  memset(&sock, 0, sizeof(sock));
+  sock.sun_family = AF_UNIX;
+  sstrncpy(sock.sun_path, path, sizeof(sock.sun_path));
+
+  PRIVS_ROOT
+
+  /* Remove any stale socket left by a previous daemon. */
+  (void) unlink(path);
+
+  res = bind(fd, (struct sockaddr *) &sock, sizeof(sock));
+  xerrno = errno;
+
+  if (res == 0) {
+    /* Access to the metrics is controlled using the socket's group
+     * ownership, and the permissions of its directory.
+     */
+    res = chmod(path, 0660);
+    xerrno = errno;
+  }
+
+  PRIVS_RELINQUISH
+
+  if (res < 0) {
+    (void) close(fd);
+    errno = xerrno;
+    return -1;
+  }
+
+  sstrncpy(metrics_sock_path, path, sizeof(metrics_sock_path));
+  return fd;
+}
+
+static int metrics_listen_inet(pool *p, const char *addr) {
+  int fd, res, xerrno, one = 1;
+  char *host, *ptr;
+  const pr_netaddr_t *na;
+  pr_netaddr_t *bind_addr;
+  int port;
+
+  host = pstrdup(p, addr);
+
+  ptr = strrchr(host, ':');
+  if (ptr == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  *ptr++ = '\0';
+  port = atoi(ptr);
+  if (port <= 0 ||
+      port > 65535) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* Allow IPv6 addresses to be given in brackets, e.g. "[::1]:9273". */
+  if (*host == '[') {
+    size_t hostlen;
+
+    host++;
+    hostlen = strlen(host);
+    if (hostlen == 0 ||
+        host[hostlen-1] != ']') {
+      errno = EINVAL;
+      return -1;
+    }
+
+    host[hostlen-1] = '\0';
+  }
+
+  na = pr_netaddr_get_addr(p, host, NULL);
+  if (na == NULL) {
+    return -1;
+  }
+
+  /* Only loopback addresses are allowed; there is no authentication of
+   * metrics clients.
+   */
+  if (pr_netaddr_is_loopback(na) != TRUE) {
+    pr_log_pri(PR_LOG_WARNING, "MetricsListen address %s is not a loopback "
+      "address, ignoring", host);
+    errno = EPERM;
+    return -1;
+  }
+
+  bind_addr = pr_netaddr_dup(p, na);
+  pr_netaddr_set_port(bind_addr, htons(port));
+
+  fd = socket(pr_netaddr_get_family(bind_addr), SOCK_STREAM, IPPROTO_TCP);
+  if (fd < 0) {
+    return -1;
+  }
+
+  (void) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (void *) &one, sizeof(one));
+
+  PRIVS_ROOT
+  res = bind(fd, pr_netaddr_get_sockaddr(bind_addr),
+    pr_netaddr_get_sockaddr_len(bind_addr));
+  xerrno = errno;
+  PRIVS_RELINQUISH
+
+  if (res < 0) {
+    (void) close(fd);
+    errno = xerrno;
+    return -1;
+  }
+
+  return fd;
+}
+
+int pr_metrics_listen(const char *addr) {
+  int fd, flags;
+  pool *tmp_pool;
+
+  if (addr == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  (void) pr_metrics_close();
+
+  tmp_pool = make_sub_pool(permanent_pool);
+
+  if (*addr == '/') {
+    fd = metrics_listen_unix(addr);
+
+  } else {
+    fd = metrics_listen_inet(tmp_pool, addr);
+  }
+
+  destroy_pool(tmp_pool);
+
+  if (fd < 0) {
+    int xerrno = errno;
+
+    pr_log_pri(PR_LOG_WARNING, "unable to listen for metrics requests on "
+      "%s: %s", addr, strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  if (listen(fd, 8) < 0) {
+    int xerrno = errno;
+
+    (void) close(fd);
+    pr_log_pri(PR_LOG_WARNING, "unable to listen for metrics requests on "
+      "%s: %s", addr, strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  /* The daemon must never block in accept(2), e.g. should the client go
+   * away before it is accepted.
+   */
+  flags = fcntl(fd, F_GETFL);
+  if (flags >= 0) {
+    (void) fcntl(fd, F_SETFL, flags|O_NONBLOCK);
+  }
+
+  if (pr_fs_get_usable_fd2(&fd) < 0) {
+    pr_log_debug(DEBUG0, "warning: unable to find good fd for metrics fd %d: "
+      "%s", fd, strerror(errno));
+  }
+
+  (void) fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+  metrics_fd = fd;
+  metrics_opener = getpid();
+
+  pr_log_debug(DEBUG2, "listening for metrics requests on %s", addr);
+  return 0;
+}
+
+int pr_metrics_close(void) {
+  if (metrics_fd < 0) {
+    return 0;
+  }
+
+  (void) close(metrics_fd);
+  metrics_fd = -1;
+
+  if (metrics_opener == getpid() &&
+      *metrics_sock_path != '\0') {
+    PRIVS_ROOT
+    (void) unlink(metrics_sock_path);
+    PRIVS_RELINQUISH
+  }
+
+  metrics_sock_path[0] = '\0';
+  metrics_opener = 0;
+  return 0;
+}
+
+int pr_metrics_set_fds(fd_set *rfds, int maxfd) {
+  if (metrics_fd < 0 ||
+      rfds == NULL) {
+    return maxfd;
+  }
+
+  FD_SET(metrics_fd, rfds);
+  return (metrics_fd > maxfd ? metrics_fd : maxfd);
+}
+
+/* Waits until the (non-blocking) socket is readable, or writable, returning
+ * -1 with ETIMEDOUT once the deadline for the whole request has passed.  The
+ * deadline covers every read and write of the request, so that a client
+ * trickling its request, or reading its response slowly, cannot hold up the
+ * daemon for longer than that.
+ */
+static int metrics_wait(int fd, int for_write, const struct timeval *deadline) {
+  while (TRUE) {
+    struct timeval now, tv;
+    fd_set fds;
+    int res;
+
+    gettimeofday(&now, NULL);
+    if (now.tv_sec > deadline->tv_sec ||
+        (now.tv_sec == deadline->tv_sec &&
+         now.tv_usec >= deadline->tv_usec)) {
+      errno = ETIMEDOUT;
+      return -1;
+    }
+
+    tv.tv_sec = deadline->tv_sec - now.tv_sec;
+    tv.tv_usec = deadline->tv_usec - now.tv_usec;
+    if (tv.tv_usec < 0) {
+      tv.tv_sec--;
+      tv.tv_usec += 1000000;
+    }
+
+    FD_ZERO(&fds);
+    FD_SET(fd, &fds);
+
+    res = select(fd + 1, for_write ? NULL : &fds, for_write ? &fds : NULL,
+      NULL, &tv);
+    if (res < 0) {
+      if (errno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+      return -1;
+    }
+
+    if (res > 0) {
+      return 0;
+    }
+  }
+}
+
+static void metrics_write(int fd, const char *buf, size_t buflen,
+    const struct timeval *deadline) {
+  while (buflen > 0) {
+    ssize_t res;
+
+    if (metrics_wait(fd, TRUE, deadline) < 0) {
+      pr_trace_msg(trace_channel, 3, "error writing metrics response: %s",
+        strerror(errno));
+      return;
+    }
+
+    res = write(fd, buf, buflen);
+    if (res < 0) {
+      if (errno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+      if (errno == EAGAIN ||
+          errno == EWOULDBLOCK) {
+        continue;
+      }
+
+      pr_trace_msg(trace_channel, 3, "error writing metrics response: %s",
+        strerror(errno));
+      return;
+    }
+
+    buf += res;
+    buflen -= res;
+  }
+}
+
+static void metrics_send_response(int fd, pool *p,
+    const struct timeval *deadline, const char *status,
+    const char *content_type, const char *body, size_t bodylen) {
+  char *headers, content_len[32];
+
+  memset(content_len, '\0', sizeof(content_len));
+  pr_snprintf(content_len, sizeof(content_len)-1, "%lu",
+    (unsigned long) bodylen);
+
+  headers = pstrcat(p, "HTTP/1.0 ", status, "\r\n",
+    "Content-Type: ", content_type, "\r\n",
+    "Content-Length: ", content_len, "\r\n",
+    "Connection: close\r\n\r\n", NULL);
+
+  metrics_write(fd, headers, strlen(headers), deadline);
+  metrics_write(fd, body, bodylen, deadline);
+}
+
+static void metrics_serve(int fd) {
+  pool *tmp_pool;
+  char *req;
+  size_t reqlen = 0;
+  struct timeval deadline;
+  int flags;
+
+  /* The request is read, and the response written, within a single short
+   * deadline, as the daemon is not accepting connections in the meantime.
+   */
+  if (fd >= FD_SETSIZE) {
+    pr_trace_msg(trace_channel, 3, "unable to serve metrics request: "
+      "fd %d exceeds FD_SETSIZE (%d)", fd, FD_SETSIZE);
+    return;
+  }
+
+  flags = fcntl(fd, F_GETFL);
+  if (flags < 0 ||
+      fcntl(fd, F_SETFL, flags|O_NONBLOCK) < 0) {
+    pr_trace_msg(trace_channel, 3, "unable to serve metrics request: "
+      "error making socket non-blocking: %s", strerror(errno));
+    return;
+  }
+
+  gettimeofday(&deadline, NULL);
+  deadline.tv_sec += PR_TUNABLE_METRICS_TIMEOUT;
+
+  tmp_pool = make_sub_pool(permanent_pool);
+  pr_pool_tag(tmp_pool, "Metrics request pool");
+
+  req = pcalloc(tmp_pool, METRICS_MAX_REQUEST_SIZE + 1);
+
+  while (reqlen < METRICS_MAX_REQUEST_SIZE) {
+    ssize_t res;
+
+    if (metrics_wait(fd, FALSE, &deadline) < 0) {
+      pr_trace_msg(trace_channel, 3, "error reading metrics request: %s",
+        strerror(errno));
+      destroy_pool(tmp_pool);
+      return;
+    }
+
+    res = read(fd, req + reqlen, METRICS_MAX_REQUEST_SIZE - reqlen);
+    if (res < 0) {
+      if (errno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+      if (errno == EAGAIN ||
+          errno == EWOULDBLOCK) {
+        continue;
+      }
+
+      pr_trace_msg(trace_channel, 3, "error reading metrics request: %s",
+        strerror(errno));
+      destroy_pool(tmp_pool);
+      return;
+    }
+
+    if (res == 0) {
+      break;
+    }
+
+    reqlen += res;
+    req[reqlen] = '\0';
+
+    if (strstr(req, "\r\n\r\n") != NULL ||
+        strstr(req, "\n\n") != NULL) {
+      break;
+    }
+  }
+
+  if (strncmp(req, "GET ", 4) != 0) {
+    const char *msg = "Method not allowed\n";
+
+    metrics_send_response(fd, tmp_pool, &deadline,
+      "405 Method Not Allowed", "text/plain", msg, strlen(msg));
+
+  } else if (strncmp(req + 4, "/metrics ", 9) != 0 &&
+             strncmp(req + 4, "/ ", 2) != 0) {
+    const char *msg = "Not found\n";
+
+    metrics_send_response(fd, tmp_pool, &deadline, "404 Not Found",
+      "text/plain", msg, strlen(msg));
+
+  } else {
+    char *text = NULL;
+    size_t textlen = 0;
+
+    if (pr_metrics_render(tmp_pool, &text, &textlen) < 0) {
+      const char *msg = "Unable to render metrics\n";
+
+      metrics_send_response(fd, tmp_pool, &deadline,
+        "500 Internal Server Error", "text/plain", msg, strlen(msg));
+
+    } else {
+      pr_trace_msg(trace_channel, 12, "sending %lu bytes of metrics",
+        (unsigned long) textlen);
+      metrics_send_response(fd, tmp_pool, &deadline, "200 OK",
+        "application/openmetrics-text; version=1.0.0; charset=utf-8",
+        text, textlen);
+    }
+  }
+
+  destroy_pool(tmp_pool);
+}
+
+int pr_metrics_handle_fds(fd_set *rfds) {
+  int fd;
+
+  if (metrics_fd < 0 ||
+      rfds == NULL ||
+      !FD_ISSET(metrics_fd, rfds)) {
+    return 0;
+  }
+
+  fd = accept(metrics_fd, NULL, NULL);
+  if (fd < 0) {
+    if (errno != EAGAIN &&
+        errno != EWOULDBLOCK &&
+        errno != EINTR) {
+      pr_trace_msg(trace_channel, 3, "error accepting metrics connection: %s",
+        strerror(errno));
+    }
+
+    return 1;
+  }
+
+  metrics_serve(fd);
+  (void) close(fd);
+
+  return 1;
+}
@@ -147,17 +147,10 @@ int modules_session_init(void) {
 }
 
 unsigned char command_exists(const char *name) {
-  int idx = -1;
-  unsigned int hash = 0;
-  cmdtable *cmdtab;
-
-  cmdtab = pr_stash_get_symbol2(PR_SYM_CMD, name, NULL, &idx, &hash);
-  while (cmdtab && cmdtab->cmd_type != CMD) {
-    pr_signals_handle();
-    cmdtab = pr_stash_get_symbol2(PR_SYM_CMD, name, cmdtab, &idx, &hash);
-  }
+  cmdtable **handlers;
 
-  return (cmdtab ? TRUE : FALSE);
+  handlers = pr_stash_get_cmd_handlers(name, 0, CMD);
+  return (handlers && handlers[0] ? TRUE : FALSE);
 }
 
 unsigned char pr_module_exists(const char *name) {
@@ -45,6 +45,11 @@ static unsigned int parser_sid = 1;
 
 static xaset_t **parser_server_list = NULL;
 
+/* The last server appended to the above list, so that appending each
+ * <VirtualHost> does not require walking the entire list.
+ */
+static server_rec *parser_server_list_tail = NULL;
+
 static const char *trace_channel = "config";
 
 struct config_src {
@@ -713,6 +718,8 @@ int pr_parser_prepare(pool *p, xaset_t **parsed_servers) {
     parser_server_list = parsed_servers;
   }
 
+  parser_server_list_tail = NULL;
+
   parser_servstack = make_array(p, 1, sizeof(server_rec *));
   parser_curr_server = (server_rec **) push_array(parser_servstack);
   *parser_curr_server = main_server;
@@ -807,6 +814,8 @@ char *pr_parser_read_line(char *buf, size_t bufsz) {
 }
 
 server_rec *pr_parser_server_ctxt_close(void) {
+  server_rec *s;
+
   if (!parser_curr_server) {
     errno = ENOENT;
     return NULL;
@@ -818,6 +827,19 @@ server_rec *pr_parser_server_ctxt_close(void) {
     return NULL;
   }
 
+  /* The server being closed may have been removed from the server list
+   * (e.g. due to an address collision); if so, it can no longer be used
+   * as the list tail.
+   */
+  s = *parser_curr_server;
+  if (s == parser_server_list_tail &&
+      s->next == NULL &&
+      s->prev == NULL &&
+      (*parser_server_list == NULL ||
+       (*parser_server_list)->xas_list != (xasetmember_t *) s)) {
+    parser_server_list_tail = NULL;
+  }
+
   parser_curr_server--;
   parser_servstack->nelts--;
 
@@ -873,8 +895,18 @@ server_rec *pr_parser_server_ctxt_open(const char *addrstr) {
   /* Have to make sure it ends up on the end of the chain, otherwise
    * main_server becomes useless.
    */
-  xaset_insert_end(*parser_server_list, (xasetmember_t *) s);
+  if (parser_server_list_tail != NULL &&
+      parser_server_list_tail->next == NULL) {
+    parser_server_list_tail->next = s;
+    s->prev = parser_server_list_tail;
+    s->next = NULL;
+
+  } else {
+    xaset_insert_end(*parser_server_list, (xasetmember_t *) s);
+  }
+
   s->set = *parser_server_list;
+  parser_server_list_tail = s;
   if (addrstr) {
     s->ServerAddress = pstrdup(s->pool, addrstr);
   }
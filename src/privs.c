@@ -429,6 +429,16 @@ int pr_privs_revoke(const char *file, int lineno) {
 
   pr_log_debug(DEBUG9, "REVOKE PRIVS at %s:%d", file, lineno);
 
+  /* The shared auth cache is trusted by every session for its logins, so
+   * only processes which can regain root may write to it.  Once root
+   * privileges are revoked, this process gives up its mapping.
+   */
+  if (pr_authcache_enabled() == TRUE) {
+    pr_trace_msg(trace_channel, 9,
+      "PRIVS_REVOKE called, releasing auth cache");
+    (void) pr_authcache_free();
+  }
+
   root_privs = user_privs = 0;
   pr_trace_msg(trace_channel, 9, "PRIVS_REVOKE called, "
     "clearing user/root privs count");
@@ -59,6 +59,17 @@ static char proc_title_buf[BUFSIZ];
 static unsigned int proc_flags = 0;
 #define PR_PROCTITLE_FL_USE_STATIC		0x001
 
+/* Time when the title was last set, and any deferred title not yet set. */
+static struct timeval proc_title_tv;
+static char proc_title_pending[BUFSIZ];
+static int proc_title_dirty = FALSE;
+static int proc_title_timerno = -1;
+
+static void proctitle_set_done(void) {
+  proc_title_dirty = FALSE;
+  (void) gettimeofday(&proc_title_tv, NULL);
+}
+
 void pr_proctitle_init(int argc, char *argv[], char *envp[]) {
   register int i;
   register size_t envpsize;
@@ -187,6 +198,8 @@ void pr_proctitle_set_str(const char *str) {
 
   setproctitle("%s", str);
 #endif /* HAVE_SETPROCTITLE */
+
+  proctitle_set_done();
 }
 
 void pr_proctitle_set(const char *fmt, ...) {
@@ -236,6 +249,8 @@ void pr_proctitle_set(const char *fmt, ...) {
 
   va_end(msg);
 
+  proctitle_set_done();
+
 #ifdef HAVE_SETPROCTITLE
   return;
 #else
@@ -277,6 +292,59 @@ void pr_proctitle_set(const char *fmt, ...) {
 #endif /* HAVE_SETPROCTITLE */
 }
 
+static int proctitle_flush_cb(CALLBACK_FRAME) {
+  proc_title_timerno = -1;
+  pr_proctitle_flush();
+
+  /* Don't restart this timer. */
+  return 0;
+}
+
+void pr_proctitle_set_deferred(const char *fmt, ...) {
+  va_list msg;
+  struct timeval now;
+  long elapsed_usecs;
+
+  if (proc_flags & PR_PROCTITLE_FL_USE_STATIC) {
+    return;
+  }
+
+  if (fmt == NULL) {
+    return;
+  }
+
+  va_start(msg, fmt);
+  pr_vsnprintf(proc_title_pending, sizeof(proc_title_pending), fmt, msg);
+  va_end(msg);
+
+  proc_title_pending[sizeof(proc_title_pending)-1] = '\0';
+
+  (void) gettimeofday(&now, NULL);
+  elapsed_usecs = ((now.tv_sec - proc_title_tv.tv_sec) * 1000000L) +
+    (now.tv_usec - proc_title_tv.tv_usec);
+
+  if (elapsed_usecs < 0 ||
+      elapsed_usecs >= (1000000L / PR_TUNABLE_DEFERRED_UPDATES_PER_SEC)) {
+    pr_proctitle_set("%s", proc_title_pending);
+    return;
+  }
+
+  proc_title_dirty = TRUE;
+
+  if (proc_title_timerno < 0) {
+    proc_title_timerno = pr_timer_add(1, -1, NULL, proctitle_flush_cb,
+      "proctitle flush");
+  }
+}
+
+void pr_proctitle_flush(void) {
+  if (proc_title_dirty == FALSE) {
+    return;
+  }
+
+  pr_proctitle_set("%s", proc_title_pending);
+}
+
 void pr_proctitle_set_static_str(const char *buf) {
   if (buf != NULL) {
     pr_proctitle_set_str(buf);
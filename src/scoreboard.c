@@ -27,6 +27,10 @@
 #include "conf.h"
 #include "privs.h"
 
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+
 /* From src/dirtree.c */
 extern char ServerType;
 
@@ -45,16 +49,558 @@ static pr_scoreboard_entry_t entry;
 static int have_entry = FALSE;
 static struct flock entry_lock;
 
+/* Time when our entry was last written to the scoreboard, and whether our
+ * entry has deferred changes not yet written.
+ */
+static struct timeval entry_written_tv;
+static int entry_dirty = FALSE;
+static int entry_flush_timerno = -1;
+
 static unsigned char scoreboard_read_locked = FALSE;
 static unsigned char scoreboard_write_locked = FALSE;
 
 /* Max number of attempts for lock requests */
 #define SCOREBOARD_MAX_LOCK_ATTEMPTS	10
 
+/* When possible, the ScoreboardFile is mapped into memory, and the entries
+ * are read and written using that mapping rather than using locks and
+ * read(2)/write(2).  The file format is not changed; other processes may
+ * still read the file as usual.
+ *
+ * Each slot is guarded by a sequence counter (a "seqlock"), kept in a
+ * mapping of the ScoreboardMutex file.  A writer makes the counter odd
+ * while changing the slot, and even again when done; a reader retries its
+ * copy of the slot if the counter was odd, or changed during the copy.
+ * Only adding and deleting entries, and scrubbing, still use the
+ * ScoreboardMutex lock.
+ */
+struct scoreboard_map {
+  void *sm_data;
+  size_t sm_datasz;
+
+  volatile uint32_t *sm_seqs;
+  size_t sm_seqssz;
+
+  /* Number of slots covered by the mappings. */
+  unsigned int sm_nslots;
+};
+
+static struct scoreboard_map scoreboard_map;
+
+/* Number of slots in the ScoreboardFile, as last seen. */
+static unsigned int scoreboard_nslots = 0;
+
+/* The slot holding our entry, and the next slot for reading. */
+static unsigned int entry_slot = 0;
+static unsigned int scan_slot = 0;
+
+/* The number of sessions per server address, and per client address, user,
+ * class, and command, are counted in a table kept in an anonymous shared
+ * mapping.  The table is created by the standalone daemon, before any
+ * session processes are forked; each session adjusts the counts whenever it
+ * changes the relevant fields of its entry, so that the Max* limits can be
+ * checked without scanning the entire scoreboard.
+ *
+ * The counts are keyed by 64-bit hashes, in an open-addressed table guarded
+ * by a spinlock which is only held briefly.  If the counts might be wrong,
+ * e.g. because the table filled up, or a process died while holding the
+ * lock, the table is marked invalid until it is next rebuilt from the
+ * scoreboard entries, which happens whenever the scoreboard is scrubbed.
+ */
+#ifndef PR_SCOREBOARD_MAX_COUNTERS
+# define PR_SCOREBOARD_MAX_COUNTERS	65536
+#endif /* PR_SCOREBOARD_MAX_COUNTERS */
+
+struct scoreboard_counter {
+  /* Zero marks an unused counter. */
+  uint64_t sc_key;
+  uint32_t sc_count;
+};
+
+struct scoreboard_counters {
+  volatile pid_t sct_lock;
+  volatile int sct_invalid;
+  unsigned int sct_nused;
+
+  struct scoreboard_counter sct_counters[PR_SCOREBOARD_MAX_COUNTERS];
+};
+
+static struct scoreboard_counters *scoreboard_counters = NULL;
+
+/* The counter keys for our entry, as last counted. */
+#define SCOREBOARD_MAX_ENTRY_KEYS	10
+static uint64_t entry_keys[SCOREBOARD_MAX_ENTRY_KEYS];
+static unsigned int entry_nkeys = 0;
+static int entry_keys_changed = FALSE;
+
+/* Minimum number of slots to map. */
+#define SCOREBOARD_MAP_MIN_SLOTS	256
+
+/* Max number of attempts for reading a changing slot */
+#define SCOREBOARD_MAX_READ_ATTEMPTS	1000
+
+#if defined(__GNUC__)
+# define SCOREBOARD_BARRIER()		__sync_synchronize()
+#else
+# define SCOREBOARD_BARRIER()
+#endif
+
 static const char *trace_channel = "scoreboard";
 
 /* Internal routines */
 
+#define SCOREBOARD_SLOT_OFFSET(slot) \
+  ((off_t) sizeof(pr_scoreboard_header_t) + \
+   ((off_t) (slot) * sizeof(pr_scoreboard_entry_t)))
+
+static int get_nslots(int fd, unsigned int *nslots) {
+  struct stat st;
+
+  if (fstat(fd, &st) < 0) {
+    return -1;
+  }
+
+  if (st.st_size < (off_t) sizeof(pr_scoreboard_header_t)) {
+    *nslots = 0;
+
+  } else {
+    *nslots = (st.st_size - sizeof(pr_scoreboard_header_t)) /
+      sizeof(pr_scoreboard_entry_t);
+  }
+
+  return 0;
+}
+
+/* Make sure the ScoreboardMutex file is large enough to hold the sequence
+ * counters for the given number of slots.  The caller must hold the
+ * ScoreboardMutex write lock.
+ */
+static int grow_seqs(int mutex_fd, unsigned int nslots) {
+  struct stat st;
+  off_t len;
+
+  if (fstat(mutex_fd, &st) < 0) {
+    return -1;
+  }
+
+  len = (off_t) nslots * sizeof(uint32_t);
+  if (st.st_size >= len) {
+    return 0;
+  }
+
+  while (ftruncate(mutex_fd, len) < 0) {
+    if (errno == EINTR) {
+      pr_signals_handle();
+      continue;
+    }
+
+    return -1;
+  }
+
+  return 0;
+}
+
+static void unmap_scoreboard(struct scoreboard_map *sm) {
+#if defined(HAVE_SYS_MMAN_H)
+  if (sm->sm_data != NULL) {
+    (void) munmap(sm->sm_data, sm->sm_datasz);
+  }
+
+  if (sm->sm_seqs != NULL) {
+    (void) munmap((void *) sm->sm_seqs, sm->sm_seqssz);
+  }
+#endif /* HAVE_SYS_MMAN_H */
+
+  memset(sm, 0, sizeof(struct scoreboard_map));
+}
+
+/* Map the given ScoreboardFile and ScoreboardMutex descriptors, covering at
+ * least the given number of slots.  Note that the mappings may extend past
+ * the end of the files; only the slots actually in the files are accessed.
+ */
+static int map_scoreboard(int fd, int mutex_fd, unsigned int nslots,
+    struct scoreboard_map *sm) {
+#if defined(HAVE_SYS_MMAN_H)
+  unsigned int map_nslots = SCOREBOARD_MAP_MIN_SLOTS;
+  void *data, *seqs;
+  size_t datasz, seqssz;
+
+  while (map_nslots < nslots) {
+    map_nslots *= 2;
+  }
+
+  datasz = SCOREBOARD_SLOT_OFFSET(map_nslots);
+  data = mmap(NULL, datasz, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    return -1;
+  }
+
+  seqssz = map_nslots * sizeof(uint32_t);
+  seqs = mmap(NULL, seqssz, PROT_READ|PROT_WRITE, MAP_SHARED, mutex_fd, 0);
+  if (seqs == MAP_FAILED) {
+    int xerrno = errno;
+
+    (void) munmap(data, datasz);
+    errno = xerrno;
+    return -1;
+  }
+
+  unmap_scoreboard(sm);
+
+  sm->sm_data = data;
+  sm->sm_datasz = datasz;
+  sm->sm_seqs = seqs;
+  sm->sm_seqssz = seqssz;
+  sm->sm_nslots = map_nslots;
+
+  pr_trace_msg(trace_channel, 9, "mapped %u scoreboard slots (fd %d)",
+    map_nslots, fd);
+  return 0;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif /* HAVE_SYS_MMAN_H */
+}
+
+static pr_scoreboard_entry_t *get_slot(struct scoreboard_map *sm,
+    unsigned int slot) {
+  return (pr_scoreboard_entry_t *) ((char *) sm->sm_data +
+    SCOREBOARD_SLOT_OFFSET(slot));
+}
+
+static void write_slot(struct scoreboard_map *sm, unsigned int slot,
+    const pr_scoreboard_entry_t *sce) {
+  uint32_t seq;
+
+  seq = sm->sm_seqs[slot];
+
+  /* A writer which died mid-update leaves an odd counter behind. */
+  if (seq & 1) {
+    seq++;
+  }
+
+  sm->sm_seqs[slot] = seq + 1;
+  SCOREBOARD_BARRIER();
+
+  memcpy(get_slot(sm, slot), sce, sizeof(pr_scoreboard_entry_t));
+
+  SCOREBOARD_BARRIER();
+  sm->sm_seqs[slot] = seq + 2;
+}
+
+static void read_slot(struct scoreboard_map *sm, unsigned int slot,
+    pr_scoreboard_entry_t *sce) {
+  register unsigned int i;
+
+  for (i = 0; i < SCOREBOARD_MAX_READ_ATTEMPTS; i++) {
+    uint32_t seq;
+
+    seq = sm->sm_seqs[slot];
+    if (seq & 1) {
+      continue;
+    }
+
+    SCOREBOARD_BARRIER();
+    memcpy(sce, get_slot(sm, slot), sizeof(pr_scoreboard_entry_t));
+    SCOREBOARD_BARRIER();
+
+    if (sm->sm_seqs[slot] == seq) {
+      return;
+    }
+  }
+
+  /* The slot is either changing constantly, or its writer died mid-update;
+   * settle for what is there now.
+   */
+  pr_trace_msg(trace_channel, 5,
+    "scoreboard slot %u still changing after %u attempts", slot, i);
+  memcpy(sce, get_slot(sm, slot), sizeof(pr_scoreboard_entry_t));
+}
+
+/* Make sure the current mapping covers the given number of slots. */
+static int remap_scoreboard(unsigned int nslots) {
+  if (nslots <= scoreboard_map.sm_nslots) {
+    return 0;
+  }
+
+  return map_scoreboard(scoreboard_fd, scoreboard_mutex_fd, nslots,
+    &scoreboard_map);
+}
+
+static uint64_t get_counter_key(int type, const char *server_addr,
+    const char *name, const char *name2) {
+  const char *ptr;
+  uint64_t h = 14695981039346656037ULL;
+
+  /* FNV-1a, over the type and the NUL-terminated strings. */
+  h = (h ^ (unsigned char) type) * 1099511628211ULL;
+  h = (h ^ (unsigned char) (type >> 8)) * 1099511628211ULL;
+
+  for (ptr = server_addr; *ptr; ptr++) {
+    h = (h ^ (unsigned char) *ptr) * 1099511628211ULL;
+  }
+  h *= 1099511628211ULL;
+
+  if (name != NULL) {
+    /* Class names are compared case-insensitively. */
+    for (ptr = name; *ptr; ptr++) {
+      unsigned char c = *ptr;
+
+      if ((type & ~PR_SCORE_COUNT_FL_AUTH) == PR_SCORE_COUNT_CLASS) {
+        c = tolower(c);
+      }
+
+      h = (h ^ c) * 1099511628211ULL;
+    }
+    h *= 1099511628211ULL;
+  }
+
+  if (name2 != NULL) {
+    for (ptr = name2; *ptr; ptr++) {
+      h = (h ^ (unsigned char) *ptr) * 1099511628211ULL;
+    }
+    h *= 1099511628211ULL;
+  }
+
+  return h != 0 ? h : 1;
+}
+
+/* Fill in the counter keys for the given entry, returning the number of
+ * keys.  Note that, as the Max* limits have always done, any user other than
+ * "(none)" counts as authenticated.
+ */
+static unsigned int get_entry_keys(const pr_scoreboard_entry_t *sce,
+    uint64_t *keys) {
+  unsigned int nkeys = 0;
+  const char *server_addr, *client_addr, *user;
+  int authenticated;
+
+  if (sce->sce_pid == 0 ||
+      sce->sce_server_addr[0] == '\0') {
+    return 0;
+  }
+
+  server_addr = sce->sce_server_addr;
+  client_addr = sce->sce_client_addr;
+  user = sce->sce_user;
+  authenticated = (strcmp(user, "(none)") != 0);
+
+  keys[nkeys++] = get_counter_key(PR_SCORE_COUNT_SERVER, server_addr, NULL,
+    NULL);
+  keys[nkeys++] = get_counter_key(PR_SCORE_COUNT_HOST, server_addr,
+    client_addr, NULL);
+  keys[nkeys++] = get_counter_key(PR_SCORE_COUNT_CLASS, server_addr,
+    sce->sce_class, NULL);
+
+  if (authenticated) {
+    keys[nkeys++] = get_counter_key(
+      PR_SCORE_COUNT_SERVER|PR_SCORE_COUNT_FL_AUTH, server_addr, NULL, NULL);
+    keys[nkeys++] = get_counter_key(
+      PR_SCORE_COUNT_HOST|PR_SCORE_COUNT_FL_AUTH, server_addr, client_addr,
+      NULL);
+    keys[nkeys++] = get_counter_key(
+      PR_SCORE_COUNT_CLASS|PR_SCORE_COUNT_FL_AUTH, server_addr,
+      sce->sce_class, NULL);
+    keys[nkeys++] = get_counter_key(PR_SCORE_COUNT_USER, server_addr, user,
+      NULL);
+    keys[nkeys++] = get_counter_key(PR_SCORE_COUNT_USER_HOST, server_addr,
+      user, client_addr);
+  }
+
+  if (sce->sce_cmd[0] != '\0') {
+    keys[nkeys++] = get_counter_key(PR_SCORE_COUNT_HOST_CMD, server_addr,
+      client_addr, sce->sce_cmd);
+    keys[nkeys++] = get_counter_key(PR_SCORE_COUNT_USER_CMD, server_addr,
+      user, sce->sce_cmd);
+  }
+
+  return nkeys;
+}
+
+#if defined(__GNUC__)
+static void lock_counters(void) {
+  pid_t pid, owner;
+  unsigned int nspins = 0;
+
+  pid = getpid();
+
+  while (!__sync_bool_compare_and_swap(&(scoreboard_counters->sct_lock), 0,
+      pid)) {
+    nspins++;
+    if (nspins < 100) {
+      continue;
+    }
+
+    /* The lock is only held briefly; if its holder no longer exists, it
+     * died while holding it, and the counts cannot be trusted.
+     */
+    owner = scoreboard_counters->sct_lock;
+    if (owner != 0 &&
+        kill(owner, 0) < 0 &&
+        errno == ESRCH) {
+      if (__sync_bool_compare_and_swap(&(scoreboard_counters->sct_lock),
+          owner, pid)) {
+        pr_trace_msg(trace_channel, 3, "PID %lu died holding scoreboard "
+          "counters lock, invalidating counters", (unsigned long) owner);
+        scoreboard_counters->sct_invalid = TRUE;
+        return;
+      }
+    }
+
+    nspins = 0;
+    (void) pr_timer_usleep(100);
+  }
+}
+
+static void unlock_counters(void) {
+  __sync_lock_release(&(scoreboard_counters->sct_lock));
+}
+#endif /* __GNUC__ */
+
+/* Adjust the count for the given key.  The caller must hold the counters
+ * lock.
+ */
+static void adjust_counter(uint64_t key, int delta) {
+  struct scoreboard_counter *counters;
+  unsigned int i, j;
+
+  counters = scoreboard_counters->sct_counters;
+
+  for (i = key % PR_SCOREBOARD_MAX_COUNTERS;
+       counters[i].sc_key != 0;
+       i = (i + 1) % PR_SCOREBOARD_MAX_COUNTERS) {
+    if (counters[i].sc_key == key) {
+      break;
+    }
+  }
+
+  if (counters[i].sc_key == 0) {
+    if (delta < 0) {
+      scoreboard_counters->sct_invalid = TRUE;
+      return;
+    }
+
+    /* Keep the table no more than three-quarters full, so that probe
+     * sequences stay short.
+     */
+    if (scoreboard_counters->sct_nused >=
+        (PR_SCOREBOARD_MAX_COUNTERS / 4) * 3) {
+      pr_trace_msg(trace_channel, 3, "scoreboard counters table full "
+        "(%u counters), invalidating counters",
+        scoreboard_counters->sct_nused);
+      scoreboard_counters->sct_invalid = TRUE;
+      return;
+    }
+
+    counters[i].sc_key = key;
+    counters[i].sc_count = 0;
+    scoreboard_counters->sct_nused++;
+  }
+
+  if (delta < 0 &&
+      counters[i].sc_count < (uint32_t) -delta) {
+    scoreboard_counters->sct_invalid = TRUE;
+    counters[i].sc_count = 0;
+
+  } else {
+    counters[i].sc_count += delta;
+  }
+
+  if (counters[i].sc_count > 0) {
+    return;
+  }
+
+  /* Remove the unused counter, moving any later counters in the same probe
+   * sequence back into the gap.
+   */
+  j = i;
+  while (TRUE) {
+    unsigned int k;
+
+    j = (j + 1) % PR_SCOREBOARD_MAX_COUNTERS;
+    if (counters[j].sc_key == 0) {
+      break;
+    }
+
+    k = counters[j].sc_key % PR_SCOREBOARD_MAX_COUNTERS;
+    if ((j > i && (k <= i || k > j)) ||
+        (j < i && (k <= i && k > j))) {
+      counters[i] = counters[j];
+      i = j;
+    }
+  }
+
+  counters[i].sc_key = 0;
+  counters[i].sc_count = 0;
+  scoreboard_counters->sct_nused--;
+}
+
+/* Recount the entries in the given mapping.  The caller must hold the
+ * counters lock.
+ */
+static void rebuild_counters(struct scoreboard_map *sm, unsigned int nslots) {
+  register unsigned int i;
+
+  memset(scoreboard_counters->sct_counters, 0,
+    sizeof(scoreboard_counters->sct_counters));
+  scoreboard_counters->sct_nused = 0;
+  scoreboard_counters->sct_invalid = FALSE;
+
+  for (i = 0; i < nslots; i++) {
+    register unsigned int j;
+    pr_scoreboard_entry_t sce;
+    uint64_t keys[SCOREBOARD_MAX_ENTRY_KEYS];
+    unsigned int nkeys;
+
+    read_slot(sm, i, &sce);
+
+    nkeys = get_entry_keys(&sce, keys);
+    for (j = 0; j < nkeys; j++) {
+      adjust_counter(keys[j], 1);
+    }
+  }
+
+  pr_trace_msg(trace_channel, 9, "rebuilt scoreboard counters for %u slots "
+    "(%u counters)", nslots, scoreboard_counters->sct_nused);
+}
+
+/* Write our entry to its slot, updating the counts to match. */
+static void write_counted_slot(void) {
+  register unsigned int i;
+  uint64_t keys[SCOREBOARD_MAX_ENTRY_KEYS];
+  unsigned int nkeys;
+
+  if (scoreboard_counters == NULL ||
+      entry_keys_changed == FALSE) {
+    write_slot(&scoreboard_map, entry_slot, &entry);
+    return;
+  }
+
+  nkeys = get_entry_keys(&entry, keys);
+
+#if defined(__GNUC__)
+  lock_counters();
+#endif /* __GNUC__ */
+
+  write_slot(&scoreboard_map, entry_slot, &entry);
+
+  for (i = 0; i < entry_nkeys; i++) {
+    adjust_counter(entry_keys[i], -1);
+  }
+
+  for (i = 0; i < nkeys; i++) {
+    adjust_counter(keys[i], 1);
+  }
+
+#if defined(__GNUC__)
+  unlock_counters();
+#endif /* __GNUC__ */
+
+  memcpy(entry_keys, keys, sizeof(keys));
+  entry_nkeys = nkeys;
+  entry_keys_changed = FALSE;
+}
+
 static char *handle_score_str(const char *fmt, va_list cmdap) {
   static char buf[PR_TUNABLE_SCOREBOARD_BUFFER_SIZE] = {'\0'};
   memset(buf, '\0', sizeof(buf));
@@ -369,6 +915,60 @@ static int write_entry(int fd) {
   return 0;
 }
 
+/* Map the just-opened scoreboard.  If it cannot be mapped, the scoreboard
+ * is read and written using the descriptor, as usual.
+ */
+static void open_scoreboard_map(void) {
+  unsigned int nslots = 0;
+  struct stat st;
+
+  if (get_nslots(scoreboard_fd, &nslots) < 0 ||
+      fstat(scoreboard_mutex_fd, &st) < 0) {
+    pr_trace_msg(trace_channel, 3, "unable to map scoreboard: %s",
+      strerror(errno));
+    return;
+  }
+
+  if (st.st_size < (off_t) (nslots * sizeof(uint32_t))) {
+    int res;
+
+    /* The scoreboard has entries, but not the sequence counters for them,
+     * e.g. if the ScoreboardMutex was deleted.
+     */
+    if (wlock_scoreboard() < 0) {
+      pr_trace_msg(trace_channel, 3, "unable to map scoreboard: %s",
+        strerror(errno));
+      return;
+    }
+
+    res = get_nslots(scoreboard_fd, &nslots);
+    if (res == 0) {
+      res = grow_seqs(scoreboard_mutex_fd, nslots);
+    }
+
+    if (res < 0) {
+      int xerrno = errno;
+
+      unlock_scoreboard();
+      pr_trace_msg(trace_channel, 3, "unable to map scoreboard: %s",
+        strerror(xerrno));
+      return;
+    }
+
+    unlock_scoreboard();
+  }
+
+  if (map_scoreboard(scoreboard_fd, scoreboard_mutex_fd, nslots,
+      &scoreboard_map) < 0) {
+    pr_trace_msg(trace_channel, 3, "unable to map scoreboard: %s",
+      strerror(errno));
+    return;
+  }
+
+  scoreboard_nslots = nslots;
+  scan_slot = 0;
+}
+
 /* Public routines */
 
 int pr_close_scoreboard(int keep_mutex) {
@@ -383,6 +983,8 @@ int pr_close_scoreboard(int keep_mutex) {
   if (scoreboard_read_locked || scoreboard_write_locked)
     unlock_scoreboard();
 
+  unmap_scoreboard(&scoreboard_map);
+
   pr_trace_msg(trace_channel, 4, "closing scoreboard fd %d", scoreboard_fd);
 
   while (close(scoreboard_fd) < 0) {
@@ -443,6 +1045,8 @@ void pr_delete_scoreboard(void) {
     }
   }
 
+  unmap_scoreboard(&scoreboard_map);
+
   scoreboard_fd = -1;
   scoreboard_mutex_fd = -1;
   scoreboard_opener = 0;
@@ -507,6 +1111,9 @@ int pr_open_scoreboard(int flags) {
     return 0;
   }
 
+  /* Any mapping inherited from our parent process is not ours to use. */
+  unmap_scoreboard(&scoreboard_map);
+
   /* Check for symlinks prior to opening the file. */
   if (lstat(scoreboard_file, &st) == 0) {
     if (S_ISLNK(st.st_mode)) {
@@ -656,9 +1263,14 @@ int pr_open_scoreboard(int flags) {
     }
 
     unlock_scoreboard();
+    open_scoreboard_map();
     return 0;
   }
 
+  if (res == 0) {
+    open_scoreboard_map();
+  }
+
   return res;
 }
 
@@ -680,6 +1292,12 @@ int pr_restore_scoreboard(void) {
     return -1;
   }
 
+  if (scoreboard_map.sm_data != NULL) {
+    scan_slot = (current_pos - sizeof(pr_scoreboard_header_t)) /
+      sizeof(pr_scoreboard_entry_t);
+    return 0;
+  }
+
   /* Position the file position pointer of the scoreboard back to
    * where it was, prior to the last pr_rewind_scoreboard() call.
    */
@@ -702,6 +1320,12 @@ int pr_rewind_scoreboard(void) {
     return -1;
   }
 
+  if (scoreboard_map.sm_data != NULL) {
+    current_pos = SCOREBOARD_SLOT_OFFSET(scan_slot);
+    scan_slot = 0;
+    return 0;
+  }
+
   res = lseek(scoreboard_fd, (off_t) 0, SEEK_CUR);
   if (res == (off_t) -1) {
     return -1;
@@ -828,25 +1452,86 @@ int pr_set_scoreboard_mutex(const char *path) {
   return 0;
 }
 
-int pr_scoreboard_entry_add(void) {
-  int res;
-  unsigned char found_slot = FALSE;
-
-  if (scoreboard_engine == FALSE) {
-    return 0;
-  }
+/* Find a free slot in the mapped scoreboard, adding one to the end of the
+ * file if there are none, and write our new entry to it.  The caller must
+ * hold the ScoreboardMutex write lock.
+ */
+static int add_mapped_entry(void) {
+  register unsigned int i;
+  unsigned int nslots;
 
-  if (scoreboard_fd < 0) {
-    errno = EINVAL;
+  if (get_nslots(scoreboard_fd, &nslots) < 0 ||
+      remap_scoreboard(nslots) < 0) {
     return -1;
   }
 
-  if (have_entry) {
-    pr_trace_msg(trace_channel, 9,
-      "unable to add scoreboard entry: already have entry");
-    errno = EPERM;
-    return -1;
-  }
+  scoreboard_nslots = nslots;
+
+  for (i = 0; i < nslots; i++) {
+    if (get_slot(&scoreboard_map, i)->sce_pid == 0) {
+      break;
+    }
+  }
+
+  if (i == nslots) {
+    /* The sequence counter must exist before the slot does. */
+    if (grow_seqs(scoreboard_mutex_fd, nslots + 1) < 0) {
+      return -1;
+    }
+
+    while (ftruncate(scoreboard_fd, SCOREBOARD_SLOT_OFFSET(nslots + 1)) < 0) {
+      if (errno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+      return -1;
+    }
+
+    if (remap_scoreboard(nslots + 1) < 0) {
+      return -1;
+    }
+
+    scoreboard_nslots = nslots + 1;
+  }
+
+  memset(&entry, '\0', sizeof(entry));
+
+  entry.sce_pid = session.pid ? session.pid : getpid();
+  entry.sce_uid = geteuid();
+  entry.sce_gid = getegid();
+
+  entry_slot = i;
+  entry_lock.l_start = SCOREBOARD_SLOT_OFFSET(i);
+  write_slot(&scoreboard_map, entry_slot, &entry);
+
+  /* A new entry has nothing yet to be counted. */
+  entry_nkeys = 0;
+  entry_keys_changed = FALSE;
+
+  pr_trace_msg(trace_channel, 9, "added scoreboard entry in slot %u", i);
+  return 0;
+}
+
+int pr_scoreboard_entry_add(void) {
+  int res;
+  unsigned char found_slot = FALSE;
+
+  if (scoreboard_engine == FALSE) {
+    return 0;
+  }
+
+  if (scoreboard_fd < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (have_entry) {
+    pr_trace_msg(trace_channel, 9,
+      "unable to add scoreboard entry: already have entry");
+    errno = EPERM;
+    return -1;
+  }
 
   pr_trace_msg(trace_channel, 3, "adding new scoreboard entry");
 
@@ -858,6 +1543,22 @@ int pr_scoreboard_entry_add(void) {
   /* No interruptions, please. */
   pr_signals_block();
 
+  if (scoreboard_map.sm_data != NULL) {
+    res = add_mapped_entry();
+    if (res < 0) {
+      pr_log_pri(PR_LOG_NOTICE, "error writing scoreboard entry: %s",
+        strerror(errno));
+
+    } else {
+      have_entry = TRUE;
+    }
+
+    pr_signals_unblock();
+    unlock_scoreboard();
+
+    return res;
+  }
+
   /* If the scoreboard is open, the file position is already past the
    * header.
    */
@@ -884,6 +1585,13 @@ int pr_scoreboard_entry_add(void) {
       break;
   }
 
+  /* Other processes may have the scoreboard mapped; make sure the sequence
+   * counter for this slot exists for them.
+   */
+  (void) grow_seqs(scoreboard_mutex_fd,
+    ((entry_lock.l_start - sizeof(pr_scoreboard_header_t)) /
+      sizeof(pr_scoreboard_entry_t)) + 1);
+
   memset(&entry, '\0', sizeof(entry));
 
   entry.sce_pid = session.pid ? session.pid : getpid();
@@ -925,6 +1633,22 @@ int pr_scoreboard_entry_del(unsigned char verbose) {
   pr_trace_msg(trace_channel, 3, "deleting scoreboard entry");
 
   memset(&entry, '\0', sizeof(entry));
+  entry_dirty = FALSE;
+
+  if (scoreboard_map.sm_data != NULL) {
+    /* Write-lock the scoreboard, since new connections might try to use the
+     * slot being opened up here.
+     */
+    wlock_scoreboard();
+
+    entry_keys_changed = TRUE;
+    write_counted_slot();
+
+    have_entry = FALSE;
+    unlock_scoreboard();
+
+    return 0;
+  }
 
   /* Write-lock this entry */
   wlock_entry(scoreboard_fd);
@@ -963,6 +1687,42 @@ time_t pr_scoreboard_get_daemon_uptime(void) {
   return header.sch_uptime;
 }
 
+/* Read the next in-use entry from the mapped scoreboard, without locking.
+ * The number of slots in the file is only checked once the last known slot
+ * has been read.
+ */
+static pr_scoreboard_entry_t *read_mapped_entry(pr_scoreboard_entry_t *sce) {
+  pr_trace_msg(trace_channel, 5, "reading scoreboard entry");
+
+  while (TRUE) {
+    while (scan_slot < scoreboard_nslots) {
+      read_slot(&scoreboard_map, scan_slot++, sce);
+
+      if (sce->sce_pid) {
+        return sce;
+      }
+    }
+
+    if (get_nslots(scoreboard_fd, &scoreboard_nslots) < 0) {
+      return NULL;
+    }
+
+    if (scan_slot >= scoreboard_nslots) {
+      break;
+    }
+
+    if (remap_scoreboard(scoreboard_nslots) < 0) {
+      pr_trace_msg(trace_channel, 3, "error mapping scoreboard: %s",
+        strerror(errno));
+      scoreboard_nslots = scoreboard_map.sm_nslots;
+      return NULL;
+    }
+  }
+
+  memset(sce, '\0', sizeof(pr_scoreboard_entry_t));
+  return NULL;
+}
+
 pr_scoreboard_entry_t *pr_scoreboard_entry_read(void) {
   static pr_scoreboard_entry_t scan_entry;
   int res = 0;
@@ -976,6 +1736,10 @@ pr_scoreboard_entry_t *pr_scoreboard_entry_read(void) {
     return NULL;
   }
 
+  if (scoreboard_map.sm_data != NULL) {
+    return read_mapped_entry(&scan_entry);
+  }
+
   /* Make sure the scoreboard file is read-locked. */
   if (!scoreboard_read_locked) {
 
@@ -1159,29 +1923,10 @@ ascii:
 #endif /* !PR_USE_NLS */
 }
 
-int pr_scoreboard_entry_update(pid_t pid, ...) {
-  va_list ap;
+static int set_entry_fields(va_list ap) {
   char *tmp = NULL;
   int entry_tag = 0;
 
-  if (scoreboard_engine == FALSE) {
-    return 0;
-  }
-
-  if (scoreboard_fd < 0) {
-    errno = EINVAL;
-    return -1;
-  }
-
-  if (!have_entry) {
-    errno = EPERM;
-    return -1;
-  }
-
-  pr_trace_msg(trace_channel, 3, "updating scoreboard entry");
-
-  va_start(ap, pid);
-
   while ((entry_tag = va_arg(ap, int)) != 0) {
     pr_signals_handle();
 
@@ -1192,6 +1937,8 @@ int pr_scoreboard_entry_update(pid_t pid, ...) {
         sstrncpy(entry.sce_user, tmp,
           str_getlen(tmp, sizeof(entry.sce_user)-1) + 1);
 
+        entry_keys_changed = TRUE;
+
         pr_trace_msg(trace_channel, 15, "updated scoreboard entry user to '%s'",
           entry.sce_user);
         break;
@@ -1203,6 +1950,7 @@ int pr_scoreboard_entry_update(pid_t pid, ...) {
             "%s", remote_addr ? pr_netaddr_get_ipstr(remote_addr) :
             "(unknown)");
           entry.sce_client_addr[sizeof(entry.sce_client_addr) - 1] = '\0';
+          entry_keys_changed = TRUE;
 
           pr_trace_msg(trace_channel, 15, "updated scoreboard entry client "
             "address to '%s'", entry.sce_client_addr);
@@ -1232,6 +1980,7 @@ int pr_scoreboard_entry_update(pid_t pid, ...) {
         tmp = va_arg(ap, char *);
         memset(entry.sce_class, '\0', sizeof(entry.sce_class));
         sstrncpy(entry.sce_class, tmp, sizeof(entry.sce_class));
+        entry_keys_changed = TRUE;
 
         pr_trace_msg(trace_channel, 15, "updated scoreboard entry class to "
           "'%s'", entry.sce_class);
@@ -1255,6 +2004,7 @@ int pr_scoreboard_entry_update(pid_t pid, ...) {
           memset(entry.sce_cmd, '\0', sizeof(entry.sce_cmd));
           sstrncpy(entry.sce_cmd, cmdstr, sizeof(entry.sce_cmd));
           (void) va_arg(ap, void *);
+          entry_keys_changed = TRUE;
 
           pr_trace_msg(trace_channel, 15, "updated scoreboard entry "
             "command to '%s'", entry.sce_cmd);
@@ -1290,6 +2040,7 @@ int pr_scoreboard_entry_update(pid_t pid, ...) {
             "%s:%d", server_addr ? pr_netaddr_get_ipstr(server_addr) :
             "(unknown)", server_port);
           entry.sce_server_addr[sizeof(entry.sce_server_addr)-1] = '\0';
+          entry_keys_changed = TRUE;
 
           pr_trace_msg(trace_channel, 15, "updated scoreboard entry server "
             "address to '%s'", entry.sce_server_addr);
@@ -1356,26 +2107,162 @@ int pr_scoreboard_entry_update(pid_t pid, ...) {
         break;
 
       default:
-        va_end(ap);
         errno = ENOENT;
         return -1;
     }
   }
 
+  return 0;
+}
+
+static void write_current_entry(void) {
+  if (scoreboard_map.sm_data != NULL) {
+    write_counted_slot();
+
+  } else {
+    if (scoreboard_counters != NULL &&
+        entry_keys_changed) {
+      /* Without the mapping, our entry cannot be counted. */
+      scoreboard_counters->sct_invalid = TRUE;
+    }
+
+    /* Write-lock this entry */
+    wlock_entry(scoreboard_fd);
+    if (write_entry(scoreboard_fd) < 0) {
+      pr_log_pri(PR_LOG_NOTICE, "error writing scoreboard entry: %s",
+        strerror(errno));
+    }
+    unlock_entry(scoreboard_fd);
+  }
+
+  entry_dirty = FALSE;
+  (void) gettimeofday(&entry_written_tv, NULL);
+}
+
+int pr_scoreboard_entry_update(pid_t pid, ...) {
+  va_list ap;
+  int res;
+
+  if (scoreboard_engine == FALSE) {
+    return 0;
+  }
+
+  if (scoreboard_fd < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (!have_entry) {
+    errno = EPERM;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 3, "updating scoreboard entry");
+
+  va_start(ap, pid);
+  res = set_entry_fields(ap);
   va_end(ap);
 
-  /* Write-lock this entry */
-  wlock_entry(scoreboard_fd);
-  if (write_entry(scoreboard_fd) < 0) {
-    pr_log_pri(PR_LOG_NOTICE, "error writing scoreboard entry: %s",
-      strerror(errno));
+  if (res < 0) {
+    return -1;
   }
-  unlock_entry(scoreboard_fd);
+
+  write_current_entry();
 
   pr_trace_msg(trace_channel, 3, "finished updating scoreboard entry");
   return 0;
 }
 
+static int entry_flush_cb(CALLBACK_FRAME) {
+  entry_flush_timerno = -1;
+  (void) pr_scoreboard_entry_flush();
+
+  /* Don't restart this timer. */
+  return 0;
+}
+
+int pr_scoreboard_entry_update_deferred(pid_t pid, ...) {
+  va_list ap;
+  int res;
+  struct timeval now;
+  long elapsed_usecs;
+
+  if (scoreboard_engine == FALSE) {
+    return 0;
+  }
+
+  if (scoreboard_fd < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (!have_entry) {
+    errno = EPERM;
+    return -1;
+  }
+
+  va_start(ap, pid);
+  res = set_entry_fields(ap);
+  va_end(ap);
+
+  if (res < 0) {
+    return -1;
+  }
+
+  (void) gettimeofday(&now, NULL);
+  elapsed_usecs = ((now.tv_sec - entry_written_tv.tv_sec) * 1000000L) +
+    (now.tv_usec - entry_written_tv.tv_usec);
+
+  if (elapsed_usecs < 0 ||
+      elapsed_usecs >= (1000000L / PR_TUNABLE_DEFERRED_UPDATES_PER_SEC)) {
+    write_current_entry();
+    return 0;
+  }
+
+  entry_dirty = TRUE;
+
+  /* Make sure that the pending changes are written out eventually, even if
+   * no more updates follow.
+   */
+  if (entry_flush_timerno < 0) {
+    entry_flush_timerno = pr_timer_add(1, -1, NULL, entry_flush_cb,
+      "scoreboard entry flush");
+  }
+
+  return 0;
+}
+
+int pr_scoreboard_entry_flush(void) {
+  if (entry_flush_timerno >= 0) {
+    (void) pr_timer_remove(entry_flush_timerno, ANY_MODULE);
+    entry_flush_timerno = -1;
+  }
+
+  if (entry_dirty == FALSE) {
+    return 0;
+  }
+
+  entry_dirty = FALSE;
+
+  if (scoreboard_engine == FALSE) {
+    return 0;
+  }
+
+  if (scoreboard_fd < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (!have_entry) {
+    errno = EPERM;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 9, "writing deferred scoreboard entry changes");
+  write_current_entry();
+  return 0;
+}
+
 /* Validate the PID in a scoreboard entry.  A PID can be invalid in a couple
  * of ways:
  *
@@ -1408,6 +2295,61 @@ static int scoreboard_valid_pid(pid_t pid, pid_t curr_pgrp) {
   return 0;
 }
 
+/* Scrub the scoreboard using a mapping of the given descriptor.  The caller
+ * must hold the ScoreboardMutex write lock.
+ */
+static int scrub_mapped_scoreboard(int fd, pid_t curr_pgrp) {
+  register unsigned int i;
+  unsigned int nslots;
+  struct scoreboard_map sm;
+  pr_scoreboard_entry_t sce;
+
+  memset(&sm, 0, sizeof(sm));
+
+  if (get_nslots(fd, &nslots) < 0 ||
+      grow_seqs(scoreboard_mutex_fd, nslots) < 0 ||
+      map_scoreboard(fd, scoreboard_mutex_fd, nslots, &sm) < 0) {
+    pr_trace_msg(trace_channel, 3, "unable to map scoreboard for scrubbing: %s",
+      strerror(errno));
+    return -1;
+  }
+
+  memset(&sce, 0, sizeof(sce));
+
+  PRIVS_ROOT
+
+  for (i = 0; i < nslots; i++) {
+    pid_t slot_pid;
+
+    pr_signals_handle();
+
+    /* Check to see if the PID in this entry is valid.  If not, erase the
+     * slot.
+     */
+    slot_pid = get_slot(&sm, i)->sce_pid;
+    if (slot_pid &&
+        scoreboard_valid_pid(slot_pid, curr_pgrp) < 0) {
+      pr_log_debug(DEBUG9, "scrubbing scoreboard entry for PID %lu",
+        (unsigned long) slot_pid);
+      write_slot(&sm, i, &sce);
+    }
+  }
+
+  PRIVS_RELINQUISH
+
+#if defined(__GNUC__)
+  /* Correct any drift in the counts, e.g. from the entries just scrubbed. */
+  if (scoreboard_counters != NULL) {
+    lock_counters();
+    rebuild_counters(&sm, nslots);
+    unlock_counters();
+  }
+#endif /* __GNUC__ */
+
+  unmap_scoreboard(&sm);
+  return 0;
+}
+
 int pr_scoreboard_scrub(void) {
   int fd = -1, res, xerrno;
   off_t curr_offset = 0;
@@ -1453,7 +2395,17 @@ int pr_scoreboard_scrub(void) {
 #elif HAVE_GETPGID
   curr_pgrp = getpgid(0);
 #endif /* !HAVE_GETPGRP and !HAVE_GETPGID */
- 
+
+  if (scrub_mapped_scoreboard(fd, curr_pgrp) == 0) {
+    unlock_scoreboard();
+    (void) close(fd);
+
+    pr_log_debug(DEBUG9, "finished scrubbing scoreboard");
+    pr_trace_msg(trace_channel, 9, "%s", "finished scrubbing scoreboard");
+
+    return 0;
+  }
+
   /* Skip past the scoreboard header. */
   curr_offset = lseek(fd, (off_t) sizeof(pr_scoreboard_header_t), SEEK_SET);
   if (curr_offset < 0) {
@@ -1590,3 +2542,107 @@ int pr_scoreboard_scrub(void) {
 
   return 0;
 }
+
+int pr_scoreboard_get_count(int type, const char *server_addr,
+    const char *name, const char *name2, unsigned int *count) {
+  struct scoreboard_counter *counters;
+  uint64_t key;
+  unsigned int i;
+
+  if (server_addr == NULL ||
+      count == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (scoreboard_counters == NULL) {
+    errno = ENOSYS;
+    return -1;
+  }
+
+  if (scoreboard_counters->sct_invalid) {
+    errno = EAGAIN;
+    return -1;
+  }
+
+  key = get_counter_key(type, server_addr, name, name2);
+  counters = scoreboard_counters->sct_counters;
+  *count = 0;
+
+#if defined(__GNUC__)
+  lock_counters();
+#endif /* __GNUC__ */
+
+  for (i = key % PR_SCOREBOARD_MAX_COUNTERS;
+       counters[i].sc_key != 0;
+       i = (i + 1) % PR_SCOREBOARD_MAX_COUNTERS) {
+    if (counters[i].sc_key == key) {
+      *count = counters[i].sc_count;
+      break;
+    }
+  }
+
+#if defined(__GNUC__)
+  unlock_counters();
+#endif /* __GNUC__ */
+
+  return 0;
+}
+
+int init_scoreboard_counters(void) {
+#if defined(__GNUC__) && defined(HAVE_SYS_MMAN_H)
+  unsigned int nslots;
+
+  if (scoreboard_engine == FALSE) {
+    return 0;
+  }
+
+  /* The counts are built from, and kept in step with, the mapped entries. */
+  if (scoreboard_map.sm_data == NULL ||
+      get_nslots(scoreboard_fd, &nslots) < 0 ||
+      remap_scoreboard(nslots) < 0) {
+    errno = EPERM;
+    return -1;
+  }
+
+  if (scoreboard_counters == NULL) {
+    void *data;
+    int mmap_flags;
+
+    mmap_flags = MAP_SHARED;
+# if defined(MAP_ANONYMOUS)
+    mmap_flags |= MAP_ANONYMOUS;
+# elif defined(MAP_ANON)
+    mmap_flags |= MAP_ANON;
+# else
+    errno = ENOSYS;
+    return -1;
+# endif
+
+    data = mmap(NULL, sizeof(struct scoreboard_counters),
+      PROT_READ|PROT_WRITE, mmap_flags, -1, 0);
+    if (data == MAP_FAILED) {
+      int xerrno = errno;
+
+      pr_log_debug(DEBUG0, "error allocating %lu bytes for scoreboard "
+        "counters: %s", (unsigned long) sizeof(struct scoreboard_counters),
+        strerror(xerrno));
+
+      errno = xerrno;
+      return -1;
+    }
+
+    memset(data, 0, sizeof(struct scoreboard_counters));
+    scoreboard_counters = data;
+  }
+
+  lock_counters();
+  rebuild_counters(&scoreboard_map, nslots);
+  unlock_counters();
+
+  return 0;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif /* __GNUC__ and HAVE_SYS_MMAN_H */
+}
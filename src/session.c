@@ -368,14 +368,25 @@ void pr_session_send_banner(server_rec *s, int flags) {
   }
 }
 
-int pr_session_set_idle(void) {
+static int session_set_idle(int deferred) {
   const char *user = NULL;
+  int (*scoreboard_update)(pid_t, ...);
+  void (*proctitle_set)(const char *, ...);
+
+  if (deferred) {
+    scoreboard_update = pr_scoreboard_entry_update_deferred;
+    proctitle_set = pr_proctitle_set_deferred;
+
+  } else {
+    scoreboard_update = pr_scoreboard_entry_update;
+    proctitle_set = pr_proctitle_set;
+  }
 
-  pr_scoreboard_entry_update(session.pid,
+  (scoreboard_update)(session.pid,
     PR_SCORE_BEGIN_IDLE, time(NULL),
     PR_SCORE_CMD, "%s", "idle", NULL, NULL);
 
-  pr_scoreboard_entry_update(session.pid,
+  (scoreboard_update)(session.pid,
     PR_SCORE_CMD_ARG, "%s", "", NULL, NULL);
 
   if (session.user) {
@@ -385,10 +396,18 @@ int pr_session_set_idle(void) {
     user = "(authenticating)";
   }
 
-  pr_proctitle_set("%s - %s: IDLE", user, session.proc_prefix);
+  (proctitle_set)("%s - %s: IDLE", user, session.proc_prefix);
   return 0;
 }
 
+int pr_session_set_idle(void) {
+  return session_set_idle(FALSE);
+}
+
+int pr_session_set_idle_deferred(void) {
+  return session_set_idle(TRUE);
+}
+
 int pr_session_set_protocol(const char *sess_proto) {
   int count, res = 0, xerrno = 0;
 
@@ -62,6 +62,9 @@ static void finish_terminate(int signo) {
       pr_pidfile_remove();
     }
 
+    /* Nor the metrics socket. */
+    pr_metrics_close();
+
     /* Run any exit handlers registered in the master process here, so that
      * they may have the benefit of root privs.  More than likely these
      * exit handlers were registered by modules' module initialization
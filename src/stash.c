@@ -64,6 +64,25 @@ static struct stash *auth_curr_sym = NULL;
 static xaset_t *hook_symbol_table[PR_TUNABLE_HASH_TABLE_SIZE];
 static struct stash *hook_curr_sym = NULL;
 
+/* Resolved dispatch lists for commands, i.e. each command's CMD symbols
+ * grouped by cmd_type.  These are resolved on first use, and discarded
+ * whenever the CMD symbols change.
+ */
+struct cmd_handlers {
+  const char *cmd_name;
+
+  /* Indexed by cmd_type, PRE_CMD through LOG_CMD_ERR. */
+  cmdtable **handlers[LOG_CMD_ERR + 1];
+};
+
+static pool *cmd_handlers_pool = NULL;
+static pr_table_t *cmd_handlers_tab = NULL;
+static struct cmd_handlers *cmd_handlers_ids[PR_CMD_MAX_ID + 1];
+static struct cmd_handlers *cmd_handlers_any = NULL;
+static cmdtable *cmd_handlers_none[1] = { NULL };
+
+static void cmd_handlers_clear(void);
+
 /* Symbol stash lookup code and management */
 
 static struct stash *sym_alloc(void) {
@@ -238,6 +257,7 @@ int pr_stash_add_symbol(pr_stash_type_t sym_type, void *data) {
       sym->sym_module = ((cmdtable *) data)->m;
       sym->ptr.sym_cmd = data;
       symbol_table = cmd_symbol_table;
+      cmd_handlers_clear();
       break;
 
     case PR_SYM_AUTH:
@@ -689,6 +709,8 @@ int pr_stash_remove_cmd(const char *cmd_name, module *m,
       cmd_curr_sym = NULL;
       tab = NULL;
       count++;
+
+      cmd_handlers_clear();
     }
 
     tab = pr_stash_get_symbol2(PR_SYM_CMD, cmd_name, tab, &prev_idx, &hash);
@@ -697,6 +719,147 @@ int pr_stash_remove_cmd(const char *cmd_name, module *m,
   return count;
 }
 
+static void cmd_handlers_clear(void) {
+  if (cmd_handlers_pool != NULL) {
+    destroy_pool(cmd_handlers_pool);
+    cmd_handlers_pool = NULL;
+  }
+
+  cmd_handlers_tab = NULL;
+  memset(cmd_handlers_ids, 0, sizeof(cmd_handlers_ids));
+  cmd_handlers_any = NULL;
+}
+
+static struct cmd_handlers *cmd_handlers_resolve(const char *cmd_name) {
+  register unsigned int i;
+  struct cmd_handlers *ch;
+  array_header *syms;
+  unsigned int counts[LOG_CMD_ERR + 1];
+  cmdtable **tabs;
+  int idx;
+  unsigned int hash;
+  size_t cmd_namelen;
+  struct stash *sym;
+
+  /* Don't forget to include one for the terminating NUL. */
+  cmd_namelen = strlen(cmd_name) + 1;
+  hash = sym_type_hash(PR_SYM_CMD, cmd_name, cmd_namelen);
+  idx = hash % PR_TUNABLE_HASH_TABLE_SIZE;
+
+  sym = stash_lookup(PR_SYM_CMD, cmd_name, cmd_namelen, idx, hash);
+  if (sym == NULL) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  if (cmd_handlers_pool == NULL) {
+    cmd_handlers_pool = make_sub_pool(symbol_pool);
+    pr_pool_tag(cmd_handlers_pool, "Stash CMD handlers pool");
+  }
+
+  memset(counts, 0, sizeof(counts));
+  syms = make_array(cmd_handlers_pool, 8, sizeof(cmdtable *));
+
+  while (sym != NULL) {
+    cmdtable *tab;
+
+    pr_signals_handle();
+
+    tab = sym->ptr.sym_cmd;
+    if (tab->cmd_type >= PRE_CMD &&
+        tab->cmd_type <= LOG_CMD_ERR) {
+      *((cmdtable **) push_array(syms)) = tab;
+      counts[tab->cmd_type]++;
+    }
+
+    sym = stash_lookup_next(PR_SYM_CMD, cmd_name, cmd_namelen, idx, hash, tab);
+  }
+
+  ch = pcalloc(cmd_handlers_pool, sizeof(struct cmd_handlers));
+  ch->cmd_name = pstrdup(cmd_handlers_pool, cmd_name);
+
+  for (i = PRE_CMD; i <= LOG_CMD_ERR; i++) {
+    if (counts[i] == 0) {
+      ch->handlers[i] = cmd_handlers_none;
+      continue;
+    }
+
+    ch->handlers[i] = pcalloc(cmd_handlers_pool,
+      (counts[i] + 1) * sizeof(cmdtable *));
+    counts[i] = 0;
+  }
+
+  tabs = syms->elts;
+  for (i = 0; i < syms->nelts; i++) {
+    unsigned char cmd_type;
+
+    cmd_type = tabs[i]->cmd_type;
+    ch->handlers[cmd_type][counts[cmd_type]++] = tabs[i];
+  }
+
+  return ch;
+}
+
+cmdtable **pr_stash_get_cmd_handlers(const char *cmd_name, int cmd_id,
+    unsigned char cmd_type) {
+  struct cmd_handlers *ch = NULL;
+
+  if (cmd_name == NULL ||
+      cmd_type < PRE_CMD ||
+      cmd_type > LOG_CMD_ERR) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  /* The cmd ID and name should agree, but the name is what the symbols are
+   * keyed on, so check.
+   */
+  if (cmd_id > 0 &&
+      cmd_id <= PR_CMD_MAX_ID) {
+    ch = cmd_handlers_ids[cmd_id];
+    if (ch != NULL &&
+        strcmp(ch->cmd_name, cmd_name) != 0) {
+      ch = NULL;
+      cmd_id = 0;
+    }
+
+  } else if (strcmp(cmd_name, C_ANY) == 0) {
+    ch = cmd_handlers_any;
+  }
+
+  if (ch == NULL &&
+      cmd_handlers_tab != NULL) {
+    ch = (struct cmd_handlers *) pr_table_get(cmd_handlers_tab, cmd_name,
+      NULL);
+  }
+
+  if (ch == NULL) {
+    ch = cmd_handlers_resolve(cmd_name);
+    if (ch == NULL) {
+      /* No symbols for this command; unknown commands are not remembered. */
+      return cmd_handlers_none;
+    }
+
+    if (cmd_handlers_tab == NULL) {
+      cmd_handlers_tab = pr_table_alloc(cmd_handlers_pool, 0);
+    }
+
+    (void) pr_table_add(cmd_handlers_tab, ch->cmd_name, ch,
+      sizeof(struct cmd_handlers *));
+  }
+
+  if (cmd_id > 0 &&
+      cmd_id <= PR_CMD_MAX_ID) {
+    cmd_handlers_ids[cmd_id] = ch;
+
+  } else if (ch->cmd_name[0] == '*' &&
+             ch->cmd_name[1] == '\0') {
+    cmd_handlers_any = ch;
+  }
+
+  return ch->handlers[cmd_type];
+}
+
 int pr_stash_remove_auth(const char *api_name, module *m) {
   int count = 0, prev_idx, symtab_idx = 0;
   size_t api_namelen = 0;
@@ -896,6 +1059,10 @@ int init_stash(void) {
     destroy_pool(symbol_pool);
   }
 
+  /* The resolved CMD handler lists were allocated out of the old pool. */
+  cmd_handlers_pool = NULL;
+  cmd_handlers_clear();
+
   symbol_pool = make_sub_pool(permanent_pool); 
   pr_pool_tag(symbol_pool, "Stash Pool");
 
@@ -0,0 +1,485 @@
+/*
+ * ProFTPD - FTP server daemon
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project and other respective copyright
+ * holders give permission to link this program with OpenSSL, and distribute
+ * the resulting executable, without including the source code for OpenSSL in
+ * the source distribution.
+ */
+
+/* Command latency statistics */
+
+#include "conf.h"
+
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+
+/* The histograms live in an anonymous shared mapping, created by the daemon
+ * before any session processes are forked, in a fixed-size open-addressed
+ * hash table.  Session processes update the histograms using atomic
+ * operations, rather than locks, to keep the cost of recording a latency
+ * low.
+ */
+
+#ifndef PR_STATS_MAX_ENTRIES
+# define PR_STATS_MAX_ENTRIES		2048
+#endif /* PR_STATS_MAX_ENTRIES */
+
+#define STATS_MAX_NAMELEN		32
+
+#if defined(__GNUC__)
+# define STATS_ATOMIC_ADD(v, n)		__sync_fetch_and_add(&(v), (n))
+# define STATS_ATOMIC_CAS(v, o, n)	__sync_bool_compare_and_swap(&(v), (o), (n))
+#else
+/* Without atomic operations, concurrent updates may occasionally be lost. */
+# define STATS_ATOMIC_ADD(v, n)		((v) += (n))
+# define STATS_ATOMIC_CAS(v, o, n)	((v) == (o) ? ((v) = (n), TRUE) : FALSE)
+#endif
+
+struct stats_entry {
+  pr_claim_t se_claim;
+  unsigned int se_hash;
+  int se_phase;
+  char se_module[STATS_MAX_NAMELEN];
+  char se_cmd[STATS_MAX_NAMELEN];
+  pr_stats_histo_t se_histo;
+};
+
+struct stats_table {
+  /* Number of latencies not recorded because the table was full. */
+  uint64_t st_ndropped;
+
+  struct stats_entry st_entries[PR_STATS_MAX_ENTRIES];
+};
+
+static struct stats_table *stats_tab = NULL;
+
+static const char *trace_channel = "stats";
+
+uint64_t pr_stats_get_usecs(void) {
+  struct timeval tv;
+
+  if (gettimeofday(&tv, NULL) < 0) {
+    return 0;
+  }
+
+  return ((uint64_t) tv.tv_sec * 1000000) + tv.tv_usec;
+}
+
+int pr_stats_enabled(void) {
+  return (stats_tab != NULL);
+}
+
+static unsigned int stats_hash(const char *module_name, const char *cmd_name,
+    int phase) {
+  const char *ptr;
+  unsigned int h = phase;
+
+  if (module_name != NULL) {
+    for (ptr = module_name; *ptr; ptr++) {
+      h = (h * 33) + *ptr;
+    }
+  }
+
+  h = (h * 33) + '/';
+  for (ptr = cmd_name; *ptr; ptr++) {
+    h = (h * 33) + *ptr;
+  }
+
+  return h;
+}
+
+static void stats_entry_set(struct stats_entry *se, unsigned int hash,
+    const char *module_name, const char *cmd_name, int phase) {
+  se->se_hash = hash;
+  se->se_phase = phase;
+  sstrncpy(se->se_module, module_name, sizeof(se->se_module));
+  sstrncpy(se->se_cmd, cmd_name, sizeof(se->se_cmd));
+  pr_claim_release(&(se->se_claim));
+}
+
+/* Finds the entry for the given key, claiming an empty entry for it if
+ * need be.  Returns NULL if the table is full.
+ */
+static struct stats_entry *stats_get_entry(const char *module_name,
+    const char *cmd_name, int phase) {
+  register unsigned int i;
+  unsigned int hash;
+
+  if (module_name == NULL) {
+    module_name = "";
+  }
+
+  hash = stats_hash(module_name, cmd_name, phase);
+
+  for (i = 0; i < PR_STATS_MAX_ENTRIES; i++) {
+    struct stats_entry *se;
+
+    se = &(stats_tab->st_entries[(hash + i) % PR_STATS_MAX_ENTRIES]);
+
+    /* Claim an empty entry for this key.  Another process may be filling
+     * in this entry; wait for it to finish, or, if it died meanwhile, fill
+     * the entry in for this key.
+     */
+    if (pr_claim_is_ready(&(se->se_claim)) == FALSE) {
+      if (pr_claim_acquire(&(se->se_claim), PR_CLAIM_EMPTY) == 0 ||
+          pr_claim_wait(&(se->se_claim)) == PR_CLAIM_TAKEN) {
+        stats_entry_set(se, hash, module_name, cmd_name, phase);
+        return se;
+      }
+    }
+
+    if (se->se_hash != hash ||
+        se->se_phase != phase) {
+      continue;
+    }
+
+    if (strncmp(se->se_module, module_name, sizeof(se->se_module)-1) == 0 &&
+        strncmp(se->se_cmd, cmd_name, sizeof(se->se_cmd)-1) == 0) {
+      return se;
+    }
+  }
+
+  return NULL;
+}
+
+static void stats_histo_add(pr_stats_histo_t *histo, uint64_t usecs) {
+  unsigned int idx = 0;
+  uint64_t max_usecs;
+
+  while (idx < PR_STATS_HISTO_NBUCKETS-1 &&
+         (usecs >> idx) != 0) {
+    idx++;
+  }
+
+  STATS_ATOMIC_ADD(histo->buckets[idx], 1);
+  STATS_ATOMIC_ADD(histo->count, 1);
+  STATS_ATOMIC_ADD(histo->total_usecs, usecs);
+
+  max_usecs = histo->max_usecs;
+  while (usecs > max_usecs) {
+    if (STATS_ATOMIC_CAS(histo->max_usecs, max_usecs, usecs)) {
+      break;
+    }
+
+    max_usecs = histo->max_usecs;
+  }
+}
+
+static int stats_add(const char *module_name, const char *cmd_name, int phase,
+    uint64_t usecs) {
+  struct stats_entry *se;
+
+  if (cmd_name == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (stats_tab == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  se = stats_get_entry(module_name, cmd_name, phase);
+  if (se == NULL) {
+    STATS_ATOMIC_ADD(stats_tab->st_ndropped, 1);
+    errno = ENOSPC;
+    return -1;
+  }
+
+  stats_histo_add(&(se->se_histo), usecs);
+  return 0;
+}
+
+int pr_stats_add_cmd(const char *cmd_name, int phase, uint64_t usecs) {
+  return stats_add(NULL, cmd_name, phase, usecs);
+}
+
+int pr_stats_add_handler(const char *module_name, const char *cmd_name,
+    int phase, uint64_t usecs) {
+  if (module_name == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return stats_add(module_name, cmd_name, phase, usecs);
+}
+
+int pr_stats_walk(int (*cb)(const char *, const char *, int,
+    const pr_stats_histo_t *, void *), void *user_data) {
+  register unsigned int i;
+
+  if (cb == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (stats_tab == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  for (i = 0; i < PR_STATS_MAX_ENTRIES; i++) {
+    struct stats_entry *se;
+    pr_stats_histo_t histo;
+
+    se = &(stats_tab->st_entries[i]);
+    if (pr_claim_is_ready(&(se->se_claim)) == FALSE) {
+      continue;
+    }
+
+    /* Work from a copy, so that the values do not change while the callback
+     * uses them.  Other processes may be recording latencies while the copy
+     * is made, so the count, total, and buckets may disagree slightly.
+     */
+    memcpy(&histo, &(se->se_histo), sizeof(histo));
+    if (histo.count == 0) {
+      continue;
+    }
+
+    if (cb(*se->se_module ? se->se_module : NULL, se->se_cmd, se->se_phase,
+        &histo, user_data) != 0) {
+      break;
+    }
+  }
+
+  if (stats_tab->st_ndropped > 0) {
+    pr_trace_msg(trace_channel, 3,
+      "%lu latencies not recorded due to full table (%u entries)",
+      (unsigned long) stats_tab->st_ndropped, PR_STATS_MAX_ENTRIES);
+  }
+
+  return 0;
+}
+
+uint64_t pr_stats_histo_get_percentile(const pr_stats_histo_t *histo,
+    unsigned int pct) {
+  register unsigned int i;
+  uint64_t count = 0, target;
+
+  if (histo == NULL ||
+      histo->count == 0) {
+    return 0;
+  }
+
+  if (pct > 100) {
+    pct = 100;
+  }
+
+  target = (histo->count * pct + 99) / 100;
+  if (target == 0) {
+    target = 1;
+  }
+
+  for (i = 0; i < PR_STATS_HISTO_NBUCKETS-1; i++) {
+    count += histo->buckets[i];
+    if (count >= target) {
+      uint64_t limit;
+
+      /* Do not report more than the maximum latency actually seen. */
+      limit = ((uint64_t) 1) << i;
+      return (limit < histo->max_usecs ? limit : histo->max_usecs);
+    }
+  }
+
+  return histo->max_usecs;
+}
+
+/* The median estimator keeps the estimate in the upper 32 bits of its
+ * state, and an estimate of the median deviation of the values from it in
+ * the lower 32 bits, so that both can be updated by a single
+ * compare-and-swap.  The deviation is never less than 1, thus a zero state
+ * means empty.
+ *
+ * Each value moves the estimate by 1/STATS_MEDIAN_STEP_DIV of the deviation,
+ * and the deviation by 1/STATS_MEDIAN_DEV_DIV of itself.  Tracking the
+ * median deviation, rather than the mean, keeps the occasional very slow
+ * value from inflating the step size.  For the first few values, the
+ * divisors are the number of values seen so far, so that the estimate
+ * quickly moves away from the first value.
+ */
+#define STATS_MEDIAN_STEP_DIV		32
+#define STATS_MEDIAN_DEV_DIV		16
+
+int pr_stats_median_add(pr_stats_median_t *median, uint32_t value) {
+  uint32_t count;
+
+  if (median == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  count = STATS_ATOMIC_ADD(median->count, 1) + 1;
+
+  while (TRUE) {
+    uint64_t state, new_state;
+    uint32_t estimate, dev, step, absdiff;
+
+    state = median->state;
+
+    if (state == 0) {
+      /* The first value is the estimate, until more arrive. */
+      estimate = value;
+      dev = value / 2;
+
+    } else {
+      estimate = (uint32_t) (state >> 32);
+      dev = (uint32_t) (state & 0xffffffff);
+
+      step = dev / (count < STATS_MEDIAN_STEP_DIV ? count :
+        STATS_MEDIAN_STEP_DIV);
+      if (step == 0) {
+        step = 1;
+      }
+
+      /* Never step past the value itself. */
+      if (value > estimate) {
+        absdiff = value - estimate;
+        estimate += (absdiff < step ? absdiff : step);
+
+      } else {
+        absdiff = estimate - value;
+        estimate -= (absdiff < step ? absdiff : step);
+      }
+
+      step = dev / (count < STATS_MEDIAN_DEV_DIV ? count :
+        STATS_MEDIAN_DEV_DIV);
+      if (step == 0) {
+        step = 1;
+      }
+
+      if (absdiff > dev) {
+        dev = (absdiff - dev < step ? absdiff : dev + step);
+
+      } else {
+        dev -= (dev - absdiff < step ? dev - absdiff : step);
+      }
+    }
+
+    if (dev == 0) {
+      dev = 1;
+    }
+
+    new_state = (((uint64_t) estimate) << 32) | dev;
+    if (STATS_ATOMIC_CAS(median->state, state, new_state)) {
+      break;
+    }
+  }
+
+  return 0;
+}
+
+long pr_stats_median_get(const pr_stats_median_t *median) {
+  uint64_t state;
+
+  if (median == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  state = median->state;
+  if (state == 0) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  return (long) (state >> 32);
+}
+
+int pr_stats_reset(void) {
+  register unsigned int i;
+
+  if (stats_tab == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  /* Keep the entries' keys, as other processes may be about to update
+   * them; only their counts are cleared.
+   */
+  for (i = 0; i < PR_STATS_MAX_ENTRIES; i++) {
+    struct stats_entry *se;
+
+    se = &(stats_tab->st_entries[i]);
+    if (pr_claim_is_ready(&(se->se_claim)) == TRUE) {
+      memset(&(se->se_histo), 0, sizeof(se->se_histo));
+    }
+  }
+
+  stats_tab->st_ndropped = 0;
+  return 0;
+}
+
+int init_stats(void) {
+  void *data;
+  int mmap_flags;
+
+  if (stats_tab != NULL) {
+    return 0;
+  }
+
+  mmap_flags = MAP_SHARED;
+#if defined(MAP_ANONYMOUS)
+  mmap_flags |= MAP_ANONYMOUS;
+#elif defined(MAP_ANON)
+  mmap_flags |= MAP_ANON;
+#else
+  pr_trace_msg(trace_channel, 1,
+    "mmap(2) MAP_ANONYMOUS and MAP_ANON flags not defined, "
+    "not recording latencies");
+  errno = ENOSYS;
+  return -1;
+#endif
+
+  data = mmap(NULL, sizeof(struct stats_table), PROT_READ|PROT_WRITE,
+    mmap_flags, -1, 0);
+  if (data == MAP_FAILED) {
+    int xerrno = errno;
+
+    pr_log_debug(DEBUG0, "error allocating %lu bytes for latency statistics: "
+      "%s", (unsigned long) sizeof(struct stats_table), strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  memset(data, 0, sizeof(struct stats_table));
+  stats_tab = data;
+
+  return 0;
+}
+
+int free_stats(void) {
+  if (stats_tab == NULL) {
+    return 0;
+  }
+
+  if (munmap((void *) stats_tab, sizeof(struct stats_table)) < 0) {
+    int xerrno = errno;
+
+    pr_log_debug(DEBUG0, "error freeing latency statistics: %s",
+      strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  stats_tab = NULL;
+  return 0;
+}
@@ -26,12 +26,105 @@
 
 #include "conf.h"
 
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+
 /* Transfer rate variables */
 static long double xfer_rate_kbps = 0.0, xfer_rate_bps = 0.0;
 static off_t xfer_rate_freebytes = 0.0;
 static int have_xfer_rate = FALSE;
 static unsigned int xfer_rate_scoreboard_updates = 0;
 
+/* The command whose TransferRate is in effect, and the bytes and time at
+ * which that rate started applying to the current transfer.
+ */
+static char xfer_rate_cmd[32];
+static off_t xfer_rate_base_len = 0;
+static long xfer_rate_base_elapsed = 0;
+static int (*xfer_rate_poll)(void) = NULL;
+
+/* TransferAggregateRate token buckets.
+ *
+ * The buckets live in an anonymous shared mapping, created by the daemon
+ * before any session processes are forked.  Each session looks up the
+ * buckets which apply to it (global, server, class and user) when a transfer
+ * starts, and then debits the bytes it transfers from all of them, using
+ * atomic operations, as it goes.  A session which drives a bucket into debt
+ * waits until the bucket's rate has repaid that debt, so the sessions sharing
+ * a bucket share its rate, without any messages having to be sent between
+ * them as sessions come and go.
+ *
+ * Tokens are kept in millionths of a byte, so that refilling a bucket with
+ * (elapsed usecs * bytes per sec) tokens is exact, even for low rates.
+ */
+
+#ifndef PR_THROTTLE_MAX_BUCKETS
+# define PR_THROTTLE_MAX_BUCKETS	1024
+#endif /* PR_THROTTLE_MAX_BUCKETS */
+
+/* Buckets which have not been used for this many seconds may be reused for
+ * other keys, when the table is full.
+ */
+#define THROTTLE_BUCKET_IDLE_SECS	300
+
+/* The most time for which a bucket is refilled at once; this keeps the
+ * token arithmetic from overflowing after long idle periods.
+ */
+#define THROTTLE_MAX_REFILL_USECS	(60 * 1000000LL)
+
+#define THROTTLE_MAX_KEYLEN		128
+#define THROTTLE_MAX_SCOPES		4
+
+#if defined(__GNUC__)
+# define THROTTLE_ATOMIC_ADD(v, n)	__sync_add_and_fetch(&(v), (n))
+# define THROTTLE_ATOMIC_CAS(v, o, n)	__sync_bool_compare_and_swap(&(v), (o), (n))
+#else
+/* Without atomic operations, concurrent debits may occasionally be lost. */
+# define THROTTLE_ATOMIC_ADD(v, n)	((v) += (n))
+# define THROTTLE_ATOMIC_CAS(v, o, n)	((v) == (o) ? ((v) = (n), TRUE) : FALSE)
+#endif
+
+struct throttle_bucket {
+  pr_claim_t tb_claim;
+  unsigned int tb_hash;
+  char tb_key[THROTTLE_MAX_KEYLEN];
+
+  /* Configured rate, in bytes per sec, and burst, in tokens. */
+  volatile uint64_t tb_rate;
+  volatile int64_t tb_burst;
+
+  volatile int64_t tb_tokens;
+  volatile uint64_t tb_refill_usecs;
+};
+
+struct throttle_table {
+  /* Number of buckets not used because the table was full. */
+  uint64_t tt_ndropped;
+
+  struct throttle_bucket tt_buckets[PR_THROTTLE_MAX_BUCKETS];
+};
+
+static struct throttle_table *throttle_tab = NULL;
+
+/* The buckets which apply to the current transfer.  An idle bucket may be
+ * reused for another key, e.g. while this session is stalled, so the key,
+ * rate, and burst are kept, to check the bucket, and look it up again if
+ * need be, before each debit.
+ */
+struct xfer_rate_bucket {
+  struct throttle_bucket *tb;
+  const char *key;
+  uint64_t rate;
+  uint64_t burst;
+};
+
+static struct xfer_rate_bucket xfer_rate_buckets[THROTTLE_MAX_SCOPES];
+static unsigned int xfer_rate_nbuckets = 0;
+static off_t xfer_rate_debited = 0;
+
+static const char *trace_channel = "throttle";
+
 /* Very similar to the {block,unblock}_signals() function, this masks most
  * of the same signals -- except for TERM.  This allows a throttling process
  * to be killed by the admin.
@@ -86,11 +179,360 @@ static long xfer_rate_since(struct timeval *then) {
     ((now.tv_usec - then->tv_usec) / 1000L));
 }
 
+static unsigned int throttle_hash(const char *key) {
+  const char *ptr;
+  unsigned int h = 0;
+
+  for (ptr = key; *ptr; ptr++) {
+    h = (h * 33) + *ptr;
+  }
+
+  return h;
+}
+
+static void throttle_bucket_set(struct throttle_bucket *tb, unsigned int hash,
+    const char *key, uint64_t rate, int64_t burst, uint64_t now) {
+  tb->tb_hash = hash;
+  sstrncpy(tb->tb_key, key, sizeof(tb->tb_key));
+  tb->tb_rate = rate;
+  tb->tb_burst = burst;
+
+  /* New buckets start out full. */
+  tb->tb_tokens = burst;
+  tb->tb_refill_usecs = now;
+
+  pr_claim_release(&(tb->tb_claim));
+}
+
+pr_throttle_bucket_t *pr_throttle_bucket_get(const char *key, uint64_t rate,
+    uint64_t burst_bytes, uint64_t now) {
+  register unsigned int i;
+  unsigned int hash;
+  int64_t burst;
+  struct throttle_bucket *idle = NULL;
+
+  if (key == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  if (throttle_tab == NULL) {
+    errno = EPERM;
+    return NULL;
+  }
+
+  hash = throttle_hash(key);
+  burst = (int64_t) burst_bytes * 1000000;
+
+  for (i = 0; i < PR_THROTTLE_MAX_BUCKETS; i++) {
+    struct throttle_bucket *tb;
+
+    tb = &(throttle_tab->tt_buckets[(hash + i) % PR_THROTTLE_MAX_BUCKETS]);
+
+    /* Claim an empty bucket for this key.  Another process may be filling
+     * in this bucket; wait for it to finish, or, if it died meanwhile, fill
+     * the bucket in for this key.
+     */
+    if (pr_claim_is_ready(&(tb->tb_claim)) == FALSE) {
+      if (pr_claim_acquire(&(tb->tb_claim), PR_CLAIM_EMPTY) == 0 ||
+          pr_claim_wait(&(tb->tb_claim)) == PR_CLAIM_TAKEN) {
+        throttle_bucket_set(tb, hash, key, rate, burst, now);
+        return tb;
+      }
+    }
+
+    if (tb->tb_hash == hash &&
+        strncmp(tb->tb_key, key, sizeof(tb->tb_key)-1) == 0) {
+
+      /* Pick up any changed configuration, e.g. after a restart. */
+      if (tb->tb_rate != rate) {
+        tb->tb_rate = rate;
+      }
+
+      if (tb->tb_burst != burst) {
+        tb->tb_burst = burst;
+      }
+
+      return tb;
+    }
+
+    if (idle == NULL &&
+        tb->tb_refill_usecs + (THROTTLE_BUCKET_IDLE_SECS * 1000000ULL) < now) {
+      idle = tb;
+    }
+  }
+
+  if (idle != NULL &&
+      pr_claim_acquire(&(idle->tb_claim), PR_CLAIM_READY) == 0) {
+
+    /* Make sure that the bucket is still idle, now that no one else can
+     * reuse it.
+     */
+    if (idle->tb_refill_usecs + (THROTTLE_BUCKET_IDLE_SECS * 1000000ULL) <
+        now) {
+      pr_trace_msg(trace_channel, 8, "reusing idle bucket '%s' for '%s'",
+        idle->tb_key, key);
+      throttle_bucket_set(idle, hash, key, rate, burst, now);
+      return idle;
+    }
+
+    pr_claim_release(&(idle->tb_claim));
+  }
+
+  THROTTLE_ATOMIC_ADD(throttle_tab->tt_ndropped, 1);
+  errno = ENOSPC;
+  return NULL;
+}
+
+/* Adds the tokens earned since the bucket was last refilled, up to the
+ * bucket's burst.
+ */
+static void throttle_bucket_refill(struct throttle_bucket *tb, uint64_t now) {
+  uint64_t then, elapsed;
+  int64_t tokens, burst;
+
+  then = tb->tb_refill_usecs;
+  if (now <= then) {
+    return;
+  }
+
+  /* Only one process gets to refill the bucket for any given interval. */
+  if (!THROTTLE_ATOMIC_CAS(tb->tb_refill_usecs, then, now)) {
+    return;
+  }
+
+  elapsed = now - then;
+  if (elapsed > THROTTLE_MAX_REFILL_USECS) {
+    elapsed = THROTTLE_MAX_REFILL_USECS;
+  }
+
+  tokens = THROTTLE_ATOMIC_ADD(tb->tb_tokens, (int64_t) (elapsed * tb->tb_rate));
+
+  burst = tb->tb_burst;
+  while (tokens > burst) {
+    if (THROTTLE_ATOMIC_CAS(tb->tb_tokens, tokens, burst)) {
+      break;
+    }
+
+    tokens = tb->tb_tokens;
+  }
+}
+
+/* Returns TRUE if the bucket is (still) the one for the given key. */
+static int throttle_bucket_is_key(struct throttle_bucket *tb,
+    const char *key) {
+  if (pr_claim_is_ready(&(tb->tb_claim)) == FALSE) {
+    return FALSE;
+  }
+
+  return (tb->tb_hash == throttle_hash(key) &&
+    strncmp(tb->tb_key, key, sizeof(tb->tb_key)-1) == 0);
+}
+
+long pr_throttle_bucket_debit(pr_throttle_bucket_t *tb, const char *key,
+    off_t nbytes, uint64_t now) {
+  int64_t tokens;
+  long usecs = 0;
+
+  if (tb == NULL ||
+      key == NULL ||
+      nbytes < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* The bucket may have been reused for another key since it was looked
+   * up, e.g. if this session stalled for longer than the idle time.
+   */
+  if (throttle_bucket_is_key(tb, key) == FALSE) {
+    errno = ESTALE;
+    return -1;
+  }
+
+  throttle_bucket_refill(tb, now);
+
+  tokens = THROTTLE_ATOMIC_ADD(tb->tb_tokens, -((int64_t) nbytes * 1000000));
+  if (tokens < 0 &&
+      tb->tb_rate > 0) {
+    /* Millionths of a byte, divided by bytes per sec, gives usecs. */
+    usecs = (long) (-tokens / (int64_t) tb->tb_rate);
+  }
+
+  return usecs;
+}
+
+/* Debits the bytes transferred since the last call from the current
+ * transfer's buckets, returning the number of usecs to wait until the most
+ * indebted bucket has been repaid.
+ */
+static long xfer_rate_debit_buckets(off_t xferlen, int xfer_ending) {
+  register unsigned int i;
+  off_t nbytes;
+  uint64_t now;
+  long delay_usecs = 0;
+
+  if (xfer_rate_nbuckets == 0) {
+    return 0;
+  }
+
+  if (xferlen <= xfer_rate_debited) {
+    xfer_rate_debited = xferlen;
+    return 0;
+  }
+
+  nbytes = xferlen - xfer_rate_debited;
+  xfer_rate_debited = xferlen;
+
+  now = pr_stats_get_usecs();
+
+  for (i = 0; i < xfer_rate_nbuckets; i++) {
+    struct xfer_rate_bucket *xrb;
+    long usecs;
+
+    xrb = &(xfer_rate_buckets[i]);
+    if (xrb->tb == NULL) {
+      continue;
+    }
+
+    usecs = pr_throttle_bucket_debit(xrb->tb, xrb->key, nbytes, now);
+    if (usecs < 0 &&
+        errno == ESTALE) {
+      pr_trace_msg(trace_channel, 8, "bucket for '%s' reused for another "
+        "key, looking it up again", xrb->key);
+
+      xrb->tb = pr_throttle_bucket_get(xrb->key, xrb->rate, xrb->burst, now);
+      if (xrb->tb == NULL) {
+        continue;
+      }
+
+      usecs = pr_throttle_bucket_debit(xrb->tb, xrb->key, nbytes, now);
+    }
+
+    if (usecs > delay_usecs) {
+      delay_usecs = usecs;
+    }
+  }
+
+  /* The final bytes still count against the buckets, but there is nothing
+   * to be gained by delaying the end of the transfer.
+   */
+  if (xfer_ending) {
+    return 0;
+  }
+
+  return delay_usecs;
+}
+
+/* Looks up the buckets of the TransferAggregateRates which apply to the
+ * given command; at most one bucket per scope is used, that of the first
+ * matching TransferAggregateRate for the scope.
+ */
+static void xfer_rate_init_buckets(cmd_rec *cmd) {
+  config_rec *c;
+  unsigned int scopes = 0;
+
+  xfer_rate_nbuckets = 0;
+  xfer_rate_debited = 0;
+
+  if (throttle_tab == NULL) {
+    return;
+  }
+
+  c = find_config(main_server->conf, CONF_PARAM, "TransferAggregateRate",
+    FALSE);
+  while (c != NULL) {
+    char **cmdlist = (char **) c->argv[0], *xfer_cmd;
+    const char *scope, *name = NULL;
+    char *key;
+    int matched_cmd = FALSE;
+    unsigned int scope_idx;
+    uint64_t rate;
+    uint64_t burst;
+    struct throttle_bucket *tb;
+
+    pr_signals_handle();
+
+    for (xfer_cmd = *cmdlist; xfer_cmd; xfer_cmd = *(cmdlist++)) {
+      if (strcasecmp(xfer_cmd, cmd->argv[0]) == 0) {
+        matched_cmd = TRUE;
+        break;
+      }
+    }
+
+    scope = c->argv[1];
+
+    if (strcmp(scope, "global") == 0) {
+      scope_idx = 0;
+      name = "";
+
+    } else if (strcmp(scope, "server") == 0) {
+      char port[32];
+
+      memset(port, '\0', sizeof(port));
+      pr_snprintf(port, sizeof(port)-1, "%u", main_server->ServerPort);
+
+      scope_idx = 1;
+      name = pstrcat(cmd->pool, main_server->ServerName, ":", port, NULL);
+
+    } else if (strcmp(scope, "class") == 0) {
+      scope_idx = 2;
+      if (session.conn_class != NULL) {
+        name = session.conn_class->cls_name;
+      }
+
+    } else {
+      scope_idx = 3;
+      name = session.user;
+    }
+
+    if (matched_cmd == FALSE ||
+        name == NULL ||
+        (scopes & (1 << scope_idx))) {
+      c = find_config_next(c, c->next, CONF_PARAM, "TransferAggregateRate",
+        FALSE);
+      continue;
+    }
+
+    rate = *((uint64_t *) c->argv[2]);
+    burst = *((uint64_t *) c->argv[3]);
+
+    key = pstrcat(cmd->pool, scope, "/", name, "/", c->argv[4], NULL);
+
+    tb = pr_throttle_bucket_get(key, rate, burst, pr_stats_get_usecs());
+    if (tb != NULL) {
+      struct xfer_rate_bucket *xrb;
+
+      xrb = &(xfer_rate_buckets[xfer_rate_nbuckets++]);
+      xrb->tb = tb;
+      xrb->key = key;
+      xrb->rate = rate;
+      xrb->burst = burst;
+      scopes |= (1 << scope_idx);
+
+      pr_log_debug(DEBUG3, "TransferAggregateRate (%.3Lf KB/s) in effect "
+        "for %s%s%s", (long double) rate / 1024.0, scope, *name ? " " : "",
+        name);
+
+    } else {
+      pr_log_debug(DEBUG3, "unable to apply TransferAggregateRate for "
+        "%s%s%s: %s", scope, *name ? " " : "", name, strerror(errno));
+    }
+
+    c = find_config_next(c, c->next, CONF_PARAM, "TransferAggregateRate",
+      FALSE);
+  }
+}
+
 int pr_throttle_have_rate(void) {
-  return have_xfer_rate;
+  return (have_xfer_rate || xfer_rate_nbuckets > 0);
 }
 
-void pr_throttle_init(cmd_rec *cmd) {
+void pr_throttle_set_rate_poll(int (*poll)(void)) {
+  xfer_rate_poll = poll;
+}
+
+/* Looks up the TransferRate which applies to the given command. */
+static void xfer_rate_lookup(const char *cmd_name) {
   config_rec *c = NULL;
   char *xfer_cmd = NULL;
   unsigned char have_user_rate = FALSE, have_group_rate = FALSE,
@@ -100,7 +542,6 @@ void pr_throttle_init(cmd_rec *cmd) {
   /* Make sure the variables are (re)initialized */
   xfer_rate_kbps = xfer_rate_bps = 0.0;
   xfer_rate_freebytes = 0;
-  xfer_rate_scoreboard_updates = 0;
   have_xfer_rate = FALSE;
 
   c = find_config(CURRENT_CONF, CONF_PARAM, "TransferRate", FALSE);
@@ -121,7 +562,7 @@ void pr_throttle_init(cmd_rec *cmd) {
      * comparisons.
      */
     for (xfer_cmd = *cmdlist; xfer_cmd; xfer_cmd = *(cmdlist++)) {
-      if (strcasecmp(xfer_cmd, cmd->argv[0]) == 0) {
+      if (strcasecmp(xfer_cmd, cmd_name) == 0) {
         matched_cmd = TRUE;
         break;
       }
@@ -214,9 +655,84 @@ void pr_throttle_init(cmd_rec *cmd) {
   }
 }
 
+void pr_throttle_init(cmd_rec *cmd) {
+  /* Give any rate poller the chance to update the TransferRates first. */
+  if (xfer_rate_poll != NULL) {
+    (void) xfer_rate_poll();
+  }
+
+  xfer_rate_scoreboard_updates = 0;
+  xfer_rate_base_len = 0;
+  xfer_rate_base_elapsed = 0;
+  sstrncpy(xfer_rate_cmd, cmd->argv[0], sizeof(xfer_rate_cmd));
+
+  xfer_rate_lookup(xfer_rate_cmd);
+  xfer_rate_init_buckets(cmd);
+}
+
+/* Progress updates happen on every pass through the transfer loop; only the
+ * final update is written to the scoreboard immediately.
+ */
+static void xfer_rate_update_scoreboard(off_t xferlen, unsigned long elapsed,
+    int xfer_ending) {
+  if (xfer_ending) {
+    pr_scoreboard_entry_update(session.pid,
+      PR_SCORE_XFER_LEN, xferlen,
+      PR_SCORE_XFER_ELAPSED, elapsed,
+      NULL);
+
+  } else {
+    pr_scoreboard_entry_update_deferred(session.pid,
+      PR_SCORE_XFER_LEN, xferlen,
+      PR_SCORE_XFER_ELAPSED, elapsed,
+      NULL);
+  }
+}
+
+/* Waits for the given number of usecs, returning -1 if the transfer was
+ * aborted in the meantime.
+ */
+static int xfer_rate_sleep(long usecs) {
+  struct timeval tv;
+
+  /* Setup for the select.  We use select() instead of usleep() because it
+   * seems to be far more portable across platforms.
+   */
+  tv.tv_sec = usecs / 1000000L;
+  tv.tv_usec = usecs % 1000000L;
+
+  pr_log_debug(DEBUG7, "transferring too fast, delaying %ld sec%s, %ld usecs",
+    (long int) tv.tv_sec, tv.tv_sec == 1 ? "" : "s", (long int) tv.tv_usec);
+
+  /* No interruptions, please... */
+  xfer_rate_sigmask(TRUE);
+
+  if (select(0, NULL, NULL, NULL, &tv) < 0) {
+    int xerrno = errno;
+
+    if (XFER_ABORTED) {
+      pr_log_pri(PR_LOG_NOTICE, "throttling interrupted, transfer aborted");
+      xfer_rate_sigmask(FALSE);
+      return -1;
+    }
+
+    /* At this point, we've probably been interrupted by one of the few
+     * signals not masked off, e.g. SIGTERM.
+     */
+    if (xerrno != EINTR) {
+      pr_log_debug(DEBUG0, "unable to throttle bandwidth: %s",
+        strerror(xerrno));
+    }
+  }
+
+  xfer_rate_sigmask(FALSE);
+  pr_signals_handle();
+
+  return 0;
+}
+
 void pr_throttle_pause(off_t xferlen, int xfer_ending) {
-  long ideal = 0, elapsed = 0;
-  off_t orig_xferlen = xferlen;
+  long elapsed = 0, delay_usecs = 0;
 
   if (XFER_ABORTED) {
     return;
@@ -225,17 +741,51 @@ void pr_throttle_pause(off_t xferlen, int xfer_ending) {
   /* Calculate the time interval since the transfer of data started. */
   elapsed = xfer_rate_since(&session.xfer.start_time);
 
-  /* Perform no throttling if no throttling has been configured. */
-  if (!have_xfer_rate) {
+  /* If the TransferRates have changed in the middle of the transfer, the
+   * new rate applies from here on.
+   */
+  if (xfer_rate_poll != NULL &&
+      xfer_rate_poll() == TRUE) {
+    xfer_rate_base_len = xferlen;
+    xfer_rate_base_elapsed = elapsed;
+    xfer_rate_lookup(xfer_rate_cmd);
+  }
+
+  /* Debit any shared buckets first, so that the other sessions sharing them
+   * see these bytes whether or not this session has to wait.
+   */
+  delay_usecs = xfer_rate_debit_buckets(xferlen, xfer_ending);
+
+  /* Give credit for any configured freebytes, so that any throttling does
+   * not take them into account.
+   */
+  if (have_xfer_rate &&
+      xferlen > xfer_rate_freebytes) {
+    long ideal;
+    off_t base_len = 0;
+
+    if (xfer_rate_base_len > xfer_rate_freebytes) {
+      base_len = xfer_rate_base_len - xfer_rate_freebytes;
+    }
+
+    ideal = xfer_rate_base_elapsed +
+      (xferlen - xfer_rate_freebytes - base_len) * 1000L / xfer_rate_bps;
+
+    /* ideal and elapsed are in milliseconds. */
+    if (ideal > elapsed &&
+        (ideal - elapsed) * 1000L > delay_usecs) {
+      delay_usecs = (ideal - elapsed) * 1000L;
+    }
+  }
+
+  if (delay_usecs <= 0) {
     xfer_rate_scoreboard_updates++;
 
     if (xfer_ending ||
         xfer_rate_scoreboard_updates % PR_TUNABLE_XFER_SCOREBOARD_UPDATES == 0) {
       /* Update the scoreboard. */
-      pr_scoreboard_entry_update(session.pid,
-        PR_SCORE_XFER_LEN, orig_xferlen,
-        PR_SCORE_XFER_ELAPSED, (unsigned long) elapsed,
-        NULL);
+      xfer_rate_update_scoreboard(xferlen, (unsigned long) elapsed,
+        xfer_ending);
 
       xfer_rate_scoreboard_updates = 0;
     }
@@ -243,93 +793,71 @@ void pr_throttle_pause(off_t xferlen, int xfer_ending) {
     return;
   }
 
-  /* Give credit for any configured freebytes. */
-  if (xferlen > 0 &&
-      xfer_rate_freebytes > 0) {
-
-    if (xferlen > xfer_rate_freebytes) {
-      /* Decrement the number of bytes transferred by the freebytes, so that
-       * any throttling does not take into account the freebytes.
-       */
-      xferlen -= xfer_rate_freebytes;
-
-    } else {
-      xfer_rate_scoreboard_updates++;
-
-      /* The number of bytes transferred is less than the freebytes.  Just
-       * update the scoreboard -- no throttling needed.
-       */
-
-      if (xfer_ending ||
-          xfer_rate_scoreboard_updates % PR_TUNABLE_XFER_SCOREBOARD_UPDATES == 0) {
-        pr_scoreboard_entry_update(session.pid,
-          PR_SCORE_XFER_LEN, orig_xferlen,
-          PR_SCORE_XFER_ELAPSED, (unsigned long) elapsed,
-          NULL);
-
-        xfer_rate_scoreboard_updates = 0;
-      }
-
-      return;
-    }
+  if (xfer_rate_sleep(delay_usecs) < 0) {
+    return;
   }
 
-  ideal = xferlen * 1000L / xfer_rate_bps;
-
-  if (ideal > elapsed) {
-    struct timeval tv;
-
-    /* Setup for the select.  We use select() instead of usleep() because it
-     * seems to be far more portable across platforms.
-     *
-     * ideal and elapsed are in milleconds, but tv_usec will be microseconds,
-     * so be sure to convert properly.
-     */
-    tv.tv_usec = (ideal - elapsed) * 1000;
-    tv.tv_sec = tv.tv_usec / 1000000L;
-    tv.tv_usec = tv.tv_usec % 1000000L;
+  /* Update the scoreboard. */
+  xfer_rate_update_scoreboard(xferlen,
+    (unsigned long) xfer_rate_since(&session.xfer.start_time), xfer_ending);
+}
 
-    pr_log_debug(DEBUG7, "transferring too fast, delaying %ld sec%s, %ld usecs",
-      (long int) tv.tv_sec, tv.tv_sec == 1 ? "" : "s", (long int) tv.tv_usec);
+int init_throttle(void) {
+  void *data;
+  int mmap_flags;
 
-    /* No interruptions, please... */
-    xfer_rate_sigmask(TRUE);
+  if (throttle_tab != NULL) {
+    return 0;
+  }
 
-    if (select(0, NULL, NULL, NULL, &tv) < 0) {
-      int xerrno = errno;
+  mmap_flags = MAP_SHARED;
+#if defined(MAP_ANONYMOUS)
+  mmap_flags |= MAP_ANONYMOUS;
+#elif defined(MAP_ANON)
+  mmap_flags |= MAP_ANON;
+#else
+  pr_trace_msg(trace_channel, 1,
+    "mmap(2) MAP_ANONYMOUS and MAP_ANON flags not defined, "
+    "not supporting TransferAggregateRate");
+  errno = ENOSYS;
+  return -1;
+#endif
+
+  data = mmap(NULL, sizeof(struct throttle_table), PROT_READ|PROT_WRITE,
+    mmap_flags, -1, 0);
+  if (data == MAP_FAILED) {
+    int xerrno = errno;
+
+    pr_log_debug(DEBUG0, "error allocating %lu bytes for transfer rate "
+      "buckets: %s", (unsigned long) sizeof(struct throttle_table),
+      strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
 
-      if (XFER_ABORTED) {
-        pr_log_pri(PR_LOG_NOTICE, "throttling interrupted, transfer aborted");
-        xfer_rate_sigmask(FALSE);
-        return;
-      }
+  memset(data, 0, sizeof(struct throttle_table));
+  throttle_tab = data;
 
-      /* At this point, we've probably been interrupted by one of the few
-       * signals not masked off, e.g. SIGTERM.
-       */
-      if (xerrno != EINTR) {
-        pr_log_debug(DEBUG0, "unable to throttle bandwidth: %s",
-          strerror(xerrno));
-      }
-    }
+  return 0;
+}
 
-    xfer_rate_sigmask(FALSE);
-    pr_signals_handle();
+int free_throttle(void) {
+  if (throttle_tab == NULL) {
+    return 0;
+  }
 
-    /* Update the scoreboard. */
-    pr_scoreboard_entry_update(session.pid,
-      PR_SCORE_XFER_LEN, orig_xferlen,
-      PR_SCORE_XFER_ELAPSED, (unsigned long) ideal,
-      NULL);
+  if (munmap((void *) throttle_tab, sizeof(struct throttle_table)) < 0) {
+    int xerrno = errno;
 
-  } else {
+    pr_log_debug(DEBUG0, "error freeing transfer rate buckets: %s",
+      strerror(xerrno));
 
-    /* Update the scoreboard. */
-    pr_scoreboard_entry_update(session.pid,
-      PR_SCORE_XFER_LEN, orig_xferlen,
-      PR_SCORE_XFER_ELAPSED, (unsigned long) elapsed,
-      NULL);
+    errno = xerrno;
+    return -1;
   }
 
-  return;
+  throttle_tab = NULL;
+  xfer_rate_nbuckets = 0;
+  return 0;
 }
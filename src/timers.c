@@ -30,10 +30,33 @@
 /* From src/main.c */
 extern volatile unsigned int recvd_signal_flags;
 
+/* Timers are kept in a hierarchical timing wheel, with one-second ticks.
+ * Level 0 has a slot for each of the next TIMER_WHEEL_SLOTS seconds; each
+ * slot of level N covers TIMER_WHEEL_SLOTS times the span of a level N-1
+ * slot.  When level 0 wraps around, the timers in the next slot of level 1
+ * are redistributed into level 0, and so on up the levels.
+ *
+ * Adding, resetting, and removing a timer is thus just a move between slot
+ * lists; timers are also hashed by their timer ID, so that they can be found
+ * without a scan.  Since resetting a timer only ever moves it later, the
+ * pending alarm is not re-armed; if the alarm fires before any timer is
+ * due, the wheel just advances, and the alarm is re-armed for the next
+ * timer.
+ */
+
+#define TIMER_WHEEL_BITS		6
+#define TIMER_WHEEL_SLOTS		(1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK		(TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS		4
+
+#define TIMER_HASH_SIZE			64
+
 struct timer {
   struct timer *next, *prev;
+  struct timer **list;		/* List on which this timer is kept */
+  struct timer *hash_next;
 
-  long count;                   /* Amount of time remaining */
+  time_t expires;		/* Time at which the timer is due */
   long interval;                /* Original length of timer */
 
   int timerno;                  /* Caller dependent timer number */
@@ -46,151 +69,332 @@ struct timer {
 
 #define PR_TIMER_DYNAMIC_TIMERNO	1024
 
-static int _current_timeout = 0;
-static int _total_time = 0;
 static int _sleep_sem = 0;
 static int alarms_blocked = 0, alarm_pending = 0;
-static xaset_t *timers = NULL;
-static xaset_t *recycled = NULL;
-static xaset_t *free_timers = NULL;
 static int _indispatch = 0;
 static int dynamic_timerno = PR_TIMER_DYNAMIC_TIMERNO;
 static unsigned int nalarms = 0;
-static time_t _alarmed_time = 0;
+
+/* Whether any timer has been added, and how many are currently scheduled. */
+static int timers_used = FALSE;
+static unsigned int ntimers = 0;
+
+static struct timer *timer_wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+static struct timer *timer_hash[TIMER_HASH_SIZE];
+static struct timer *free_timers = NULL;
+
+/* The timer whose callback is currently being invoked, if any. */
+static struct timer *timer_dispatching = NULL;
+
+/* The last tick processed, and the interval of the currently pending
+ * alarm.
+ */
+static time_t timer_tick = 0;
+static unsigned int timer_alarm_secs = 0;
 
 static pool *timer_pool = NULL;
 
 static const char *trace_channel = "timer";
 
-static int timer_cmp(struct timer *t1, struct timer *t2) {
-  if (t1->count < t2->count) {
-    return -1;
+static void timer_list_add(struct timer **list, struct timer *t) {
+  t->list = list;
+  t->prev = NULL;
+  t->next = *list;
+
+  if (*list != NULL) {
+    (*list)->prev = t;
   }
 
-  if (t1->count > t2->count) {
-    return 1;
+  *list = t;
+}
+
+static void timer_list_remove(struct timer *t) {
+  if (t->list == NULL) {
+    return;
   }
 
-  return 0;
+  if (t->prev != NULL) {
+    t->prev->next = t->next;
+
+  } else {
+    *(t->list) = t->next;
+  }
+
+  if (t->next != NULL) {
+    t->next->prev = t->prev;
+  }
+
+  t->next = t->prev = NULL;
+  t->list = NULL;
 }
 
-/* This function does the work of iterating through the list of registered
- * timers, checking to see if their callbacks should be invoked and whether
- * they should be removed from the registration list. Its return value is
- * the amount of time remaining on the first timer in the list.
+/* Places the timer in the wheel slot for its expiry time, relative to the
+ * last processed tick.
  */
-static int process_timers(int elapsed) {
-  struct timer *t = NULL, *next = NULL;
-  int res = 0;
+static void timer_wheel_add(struct timer *t) {
+  register unsigned int level;
+  time_t expires, delta;
 
-  if (recycled == NULL) {
-    recycled = xaset_create(timer_pool, NULL);
+  expires = t->expires;
+  if (expires <= timer_tick) {
+    /* Already due; process it on the next tick. */
+    expires = timer_tick + 1;
   }
 
-  if (elapsed == 0 &&
-      recycled->xas_list == NULL) {
-    if (timers == NULL) {
-      return 0;
+  delta = expires - timer_tick;
+
+  for (level = 0; level < TIMER_WHEEL_LEVELS-1; level++) {
+    if (delta < ((time_t) 1 << (TIMER_WHEEL_BITS * (level + 1)))) {
+      break;
     }
+  }
 
-    if (timers->xas_list != NULL) {
-      /* The value we return is a proposed timeout, for the next call to
-       * alarm(3).  We start with the simple count of timers in our list.
-       *
-       * But then we reduce the number; some of the timers' intervals may
-       * less than the number of total timers.
-       */
-      res = ((struct timer *) timers->xas_list)->count;
-      if (res > 5) {
-        res = 5;
+  if (level == TIMER_WHEEL_LEVELS-1 &&
+      delta >= ((time_t) 1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))) {
+    /* Beyond the span of the wheel; the timer is placed again when this
+     * slot is reached.
+     */
+    expires = timer_tick +
+      ((time_t) 1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1;
+  }
+
+  timer_list_add(&(timer_wheel[level][(expires >> (TIMER_WHEEL_BITS * level)) &
+    TIMER_WHEEL_MASK]), t);
+}
+
+static struct timer *timer_lookup(int timerno, module *mod) {
+  struct timer *t;
+
+  for (t = timer_hash[(unsigned int) timerno % TIMER_HASH_SIZE]; t != NULL;
+      t = t->hash_next) {
+    if (t->timerno == timerno &&
+        (t->mod == mod || mod == ANY_MODULE)) {
+      return t;
+    }
+  }
+
+  return NULL;
+}
+
+static void timer_hash_remove(struct timer *t) {
+  struct timer **tp;
+
+  for (tp = &(timer_hash[(unsigned int) t->timerno % TIMER_HASH_SIZE]);
+      *tp != NULL; tp = &((*tp)->hash_next)) {
+    if (*tp == t) {
+      *tp = t->hash_next;
+      break;
+    }
+  }
+
+  t->hash_next = NULL;
+}
+
+/* Unschedules the timer, and keeps it for later reuse. */
+static void timer_free(struct timer *t) {
+  timer_list_remove(t);
+  timer_hash_remove(t);
+
+  t->next = free_timers;
+  free_timers = t;
+
+  if (ntimers > 0) {
+    ntimers--;
+  }
+}
+
+/* Moves all of the timers in the given slot to their slots in the lower
+ * levels.
+ */
+static void timer_wheel_cascade(unsigned int level, unsigned int slot) {
+  struct timer *t;
+
+  t = timer_wheel[level][slot];
+  while (t != NULL) {
+    timer_list_remove(t);
+    timer_wheel_add(t);
+    t = timer_wheel[level][slot];
+  }
+}
+
+/* Re-places all of the timers, after the clock has jumped. */
+static void timer_wheel_rebuild(time_t now, time_t shift) {
+  register unsigned int i, j;
+  struct timer *pending = NULL, *t;
+
+  for (i = 0; i < TIMER_WHEEL_LEVELS; i++) {
+    for (j = 0; j < TIMER_WHEEL_SLOTS; j++) {
+      t = timer_wheel[i][j];
+      while (t != NULL) {
+        timer_list_remove(t);
+        timer_list_add(&pending, t);
+        t = timer_wheel[i][j];
       }
     }
+  }
+
+  timer_tick = now;
 
-    return res;
+  t = pending;
+  while (t != NULL) {
+    timer_list_remove(t);
+    t->expires += shift;
+    timer_wheel_add(t);
+    t = pending;
   }
+}
 
+/* Invokes the callbacks of the timers in the given list, all of which are
+ * due.
+ */
+static void timer_dispatch(struct timer **due) {
+  struct timer *t;
+
+  t = *due;
+  while (t != NULL) {
+    int res;
+
+    timer_list_remove(t);
+
+    if (t->remove) {
+      timer_free(t);
+      t = *due;
+      continue;
+    }
+
+    pr_trace_msg(trace_channel, 4,
+      "%ld %s for timer ID %d ('%s', for module '%s') elapsed, invoking "
+      "callback (%p)", t->interval,
+      t->interval != 1 ? "seconds" : "second", t->timerno,
+      t->desc ? t->desc : "<unknown>",
+      t->mod ? t->mod->name : "<none>", t->callback);
+
+    timer_dispatching = t;
+    res = t->callback(t->interval, t->timerno,
+      t->interval + (long) (timer_tick - t->expires), t->mod);
+    timer_dispatching = NULL;
+
+    if (res == 0 ||
+        t->remove) {
+      /* A return value of zero means this timer is done, and can be
+       * removed.
+       */
+      timer_free(t);
+
+    } else {
+      /* A non-zero return value from a timer callback signals that
+       * the timer should be reused/restarted.
+       */
+      pr_trace_msg(trace_channel, 6,
+        "restarting timer ID %d ('%s'), as per callback", t->timerno,
+        t->desc ? t->desc : "<unknown>");
+
+      t->expires = timer_tick + t->interval;
+      timer_wheel_add(t);
+    }
+
+    t = *due;
+  }
+}
+
+/* Advances the wheel to the given time, invoking the callbacks of any timers
+ * which are due.
+ */
+static void process_timers(time_t now) {
   /* Critical code, no interruptions please */
   if (_indispatch) {
-    return 0;
+    return;
   }
 
   pr_alarms_block();
   _indispatch++;
 
-  if (elapsed) {
-    for (t = (struct timer *) timers->xas_list; t; t = next) {
-      /* If this timer has already been handled, skip */
-      next = t->next;
+  if (now < timer_tick) {
+    /* The clock went backwards; keep the timers' remaining intervals. */
+    timer_wheel_rebuild(now, now - timer_tick);
+
+  } else if (now - timer_tick > TIMER_WHEEL_SLOTS) {
+    /* Rather than stepping through every missed tick, place the timers
+     * anew; any which are now due will be in the next slot.
+     */
+    timer_wheel_rebuild(now - 1, 0);
+  }
+
+  while (timer_tick < now) {
+    register unsigned int level;
+    unsigned int slot;
+    struct timer *due = NULL, *t;
 
-      if (t->remove) {
-        /* Move the timer onto the free_timers chain, for later reuse. */
-        xaset_remove(timers, (xasetmember_t *) t);
-        xaset_insert(free_timers, (xasetmember_t *) t);
+    timer_tick++;
 
-      } else if ((t->count -= elapsed) <= 0) {
-        /* This timer's interval has elapsed, so trigger its callback. */
+    /* When a level wraps around, bring down the next slot of the level
+     * above.
+     */
+    for (level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+      if (((timer_tick >> (TIMER_WHEEL_BITS * (level - 1))) &
+          TIMER_WHEEL_MASK) != 0) {
+        break;
+      }
 
-        pr_trace_msg(trace_channel, 4,
-          "%ld %s for timer ID %d ('%s', for module '%s') elapsed, invoking "
-          "callback (%p)", t->interval,
-          t->interval != 1 ? "seconds" : "second", t->timerno,
-          t->desc ? t->desc : "<unknown>",
-          t->mod ? t->mod->name : "<none>", t->callback);
+      timer_wheel_cascade(level,
+        (timer_tick >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK);
+    }
 
-        if (t->callback(t->interval, t->timerno, t->interval - t->count,
-            t->mod) == 0) {
+    slot = timer_tick & TIMER_WHEEL_MASK;
 
-          /* A return value of zero means this timer is done, and can be
-           * removed.
-           */
-          xaset_remove(timers, (xasetmember_t *) t);
-          xaset_insert(free_timers, (xasetmember_t *) t);
+    /* Collect the due timers first, since their callbacks may add, reset,
+     * or remove timers.
+     */
+    t = timer_wheel[0][slot];
+    while (t != NULL) {
+      timer_list_remove(t);
 
-        } else {
-          /* A non-zero return value from a timer callback signals that
-           * the timer should be reused/restarted.
-           */
-          pr_trace_msg(trace_channel, 6,
-            "restarting timer ID %d ('%s'), as per callback", t->timerno,
-            t->desc ? t->desc : "<unknown>");
-
-          xaset_remove(timers, (xasetmember_t *) t);
-          t->count = t->interval;
-          xaset_insert(recycled, (xasetmember_t *) t);
-        }
+      if (t->expires <= timer_tick) {
+        timer_list_add(&due, t);
+
+      } else {
+        timer_wheel_add(t);
       }
+
+      t = timer_wheel[0][slot];
     }
-  }
 
-  /* Put the recycled timers back into the main timer list. */
-  t = (struct timer *) recycled->xas_list;
-  while (t != NULL) {
-    xaset_remove(recycled, (xasetmember_t *) t);
-    xaset_insert_sort(timers, (xasetmember_t *) t, TRUE);
-    t = (struct timer *) recycled->xas_list;
+    timer_dispatch(&due);
   }
 
   _indispatch--;
   pr_alarms_unblock();
+}
 
-  /* If no active timers remain in the list, there is no reason to set the
-   * SIGALRM handle.
-   */
+/* Returns the number of seconds until the wheel next needs processing, or
+ * zero if there are no timers.
+ */
+static unsigned int timer_next_secs(time_t now) {
+  register unsigned int i;
+  time_t next = 0;
 
-  if (timers->xas_list != NULL) {
-    /* The value we return is a proposed timeout, for the next call to
-     * alarm(3).  We start with the simple count of timers in our list.
-     *
-     * But then we reduce the number; some of the timers' intervals may
-     * less than the number of total timers.
-     */
-    res = ((struct timer *) timers->xas_list)->count;
-    if (res > 5) {
-      res = 5;
+  if (ntimers == 0) {
+    return 0;
+  }
+
+  for (i = 1; i <= TIMER_WHEEL_SLOTS; i++) {
+    if (timer_wheel[0][(timer_tick + i) & TIMER_WHEEL_MASK] != NULL) {
+      next = timer_tick + i;
+      break;
     }
+
+    /* Stop at the next cascade from the higher levels. */
+    if (((timer_tick + i) & TIMER_WHEEL_MASK) == 0) {
+      next = timer_tick + i;
+      break;
+    }
+  }
+
+  if (next <= now) {
+    return 1;
   }
 
-  return res;
+  return (unsigned int) (next - now);
 }
 
 static RETSIGTYPE sig_alarm(int signo) {
@@ -221,11 +425,11 @@ static RETSIGTYPE sig_alarm(int signo) {
   recvd_signal_flags |= RECEIVED_SIG_ALRM;
   nalarms++;
 
-  /* Reset the alarm */
-  _total_time += _current_timeout;
-  if (_current_timeout) {
-    _alarmed_time = time(NULL);
-    alarm(_current_timeout);
+  /* Reset the alarm, in case this one is not handled before the process
+   * blocks again.
+   */
+  if (timer_alarm_secs) {
+    alarm(timer_alarm_secs);
   }
 }
 
@@ -254,16 +458,12 @@ static void set_sig_alarm(void) {
 #endif
 }
 
+static void timer_set_alarm(time_t now) {
+  timer_alarm_secs = timer_next_secs(now);
+  alarm(timer_alarm_secs);
+}
+
 void handle_alarm(void) {
-  int new_timeout = 0;
-
-  /* We need to adjust for any time that might be remaining on the alarm,
-   * in case we were called in order to change alarm durations.  Note
-   * that rapid-fire calling of this function will probably screw
-   * up the already poor resolution of alarm() _horribly_.  Oh well,
-   * this shouldn't be used for any precise work anyway, it's only
-   * for modules to perform approximate timing.
-   */
 
   /* It's possible that alarms are blocked when this function is
    * called, if so, increment alarm_pending and exit swiftly.
@@ -272,22 +472,11 @@ void handle_alarm(void) {
     nalarms = 0;
 
     if (!alarms_blocked) {
-      int alarm_elapsed;
       time_t now;
 
-      /* Clear any pending ALRM signals. */
-      alarm(0);
-
-      /* Determine how much time has elapsed since we last processed timers. */
       time(&now);
-      alarm_elapsed = _alarmed_time > 0 ? (int) (now - _alarmed_time) : 0;
-
-      new_timeout = _total_time + alarm_elapsed;
-      _total_time = 0;
-      new_timeout = process_timers(new_timeout);
-
-      _alarmed_time = now;
-      alarm(_current_timeout = new_timeout);
+      process_timers(now);
+      timer_set_alarm(now);
 
     } else {
       alarm_pending++;
@@ -298,7 +487,7 @@ void handle_alarm(void) {
 int pr_timer_reset(int timerno, module *mod) {
   struct timer *t = NULL;
 
-  if (timers == NULL) {
+  if (timers_used == FALSE) {
     errno = EPERM;
     return -1;
   }
@@ -308,80 +497,66 @@ int pr_timer_reset(int timerno, module *mod) {
     return -1;
   }
 
-  pr_alarms_block();
-
-  if (recycled == NULL) {
-    recycled = xaset_create(timer_pool, NULL);
-  }
-
-  for (t = (struct timer *) timers->xas_list; t; t = t->next) {
-    if (t->timerno == timerno &&
-        (t->mod == mod || mod == ANY_MODULE)) {
-      t->count = t->interval;
-      xaset_remove(timers, (xasetmember_t *) t);
-      xaset_insert(recycled, (xasetmember_t *) t);
-      nalarms++;
-
-      /* The handle_alarm() function also readjusts the timers lists
-       * as part of its processing, so it needs to be called when a timer
-       * is reset.
-       */
-      handle_alarm();
-      break;
-    }
+  t = timer_lookup(timerno, mod);
+  if (t == NULL) {
+    return 0;
   }
 
+  /* No need to re-arm the alarm: the timer is now due later than it was. */
+  pr_alarms_block();
+  timer_list_remove(t);
+  t->expires = time(NULL) + t->interval;
+  timer_wheel_add(t);
   pr_alarms_unblock();
 
-  if (t != NULL) {
-    pr_trace_msg(trace_channel, 7, "reset timer ID %d ('%s', for module '%s')",
-      t->timerno, t->desc, t->mod ? t->mod->name : "[none]");
-    return t->timerno;
-  }
-
-  return 0;
+  pr_trace_msg(trace_channel, 7, "reset timer ID %d ('%s', for module '%s')",
+    t->timerno, t->desc, t->mod ? t->mod->name : "[none]");
+  return t->timerno;
 }
 
 int pr_timer_remove(int timerno, module *mod) {
+  register unsigned int i;
   struct timer *t = NULL, *tnext = NULL;
   int nremoved = 0;
 
   /* If there are no timers currently registered, do nothing. */
-  if (!timers)
+  if (timers_used == FALSE)
     return 0;
 
   pr_alarms_block();
 
-  for (t = (struct timer *) timers->xas_list; t; t = tnext) {
-    tnext = t->next;
+  for (i = 0; i < TIMER_HASH_SIZE; i++) {
+    if (timerno >= 0 &&
+        i != (unsigned int) timerno % TIMER_HASH_SIZE) {
+      continue;
+    }
 
-    if ((timerno < 0 || t->timerno == timerno) &&
-        (mod == ANY_MODULE || t->mod == mod)) {
-      nremoved++;
+    for (t = timer_hash[i]; t; t = tnext) {
+      tnext = t->hash_next;
 
-      if (_indispatch) {
-        t->remove++;
+      if ((timerno < 0 || t->timerno == timerno) &&
+          (mod == ANY_MODULE || t->mod == mod)) {
+        nremoved++;
 
-      } else {
-        xaset_remove(timers, (xasetmember_t *) t);
-        xaset_insert(free_timers, (xasetmember_t *) t);
-	nalarms++;
-
-        /* The handle_alarm() function also readjusts the timers lists
-         * as part of its processing, so it needs to be called when a timer
-         * is removed.
-         */
-        handle_alarm();
-      }
+        pr_trace_msg(trace_channel, 7,
+          "removed timer ID %d ('%s', for module '%s')", t->timerno, t->desc,
+          t->mod ? t->mod->name : "[none]");
 
-      pr_trace_msg(trace_channel, 7,
-        "removed timer ID %d ('%s', for module '%s')", t->timerno, t->desc,
-        t->mod ? t->mod->name : "[none]");
+        if (t == timer_dispatching) {
+          /* Removed once its callback returns. */
+          t->remove++;
+
+        } else {
+          timer_free(t);
+        }
+
+        /* If we are removing a specific timer, we are done. */
+        if (timerno >= 0) {
+          break;
+        }
+      }
     }
 
-    /* If we are removing a specific timer, break out of the loop now.
-     * Otherwise, keep removing any matching timers.
-     */
     if (nremoved > 0 &&
         timerno >= 0) {
       break;
@@ -408,6 +583,7 @@ int pr_timer_remove(int timerno, module *mod) {
 int pr_timer_add(int seconds, int timerno, module *mod, callback_t cb,
     const char *desc) {
   struct timer *t = NULL;
+  time_t now;
 
   if (seconds <= 0 ||
       cb == NULL ||
@@ -416,27 +592,18 @@ int pr_timer_add(int seconds, int timerno, module *mod, callback_t cb,
     return -1;
   }
 
-  if (!timers)
-    timers = xaset_create(timer_pool, (XASET_COMPARE) timer_cmp);
-
   /* Check to see that, if specified, the timerno is not already in use. */
-  if (timerno >= 0) {
-    for (t = (struct timer *) timers->xas_list; t; t = t->next) {
-      if (t->timerno == timerno) {
-        errno = EPERM;
-        return -1;
-      }
-    }
+  if (timerno >= 0 &&
+      timer_lookup(timerno, ANY_MODULE) != NULL) {
+    errno = EPERM;
+    return -1;
   }
 
-  if (!free_timers)
-    free_timers = xaset_create(timer_pool, NULL);
-
   /* Try to use an old timer first */
   pr_alarms_block();
-  t = (struct timer *) free_timers->xas_list;
+  t = free_timers;
   if (t != NULL) {
-    xaset_remove(free_timers, (xasetmember_t *) t);
+    free_timers = t->next;
 
   } else {
     if (timer_pool == NULL) {
@@ -457,32 +624,40 @@ int pr_timer_add(int seconds, int timerno, module *mod, callback_t cb,
     timerno = dynamic_timerno++;
   }
 
+  time(&now);
+
+  if (ntimers == 0 &&
+      !_indispatch) {
+    /* Nothing to catch up on. */
+    timer_tick = now;
+  }
+
+  memset(t, 0, sizeof(struct timer));
   t->timerno = timerno;
-  t->count = t->interval = seconds;
+  t->interval = seconds;
+  t->expires = now + seconds;
   t->callback = cb;
   t->mod = mod;
   t->remove = 0;
   t->desc = desc;
 
-  /* If called while _indispatch, add to the recycled list to prevent
-   * list corruption
-   */
+  t->hash_next = timer_hash[(unsigned int) timerno % TIMER_HASH_SIZE];
+  timer_hash[(unsigned int) timerno % TIMER_HASH_SIZE] = t;
 
-  if (_indispatch) {
-    if (!recycled)
-      recycled = xaset_create(timer_pool, NULL);
-    xaset_insert(recycled, (xasetmember_t *) t);
+  timer_wheel_add(t);
+  ntimers++;
+  timers_used = TRUE;
 
-  } else {
-    xaset_insert_sort(timers, (xasetmember_t *) t, TRUE);
-    nalarms++;
+  /* If called while dispatching, the alarm is set once dispatching is
+   * done.
+   */
+  if (!_indispatch) {
     set_sig_alarm();
 
-    /* The handle_alarm() function also readjusts the timers lists
-     * as part of its processing, so it needs to be called when a timer
-     * is added.
-     */
-    handle_alarm();
+    if (timer_alarm_secs == 0 ||
+        (unsigned int) seconds < timer_alarm_secs) {
+      timer_set_alarm(now);
+    }
   }
 
   pr_alarms_unblock();
@@ -560,19 +735,32 @@ int pr_timer_usleep(unsigned long usecs) {
   return 0;
 }
 
+/* Pending alarms are not inherited across fork(2); a process which keeps its
+ * parent's timers (e.g. the daemon, once daemonized) sets the alarm again.
+ */
+void timers_reset_alarm(void) {
+  if (timer_alarm_secs == 0) {
+    return;
+  }
+
+  timer_set_alarm(time(NULL));
+}
+
 void timers_init(void) {
 
   /* Reset some of the key static variables. */
-  _current_timeout = 0;
-  _total_time = 0;
   nalarms = 0;
-  _alarmed_time = 0;
+  timer_tick = 0;
+  timer_alarm_secs = 0;
   dynamic_timerno = PR_TIMER_DYNAMIC_TIMERNO;
 
-  /* Don't inherit the parent's timer lists. */
-  timers = NULL;
-  recycled = NULL;
+  /* Don't inherit the parent's timers. */
+  memset(timer_wheel, 0, sizeof(timer_wheel));
+  memset(timer_hash, 0, sizeof(timer_hash));
   free_timers = NULL;
+  timer_dispatching = NULL;
+  timers_used = FALSE;
+  ntimers = 0;
 
   /* Reset the timer pool. */
   if (timer_pool) {
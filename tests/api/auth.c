@@ -26,6 +26,8 @@
 
 #include "tests.h"
 
+extern module *loaded_modules;
+
 #define PR_TEST_AUTH_NAME		"testsuite_user"
 #define PR_TEST_AUTH_NOBODY		"testsuite_nobody"
 #define PR_TEST_AUTH_NOBODY2		"testsuite_nobody2"
@@ -62,6 +64,7 @@ static unsigned int getgrgid_count = 0;
 static unsigned int name2gid_count = 0;
 static unsigned int gid2name_count = 0;
 static unsigned int getgroups_count = 0;
+static unsigned int other_authn_count = 0;
 
 static module testsuite_module = {
   NULL, NULL,
@@ -149,6 +152,11 @@ MODRET handle_getpwnam(cmd_rec *cmd) {
   return PR_DECLINED(cmd);
 }
 
+MODRET error_getpwnam(cmd_rec *cmd) {
+  getpwnam_count++;
+  return PR_ERROR(cmd);
+}
+
 MODRET handle_getpwuid(cmd_rec *cmd) {
   uid_t uid;
 
@@ -343,6 +351,11 @@ MODRET handle_getgroups(cmd_rec *cmd) {
   return mod_create_data(cmd, (void *) &gids->nelts);
 }
 
+MODRET error_getgroups(cmd_rec *cmd) {
+  getgroups_count++;
+  return PR_ERROR(cmd);
+}
+
 static int authn_rfc2228 = FALSE;
 
 MODRET handle_authn(cmd_rec *cmd) {
@@ -367,6 +380,11 @@ MODRET handle_authn(cmd_rec *cmd) {
   return PR_DECLINED(cmd);
 }
 
+MODRET other_authn(cmd_rec *cmd) {
+  other_authn_count++;
+  return PR_ERROR_INT(cmd, PR_AUTH_BADPWD);
+}
+
 MODRET handle_authz(cmd_rec *cmd) {
   const char *user;
 
@@ -463,6 +481,7 @@ static void set_up(void) {
   name2gid_count = 0;
   gid2name_count = 0;
   getgroups_count = 0;
+  other_authn_count = 0;
 
   pr_auth_cache_clear();
 }
@@ -1425,6 +1444,153 @@ START_TEST (auth_cache_set_test) {
 }
 END_TEST
 
+START_TEST (auth_authcache_test) {
+  int res;
+  struct passwd *pw;
+  array_header *gids = NULL, *names = NULL;
+  authtable authtab, getgroups_tab, authn_tab, other_authn_tab;
+  module other_module;
+
+  memset(&other_module, 0, sizeof(other_module));
+  other_module.api_version = 0x20;
+  other_module.name = "testsuite_other";
+
+  /* Cache hits name the answering module, which must be found again. */
+  loaded_modules = &testsuite_module;
+
+  res = pr_authcache_init(1024 * 1024, 60, 10);
+  fail_unless(res == 0, "Failed to init auth cache: %s", strerror(errno));
+  (void) pr_auth_cache_set(TRUE, PR_AUTH_CACHE_FL_AUTH_MODULE);
+
+  /* Errors from the auth modules are not cached. */
+  memset(&authtab, 0, sizeof(authtab));
+  authtab.name = "getpwnam";
+  authtab.handler = error_getpwnam;
+  authtab.m = &testsuite_module;
+  res = pr_stash_add_symbol(PR_SYM_AUTH, &authtab);
+  fail_unless(res == 0, "Failed to add 'getpwnam' AUTH symbol: %s",
+    strerror(errno));
+
+  pw = pr_auth_getpwnam(p, PR_TEST_AUTH_NAME);
+  fail_unless(pw == NULL, "Found user '%s' unexpectedly", PR_TEST_AUTH_NAME);
+  pw = pr_auth_getpwnam(p, PR_TEST_AUTH_NAME);
+  fail_unless(pw == NULL, "Found user '%s' unexpectedly", PR_TEST_AUTH_NAME);
+  fail_unless(getpwnam_count == 2, "Expected call count 2, got %u",
+    getpwnam_count);
+
+  pr_stash_remove_symbol(PR_SYM_AUTH, "getpwnam", &testsuite_module);
+
+  memset(&getgroups_tab, 0, sizeof(getgroups_tab));
+  getgroups_tab.name = "getgroups";
+  getgroups_tab.handler = error_getgroups;
+  getgroups_tab.m = &testsuite_module;
+  res = pr_stash_add_symbol(PR_SYM_AUTH, &getgroups_tab);
+  fail_unless(res == 0, "Failed to add 'getgroups' AUTH symbol: %s",
+    strerror(errno));
+
+  res = pr_auth_getgroups(p, PR_TEST_AUTH_NAME, &gids, &names);
+  fail_unless(res < 0, "Found groups for '%s' unexpectedly", PR_TEST_AUTH_NAME);
+  res = pr_auth_getgroups(p, PR_TEST_AUTH_NAME, &gids, &names);
+  fail_unless(res < 0, "Found groups for '%s' unexpectedly", PR_TEST_AUTH_NAME);
+  fail_unless(getgroups_count == 2, "Expected call count 2, got %u",
+    getgroups_count);
+
+  pr_stash_remove_symbol(PR_SYM_AUTH, "getgroups", &testsuite_module);
+
+  /* Answers are cached, and later lookups do not dispatch to the modules. */
+  authtab.handler = handle_getpwnam;
+  res = pr_stash_add_symbol(PR_SYM_AUTH, &authtab);
+  fail_unless(res == 0, "Failed to add 'getpwnam' AUTH symbol: %s",
+    strerror(errno));
+
+  getpwnam_count = 0;
+  pw = pr_auth_getpwnam(p, PR_TEST_AUTH_NAME);
+  fail_unless(pw != NULL, "Failed to find user '%s': %s", PR_TEST_AUTH_NAME,
+    strerror(errno));
+  fail_unless(getpwnam_count == 1, "Expected call count 1, got %u",
+    getpwnam_count);
+
+  pw = pr_auth_getpwnam(p, PR_TEST_AUTH_NAME);
+  fail_unless(pw != NULL, "Failed to find user '%s': %s", PR_TEST_AUTH_NAME,
+    strerror(errno));
+  fail_unless(getpwnam_count == 1, "Expected call count 1, got %u",
+    getpwnam_count);
+  fail_unless(pw->pw_uid == PR_TEST_AUTH_UID, "Expected UID %lu, got %lu",
+    (unsigned long) PR_TEST_AUTH_UID, (unsigned long) pw->pw_uid);
+  fail_unless(strcmp(pw->pw_dir, PR_TEST_AUTH_HOME) == 0,
+    "Expected home '%s', got '%s'", PR_TEST_AUTH_HOME, pw->pw_dir);
+
+  getgroups_tab.handler = handle_getgroups;
+  res = pr_stash_add_symbol(PR_SYM_AUTH, &getgroups_tab);
+  fail_unless(res == 0, "Failed to add 'getgroups' AUTH symbol: %s",
+    strerror(errno));
+
+  getgroups_count = 0;
+  res = pr_auth_getgroups(p, PR_TEST_AUTH_NAME, &gids, &names);
+  fail_unless(res == 1, "Expected group count 1, got %d: %s", res,
+    strerror(errno));
+  fail_unless(getgroups_count == 1, "Expected call count 1, got %u",
+    getgroups_count);
+
+  res = pr_auth_getgroups(p, PR_TEST_AUTH_NAME, &gids, &names);
+  fail_unless(res == 1, "Expected group count 1, got %d: %s", res,
+    strerror(errno));
+  fail_unless(getgroups_count == 1, "Expected call count 1, got %u",
+    getgroups_count);
+  fail_unless(gids->nelts == 1, "Expected 1 GID, got %u", gids->nelts);
+  fail_unless(((gid_t *) gids->elts)[0] == PR_TEST_AUTH_GID,
+    "Expected GID %lu, got %lu", (unsigned long) PR_TEST_AUTH_GID,
+    (unsigned long) ((gid_t *) gids->elts)[0]);
+  fail_unless(names->nelts == 1, "Expected 1 group name, got %u",
+    names->nelts);
+  fail_unless(strcmp(((char **) names->elts)[0], PR_TEST_AUTH_NAME) == 0,
+    "Expected group name '%s', got '%s'", PR_TEST_AUTH_NAME,
+    ((char **) names->elts)[0]);
+
+  /* A session whose getpwnam was answered from the cache still routes the
+   * "auth" request only to the module which answered the lookup.
+   */
+  pr_auth_cache_clear();
+  pw = pr_auth_getpwnam(p, PR_TEST_AUTH_NAME);
+  fail_unless(pw != NULL, "Failed to find user '%s': %s", PR_TEST_AUTH_NAME,
+    strerror(errno));
+  fail_unless(getpwnam_count == 1, "Expected call count 1, got %u",
+    getpwnam_count);
+
+  memset(&authn_tab, 0, sizeof(authn_tab));
+  authn_tab.name = "auth";
+  authn_tab.handler = handle_authn;
+  authn_tab.m = &testsuite_module;
+  res = pr_stash_add_symbol(PR_SYM_AUTH, &authn_tab);
+  fail_unless(res == 0, "Failed to add 'auth' AUTH symbol: %s",
+    strerror(errno));
+
+  /* Added last, this module's handler is tried first. */
+  memset(&other_authn_tab, 0, sizeof(other_authn_tab));
+  other_authn_tab.name = "auth";
+  other_authn_tab.handler = other_authn;
+  other_authn_tab.m = &other_module;
+  res = pr_stash_add_symbol(PR_SYM_AUTH, &other_authn_tab);
+  fail_unless(res == 0, "Failed to add 'auth' AUTH symbol: %s",
+    strerror(errno));
+
+  res = pr_auth_authenticate(p, PR_TEST_AUTH_NAME, PR_TEST_AUTH_PASSWD);
+  fail_unless(res == PR_AUTH_OK,
+    "Failed to authenticate user '%s' (expected %d, got %d)",
+    PR_TEST_AUTH_NAME, PR_AUTH_OK, res);
+  fail_unless(other_authn_count == 0,
+    "Expected other module call count 0, got %u", other_authn_count);
+
+  pr_stash_remove_symbol(PR_SYM_AUTH, "auth", &other_module);
+  pr_stash_remove_symbol(PR_SYM_AUTH, "auth", &testsuite_module);
+  pr_stash_remove_symbol(PR_SYM_AUTH, "getgroups", &testsuite_module);
+  pr_stash_remove_symbol(PR_SYM_AUTH, "getpwnam", &testsuite_module);
+
+  (void) pr_authcache_free();
+  loaded_modules = NULL;
+}
+END_TEST
+
 START_TEST (auth_clear_auth_only_module_test) {
   int res;
 
@@ -1890,6 +2056,7 @@ Suite *tests_get_auth_suite(void) {
   tcase_add_test(testcase, auth_cache_name2gid_failed_test);
   tcase_add_test(testcase, auth_cache_clear_test);
   tcase_add_test(testcase, auth_cache_set_test);
+  tcase_add_test(testcase, auth_authcache_test);
 
   /* Auth modules */
   tcase_add_test(testcase, auth_clear_auth_only_module_test);
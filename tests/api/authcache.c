@@ -0,0 +1,420 @@
+/*
+ * ProFTPD - FTP server testsuite
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Authentication cache API tests */
+
+#include "tests.h"
+
+static pool *p = NULL;
+
+static void set_up(void) {
+  if (p == NULL) {
+    p = session.pool = permanent_pool = make_sub_pool(NULL);
+  }
+
+  main_server = pcalloc(p, sizeof(server_rec));
+  main_server->pool = p;
+  main_server->sid = 1;
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("authcache", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  (void) pr_authcache_free();
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("authcache", 0, 0);
+  }
+
+  main_server = NULL;
+  session.anon_config = NULL;
+
+  if (p) {
+    destroy_pool(p);
+    p = session.pool = permanent_pool = NULL;
+  }
+}
+
+START_TEST (authcache_init_test) {
+  int res;
+  struct passwd *pw = NULL;
+
+  fail_unless(pr_authcache_enabled() == FALSE, "Expected cache disabled");
+
+  res = pr_authcache_get_pwnam(p, "foo", &pw, NULL);
+  fail_unless(res < 0, "Found cached user unexpectedly");
+  fail_unless(errno == EPERM, "Expected EPERM (%d), got %s (%d)", EPERM,
+    strerror(errno), errno);
+
+  res = pr_authcache_init(0, 60, 10);
+  fail_unless(res < 0, "Initialized cache of zero size unexpectedly");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_authcache_init(1024 * 1024, 0, 10);
+  fail_unless(res < 0, "Initialized cache with zero TTL unexpectedly");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_authcache_init(1024 * 1024, 60, 10);
+  fail_unless(res == 0, "Failed to initialize cache: %s", strerror(errno));
+  fail_unless(pr_authcache_enabled() == TRUE, "Expected cache enabled");
+
+  res = pr_authcache_free();
+  fail_unless(res == 0, "Failed to free cache: %s", strerror(errno));
+  fail_unless(pr_authcache_enabled() == FALSE, "Expected cache disabled");
+}
+END_TEST
+
+START_TEST (authcache_pwnam_test) {
+  int res;
+  struct passwd pwd, *pw = NULL;
+  const char *module_name = NULL;
+
+  res = pr_authcache_init(1024 * 1024, 60, 10);
+  fail_unless(res == 0, "Failed to initialize cache: %s", strerror(errno));
+
+  res = pr_authcache_get_pwnam(p, "foo", &pw, &module_name);
+  fail_unless(res < 0, "Found cached user unexpectedly");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  memset(&pwd, 0, sizeof(pwd));
+  pwd.pw_name = "foo";
+  pwd.pw_passwd = "secret";
+  pwd.pw_uid = 500;
+  pwd.pw_gid = 501;
+  pwd.pw_gecos = "Foo User";
+  pwd.pw_dir = "/home/foo";
+  pwd.pw_shell = "/bin/sh";
+
+  res = pr_authcache_add_pwnam("foo", &pwd, "sql");
+  fail_unless(res == 0, "Failed to add user: %s", strerror(errno));
+
+  res = pr_authcache_get_pwnam(p, "foo", &pw, &module_name);
+  fail_unless(res == 0, "Failed to get user: %s", strerror(errno));
+  fail_unless(pw != NULL, "Expected user, got null");
+  fail_unless(pw->pw_uid == 500, "Expected UID 500, got %lu",
+    (unsigned long) pw->pw_uid);
+  fail_unless(pw->pw_gid == 501, "Expected GID 501, got %lu",
+    (unsigned long) pw->pw_gid);
+  fail_unless(strcmp(pw->pw_name, "foo") == 0, "Expected 'foo', got '%s'",
+    pw->pw_name);
+  fail_unless(strcmp(pw->pw_passwd, "secret") != 0,
+    "Expected password to not be cached");
+  fail_unless(strcmp(pw->pw_dir, "/home/foo") == 0,
+    "Expected '/home/foo', got '%s'", pw->pw_dir);
+  fail_unless(strcmp(pw->pw_shell, "/bin/sh") == 0,
+    "Expected '/bin/sh', got '%s'", pw->pw_shell);
+  fail_unless(module_name != NULL && strcmp(module_name, "sql") == 0,
+    "Expected module 'sql', got '%s'", module_name);
+
+  /* Results are cached per server. */
+  main_server->sid = 2;
+  res = pr_authcache_get_pwnam(p, "foo", &pw, NULL);
+  fail_unless(res < 0, "Found user cached for other server unexpectedly");
+  main_server->sid = 1;
+
+  /* And per <Anonymous> section. */
+  session.anon_config = pcalloc(p, sizeof(config_rec));
+  session.anon_config->name = "/srv/ftp";
+  res = pr_authcache_get_pwnam(p, "foo", &pw, NULL);
+  fail_unless(res < 0, "Found user cached for server in <Anonymous> "
+    "unexpectedly");
+
+  pwd.pw_uid = 600;
+  res = pr_authcache_add_pwnam("foo", &pwd, "sql");
+  fail_unless(res == 0, "Failed to add user: %s", strerror(errno));
+
+  res = pr_authcache_get_pwnam(p, "foo", &pw, NULL);
+  fail_unless(res == 0, "Failed to get user: %s", strerror(errno));
+  fail_unless(pw->pw_uid == 600, "Expected UID 600, got %lu",
+    (unsigned long) pw->pw_uid);
+
+  session.anon_config->name = "/srv/other";
+  res = pr_authcache_get_pwnam(p, "foo", &pw, NULL);
+  fail_unless(res < 0, "Found user cached for other <Anonymous> "
+    "unexpectedly");
+
+  session.anon_config = NULL;
+  res = pr_authcache_get_pwnam(p, "foo", &pw, NULL);
+  fail_unless(res == 0, "Failed to get user: %s", strerror(errno));
+  fail_unless(pw->pw_uid == 500, "Expected UID 500, got %lu",
+    (unsigned long) pw->pw_uid);
+
+  /* Not-found results are cached, too. */
+  res = pr_authcache_add_pwnam("bar", NULL, NULL);
+  fail_unless(res == 0, "Failed to add not-found user: %s", strerror(errno));
+
+  pw = &pwd;
+  res = pr_authcache_get_pwnam(p, "bar", &pw, &module_name);
+  fail_unless(res == 0, "Failed to get not-found user: %s", strerror(errno));
+  fail_unless(pw == NULL, "Expected null user");
+  fail_unless(module_name == NULL, "Expected null module name, got '%s'",
+    module_name);
+}
+END_TEST
+
+START_TEST (authcache_negative_ttl_test) {
+  int res;
+  struct passwd *pw = NULL;
+
+  res = pr_authcache_init(1024 * 1024, 60, 0);
+  fail_unless(res == 0, "Failed to initialize cache: %s", strerror(errno));
+
+  /* A negative TTL of zero disables caching of not-found results. */
+  res = pr_authcache_add_pwnam("bar", NULL, NULL);
+  fail_unless(res == 0, "Failed to add not-found user: %s", strerror(errno));
+
+  res = pr_authcache_get_pwnam(p, "bar", &pw, NULL);
+  fail_unless(res < 0, "Found not-found user unexpectedly");
+
+  res = pr_authcache_init(1024 * 1024, 60, 1);
+  fail_unless(res == 0, "Failed to initialize cache: %s", strerror(errno));
+
+  res = pr_authcache_add_pwnam("bar", NULL, NULL);
+  fail_unless(res == 0, "Failed to add not-found user: %s", strerror(errno));
+
+  res = pr_authcache_get_pwnam(p, "bar", &pw, NULL);
+  fail_unless(res == 0, "Failed to get not-found user: %s", strerror(errno));
+
+  sleep(2);
+
+  res = pr_authcache_get_pwnam(p, "bar", &pw, NULL);
+  fail_unless(res < 0, "Found expired not-found user unexpectedly");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+}
+END_TEST
+
+START_TEST (authcache_grnam_test) {
+  int res, count = 0;
+  struct group grp, *gr = NULL;
+  char *members[] = { "foo", "bar", NULL };
+
+  res = pr_authcache_init(1024 * 1024, 60, 10);
+  fail_unless(res == 0, "Failed to initialize cache: %s", strerror(errno));
+
+  memset(&grp, 0, sizeof(grp));
+  grp.gr_name = "staff";
+  grp.gr_passwd = "x";
+  grp.gr_gid = 50;
+  grp.gr_mem = members;
+
+  res = pr_authcache_add_grnam("staff", &grp, "ldap");
+  fail_unless(res == 0, "Failed to add group: %s", strerror(errno));
+
+  res = pr_authcache_get_grnam(p, "staff", &gr, NULL);
+  fail_unless(res == 0, "Failed to get group: %s", strerror(errno));
+  fail_unless(gr != NULL, "Expected group, got null");
+  fail_unless(gr->gr_gid == 50, "Expected GID 50, got %lu",
+    (unsigned long) gr->gr_gid);
+  fail_unless(strcmp(gr->gr_name, "staff") == 0,
+    "Expected 'staff', got '%s'", gr->gr_name);
+  fail_unless(gr->gr_mem[0] != NULL && strcmp(gr->gr_mem[0], "foo") == 0,
+    "Expected first member 'foo'");
+  fail_unless(gr->gr_mem[1] != NULL && strcmp(gr->gr_mem[1], "bar") == 0,
+    "Expected second member 'bar'");
+  fail_unless(gr->gr_mem[2] == NULL, "Expected two members");
+
+  /* A group name is not a user name. */
+  res = pr_authcache_get_groups(p, "staff", NULL, NULL, &count, NULL);
+  fail_unless(res < 0, "Found groups for group name unexpectedly");
+}
+END_TEST
+
+START_TEST (authcache_groups_test) {
+  int res, count = 0;
+  array_header *gids, *names;
+
+  res = pr_authcache_init(1024 * 1024, 60, 10);
+  fail_unless(res == 0, "Failed to initialize cache: %s", strerror(errno));
+
+  gids = make_array(p, 2, sizeof(gid_t));
+  *((gid_t *) push_array(gids)) = 501;
+  *((gid_t *) push_array(gids)) = 50;
+
+  names = make_array(p, 2, sizeof(char *));
+  *((char **) push_array(names)) = "foo";
+  *((char **) push_array(names)) = "staff";
+
+  res = pr_authcache_add_groups("foo", NULL, names, 2, "sql");
+  fail_unless(res < 0, "Added partial groups unexpectedly");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_authcache_add_groups("foo", gids, names, 2, "sql");
+  fail_unless(res == 0, "Failed to add groups: %s", strerror(errno));
+
+  gids = make_array(p, 2, sizeof(gid_t));
+  names = make_array(p, 2, sizeof(char *));
+
+  res = pr_authcache_get_groups(p, "foo", gids, names, &count, NULL);
+  fail_unless(res == 0, "Failed to get groups: %s", strerror(errno));
+  fail_unless(count == 2, "Expected count 2, got %d", count);
+  fail_unless(gids->nelts == 2, "Expected 2 GIDs, got %u", gids->nelts);
+  fail_unless(((gid_t *) gids->elts)[1] == 50, "Expected GID 50, got %lu",
+    (unsigned long) ((gid_t *) gids->elts)[1]);
+  fail_unless(names->nelts == 2, "Expected 2 names, got %u", names->nelts);
+  fail_unless(strcmp(((char **) names->elts)[1], "staff") == 0,
+    "Expected 'staff', got '%s'", ((char **) names->elts)[1]);
+
+  /* Either array may be omitted on lookup. */
+  names = make_array(p, 2, sizeof(char *));
+  res = pr_authcache_get_groups(p, "foo", NULL, names, &count, NULL);
+  fail_unless(res == 0, "Failed to get group names: %s", strerror(errno));
+  fail_unless(names->nelts == 2, "Expected 2 names, got %u", names->nelts);
+
+  res = pr_authcache_add_groups("bar", NULL, NULL, -1, NULL);
+  fail_unless(res == 0, "Failed to add not-found groups: %s", strerror(errno));
+
+  res = pr_authcache_get_groups(p, "bar", NULL, NULL, &count, NULL);
+  fail_unless(res == 0, "Failed to get not-found groups: %s", strerror(errno));
+  fail_unless(count == -1, "Expected count -1, got %d", count);
+}
+END_TEST
+
+START_TEST (authcache_remove_clear_test) {
+  int res, count = 0;
+  struct passwd pwd, *pw = NULL;
+  struct group grp, *gr = NULL;
+  char *members[] = { NULL };
+
+  res = pr_authcache_remove(0, "foo");
+  fail_unless(res < 0, "Removed from disabled cache unexpectedly");
+  fail_unless(errno == EPERM, "Expected EPERM (%d), got %s (%d)", EPERM,
+    strerror(errno), errno);
+
+  res = pr_authcache_init(1024 * 1024, 60, 10);
+  fail_unless(res == 0, "Failed to initialize cache: %s", strerror(errno));
+
+  memset(&pwd, 0, sizeof(pwd));
+  pwd.pw_name = "foo";
+  pwd.pw_uid = 500;
+  pwd.pw_gid = 501;
+
+  memset(&grp, 0, sizeof(grp));
+  grp.gr_name = "foo";
+  grp.gr_gid = 501;
+  grp.gr_mem = members;
+
+  (void) pr_authcache_add_pwnam("foo", &pwd, "sql");
+  (void) pr_authcache_add_grnam("foo", &grp, "sql");
+  (void) pr_authcache_add_groups("foo", NULL, NULL, -1, NULL);
+
+  res = pr_authcache_remove(PR_AUTHCACHE_TYPE_GRNAM, "foo");
+  fail_unless(res == 1, "Expected 1 removed entry, got %d", res);
+
+  res = pr_authcache_get_grnam(p, "foo", &gr, NULL);
+  fail_unless(res < 0, "Found removed group unexpectedly");
+
+  res = pr_authcache_get_pwnam(p, "foo", &pw, NULL);
+  fail_unless(res == 0, "Failed to get user: %s", strerror(errno));
+
+  res = pr_authcache_remove(0, "foo");
+  fail_unless(res == 2, "Expected 2 removed entries, got %d", res);
+
+  res = pr_authcache_get_pwnam(p, "foo", &pw, NULL);
+  fail_unless(res < 0, "Found removed user unexpectedly");
+
+  res = pr_authcache_get_groups(p, "foo", NULL, NULL, &count, NULL);
+  fail_unless(res < 0, "Found removed groups unexpectedly");
+
+  (void) pr_authcache_add_pwnam("foo", &pwd, "sql");
+  res = pr_authcache_clear();
+  fail_unless(res == 0, "Failed to clear cache: %s", strerror(errno));
+
+  res = pr_authcache_get_pwnam(p, "foo", &pw, NULL);
+  fail_unless(res < 0, "Found cleared user unexpectedly");
+}
+END_TEST
+
+START_TEST (authcache_stats_test) {
+  int res;
+  array_header *stats;
+  struct authcache_stats *elts;
+  struct passwd pwd, *pw = NULL;
+  register unsigned int i;
+
+  stats = pr_authcache_get_stats(p);
+  fail_unless(stats == NULL, "Got stats for disabled cache unexpectedly");
+  fail_unless(errno == EPERM, "Expected EPERM (%d), got %s (%d)", EPERM,
+    strerror(errno), errno);
+
+  res = pr_authcache_init(1024 * 1024, 60, 10);
+  fail_unless(res == 0, "Failed to initialize cache: %s", strerror(errno));
+
+  memset(&pwd, 0, sizeof(pwd));
+  pwd.pw_name = "foo";
+  pwd.pw_uid = 500;
+  pwd.pw_gid = 501;
+
+  (void) pr_authcache_add_pwnam("foo", &pwd, "sql");
+  (void) pr_authcache_add_pwnam("bar", NULL, NULL);
+
+  for (i = 0; i < 3; i++) {
+    (void) pr_authcache_get_pwnam(p, "foo", &pw, NULL);
+  }
+  (void) pr_authcache_get_pwnam(p, "bar", &pw, NULL);
+
+  stats = pr_authcache_get_stats(p);
+  fail_unless(stats != NULL, "Failed to get stats: %s", strerror(errno));
+  fail_unless(stats->nelts == 2, "Expected 2 modules, got %u", stats->nelts);
+
+  elts = stats->elts;
+  fail_unless(strcmp(elts[0].module_name, "sql") == 0,
+    "Expected 'sql', got '%s'", elts[0].module_name);
+  fail_unless(elts[0].hits == 3, "Expected 3 hits, got %lu",
+    (unsigned long) elts[0].hits);
+  fail_unless(elts[0].misses == 1, "Expected 1 miss, got %lu",
+    (unsigned long) elts[0].misses);
+  fail_unless(strcmp(elts[1].module_name, "none") == 0,
+    "Expected 'none', got '%s'", elts[1].module_name);
+  fail_unless(elts[1].hits == 1, "Expected 1 hit, got %lu",
+    (unsigned long) elts[1].hits);
+}
+END_TEST
+
+Suite *tests_get_authcache_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("authcache");
+  testcase = tcase_create("base");
+
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, authcache_init_test);
+  tcase_add_test(testcase, authcache_pwnam_test);
+  tcase_add_test(testcase, authcache_negative_ttl_test);
+  tcase_add_test(testcase, authcache_grnam_test);
+  tcase_add_test(testcase, authcache_groups_test);
+  tcase_add_test(testcase, authcache_remove_clear_test);
+  tcase_add_test(testcase, authcache_stats_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
@@ -0,0 +1,344 @@
+/*
+ * ProFTPD - FTP server testsuite
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Bindings API tests */
+
+#include "tests.h"
+
+static pool *p = NULL;
+
+/* Fixtures */
+
+static void set_up(void) {
+  if (p == NULL) {
+    p = permanent_pool = make_sub_pool(NULL);
+  }
+
+  init_netaddr();
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("binding", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("binding", 0, 0);
+  }
+
+  free_bindings();
+
+  if (p) {
+    destroy_pool(p);
+    p = permanent_pool = NULL;
+  }
+}
+
+static server_rec *create_server(const char *name) {
+  server_rec *s;
+  pool *server_pool;
+
+  server_pool = make_sub_pool(p);
+  s = pcalloc(server_pool, sizeof(server_rec));
+  s->pool = server_pool;
+  s->ServerName = pstrdup(server_pool, name);
+  s->ServerPort = 21;
+
+  return s;
+}
+
+/* Tests */
+
+START_TEST (namebind_create_test) {
+  int res;
+  server_rec *s;
+  const pr_netaddr_t *addr;
+
+  res = pr_namebind_create(NULL, NULL, NULL, 0);
+  fail_unless(res < 0, "Failed to handle null arguments");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  s = create_server("test");
+  addr = pr_netaddr_get_addr(p, "127.0.0.1", NULL);
+  fail_unless(addr != NULL, "Failed to get address: %s", strerror(errno));
+  s->addr = addr;
+
+  res = pr_namebind_create(s, "ftp.example.com", addr, 21);
+  fail_unless(res < 0, "Failed to handle missing ipbind");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  res = pr_ipbind_create(s, addr, 21);
+  fail_unless(res == 0, "Failed to create ipbind: %s", strerror(errno));
+
+  res = pr_namebind_create(s, "ftp.example.com", addr, 21);
+  fail_unless(res == 0, "Failed to create namebind: %s", strerror(errno));
+
+  res = pr_namebind_create(s, "FTP.Example.COM", addr, 21);
+  fail_unless(res < 0, "Failed to handle duplicate namebind");
+  fail_unless(errno == EEXIST, "Expected EEXIST (%d), got %s (%d)", EEXIST,
+    strerror(errno), errno);
+
+  res = pr_namebind_create(s, "*.example.com", addr, 21);
+  fail_unless(res == 0, "Failed to create wildcard namebind: %s",
+    strerror(errno));
+
+  res = pr_namebind_create(s, "*.example.com", addr, 21);
+  fail_unless(res < 0, "Failed to handle duplicate wildcard namebind");
+  fail_unless(errno == EEXIST, "Expected EEXIST (%d), got %s (%d)", EEXIST,
+    strerror(errno), errno);
+
+  res = (int) pr_namebind_count(s);
+  fail_unless(res == 2, "Expected 2 namebinds, got %d", res);
+}
+END_TEST
+
+START_TEST (namebind_find_test) {
+  int res;
+  server_rec *s, *exact_server, *wildcard_server, *deep_server;
+  const pr_netaddr_t *addr;
+  pr_namebind_t *namebind;
+
+  namebind = pr_namebind_find(NULL, NULL, 0, FALSE);
+  fail_unless(namebind == NULL, "Failed to handle null arguments");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  s = create_server("test");
+  addr = pr_netaddr_get_addr(p, "127.0.0.1", NULL);
+  fail_unless(addr != NULL, "Failed to get address: %s", strerror(errno));
+  s->addr = addr;
+
+  res = pr_ipbind_create(s, addr, 21);
+  fail_unless(res == 0, "Failed to create ipbind: %s", strerror(errno));
+
+  res = pr_ipbind_open(addr, 21, NULL, FALSE, FALSE, FALSE);
+  fail_unless(res == 0, "Failed to open ipbind: %s", strerror(errno));
+
+  namebind = pr_namebind_find("ftp.example.com", addr, 21, FALSE);
+  fail_unless(namebind == NULL, "Found namebind unexpectedly");
+
+  wildcard_server = create_server("wildcard");
+  res = pr_namebind_create(wildcard_server, "*.example.com", addr, 21);
+  fail_unless(res == 0, "Failed to create namebind: %s", strerror(errno));
+
+  deep_server = create_server("deep");
+  res = pr_namebind_create(deep_server, "ftp?.eu.example.com", addr, 21);
+  fail_unless(res == 0, "Failed to create namebind: %s", strerror(errno));
+
+  exact_server = create_server("exact");
+  res = pr_namebind_create(exact_server, "ftp1.eu.example.com", addr, 21);
+  fail_unless(res == 0, "Failed to create namebind: %s", strerror(errno));
+
+  /* Exact names are preferred over any pattern. */
+  namebind = pr_namebind_find("FTP1.EU.example.com", addr, 21, FALSE);
+  fail_unless(namebind != NULL, "Failed to find namebind: %s",
+    strerror(errno));
+  fail_unless(namebind->nb_server == exact_server,
+    "Expected server '%s', got '%s'", exact_server->ServerName,
+    namebind->nb_server->ServerName);
+
+  /* Patterns with the longest literal suffix are preferred. */
+  namebind = pr_namebind_find("ftp2.eu.example.com", addr, 21, FALSE);
+  fail_unless(namebind != NULL, "Failed to find namebind: %s",
+    strerror(errno));
+  fail_unless(namebind->nb_server == deep_server,
+    "Expected server '%s', got '%s'", deep_server->ServerName,
+    namebind->nb_server->ServerName);
+
+  namebind = pr_namebind_find("ftp22.eu.example.com", addr, 21, FALSE);
+  fail_unless(namebind != NULL, "Failed to find namebind: %s",
+    strerror(errno));
+  fail_unless(namebind->nb_server == wildcard_server,
+    "Expected server '%s', got '%s'", wildcard_server->ServerName,
+    namebind->nb_server->ServerName);
+
+  namebind = pr_namebind_find("example.com", addr, 21, FALSE);
+  fail_unless(namebind == NULL, "Found namebind for 'example.com' unexpectedly");
+
+  namebind = pr_namebind_find("ftp.example.org", addr, 21, FALSE);
+  fail_unless(namebind == NULL,
+    "Found namebind for 'ftp.example.org' unexpectedly");
+
+  /* Inactive namebinds are skipped, if requested. */
+  namebind = pr_namebind_find("ftp1.eu.example.com", addr, 21, TRUE);
+  fail_unless(namebind == NULL, "Found inactive namebind unexpectedly");
+
+  res = pr_namebind_open("ftp?.eu.example.com", addr);
+  fail_unless(res == 0, "Failed to open namebind: %s", strerror(errno));
+
+  namebind = pr_namebind_find("ftp1.eu.example.com", addr, 21, TRUE);
+  fail_unless(namebind != NULL, "Failed to find namebind: %s",
+    strerror(errno));
+  fail_unless(namebind->nb_server == deep_server,
+    "Expected server '%s', got '%s'", deep_server->ServerName,
+    namebind->nb_server->ServerName);
+
+  res = pr_namebind_open("ftp1.eu.example.com", addr);
+  fail_unless(res == 0, "Failed to open namebind: %s", strerror(errno));
+
+  namebind = pr_namebind_find("ftp1.eu.example.com", addr, 21, TRUE);
+  fail_unless(namebind != NULL, "Failed to find namebind: %s",
+    strerror(errno));
+  fail_unless(namebind->nb_server == exact_server,
+    "Expected server '%s', got '%s'", exact_server->ServerName,
+    namebind->nb_server->ServerName);
+
+  res = pr_namebind_close("ftp1.eu.example.com", addr);
+  fail_unless(res == 0, "Failed to close namebind: %s", strerror(errno));
+
+  fail_unless(pr_namebind_get_server("ftp1.eu.example.com", addr, 21) ==
+    deep_server, "Failed to get expected server for closed namebind");
+}
+END_TEST
+
+START_TEST (namebind_find_bracket_pattern_test) {
+  int res;
+  server_rec *s;
+  const pr_netaddr_t *addr;
+  pr_namebind_t *namebind;
+
+  s = create_server("test");
+  addr = pr_netaddr_get_addr(p, "127.0.0.1", NULL);
+  fail_unless(addr != NULL, "Failed to get address: %s", strerror(errno));
+  s->addr = addr;
+
+  res = pr_ipbind_create(s, addr, 21);
+  fail_unless(res == 0, "Failed to create ipbind: %s", strerror(errno));
+
+  res = pr_namebind_create(s, "ftp[.]eu.example.com", addr, 21);
+  fail_unless(res == 0, "Failed to create namebind: %s", strerror(errno));
+
+  res = pr_namebind_create(s, "ftp.*", addr, 21);
+  fail_unless(res == 0, "Failed to create namebind: %s", strerror(errno));
+
+  namebind = pr_namebind_find("ftp.eu.example.com", addr, 21, FALSE);
+  fail_unless(namebind != NULL, "Failed to find namebind: %s",
+    strerror(errno));
+  fail_unless(strcmp(namebind->nb_name, "ftp[.]eu.example.com") == 0,
+    "Expected namebind 'ftp[.]eu.example.com', got '%s'", namebind->nb_name);
+
+  namebind = pr_namebind_find("ftp.example.net", addr, 21, FALSE);
+  fail_unless(namebind != NULL, "Failed to find namebind: %s",
+    strerror(errno));
+  fail_unless(strcmp(namebind->nb_name, "ftp.*") == 0,
+    "Expected namebind 'ftp.*', got '%s'", namebind->nb_name);
+}
+END_TEST
+
+START_TEST (namebind_find_large_table_test) {
+  register unsigned int i;
+  int res;
+  server_rec *s;
+  const pr_netaddr_t *addr;
+  struct timeval start_tv, end_tv;
+  unsigned long elapsed_ms;
+  unsigned int nvhosts = 10000, nlookups = 100000;
+
+  s = create_server("test");
+  addr = pr_netaddr_get_addr(p, "127.0.0.1", NULL);
+  fail_unless(addr != NULL, "Failed to get address: %s", strerror(errno));
+  s->addr = addr;
+
+  res = pr_ipbind_create(s, addr, 21);
+  fail_unless(res == 0, "Failed to create ipbind: %s", strerror(errno));
+
+  /* Half of the vhosts use exact names, the other half use patterns. */
+  gettimeofday(&start_tv, NULL);
+  for (i = 0; i < nvhosts; i++) {
+    char buf[128], *name;
+
+    if (i % 2 == 0) {
+      snprintf(buf, sizeof(buf), "ftp.customer%u.example.com", i);
+
+    } else {
+      snprintf(buf, sizeof(buf), "*.customer%u.example.com", i);
+    }
+
+    name = pstrdup(p, buf);
+
+    res = pr_namebind_create(s, name, addr, 21);
+    fail_unless(res == 0, "Failed to create namebind '%s': %s", name,
+      strerror(errno));
+  }
+  gettimeofday(&end_tv, NULL);
+
+  elapsed_ms = ((end_tv.tv_sec - start_tv.tv_sec) * 1000) +
+    ((end_tv.tv_usec - start_tv.tv_usec) / 1000);
+  pr_trace_msg("binding", 1, "created %u namebinds in %lu ms", nvhosts,
+    elapsed_ms);
+
+  gettimeofday(&start_tv, NULL);
+  for (i = 0; i < nlookups; i++) {
+    char name[128];
+    unsigned int n;
+    pr_namebind_t *namebind;
+
+    n = i % (nvhosts + 100);
+    if (n % 2 == 0) {
+      snprintf(name, sizeof(name), "ftp.customer%u.example.com", n);
+
+    } else {
+      snprintf(name, sizeof(name), "www%u.customer%u.example.com", i, n);
+    }
+
+    namebind = pr_namebind_find(name, addr, 21, FALSE);
+    if (n < nvhosts) {
+      fail_unless(namebind != NULL, "Failed to find namebind for '%s'", name);
+      fail_unless(pr_fnmatch(namebind->nb_name, name,
+        PR_FNM_NOESCAPE|PR_FNM_CASEFOLD) == 0,
+        "Found wrong namebind '%s' for '%s'", namebind->nb_name, name);
+
+    } else {
+      fail_unless(namebind == NULL, "Found namebind for '%s' unexpectedly",
+        name);
+    }
+  }
+  gettimeofday(&end_tv, NULL);
+
+  elapsed_ms = ((end_tv.tv_sec - start_tv.tv_sec) * 1000) +
+    ((end_tv.tv_usec - start_tv.tv_usec) / 1000);
+  pr_trace_msg("binding", 1, "resolved %u names against %u namebinds in %lu ms",
+    nlookups, nvhosts, elapsed_ms);
+}
+END_TEST
+
+Suite *tests_get_bindings_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("bindings");
+
+  testcase = tcase_create("base");
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, namebind_create_test);
+  tcase_add_test(testcase, namebind_find_test);
+  tcase_add_test(testcase, namebind_find_bracket_pattern_test);
+  tcase_add_test(testcase, namebind_find_large_table_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
@@ -0,0 +1,211 @@
+/*
+ * ProFTPD - FTP server testsuite
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Claim API tests */
+
+#include "tests.h"
+
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+
+static pool *p = NULL;
+
+static void set_up(void) {
+  if (p == NULL) {
+    p = permanent_pool = make_sub_pool(NULL);
+  }
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("claim", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("claim", 0, 0);
+  }
+
+  if (p) {
+    destroy_pool(p);
+    p = permanent_pool = NULL;
+  }
+}
+
+/* Returns the PID of a process which has since exited. */
+static pid_t get_dead_pid(void) {
+  pid_t pid;
+  int status;
+
+  pid = fork();
+  if (pid == 0) {
+    _exit(0);
+  }
+
+  (void) waitpid(pid, &status, 0);
+  return pid;
+}
+
+START_TEST (claim_acquire_test) {
+  pr_claim_t claim;
+  int res;
+
+  memset(&claim, 0, sizeof(claim));
+
+  res = pr_claim_acquire(NULL, PR_CLAIM_EMPTY);
+  fail_unless(res < 0, "Failed to handle null claim");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_claim_acquire(&claim, 7);
+  fail_unless(res < 0, "Failed to handle invalid state");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_claim_is_ready(&claim);
+  fail_unless(res == FALSE, "Expected empty claim to not be ready");
+
+  res = pr_claim_acquire(&claim, PR_CLAIM_READY);
+  fail_unless(res < 0, "Acquired empty claim as if ready");
+  fail_unless(errno == EBUSY, "Expected EBUSY (%d), got %s (%d)", EBUSY,
+    strerror(errno), errno);
+
+  res = pr_claim_acquire(&claim, PR_CLAIM_EMPTY);
+  fail_unless(res == 0, "Failed to acquire empty claim: %s", strerror(errno));
+  fail_unless(claim.state == (uint32_t) getpid(),
+    "Expected state %lu, got %lu", (unsigned long) getpid(),
+    (unsigned long) claim.state);
+
+  res = pr_claim_acquire(&claim, PR_CLAIM_EMPTY);
+  fail_unless(res < 0, "Acquired claim twice");
+  fail_unless(errno == EBUSY, "Expected EBUSY (%d), got %s (%d)", EBUSY,
+    strerror(errno), errno);
+
+  res = pr_claim_is_ready(&claim);
+  fail_unless(res == FALSE, "Expected held claim to not be ready");
+
+  pr_claim_release(&claim);
+  res = pr_claim_is_ready(&claim);
+  fail_unless(res == TRUE, "Expected released claim to be ready");
+
+  /* Ready entries may be claimed again, e.g. for reuse. */
+  res = pr_claim_acquire(&claim, PR_CLAIM_READY);
+  fail_unless(res == 0, "Failed to acquire ready claim: %s", strerror(errno));
+  pr_claim_release(&claim);
+}
+END_TEST
+
+START_TEST (claim_wait_test) {
+  pr_claim_t claim;
+  int res;
+
+  res = pr_claim_wait(NULL);
+  fail_unless(res < 0, "Failed to handle null claim");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  /* A ready entry needs no waiting. */
+  memset(&claim, 0, sizeof(claim));
+  claim.state = PR_CLAIM_READY;
+  res = pr_claim_wait(&claim);
+  fail_unless(res == 0, "Expected 0, got %d", res);
+
+  /* A claim held by a process which has exited is taken over. */
+  claim.state = (uint32_t) get_dead_pid();
+  claim.claimed = (uint32_t) time(NULL);
+  res = pr_claim_wait(&claim);
+  fail_unless(res == PR_CLAIM_TAKEN, "Expected PR_CLAIM_TAKEN, got %d", res);
+  fail_unless(claim.state == (uint32_t) getpid(),
+    "Expected state %lu, got %lu", (unsigned long) getpid(),
+    (unsigned long) claim.state);
+  pr_claim_release(&claim);
+
+  /* So is a claim held for too long by a live process, e.g. one which has
+   * reused the PID of the claiming process.
+   */
+  claim.state = (uint32_t) getppid();
+  claim.claimed = (uint32_t) time(NULL) - (PR_CLAIM_STALE_SECS + 5);
+  res = pr_claim_wait(&claim);
+  fail_unless(res == PR_CLAIM_TAKEN, "Expected PR_CLAIM_TAKEN, got %d", res);
+  pr_claim_release(&claim);
+}
+END_TEST
+
+START_TEST (claim_wait_live_test) {
+  pr_claim_t *claim;
+  pid_t pid;
+  int res, status;
+
+  /* A live claimer which takes a while to fill in the entry is waited for,
+   * rather than having its claim taken over.
+   */
+  claim = mmap(NULL, sizeof(pr_claim_t), PROT_READ|PROT_WRITE,
+    MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+  fail_unless(claim != MAP_FAILED, "Failed to map claim: %s",
+    strerror(errno));
+  memset(claim, 0, sizeof(pr_claim_t));
+
+  pid = fork();
+  if (pid == 0) {
+    if (pr_claim_acquire(claim, PR_CLAIM_EMPTY) < 0) {
+      _exit(1);
+    }
+
+    (void) usleep(250000);
+    pr_claim_release(claim);
+    _exit(0);
+  }
+
+  while (claim->state == PR_CLAIM_EMPTY) {
+    (void) usleep(1000);
+  }
+
+  res = pr_claim_wait(claim);
+  fail_unless(res == 0, "Expected 0, got %d", res);
+  fail_unless(pr_claim_is_ready(claim) == TRUE, "Expected ready claim");
+
+  (void) waitpid(pid, &status, 0);
+  fail_unless(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+    "Claiming process failed");
+
+  (void) munmap(claim, sizeof(pr_claim_t));
+}
+END_TEST
+
+Suite *tests_get_claim_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("claim");
+  testcase = tcase_create("base");
+
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, claim_acquire_test);
+  tcase_add_test(testcase, claim_wait_test);
+  tcase_add_test(testcase, claim_wait_live_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
@@ -26,6 +26,14 @@
 
 #include "tests.h"
 
+#if defined(__linux__)
+# include <sys/syscall.h>
+# if defined(SYS_openat2) && defined(O_PATH)
+#  include <linux/openat2.h>
+#  define FSIO_TEST_USE_OPENAT2	1
+# endif
+#endif
+
 static pool *p = NULL;
 
 static char *fsio_cwd = NULL;
@@ -2207,6 +2215,345 @@ START_TEST (fsio_sys_readdir_test) {
 }
 END_TEST
 
+static void fsio_testdir_remove(void) {
+  DIR *dirh;
+  struct dirent *dent;
+
+  dirh = opendir(fsio_testdir_path);
+  if (dirh == NULL) {
+    return;
+  }
+
+  while ((dent = readdir(dirh)) != NULL) {
+    char path[PR_TUNABLE_PATH_MAX+1];
+
+    if (strcmp(dent->d_name, ".") == 0 ||
+        strcmp(dent->d_name, "..") == 0) {
+      continue;
+    }
+
+    pr_snprintf(path, sizeof(path), "%s/%s", fsio_testdir_path, dent->d_name);
+    if (unlink(path) < 0) {
+      (void) rmdir(path);
+    }
+  }
+
+  (void) closedir(dirh);
+  (void) rmdir(fsio_testdir_path);
+}
+
+START_TEST (fsio_sys_readdir2_test) {
+  void *dirh;
+  pr_fs_dirent_t *dent;
+  int fd, res, seen_file = FALSE, seen_dir = FALSE, seen_link = FALSE;
+  char *path;
+
+  dent = pr_fsio_readdir2(NULL, 0);
+  fail_unless(dent == NULL, "Failed to handle null arguments");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  dent = pr_fsio_readdir2("/etc/hosts", 0);
+  fail_unless(dent == NULL, "Failed to handle file argument");
+  fail_unless(errno == ENOTDIR, "Expected ENOTDIR (%d), got %s (%d)", ENOTDIR,
+    strerror(errno), errno);
+
+  fsio_testdir_remove();
+  res = mkdir(fsio_testdir_path, 0755);
+  fail_unless(res == 0, "Failed to create '%s': %s", fsio_testdir_path,
+    strerror(errno));
+
+  path = pdircat(p, fsio_testdir_path, "file", NULL);
+  fd = open(path, O_CREAT|O_WRONLY, 0600);
+  fail_unless(fd >= 0, "Failed to create '%s': %s", path, strerror(errno));
+  fail_unless(write(fd, "foo", 3) == 3, "Failed to write '%s': %s", path,
+    strerror(errno));
+  (void) close(fd);
+
+  res = mkdir(pdircat(p, fsio_testdir_path, "dir", NULL), 0755);
+  fail_unless(res == 0, "Failed to create directory: %s", strerror(errno));
+
+  res = symlink("file", pdircat(p, fsio_testdir_path, "link", NULL));
+  fail_unless(res == 0, "Failed to create symlink: %s", strerror(errno));
+
+  dirh = pr_fsio_opendir(fsio_testdir_path);
+  fail_unless(dirh != NULL, "Failed to open '%s': %s", fsio_testdir_path,
+    strerror(errno));
+
+  while ((dent = pr_fsio_readdir2(dirh, PR_FSIO_READDIR_FL_LSTAT)) != NULL) {
+    fail_unless(dent->st_errno == 0, "Failed to lstat '%s': %s", dent->name,
+      strerror(dent->st_errno));
+
+    if (strcmp(dent->name, "file") == 0) {
+      fail_unless(S_ISREG(dent->type), "Expected file type for '%s'",
+        dent->name);
+      fail_unless(dent->st.st_size == 3, "Expected size 3, got %lu",
+        (unsigned long) dent->st.st_size);
+      seen_file = TRUE;
+
+    } else if (strcmp(dent->name, "dir") == 0) {
+      fail_unless(S_ISDIR(dent->type), "Expected directory type for '%s'",
+        dent->name);
+      fail_unless(S_ISDIR(dent->st.st_mode), "Expected directory mode for '%s'",
+        dent->name);
+      seen_dir = TRUE;
+
+    } else if (strcmp(dent->name, "link") == 0) {
+      fail_unless(S_ISLNK(dent->type), "Expected symlink type for '%s'",
+        dent->name);
+      fail_unless(S_ISLNK(dent->st.st_mode), "Expected symlink mode for '%s'",
+        dent->name);
+      seen_link = TRUE;
+    }
+  }
+
+  fail_unless(seen_file && seen_dir && seen_link, "Missing directory entries");
+  (void) pr_fsio_closedir(dirh);
+
+  /* Following symlinks, the link is reported as its target. */
+  dirh = pr_fsio_opendir(fsio_testdir_path);
+  fail_unless(dirh != NULL, "Failed to open '%s': %s", fsio_testdir_path,
+    strerror(errno));
+
+  while ((dent = pr_fsio_readdir2(dirh, PR_FSIO_READDIR_FL_STAT)) != NULL) {
+    if (strcmp(dent->name, "link") == 0) {
+      fail_unless(S_ISREG(dent->type), "Expected file type for '%s'",
+        dent->name);
+      fail_unless(dent->st.st_size == 3, "Expected size 3, got %lu",
+        (unsigned long) dent->st.st_size);
+    }
+  }
+
+  (void) pr_fsio_closedir(dirh);
+  fsio_testdir_remove();
+}
+END_TEST
+
+static int fsio_readdir2_lstat(pr_fs_t *fs, const char *path,
+    struct stat *st) {
+  int res;
+
+  res = lstat(path, st);
+  if (res == 0) {
+    st->st_size = 42;
+  }
+
+  return res;
+}
+
+START_TEST (fsio_sys_readdir2_custom_fs_test) {
+  void *dirh;
+  pr_fs_t *fs;
+  pr_fs_dirent_t *dent;
+  int fd, res, seen_file;
+  char *path;
+
+  fsio_testdir_remove();
+  res = mkdir(fsio_testdir_path, 0755);
+  fail_unless(res == 0, "Failed to create '%s': %s", fsio_testdir_path,
+    strerror(errno));
+
+  path = pdircat(p, fsio_testdir_path, "file", NULL);
+  fd = open(path, O_CREAT|O_WRONLY, 0600);
+  fail_unless(fd >= 0, "Failed to create '%s': %s", path, strerror(errno));
+  (void) close(fd);
+
+  /* Entries handled by an FS registered below the directory are looked up
+   * using that FS.
+   */
+  fs = pr_register_fs(p, "testsuite", path);
+  fail_unless(fs != NULL, "Failed to register FS: %s", strerror(errno));
+  fs->lstat = fsio_readdir2_lstat;
+
+  dirh = pr_fsio_opendir(fsio_testdir_path);
+  fail_unless(dirh != NULL, "Failed to open '%s': %s", fsio_testdir_path,
+    strerror(errno));
+
+  seen_file = FALSE;
+  while ((dent = pr_fsio_readdir2(dirh, PR_FSIO_READDIR_FL_LSTAT)) != NULL) {
+    if (strcmp(dent->name, "file") == 0) {
+      fail_unless(dent->st_errno == 0, "Failed to lstat '%s': %s", dent->name,
+        strerror(dent->st_errno));
+      fail_unless(dent->st.st_size == 42, "Expected size 42, got %lu",
+        (unsigned long) dent->st.st_size);
+      seen_file = TRUE;
+    }
+  }
+
+  fail_unless(seen_file == TRUE, "Missing directory entry");
+  (void) pr_fsio_closedir(dirh);
+  (void) pr_remove_fs(path);
+
+  /* So are those handled by an FS registered after opening the directory. */
+  dirh = pr_fsio_opendir(fsio_testdir_path);
+  fail_unless(dirh != NULL, "Failed to open '%s': %s", fsio_testdir_path,
+    strerror(errno));
+
+  fs = pr_register_fs(p, "testsuite", path);
+  fail_unless(fs != NULL, "Failed to register FS: %s", strerror(errno));
+  fs->lstat = fsio_readdir2_lstat;
+
+  seen_file = FALSE;
+  while ((dent = pr_fsio_readdir2(dirh, PR_FSIO_READDIR_FL_LSTAT)) != NULL) {
+    if (strcmp(dent->name, "file") == 0) {
+      fail_unless(dent->st.st_size == 42, "Expected size 42, got %lu",
+        (unsigned long) dent->st.st_size);
+      seen_file = TRUE;
+    }
+  }
+
+  fail_unless(seen_file == TRUE, "Missing directory entry");
+  (void) pr_fsio_closedir(dirh);
+  (void) pr_remove_fs(path);
+
+  fsio_testdir_remove();
+}
+END_TEST
+
+START_TEST (fsio_sys_statat_test) {
+  void *dirh;
+  int fd, res;
+  struct stat st;
+
+  res = pr_fsio_statat(NULL, NULL, NULL, 0);
+  fail_unless(res < 0, "Failed to handle null arguments");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_fsio_statat("/etc", "hosts", &st, 0);
+  fail_unless(res < 0, "Failed to handle unopened directory");
+  fail_unless(errno == ENOTDIR, "Expected ENOTDIR (%d), got %s (%d)", ENOTDIR,
+    strerror(errno), errno);
+
+  dirh = pr_fsio_opendir("/");
+  fail_unless(dirh != NULL, "Failed to open '/': %s", strerror(errno));
+
+  res = pr_fsio_statat(dirh, "tmp", &st, PR_FSIO_STATAT_FL_NOFOLLOW);
+  fail_unless(res == 0, "Failed to stat 'tmp': %s", strerror(errno));
+  fail_unless(S_ISDIR(st.st_mode), "Expected directory mode for 'tmp'");
+
+  res = pr_fsio_statat(dirh, "foo.bar.baz.d", &st, 0);
+  fail_unless(res < 0, "Check of 'foo.bar.baz.d' succeeded unexpectedly");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  /* Names with path separators are looked up by path. */
+  res = pr_fsio_statat(dirh, "etc/hosts", &st, 0);
+  fail_unless(res == 0, "Failed to stat 'etc/hosts': %s", strerror(errno));
+
+  /* Such lookups bypass the statcache, neither using nor changing it. */
+  fd = open(fsio_test_path, O_CREAT|O_WRONLY, 0644);
+  fail_unless(fd >= 0, "Failed to create '%s': %s", fsio_test_path,
+    strerror(errno));
+
+  res = pr_fsio_stat(fsio_test_path, &st);
+  fail_unless(res == 0, "Failed to stat '%s': %s", fsio_test_path,
+    strerror(errno));
+  fail_unless(st.st_size == 0, "Expected size 0, got %lu",
+    (unsigned long) st.st_size);
+
+  fail_unless(write(fd, "foo", 3) == 3, "Failed to write to '%s': %s",
+    fsio_test_path, strerror(errno));
+  (void) close(fd);
+
+  res = pr_fsio_statat(dirh, fsio_test_path + 1, &st, 0);
+  fail_unless(res == 0, "Failed to stat '%s': %s", fsio_test_path + 1,
+    strerror(errno));
+  fail_unless(st.st_size == 3, "Expected size 3, got %lu",
+    (unsigned long) st.st_size);
+
+  res = pr_fsio_stat(fsio_test_path, &st);
+  fail_unless(res == 0, "Failed to stat '%s': %s", fsio_test_path,
+    strerror(errno));
+  fail_unless(st.st_size == 0, "Expected cached size 0, got %lu",
+    (unsigned long) st.st_size);
+
+  pr_fs_clear_cache2(fsio_test_path);
+  (void) unlink(fsio_test_path);
+  (void) pr_fsio_closedir(dirh);
+}
+END_TEST
+
+START_TEST (fsio_sys_readdir2_perf_test) {
+  register unsigned int i;
+  void *dirh;
+  struct dirent *de;
+  pr_fs_dirent_t *dent;
+  struct timeval start_tv, end_tv;
+  unsigned long elapsed_ms;
+  unsigned int count = 5000, nents;
+  int res;
+
+  /* Listings used to lstat(2) each entry via its full path, through the
+   * statcache; compare that with looking up the entries relative to the
+   * open directory.
+   */
+  fsio_testdir_remove();
+  res = mkdir(fsio_testdir_path, 0755);
+  fail_unless(res == 0, "Failed to create '%s': %s", fsio_testdir_path,
+    strerror(errno));
+
+  for (i = 0; i < count; i++) {
+    char path[PR_TUNABLE_PATH_MAX+1];
+    int fd;
+
+    pr_snprintf(path, sizeof(path), "%s/file%05u.dat", fsio_testdir_path, i);
+    fd = open(path, O_CREAT|O_WRONLY, 0600);
+    fail_unless(fd >= 0, "Failed to create '%s': %s", path, strerror(errno));
+    (void) close(fd);
+  }
+
+  dirh = pr_fsio_opendir(fsio_testdir_path);
+  fail_unless(dirh != NULL, "Failed to open '%s': %s", fsio_testdir_path,
+    strerror(errno));
+
+  nents = 0;
+  gettimeofday(&start_tv, NULL);
+  while ((de = pr_fsio_readdir(dirh)) != NULL) {
+    char *path;
+    struct stat st;
+
+    path = pdircat(p, fsio_testdir_path, de->d_name, NULL);
+    pr_fs_clear_cache2(path);
+    if (pr_fsio_lstat(path, &st) == 0) {
+      nents++;
+    }
+  }
+  gettimeofday(&end_tv, NULL);
+  (void) pr_fsio_closedir(dirh);
+
+  elapsed_ms = ((end_tv.tv_sec - start_tv.tv_sec) * 1000) +
+    ((end_tv.tv_usec - start_tv.tv_usec) / 1000);
+  pr_trace_msg("fsio", 1, "readdir + lstat of %u entries in %lu ms", nents,
+    elapsed_ms);
+  fail_unless(nents == count + 2, "Expected %u entries, got %u", count + 2,
+    nents);
+
+  dirh = pr_fsio_opendir(fsio_testdir_path);
+  fail_unless(dirh != NULL, "Failed to open '%s': %s", fsio_testdir_path,
+    strerror(errno));
+
+  nents = 0;
+  gettimeofday(&start_tv, NULL);
+  while ((dent = pr_fsio_readdir2(dirh, PR_FSIO_READDIR_FL_LSTAT)) != NULL) {
+    if (dent->st_errno == 0) {
+      nents++;
+    }
+  }
+  gettimeofday(&end_tv, NULL);
+  (void) pr_fsio_closedir(dirh);
+
+  elapsed_ms = ((end_tv.tv_sec - start_tv.tv_sec) * 1000) +
+    ((end_tv.tv_usec - start_tv.tv_usec) / 1000);
+  pr_trace_msg("fsio", 1, "readdir2 of %u entries in %lu ms", nents,
+    elapsed_ms);
+  fail_unless(nents == count + 2, "Expected %u entries, got %u", count + 2,
+    nents);
+
+  fsio_testdir_remove();
+}
+END_TEST
+
 START_TEST (fsio_sys_closedir_test) {
   void *dirh;
   int res;
@@ -3199,6 +3546,127 @@ START_TEST (fsio_statcache_expired_test) {
 }
 END_TEST
 
+START_TEST (fsio_statcache_lru_test) {
+  int expected, res;
+  struct stat st;
+
+  pr_fs_statcache_set_policy(2, PR_TUNABLE_FS_STATCACHE_MAX_AGE, 0);
+
+  res = pr_fsio_stat("/tmp", &st);
+  fail_unless(res == 0, "Failed to stat '/tmp': %s", strerror(errno));
+
+  res = pr_fsio_stat("/", &st);
+  fail_unless(res == 0, "Failed to stat '/': %s", strerror(errno));
+
+  /* This hit makes '/' the least recently used entry... */
+  res = pr_fsio_stat("/tmp", &st);
+  fail_unless(res == 0, "Failed to stat '/tmp': %s", strerror(errno));
+
+  /* ...which is evicted to make room for this one. */
+  res = pr_fsio_stat(fsio_test_path, &st);
+  fail_unless(res < 0, "Check of '%s' succeeded unexpectedly", fsio_test_path);
+
+  res = pr_fs_clear_cache2("/");
+  expected = 0;
+  fail_unless(res == expected, "Expected %d, got %d", expected, res);
+
+  res = pr_fs_clear_cache2("/tmp");
+  expected = 1;
+  fail_unless(res == expected, "Expected %d, got %d", expected, res);
+
+  res = pr_fs_clear_cache2(fsio_test_path);
+  expected = 1;
+  fail_unless(res == expected, "Expected %d, got %d", expected, res);
+
+  pr_fs_clear_cache();
+}
+END_TEST
+
+START_TEST (fsio_statcache_negative_max_age_test) {
+  int fd, res;
+  struct stat st;
+
+  res = pr_fs_statcache_set_negative_max_age(1);
+  fail_unless(res == 0, "Failed to set negative max age: %s", strerror(errno));
+
+  res = pr_fsio_stat(fsio_test_path, &st);
+  fail_unless(res < 0, "Check of '%s' succeeded unexpectedly", fsio_test_path);
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  /* Create the file behind the cache's back, as another process would. */
+  fd = open(fsio_test_path, O_CREAT|O_WRONLY, 0600);
+  fail_unless(fd >= 0, "Failed to create '%s': %s", fsio_test_path,
+    strerror(errno));
+  (void) close(fd);
+
+  res = pr_fsio_stat(fsio_test_path, &st);
+  fail_unless(res < 0, "Expected cached failure for '%s'", fsio_test_path);
+
+  /* The failure is cached for less time than the max age. */
+  sleep(2);
+
+  res = pr_fsio_stat(fsio_test_path, &st);
+  fail_unless(res == 0, "Failed to stat '%s': %s", fsio_test_path,
+    strerror(errno));
+
+  (void) unlink(fsio_test_path);
+  pr_fs_statcache_set_negative_max_age(
+    PR_TUNABLE_FS_STATCACHE_NEGATIVE_MAX_AGE);
+  pr_fs_clear_cache();
+}
+END_TEST
+
+START_TEST (fsio_statcache_invalidate_test) {
+  int expected, res;
+  char *path;
+  struct stat st;
+  pr_fh_t *fh;
+
+  res = mkdir(fsio_testdir_path, 0755);
+  fail_unless(res == 0, "Failed to create '%s': %s", fsio_testdir_path,
+    strerror(errno));
+
+  path = pdircat(p, fsio_testdir_path, "foo", NULL);
+
+  res = pr_fsio_stat(fsio_testdir_path, &st);
+  fail_unless(res == 0, "Failed to stat '%s': %s", fsio_testdir_path,
+    strerror(errno));
+
+  res = pr_fsio_stat(path, &st);
+  fail_unless(res < 0, "Check of '%s' succeeded unexpectedly", path);
+
+  /* Creating a file clears the entries for it, and for its directory. */
+  fh = pr_fsio_open(path, O_CREAT|O_WRONLY);
+  fail_unless(fh != NULL, "Failed to create '%s': %s", path, strerror(errno));
+  (void) pr_fsio_close(fh);
+
+  res = pr_fs_clear_cache2(fsio_testdir_path);
+  expected = 0;
+  fail_unless(res == expected, "Expected %d, got %d", expected, res);
+
+  res = pr_fsio_stat(path, &st);
+  fail_unless(res == 0, "Failed to stat '%s': %s", path, strerror(errno));
+
+  res = pr_fsio_unlink(path);
+  fail_unless(res == 0, "Failed to unlink '%s': %s", path, strerror(errno));
+
+  res = pr_fsio_stat(path, &st);
+  fail_unless(res < 0, "Check of '%s' succeeded unexpectedly", path);
+
+  /* Removing a directory clears the entries for anything beneath it. */
+  res = pr_fsio_rmdir(fsio_testdir_path);
+  fail_unless(res == 0, "Failed to remove '%s': %s", fsio_testdir_path,
+    strerror(errno));
+
+  res = pr_fs_clear_cache2(path);
+  expected = 0;
+  fail_unless(res == expected, "Expected %d, got %d", expected, res);
+
+  pr_fs_clear_cache();
+}
+END_TEST
+
 START_TEST (fsio_statcache_dump_test) {
   mark_point();
   pr_fs_statcache_dump();
@@ -3904,34 +4372,268 @@ START_TEST (fs_copy_file2_test) {
 }
 END_TEST
 
-START_TEST (fs_interpolate_test) {
-  int res;
-  char buf[PR_TUNABLE_PATH_MAX], *path;
+static off_t copy_progress_bytes = 0;
+static void copy_progress_bytes_cb(int nwritten) {
+  copy_progress_iter++;
+  copy_progress_bytes += nwritten;
+}
 
-  memset(buf, '\0', sizeof(buf));
+static int fsio_copy_write(pr_fh_t *fh, int fd, const char *buf, size_t sz) {
+  return write(fd, buf, sz);
+}
 
-  res = pr_fs_interpolate(NULL, NULL, 0);
-  fail_unless(res < 0, "Failed to handle null arguments");
-  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
-    strerror(errno), errno);
+static int fsio_copy_cmp(const char *path1, const char *path2) {
+  FILE *fp1, *fp2;
+  int c1, c2;
 
-  path = "/tmp";
-  res = pr_fs_interpolate(path, NULL, 0);
-  fail_unless(res < 0, "Failed to handle null buffer");
-  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
-    strerror(errno), errno);
+  fp1 = fopen(path1, "r");
+  fp2 = fopen(path2, "r");
+  if (fp1 == NULL ||
+      fp2 == NULL) {
+    if (fp1 != NULL) {
+      fclose(fp1);
+    }
 
-  res = pr_fs_interpolate(path, buf, 0);
-  fail_unless(res < 0, "Failed to handle zero buffer length");
-  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
-    strerror(errno), errno);
+    if (fp2 != NULL) {
+      fclose(fp2);
+    }
 
-  res = pr_fs_interpolate(path, buf, sizeof(buf)-1);
-  fail_unless(res == 1, "Failed to interpolate path '%s': %s", path,
-    strerror(errno));
-  fail_unless(strcmp(buf, path) == 0, "Expected '%s', got '%s'", path, buf);
+    return -1;
+  }
+
+  do {
+    c1 = getc(fp1);
+    c2 = getc(fp2);
+  } while (c1 == c2 && c1 != EOF);
+
+  fclose(fp1);
+  fclose(fp2);
+
+  return c1 == c2 ? 0 : -1;
+}
+
+START_TEST (fs_copy_file_perf_test) {
+  register unsigned int i;
+  int fd, res;
+  char *buf, *dst_path;
+  const char *src_path;
+  size_t bufsz = 1024 * 1024;
+  unsigned int nchunks = 64, fast_iter;
+  struct timeval start_tv, end_tv;
+  unsigned long fast_ms, loop_ms;
+  pr_fs_t *fs;
+  struct stat st;
+
+  src_path = fsio_copy_src_path;
+  dst_path = (char *) fsio_copy_dst_path;
+
+  buf = malloc(bufsz);
+  fail_unless(buf != NULL, "Failed to allocate buffer");
+
+  (void) unlink(src_path);
+  fd = open(src_path, O_CREAT|O_EXCL|O_WRONLY, 0600);
+  fail_unless(fd >= 0, "Failed to open '%s': %s", src_path, strerror(errno));
+
+  for (i = 0; i < nchunks; i++) {
+    memset(buf, 'A' + (i % 26), bufsz);
+    res = write(fd, buf, bufsz);
+    fail_unless(res == (int) bufsz, "Failed to write '%s': %s", src_path,
+      strerror(errno));
+  }
+
+  (void) close(fd);
+  free(buf);
+
+  /* Copied within the kernel, where the filesystem allows. */
+  (void) unlink(dst_path);
+  copy_progress_iter = 0;
+  copy_progress_bytes = 0;
+
+  gettimeofday(&start_tv, NULL);
+  res = pr_fs_copy_file2(src_path, dst_path, 0, copy_progress_bytes_cb);
+  gettimeofday(&end_tv, NULL);
+  fail_unless(res == 0, "Failed to copy file: %s", strerror(errno));
+
+  fast_ms = ((end_tv.tv_sec - start_tv.tv_sec) * 1000) +
+    ((end_tv.tv_usec - start_tv.tv_usec) / 1000);
+  fast_iter = copy_progress_iter;
+
+  fail_unless(copy_progress_bytes == (off_t) (bufsz * nchunks),
+    "Expected %lu bytes of progress, got %lu", (unsigned long) bufsz * nchunks,
+    (unsigned long) copy_progress_bytes);
+  fail_unless(fsio_copy_cmp(src_path, dst_path) == 0,
+    "Copy '%s' differs from '%s'", dst_path, src_path);
+
+  /* Files written through a custom FS (e.g. for quotas) are still copied by
+   * reading and writing the data.
+   */
+  fsio_testdir_remove();
+  res = mkdir(fsio_testdir_path, 0755);
+  fail_unless(res == 0, "Failed to create '%s': %s", fsio_testdir_path,
+    strerror(errno));
+
+  fs = pr_register_fs(p, "testsuite", "/tmp/prt-fsio-test.d/");
+  fail_unless(fs != NULL, "Failed to register FS: %s", strerror(errno));
+  fs->write = fsio_copy_write;
+
+  dst_path = pdircat(p, fsio_testdir_path, "dst.dat", NULL);
+  copy_progress_iter = 0;
+  copy_progress_bytes = 0;
+
+  gettimeofday(&start_tv, NULL);
+  res = pr_fs_copy_file2(src_path, dst_path, 0, copy_progress_bytes_cb);
+  gettimeofday(&end_tv, NULL);
+  fail_unless(res == 0, "Failed to copy file: %s", strerror(errno));
+
+  loop_ms = ((end_tv.tv_sec - start_tv.tv_sec) * 1000) +
+    ((end_tv.tv_usec - start_tv.tv_usec) / 1000);
+
+  fail_unless(copy_progress_bytes == (off_t) (bufsz * nchunks),
+    "Expected %lu bytes of progress, got %lu", (unsigned long) bufsz * nchunks,
+    (unsigned long) copy_progress_bytes);
+  fail_unless(copy_progress_iter > fast_iter,
+    "Expected more than %u progress callbacks, got %u", fast_iter,
+    copy_progress_iter);
+  fail_unless(fsio_copy_cmp(src_path, dst_path) == 0,
+    "Copy '%s' differs from '%s'", dst_path, src_path);
+
+  res = stat(dst_path, &st);
+  fail_unless(res == 0, "Failed to stat '%s': %s", dst_path, strerror(errno));
+
+  pr_trace_msg("fsio", 1, "copied %u MB in %lu ms within the kernel, "
+    "%lu ms reading and writing", nchunks, fast_ms, loop_ms);
+
+  (void) pr_remove_fs("/tmp/prt-fsio-test.d/");
+  (void) unlink(dst_path);
+  (void) unlink(fsio_copy_dst_path);
+  (void) unlink(src_path);
+  fsio_testdir_remove();
+}
+END_TEST
+
+static int fsio_test_read(pr_fh_t *fh, int fd, char *buf, size_t sz) {
+  return read(fd, buf, sz);
+}
+
+START_TEST (fs_uses_sys_read_test) {
+  int res;
+  char *path;
+  pr_fh_t *fh;
+  pr_fs_t *fs;
+
+  res = pr_fs_uses_sys_read(NULL);
+  fail_unless(res < 0, "Failed to handle null file handle");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  fsio_testdir_remove();
+  res = mkdir(fsio_testdir_path, 0755);
+  fail_unless(res == 0, "Failed to create '%s': %s", fsio_testdir_path,
+    strerror(errno));
+
+  path = pdircat(p, fsio_testdir_path, "file.txt", NULL);
+  fh = pr_fsio_open(path, O_CREAT|O_EXCL|O_WRONLY);
+  fail_unless(fh != NULL, "Failed to open '%s': %s", path, strerror(errno));
+
+  res = pr_fs_uses_sys_read(fh);
+  fail_unless(res == TRUE, "Expected TRUE, got %d", res);
+  (void) pr_fsio_close(fh);
+
+  /* A custom FS which only handles writes still uses the system read. */
+  fs = pr_register_fs(p, "testsuite", "/tmp/prt-fsio-test.d/");
+  fail_unless(fs != NULL, "Failed to register FS: %s", strerror(errno));
+  fs->write = fsio_copy_write;
+
+  fh = pr_fsio_open(path, O_RDONLY);
+  fail_unless(fh != NULL, "Failed to open '%s': %s", path, strerror(errno));
+
+  res = pr_fs_uses_sys_read(fh);
+  fail_unless(res == TRUE, "Expected TRUE, got %d", res);
+
+  fs->read = fsio_test_read;
+  res = pr_fs_uses_sys_read(fh);
+  fail_unless(res == FALSE, "Expected FALSE, got %d", res);
+  (void) pr_fsio_close(fh);
+
+  (void) pr_remove_fs("/tmp/prt-fsio-test.d/");
+  (void) unlink(path);
+  fsio_testdir_remove();
+}
+END_TEST
+
+START_TEST (fs_uses_sys_write_test) {
+  int res;
+  char *path;
+  pr_fh_t *fh;
+  pr_fs_t *fs;
+
+  res = pr_fs_uses_sys_write(NULL);
+  fail_unless(res < 0, "Failed to handle null file handle");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  fsio_testdir_remove();
+  res = mkdir(fsio_testdir_path, 0755);
+  fail_unless(res == 0, "Failed to create '%s': %s", fsio_testdir_path,
+    strerror(errno));
+
+  path = pdircat(p, fsio_testdir_path, "file.txt", NULL);
+  fh = pr_fsio_open(path, O_CREAT|O_EXCL|O_WRONLY);
+  fail_unless(fh != NULL, "Failed to open '%s': %s", path, strerror(errno));
+
+  res = pr_fs_uses_sys_write(fh);
+  fail_unless(res == TRUE, "Expected TRUE, got %d", res);
+  (void) pr_fsio_close(fh);
+
+  fs = pr_register_fs(p, "testsuite", "/tmp/prt-fsio-test.d/");
+  fail_unless(fs != NULL, "Failed to register FS: %s", strerror(errno));
+  fs->read = fsio_test_read;
+
+  fh = pr_fsio_open(path, O_WRONLY);
+  fail_unless(fh != NULL, "Failed to open '%s': %s", path, strerror(errno));
+
+  res = pr_fs_uses_sys_write(fh);
+  fail_unless(res == TRUE, "Expected TRUE, got %d", res);
+
+  fs->write = fsio_copy_write;
+  res = pr_fs_uses_sys_write(fh);
+  fail_unless(res == FALSE, "Expected FALSE, got %d", res);
+  (void) pr_fsio_close(fh);
+
+  (void) pr_remove_fs("/tmp/prt-fsio-test.d/");
+  (void) unlink(path);
+  fsio_testdir_remove();
+}
+END_TEST
+
+START_TEST (fs_interpolate_test) {
+  int res;
+  char buf[PR_TUNABLE_PATH_MAX], *path;
+
+  memset(buf, '\0', sizeof(buf));
+
+  res = pr_fs_interpolate(NULL, NULL, 0);
+  fail_unless(res < 0, "Failed to handle null arguments");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  path = "/tmp";
+  res = pr_fs_interpolate(path, NULL, 0);
+  fail_unless(res < 0, "Failed to handle null buffer");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_fs_interpolate(path, buf, 0);
+  fail_unless(res < 0, "Failed to handle zero buffer length");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
 
-  path = "~/foo/bar/baz/quzz/quzz.d";
+  res = pr_fs_interpolate(path, buf, sizeof(buf)-1);
+  fail_unless(res == 1, "Failed to interpolate path '%s': %s", path,
+    strerror(errno));
+  fail_unless(strcmp(buf, path) == 0, "Expected '%s', got '%s'", path, buf);
+
+  path = "~/foo/bar/baz/quzz/quzz.d";
   res = pr_fs_interpolate(path, buf, sizeof(buf)-1);
   fail_unless(res == 1, "Failed to interpolate path '%s': %s", path,
     strerror(errno));
@@ -4103,6 +4805,460 @@ START_TEST (fs_resolve_path_test) {
 }
 END_TEST
 
+static const char *fsio_resolve_dirs[] = {
+  "/tmp/prt-fsio-test.d",
+  "/tmp/prt-fsio-test.d/a",
+  "/tmp/prt-fsio-test.d/a/b",
+  "/tmp/prt-fsio-test.d/a/b/c",
+  "/tmp/prt-fsio-test.d/a/b/c/d",
+  "/tmp/prt-fsio-test.d/a/b/c/d/e",
+  "/tmp/prt-fsio-test.d/a/b/c/d/e/f",
+  "/tmp/prt-fsio-test.d/a/b/c/d/e/f/g",
+  NULL
+};
+
+static void fsio_resolve_dirs_create(void) {
+  register unsigned int i;
+
+  for (i = 0; fsio_resolve_dirs[i] != NULL; i++) {
+    int res;
+
+    res = mkdir(fsio_resolve_dirs[i], 0755);
+    fail_unless(res == 0 || errno == EEXIST, "Failed to create '%s': %s",
+      fsio_resolve_dirs[i], strerror(errno));
+  }
+}
+
+static void fsio_resolve_dirs_remove(void) {
+  int i;
+
+  (void) unlink("/tmp/prt-fsio-test.d/a/b/c/d/e/f/g/link");
+
+  for (i = (sizeof(fsio_resolve_dirs) / sizeof(char *)) - 2; i >= 0; i--) {
+    (void) rmdir(fsio_resolve_dirs[i]);
+  }
+}
+
+/* Counts the lstat(2) calls made when resolving the path, using the entries
+ * left in the (emptied beforehand) statcache.
+ */
+static unsigned int fsio_resolve_count_lstats(const char *path) {
+  char buf[PR_TUNABLE_PATH_MAX+1], *ptr;
+  unsigned int count = 0;
+  int res;
+
+  sstrncpy(buf, path, sizeof(buf));
+  res = pr_fs_clear_cache2(buf);
+  if (res > 0) {
+    count += res;
+  }
+
+  while ((ptr = strrchr(buf, '/')) != NULL) {
+    if (ptr == buf) {
+      ptr[1] = '\0';
+      res = pr_fs_clear_cache2(buf);
+      if (res > 0) {
+        count += res;
+      }
+
+      break;
+    }
+
+    *ptr = '\0';
+    res = pr_fs_clear_cache2(buf);
+    if (res > 0) {
+      count += res;
+    }
+  }
+
+  return count;
+}
+
+/* Returns TRUE if openat2(2) can be used here, i.e. the kernel (and any
+ * seccomp filter) allows it, as checked by fs_resolve_beneath().
+ */
+static int fsio_resolve_have_openat2(void) {
+#ifdef FSIO_TEST_USE_OPENAT2
+  struct open_how how;
+  int fd;
+
+  memset(&how, 0, sizeof(how));
+  how.flags = O_PATH|O_CLOEXEC;
+  how.resolve = RESOLVE_BENEATH|RESOLVE_NO_MAGICLINKS|RESOLVE_NO_SYMLINKS;
+
+  fd = (int) syscall(SYS_openat2, AT_FDCWD, "tmp", &how, sizeof(how));
+  if (fd < 0) {
+    return errno == ENOENT || errno == ENOTDIR ? TRUE : FALSE;
+  }
+
+  (void) close(fd);
+  return TRUE;
+#else
+  return FALSE;
+#endif /* FSIO_TEST_USE_OPENAT2 */
+}
+
+/* A custom FS which counts the lstat(2) and stat(2) calls made through it. */
+static unsigned int fsio_resolve_syscalls = 0;
+
+static int fsio_resolve_lstat(pr_fs_t *fs, const char *path, struct stat *st) {
+  fsio_resolve_syscalls++;
+  return lstat(path, st);
+}
+
+static int fsio_resolve_stat(pr_fs_t *fs, const char *path, struct stat *st) {
+  fsio_resolve_syscalls++;
+  return stat(path, st);
+}
+
+static pr_fs_t *fsio_resolve_register_counting_fs(void) {
+  pr_fs_t *fs;
+
+  fs = pr_register_fs(p, "counting", "/tmp/prt-fsio-test.d/");
+  fail_unless(fs != NULL, "Failed to register FS: %s", strerror(errno));
+  fs->lstat = fsio_resolve_lstat;
+  fs->stat = fsio_resolve_stat;
+
+  fsio_resolve_syscalls = 0;
+  return fs;
+}
+
+START_TEST (fs_resolve_path_beneath_test) {
+  int res, have_openat2;
+  unsigned int beneath_count, walk_count, walk_syscalls;
+  char buf[PR_TUNABLE_PATH_MAX+1];
+  const char *path, *expected;
+
+  fsio_resolve_dirs_create();
+  path = "/tmp/prt-fsio-test.d/a/b/c/d/e/f/g";
+  have_openat2 = fsio_resolve_have_openat2();
+
+  pr_fs_clear_cache();
+  memset(buf, '\0', sizeof(buf));
+  res = pr_fs_resolve_path(path, buf, sizeof(buf)-1, FSIO_FILE_STAT);
+  fail_unless(res == 0, "Failed to resolve '%s': %s", path, strerror(errno));
+  fail_unless(strcmp(buf, path) == 0, "Expected '%s', got '%s'", path, buf);
+  beneath_count = fsio_resolve_count_lstats(path);
+
+  (void) pr_fsio_set_options(PR_FSIO_OPT_IGNORE_RESOLVE_BENEATH);
+
+  pr_fs_clear_cache();
+  memset(buf, '\0', sizeof(buf));
+  res = pr_fs_resolve_path(path, buf, sizeof(buf)-1, FSIO_FILE_STAT);
+  fail_unless(res == 0, "Failed to resolve '%s': %s", path, strerror(errno));
+  fail_unless(strcmp(buf, path) == 0, "Expected '%s', got '%s'", path, buf);
+  walk_count = fsio_resolve_count_lstats(path);
+
+  (void) pr_fsio_set_options(0UL);
+
+  pr_trace_msg("fsio", 1, "resolved '%s' using %u lstat(2) calls walking, "
+    "%u beneath root (openat2 %s)", path, walk_count, beneath_count,
+    have_openat2 ? "available" : "unavailable");
+  fail_unless(walk_count == 10, "Expected 10 lstat(2) calls walking, got %u",
+    walk_count);
+
+  if (have_openat2) {
+    /* The path was resolved by a single openat2(2) call, without looking up
+     * any of its components.
+     */
+    fail_unless(beneath_count == 0,
+      "Expected 0 lstat(2) calls beneath root, got %u", beneath_count);
+
+  } else {
+    fail_unless(beneath_count == walk_count,
+      "Expected %u lstat(2) calls without openat2(2), got %u", walk_count,
+      beneath_count);
+  }
+
+  /* Count the lstat(2) calls which actually reach the filesystem, one for
+   * each component handled by the custom FS; paths handled by a custom FS
+   * are always walked.
+   */
+  fsio_resolve_register_counting_fs();
+
+  pr_fs_clear_cache();
+  memset(buf, '\0', sizeof(buf));
+  res = pr_fs_resolve_path(path, buf, sizeof(buf)-1, FSIO_FILE_STAT);
+  fail_unless(res == 0, "Failed to resolve '%s': %s", path, strerror(errno));
+  fail_unless(strcmp(buf, path) == 0, "Expected '%s', got '%s'", path, buf);
+  walk_syscalls = fsio_resolve_syscalls;
+
+  (void) pr_remove_fs("/tmp/prt-fsio-test.d/");
+
+  pr_trace_msg("fsio", 1, "walking '%s' made %u lstat(2) calls through the "
+    "custom FS", path, walk_syscalls);
+  fail_unless(walk_syscalls == 7,
+    "Expected 7 lstat(2) calls walking, got %u", walk_syscalls);
+
+  if (have_openat2) {
+    unsigned int beneath_syscalls;
+
+    /* A single openat2(2) call, plus any component lookups. */
+    beneath_syscalls = 1 + beneath_count;
+    fail_unless(beneath_syscalls < walk_syscalls,
+      "Expected openat2(2) to use fewer calls (%u) than walking (%u)",
+      beneath_syscalls, walk_syscalls);
+  }
+
+  /* Relative paths, "." components and trailing slashes. */
+  res = pr_fsio_chdir("/tmp/prt-fsio-test.d/a", FALSE);
+  fail_unless(res == 0, "Failed to chdir: %s", strerror(errno));
+
+  path = "./b/c/./d/";
+  expected = "/tmp/prt-fsio-test.d/a/b/c/d";
+  res = pr_fs_resolve_partial(path, buf, sizeof(buf)-1, FSIO_FILE_STAT);
+  fail_unless(res == 0, "Failed to resolve '%s': %s", path, strerror(errno));
+  fail_unless(strcmp(buf, expected) == 0, "Expected '%s', got '%s'",
+    expected, buf);
+
+  /* Paths with ".." and symlinks are walked. */
+  path = "b/c/../c/d";
+  res = pr_fs_resolve_partial(path, buf, sizeof(buf)-1, FSIO_FILE_STAT);
+  fail_unless(res == 0, "Failed to resolve '%s': %s", path, strerror(errno));
+  fail_unless(strcmp(buf, expected) == 0, "Expected '%s', got '%s'",
+    expected, buf);
+
+  res = symlink("/tmp/prt-fsio-test.d/a/b", "b/c/d/e/f/g/link");
+  fail_unless(res == 0, "Failed to create symlink: %s", strerror(errno));
+
+  path = "b/c/d/e/f/g/link/c/d";
+  res = pr_fs_resolve_path(path, buf, sizeof(buf)-1, FSIO_FILE_STAT);
+  fail_unless(res == 0, "Failed to resolve '%s': %s", path, strerror(errno));
+  fail_unless(strcmp(buf, expected) == 0, "Expected '%s', got '%s'",
+    expected, buf);
+
+  path = "b/c/nonexistent";
+  res = pr_fs_resolve_path(path, buf, sizeof(buf)-1, FSIO_FILE_STAT);
+  fail_unless(res < 0, "Resolved '%s' unexpectedly", path);
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  (void) pr_fsio_chdir(fsio_cwd, FALSE);
+  fsio_resolve_dirs_remove();
+}
+END_TEST
+
+START_TEST (fs_resolve_path_dentry_test) {
+  int res;
+  unsigned int count;
+  char buf[PR_TUNABLE_PATH_MAX+1];
+  const char *path, *expected;
+
+  fsio_resolve_dirs_create();
+  path = "/tmp/prt-fsio-test.d/a/b/c/d/e/f/g";
+
+  /* Walk the path, so that its lstat(2) calls are visible in the statcache. */
+  (void) pr_fsio_set_options(PR_FSIO_OPT_IGNORE_RESOLVE_BENEATH);
+
+  pr_fs_clear_cache();
+  res = pr_fs_resolve_path(path, buf, sizeof(buf)-1, FSIO_FILE_STAT);
+  fail_unless(res == 0, "Failed to resolve '%s': %s", path, strerror(errno));
+  count = fsio_resolve_count_lstats(path);
+  fail_unless(count == 10, "Expected 10 lstat(2) calls, got %u", count);
+
+  /* The second lookup is served from the dentry cache. */
+  memset(buf, '\0', sizeof(buf));
+  res = pr_fs_resolve_path(path, buf, sizeof(buf)-1, FSIO_FILE_STAT);
+  fail_unless(res == 0, "Failed to resolve '%s': %s", path, strerror(errno));
+  fail_unless(strcmp(buf, path) == 0, "Expected '%s', got '%s'", path, buf);
+  count = fsio_resolve_count_lstats(path);
+  fail_unless(count == 0, "Expected 0 lstat(2) calls, got %u", count);
+
+  res = pr_fsio_chdir("/tmp/prt-fsio-test.d/a", FALSE);
+  fail_unless(res == 0, "Failed to chdir: %s", strerror(errno));
+
+  /* Renamed paths are not resolved from stale entries. */
+  path = "b/c/d";
+  expected = "/tmp/prt-fsio-test.d/a/b/c/d";
+  res = pr_fs_resolve_partial(path, buf, sizeof(buf)-1, FSIO_FILE_STAT);
+  fail_unless(res == 0, "Failed to resolve '%s': %s", path, strerror(errno));
+  fail_unless(strcmp(buf, expected) == 0, "Expected '%s', got '%s'",
+    expected, buf);
+
+  res = pr_fsio_rename("b/c/d", "b/c/x");
+  fail_unless(res == 0, "Failed to rename: %s", strerror(errno));
+
+  res = pr_fs_resolve_partial(path, buf, sizeof(buf)-1, FSIO_FILE_STAT);
+  fail_unless(res < 0, "Resolved '%s' unexpectedly", path);
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  res = pr_fsio_rename("b/c/x", "b/c/d");
+  fail_unless(res == 0, "Failed to rename: %s", strerror(errno));
+
+  /* Nor are removed symlinks. */
+  res = pr_fsio_symlink("c", "b/c/d/e/f/g/link");
+  fail_unless(res == 0, "Failed to create symlink: %s", strerror(errno));
+
+  path = "b/c/d/e/f/g/link";
+  expected = "/tmp/prt-fsio-test.d/a/b/c/d/e/f/g/c";
+  res = pr_fs_resolve_partial(path, buf, sizeof(buf)-1, FSIO_FILE_STAT);
+  fail_unless(res < 0, "Resolved dangling '%s' unexpectedly", path);
+
+  res = pr_fsio_mkdir("b/c/d/e/f/g/c", 0755);
+  fail_unless(res == 0, "Failed to mkdir: %s", strerror(errno));
+
+  res = pr_fs_resolve_partial(path, buf, sizeof(buf)-1, FSIO_FILE_STAT);
+  fail_unless(res == 0, "Failed to resolve '%s': %s", path, strerror(errno));
+  fail_unless(strcmp(buf, expected) == 0, "Expected '%s', got '%s'",
+    expected, buf);
+
+  res = pr_fsio_rmdir("b/c/d/e/f/g/c");
+  fail_unless(res == 0, "Failed to rmdir: %s", strerror(errno));
+
+  res = pr_fs_resolve_partial(path, buf, sizeof(buf)-1, FSIO_FILE_STAT);
+  fail_unless(res < 0, "Resolved dangling '%s' unexpectedly", path);
+
+  res = pr_fsio_unlink(path);
+  fail_unless(res == 0, "Failed to unlink: %s", strerror(errno));
+
+  /* Relative paths are resolved again after changing directory. */
+  path = "b";
+  res = pr_fs_resolve_path(path, buf, sizeof(buf)-1, FSIO_FILE_STAT);
+  fail_unless(res == 0, "Failed to resolve '%s': %s", path, strerror(errno));
+
+  res = pr_fsio_chdir("/tmp/prt-fsio-test.d/a/b", FALSE);
+  fail_unless(res == 0, "Failed to chdir: %s", strerror(errno));
+
+  res = pr_fs_resolve_path(path, buf, sizeof(buf)-1, FSIO_FILE_STAT);
+  fail_unless(res < 0, "Resolved '%s' unexpectedly", path);
+
+  (void) pr_fsio_set_options(0UL);
+  (void) pr_fsio_chdir(fsio_cwd, FALSE);
+  fsio_resolve_dirs_remove();
+}
+END_TEST
+
+START_TEST (fs_resolve_path_dentry_symlink_test) {
+  int res;
+  char buf[PR_TUNABLE_PATH_MAX+1];
+  const char *path, *expected;
+
+  fsio_resolve_dirs_create();
+  (void) pr_fsio_set_options(PR_FSIO_OPT_IGNORE_RESOLVE_BENEATH);
+
+  res = pr_fsio_chdir("/tmp/prt-fsio-test.d/a", FALSE);
+  fail_unless(res == 0, "Failed to chdir: %s", strerror(errno));
+
+  res = mkdir("b/x", 0755);
+  fail_unless(res == 0, "Failed to mkdir: %s", strerror(errno));
+  res = mkdir("b/x/d", 0755);
+  fail_unless(res == 0, "Failed to mkdir: %s", strerror(errno));
+
+  pr_fs_clear_cache();
+
+  path = "b/c/d";
+  expected = "/tmp/prt-fsio-test.d/a/b/c/d";
+  res = pr_fs_resolve_partial(path, buf, sizeof(buf)-1, FSIO_FILE_STAT);
+  fail_unless(res == 0, "Failed to resolve '%s': %s", path, strerror(errno));
+  fail_unless(strcmp(buf, expected) == 0, "Expected '%s', got '%s'",
+    expected, buf);
+
+  /* Replace a component of the resolved path with a symlink; the path
+   * resolves to the symlink's target afterwards.
+   */
+  res = rename("b/c", "b/c.orig");
+  fail_unless(res == 0, "Failed to rename: %s", strerror(errno));
+
+  res = pr_fsio_symlink("x", "b/c");
+  fail_unless(res == 0, "Failed to create symlink: %s", strerror(errno));
+
+  expected = "/tmp/prt-fsio-test.d/a/b/x/d";
+  res = pr_fs_resolve_partial(path, buf, sizeof(buf)-1, FSIO_FILE_STAT);
+  fail_unless(res == 0, "Failed to resolve '%s': %s", path, strerror(errno));
+  fail_unless(strcmp(buf, expected) == 0, "Expected '%s', got '%s'",
+    expected, buf);
+
+  (void) unlink("b/c");
+  (void) rename("b/c.orig", "b/c");
+  (void) rmdir("b/x/d");
+  (void) rmdir("b/x");
+
+  (void) pr_fsio_set_options(0UL);
+  (void) pr_fsio_chdir(fsio_cwd, FALSE);
+  fsio_resolve_dirs_remove();
+}
+END_TEST
+
+START_TEST (fs_resolve_path_perf_test) {
+  register unsigned int i;
+  char buf[PR_TUNABLE_PATH_MAX+1];
+  const char *path;
+  struct timeval start_tv, end_tv;
+  unsigned long beneath_ms, walk_ms, warm_ms;
+  unsigned int count = 20000, walk_syscalls, warm_syscalls;
+  int res;
+
+  fsio_resolve_dirs_create();
+  path = "/tmp/prt-fsio-test.d/a/b/c/d/e/f/g";
+
+  /* Every FTP command resolves its path at least once, usually with the
+   * statcache emptied beforehand.
+   */
+  gettimeofday(&start_tv, NULL);
+  for (i = 0; i < count; i++) {
+    pr_fs_clear_cache();
+    res = pr_fs_resolve_path(path, buf, sizeof(buf)-1, FSIO_FILE_STAT);
+    fail_unless(res == 0, "Failed to resolve '%s': %s", path, strerror(errno));
+  }
+  gettimeofday(&end_tv, NULL);
+
+  beneath_ms = ((end_tv.tv_sec - start_tv.tv_sec) * 1000) +
+    ((end_tv.tv_usec - start_tv.tv_usec) / 1000);
+
+  /* Walking the path through a custom FS counts its lstat(2) calls. */
+  fsio_resolve_register_counting_fs();
+
+  gettimeofday(&start_tv, NULL);
+  for (i = 0; i < count; i++) {
+    pr_fs_clear_cache();
+    res = pr_fs_resolve_path(path, buf, sizeof(buf)-1, FSIO_FILE_STAT);
+    fail_unless(res == 0, "Failed to resolve '%s': %s", path, strerror(errno));
+  }
+  gettimeofday(&end_tv, NULL);
+
+  walk_syscalls = fsio_resolve_syscalls;
+  walk_ms = ((end_tv.tv_sec - start_tv.tv_sec) * 1000) +
+    ((end_tv.tv_usec - start_tv.tv_usec) / 1000);
+
+  pr_trace_msg("fsio", 1, "resolved '%s' %u times: %lu ms walking (%u "
+    "lstat(2) calls), %lu ms beneath root", path, count, walk_ms,
+    walk_syscalls, beneath_ms);
+  fail_unless(walk_syscalls == count * 7,
+    "Expected %u lstat(2) calls walking, got %u", count * 7, walk_syscalls);
+
+  /* One openat2(2) call costs less than seven or more lstat(2) calls. */
+  if (fsio_resolve_have_openat2()) {
+    fail_unless(beneath_ms < walk_ms,
+      "Expected resolving beneath root (%lu ms) to be faster than walking "
+      "(%lu ms)", beneath_ms, walk_ms);
+  }
+
+  /* Repeated lookups of the same path, as with SFTP clients, use the dentry
+   * cache, without any lstat(2) calls.
+   */
+  fsio_resolve_syscalls = 0;
+
+  gettimeofday(&start_tv, NULL);
+  for (i = 0; i < count; i++) {
+    res = pr_fs_resolve_path(path, buf, sizeof(buf)-1, FSIO_FILE_STAT);
+    fail_unless(res == 0, "Failed to resolve '%s': %s", path, strerror(errno));
+  }
+  gettimeofday(&end_tv, NULL);
+
+  warm_syscalls = fsio_resolve_syscalls;
+  warm_ms = ((end_tv.tv_sec - start_tv.tv_sec) * 1000) +
+    ((end_tv.tv_usec - start_tv.tv_usec) / 1000);
+  pr_trace_msg("fsio", 1, "resolved '%s' %u times with warm caches in %lu ms",
+    path, count, warm_ms);
+  fail_unless(warm_syscalls == 0,
+    "Expected 0 lstat(2) calls with warm caches, got %u", warm_syscalls);
+
+  (void) pr_remove_fs("/tmp/prt-fsio-test.d/");
+  fsio_resolve_dirs_remove();
+}
+END_TEST
+
 START_TEST (fs_use_encoding_test) {
   int res;
 
@@ -4547,6 +5703,119 @@ START_TEST (fs_fadvise_test) {
 }
 END_TEST
 
+START_TEST (fs_sync_range_test) {
+  int fd, res;
+  char buf[8192];
+  off_t len;
+
+  res = pr_fs_sync_range(-1, 0, 0, PR_FS_SYNC_RANGE_WRITE);
+  fail_unless(res < 0, "Failed to handle bad fd");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  fd = open(fsio_test_path, O_CREAT|O_EXCL|O_WRONLY, 0644);
+  fail_unless(fd >= 0, "Failed to open '%s': %s", fsio_test_path,
+    strerror(errno));
+
+  res = pr_fs_sync_range(fd, -1, 0, PR_FS_SYNC_RANGE_WRITE);
+  fail_unless(res < 0, "Failed to handle negative offset");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_fs_sync_range(fd, 0, 0, 0);
+  fail_unless(res < 0, "Failed to handle missing flags");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  memset(buf, 'A', sizeof(buf));
+  for (len = 0; len < 1024 * 1024; len += sizeof(buf)) {
+    res = write(fd, buf, sizeof(buf));
+    fail_unless(res == sizeof(buf), "Failed to write to '%s': %s",
+      fsio_test_path, strerror(errno));
+  }
+
+  res = pr_fs_sync_range(fd, 0, len / 2, PR_FS_SYNC_RANGE_WRITE);
+  if (res < 0) {
+    /* Not every platform can write out sections of a file. */
+    fail_unless(errno == ENOSYS, "Expected ENOSYS (%d), got %s (%d)", ENOSYS,
+      strerror(errno), errno);
+
+  } else {
+    res = pr_fs_sync_range(fd, len / 2, 0, PR_FS_SYNC_RANGE_WRITE);
+    fail_unless(res == 0, "Failed to start writeback: %s", strerror(errno));
+
+    res = pr_fs_sync_range(fd, 0, len / 2, PR_FS_SYNC_RANGE_WAIT);
+    fail_unless(res == 0, "Failed to wait for writeback: %s",
+      strerror(errno));
+  }
+
+  res = pr_fs_sync_range(fd, 0, 0, PR_FS_SYNC_RANGE_DATASYNC);
+  fail_unless(res == 0, "Failed to sync data: %s", strerror(errno));
+
+  (void) close(fd);
+  (void) unlink(fsio_test_path);
+}
+END_TEST
+
+START_TEST (fs_allocate_test) {
+  int fd, res;
+  off_t len = 1024 * 1024;
+  struct stat st;
+
+  res = pr_fs_allocate(-1, 0, len, 0);
+  fail_unless(res < 0, "Failed to handle bad fd");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  fd = open(fsio_test_path, O_CREAT|O_EXCL|O_RDWR, 0644);
+  fail_unless(fd >= 0, "Failed to open '%s': %s", fsio_test_path,
+    strerror(errno));
+
+  res = pr_fs_allocate(fd, 0, 0, 0);
+  fail_unless(res < 0, "Failed to handle zero length");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = write(fd, "0123456789", 10);
+  fail_unless(res == 10, "Failed to write to '%s': %s", fsio_test_path,
+    strerror(errno));
+
+  res = pr_fs_allocate(fd, 0, len, 0);
+  if (res < 0) {
+    /* Not every platform, or filesystem, supports preallocation. */
+    fail_unless(errno == ENOSYS || errno == EOPNOTSUPP,
+      "Expected ENOSYS (%d) or EOPNOTSUPP (%d), got %s (%d)", ENOSYS,
+      EOPNOTSUPP, strerror(errno), errno);
+
+  } else {
+    res = fstat(fd, &st);
+    fail_unless(res == 0, "Failed to stat '%s': %s", fsio_test_path,
+      strerror(errno));
+    fail_unless(st.st_size == 10, "Expected size 10, got %" PR_LU,
+      (pr_off_t) st.st_size);
+    fail_unless((off_t) st.st_blocks * 512 >= len,
+      "Expected at least %" PR_LU " bytes allocated, got %" PR_LU,
+      (pr_off_t) len, (pr_off_t) st.st_blocks * 512);
+
+    res = pr_fs_allocate(fd, st.st_size, len - st.st_size,
+      PR_FS_ALLOCATE_FL_DEALLOCATE);
+    fail_unless(res == 0, "Failed to deallocate blocks: %s", strerror(errno));
+
+    res = fstat(fd, &st);
+    fail_unless(res == 0, "Failed to stat '%s': %s", fsio_test_path,
+      strerror(errno));
+    fail_unless(st.st_size == 10, "Expected size 10, got %" PR_LU,
+      (pr_off_t) st.st_size);
+    fail_unless((off_t) st.st_blocks * 512 < len,
+      "Expected blocks beyond EOF to be deallocated, got %" PR_LU " bytes",
+      (pr_off_t) st.st_blocks * 512);
+  }
+
+  (void) close(fd);
+  (void) unlink(fsio_test_path);
+}
+END_TEST
+
 START_TEST (fs_have_access_test) {
   int res;
   struct stat st;
@@ -5092,6 +6361,10 @@ Suite *tests_get_fsio_suite(void) {
   tcase_add_test(testcase, fsio_sys_chroot_test);
   tcase_add_test(testcase, fsio_sys_opendir_test);
   tcase_add_test(testcase, fsio_sys_readdir_test);
+  tcase_add_test(testcase, fsio_sys_readdir2_test);
+  tcase_add_test(testcase, fsio_sys_readdir2_custom_fs_test);
+  tcase_add_test(testcase, fsio_sys_statat_test);
+  tcase_add_test(testcase, fsio_sys_readdir2_perf_test);
   tcase_add_test(testcase, fsio_sys_closedir_test);
 
   /* FSIO with error tests */
@@ -5117,6 +6390,9 @@ Suite *tests_get_fsio_suite(void) {
   tcase_add_test(testcase, fsio_statcache_cache_hit_test);
   tcase_add_test(testcase, fsio_statcache_negative_cache_test);
   tcase_add_test(testcase, fsio_statcache_expired_test);
+  tcase_add_test(testcase, fsio_statcache_lru_test);
+  tcase_add_test(testcase, fsio_statcache_negative_max_age_test);
+  tcase_add_test(testcase, fsio_statcache_invalidate_test);
   tcase_add_test(testcase, fsio_statcache_dump_test);
 
   /* Custom FSIO management tests */
@@ -5144,9 +6420,16 @@ Suite *tests_get_fsio_suite(void) {
   tcase_add_test(testcase, fs_glob_test);
   tcase_add_test(testcase, fs_copy_file_test);
   tcase_add_test(testcase, fs_copy_file2_test);
+  tcase_add_test(testcase, fs_copy_file_perf_test);
+  tcase_add_test(testcase, fs_uses_sys_read_test);
+  tcase_add_test(testcase, fs_uses_sys_write_test);
   tcase_add_test(testcase, fs_interpolate_test);
   tcase_add_test(testcase, fs_resolve_partial_test);
   tcase_add_test(testcase, fs_resolve_path_test);
+  tcase_add_test(testcase, fs_resolve_path_beneath_test);
+  tcase_add_test(testcase, fs_resolve_path_dentry_test);
+  tcase_add_test(testcase, fs_resolve_path_dentry_symlink_test);
+  tcase_add_test(testcase, fs_resolve_path_perf_test);
   tcase_add_test(testcase, fs_use_encoding_test);
   tcase_add_test(testcase, fs_decode_path2_test);
   tcase_add_test(testcase, fs_encode_path_test);
@@ -5160,6 +6443,8 @@ Suite *tests_get_fsio_suite(void) {
   tcase_add_test(testcase, fs_getsize2_test);
   tcase_add_test(testcase, fs_fgetsize_test);
   tcase_add_test(testcase, fs_fadvise_test);
+  tcase_add_test(testcase, fs_sync_range_test);
+  tcase_add_test(testcase, fs_allocate_test);
   tcase_add_test(testcase, fs_have_access_test);
   tcase_add_test(testcase, fs_is_nfs_test);
   tcase_add_test(testcase, fs_valid_path_test);
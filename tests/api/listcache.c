@@ -0,0 +1,376 @@
+/*
+ * ProFTPD - FTP server testsuite
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Listing cache API tests */
+
+#include "tests.h"
+
+static pool *p = NULL;
+
+static void set_up(void) {
+  if (p == NULL) {
+    p = session.pool = permanent_pool = make_sub_pool(NULL);
+  }
+
+  init_dirtree();
+  init_netaddr();
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("listcache", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  (void) pr_listcache_free();
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("listcache", 0, 0);
+  }
+
+  if (p) {
+    destroy_pool(p);
+    p = session.pool = permanent_pool = NULL;
+  }
+}
+
+START_TEST (listcache_init_test) {
+  int res;
+
+  fail_unless(pr_listcache_enabled() == FALSE, "Expected cache disabled");
+  fail_unless(pr_listcache_get_max_size() == 0, "Expected zero max size");
+
+  res = pr_listcache_init(0);
+  fail_unless(res < 0, "Initialized cache of zero size unexpectedly");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_listcache_init(1024 * 1024);
+  fail_unless(res == 0, "Failed to initialize cache: %s", strerror(errno));
+  fail_unless(pr_listcache_enabled() == TRUE, "Expected cache enabled");
+  fail_unless(pr_listcache_get_max_size() == 256 * 1024,
+    "Expected max size 262144, got %lu",
+    (unsigned long) pr_listcache_get_max_size());
+
+  res = pr_listcache_free();
+  fail_unless(res == 0, "Failed to free cache: %s", strerror(errno));
+  fail_unless(pr_listcache_enabled() == FALSE, "Expected cache disabled");
+}
+END_TEST
+
+START_TEST (listcache_get_key_test) {
+  const char *key, *key2;
+  struct stat st;
+
+  key = pr_listcache_get_key(NULL, NULL, NULL, NULL, NULL);
+  fail_unless(key == NULL, "Failed to handle null arguments");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  memset(&st, 0, sizeof(st));
+  st.st_ino = 1;
+  st.st_mtime = 1000;
+
+  key = pr_listcache_get_key(p, "LIST", "/tmp", &st, "-l");
+  fail_unless(key != NULL, "Failed to get key: %s", strerror(errno));
+
+  key2 = pr_listcache_get_key(p, "LIST", "/tmp", &st, "-l");
+  fail_unless(key2 != NULL, "Failed to get key: %s", strerror(errno));
+  fail_unless(strcmp(key, key2) == 0, "Expected '%s', got '%s'", key, key2);
+
+  /* Changed options, commands, and directories all use different keys. */
+  key2 = pr_listcache_get_key(p, "LIST", "/tmp", &st, "-la");
+  fail_unless(strcmp(key, key2) != 0, "Expected different keys");
+
+  key2 = pr_listcache_get_key(p, "NLST", "/tmp", &st, "-l");
+  fail_unless(strcmp(key, key2) != 0, "Expected different keys");
+
+  st.st_mtime++;
+  key2 = pr_listcache_get_key(p, "LIST", "/tmp", &st, "-l");
+  fail_unless(strcmp(key, key2) != 0, "Expected different keys");
+  st.st_mtime--;
+
+  /* As does a different user. */
+  session.user = "foo";
+  key2 = pr_listcache_get_key(p, "LIST", "/tmp", &st, "-l");
+  session.user = NULL;
+  fail_unless(strcmp(key, key2) != 0, "Expected different keys");
+
+  /* And a different client address, for Allow/Deny from rules. */
+  session.c = pcalloc(p, sizeof(conn_t));
+  session.c->remote_addr = pr_netaddr_get_addr(p, "127.0.0.1", NULL);
+  fail_unless(session.c->remote_addr != NULL, "Failed to get address: %s",
+    strerror(errno));
+
+  key = pr_listcache_get_key(p, "LIST", "/tmp", &st, "-l");
+  fail_unless(key != NULL, "Failed to get key: %s", strerror(errno));
+
+  session.c->remote_addr = pr_netaddr_get_addr(p, "127.0.0.2", NULL);
+  fail_unless(session.c->remote_addr != NULL, "Failed to get address: %s",
+    strerror(errno));
+
+  key2 = pr_listcache_get_key(p, "LIST", "/tmp", &st, "-l");
+  session.c = NULL;
+  fail_unless(strcmp(key, key2) != 0, "Expected different keys");
+}
+END_TEST
+
+START_TEST (listcache_lookup_test) {
+  int res, engine = TRUE;
+  char *data = NULL;
+  size_t datalen = 0;
+  const char *key = NULL, *listing = "file1\r\nfile2\r\n";
+  struct stat st;
+
+  res = pr_listcache_lookup(p, "LIST", "/tmp", &st, "-l", NULL, &data,
+    &datalen);
+  fail_unless(res < 0, "Failed to handle null key");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  memset(&st, 0, sizeof(st));
+  st.st_ino = 1;
+  st.st_mtime = st.st_ctime = time(NULL) - 5;
+
+  /* Without ListCacheEngine, nothing is cached. */
+  res = pr_listcache_init(128 * 1024);
+  fail_unless(res == 0, "Failed to initialize cache: %s", strerror(errno));
+  fail_unless(pr_listcache_engine_enabled() == FALSE,
+    "Expected ListCacheEngine off");
+
+  res = pr_listcache_lookup(p, "LIST", "/tmp", &st, "-l", &key, &data,
+    &datalen);
+  fail_unless(res < 0, "Looked up listing unexpectedly");
+  fail_unless(errno == EPERM, "Expected EPERM (%d), got %s (%d)", EPERM,
+    strerror(errno), errno);
+  fail_unless(key == NULL, "Expected null key, got '%s'", key);
+
+  (void) add_config_param_set(&(main_server->conf), "ListCacheEngine", 1,
+    &engine);
+  fail_unless(pr_listcache_engine_enabled() == TRUE,
+    "Expected ListCacheEngine on");
+
+  /* A miss returns the key for adding the rendered listing. */
+  res = pr_listcache_lookup(p, "LIST", "/tmp", &st, "-l", &key, &data,
+    &datalen);
+  fail_unless(res < 0, "Looked up listing unexpectedly");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+  fail_unless(key != NULL, "Expected key");
+
+  res = pr_listcache_add(key, listing, strlen(listing));
+  fail_unless(res == 0, "Failed to add listing: %s", strerror(errno));
+
+  key = NULL;
+  res = pr_listcache_lookup(p, "LIST", "/tmp", &st, "-l", &key, &data,
+    &datalen);
+  fail_unless(res == 0, "Failed to look up listing: %s", strerror(errno));
+  fail_unless(datalen == strlen(listing), "Expected %lu bytes, got %lu",
+    (unsigned long) strlen(listing), (unsigned long) datalen);
+  fail_unless(strncmp(data, listing, datalen) == 0, "Expected '%s', got '%s'",
+    listing, data);
+
+  /* Directories changed within the current second are not cached. */
+  st.st_mtime = time(NULL);
+  res = pr_listcache_lookup(p, "LIST", "/tmp", &st, "-l", &key, &data,
+    &datalen);
+  fail_unless(res < 0, "Looked up listing unexpectedly");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+  fail_unless(key == NULL, "Expected null key, got '%s'", key);
+
+  main_server->conf = NULL;
+}
+END_TEST
+
+START_TEST (listcache_add_get_test) {
+  int res;
+  char *data = NULL, big[64 * 1024];
+  size_t datalen = 0;
+  const char *key, *listing = "file1\r\nfile2\r\n";
+
+  key = "LIST\n/tmp\n";
+
+  res = pr_listcache_add(key, listing, strlen(listing));
+  fail_unless(res < 0, "Added listing to unallocated cache unexpectedly");
+  fail_unless(errno == EPERM, "Expected EPERM (%d), got %s (%d)", EPERM,
+    strerror(errno), errno);
+
+  res = pr_listcache_init(128 * 1024);
+  fail_unless(res == 0, "Failed to initialize cache: %s", strerror(errno));
+
+  res = pr_listcache_get(p, key, 0, &data, &datalen);
+  fail_unless(res < 0, "Found listing in empty cache unexpectedly");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  res = pr_listcache_add(key, listing, strlen(listing));
+  fail_unless(res == 0, "Failed to add listing: %s", strerror(errno));
+
+  res = pr_listcache_get(p, key, 30, &data, &datalen);
+  fail_unless(res == 0, "Failed to get listing: %s", strerror(errno));
+  fail_unless(datalen == strlen(listing), "Expected %lu bytes, got %lu",
+    (unsigned long) strlen(listing), (unsigned long) datalen);
+  fail_unless(memcmp(data, listing, datalen) == 0,
+    "Expected '%s', got '%.*s'", listing, (int) datalen, data);
+
+  res = pr_listcache_get(p, "LIST\n/var\n", 0, &data, &datalen);
+  fail_unless(res < 0, "Found listing for other key unexpectedly");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  /* Empty listings can be cached, too. */
+  res = pr_listcache_add("NLST\n/empty\n", NULL, 0);
+  fail_unless(res == 0, "Failed to add empty listing: %s", strerror(errno));
+
+  res = pr_listcache_get(p, "NLST\n/empty\n", 0, &data, &datalen);
+  fail_unless(res == 0, "Failed to get empty listing: %s", strerror(errno));
+  fail_unless(datalen == 0, "Expected 0 bytes, got %lu",
+    (unsigned long) datalen);
+
+  /* Listings larger than the max size are not cached. */
+  memset(big, 'A', sizeof(big));
+  res = pr_listcache_add(key, big, sizeof(big));
+  fail_unless(res < 0, "Added too-large listing unexpectedly");
+  fail_unless(errno == EFBIG, "Expected EFBIG (%d), got %s (%d)", EFBIG,
+    strerror(errno), errno);
+
+  res = pr_listcache_clear();
+  fail_unless(res == 0, "Failed to clear cache: %s", strerror(errno));
+
+  res = pr_listcache_get(p, key, 0, &data, &datalen);
+  fail_unless(res < 0, "Found listing in cleared cache unexpectedly");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+}
+END_TEST
+
+START_TEST (listcache_append_test) {
+  register unsigned int i;
+  int res;
+  pr_listcache_buf_t buf;
+  const char *line = "-rw-r--r--   1 ftp  ftp  1024 Jan 01 00:00 file\r\n";
+  size_t linelen;
+
+  memset(&buf, 0, sizeof(buf));
+  linelen = strlen(line);
+
+  res = pr_listcache_append(NULL, NULL, NULL, 0);
+  fail_unless(res < 0, "Failed to handle null arguments");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_listcache_append(p, &buf, line, linelen);
+  fail_unless(res < 0, "Appended with unallocated cache unexpectedly");
+  fail_unless(errno == EFBIG, "Expected EFBIG (%d), got %s (%d)", EFBIG,
+    strerror(errno), errno);
+
+  res = pr_listcache_init(128 * 1024);
+  fail_unless(res == 0, "Failed to initialize cache: %s", strerror(errno));
+
+  /* Grow the buffer through a few reallocations. */
+  for (i = 0; i < 300; i++) {
+    res = pr_listcache_append(p, &buf, line, linelen);
+    fail_unless(res == 0, "Failed to append line %u: %s", i, strerror(errno));
+  }
+
+  fail_unless(buf.datalen == 300 * linelen, "Expected %lu bytes, got %lu",
+    (unsigned long) (300 * linelen), (unsigned long) buf.datalen);
+  fail_unless(buf.datasz >= buf.datalen, "Expected buffer of at least %lu "
+    "bytes, got %lu", (unsigned long) buf.datalen, (unsigned long) buf.datasz);
+  fail_unless(memcmp(buf.data + (299 * linelen), line, linelen) == 0,
+    "Expected last line '%s', got '%.*s'", line, (int) linelen,
+    buf.data + (299 * linelen));
+
+  /* Listings larger than the max size are not captured. */
+  res = 0;
+  while (res == 0) {
+    res = pr_listcache_append(p, &buf, line, linelen);
+  }
+
+  fail_unless(errno == EFBIG, "Expected EFBIG (%d), got %s (%d)", EFBIG,
+    strerror(errno), errno);
+  fail_unless(buf.datalen <= pr_listcache_get_max_size(),
+    "Captured %lu bytes, more than max %lu", (unsigned long) buf.datalen,
+    (unsigned long) pr_listcache_get_max_size());
+}
+END_TEST
+
+START_TEST (listcache_add_wrap_test) {
+  register unsigned int i;
+  int res;
+  char *data = NULL, buf[16 * 1024], key[64];
+  size_t datalen = 0;
+
+  res = pr_listcache_init(128 * 1024);
+  fail_unless(res == 0, "Failed to initialize cache: %s", strerror(errno));
+
+  /* Add enough listings to go around the ring a few times; the most recent
+   * listings are kept, and the oldest are overwritten.
+   */
+  for (i = 0; i < 32; i++) {
+    memset(buf, 'a' + (i % 26), sizeof(buf));
+    pr_snprintf(key, sizeof(key), "LIST\n/dir%u\n", i);
+
+    res = pr_listcache_add(key, buf, sizeof(buf));
+    fail_unless(res == 0, "Failed to add listing %u: %s", i, strerror(errno));
+  }
+
+  pr_snprintf(key, sizeof(key), "LIST\n/dir%u\n", 0);
+  res = pr_listcache_get(p, key, 0, &data, &datalen);
+  fail_unless(res < 0, "Found overwritten listing unexpectedly");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  for (i = 28; i < 32; i++) {
+    pr_snprintf(key, sizeof(key), "LIST\n/dir%u\n", i);
+
+    res = pr_listcache_get(p, key, 0, &data, &datalen);
+    fail_unless(res == 0, "Failed to get listing %u: %s", i, strerror(errno));
+    fail_unless(datalen == sizeof(buf), "Expected %lu bytes, got %lu",
+      (unsigned long) sizeof(buf), (unsigned long) datalen);
+    fail_unless(data[0] == 'a' + (i % 26) &&
+      data[datalen-1] == 'a' + (i % 26), "Wrong data for listing %u", i);
+  }
+}
+END_TEST
+
+Suite *tests_get_listcache_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("listcache");
+  testcase = tcase_create("base");
+
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, listcache_init_test);
+  tcase_add_test(testcase, listcache_get_key_test);
+  tcase_add_test(testcase, listcache_lookup_test);
+  tcase_add_test(testcase, listcache_add_get_test);
+  tcase_add_test(testcase, listcache_append_test);
+  tcase_add_test(testcase, listcache_add_wrap_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
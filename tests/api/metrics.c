@@ -0,0 +1,233 @@
+/*
+ * ProFTPD - FTP server testsuite
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Metrics API tests */
+
+#include "tests.h"
+
+static pool *p = NULL;
+
+static void set_up(void) {
+  if (p == NULL) {
+    p = permanent_pool = make_sub_pool(NULL);
+  }
+
+  ServerType = SERVER_INETD;
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("metrics", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  (void) pr_metrics_unregister(NULL, NULL);
+  ServerType = SERVER_STANDALONE;
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("metrics", 0, 0);
+  }
+
+  if (p) {
+    destroy_pool(p);
+    p = permanent_pool = NULL;
+  }
+}
+
+static int metrics_test_cb(pr_metrics_t *metrics, void *user_data) {
+  pr_metrics_add_family(metrics, "test_requests", PR_METRICS_TYPE_COUNTER,
+    "Test \"requests\"");
+  pr_metrics_add_sample(metrics, "test_requests_total", 7.0,
+    "path", "/a\"b\\c", NULL);
+  return 0;
+}
+
+static int metrics_histo_cb(pr_metrics_t *metrics, void *user_data) {
+  pr_stats_histo_t *histo = user_data;
+
+  pr_metrics_add_family(metrics, "test_latency_seconds",
+    PR_METRICS_TYPE_HISTOGRAM, NULL);
+  pr_metrics_add_histogram(metrics, "test_latency_seconds", histo,
+    "command", "RETR", NULL);
+  return 0;
+}
+
+static int metrics_bad_family_cb(pr_metrics_t *metrics, void *user_data) {
+  int *res = user_data;
+
+  *res = pr_metrics_add_family(metrics, "test_bad", -1, NULL);
+  return 0;
+}
+
+START_TEST (metrics_register_test) {
+  int res;
+
+  res = pr_metrics_register(NULL, NULL, NULL, NULL);
+  fail_unless(res < 0, "Failed to handle null arguments");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_metrics_register(NULL, "test", NULL, NULL);
+  fail_unless(res < 0, "Failed to handle null callback");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_metrics_register(NULL, "test", metrics_test_cb, NULL);
+  fail_unless(res == 0, "Failed to register collector: %s", strerror(errno));
+
+  res = pr_metrics_register(NULL, "test", metrics_test_cb, NULL);
+  fail_unless(res < 0, "Failed to handle duplicate collector");
+  fail_unless(errno == EEXIST, "Expected EEXIST (%d), got %s (%d)", EEXIST,
+    strerror(errno), errno);
+
+  res = pr_metrics_unregister(NULL, "test");
+  fail_unless(res == 0, "Failed to unregister collector: %s", strerror(errno));
+
+  res = pr_metrics_unregister(NULL, "test");
+  fail_unless(res < 0, "Failed to handle unregistered collector");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+}
+END_TEST
+
+START_TEST (metrics_render_test) {
+  int res, family_res = 0;
+  char *text = NULL;
+  size_t textlen = 0;
+
+  res = pr_metrics_render(NULL, NULL, NULL);
+  fail_unless(res < 0, "Failed to handle null arguments");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_metrics_register(NULL, "test", metrics_test_cb, NULL);
+  fail_unless(res == 0, "Failed to register collector: %s", strerror(errno));
+
+  res = pr_metrics_register(NULL, "bad", metrics_bad_family_cb, &family_res);
+  fail_unless(res == 0, "Failed to register collector: %s", strerror(errno));
+
+  res = pr_metrics_render(p, &text, &textlen);
+  fail_unless(res == 0, "Failed to render metrics: %s", strerror(errno));
+  fail_unless(text != NULL, "Expected metrics text");
+  fail_unless(strlen(text) == textlen, "Expected length %lu, got %lu",
+    (unsigned long) strlen(text), (unsigned long) textlen);
+
+  fail_unless(strstr(text, "proftpd_build_info{version=\"") != NULL,
+    "Missing build info in '%s'", text);
+  fail_unless(strstr(text, "# TYPE test_requests counter\n") != NULL,
+    "Missing TYPE in '%s'", text);
+  fail_unless(strstr(text, "# HELP test_requests Test \"requests\"\n") != NULL,
+    "Missing HELP in '%s'", text);
+  fail_unless(
+    strstr(text, "test_requests_total{path=\"/a\\\"b\\\\c\"} 7\n") != NULL,
+    "Missing escaped sample in '%s'", text);
+  fail_unless(strstr(text, "test_bad") == NULL,
+    "Unexpected invalid family in '%s'", text);
+  fail_unless(textlen >= 6 && strcmp(text + textlen - 6, "# EOF\n") == 0,
+    "Expected '# EOF' terminator in '%s'", text);
+
+  fail_unless(family_res < 0, "Failed to handle invalid family type");
+}
+END_TEST
+
+START_TEST (metrics_render_histogram_test) {
+  int res;
+  char *text = NULL;
+  size_t textlen = 0;
+  pr_stats_histo_t histo;
+
+  /* Two latencies below 4 usecs, and one over the last bucket. */
+  memset(&histo, 0, sizeof(histo));
+  histo.buckets[2] = 2;
+  histo.buckets[PR_STATS_HISTO_NBUCKETS-1] = 1;
+  histo.count = 3;
+  histo.total_usecs = 1500000;
+
+  res = pr_metrics_register(NULL, "histo", metrics_histo_cb, &histo);
+  fail_unless(res == 0, "Failed to register collector: %s", strerror(errno));
+
+  res = pr_metrics_render(p, &text, &textlen);
+  fail_unless(res == 0, "Failed to render metrics: %s", strerror(errno));
+
+  fail_unless(strstr(text, "# TYPE test_latency_seconds histogram\n") != NULL,
+    "Missing TYPE in '%s'", text);
+  fail_unless(strstr(text,
+    "test_latency_seconds_bucket{command=\"RETR\",le=\"2e-06\"} 0\n") != NULL,
+    "Missing empty bucket in '%s'", text);
+  fail_unless(strstr(text,
+    "test_latency_seconds_bucket{command=\"RETR\",le=\"4e-06\"} 2\n") != NULL,
+    "Missing cumulative bucket in '%s'", text);
+  fail_unless(strstr(text,
+    "test_latency_seconds_bucket{command=\"RETR\",le=\"+Inf\"} 3\n") != NULL,
+    "Missing +Inf bucket in '%s'", text);
+  fail_unless(strstr(text,
+    "test_latency_seconds_count{command=\"RETR\"} 3\n") != NULL,
+    "Missing count in '%s'", text);
+  fail_unless(strstr(text,
+    "test_latency_seconds_sum{command=\"RETR\"} 1.5\n") != NULL,
+    "Missing sum in '%s'", text);
+}
+END_TEST
+
+START_TEST (metrics_listen_test) {
+  int res;
+
+  res = pr_metrics_listen(NULL);
+  fail_unless(res < 0, "Failed to handle null address");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_metrics_listen("foo");
+  fail_unless(res < 0, "Failed to handle invalid address");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  /* Only loopback addresses are allowed. */
+  res = pr_metrics_listen("192.0.2.1:9273");
+  fail_unless(res < 0, "Failed to handle non-loopback address");
+  fail_unless(errno == EPERM, "Expected EPERM (%d), got %s (%d)", EPERM,
+    strerror(errno), errno);
+
+  res = pr_metrics_close();
+  fail_unless(res == 0, "Failed to close metrics listener: %s",
+    strerror(errno));
+}
+END_TEST
+
+Suite *tests_get_metrics_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("metrics");
+  testcase = tcase_create("base");
+
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, metrics_register_test);
+  tcase_add_test(testcase, metrics_render_test);
+  tcase_add_test(testcase, metrics_render_histogram_test);
+  tcase_add_test(testcase, metrics_listen_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
@@ -879,6 +879,372 @@ START_TEST (scoreboard_entry_update_test) {
 }
 END_TEST
 
+START_TEST (scoreboard_entry_update_deferred_test) {
+  int fd, res;
+  pid_t pid = getpid();
+  pr_scoreboard_entry_t sce;
+  ssize_t len;
+  off_t xfer_len;
+
+  res = mkdir(test_dir, 0775);
+  fail_unless(res == 0, "Failed to create directory '%s': %s", test_dir,
+    strerror(errno));
+
+  res = chmod(test_dir, 0775);
+  fail_unless(res == 0, "Failed to set perms on '%s' to 0775': %s", test_dir,
+    strerror(errno));
+
+  res = pr_set_scoreboard(test_file);
+  fail_unless(res == 0, "Failed to set scoreboard to '%s': %s", test_file,
+    strerror(errno));
+
+  res = pr_scoreboard_entry_update_deferred(pid, 0);
+  fail_unless(res < 0, "Unexpectedly updated scoreboard entry");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = pr_open_scoreboard(O_RDWR);
+  fail_unless(res == 0, "Failed to open scoreboard: %s", strerror(errno));
+
+  res = pr_scoreboard_entry_update_deferred(pid, 0);
+  fail_unless(res < 0, "Unexpectedly updated scoreboard entry");
+  fail_unless(errno == EPERM, "Expected EPERM (%d), got %s (%d)", EPERM,
+    strerror(errno), errno);
+
+  res = pr_scoreboard_entry_add();
+  fail_unless(res == 0, "Failed to add entry to scoreboard: %s",
+    strerror(errno));
+
+  xfer_len = 1;
+  res = pr_scoreboard_entry_update(pid, PR_SCORE_XFER_LEN, xfer_len, NULL);
+  fail_unless(res == 0, "Failed to update PR_SCORE_XFER_LEN: %s",
+    strerror(errno));
+
+  /* Coming right after the previous write, this change should be held
+   * back until flushed.
+   */
+  xfer_len = 2;
+  res = pr_scoreboard_entry_update_deferred(pid, PR_SCORE_XFER_LEN, xfer_len,
+    NULL);
+  fail_unless(res == 0, "Failed to update PR_SCORE_XFER_LEN: %s",
+    strerror(errno));
+
+  fd = open(test_file, O_RDONLY);
+  fail_unless(fd >= 0, "Failed to open '%s': %s", test_file, strerror(errno));
+
+  len = pread(fd, &sce, sizeof(sce), sizeof(pr_scoreboard_header_t));
+  fail_unless(len == sizeof(sce), "Failed to read scoreboard entry: %s",
+    strerror(errno));
+  fail_unless(sce.sce_xfer_len == 1, "Expected xfer len 1, got %" PR_LU,
+    (pr_off_t) sce.sce_xfer_len);
+
+  res = pr_scoreboard_entry_flush();
+  fail_unless(res == 0, "Failed to flush scoreboard entry: %s",
+    strerror(errno));
+
+  len = pread(fd, &sce, sizeof(sce), sizeof(pr_scoreboard_header_t));
+  (void) close(fd);
+  fail_unless(len == sizeof(sce), "Failed to read scoreboard entry: %s",
+    strerror(errno));
+  fail_unless(sce.sce_xfer_len == 2, "Expected xfer len 2, got %" PR_LU,
+    (pr_off_t) sce.sce_xfer_len);
+
+  /* Nothing is pending now. */
+  res = pr_scoreboard_entry_flush();
+  fail_unless(res == 0, "Failed to flush scoreboard entry: %s",
+    strerror(errno));
+
+  res = pr_scoreboard_entry_del(FALSE);
+  fail_unless(res == 0, "Failed to delete entry from scoreboard: %s",
+    strerror(errno));
+
+  (void) unlink(test_mutex);
+  (void) unlink(test_file);
+  (void) rmdir(test_dir);
+}
+END_TEST
+
+START_TEST (scoreboard_entry_shared_test) {
+  int fd, res, status;
+  pid_t child_pid;
+  pr_scoreboard_entry_t *score, sce;
+  ssize_t len;
+  struct stat st;
+
+  res = mkdir(test_dir, 0775);
+  fail_unless(res == 0, "Failed to create directory '%s': %s", test_dir,
+    strerror(errno));
+
+  res = chmod(test_dir, 0775);
+  fail_unless(res == 0, "Failed to set perms on '%s' to 0775': %s", test_dir,
+    strerror(errno));
+
+  res = pr_set_scoreboard(test_file);
+  fail_unless(res == 0, "Failed to set scoreboard to '%s': %s", test_file,
+    strerror(errno));
+
+  res = pr_open_scoreboard(O_RDWR);
+  fail_unless(res == 0, "Failed to open scoreboard: %s", strerror(errno));
+
+  /* Have another process add, and update, its own entry. */
+  child_pid = fork();
+  fail_unless(child_pid >= 0, "Failed to fork: %s", strerror(errno));
+
+  if (child_pid == 0) {
+    if (pr_open_scoreboard(O_RDWR) < 0 ||
+        pr_scoreboard_entry_add() < 0 ||
+        pr_scoreboard_entry_update(getpid(), PR_SCORE_USER, "child",
+          PR_SCORE_CMD, "%s", "RETR", NULL, NULL) < 0) {
+      _exit(1);
+    }
+
+    _exit(0);
+  }
+
+  res = waitpid(child_pid, &status, 0);
+  fail_unless(res == child_pid, "Failed to wait for child: %s",
+    strerror(errno));
+  fail_unless(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+    "Child failed to add scoreboard entry");
+
+  res = pr_rewind_scoreboard();
+  fail_unless(res == 0, "Failed to rewind scoreboard: %s", strerror(errno));
+
+  score = pr_scoreboard_entry_read();
+  fail_unless(score != NULL, "Failed to read scoreboard entry: %s",
+    strerror(errno));
+  fail_unless(score->sce_pid == child_pid, "Expected PID %lu, got %lu",
+    (unsigned long) child_pid, (unsigned long) score->sce_pid);
+  fail_unless(strcmp(score->sce_user, "child") == 0,
+    "Expected user 'child', got '%s'", score->sce_user);
+  fail_unless(strcmp(score->sce_cmd, "RETR") == 0,
+    "Expected command 'RETR', got '%s'", score->sce_cmd);
+
+  score = pr_scoreboard_entry_read();
+  fail_unless(score == NULL, "Unexpectedly read scoreboard entry");
+
+  /* Entries added later are seen on the next read. */
+  res = pr_scoreboard_entry_add();
+  fail_unless(res == 0, "Failed to add entry to scoreboard: %s",
+    strerror(errno));
+
+  res = pr_scoreboard_entry_update(getpid(), PR_SCORE_USER, "parent", NULL);
+  fail_unless(res == 0, "Failed to update PR_SCORE_USER: %s", strerror(errno));
+
+  score = pr_scoreboard_entry_read();
+  fail_unless(score != NULL, "Failed to read scoreboard entry: %s",
+    strerror(errno));
+  fail_unless(strcmp(score->sce_user, "parent") == 0,
+    "Expected user 'parent', got '%s'", score->sce_user);
+
+  /* The file itself must still be readable the old-fashioned way. */
+  res = stat(test_file, &st);
+  fail_unless(res == 0, "Failed to stat '%s': %s", test_file, strerror(errno));
+  fail_unless(st.st_size == (off_t) (sizeof(pr_scoreboard_header_t) +
+    (2 * sizeof(pr_scoreboard_entry_t))), "Unexpected scoreboard size %lu",
+    (unsigned long) st.st_size);
+
+  fd = open(test_file, O_RDONLY);
+  fail_unless(fd >= 0, "Failed to open '%s': %s", test_file, strerror(errno));
+
+  len = pread(fd, &sce, sizeof(sce), sizeof(pr_scoreboard_header_t));
+  (void) close(fd);
+  fail_unless(len == sizeof(sce), "Failed to read scoreboard entry: %s",
+    strerror(errno));
+  fail_unless(sce.sce_pid == child_pid, "Expected PID %lu, got %lu",
+    (unsigned long) child_pid, (unsigned long) sce.sce_pid);
+  fail_unless(strcmp(sce.sce_user, "child") == 0,
+    "Expected user 'child', got '%s'", sce.sce_user);
+
+  /* The child is gone; scrubbing should remove its entry, but not ours. */
+  res = pr_scoreboard_scrub();
+  fail_unless(res == 0, "Failed to scrub scoreboard: %s", strerror(errno));
+
+  res = pr_rewind_scoreboard();
+  fail_unless(res == 0, "Failed to rewind scoreboard: %s", strerror(errno));
+
+  score = pr_scoreboard_entry_read();
+  fail_unless(score != NULL, "Failed to read scoreboard entry: %s",
+    strerror(errno));
+  fail_unless(score->sce_pid == getpid(), "Expected PID %lu, got %lu",
+    (unsigned long) getpid(), (unsigned long) score->sce_pid);
+
+  score = pr_scoreboard_entry_read();
+  fail_unless(score == NULL, "Unexpectedly read scoreboard entry");
+
+  res = pr_scoreboard_entry_del(FALSE);
+  fail_unless(res == 0, "Failed to delete entry from scoreboard: %s",
+    strerror(errno));
+
+  (void) unlink(test_mutex);
+  (void) unlink(test_file);
+  (void) rmdir(test_dir);
+}
+END_TEST
+
+START_TEST (scoreboard_get_count_test) {
+  int res, status;
+  unsigned int count;
+  pid_t child_pid;
+  const pr_netaddr_t *addr;
+  const char *server_addr = "127.0.0.1:21", *client_addr = "127.0.0.1";
+
+  res = pr_scoreboard_get_count(PR_SCORE_COUNT_SERVER, NULL, NULL, NULL,
+    &count);
+  fail_unless(res < 0, "Failed to handle null server address");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = mkdir(test_dir, 0775);
+  fail_unless(res == 0, "Failed to create directory '%s': %s", test_dir,
+    strerror(errno));
+
+  res = chmod(test_dir, 0775);
+  fail_unless(res == 0, "Failed to set perms on '%s' to 0775': %s", test_dir,
+    strerror(errno));
+
+  res = pr_set_scoreboard(test_file);
+  fail_unless(res == 0, "Failed to set scoreboard to '%s': %s", test_file,
+    strerror(errno));
+
+  res = pr_open_scoreboard(O_RDWR);
+  fail_unless(res == 0, "Failed to open scoreboard: %s", strerror(errno));
+
+  res = init_scoreboard_counters();
+  fail_unless(res == 0, "Failed to init scoreboard counters: %s",
+    strerror(errno));
+
+  addr = pr_netaddr_get_addr(p, "127.0.0.1", NULL);
+  fail_unless(addr != NULL, "Failed to resolve '127.0.0.1': %s",
+    strerror(errno));
+
+  /* Have another process add an entry, then exit without removing it. */
+  child_pid = fork();
+  fail_unless(child_pid >= 0, "Failed to fork: %s", strerror(errno));
+
+  if (child_pid == 0) {
+    if (pr_open_scoreboard(O_RDWR) < 0 ||
+        pr_scoreboard_entry_add() < 0 ||
+        pr_scoreboard_entry_update(getpid(),
+          PR_SCORE_USER, "bob",
+          PR_SCORE_SERVER_ADDR, addr, 21,
+          PR_SCORE_CLIENT_ADDR, addr,
+          NULL) < 0) {
+      _exit(1);
+    }
+
+    _exit(0);
+  }
+
+  res = waitpid(child_pid, &status, 0);
+  fail_unless(res == child_pid, "Failed to wait for child: %s",
+    strerror(errno));
+  fail_unless(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+    "Child failed to add scoreboard entry");
+
+  res = pr_scoreboard_get_count(PR_SCORE_COUNT_HOST, server_addr, client_addr,
+    NULL, &count);
+  fail_unless(res == 0, "Failed to get host count: %s", strerror(errno));
+  fail_unless(count == 1, "Expected host count 1, got %u", count);
+
+  /* Scrubbing the dead child's entry should remove it from the counts. */
+  res = pr_scoreboard_scrub();
+  fail_unless(res == 0, "Failed to scrub scoreboard: %s", strerror(errno));
+
+  res = pr_scoreboard_get_count(PR_SCORE_COUNT_HOST, server_addr, client_addr,
+    NULL, &count);
+  fail_unless(res == 0, "Failed to get host count: %s", strerror(errno));
+  fail_unless(count == 0, "Expected host count 0, got %u", count);
+
+  res = pr_scoreboard_get_count(PR_SCORE_COUNT_USER, server_addr, "bob",
+    NULL, &count);
+  fail_unless(res == 0, "Failed to get user count: %s", strerror(errno));
+  fail_unless(count == 0, "Expected user count 0, got %u", count);
+
+  res = pr_scoreboard_entry_add();
+  fail_unless(res == 0, "Failed to add entry to scoreboard: %s",
+    strerror(errno));
+
+  res = pr_scoreboard_entry_update(getpid(),
+    PR_SCORE_USER, "(none)",
+    PR_SCORE_SERVER_ADDR, addr, 21,
+    PR_SCORE_CLIENT_ADDR, addr,
+    PR_SCORE_CLASS, "Staff",
+    NULL);
+  fail_unless(res == 0, "Failed to update scoreboard entry: %s",
+    strerror(errno));
+
+  res = pr_scoreboard_get_count(PR_SCORE_COUNT_SERVER, server_addr, NULL,
+    NULL, &count);
+  fail_unless(res == 0, "Failed to get server count: %s", strerror(errno));
+  fail_unless(count == 1, "Expected server count 1, got %u", count);
+
+  res = pr_scoreboard_get_count(PR_SCORE_COUNT_SERVER|PR_SCORE_COUNT_FL_AUTH,
+    server_addr, NULL, NULL, &count);
+  fail_unless(res == 0, "Failed to get server count: %s", strerror(errno));
+  fail_unless(count == 0, "Expected authenticated server count 0, got %u",
+    count);
+
+  res = pr_scoreboard_get_count(PR_SCORE_COUNT_HOST, server_addr, client_addr,
+    NULL, &count);
+  fail_unless(res == 0, "Failed to get host count: %s", strerror(errno));
+  fail_unless(count == 1, "Expected host count 1, got %u", count);
+
+  /* Classes are compared case-insensitively. */
+  res = pr_scoreboard_get_count(PR_SCORE_COUNT_CLASS, server_addr, "staff",
+    NULL, &count);
+  fail_unless(res == 0, "Failed to get class count: %s", strerror(errno));
+  fail_unless(count == 1, "Expected class count 1, got %u", count);
+
+  res = pr_scoreboard_entry_update(getpid(), PR_SCORE_USER, "alice", NULL);
+  fail_unless(res == 0, "Failed to update PR_SCORE_USER: %s", strerror(errno));
+
+  res = pr_scoreboard_entry_update(getpid(), PR_SCORE_CMD, "%s", "RETR", NULL,
+    NULL);
+  fail_unless(res == 0, "Failed to update PR_SCORE_CMD: %s", strerror(errno));
+
+  res = pr_scoreboard_get_count(PR_SCORE_COUNT_SERVER|PR_SCORE_COUNT_FL_AUTH,
+    server_addr, NULL, NULL, &count);
+  fail_unless(res == 0, "Failed to get server count: %s", strerror(errno));
+  fail_unless(count == 1, "Expected authenticated server count 1, got %u",
+    count);
+
+  res = pr_scoreboard_get_count(PR_SCORE_COUNT_USER_HOST, server_addr,
+    "alice", client_addr, &count);
+  fail_unless(res == 0, "Failed to get user host count: %s", strerror(errno));
+  fail_unless(count == 1, "Expected user host count 1, got %u", count);
+
+  res = pr_scoreboard_get_count(PR_SCORE_COUNT_HOST_CMD, server_addr,
+    client_addr, "RETR", &count);
+  fail_unless(res == 0, "Failed to get host command count: %s",
+    strerror(errno));
+  fail_unless(count == 1, "Expected host command count 1, got %u", count);
+
+  res = pr_scoreboard_entry_update(getpid(), PR_SCORE_CMD, "%s", "STOR", NULL,
+    NULL);
+  fail_unless(res == 0, "Failed to update PR_SCORE_CMD: %s", strerror(errno));
+
+  res = pr_scoreboard_get_count(PR_SCORE_COUNT_USER_CMD, server_addr,
+    "alice", "RETR", &count);
+  fail_unless(res == 0, "Failed to get user command count: %s",
+    strerror(errno));
+  fail_unless(count == 0, "Expected user command count 0, got %u", count);
+
+  res = pr_scoreboard_entry_del(FALSE);
+  fail_unless(res == 0, "Failed to delete entry from scoreboard: %s",
+    strerror(errno));
+
+  res = pr_scoreboard_get_count(PR_SCORE_COUNT_SERVER, server_addr, NULL,
+    NULL, &count);
+  fail_unless(res == 0, "Failed to get server count: %s", strerror(errno));
+  fail_unless(count == 0, "Expected server count 0, got %u", count);
+
+  (void) unlink(test_mutex);
+  (void) unlink(test_file);
+  (void) rmdir(test_dir);
+}
+END_TEST
+
 START_TEST (scoreboard_entry_kill_test) {
   int res;
   pr_scoreboard_entry_t sce;
@@ -1046,6 +1412,9 @@ Suite *tests_get_scoreboard_suite(void) {
   tcase_add_test(testcase, scoreboard_entry_read_test);
   tcase_add_test(testcase, scoreboard_entry_get_test);
   tcase_add_test(testcase, scoreboard_entry_update_test);
+  tcase_add_test(testcase, scoreboard_entry_update_deferred_test);
+  tcase_add_test(testcase, scoreboard_entry_shared_test);
+  tcase_add_test(testcase, scoreboard_get_count_test);
   tcase_add_test(testcase, scoreboard_entry_kill_test);
   tcase_add_test(testcase, scoreboard_entry_lock_test);
   tcase_add_test(testcase, scoreboard_disabled_test);
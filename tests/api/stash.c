@@ -34,9 +34,17 @@ static void set_up(void) {
   }
 
   init_stash();
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("stash", 1, 20);
+  }
 }
 
 static void tear_down(void) {
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("stash", 0, 0);
+  }
+
   if (p) {
     destroy_pool(p);
     p = permanent_pool = NULL;
@@ -533,6 +541,203 @@ START_TEST (stash_remove_cmd_test) {
 }
 END_TEST
 
+START_TEST (stash_get_cmd_handlers_test) {
+  int res;
+  cmdtable **handlers;
+  cmdtable cmdtab, cmdtab2, cmdtab3;
+  module m, m2;
+
+  handlers = pr_stash_get_cmd_handlers(NULL, 0, CMD);
+  fail_unless(handlers == NULL, "Failed to handle null name");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  handlers = pr_stash_get_cmd_handlers("FOO", 0, HOOK);
+  fail_unless(handlers == NULL, "Failed to handle HOOK cmd_type");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  handlers = pr_stash_get_cmd_handlers("FOO", 0, CMD);
+  fail_unless(handlers != NULL, "Failed to get handlers: %s", strerror(errno));
+  fail_unless(handlers[0] == NULL, "Expected no handlers for FOO");
+
+  /* Handlers from higher priority modules are dispatched first. */
+  memset(&m, 0, sizeof(m));
+  m.name = "low";
+  m.priority = 1;
+
+  memset(&m2, 0, sizeof(m2));
+  m2.name = "high";
+  m2.priority = 2;
+
+  memset(&cmdtab, 0, sizeof(cmdtab));
+  cmdtab.command = C_PWD;
+  cmdtab.cmd_type = CMD;
+  cmdtab.m = &m;
+  res = pr_stash_add_symbol(PR_SYM_CMD, &cmdtab);
+  fail_unless(res == 0, "Failed to add CMD symbol: %s", strerror(errno));
+
+  memset(&cmdtab2, 0, sizeof(cmdtab2));
+  cmdtab2.command = C_PWD;
+  cmdtab2.cmd_type = PRE_CMD;
+  cmdtab2.m = &m;
+  res = pr_stash_add_symbol(PR_SYM_CMD, &cmdtab2);
+  fail_unless(res == 0, "Failed to add CMD symbol: %s", strerror(errno));
+
+  handlers = pr_stash_get_cmd_handlers(C_PWD, PR_CMD_PWD_ID, CMD);
+  fail_unless(handlers != NULL, "Failed to get handlers: %s", strerror(errno));
+  fail_unless(handlers[0] == &cmdtab, "Expected %p, got %p", &cmdtab,
+    handlers[0]);
+  fail_unless(handlers[1] == NULL, "Expected only one CMD handler");
+
+  handlers = pr_stash_get_cmd_handlers(C_PWD, PR_CMD_PWD_ID, PRE_CMD);
+  fail_unless(handlers != NULL, "Failed to get handlers: %s", strerror(errno));
+  fail_unless(handlers[0] == &cmdtab2, "Expected %p, got %p", &cmdtab2,
+    handlers[0]);
+  fail_unless(handlers[1] == NULL, "Expected only one PRE_CMD handler");
+
+  handlers = pr_stash_get_cmd_handlers(C_PWD, PR_CMD_PWD_ID, POST_CMD);
+  fail_unless(handlers != NULL, "Failed to get handlers: %s", strerror(errno));
+  fail_unless(handlers[0] == NULL, "Expected no POST_CMD handlers");
+
+  /* Adding a symbol must be reflected in subsequent lookups. */
+  mark_point();
+  memset(&cmdtab3, 0, sizeof(cmdtab3));
+  cmdtab3.command = C_PWD;
+  cmdtab3.cmd_type = CMD;
+  cmdtab3.m = &m2;
+  res = pr_stash_add_symbol(PR_SYM_CMD, &cmdtab3);
+  fail_unless(res == 0, "Failed to add CMD symbol: %s", strerror(errno));
+
+  handlers = pr_stash_get_cmd_handlers(C_PWD, PR_CMD_PWD_ID, CMD);
+  fail_unless(handlers != NULL, "Failed to get handlers: %s", strerror(errno));
+  fail_unless(handlers[0] == &cmdtab3, "Expected %p, got %p", &cmdtab3,
+    handlers[0]);
+  fail_unless(handlers[1] == &cmdtab, "Expected %p, got %p", &cmdtab,
+    handlers[1]);
+  fail_unless(handlers[2] == NULL, "Expected only two CMD handlers");
+
+  /* A mismatched cmd ID must not return another command's handlers. */
+  handlers = pr_stash_get_cmd_handlers(C_XPWD, PR_CMD_PWD_ID, CMD);
+  fail_unless(handlers != NULL, "Failed to get handlers: %s", strerror(errno));
+  fail_unless(handlers[0] == NULL, "Expected no handlers for XPWD");
+
+  /* As must removing one. */
+  mark_point();
+  res = pr_stash_remove_cmd(C_PWD, &m2, 0, NULL, -1);
+  fail_unless(res == 1, "Expected %d, got %d", 1, res);
+
+  handlers = pr_stash_get_cmd_handlers(C_PWD, 0, CMD);
+  fail_unless(handlers != NULL, "Failed to get handlers: %s", strerror(errno));
+  fail_unless(handlers[0] == &cmdtab, "Expected %p, got %p", &cmdtab,
+    handlers[0]);
+  fail_unless(handlers[1] == NULL, "Expected only one CMD handler");
+
+  (void) pr_stash_remove_symbol(PR_SYM_CMD, C_PWD, NULL);
+
+  handlers = pr_stash_get_cmd_handlers(C_PWD, PR_CMD_PWD_ID, CMD);
+  fail_unless(handlers != NULL, "Failed to get handlers: %s", strerror(errno));
+  fail_unless(handlers[0] == NULL, "Expected no handlers for PWD");
+}
+END_TEST
+
+/* Compares the cost of finding a command's handlers, for each dispatch phase,
+ * by walking the stash symbols (as dispatching used to) and by using the
+ * resolved handler lists.
+ */
+START_TEST (stash_get_cmd_handlers_perf_test) {
+  register unsigned int i, j;
+  unsigned int nmodules = 40, nlookups = 200000, walked = 0, listed = 0;
+  int res;
+  module *modules;
+  struct timeval start_tv, end_tv;
+  unsigned long elapsed_ms;
+  const char *names[] = { C_ANY, C_RETR, C_STOR, C_LIST, C_PWD, C_USER, NULL };
+  unsigned char cmd_types[] = { PRE_CMD, CMD, POST_CMD, POST_CMD_ERR, LOG_CMD,
+    LOG_CMD_ERR };
+
+  /* Register handlers for a set of commands, in every phase, from many
+   * modules, much as a fully-loaded server would.
+   */
+  modules = pcalloc(p, sizeof(module) * nmodules);
+  for (i = 0; i < nmodules; i++) {
+    char buf[32];
+
+    memset(buf, '\0', sizeof(buf));
+    snprintf(buf, sizeof(buf)-1, "mod%u", i);
+    modules[i].name = pstrdup(p, buf);
+    modules[i].priority = i;
+
+    for (j = 0; names[j] != NULL; j++) {
+      cmdtable *cmdtab;
+
+      if ((i + j) % 3 != 0) {
+        continue;
+      }
+
+      cmdtab = pcalloc(p, sizeof(cmdtable));
+      cmdtab->command = (char *) names[j];
+      cmdtab->cmd_type = cmd_types[(i + j) % 6];
+      cmdtab->m = &(modules[i]);
+
+      res = pr_stash_add_symbol(PR_SYM_CMD, cmdtab);
+      fail_unless(res == 0, "Failed to add CMD symbol: %s", strerror(errno));
+    }
+  }
+
+  gettimeofday(&start_tv, NULL);
+  for (i = 0; i < nlookups; i++) {
+    const char *name;
+    unsigned char cmd_type;
+    int idx = -1;
+    unsigned int hash = 0;
+    cmdtable *c;
+
+    name = names[i % 6];
+    cmd_type = cmd_types[i % 6];
+
+    c = pr_stash_get_symbol2(PR_SYM_CMD, name, NULL, &idx, &hash);
+    while (c != NULL) {
+      if (c->cmd_type == cmd_type) {
+        walked++;
+      }
+
+      c = pr_stash_get_symbol2(PR_SYM_CMD, name, c, &idx, &hash);
+    }
+  }
+  gettimeofday(&end_tv, NULL);
+
+  elapsed_ms = ((end_tv.tv_sec - start_tv.tv_sec) * 1000) +
+    ((end_tv.tv_usec - start_tv.tv_usec) / 1000);
+  pr_trace_msg("stash", 1, "walked symbols for %u lookups in %lu ms",
+    nlookups, elapsed_ms);
+
+  gettimeofday(&start_tv, NULL);
+  for (i = 0; i < nlookups; i++) {
+    const char *name;
+    unsigned char cmd_type;
+    cmdtable **handlers;
+
+    name = names[i % 6];
+    cmd_type = cmd_types[i % 6];
+
+    handlers = pr_stash_get_cmd_handlers(name, pr_cmd_get_id(name), cmd_type);
+    for (j = 0; handlers[j] != NULL; j++) {
+      listed++;
+    }
+  }
+  gettimeofday(&end_tv, NULL);
+
+  elapsed_ms = ((end_tv.tv_sec - start_tv.tv_sec) * 1000) +
+    ((end_tv.tv_usec - start_tv.tv_usec) / 1000);
+  pr_trace_msg("stash", 1, "listed handlers for %u lookups in %lu ms",
+    nlookups, elapsed_ms);
+
+  fail_unless(walked == listed, "Expected %u handlers, got %u", walked,
+    listed);
+}
+END_TEST
+
 START_TEST (stash_remove_auth_test) {
   int res;
   authtable authtab;
@@ -602,6 +807,8 @@ Suite *tests_get_stash_suite(void) {
 
   tcase_add_test(testcase, stash_remove_conf_test);
   tcase_add_test(testcase, stash_remove_cmd_test);
+  tcase_add_test(testcase, stash_get_cmd_handlers_test);
+  tcase_add_test(testcase, stash_get_cmd_handlers_perf_test);
   tcase_add_test(testcase, stash_remove_auth_test);
   tcase_add_test(testcase, stash_remove_hook_test);
 
@@ -0,0 +1,345 @@
+/*
+ * ProFTPD - FTP server testsuite
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Stats API tests */
+
+#include "tests.h"
+
+static pool *p = NULL;
+
+static void set_up(void) {
+  if (p == NULL) {
+    p = permanent_pool = make_sub_pool(NULL);
+  }
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("stats", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("stats", 0, 0);
+  }
+
+  if (p) {
+    destroy_pool(p);
+    p = permanent_pool = NULL;
+  }
+}
+
+struct stats_found {
+  const char *module_name;
+  const char *cmd_name;
+  int phase;
+  pr_stats_histo_t histo;
+  unsigned int count;
+};
+
+static int stats_find_cb(const char *module_name, const char *cmd_name,
+    int phase, const pr_stats_histo_t *histo, void *user_data) {
+  struct stats_found *found = user_data;
+
+  if (phase != found->phase ||
+      strcmp(cmd_name, found->cmd_name) != 0) {
+    return 0;
+  }
+
+  if (found->module_name == NULL) {
+    if (module_name != NULL) {
+      return 0;
+    }
+
+  } else if (module_name == NULL ||
+             strcmp(module_name, found->module_name) != 0) {
+    return 0;
+  }
+
+  memcpy(&(found->histo), histo, sizeof(pr_stats_histo_t));
+  found->count++;
+  return 0;
+}
+
+START_TEST (stats_add_cmd_test) {
+  int res;
+  struct stats_found found;
+
+  res = pr_stats_add_cmd(NULL, 0, 0);
+  fail_unless(res < 0, "Failed to handle null name");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = init_stats();
+  fail_unless(res == 0, "Failed to init stats: %s", strerror(errno));
+  (void) pr_stats_reset();
+
+  res = pr_stats_add_cmd(C_RETR, 0, 3);
+  fail_unless(res == 0, "Failed to add RETR latency: %s", strerror(errno));
+
+  res = pr_stats_add_cmd(C_RETR, 0, 700);
+  fail_unless(res == 0, "Failed to add RETR latency: %s", strerror(errno));
+
+  res = pr_stats_add_cmd(C_RETR, CMD, 5);
+  fail_unless(res == 0, "Failed to add RETR CMD latency: %s", strerror(errno));
+
+  memset(&found, 0, sizeof(found));
+  found.cmd_name = C_RETR;
+  found.phase = 0;
+
+  res = pr_stats_walk(stats_find_cb, &found);
+  fail_unless(res == 0, "Failed to walk stats: %s", strerror(errno));
+  fail_unless(found.count == 1, "Expected 1 RETR histogram, got %u",
+    found.count);
+  fail_unless(found.histo.count == 2, "Expected count 2, got %lu",
+    (unsigned long) found.histo.count);
+  fail_unless(found.histo.total_usecs == 703, "Expected total 703, got %lu",
+    (unsigned long) found.histo.total_usecs);
+  fail_unless(found.histo.max_usecs == 700, "Expected max 700, got %lu",
+    (unsigned long) found.histo.max_usecs);
+
+  /* 3 usecs falls into the [2, 4) bucket, 700 usecs into [512, 1024). */
+  fail_unless(found.histo.buckets[2] == 1, "Expected 1 in bucket 2, got %lu",
+    (unsigned long) found.histo.buckets[2]);
+  fail_unless(found.histo.buckets[10] == 1, "Expected 1 in bucket 10, got %lu",
+    (unsigned long) found.histo.buckets[10]);
+
+  memset(&found, 0, sizeof(found));
+  found.cmd_name = C_RETR;
+  found.phase = CMD;
+
+  res = pr_stats_walk(stats_find_cb, &found);
+  fail_unless(res == 0, "Failed to walk stats: %s", strerror(errno));
+  fail_unless(found.count == 1, "Expected 1 RETR CMD histogram, got %u",
+    found.count);
+  fail_unless(found.histo.count == 1, "Expected count 1, got %lu",
+    (unsigned long) found.histo.count);
+}
+END_TEST
+
+START_TEST (stats_add_handler_test) {
+  int res;
+  struct stats_found found;
+
+  res = pr_stats_add_handler(NULL, C_USER, 0, 0);
+  fail_unless(res < 0, "Failed to handle null module");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  res = init_stats();
+  fail_unless(res == 0, "Failed to init stats: %s", strerror(errno));
+  (void) pr_stats_reset();
+
+  res = pr_stats_add_handler("sql", "getpwnam", 0, 25000);
+  fail_unless(res == 0, "Failed to add handler latency: %s", strerror(errno));
+
+  res = pr_stats_add_cmd("getpwnam", 0, 10);
+  fail_unless(res == 0, "Failed to add cmd latency: %s", strerror(errno));
+
+  memset(&found, 0, sizeof(found));
+  found.module_name = "sql";
+  found.cmd_name = "getpwnam";
+  found.phase = 0;
+
+  res = pr_stats_walk(stats_find_cb, &found);
+  fail_unless(res == 0, "Failed to walk stats: %s", strerror(errno));
+  fail_unless(found.count == 1, "Expected 1 handler histogram, got %u",
+    found.count);
+  fail_unless(found.histo.max_usecs == 25000, "Expected max 25000, got %lu",
+    (unsigned long) found.histo.max_usecs);
+
+  /* Resetting clears the counts. */
+  res = pr_stats_reset();
+  fail_unless(res == 0, "Failed to reset stats: %s", strerror(errno));
+
+  memset(&found, 0, sizeof(found));
+  found.module_name = "sql";
+  found.cmd_name = "getpwnam";
+  found.phase = 0;
+
+  res = pr_stats_walk(stats_find_cb, &found);
+  fail_unless(res == 0, "Failed to walk stats: %s", strerror(errno));
+  fail_unless(found.count == 0, "Expected no histograms after reset, got %u",
+    found.count);
+}
+END_TEST
+
+START_TEST (stats_histo_get_percentile_test) {
+  register unsigned int i;
+  uint64_t res;
+  pr_stats_histo_t histo;
+
+  res = pr_stats_histo_get_percentile(NULL, 50);
+  fail_unless(res == 0, "Expected 0, got %lu", (unsigned long) res);
+
+  /* 90 fast (< 1 msec) and 10 slow (about 1 sec) latencies. */
+  memset(&histo, 0, sizeof(histo));
+  for (i = 0; i < 90; i++) {
+    histo.buckets[10]++;
+  }
+
+  for (i = 0; i < 10; i++) {
+    histo.buckets[20]++;
+  }
+
+  histo.count = 100;
+  histo.max_usecs = 1000000;
+
+  res = pr_stats_histo_get_percentile(&histo, 50);
+  fail_unless(res == 1024, "Expected 1024, got %lu", (unsigned long) res);
+
+  res = pr_stats_histo_get_percentile(&histo, 90);
+  fail_unless(res == 1024, "Expected 1024, got %lu", (unsigned long) res);
+
+  res = pr_stats_histo_get_percentile(&histo, 99);
+  fail_unless(res == 1000000, "Expected 1000000, got %lu", (unsigned long) res);
+}
+END_TEST
+
+static int stats_cmp_long(const void *a, const void *b) {
+  long la = *((const long *) a), lb = *((const long *) b);
+
+  return (la > lb) - (la < lb);
+}
+
+/* Returns the exact median of the last nvals values, the way mod_delay used
+ * to select it from its DelayTable rows.
+ */
+static long stats_exact_median(const long *vals, unsigned int nvals) {
+  long sorted[256];
+
+  memcpy(sorted, vals, nvals * sizeof(long));
+  qsort(sorted, nvals, sizeof(long), stats_cmp_long);
+  return sorted[nvals / 2];
+}
+
+/* Generates login-like intervals, in usecs: mostly near the given base,
+ * skewed toward slower values, with the occasional much slower outlier.
+ */
+static long stats_next_interval(unsigned long *seed, long base) {
+  long val;
+
+  *seed = (*seed * 1103515245UL + 12345UL) & 0x7fffffffUL;
+  val = base + (long) ((*seed >> 8) % (unsigned long) base);
+
+  if ((*seed % 100) < 2) {
+    val *= 20;
+  }
+
+  if ((*seed % 4) == 0) {
+    val = base + (val - base) / 4;
+  }
+
+  return val;
+}
+
+START_TEST (stats_median_test) {
+  register unsigned int i;
+  int res;
+  long est, exact, vals[256];
+  unsigned long seed = 17;
+  pr_stats_median_t median;
+
+  res = pr_stats_median_add(NULL, 0);
+  fail_unless(res < 0, "Failed to handle null median");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  est = pr_stats_median_get(NULL);
+  fail_unless(est < 0, "Failed to handle null median");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  memset(&median, 0, sizeof(median));
+
+  est = pr_stats_median_get(&median);
+  fail_unless(est < 0, "Failed to handle empty median");
+  fail_unless(errno == ENOENT, "Expected ENOENT (%d), got %s (%d)", ENOENT,
+    strerror(errno), errno);
+
+  res = pr_stats_median_add(&median, 5000);
+  fail_unless(res == 0, "Failed to add value: %s", strerror(errno));
+
+  est = pr_stats_median_get(&median);
+  fail_unless(est == 5000, "Expected 5000, got %ld", est);
+
+  /* Compare the estimate with the exact median of the last 256 values, as
+   * the login intervals change.
+   */
+  memset(&median, 0, sizeof(median));
+
+  for (i = 0; i < 4096; i++) {
+    long base, val;
+
+    base = (i < 2048 ? 200000 : 50000);
+    val = stats_next_interval(&seed, base);
+    vals[i % 256] = val;
+
+    res = pr_stats_median_add(&median, (uint32_t) val);
+    fail_unless(res == 0, "Failed to add value: %s", strerror(errno));
+
+    /* The estimate should be usable early on, and close once warmed up. */
+    if (i == 31) {
+      long diff;
+
+      est = pr_stats_median_get(&median);
+      exact = stats_exact_median(vals, 32);
+
+      diff = est > exact ? est - exact : exact - est;
+      fail_unless(diff <= exact / 6,
+        "Estimated median %ld too far from exact median %ld (after %u values)",
+        est, exact, i + 1);
+    }
+
+    if (i % 256 == 255) {
+      long diff;
+
+      est = pr_stats_median_get(&median);
+      exact = stats_exact_median(vals, 256);
+
+      diff = est > exact ? est - exact : exact - est;
+      fail_unless(diff <= exact / 10,
+        "Estimated median %ld too far from exact median %ld (after %u values)",
+        est, exact, i + 1);
+    }
+  }
+}
+END_TEST
+
+Suite *tests_get_stats_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("stats");
+  testcase = tcase_create("base");
+
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, stats_add_cmd_test);
+  tcase_add_test(testcase, stats_add_handler_test);
+  tcase_add_test(testcase, stats_histo_get_percentile_test);
+  tcase_add_test(testcase, stats_median_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
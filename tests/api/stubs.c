@@ -36,6 +36,8 @@ pid_t mpid = 1;
 module *static_modules[] = { NULL };
 module *loaded_modules = NULL;
 xaset_t *server_list = NULL;
+int SocketBindTight = FALSE;
+int tcpBackLog = PR_TUNABLE_DEFAULT_BACKLOG;
 
 static cmd_rec *next_cmd = NULL;
 
@@ -81,6 +83,10 @@ void init_dirtree(void) {
   main_server->ServerPort = 21;
 }
 
+xaset_t *get_dir_ctxt(pool *p, char *dir_path) {
+  return main_server != NULL ? main_server->conf : NULL;
+}
+
 int pr_cmd_dispatch(cmd_rec *cmd) {
   return 0;
 }
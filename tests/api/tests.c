@@ -61,6 +61,7 @@ static struct testsuite_info suites[] = {
   { "auth",		tests_get_auth_suite },
   { "filter",		tests_get_filter_suite },
   { "inet",		tests_get_inet_suite },
+  { "bindings",		tests_get_bindings_suite },
   { "data",		tests_get_data_suite },
   { "ascii",		tests_get_ascii_suite },
   { "help",		tests_get_help_suite },
@@ -73,6 +74,12 @@ static struct testsuite_info suites[] = {
   { "jot",		tests_get_jot_suite },
   { "redis",		tests_get_redis_suite },
   { "error",		tests_get_error_suite },
+  { "stats",		tests_get_stats_suite },
+  { "metrics",		tests_get_metrics_suite },
+  { "listcache",	tests_get_listcache_suite },
+  { "authcache",	tests_get_authcache_suite },
+  { "claim",		tests_get_claim_suite },
+  { "throttle",		tests_get_throttle_suite },
 
   { NULL, NULL }
 };
@@ -70,6 +70,7 @@ Suite *tests_get_config_suite(void);
 Suite *tests_get_auth_suite(void);
 Suite *tests_get_filter_suite(void);
 Suite *tests_get_inet_suite(void);
+Suite *tests_get_bindings_suite(void);
 Suite *tests_get_data_suite(void);
 Suite *tests_get_ascii_suite(void);
 Suite *tests_get_help_suite(void);
@@ -82,6 +83,12 @@ Suite *tests_get_json_suite(void);
 Suite *tests_get_jot_suite(void);
 Suite *tests_get_redis_suite(void);
 Suite *tests_get_error_suite(void);
+Suite *tests_get_stats_suite(void);
+Suite *tests_get_metrics_suite(void);
+Suite *tests_get_listcache_suite(void);
+Suite *tests_get_authcache_suite(void);
+Suite *tests_get_claim_suite(void);
+Suite *tests_get_throttle_suite(void);
 
 /* Temporary hack/placement for this variable, until we get to testing
  * the Signals API.
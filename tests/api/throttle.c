@@ -0,0 +1,277 @@
+/*
+ * ProFTPD - FTP server testsuite
+ * Copyright (c) 2017 The ProFTPD Project team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, The ProFTPD Project team and other respective
+ * copyright holders give permission to link this program with OpenSSL, and
+ * distribute the resulting executable, without including the source code for
+ * OpenSSL in the source distribution.
+ */
+
+/* Throttle API tests */
+
+#include "tests.h"
+
+/* Must match the table size, and idle time, in src/throttle.c. */
+#define THROTTLE_TEST_MAX_BUCKETS	1024
+#define THROTTLE_TEST_IDLE_USECS	(300 * 1000000ULL)
+
+static pool *p = NULL;
+
+static void set_up(void) {
+  if (p == NULL) {
+    p = permanent_pool = make_sub_pool(NULL);
+  }
+
+  init_throttle();
+
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("throttle", 1, 20);
+    pr_trace_set_levels("claim", 1, 20);
+  }
+}
+
+static void tear_down(void) {
+  if (getenv("TEST_VERBOSE") != NULL) {
+    pr_trace_set_levels("throttle", 0, 0);
+    pr_trace_set_levels("claim", 0, 0);
+  }
+
+  free_throttle();
+
+  if (p) {
+    destroy_pool(p);
+    p = permanent_pool = NULL;
+  }
+}
+
+START_TEST (throttle_bucket_get_test) {
+  pr_throttle_bucket_t *tb, *tb2;
+  uint64_t now;
+
+  now = pr_stats_get_usecs();
+
+  tb = pr_throttle_bucket_get(NULL, 0, 0, now);
+  fail_unless(tb == NULL, "Failed to handle null key");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  free_throttle();
+  tb = pr_throttle_bucket_get("global//foo", 1024, 1024, now);
+  fail_unless(tb == NULL, "Failed to handle missing table");
+  fail_unless(errno == EPERM, "Expected EPERM (%d), got %s (%d)", EPERM,
+    strerror(errno), errno);
+  init_throttle();
+
+  tb = pr_throttle_bucket_get("global//foo", 1024, 1024, now);
+  fail_unless(tb != NULL, "Failed to get bucket: %s", strerror(errno));
+
+  tb2 = pr_throttle_bucket_get("global//foo", 1024, 1024, now);
+  fail_unless(tb2 == tb, "Expected same bucket for same key");
+
+  tb2 = pr_throttle_bucket_get("global//bar", 1024, 1024, now);
+  fail_unless(tb2 != NULL, "Failed to get bucket: %s", strerror(errno));
+  fail_unless(tb2 != tb, "Expected different bucket for different key");
+}
+END_TEST
+
+START_TEST (throttle_bucket_debit_test) {
+  pr_throttle_bucket_t *tb;
+  const char *key = "server/ftp:21/foo";
+  uint64_t now;
+  long usecs;
+
+  now = pr_stats_get_usecs();
+
+  usecs = pr_throttle_bucket_debit(NULL, key, 1, now);
+  fail_unless(usecs < 0, "Failed to handle null bucket");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  /* 1000 bytes per sec, with a burst of 2000 bytes. */
+  tb = pr_throttle_bucket_get(key, 1000, 2000, now);
+  fail_unless(tb != NULL, "Failed to get bucket: %s", strerror(errno));
+
+  usecs = pr_throttle_bucket_debit(tb, NULL, 1, now);
+  fail_unless(usecs < 0, "Failed to handle null key");
+  fail_unless(errno == EINVAL, "Expected EINVAL (%d), got %s (%d)", EINVAL,
+    strerror(errno), errno);
+
+  /* New buckets start out full, so the burst costs no delay. */
+  usecs = pr_throttle_bucket_debit(tb, key, 2000, now);
+  fail_unless(usecs == 0, "Expected no delay for burst, got %ld", usecs);
+
+  /* Debt turns into delay: 500 bytes at 1000 bytes per sec is 0.5 sec. */
+  usecs = pr_throttle_bucket_debit(tb, key, 500, now);
+  fail_unless(usecs == 500000, "Expected delay of 500000 usecs, got %ld",
+    usecs);
+
+  /* More debt means more delay. */
+  usecs = pr_throttle_bucket_debit(tb, key, 500, now);
+  fail_unless(usecs == 1000000, "Expected delay of 1000000 usecs, got %ld",
+    usecs);
+
+  /* Half a second later, half a second of the debt is repaid. */
+  now += 500000;
+  usecs = pr_throttle_bucket_debit(tb, key, 0, now);
+  fail_unless(usecs == 500000, "Expected delay of 500000 usecs, got %ld",
+    usecs);
+}
+END_TEST
+
+START_TEST (throttle_bucket_refill_test) {
+  pr_throttle_bucket_t *tb;
+  const char *key = "class/foo/";
+  uint64_t now;
+  long usecs;
+
+  now = pr_stats_get_usecs();
+
+  tb = pr_throttle_bucket_get(key, 1000, 2000, now);
+  fail_unless(tb != NULL, "Failed to get bucket: %s", strerror(errno));
+
+  usecs = pr_throttle_bucket_debit(tb, key, 2000, now);
+  fail_unless(usecs == 0, "Expected no delay, got %ld", usecs);
+
+  /* One second refills 1000 bytes. */
+  now += 1000000;
+  usecs = pr_throttle_bucket_debit(tb, key, 1000, now);
+  fail_unless(usecs == 0, "Expected no delay after refill, got %ld", usecs);
+
+  usecs = pr_throttle_bucket_debit(tb, key, 1, now);
+  fail_unless(usecs == 1000, "Expected delay of 1000 usecs, got %ld", usecs);
+
+  /* A long idle time refills the bucket only up to its burst. */
+  now += 10 * 1000000;
+  usecs = pr_throttle_bucket_debit(tb, key, 2000, now);
+  fail_unless(usecs == 0, "Expected no delay for burst, got %ld", usecs);
+
+  usecs = pr_throttle_bucket_debit(tb, key, 1, now);
+  fail_unless(usecs == 1000, "Expected delay of 1000 usecs (burst cap), "
+    "got %ld", usecs);
+}
+END_TEST
+
+START_TEST (throttle_bucket_table_full_test) {
+  register unsigned int i;
+  pr_throttle_bucket_t *tb;
+  uint64_t now;
+
+  now = pr_stats_get_usecs();
+
+  for (i = 0; i < THROTTLE_TEST_MAX_BUCKETS; i++) {
+    char key[64];
+
+    memset(key, '\0', sizeof(key));
+    pr_snprintf(key, sizeof(key)-1, "user/user%u/", i);
+
+    tb = pr_throttle_bucket_get(key, 1000, 1000, now);
+    fail_unless(tb != NULL, "Failed to get bucket for '%s': %s", key,
+      strerror(errno));
+  }
+
+  tb = pr_throttle_bucket_get("user/onemore/", 1000, 1000, now);
+  fail_unless(tb == NULL, "Got bucket from full table");
+  fail_unless(errno == ENOSPC, "Expected ENOSPC (%d), got %s (%d)", ENOSPC,
+    strerror(errno), errno);
+
+  /* Existing keys still find their buckets. */
+  tb = pr_throttle_bucket_get("user/user7/", 1000, 1000, now);
+  fail_unless(tb != NULL, "Failed to get bucket: %s", strerror(errno));
+}
+END_TEST
+
+START_TEST (throttle_bucket_idle_reuse_test) {
+  register unsigned int i;
+  pr_throttle_bucket_t *tb, *old_tb = NULL;
+  const char *old_key = "user/user0/";
+  uint64_t now;
+  long usecs;
+
+  now = pr_stats_get_usecs();
+
+  for (i = 0; i < THROTTLE_TEST_MAX_BUCKETS; i++) {
+    char key[64];
+
+    memset(key, '\0', sizeof(key));
+    pr_snprintf(key, sizeof(key)-1, "user/user%u/", i);
+
+    tb = pr_throttle_bucket_get(key, 1000, 1000, now);
+    fail_unless(tb != NULL, "Failed to get bucket for '%s': %s", key,
+      strerror(errno));
+
+    if (i == 0) {
+      old_tb = tb;
+    }
+  }
+
+  /* Keep all but the first bucket in use. */
+  now += THROTTLE_TEST_IDLE_USECS + 1000000;
+  for (i = 1; i < THROTTLE_TEST_MAX_BUCKETS; i++) {
+    char key[64];
+
+    memset(key, '\0', sizeof(key));
+    pr_snprintf(key, sizeof(key)-1, "user/user%u/", i);
+
+    tb = pr_throttle_bucket_get(key, 1000, 1000, now);
+    fail_unless(tb != NULL, "Failed to get bucket for '%s': %s", key,
+      strerror(errno));
+    (void) pr_throttle_bucket_debit(tb, key, 0, now);
+  }
+
+  /* The full table's idle bucket is reused for the new key. */
+  tb = pr_throttle_bucket_get("user/newuser/", 1000, 1000, now);
+  fail_unless(tb != NULL, "Failed to reuse idle bucket: %s", strerror(errno));
+  fail_unless(tb == old_tb, "Expected idle bucket to be reused");
+
+  /* A session still holding the reused bucket must not debit the new key's
+   * tokens.
+   */
+  usecs = pr_throttle_bucket_debit(old_tb, old_key, 1000, now);
+  fail_unless(usecs < 0, "Debited reused bucket for old key");
+  fail_unless(errno == ESTALE, "Expected ESTALE (%d), got %s (%d)", ESTALE,
+    strerror(errno), errno);
+
+  usecs = pr_throttle_bucket_debit(tb, "user/newuser/", 1000, now);
+  fail_unless(usecs == 0, "Expected no delay for new key, got %ld", usecs);
+
+  /* Buckets in use are not reused. */
+  tb = pr_throttle_bucket_get("user/anotheruser/", 1000, 1000, now);
+  fail_unless(tb == NULL, "Reused bucket which is in use");
+  fail_unless(errno == ENOSPC, "Expected ENOSPC (%d), got %s (%d)", ENOSPC,
+    strerror(errno), errno);
+}
+END_TEST
+
+Suite *tests_get_throttle_suite(void) {
+  Suite *suite;
+  TCase *testcase;
+
+  suite = suite_create("throttle");
+  testcase = tcase_create("base");
+
+  tcase_add_checked_fixture(testcase, set_up, tear_down);
+
+  tcase_add_test(testcase, throttle_bucket_get_test);
+  tcase_add_test(testcase, throttle_bucket_debit_test);
+  tcase_add_test(testcase, throttle_bucket_refill_test);
+  tcase_add_test(testcase, throttle_bucket_table_full_test);
+  tcase_add_test(testcase, throttle_bucket_idle_reuse_test);
+
+  suite_add_tcase(suite, testcase);
+  return suite;
+}
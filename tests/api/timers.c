@@ -243,6 +243,48 @@ START_TEST (timer_reset_test) {
 }
 END_TEST
 
+START_TEST (timer_reset_perf_test) {
+  register unsigned int i;
+  int res;
+  struct timeval start_tv, end_tv;
+  unsigned long elapsed_ms;
+  unsigned int count = 1000000;
+
+  /* Sessions reset their idle timers on every command and data transfer
+   * read/write, so resets need to be cheap.
+   */
+  mark_point();
+  for (i = 0; i < 32; i++) {
+    res = pr_timer_add(30 + (i * 60), -1, NULL, timers_test_cb, "test");
+    fail_unless(res > 0, "Failed to add timer: %s", strerror(errno));
+  }
+
+  res = pr_timer_add(2, 1, NULL, timers_test_cb, "test");
+  fail_unless(res == 1, "Failed to add timer: %s", strerror(errno));
+
+  gettimeofday(&start_tv, NULL);
+  for (i = 0; i < count; i++) {
+    res = pr_timer_reset(1, NULL);
+    fail_if(res != 1, "Failed to reset timer");
+  }
+  gettimeofday(&end_tv, NULL);
+
+  elapsed_ms = ((end_tv.tv_sec - start_tv.tv_sec) * 1000) +
+    ((end_tv.tv_usec - start_tv.tv_usec) / 1000);
+  pr_trace_msg("timers", 1, "%u timer resets in %lu ms", count, elapsed_ms);
+
+  /* The timer must still fire, once the resets stop. */
+  sleep(3);
+  timers_handle_signals();
+
+  fail_unless(timer_triggered_count == 1,
+    "Timer failed to fire (expected count 1, got %u)", timer_triggered_count);
+
+  res = pr_timer_remove(-1, ANY_MODULE);
+  fail_unless(res == 32, "Expected 32 timers removed, got %d", res);
+}
+END_TEST
+
 START_TEST (timer_sleep_test) {
   int res;
 
@@ -287,6 +329,7 @@ Suite *tests_get_timers_suite(void) {
   tcase_add_test(testcase, timer_remove_test);
   tcase_add_test(testcase, timer_remove_multi_test);
   tcase_add_test(testcase, timer_reset_test);
+  tcase_add_test(testcase, timer_reset_perf_test);
   tcase_add_test(testcase, timer_sleep_test);
   tcase_add_test(testcase, timer_usleep_test);
 
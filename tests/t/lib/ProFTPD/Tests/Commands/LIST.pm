@@ -93,6 +93,16 @@ my $TESTS = {
     test_class => [qw(bug forking slow)],
   },
 
+  list_streaming => {
+    order => ++$order,
+    test_class => [qw(forking slow)],
+  },
+
+  list_streaming_sorted => {
+    order => ++$order,
+    test_class => [qw(forking slow)],
+  },
+
   list_opt_C => {
     order => ++$order,
     test_class => [qw(bug forking)],
@@ -2274,6 +2284,386 @@ sub list_unsorted_buffering_bug4060 {
   unlink($log_file);
 }
 
+sub list_streaming {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/cmds.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/cmds.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/cmds.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/cmds.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/cmds.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  # For this test, we need to create MANY (i.e. 100K) files in a subdirectory.
+  my $test_dir = File::Spec->rel2abs("$tmpdir/test.d");
+  mkpath($test_dir);
+
+  my $count = 100000;
+  print STDOUT "# Creating $count files in $test_dir\n";
+  for (my $i = 1; $i <= $count; $i++) {
+    my $test_file = 'test_' . sprintf("%07s", $i);
+    my $test_path = "$test_dir/$test_file";
+
+    if (open(my $fh, "> $test_path")) {
+      close($fh);
+
+    } else {
+      die("Can't open $test_path: $!");
+    }
+
+    if ($i % 10000 == 0) {
+      print STDOUT "# Created file $test_file\n";
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $timeout = 900;
+
+  my $config = {
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+    TraceLog => $log_file,
+    Trace => 'DEFAULT:0 data:10 fsio:0 lock:0',
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    TimeoutIdle => $timeout + 15,
+    TimeoutNoTransfer => $timeout + 15,
+
+    Directory => {
+      $test_dir => {
+        ListStreaming => '1000',
+      },
+    },
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($user, $passwd);
+
+      my $list_start = [gettimeofday()];
+
+      my $conn = $client->list_raw('test.d');
+      unless ($conn) {
+        die("LIST failed: " . $client->response_code() . " " .
+          $client->response_msg());
+      }
+
+      my $first_elapsed;
+
+      my $buf;
+      my $tmp;
+      while ($conn->read($tmp, 32768, $timeout)) {
+        unless (defined($first_elapsed)) {
+          $first_elapsed = tv_interval($list_start);
+        }
+
+        $buf .= $tmp;
+      }
+      eval { $conn->close() };
+
+      my $list_elapsed = tv_interval($list_start);
+
+      $client->quit();
+
+      my $names = [];
+      my $lines = [split(/\n/, $buf)];
+      foreach my $line (@$lines) {
+        if ($line =~ /^\S+\s+\d+\s+\S+\s+\S+\s+.*?\s+(\S+)$/) {
+          push(@$names, $1);
+        }
+      }
+
+      my $list_count = scalar(@$names);
+      $self->assert($list_count == $count,
+        test_msg("LIST returned wrong number of entries (expected $count, got $list_count)"));
+
+      if ($ENV{TEST_VERBOSE}) {
+        print STDERR "# LIST time to first byte: $first_elapsed\n";
+        print STDERR "# LIST elapsed time: $list_elapsed\n";
+      }
+
+      # The first entries should arrive long before the listing is done,
+      # rather than only once the entire directory has been listed.
+      $self->assert($first_elapsed < ($list_elapsed / 2),
+        test_msg("LIST time to first byte ($first_elapsed) too close to elapsed time ($list_elapsed)"));
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh, $timeout * 2) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
+sub list_streaming_sorted {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/cmds.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/cmds.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/cmds.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/cmds.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/cmds.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  # For this test, we need to create MANY (i.e. 100K) files in a subdirectory.
+  my $test_dir = File::Spec->rel2abs("$tmpdir/test.d");
+  mkpath($test_dir);
+
+  my $count = 100000;
+  print STDOUT "# Creating $count files in $test_dir\n";
+  for (my $i = 1; $i <= $count; $i++) {
+    my $test_file = 'test_' . sprintf("%07s", $i);
+    my $test_path = "$test_dir/$test_file";
+
+    if (open(my $fh, "> $test_path")) {
+      close($fh);
+
+    } else {
+      die("Can't open $test_path: $!");
+    }
+
+    if ($i % 10000 == 0) {
+      print STDOUT "# Created file $test_file\n";
+    }
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $timeout = 900;
+
+  my $config = {
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+    TraceLog => $log_file,
+    Trace => 'DEFAULT:0 data:10 fsio:0 lock:0',
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+
+    TimeoutIdle => $timeout + 15,
+    TimeoutNoTransfer => $timeout + 15,
+
+    Directory => {
+      $test_dir => {
+        ListStreaming => '1000 Sorted',
+      },
+    },
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($user, $passwd);
+
+      my $list_start = [gettimeofday()];
+
+      my $conn = $client->list_raw('test.d');
+      unless ($conn) {
+        die("LIST failed: " . $client->response_code() . " " .
+          $client->response_msg());
+      }
+
+      my $first_elapsed;
+
+      my $buf;
+      my $tmp;
+      while ($conn->read($tmp, 32768, $timeout)) {
+        unless (defined($first_elapsed)) {
+          $first_elapsed = tv_interval($list_start);
+        }
+
+        $buf .= $tmp;
+      }
+      eval { $conn->close() };
+
+      my $list_elapsed = tv_interval($list_start);
+
+      $client->quit();
+
+      my $names = [];
+      my $lines = [split(/\n/, $buf)];
+      foreach my $line (@$lines) {
+        if ($line =~ /^\S+\s+\d+\s+\S+\s+\S+\s+.*?\s+(\S+)$/) {
+          push(@$names, $1);
+        }
+      }
+
+      my $list_count = scalar(@$names);
+      $self->assert($list_count == $count,
+        test_msg("LIST returned wrong number of entries (expected $count, got $list_count)"));
+
+      # Sorted streaming should list the entries in the same order as when
+      # not streaming.
+      for (my $i = 0; $i < $count; $i++) {
+        my $expected = 'test_' . sprintf("%07s", $i + 1);
+        $self->assert($names->[$i] eq $expected,
+          test_msg("Expected entry '$expected' at $i, got '$names->[$i]'"));
+      }
+
+      if ($ENV{TEST_VERBOSE}) {
+        print STDERR "# LIST time to first byte: $first_elapsed\n";
+        print STDERR "# LIST elapsed time: $list_elapsed\n";
+      }
+
+      # The first entries should arrive long before the listing is done,
+      # rather than only once the entire directory has been listed.
+      $self->assert($first_elapsed < ($list_elapsed / 2),
+        test_msg("LIST time to first byte ($first_elapsed) too close to elapsed time ($list_elapsed)"));
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh, $timeout * 2) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  unlink($log_file);
+}
+
 sub list_opt_C {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
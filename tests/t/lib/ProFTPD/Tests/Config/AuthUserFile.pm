@@ -20,6 +20,11 @@ my $TESTS = {
     test_class => [qw(bug forking os_darwin)],
   },
 
+  authuserfile_index => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
 };
 
 sub new {
@@ -144,4 +149,258 @@ sub authuserfile_empty_passwd {
   unlink($log_file);
 }
 
+sub authuserfile_index {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+
+  my $config_file = "$tmpdir/config.conf";
+  my $pid_file = File::Spec->rel2abs("$tmpdir/config.pid");
+  my $scoreboard_file = File::Spec->rel2abs("$tmpdir/config.scoreboard");
+
+  my $log_file = test_get_logfile();
+
+  my $auth_user_file = File::Spec->rel2abs("$tmpdir/config.passwd");
+  my $auth_group_file = File::Spec->rel2abs("$tmpdir/config.group");
+
+  my $user = 'proftpd';
+  my $passwd = 'test';
+  my $group = 'ftpd';
+  my $home_dir = File::Spec->rel2abs($tmpdir);
+  my $uid = 500;
+  my $gid = 500;
+
+  # Make sure that, if we're running as root, that the home directory has
+  # permissions/privs set for the account we create
+  if ($< == 0) {
+    unless (chmod(0755, $home_dir)) {
+      die("Can't set perms on $home_dir to 0755: $!");
+    }
+
+    unless (chown($uid, $gid, $home_dir)) {
+      die("Can't set owner of $home_dir to $uid/$gid: $!");
+    }
+  }
+
+  # The owner and group of this file are looked up, by ID, for listings.
+  my $test_file = File::Spec->rel2abs("$tmpdir/test.txt");
+  if (open(my $fh, "> $test_file")) {
+    close($fh);
+
+  } else {
+    die("Can't open $test_file: $!");
+  }
+
+  if ($< == 0) {
+    unless (chown($uid, $gid, $test_file)) {
+      die("Can't set owner of $test_file to $uid/$gid: $!");
+    }
+  }
+
+  my ($file_uid, $file_gid) = (stat($test_file))[4, 5];
+
+  # Put our user at the end of a larger file.
+  for (my $i = 0; $i < 1000; $i++) {
+    auth_user_write($auth_user_file, "user$i", $passwd, 1000 + $i, $gid,
+      $home_dir, '/bin/bash');
+  }
+
+  auth_user_write($auth_user_file, $user, $passwd, $uid, $gid, $home_dir,
+    '/bin/bash');
+  auth_group_write($auth_group_file, $group, $gid, $user);
+
+  my $file_user = $user;
+  if ($file_uid != $uid) {
+    $file_user = 'fileowner';
+    auth_user_write($auth_user_file, $file_user, $passwd, $file_uid, $gid,
+      $home_dir, '/bin/bash');
+  }
+
+  my $file_group = $group;
+  if ($file_gid != $gid) {
+    $file_group = 'filegroup';
+    auth_group_write($auth_group_file, $file_group, $file_gid, $user);
+  }
+
+  # Logins require a supplemental group, which is only found in the
+  # AuthGroupFile (by getgroups).
+  my $login_group = 'ftpd2';
+  for (my $i = 0; $i < 1000; $i++) {
+    auth_group_write($auth_group_file, "group$i", 1000 + $i, "user$i");
+  }
+
+  auth_group_write($auth_group_file, $login_group, 600, $user, 'newuser');
+
+  # Files changed in the second in which they are indexed are not used,
+  # until they are indexed again; make sure that the first index is used.
+  sleep(1);
+
+  my $config = {
+    PidFile => $pid_file,
+    ScoreboardFile => $scoreboard_file,
+    SystemLog => $log_file,
+    TraceLog => $log_file,
+    Trace => 'auth:10 auth.file:20',
+
+    AuthUserFile => $auth_user_file,
+    AuthGroupFile => $auth_group_file,
+    AuthFileIndex => 'on 1',
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+    },
+
+    Limit => {
+      LOGIN => {
+        AllowGroup => $login_group,
+        DenyAll => '',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($config_file, $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Returns the owner and group shown in the listing of the test file.
+  my $list_owner = sub {
+    my $client = shift;
+
+    my $conn = $client->list_raw('test.txt');
+    unless ($conn) {
+      die("Failed to LIST: " . $client->response_code() . " " .
+        $client->response_msg());
+    }
+
+    my $buf;
+    $conn->read($buf, 8192, 30);
+    eval { $conn->close() };
+
+    my $resp_code = $client->response_code();
+    my $resp_msg = $client->response_msg();
+    $self->assert_transfer_ok($resp_code, $resp_msg);
+
+    unless ($buf =~ /^\S+\s+\d+\s+(\S+)\s+(\S+)\s+/) {
+      die("Unexpected LIST data '$buf'");
+    }
+
+    return "$1/$2";
+  };
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Give the server time to start up, and to index the files.
+      sleep(2);
+
+      my $expected = "$file_user/$file_group";
+
+      my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($user, $passwd);
+      my $indexed = $list_owner->($client);
+      $client->quit();
+
+      $self->assert($indexed eq $expected,
+        test_msg("Expected '$expected', got '$indexed' (indexed)"));
+
+      # Users and groups added to the files can be used right away, before
+      # the indexes are rebuilt, as well as after; until then, the files
+      # themselves are read.
+      my $new_user = 'newuser';
+      auth_user_write($auth_user_file, $new_user, $passwd, 2000, $gid,
+        $home_dir, '/bin/bash');
+      auth_group_write($auth_group_file, 'newgroup', 2000, $new_user);
+
+      $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($user, $passwd);
+      my $unindexed = $list_owner->($client);
+      $client->quit();
+
+      $self->assert($unindexed eq $indexed,
+        test_msg("Expected '$indexed', got '$unindexed' (from files)"));
+
+      $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($new_user, $passwd);
+      $client->quit();
+
+      sleep(3);
+
+      $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+      $client->login($new_user, $passwd);
+      $client->quit();
+    };
+
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($config_file, $rfh, 15) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($pid_file);
+
+  $self->assert_child_ok($pid);
+
+  if ($ex) {
+    test_append_logfile($log_file, $ex);
+    unlink($log_file);
+
+    die($ex);
+  }
+
+  if (open(my $fh, "< $log_file")) {
+    my $used_user_index = 0;
+    my $used_group_index = 0;
+    my $rebuilt = 0;
+
+    while (my $line = <$fh>) {
+      if ($line =~ /using index of '\Q$auth_user_file\E'/) {
+        $used_user_index = 1;
+
+      } elsif ($line =~ /using index of '\Q$auth_group_file\E'/) {
+        $used_group_index = 1;
+
+      } elsif ($line =~ /rebuilding index of '\Q$auth_user_file\E'/) {
+        $rebuilt = 1;
+      }
+    }
+
+    close($fh);
+
+    $self->assert($used_user_index,
+      test_msg("Expected AuthUserFile index to be used"));
+    $self->assert($used_group_index,
+      test_msg("Expected AuthGroupFile index to be used"));
+    $self->assert($rebuilt,
+      test_msg("Expected AuthUserFile index to be rebuilt"));
+
+  } else {
+    die("Can't read $log_file: $!");
+  }
+
+  unlink($log_file);
+}
+
 1;
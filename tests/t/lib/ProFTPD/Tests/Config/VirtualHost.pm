@@ -21,6 +21,10 @@ my $TESTS = {
     test_class => [qw(forking)],
   },
 
+  vhost_many_startup => {
+    test_class => [qw(forking)],
+  },
+
 };
 
 sub new {
@@ -31,6 +35,139 @@ sub list_tests {
   return testsuite_get_runnable_tests($TESTS);
 }
 
+# Appends a synthetic configuration of $count <VirtualHost> sections to the
+# given config file: a mix of port-based and name-based vhosts, each with
+# its own <Directory> sections, as seen in large hosting configurations.
+sub write_many_vhosts {
+  my $config_file = shift;
+  my $count = shift;
+  my $base_port = shift;
+  my $home_dir = shift;
+
+  my $fh;
+  unless (open($fh, ">> $config_file")) {
+    die("Can't open $config_file: $!");
+  }
+
+  print $fh <<EOC;
+<Global>
+  AllowOverwrite on
+  Umask 022
+  <Directory $home_dir/incoming>
+    <Limit WRITE>
+      DenyAll
+    </Limit>
+  </Directory>
+</Global>
+EOC
+
+  for (my $i = 1; $i <= $count; $i++) {
+    my $port = $base_port + ($i % 2 ? $i : 0);
+
+    print $fh <<EOC;
+<VirtualHost 127.0.0.1>
+  ServerName "vhost$i"
+  ServerAlias ftp$i.example.com
+  Port $port
+  DefaultRoot $home_dir/vhost$i
+  <Directory $home_dir/vhost$i>
+    AllowOverwrite off
+  </Directory>
+  <Directory $home_dir/vhost$i/pub/*>
+    HideNoAccess on
+  </Directory>
+</VirtualHost>
+EOC
+  }
+
+  unless (close($fh)) {
+    die("Can't write $config_file: $!");
+  }
+}
+
+sub vhost_many_startup {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'config');
+
+  # Use e.g. PROFTPD_TEST_VHOST_COUNT=20000 for benchmarking.
+  my $vhost_count = $ENV{PROFTPD_TEST_VHOST_COUNT} || 2000;
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+
+    IfModules => {
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  write_many_vhosts($setup->{config_file}, $vhost_count, $port + 1,
+    $setup->{home_dir});
+
+  my $proftpd_bin = ProFTPD::TestSuite::Utils::get_proftpd_bin();
+
+  my $ex;
+
+  eval {
+    my $start = time();
+    my @res = `$proftpd_bin -t -d10 -c $setup->{config_file} 2>&1`;
+    my $elapsed = time() - $start;
+
+    $self->assert($? == 0,
+      test_msg("Syntax check of $vhost_count vhosts failed"));
+
+    my $timings = {};
+    my $server_count = 0;
+
+    foreach my $line (@res) {
+      if ($line =~ /startup: (.*?) took (\d+) ms/) {
+        $timings->{$1} = $2;
+
+      } elsif ($line =~ /startup: (\d+) servers configured/) {
+        $server_count = $1;
+      }
+    }
+
+    if ($ENV{TEST_VERBOSE}) {
+      print STDERR "# $vhost_count vhosts: syntax check took ${elapsed}s\n";
+      foreach my $phase (sort(keys(%$timings))) {
+        print STDERR "#   $phase: $timings->{$phase} ms\n";
+      }
+    }
+
+    foreach my $phase ('parsing configuration', 'fixing up servers',
+        'initializing bindings') {
+      $self->assert(defined($timings->{$phase}),
+        test_msg("Expected timing for '$phase' phase"));
+    }
+
+    my $expected = $vhost_count + 1;
+    $self->assert($server_count == $expected,
+      test_msg("Expected $expected servers, got $server_count"));
+
+    # Generous, but well below the minutes that quadratic passes take for
+    # tens of thousands of vhosts.
+    my $max_elapsed = 30 + int($vhost_count / 1000);
+    $self->assert($elapsed <= $max_elapsed,
+      test_msg("Expected startup within ${max_elapsed}s, took ${elapsed}s"));
+  };
+  if ($@) {
+    $ex = $@;
+  }
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
 sub vhost_namebased_different_ports {
   my $self = shift;
   my $tmpdir = $self->{tmpdir};
@@ -0,0 +1,297 @@
+package ProFTPD::Tests::Modules::mod_filecache;
+
+use lib qw(t/lib);
+use base qw(ProFTPD::TestSuite::Child);
+use strict;
+
+use File::Spec;
+use IO::Handle;
+
+use ProFTPD::TestSuite::FTP;
+use ProFTPD::TestSuite::Utils qw(:auth :config :running :test :testsuite);
+
+$| = 1;
+
+my $order = 0;
+
+my $TESTS = {
+  filecache_retr => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+  filecache_retr_changed_file => {
+    order => ++$order,
+    test_class => [qw(forking)],
+  },
+
+};
+
+sub new {
+  return shift()->SUPER::new(@_);
+}
+
+sub list_tests {
+  return testsuite_get_runnable_tests($TESTS);
+}
+
+sub write_file {
+  my $path = shift;
+  my $data = shift;
+
+  if (open(my $fh, "> $path")) {
+    print $fh $data;
+    unless (close($fh)) {
+      die("Can't write $path: $!");
+    }
+
+  } else {
+    die("Can't open $path: $!");
+  }
+}
+
+sub retr_file {
+  my $self = shift;
+  my $port = shift;
+  my $setup = shift;
+  my $path = shift;
+
+  my $client = ProFTPD::TestSuite::FTP->new('127.0.0.1', $port);
+  $client->login($setup->{user}, $setup->{passwd});
+  $client->type('binary');
+
+  my $conn = $client->retr_raw($path);
+  unless ($conn) {
+    die("Failed to RETR $path: " . $client->response_code() . " " .
+      $client->response_msg());
+  }
+
+  my $buf = '';
+  my $tmp;
+  while ($conn->read($tmp, 8192, 25)) {
+    $buf .= $tmp;
+  }
+  eval { $conn->close() };
+
+  my $resp_code = $client->response_code();
+  my $resp_msg = $client->response_msg();
+  $self->assert_transfer_ok($resp_code, $resp_msg);
+
+  $client->quit();
+  return $buf;
+}
+
+sub filecache_retr {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'filecache');
+
+  my $test_file = File::Spec->rel2abs("$setup->{home_dir}/test.txt");
+  my $test_data = "Hello, World!\n" x 64;
+  write_file($test_file, $test_data);
+
+  my $filecache_tab = File::Spec->rel2abs("$tmpdir/filecache.tab");
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'fsio:10 filecache:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+
+    IfModules => {
+      'mod_filecache.c' => {
+        FileCacheEngine => 'on',
+        FileCacheTable => $filecache_tab,
+      },
+
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      # Files changed within the current second are not cached.
+      sleep(2);
+
+      # The first session caches the file, the second one reads it from
+      # the cache.
+      for (my $i = 0; $i < 2; $i++) {
+        my $data = $self->retr_file($port, $setup, 'test.txt');
+        $self->assert($data eq $test_data,
+          test_msg("Expected '$test_data', got '$data'"));
+      }
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  eval {
+    if (open(my $fh, "< $setup->{log_file}")) {
+      my $adding_entry = 0;
+      my $cached_file = 0;
+
+      while (my $line = <$fh>) {
+        chomp($line);
+
+        if ($ENV{TEST_VERBOSE}) {
+          print STDERR "# line: $line\n";
+        }
+
+        if ($line =~ /<filecache:9>/ &&
+            $line =~ /adding entry for '.*?test\.txt'/) {
+          $adding_entry++;
+          next;
+        }
+
+        if ($line =~ /<filecache:11>/ &&
+            $line =~ /serving '.*?test\.txt' \(\d+ bytes\) from cache/) {
+          $cached_file++;
+          next;
+        }
+      }
+
+      close($fh);
+
+      $self->assert($adding_entry == 1 && $cached_file == 1,
+        test_msg("Did not see expected 'filecache' TraceLog messages"));
+
+    } else {
+      die("Can't read $setup->{log_file}: $!");
+    }
+  };
+  if ($@) {
+    $ex = $@;
+  }
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
+sub filecache_retr_changed_file {
+  my $self = shift;
+  my $tmpdir = $self->{tmpdir};
+  my $setup = test_setup($tmpdir, 'filecache');
+
+  my $test_file = File::Spec->rel2abs("$setup->{home_dir}/test.txt");
+  my $test_data = "Hello, World!\n" x 64;
+  write_file($test_file, $test_data);
+
+  my $filecache_tab = File::Spec->rel2abs("$tmpdir/filecache.tab");
+
+  my $config = {
+    PidFile => $setup->{pid_file},
+    ScoreboardFile => $setup->{scoreboard_file},
+    SystemLog => $setup->{log_file},
+    TraceLog => $setup->{log_file},
+    Trace => 'fsio:10 filecache:20',
+
+    AuthUserFile => $setup->{auth_user_file},
+    AuthGroupFile => $setup->{auth_group_file},
+
+    IfModules => {
+      'mod_filecache.c' => {
+        FileCacheEngine => 'on',
+        FileCacheTable => $filecache_tab,
+      },
+
+      'mod_delay.c' => {
+        DelayEngine => 'off',
+      },
+    },
+  };
+
+  my ($port, $config_user, $config_group) = config_write($setup->{config_file},
+    $config);
+
+  # Open pipes, for use between the parent and child processes.  Specifically,
+  # the child will indicate when it's done with its test by writing a message
+  # to the parent.
+  my ($rfh, $wfh);
+  unless (pipe($rfh, $wfh)) {
+    die("Can't open pipe: $!");
+  }
+
+  my $ex;
+
+  # Fork child
+  $self->handle_sigchld();
+  defined(my $pid = fork()) or die("Can't fork: $!");
+  if ($pid) {
+    eval {
+      sleep(2);
+
+      my $data = $self->retr_file($port, $setup, 'test.txt');
+      $self->assert($data eq $test_data,
+        test_msg("Expected '$test_data', got '$data'"));
+
+      # Change the file, keeping its size; the cached copy must not be used.
+      my $new_data = "Goodbye World\n" x 64;
+      write_file($test_file, $new_data);
+
+      $data = $self->retr_file($port, $setup, 'test.txt');
+      $self->assert($data eq $new_data,
+        test_msg("Expected '$new_data', got '$data'"));
+    };
+    if ($@) {
+      $ex = $@;
+    }
+
+    $wfh->print("done\n");
+    $wfh->flush();
+
+  } else {
+    eval { server_wait($setup->{config_file}, $rfh) };
+    if ($@) {
+      warn($@);
+      exit 1;
+    }
+
+    exit 0;
+  }
+
+  # Stop server
+  server_stop($setup->{pid_file});
+  $self->assert_child_ok($pid);
+
+  test_cleanup($setup->{log_file}, $ex);
+}
+
+1;
@@ -93,7 +93,7 @@ int main(int argc, char **argv) {
   int c = 0, res = 0;
   char *server_name = NULL;
   struct scoreboard_class classes[MAX_CLASSES];
-  char *cp, *progname = *argv;
+  char *cp, *mutex_path, *progname = *argv;
   const char *cmdopts = "S:c:f:h";
   register unsigned int i;
 
@@ -155,6 +155,15 @@ int main(int argc, char **argv) {
     }
   }
 
+  /* The ScoreboardMutex holds the sequence counters needed for reading the
+   * scoreboard without locks.
+   */
+  mutex_path = util_scan_config(config_filename, "ScoreboardMutex");
+  if (mutex_path != NULL) {
+    util_set_scoreboard_mutex(mutex_path);
+    free(mutex_path);
+  }
+
   count = 0;
   res = util_open_scoreboard(O_RDONLY);
   if (res < 0) {
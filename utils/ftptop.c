@@ -89,6 +89,10 @@ static const char *program = "ftptop";
 #define	FTPTOP_SHOW_REG \
   (FTPTOP_SHOW_DOWNLOAD|FTPTOP_SHOW_UPLOAD|FTPTOP_SHOW_IDLE)
 #define FTPTOP_SHOW_RATES		0x0010
+#define FTPTOP_SHOW_SUMMARY		0x0020
+
+/* Number of rows shown in each of the summary display's lists. */
+#define FTPTOP_SUMMARY_NROWS		5
 
 static int delay = 2;
 static unsigned int display_mode = FTPTOP_SHOW_REG;
@@ -105,6 +109,29 @@ static char *server_name = NULL;
 static char **ftp_sessions = NULL;
 static unsigned int chunklen = 3;
 
+/* For the summary display, the figures for each session are gathered in the
+ * same pass over the scoreboard, then aggregated by sorting.
+ */
+struct summary_session {
+  pid_t pid;
+  char status;
+  char server[32];
+  char user[32];
+  char client[32];
+  double rate;
+};
+
+struct summary_group {
+  const char *name;
+  unsigned int nsessions;
+  unsigned int nxfers;
+  double rate;
+};
+
+static struct summary_session *summary_sessions = NULL;
+static unsigned int summary_nsessions = 0;
+static unsigned int summary_size = 0;
+
 /* necessary prototypes */
 static void scoreboard_close(void);
 static int scoreboard_open(void);
@@ -125,6 +152,8 @@ static void clear_counters(void) {
     ftp_sessions = NULL;
   }
 
+  summary_nsessions = 0;
+
   /* Reset the session counters. */
   ftp_nsessions = 0;
   ftp_nuploads = 0;
@@ -290,6 +319,7 @@ static const char *show_ftpd_uptime(void) {
 static void process_opts(int argc, char *argv[]) {
   int optc = 0;
   const char *prgopts = "AaDS:d:f:hIiUV";
+  char *mutex_path;
 
   while ((optc = getopt(argc, argv, prgopts)) != -1) {
     switch (optc) {
@@ -390,6 +420,267 @@ static void process_opts(int argc, char *argv[]) {
       exit(1);
     }
   }
+
+  /* The ScoreboardMutex holds the sequence counters needed for reading the
+   * scoreboard without locks.
+   */
+  mutex_path = util_scan_config(config_filename, "ScoreboardMutex");
+  if (mutex_path != NULL) {
+    util_set_scoreboard_mutex(mutex_path);
+    free(mutex_path);
+  }
+}
+
+/* Returns the status symbol to display for the given session. */
+static const char *get_session_status(pr_scoreboard_entry_t *score) {
+
+  /* Has the user authenticated yet? */
+  if (strcmp(score->sce_user, "(none)") == 0) {
+    return "A";
+  }
+
+  if (strcmp(score->sce_cmd, "idle") == 0) {
+    return "I";
+  }
+
+  if (strcmp(score->sce_cmd, "RETR") == 0 ||
+      strcmp(score->sce_cmd, "READ") == 0 ||
+      strcmp(score->sce_cmd, "scp download") == 0) {
+    return "D";
+  }
+
+  if (strcmp(score->sce_cmd, "STOR") == 0 ||
+      strcmp(score->sce_cmd, "APPE") == 0 ||
+      strcmp(score->sce_cmd, "STOU") == 0 ||
+      strcmp(score->sce_cmd, "WRITE") == 0 ||
+      strcmp(score->sce_cmd, "scp upload") == 0) {
+    return "U";
+  }
+
+  if (strcmp(score->sce_cmd, "LIST") == 0 ||
+      strcmp(score->sce_cmd, "NLST") == 0 ||
+      strcmp(score->sce_cmd, "MLST") == 0 ||
+      strcmp(score->sce_cmd, "MLSD") == 0 ||
+      strcmp(score->sce_cmd, "READDIR") == 0) {
+    return "L";
+  }
+
+  /* Default status: "A" for "authenticating" */
+  return "A";
+}
+
+/* Returns the transfer rate, in KB/s, for the given session. */
+static double get_session_rate(pr_scoreboard_entry_t *score) {
+  if (score->sce_xfer_elapsed == 0) {
+    return 0.0;
+  }
+
+  return (score->sce_xfer_len / 1024.0) / (score->sce_xfer_elapsed / 1000.0);
+}
+
+static int is_xfer_status(char status) {
+  return (status == 'D' || status == 'U');
+}
+
+static void add_summary_session(pr_scoreboard_entry_t *score,
+    const char *status) {
+  struct summary_session *sess;
+
+  if (summary_nsessions == summary_size) {
+    summary_size = summary_size ? summary_size * 2 : 64;
+    summary_sessions = realloc(summary_sessions,
+      summary_size * sizeof(struct summary_session));
+    if (summary_sessions == NULL) {
+      exit(1);
+    }
+  }
+
+  sess = &(summary_sessions[summary_nsessions++]);
+  sess->pid = score->sce_pid;
+  sess->status = *status;
+  util_sstrncpy(sess->server, score->sce_server_label, sizeof(sess->server));
+  util_sstrncpy(sess->user, score->sce_user, sizeof(sess->user));
+  util_sstrncpy(sess->client, score->sce_client_name, sizeof(sess->client));
+
+  sess->rate = 0.0;
+  if (is_xfer_status(sess->status)) {
+    sess->rate = get_session_rate(score);
+  }
+}
+
+static int summary_server_cmp(const void *a, const void *b) {
+  return strcmp(((const struct summary_session *) a)->server,
+    ((const struct summary_session *) b)->server);
+}
+
+static int summary_user_cmp(const void *a, const void *b) {
+  return strcmp(((const struct summary_session *) a)->user,
+    ((const struct summary_session *) b)->user);
+}
+
+static int summary_rate_cmp(const void *a, const void *b) {
+  const struct summary_session *sess1 = a, *sess2 = b;
+
+  /* Transferring sessions first, highest rates first. */
+  if (is_xfer_status(sess1->status) != is_xfer_status(sess2->status)) {
+    return is_xfer_status(sess1->status) ? -1 : 1;
+  }
+
+  if (sess1->rate > sess2->rate) {
+    return -1;
+  }
+
+  return sess1->rate < sess2->rate ? 1 : 0;
+}
+
+static int summary_group_cmp(const void *a, const void *b) {
+  const struct summary_group *group1 = a, *group2 = b;
+
+  if (group1->rate > group2->rate) {
+    return -1;
+  }
+
+  if (group1->rate < group2->rate) {
+    return 1;
+  }
+
+  return (int) group2->nsessions - (int) group1->nsessions;
+}
+
+/* Groups the sessions, which must be sorted by the group name, filling in
+ * the given groups array; returns the number of groups.
+ */
+static unsigned int group_sessions(struct summary_group *groups,
+    int by_user) {
+  register unsigned int i;
+  unsigned int ngroups = 0;
+
+  for (i = 0; i < summary_nsessions; i++) {
+    struct summary_session *sess = &(summary_sessions[i]);
+    const char *name = by_user ? sess->user : sess->server;
+
+    if (ngroups == 0 ||
+        strcmp(groups[ngroups-1].name, name) != 0) {
+      groups[ngroups].name = name;
+      groups[ngroups].nsessions = 0;
+      groups[ngroups].nxfers = 0;
+      groups[ngroups].rate = 0.0;
+      ngroups++;
+    }
+
+    groups[ngroups-1].nsessions++;
+    if (is_xfer_status(sess->status)) {
+      groups[ngroups-1].nxfers++;
+      groups[ngroups-1].rate += sess->rate;
+    }
+  }
+
+  qsort(groups, ngroups, sizeof(struct summary_group), summary_group_cmp);
+  return ngroups;
+}
+
+static void show_summary_groups(const char *label, int by_user,
+    struct summary_group *groups) {
+  register unsigned int i;
+  unsigned int ngroups;
+
+  qsort(summary_sessions, summary_nsessions, sizeof(struct summary_session),
+    by_user ? summary_user_cmp : summary_server_cmp);
+  ngroups = group_sessions(groups, by_user);
+
+  attron(A_REVERSE);
+  printw("%-32s %-8s %-9s %-10s\n", label, "SESSIONS", "TRANSFERS", "KB/s");
+  attroff(A_REVERSE);
+
+  for (i = 0; i < ngroups && i < FTPTOP_SUMMARY_NROWS; i++) {
+    printw("%-32.32s %-8u %-9u %-10.2f\n",
+      *groups[i].name ? groups[i].name : "-", groups[i].nsessions,
+      groups[i].nxfers, groups[i].rate);
+  }
+
+  if (ngroups > FTPTOP_SUMMARY_NROWS) {
+    printw("(%u more)\n", ngroups - FTPTOP_SUMMARY_NROWS);
+  }
+
+  printw("\n");
+}
+
+static void show_summary(void) {
+  register unsigned int i;
+  const char *states = "DULIA";
+  unsigned int state_nsessions[5], nxfers = 0;
+  double state_rates[5];
+  struct summary_group *groups;
+
+  memset(state_nsessions, 0, sizeof(state_nsessions));
+  memset(state_rates, 0, sizeof(state_rates));
+
+  groups = calloc(summary_nsessions + 1, sizeof(struct summary_group));
+  if (groups == NULL) {
+    exit(1);
+  }
+
+  show_summary_groups("SERVER", FALSE, groups);
+  show_summary_groups("USER", TRUE, groups);
+
+  for (i = 0; i < summary_nsessions; i++) {
+    const char *ptr;
+
+    ptr = strchr(states, summary_sessions[i].status);
+    if (ptr != NULL) {
+      state_nsessions[ptr - states]++;
+      state_rates[ptr - states] += summary_sessions[i].rate;
+    }
+  }
+
+  attron(A_REVERSE);
+  printw("%-32s %-8s %-9s %-10s\n", "STATE", "SESSIONS", "", "KB/s");
+  attroff(A_REVERSE);
+
+  for (i = 0; states[i]; i++) {
+    printw("%-32c %-8u %-9s %-10.2f\n", states[i], state_nsessions[i], "",
+      state_rates[i]);
+  }
+  printw("\n");
+
+  /* Sorting by rate gives both the top talkers, and the percentiles. */
+  qsort(summary_sessions, summary_nsessions, sizeof(struct summary_session),
+    summary_rate_cmp);
+
+  attron(A_REVERSE);
+  printw("%-5s %s %-8s %-26s %-10s\n", "PID", "S", "USER", "CLIENT", "KB/s");
+  attroff(A_REVERSE);
+
+  for (i = 0; i < summary_nsessions && i < FTPTOP_SUMMARY_NROWS; i++) {
+    struct summary_session *sess = &(summary_sessions[i]);
+
+    if (!is_xfer_status(sess->status)) {
+      break;
+    }
+
+    printw("%-5u %c %-8.8s %-26.26s %-10.2f\n", (unsigned int) sess->pid,
+      sess->status, sess->user, sess->client, sess->rate);
+  }
+  printw("\n");
+
+  while (nxfers < summary_nsessions &&
+         is_xfer_status(summary_sessions[nxfers].status)) {
+    nxfers++;
+  }
+
+  if (nxfers > 0) {
+    /* The transferring sessions are sorted highest rate first. */
+    printw("Transfer rates (KB/s): p50 %.2f, p90 %.2f, p99 %.2f, max %.2f\n",
+      summary_sessions[nxfers - 1 - ((nxfers - 1) * 50 / 100)].rate,
+      summary_sessions[nxfers - 1 - ((nxfers - 1) * 90 / 100)].rate,
+      summary_sessions[nxfers - 1 - ((nxfers - 1) * 99 / 100)].rate,
+      summary_sessions[0].rate);
+
+  } else {
+    printw("Transfer rates (KB/s): no transfers\n");
+  }
+
+  free(groups);
 }
 
 static void read_scoreboard(void) {
@@ -407,11 +698,11 @@ static void read_scoreboard(void) {
   if (scoreboard_open() < 0)
     return;
 
-  /* Iterate through the scoreboard. */
+  /* Iterate through the scoreboard.  The entries come from a snapshot of the
+   * scoreboard, so no locks are held while they are processed.
+   */
   while ((score = util_scoreboard_entry_read()) != NULL) {
-
-    /* Default status: "A" for "authenticating" */
-    char *status = "A";
+    const char *status;
 
     /* If a ServerName was given, skip unless the scoreboard entry matches. */
     if (server_name != NULL &&
@@ -422,51 +713,37 @@ static void read_scoreboard(void) {
     /* Clear the buffer for this run. */
     memset(buf, '\0', sizeof(buf));
 
-    /* Has the user authenticated yet? */
-    if (strcmp(score->sce_user, "(none)") != 0) {
+    /* Determine the status symbol to display. */
+    status = get_session_status(score);
 
-      /* Determine the status symbol to display. */
-      if (strcmp(score->sce_cmd, "idle") == 0) {
-        status = "I";
+    switch (*status) {
+      case 'I':
         ftp_nidles++;
+        break;
 
-        if (display_mode != FTPTOP_SHOW_RATES &&
-            !(display_mode & FTPTOP_SHOW_IDLE))
-          continue;
-
-      } else if (strcmp(score->sce_cmd, "RETR") == 0 ||
-                 strcmp(score->sce_cmd, "READ") == 0 ||
-                 strcmp(score->sce_cmd, "scp download") == 0) {
-        status = "D";
+      case 'D':
         ftp_ndownloads++;
+        break;
 
-        if (display_mode != FTPTOP_SHOW_RATES &&
-            !(display_mode & FTPTOP_SHOW_DOWNLOAD))
-          continue;
-
-      } else if (strcmp(score->sce_cmd, "STOR") == 0 ||
-                 strcmp(score->sce_cmd, "APPE") == 0 ||
-                 strcmp(score->sce_cmd, "STOU") == 0 ||
-                 strcmp(score->sce_cmd, "WRITE") == 0 ||
-                 strcmp(score->sce_cmd, "scp upload") == 0) {
-        status = "U";
+      case 'U':
         ftp_nuploads++;
+        break;
+    }
 
-        if (display_mode != FTPTOP_SHOW_RATES &&
-            !(display_mode & FTPTOP_SHOW_UPLOAD))
-          continue;
+    if (display_mode == FTPTOP_SHOW_SUMMARY) {
+      add_summary_session(score, status);
+      continue;
+    }
 
-      } else if (strcmp(score->sce_cmd, "LIST") == 0 ||
-                 strcmp(score->sce_cmd, "NLST") == 0 ||
-                 strcmp(score->sce_cmd, "MLST") == 0 ||
-                 strcmp(score->sce_cmd, "MLSD") == 0 ||
-                 strcmp(score->sce_cmd, "READDIR") == 0) {
-        status = "L";
+    if (display_mode != FTPTOP_SHOW_RATES) {
+      if ((*status == 'I' && !(display_mode & FTPTOP_SHOW_IDLE)) ||
+          (*status == 'D' && !(display_mode & FTPTOP_SHOW_DOWNLOAD)) ||
+          (*status == 'U' && !(display_mode & FTPTOP_SHOW_UPLOAD))) {
+        continue;
       }
+    }
 
-    } else {
-      status = "A";
-
+    if (strcmp(score->sce_user, "(none)") == 0) {
       /* Overwrite the "command", for display purposes */
       util_sstrncpy(score->sce_cmd, "(authenticating)", sizeof(score->sce_cmd));
     }
@@ -501,7 +778,7 @@ static void read_scoreboard(void) {
         (unsigned int) score->sce_pid, status,
         user_namelen, user_namelen, score->sce_user,
         client_namelen, client_namelen, score->sce_client_name,
-        (score->sce_xfer_len / 1024.0) / (score->sce_xfer_elapsed / 1000),
+        get_session_rate(score),
         FTPTOP_XFER_DONE_SIZE, FTPTOP_XFER_DONE_SIZE,
         *status == 'D' ?
           calc_percent_done(score->sce_xfer_size, score->sce_xfer_done) :
@@ -592,11 +869,18 @@ static void show_sessions(void) {
   attron(A_BOLD);
   printw(FTPTOP_VERSION ": %s%s\n", now_str, uptime_str);
   printw("%u Total FTP Sessions: %u downloading, %u uploading, %u idle\n",
-    ftp_nsessions, ftp_ndownloads, ftp_nuploads, ftp_nidles);
+    display_mode == FTPTOP_SHOW_SUMMARY ? summary_nsessions : ftp_nsessions,
+    ftp_ndownloads, ftp_nuploads, ftp_nidles);
   attroff(A_BOLD);
 
   printw("\n");
 
+  if (display_mode == FTPTOP_SHOW_SUMMARY) {
+    show_summary();
+    wrefresh(stdscr);
+    return;
+  }
+
   attron(A_REVERSE);
 
   if (display_mode != FTPTOP_SHOW_RATES) {
@@ -622,14 +906,19 @@ static void show_sessions(void) {
   wrefresh(stdscr);
 }
 
-static void toggle_mode(void) {
+static void toggle_mode(unsigned int mode) {
   static unsigned int cached_mode = 0;
 
   if (cached_mode == 0)
     cached_mode = display_mode;
 
-  if (display_mode != FTPTOP_SHOW_RATES) {
-    display_mode = FTPTOP_SHOW_RATES;
+  if (display_mode != mode) {
+    if (display_mode != FTPTOP_SHOW_RATES &&
+        display_mode != FTPTOP_SHOW_SUMMARY) {
+      cached_mode = display_mode;
+    }
+
+    display_mode = mode;
 
   } else {
     display_mode = cached_mode;
@@ -654,7 +943,8 @@ static void usage(void) {
   fprintf(stdout, "\t-V      \t\tshows version\n");
   fprintf(stdout, "\n");
   fprintf(stdout, "  Use the 't' key to toggle between \"regular\" and \"transfer speed\"\n");
-  fprintf(stdout, "  display modes. Use the 'q' key to quit.\n\n");
+  fprintf(stdout, "  display modes, and the 's' key to toggle the \"summary\" display\n");
+  fprintf(stdout, "  mode. Use the 'q' key to quit.\n\n");
   exit(0);
 }
 
@@ -700,11 +990,14 @@ int main(int argc, char *argv[]) {
   for (;;) {
     int c = -1;
 
+    /* The summary display is refreshed every second. */
+    int refresh_delay = display_mode == FTPTOP_SHOW_SUMMARY ? 1 : delay;
+
 #ifdef HAVE_NCURSES
-    if (halfdelay(delay * 10) != ERR)
+    if (halfdelay(refresh_delay * 10) != ERR)
       c = getch();
 #else
-    sleep(delay);
+    sleep(refresh_delay);
     c = getch();
 #endif
 
@@ -714,7 +1007,11 @@ int main(int argc, char *argv[]) {
       }
 
       if (tolower(c) == 't') {
-        toggle_mode();
+        toggle_mode(FTPTOP_SHOW_RATES);
+      }
+
+      if (tolower(c) == 's') {
+        toggle_mode(FTPTOP_SHOW_SUMMARY);
       }
     }
 
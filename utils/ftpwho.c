@@ -359,7 +359,7 @@ int main(int argc, char **argv) {
   int c = 0, res = 0;
   char *server_name = NULL;
   struct scoreboard_class classes[MAX_CLASSES];
-  char *cp, *progname = *argv;
+  char *cp, *mutex_path, *progname = *argv;
   const char *cmdopts = "S:c:f:ho:v";
   unsigned char verbose = FALSE;
   unsigned long outform = 0;
@@ -444,6 +444,15 @@ int main(int argc, char **argv) {
     }
   }
 
+  /* The ScoreboardMutex holds the sequence counters needed for reading the
+   * scoreboard without locks.
+   */
+  mutex_path = util_scan_config(config_filename, "ScoreboardMutex");
+  if (mutex_path != NULL) {
+    util_set_scoreboard_mutex(mutex_path);
+    free(mutex_path);
+  }
+
   res = util_open_scoreboard(O_RDONLY);
   if (res < 0) {
     switch (res) {
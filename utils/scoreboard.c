@@ -26,13 +26,39 @@
 
 #include "utils.h"
 
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+
 static int util_scoreboard_fd = -1;
 static char util_scoreboard_file[PR_TUNABLE_PATH_MAX] = PR_RUN_DIR "/proftpd.scoreboard";
+static char util_scoreboard_mutex[PR_TUNABLE_PATH_MAX] = PR_RUN_DIR "/proftpd.scoreboard.lck";
 
 static pr_scoreboard_header_t util_header;
 
 static unsigned char util_scoreboard_read_locked = FALSE;
 
+/* When possible, util_scoreboard_entry_read() returns the entries from a
+ * snapshot of the scoreboard, copied all at once from a read-only mapping
+ * of the ScoreboardFile, rather than reading the file entry by entry under
+ * a lock.  The snapshot needs the sequence counters which the daemon keeps
+ * in the ScoreboardMutex file; without them, the file is read as usual.
+ */
+static pr_scoreboard_entry_t *util_snapshot = NULL;
+static unsigned int util_snapshot_nentries = 0;
+static unsigned int util_snapshot_idx = 0;
+static unsigned char util_snapshot_taken = FALSE;
+static unsigned char util_snapshot_tried = FALSE;
+
+/* Max number of attempts for copying a changing entry */
+#define UTIL_SNAPSHOT_MAX_READ_ATTEMPTS	1000
+
+#if defined(__GNUC__)
+# define UTIL_BARRIER()		__sync_synchronize()
+#else
+# define UTIL_BARRIER()
+#endif
+
 /* Internal routines
  */
 
@@ -114,10 +140,182 @@ static int unlock_scoreboard(void) {
   return 0;
 }
 
+#ifdef HAVE_SYS_MMAN_H
+/* Map the sequence counters which the daemon keeps, in the ScoreboardMutex
+ * file, for each entry.  Returns NULL if the mutex file cannot be read, or
+ * does not (yet) have counters for all of the entries.
+ */
+static volatile uint32_t *map_seqs(unsigned int nslots, size_t *seqssz) {
+  struct stat st;
+  void *seqs;
+  int fd;
+
+  fd = open(util_scoreboard_mutex, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  *seqssz = nslots * sizeof(uint32_t);
+  if (fstat(fd, &st) < 0 ||
+      (size_t) st.st_size < *seqssz ||
+      *seqssz == 0) {
+    (void) close(fd);
+    return NULL;
+  }
+
+  seqs = mmap(NULL, *seqssz, PROT_READ, MAP_SHARED, fd, 0);
+  (void) close(fd);
+
+  if (seqs == MAP_FAILED) {
+    return NULL;
+  }
+
+  return seqs;
+}
+
+static void copy_entry(const pr_scoreboard_entry_t *slot,
+    volatile uint32_t *seq, pr_scoreboard_entry_t *sce) {
+  register unsigned int i;
+
+  for (i = 0; i < UTIL_SNAPSHOT_MAX_READ_ATTEMPTS; i++) {
+    uint32_t val;
+
+    val = *seq;
+    if (val & 1) {
+      continue;
+    }
+
+    UTIL_BARRIER();
+    memcpy(sce, slot, sizeof(pr_scoreboard_entry_t));
+    UTIL_BARRIER();
+
+    if (*seq == val) {
+      return;
+    }
+  }
+
+  memcpy(sce, slot, sizeof(pr_scoreboard_entry_t));
+}
+#endif /* HAVE_SYS_MMAN_H */
+
+static void free_snapshot(void) {
+  if (util_snapshot != NULL) {
+    free(util_snapshot);
+    util_snapshot = NULL;
+  }
+
+  util_snapshot_nentries = util_snapshot_idx = 0;
+  util_snapshot_taken = util_snapshot_tried = FALSE;
+}
+
 /* Public routines
  */
 
+int util_scoreboard_snapshot(pr_scoreboard_entry_t **entries,
+    unsigned int *nentries) {
+#ifdef HAVE_SYS_MMAN_H
+  register unsigned int i;
+  struct stat st;
+  unsigned int nslots;
+  size_t datasz, seqssz = 0;
+  char *data;
+  volatile uint32_t *seqs;
+
+  if (util_scoreboard_fd < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (util_snapshot_taken) {
+    *entries = util_snapshot;
+    *nentries = util_snapshot_nentries;
+    return 0;
+  }
+
+  if (fstat(util_scoreboard_fd, &st) < 0) {
+    return -1;
+  }
+
+  if (st.st_size <= (off_t) sizeof(pr_scoreboard_header_t)) {
+    nslots = 0;
+
+  } else {
+    nslots = (st.st_size - sizeof(pr_scoreboard_header_t)) /
+      sizeof(pr_scoreboard_entry_t);
+  }
+
+  if (nslots == 0) {
+    util_snapshot_taken = TRUE;
+    util_snapshot_nentries = 0;
+
+    *entries = NULL;
+    *nentries = 0;
+    return 0;
+  }
+
+  seqs = map_seqs(nslots, &seqssz);
+  if (seqs == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  datasz = sizeof(pr_scoreboard_header_t) +
+    (nslots * sizeof(pr_scoreboard_entry_t));
+  data = mmap(NULL, datasz, PROT_READ, MAP_SHARED, util_scoreboard_fd, 0);
+  if (data == MAP_FAILED) {
+    int xerrno = errno;
+
+    (void) munmap((void *) seqs, seqssz);
+    errno = xerrno;
+    return -1;
+  }
+
+  util_snapshot = calloc(nslots, sizeof(pr_scoreboard_entry_t));
+  if (util_snapshot == NULL) {
+    (void) munmap(data, datasz);
+    (void) munmap((void *) seqs, seqssz);
+    errno = ENOMEM;
+    return -1;
+  }
+
+  util_snapshot_taken = TRUE;
+  util_snapshot_nentries = 0;
+
+  for (i = 0; i < nslots; i++) {
+    const pr_scoreboard_entry_t *slot;
+    pr_scoreboard_entry_t *sce;
+
+    slot = (const pr_scoreboard_entry_t *) (data +
+      sizeof(pr_scoreboard_header_t) + (i * sizeof(pr_scoreboard_entry_t)));
+
+    /* Unused slots need not be copied. */
+    if (slot->sce_pid == 0) {
+      continue;
+    }
+
+    sce = &(util_snapshot[util_snapshot_nentries]);
+    copy_entry(slot, &(seqs[i]), sce);
+
+    if (sce->sce_pid != 0) {
+      util_snapshot_nentries++;
+    }
+  }
+
+  (void) munmap((void *) seqs, seqssz);
+  (void) munmap(data, datasz);
+
+  *entries = util_snapshot;
+  *nentries = util_snapshot_nentries;
+  return 0;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif /* HAVE_SYS_MMAN_H */
+}
+
 int util_close_scoreboard(void) {
+  free_snapshot();
+
   if (util_scoreboard_fd == -1)
     return 0;
 
@@ -135,6 +333,10 @@ const char *util_get_scoreboard(void) {
   return util_scoreboard_file;
 }
 
+const char *util_get_scoreboard_mutex(void) {
+  return util_scoreboard_mutex;
+}
+
 int util_open_scoreboard(int flags) {
   int res;
   struct stat st;
@@ -144,6 +346,8 @@ int util_open_scoreboard(int flags) {
    * If so, close the file and error out.  If not, truncate as necessary,
    * and continue.
    */
+  free_snapshot();
+
   util_scoreboard_fd = open(util_scoreboard_file, flags);
   if (util_scoreboard_fd < 0)
     return -1;
@@ -204,6 +408,24 @@ int util_set_scoreboard(const char *path) {
     return -1;
 
   util_sstrncpy(util_scoreboard_file, path, sizeof(util_scoreboard_file));
+
+  /* As for the daemon, the ScoreboardMutex defaults to the ScoreboardFile
+   * with a ".lck" suffix.
+   */
+  util_sstrncpy(util_scoreboard_mutex, path, sizeof(util_scoreboard_mutex));
+  strncat(util_scoreboard_mutex, ".lck",
+    sizeof(util_scoreboard_mutex) - strlen(util_scoreboard_mutex) - 1);
+
+  return 0;
+}
+
+int util_set_scoreboard_mutex(const char *path) {
+  if (path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  util_sstrncpy(util_scoreboard_mutex, path, sizeof(util_scoreboard_mutex));
   return 0;
 }
 
@@ -224,6 +446,27 @@ pr_scoreboard_entry_t *util_scoreboard_entry_read(void) {
     return NULL;
   }
 
+  if (!util_snapshot_tried) {
+    pr_scoreboard_entry_t *entries;
+    unsigned int nentries;
+
+    util_snapshot_tried = TRUE;
+    (void) util_scoreboard_snapshot(&entries, &nentries);
+  }
+
+  if (util_snapshot_taken) {
+    errno = 0;
+
+    if (util_snapshot_idx == util_snapshot_nentries) {
+      return NULL;
+    }
+
+    /* Hand out a copy, as callers may modify the entry for display. */
+    memcpy(&scan_entry, &(util_snapshot[util_snapshot_idx++]),
+      sizeof(scan_entry));
+    return &scan_entry;
+  }
+
   /* Make sure the scoreboard file is read-locked. */
   if (!util_scoreboard_read_locked)
     rlock_scoreboard();
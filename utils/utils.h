@@ -153,6 +153,12 @@ char *util_sstrncpy(char *, const char *, size_t);
 const char *util_get_scoreboard(void);
 int util_set_scoreboard(const char *);
 
+/* Setting the ScoreboardFile also sets the ScoreboardMutex, to the same
+ * path with a ".lck" suffix, as the daemon does.
+ */
+const char *util_get_scoreboard_mutex(void);
+int util_set_scoreboard_mutex(const char *);
+
 char *util_scan_config(const char *, const char *);
 
 int util_close_scoreboard(void);
@@ -160,6 +166,16 @@ int util_open_scoreboard(int);
 pid_t util_scoreboard_get_daemon_pid(void);
 time_t util_scoreboard_get_daemon_uptime(void);
 pr_scoreboard_entry_t *util_scoreboard_entry_read(void);
+
+/* Copies all of the in-use entries in the open scoreboard, at once and
+ * without taking any locks.  The copies remain valid until the scoreboard is
+ * closed; util_scoreboard_entry_read() returns the entries of this same
+ * snapshot.  Returns -1, with errno set to ENOENT, if the ScoreboardMutex
+ * does not have the daemon's sequence counters for the entries; the entries
+ * are then read from the file, under a lock, by util_scoreboard_entry_read().
+ */
+int util_scoreboard_snapshot(pr_scoreboard_entry_t **entries,
+  unsigned int *nentries);
 int util_scoreboard_scrub(int);
 
 #endif /* UTILS_UTILS_H */